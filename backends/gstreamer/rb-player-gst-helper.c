@@ -358,6 +358,73 @@ rb_gst_error_get_error_code (const GError *error)
 	}
 }
 
+/* position extrapolation */
+
+/* how long to extrapolate from a position sample before taking a new one */
+#define POSITION_SAMPLE_LIFETIME	(5 * G_USEC_PER_SEC)
+
+/**
+ * rb_gst_position_reset:
+ * @pos: position state
+ *
+ * Discards the current position sample, so the next estimate will fail.
+ * This should be called whenever playback position jumps or stops advancing
+ * at the normal rate, such as on seeks, pauses and track changes.
+ */
+void
+rb_gst_position_reset (RBGstPosition *pos)
+{
+	pos->position = -1;
+	pos->sample_time = 0;
+}
+
+/**
+ * rb_gst_position_update:
+ * @pos: position state
+ * @position: playback position queried from the pipeline, in nanoseconds
+ *
+ * Records a new position sample.
+ */
+void
+rb_gst_position_update (RBGstPosition *pos, gint64 position)
+{
+	if (position < 0) {
+		rb_gst_position_reset (pos);
+		return;
+	}
+
+	pos->position = position;
+	pos->sample_time = g_get_monotonic_time ();
+}
+
+/**
+ * rb_gst_position_estimate:
+ * @pos: position state
+ * @position: (out): returns the estimated playback position, in nanoseconds
+ *
+ * Estimates the current playback position by extrapolating from the last
+ * position sample using the monotonic clock, avoiding a position query on
+ * the pipeline.  Samples are only used for a few seconds so any drift between
+ * the system clock and the audio clock doesn't accumulate.
+ *
+ * Return value: %TRUE if an estimate is available, %FALSE if a new sample is required
+ */
+gboolean
+rb_gst_position_estimate (RBGstPosition *pos, gint64 *position)
+{
+	gint64 now;
+
+	if (pos->sample_time == 0)
+		return FALSE;
+
+	now = g_get_monotonic_time ();
+	if (now - pos->sample_time > POSITION_SAMPLE_LIFETIME)
+		return FALSE;
+
+	*position = pos->position + (now - pos->sample_time) * 1000;
+	return TRUE;
+}
+
 /* pipeline block-add/remove-unblock operations */
 static RBGstPipelineOp *
 new_pipeline_op (GObject *player, GstElement *fixture, GstElement *element)
@@ -51,6 +51,17 @@ gboolean	rb_gst_process_tag_string	(const GstTagList *taglist,
 
 int		rb_gst_error_get_error_code	(const GError *error);
 
+/* position extrapolation */
+
+typedef struct {
+	gint64 position;
+	gint64 sample_time;
+} RBGstPosition;
+
+void		rb_gst_position_reset		(RBGstPosition *pos);
+void		rb_gst_position_update		(RBGstPosition *pos, gint64 position);
+gboolean	rb_gst_position_estimate	(RBGstPosition *pos, gint64 *position);
+
 /* tee and filter support */
 
 GstElement *	rb_gst_create_filter_bin (void);
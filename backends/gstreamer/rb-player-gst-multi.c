@@ -35,11 +35,17 @@
  * operating on the assumption that the platform sound mechanism (usually a sound
  * server such as pipewire) will mix them appropriately.
  *
- * Each stream is a uridecodebin3 connected to any per-stream filters created
- * by plugins, then a volume element (used for crossfading and fade in/out on
- * pause/unpause) then an audio sink.  The RBPlayerGstFilter and
- * RBPlayerGstTee interfaces are not supported as they require the elements
- * added to the pipeline to persist, which isn't possible here.
+ * Each stream is a uridecodebin3, then a queue holding decoded audio, then a
+ * volume element (used for crossfading and fade in/out on pause/unpause),
+ * any per-stream filters created by plugins, then an audio sink.  The
+ * RBPlayerGstFilter and RBPlayerGstTee interfaces are not supported as they
+ * require the elements added to the pipeline to persist, which isn't possible
+ * here.
+ *
+ * The stream that is expected to be played next can be created ahead of time
+ * using rb_player_prepare (a lookahead stream).  It is paused once it has
+ * prerolled, so its queue fills up with decoded audio, and it is used when
+ * the same URI is opened.
  */
 
 #include <config.h>
@@ -57,6 +63,7 @@
 
 #include "rb-debug.h"
 #include "rb-util.h"
+#include "rb-file-helpers.h"
 
 #include "rb-player.h"
 #include "rb-player-gst-multi.h"
@@ -69,7 +76,6 @@ G_DEFINE_TYPE_WITH_CODE(RBPlayerGstMulti, rb_player_gst_multi, G_TYPE_OBJECT,
 			G_IMPLEMENT_INTERFACE(RB_TYPE_PLAYER, rb_player_init)
 			)
 
-#define RB_PLAYER_GST_TICK_HZ 5
 #define STATE_CHANGE_MESSAGE_TIMEOUT 5
 
 #define PAUSE_FADE_DURATION	(0.5 * GST_SECOND)
@@ -77,10 +83,16 @@ G_DEFINE_TYPE_WITH_CODE(RBPlayerGstMulti, rb_player_gst_multi, G_TYPE_OBJECT,
 #define EPSILON			(0.001)
 #define FADE_DONE_MESSAGE	"rb-fade-done"
 
+/* decoded audio queue limits for streams that aren't decoded ahead of time */
+#define QUEUE_MAX_BUFFERS	200
+#define QUEUE_MAX_BYTES		(10 * 1024 * 1024)
+#define QUEUE_MAX_TIME		GST_SECOND
+
 enum
 {
 	PROP_0,
-	PROP_BUS
+	PROP_BUS,
+	PROP_UNDERRUNS
 };
 
 enum
@@ -124,6 +136,7 @@ typedef struct _RBPlayerGstMultiStream
 	GstElement *volume;
 	GstElement *stream_sync;
 	GstElement *audioconvert;
+	GstElement *queue;
 	GstElement *audio_sink;
 
 	GMutex eos_lock;
@@ -144,6 +157,9 @@ typedef struct _RBPlayerGstMultiStream
 	gboolean emitted_image;
 	gboolean emitted_error;
 	gboolean finishing;
+	gboolean lookahead;
+	gboolean lookahead_failed;
+	gint queue_running;
 
 	GList *tags;
 
@@ -156,11 +172,15 @@ struct _RBPlayerGstMultiPrivate
 {
 	RBPlayerGstMultiStream *current;
 	RBPlayerGstMultiStream *next;
+	RBPlayerGstMultiStream *lookahead;
 	GList *previous;
+	gint underruns;
 
 	float cur_volume;
 
 	guint tick_timeout_id;
+	gboolean ticking;
+	RBGstPosition tick_position;
 	guint emit_stream_idle_id;
 };
 
@@ -239,7 +259,8 @@ reuse_stream (RBPlayerGstMultiStream *stream, RBPlayerGstMultiStream *next, gboo
 	next->stream_data = NULL;
 	next->stream_data_destroy = NULL;
 
-	destroy_stream (next);
+	/* next may have been decoded ahead of time */
+	stop_and_destroy_stream (next);
 }
 
 static void
@@ -373,7 +394,7 @@ actually_emit_stream_and_tags (RBPlayerGstMultiStream *stream)
 
 		tags = (GstTagList *)t->data;
 		rb_debug ("processing buffered taglist");
-		gst_tag_list_foreach (tags, (GstTagForeachFunc) process_tag, player);
+		gst_tag_list_foreach (tags, (GstTagForeachFunc) process_tag, stream);
 		gst_tag_list_free (tags);
 	}
 	g_list_free (stream->tags);
@@ -433,10 +454,22 @@ handle_missing_plugin_message (RBPlayerGstMultiStream *stream, GstMessage *messa
 static gboolean
 tick_timeout (RBPlayerGstMulti *player)
 {
+	gint64 pos;
+
 	if (player->priv->current && player->priv->current->playing) {
+		/* only query the pipeline every few seconds, except while
+		 * buffering, when the position isn't advancing
+		 */
+		if (player->priv->current->buffering) {
+			pos = rb_player_get_time (RB_PLAYER (player));
+		} else if (rb_gst_position_estimate (&player->priv->tick_position, &pos) == FALSE) {
+			pos = rb_player_get_time (RB_PLAYER (player));
+			rb_gst_position_update (&player->priv->tick_position, pos);
+		}
+
 		_rb_player_emit_tick (RB_PLAYER (player),
 				      player->priv->current->stream_data,
-				      rb_player_get_time (RB_PLAYER (player)),	/* stupid */
+				      pos,
 				      -1);
 	}
 	return TRUE;
@@ -445,17 +478,20 @@ tick_timeout (RBPlayerGstMulti *player)
 static void
 start_tick_timeout (RBPlayerGstMulti *player)
 {
+	rb_gst_position_reset (&player->priv->tick_position);
+	player->priv->ticking = TRUE;
 	if (player->priv->tick_timeout_id == 0) {
 		player->priv->tick_timeout_id =
-			g_timeout_add (1000 / RB_PLAYER_GST_TICK_HZ,
-				       (GSourceFunc) tick_timeout,
-				       player);
+			_rb_player_add_tick_timeout (RB_PLAYER (player),
+						     (GSourceFunc) tick_timeout,
+						     player);
 	}
 }
 
 static void
 stop_tick_timeout (RBPlayerGstMulti *player)
 {
+	player->priv->ticking = FALSE;
 	if (player->priv->tick_timeout_id != 0) {
 		g_source_remove (player->priv->tick_timeout_id);
 		player->priv->tick_timeout_id = 0;
@@ -545,6 +581,25 @@ start_state_change (RBPlayerGstMultiStream *stream, GstState state, enum StateCh
 	}
 }
 
+/* lookahead streams may already be in the target state, in which case
+ * there won't be a state change message to finish the action.
+ */
+static void
+start_prepared_state_change (RBPlayerGstMultiStream *stream, GstState state, enum StateChangeAction action)
+{
+	GstState current;
+
+	if (stream->target_state == GST_STATE_VOID_PENDING &&
+	    gst_element_get_state (stream->pipeline, &current, NULL, 0) == GST_STATE_CHANGE_SUCCESS &&
+	    current == state) {
+		rb_debug ("stream %s already in state %s", stream->uri, gst_element_state_get_name (state));
+		stream->state_change_action = action;
+		state_change_finished (stream, NULL);
+	} else {
+		start_state_change (stream, state, action);
+	}
+}
+
 
 static void
 stream_volume_changed_cb (GObject *object, GParamSpec *pspec, RBPlayerGstMultiStream *stream)
@@ -746,12 +801,76 @@ message_from_sink (GstElement *sink, GstMessage *message)
 	return FALSE;
 }
 
+/* nothing is emitted for lookahead streams as they aren't associated with
+ * anything yet.  if something goes wrong, the stream is discarded when it
+ * is opened, and a new stream reports any errors then.
+ */
+static void
+handle_lookahead_message (RBPlayerGstMultiStream *stream, GstMessage *message)
+{
+	switch (GST_MESSAGE_TYPE (message)) {
+	case GST_MESSAGE_ERROR: {
+		char *debug = NULL;
+		GError *error = NULL;
+
+		gst_message_parse_error (message, &error, &debug);
+		rb_debug ("lookahead stream %s failed: %s (%s)", stream->uri, error->message, debug);
+		stream->lookahead_failed = TRUE;
+		g_error_free (error);
+		g_free (debug);
+		break;
+	}
+
+	case GST_MESSAGE_STATE_CHANGED: {
+		GstState oldstate;
+		GstState newstate;
+		GstState pending;
+		gst_message_parse_state_changed (message, &oldstate, &newstate, &pending);
+		if (GST_MESSAGE_SRC (message) == GST_OBJECT (stream->pipeline) && pending == GST_STATE_VOID_PENDING) {
+			rb_debug ("lookahead stream %s: pipeline reached state %s", stream->uri, gst_element_state_get_name (newstate));
+			state_change_finished (stream, NULL);
+		}
+		break;
+	}
+
+	case GST_MESSAGE_TAG: {
+		GstTagList *tags;
+
+		/* emitted when the stream starts playing */
+		gst_message_parse_tag (message, &tags);
+		stream->tags = g_list_append (stream->tags, tags);
+		break;
+	}
+
+	case GST_MESSAGE_BUFFERING:
+		/* buffering is only handled for playing streams */
+		rb_debug ("lookahead stream %s needs buffering", stream->uri);
+		stream->lookahead_failed = TRUE;
+		break;
+
+	case GST_MESSAGE_ELEMENT:
+		if (gst_is_missing_plugin_message (message)) {
+			rb_debug ("lookahead stream %s is missing plugins", stream->uri);
+			stream->lookahead_failed = TRUE;
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
 static gboolean
 bus_cb (GstBus *bus, GstMessage *message, RBPlayerGstMultiStream *stream)
 {
 	const GstStructure *structure;
 	const char *name;
 
+	if (stream->lookahead) {
+		handle_lookahead_message (stream, message);
+		return TRUE;
+	}
+
 	switch (GST_MESSAGE_TYPE (message)) {
 	case GST_MESSAGE_ERROR: {
 		char *debug = NULL;
@@ -833,6 +952,14 @@ bus_cb (GstBus *bus, GstMessage *message, RBPlayerGstMultiStream *stream)
 			reused_stream (stream);
 			emit_playing_stream_and_tags (stream);
 			g_free (old_uri);
+		} else if (stream == stream->player->priv->current &&
+			   stream->player->priv->next != NULL &&
+			   stream->player->priv->next->playing &&
+			   stream->player->priv->next->pipeline != NULL) {
+			RBPlayerGstMultiStream *next = stream->player->priv->next;
+
+			rb_debug ("stream %s ended, starting %s", stream->uri, next->uri);
+			start_prepared_state_change (next, GST_STATE_PAUSED, START_NEXT_STREAM);
 		} else {
 			_rb_player_emit_eos (RB_PLAYER (stream->player), stream->stream_data, FALSE);
 		}
@@ -882,6 +1009,8 @@ bus_cb (GstBus *bus, GstMessage *message, RBPlayerGstMultiStream *stream)
 
 		if (progress >= 100) {
 			stream->buffering = FALSE;
+			if (stream == stream->player->priv->current)
+				rb_gst_position_reset (&stream->player->priv->tick_position);
 			if (stream->playing) {
 				if (stream->target_state != GST_STATE_PAUSED) {
 					rb_debug ("stream %s: buffering done, setting pipeline back to PLAYING", stream->uri);
@@ -901,6 +1030,8 @@ bus_cb (GstBus *bus, GstMessage *message, RBPlayerGstMultiStream *stream)
 				rb_debug ("stream %s buffering while prerolling", stream->uri);
 			}
 			stream->buffering = TRUE;
+			if (stream == stream->player->priv->current)
+				rb_gst_position_reset (&stream->player->priv->tick_position);
 		}
 
 		_rb_player_emit_buffering (RB_PLAYER (stream->player), stream->stream_data, progress);
@@ -1023,6 +1154,27 @@ stream_pad_added_cb (GstElement *decoder, GstPad *pad, RBPlayerGstMultiStream *s
 	gst_caps_unref (caps);
 }
 
+/* called on a streaming thread when the decoded audio queue runs dry.
+ * this also happens while prerolling and after seeking, so only count
+ * it if the queue has been running since then.
+ */
+static void
+queue_underrun_cb (GstElement *queue, RBPlayerGstMultiStream *stream)
+{
+	if (g_atomic_int_compare_and_exchange (&stream->queue_running, TRUE, FALSE) &&
+	    stream->playing &&
+	    stream->buffering == FALSE) {
+		int underruns = g_atomic_int_add (&stream->player->priv->underruns, 1) + 1;
+		rb_debug ("stream %s underrun (%d so far)", stream->uri, underruns);
+	}
+}
+
+static void
+queue_running_cb (GstElement *queue, RBPlayerGstMultiStream *stream)
+{
+	g_atomic_int_set (&stream->queue_running, TRUE);
+}
+
 static gboolean
 construct_pipeline (RBPlayerGstMultiStream *stream, GError **error)
 {
@@ -1107,6 +1259,29 @@ construct_pipeline (RBPlayerGstMultiStream *stream, GError **error)
 		return FALSE;
 	}
 
+	stream->queue = gst_element_factory_make ("queue", NULL);
+	if (stream->queue == NULL) {
+		g_set_error (error,
+			     RB_PLAYER_ERROR,
+			     RB_PLAYER_ERROR_GENERAL,
+			     _("Failed to create %s element; check your GStreamer installation"),
+			     "queue");
+		return FALSE;
+	}
+	g_object_set (stream->queue,
+		      "max-size-buffers", QUEUE_MAX_BUFFERS,
+		      "max-size-bytes", QUEUE_MAX_BYTES,
+		      "max-size-time", (guint64) QUEUE_MAX_TIME,
+		      NULL);
+	g_signal_connect (G_OBJECT (stream->queue),
+			  "underrun",
+			  G_CALLBACK (queue_underrun_cb),
+			  stream);
+	g_signal_connect (G_OBJECT (stream->queue),
+			  "running",
+			  G_CALLBACK (queue_running_cb),
+			  stream);
+
 	stream->volume = gst_element_factory_make ("volume", NULL);
 	if (stream->volume == NULL) {
 		g_set_error (error,
@@ -1131,10 +1306,11 @@ construct_pipeline (RBPlayerGstMultiStream *stream, GError **error)
 			  stream->uridecodebin,
 			  stream->stream_sync,
 			  stream->audioconvert,
+			  stream->queue,
 			  stream->volume,
 			  stream->audio_sink,
 			  NULL);
-	gst_element_link (stream->audioconvert, stream->volume);
+	gst_element_link_many (stream->audioconvert, stream->queue, stream->volume, NULL);
 
 	/* link in any per-stream filters */
 	tail = stream->volume;
@@ -1175,6 +1351,9 @@ impl_close (RBPlayer *rbp, const char *uri, GError **error)
 
 	stop_tick_timeout (player);
 
+	if (uri == NULL)
+		g_clear_pointer (&player->priv->lookahead, stop_and_destroy_stream);
+
 	if (stream != NULL) {
 		stream->playing = FALSE;
 		stop_and_destroy_stream (stream);
@@ -1183,6 +1362,90 @@ impl_close (RBPlayer *rbp, const char *uri, GError **error)
 	return TRUE;
 }
 
+/*
+ * takes the lookahead stream if it's for the uri being opened and is still
+ * usable, resetting its queue limits so it plays like any other stream.
+ * any other lookahead stream is discarded.
+ */
+static RBPlayerGstMultiStream *
+take_lookahead_stream (RBPlayerGstMulti *player, const char *uri)
+{
+	RBPlayerGstMultiStream *stream;
+
+	stream = player->priv->lookahead;
+	if (stream == NULL)
+		return NULL;
+	player->priv->lookahead = NULL;
+
+	if (stream->lookahead_failed || strcmp (stream->uri, uri) != 0) {
+		rb_debug ("discarding lookahead stream %s", stream->uri);
+		stop_and_destroy_stream (stream);
+		return NULL;
+	}
+
+	rb_debug ("setting next stream %s, decoded ahead of time", uri);
+	stream->lookahead = FALSE;
+	g_object_set (stream->queue,
+		      "max-size-buffers", QUEUE_MAX_BUFFERS,
+		      "max-size-bytes", QUEUE_MAX_BYTES,
+		      "max-size-time", (guint64) QUEUE_MAX_TIME,
+		      NULL);
+	return stream;
+}
+
+static gboolean
+impl_prepare (RBPlayer *rbp,
+	      const char *uri,
+	      gint64 lookahead,
+	      guint64 max_size,
+	      GError **error)
+{
+	RBPlayerGstMulti *player = RB_PLAYER_GST_MULTI (rbp);
+	RBPlayerGstMultiStream *stream;
+
+	if (player->priv->lookahead != NULL) {
+		if (strcmp (player->priv->lookahead->uri, uri) == 0) {
+			rb_debug ("already decoding %s ahead of time", uri);
+			return TRUE;
+		}
+
+		rb_debug ("discarding lookahead stream %s", player->priv->lookahead->uri);
+		g_clear_pointer (&player->priv->lookahead, stop_and_destroy_stream);
+	}
+
+	/* network streams have their own buffering */
+	if (rb_uri_is_local (uri) == FALSE) {
+		rb_debug ("not decoding %s ahead of time", uri);
+		return FALSE;
+	}
+
+	stream = g_new0 (RBPlayerGstMultiStream, 1);
+	stream->player = player;
+	stream->uri = g_strdup (uri);
+	stream->lookahead = TRUE;
+	if (construct_pipeline (stream, error) == FALSE) {
+		destroy_stream (stream);
+		return FALSE;
+	}
+
+	/* the queue needs to hold at least as much as it normally would */
+	lookahead = MAX (lookahead, QUEUE_MAX_TIME);
+	max_size = CLAMP (max_size, QUEUE_MAX_BYTES, G_MAXUINT);
+
+	rb_debug ("decoding %" G_GINT64_FORMAT " ns (up to %" G_GUINT64_FORMAT " bytes) of %s ahead of time",
+		  lookahead, max_size, uri);
+	g_object_set (stream->queue,
+		      "max-size-buffers", 0,
+		      "max-size-bytes", (guint) max_size,
+		      "max-size-time", (guint64) lookahead,
+		      NULL);
+
+	/* once the sink has prerolled, the queue fills up with decoded audio */
+	player->priv->lookahead = stream;
+	start_state_change (stream, GST_STATE_PAUSED, DO_NOTHING);
+	return TRUE;
+}
+
 static gboolean
 impl_open (RBPlayer *rbp,
 	   const char *uri,
@@ -1199,10 +1462,13 @@ impl_open (RBPlayer *rbp,
 
 	g_clear_pointer (&player->priv->next, stop_and_destroy_stream);
 
-	rb_debug ("setting next stream %s", uri);
-	stream = g_new0 (RBPlayerGstMultiStream, 1);
-	stream->player = player;
-	stream->uri = g_strdup (uri);
+	stream = take_lookahead_stream (player, uri);
+	if (stream == NULL) {
+		rb_debug ("setting next stream %s", uri);
+		stream = g_new0 (RBPlayerGstMultiStream, 1);
+		stream->player = player;
+		stream->uri = g_strdup (uri);
+	}
 	stream->stream_data = stream_data;
 	stream->stream_data_destroy = stream_data_destroy;
 	player->priv->next = stream;
@@ -1255,6 +1521,12 @@ impl_play (RBPlayer *rbp, RBPlayerPlayType play_type, gint64 crossfade, GError *
 			break;
 		}
 
+		if (next->pipeline != NULL) {
+			/* decoded ahead of time, so start it when the current stream ends */
+			rb_debug ("will start %s when %s ends", next->uri, current->uri);
+			return TRUE;
+		}
+
 		rb_debug ("will reuse current stream to play %s", next->uri);
 
 		reuse_stream (current, next, TRUE);
@@ -1277,7 +1549,7 @@ impl_play (RBPlayer *rbp, RBPlayerPlayType play_type, gint64 crossfade, GError *
 		g_assert_not_reached ();
 	}
 
-	if (current != NULL) {
+	if (current != NULL && next->pipeline == NULL) {
 		/* try to reuse the current stream */
 		gboolean reused = FALSE;
 		g_signal_emit (player, signals[CAN_REUSE_STREAM], 0, next->uri, current->uri, GST_ELEMENT (current->pipeline), &reused);
@@ -1293,25 +1565,26 @@ impl_play (RBPlayer *rbp, RBPlayerPlayType play_type, gint64 crossfade, GError *
 		}
 	}
 
-	if (construct_pipeline (next, error) == FALSE) {
+	/* streams decoded ahead of time already have a pipeline */
+	if (next->pipeline == NULL && construct_pipeline (next, error) == FALSE) {
 		return FALSE;
 	}
 
 	if (current == NULL) {
 		/* not much else we can do */
 		gst_timed_value_control_source_set (GST_TIMED_VALUE_CONTROL_SOURCE (next->fader), 0, 0.1);
-		start_state_change (next, GST_STATE_PLAYING, FINISH_TRACK_CHANGE);
+		start_prepared_state_change (next, GST_STATE_PLAYING, FINISH_TRACK_CHANGE);
 	} else if (current->playing) {
 
 		switch (play_type) {
 		case RB_PLAYER_PLAY_REPLACE:
-			start_state_change (next, GST_STATE_PAUSED, START_NEXT_STREAM);
+			start_prepared_state_change (next, GST_STATE_PAUSED, START_NEXT_STREAM);
 			break;
 
 		case RB_PLAYER_PLAY_CROSSFADE:
 			current->crossfade = crossfade;
 			next->crossfade = crossfade;
-			start_state_change (next, GST_STATE_PLAYING, START_CROSSFADE);
+			start_prepared_state_change (next, GST_STATE_PLAYING, START_CROSSFADE);
 			break;
 
 		case RB_PLAYER_PLAY_AFTER_EOS:
@@ -1320,7 +1593,7 @@ impl_play (RBPlayer *rbp, RBPlayerPlayType play_type, gint64 crossfade, GError *
 		}
 	} else {
 		/* can't crossfade or wait for eos, so we just have to start the new stream */
-		start_state_change (next, GST_STATE_PAUSED, START_NEXT_STREAM);
+		start_prepared_state_change (next, GST_STATE_PAUSED, START_NEXT_STREAM);
 	}
 
 	g_object_notify (G_OBJECT (player), "bus");
@@ -1425,12 +1698,25 @@ impl_set_time (RBPlayer *rbp, gint64 time)
 	stream = player->priv->current;
 	if (stream) {
 		rb_debug ("seeking to %" G_GINT64_FORMAT, time);
+		g_atomic_int_set (&stream->queue_running, FALSE);
 		gst_element_seek (stream->pipeline, 1.0,
 				  GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH,
 				  GST_SEEK_TYPE_SET, time,
 				  GST_SEEK_TYPE_NONE, -1);
 
 		gst_element_get_state (stream->pipeline, NULL, NULL, 100 * GST_MSECOND);
+		rb_gst_position_reset (&player->priv->tick_position);
+	}
+}
+
+static void
+impl_tick_interval_changed (RBPlayer *rbp)
+{
+	RBPlayerGstMulti *player = RB_PLAYER_GST_MULTI (rbp);
+
+	if (player->priv->ticking) {
+		stop_tick_timeout (player);
+		start_tick_timeout (player);
 	}
 }
 
@@ -1483,6 +1769,9 @@ impl_get_property (GObject *object,
 			gst_object_unref (bus);
 		}
 		break;
+	case PROP_UNDERRUNS:
+		g_value_set_uint (value, g_atomic_int_get (&player->priv->underruns));
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -1518,6 +1807,8 @@ impl_dispose (GObject *object)
 		player->priv->emit_stream_idle_id = 0;
 	}
 
+	g_clear_pointer (&player->priv->lookahead, stop_and_destroy_stream);
+
 	g_list_free_full (player->priv->previous, (GDestroyNotify) destroy_stream);
 	if (player->priv->current != NULL) {
 		/* make sure we're in NULL state? */
@@ -1542,6 +1833,8 @@ rb_player_init (RBPlayerIface *iface)
 	iface->set_time = impl_set_time;
 	iface->get_time = impl_get_time;
 	iface->multiple_open = (RBPlayerFeatureFunc) rb_true_function;
+	iface->tick_interval_changed = impl_tick_interval_changed;
+	iface->prepare = impl_prepare;
 }
 
 static void
@@ -1560,6 +1853,19 @@ rb_player_gst_multi_class_init (RBPlayerGstMultiClass *klass)
 							      "GStreamer message bus",
 							      GST_TYPE_BUS,
 							      G_PARAM_READABLE));
+	/**
+	 * RBPlayerGstMulti:underruns:
+	 *
+	 * Number of times playback has stalled because no decoded audio
+	 * was available.
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_UNDERRUNS,
+					 g_param_spec_uint ("underruns",
+							    "underruns",
+							    "number of playback underruns",
+							    0, G_MAXUINT, 0,
+							    G_PARAM_READABLE));
 
 	signals[PREPARE_SOURCE] =
 		g_signal_new ("prepare-source",
@@ -57,7 +57,6 @@ G_DEFINE_TYPE_WITH_CODE(RBPlayerGst, rb_player_gst, G_TYPE_OBJECT,
 			G_IMPLEMENT_INTERFACE(RB_TYPE_PLAYER_GST_FILTER, rb_player_gst_filter_init)
 			)
 
-#define RB_PLAYER_GST_TICK_HZ 5
 #define STATE_CHANGE_MESSAGE_TIMEOUT 5
 
 enum
@@ -117,6 +116,8 @@ struct _RBPlayerGstPrivate
 	float cur_volume;
 
 	guint tick_timeout_id;
+	gboolean ticking;
+	RBGstPosition tick_position;
 	guint emit_stream_idle_id;
 
 	GList *waiting_filters; /* in reverse order */
@@ -316,15 +317,50 @@ handle_missing_plugin_message (RBPlayerGst *player, GstMessage *message)
 static gboolean
 tick_timeout (RBPlayerGst *mp)
 {
+	gint64 pos;
+
 	if (mp->priv->playing) {
+		/* only query the pipeline every few seconds, except while
+		 * buffering, when the position isn't advancing
+		 */
+		if (mp->priv->buffering) {
+			pos = rb_player_get_time (RB_PLAYER (mp));
+		} else if (rb_gst_position_estimate (&mp->priv->tick_position, &pos) == FALSE) {
+			pos = rb_player_get_time (RB_PLAYER (mp));
+			rb_gst_position_update (&mp->priv->tick_position, pos);
+		}
+
 		_rb_player_emit_tick (RB_PLAYER (mp),
 				      mp->priv->stream_data,
-				      rb_player_get_time (RB_PLAYER (mp)),
+				      pos,
 				      -1);
 	}
 	return TRUE;
 }
 
+static void
+start_tick_timeout (RBPlayerGst *mp)
+{
+	rb_gst_position_reset (&mp->priv->tick_position);
+	mp->priv->ticking = TRUE;
+	if (mp->priv->tick_timeout_id == 0) {
+		mp->priv->tick_timeout_id =
+			_rb_player_add_tick_timeout (RB_PLAYER (mp),
+						     (GSourceFunc) tick_timeout,
+						     mp);
+	}
+}
+
+static void
+stop_tick_timeout (RBPlayerGst *mp)
+{
+	mp->priv->ticking = FALSE;
+	if (mp->priv->tick_timeout_id != 0) {
+		g_source_remove (mp->priv->tick_timeout_id);
+		mp->priv->tick_timeout_id = 0;
+	}
+}
+
 static void
 set_playbin_volume (RBPlayerGst *player, float volume)
 {
@@ -361,12 +397,7 @@ track_change_done (RBPlayerGst *mp, GError *error)
 		emit_playing_stream_and_tags (mp, mp->priv->track_change);
 	}
 
-	if (mp->priv->tick_timeout_id == 0) {
-		mp->priv->tick_timeout_id =
-			g_timeout_add (1000 / RB_PLAYER_GST_TICK_HZ,
-				       (GSourceFunc) tick_timeout,
-				       mp);
-	}
+	start_tick_timeout (mp);
 
 	if (mp->priv->volume_applied == 0) {
 		GstElement *e;
@@ -444,10 +475,7 @@ state_change_finished (RBPlayerGst *mp, GError *error)
 		if (error != NULL) {
 			g_warning ("unable to pause playback: %s\n", error->message);
 		} else {
-			if (mp->priv->tick_timeout_id != 0) {
-				g_source_remove (mp->priv->tick_timeout_id);
-				mp->priv->tick_timeout_id = 0;
-			}
+			stop_tick_timeout (mp);
 		}
 		break;
 
@@ -599,6 +627,7 @@ bus_cb (GstBus *bus, GstMessage *message, RBPlayerGst *mp)
 
 		if (progress >= 100) {
 			mp->priv->buffering = FALSE;
+			rb_gst_position_reset (&mp->priv->tick_position);
 			if (mp->priv->playing) {
 				rb_debug ("buffering done, setting pipeline back to PLAYING");
 				gst_element_set_state (mp->priv->playbin, GST_STATE_PLAYING);
@@ -610,6 +639,7 @@ bus_cb (GstBus *bus, GstMessage *message, RBPlayerGst *mp)
 			rb_debug ("buffering - temporarily pausing playback");
 			gst_element_set_state (mp->priv->playbin, GST_STATE_PAUSED);
 			mp->priv->buffering = TRUE;
+			rb_gst_position_reset (&mp->priv->tick_position);
 		}
 
 		_rb_player_emit_buffering (RB_PLAYER (mp), mp->priv->stream_data, progress);
@@ -625,6 +655,10 @@ bus_cb (GstBus *bus, GstMessage *message, RBPlayerGst *mp)
 		if (mp->priv->playbin_stream_changing) {
 			rb_debug ("got STREAM_START message");
 			mp->priv->playbin_stream_changing = FALSE;
+			/* in gapless mode, the previous track was still playing when the
+			 * tick timer was restarted, so the position sample belongs to it.
+			 */
+			rb_gst_position_reset (&mp->priv->tick_position);
 			emit_playing_stream_and_tags (mp, TRUE);
 		}
 		break;
@@ -760,10 +794,7 @@ impl_close (RBPlayer *player, const char *uri, GError **error)
 	mp->priv->uri = NULL;
 	mp->priv->prev_uri = NULL;
 
-	if (mp->priv->tick_timeout_id != 0) {
-		g_source_remove (mp->priv->tick_timeout_id);
-		mp->priv->tick_timeout_id = 0;
-	}
+	stop_tick_timeout (mp);
 
 	if (mp->priv->playbin != NULL) {
 		start_state_change (mp, GST_STATE_NULL, PLAYER_SHUTDOWN);
@@ -958,6 +989,18 @@ impl_set_time (RBPlayer *player, gint64 time)
 			  GST_SEEK_TYPE_NONE, -1);
 
 	gst_element_get_state (mp->priv->playbin, NULL, NULL, 100 * GST_MSECOND);
+	rb_gst_position_reset (&mp->priv->tick_position);
+}
+
+static void
+impl_tick_interval_changed (RBPlayer *player)
+{
+	RBPlayerGst *mp = RB_PLAYER_GST (player);
+
+	if (mp->priv->ticking) {
+		stop_tick_timeout (mp);
+		start_tick_timeout (mp);
+	}
 }
 
 static gint64
@@ -1083,10 +1126,7 @@ impl_dispose (GObject *object)
 
 	mp = RB_PLAYER_GST (object);
 
-	if (mp->priv->tick_timeout_id != 0) {
-		g_source_remove (mp->priv->tick_timeout_id);
-		mp->priv->tick_timeout_id = 0;
-	}
+	stop_tick_timeout (mp);
 
 	if (mp->priv->emit_stream_idle_id != 0) {
 		g_source_remove (mp->priv->emit_stream_idle_id);
@@ -1124,6 +1164,7 @@ rb_player_init (RBPlayerIface *iface)
 	iface->set_time = impl_set_time;
 	iface->get_time = impl_get_time;
 	iface->multiple_open = (RBPlayerFeatureFunc) rb_false_function;
+	iface->tick_interval_changed = impl_tick_interval_changed;
 }
 
 static void
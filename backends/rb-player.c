@@ -31,6 +31,7 @@
 #include "rb-player-gst.h"
 #include "rb-player-gst-multi.h"
 #include "rb-util.h"
+#include "rb-debug.h"
 
 /**
  * RBPlayerPlayType:
@@ -174,6 +175,9 @@ rb_player_interface_init (RBPlayerIface *iface)
 	 * The 'tick' signal is emitted repeatedly while the stream is
 	 * playing. Signal handlers can use this to update UI and to
 	 * prepare new streams for crossfade or gapless playback.
+	 * It is only emitted while something has registered interest in it
+	 * using #rb_player_add_tick_subscriber, at the shortest interval
+	 * requested.
 	 **/
 	signals[TICK] =
 		g_signal_new ("tick",
@@ -566,6 +570,197 @@ rb_player_multiple_open (RBPlayer *player)
 		return FALSE;
 }
 
+/**
+ * rb_player_prepare:
+ * @player:	a #RBPlayer
+ * @uri:	URI of the stream that is likely to be opened next
+ * @lookahead:	amount of decoded audio to buffer, in nanoseconds
+ * @max_size:	maximum size of the decoded audio buffer, in bytes
+ * @error:	returns error information
+ *
+ * Hints that @uri is likely to be opened soon, allowing the player to start
+ * reading and decoding it ahead of time.  If the stream is then opened using
+ * #rb_player_open, playback can start from the buffered audio.  If it isn't,
+ * the prepared stream is discarded when something else is opened.
+ *
+ * Return value: TRUE if the player is preparing the stream, FALSE if the player
+ * doesn't support this or the stream couldn't be prepared.
+ */
+gboolean
+rb_player_prepare (RBPlayer *player, const char *uri, gint64 lookahead, guint64 max_size, GError **error)
+{
+	RBPlayerIface *iface = RB_PLAYER_GET_IFACE (player);
+
+	if (iface->prepare)
+		return iface->prepare (player, uri, lookahead, max_size, error);
+	else
+		return FALSE;
+}
+
+typedef struct {
+	guint id;
+	guint interval;
+} RBPlayerTickSubscriber;
+
+typedef struct {
+	GArray *subscribers;
+	guint next_id;
+	guint interval;
+} RBPlayerTickSubscriptions;
+
+static GQuark
+rb_player_tick_subscriptions_quark (void)
+{
+	static GQuark quark = 0;
+	if (!quark)
+		quark = g_quark_from_static_string ("rb_player_tick_subscriptions");
+
+	return quark;
+}
+
+static void
+free_tick_subscriptions (RBPlayerTickSubscriptions *subs)
+{
+	g_array_free (subs->subscribers, TRUE);
+	g_free (subs);
+}
+
+static RBPlayerTickSubscriptions *
+get_tick_subscriptions (RBPlayer *player)
+{
+	RBPlayerTickSubscriptions *subs;
+
+	subs = g_object_get_qdata (G_OBJECT (player), rb_player_tick_subscriptions_quark ());
+	if (subs == NULL) {
+		subs = g_new0 (RBPlayerTickSubscriptions, 1);
+		subs->subscribers = g_array_new (FALSE, FALSE, sizeof (RBPlayerTickSubscriber));
+		subs->next_id = 1;
+		g_object_set_qdata_full (G_OBJECT (player),
+					 rb_player_tick_subscriptions_quark (),
+					 subs,
+					 (GDestroyNotify) free_tick_subscriptions);
+	}
+	return subs;
+}
+
+static void
+update_tick_interval (RBPlayer *player, RBPlayerTickSubscriptions *subs)
+{
+	RBPlayerIface *iface = RB_PLAYER_GET_IFACE (player);
+	guint interval = 0;
+	guint i;
+
+	for (i = 0; i < subs->subscribers->len; i++) {
+		RBPlayerTickSubscriber *sub = &g_array_index (subs->subscribers, RBPlayerTickSubscriber, i);
+		if (interval == 0 || sub->interval < interval)
+			interval = sub->interval;
+	}
+
+	if (interval == subs->interval)
+		return;
+
+	rb_debug ("tick interval changed from %u to %u ms", subs->interval, interval);
+	subs->interval = interval;
+	if (iface->tick_interval_changed)
+		iface->tick_interval_changed (player);
+}
+
+/**
+ * rb_player_add_tick_subscriber:
+ * @player:	a #RBPlayer
+ * @interval:	the longest acceptable time between ticks, in milliseconds
+ *
+ * Registers interest in the 'tick' signal.  The player emits ticks at the
+ * shortest interval requested by any subscriber, and not at all when there
+ * are no subscribers, so callers should ask for the coarsest interval they
+ * can live with and remove the subscription when they no longer need it.
+ *
+ * Return value: subscription ID, to be passed to #rb_player_remove_tick_subscriber
+ */
+guint
+rb_player_add_tick_subscriber (RBPlayer *player, guint interval)
+{
+	RBPlayerTickSubscriptions *subs;
+	RBPlayerTickSubscriber sub;
+
+	g_return_val_if_fail (interval > 0, 0);
+
+	subs = get_tick_subscriptions (player);
+	sub.id = subs->next_id++;
+	sub.interval = interval;
+	g_array_append_val (subs->subscribers, sub);
+
+	update_tick_interval (player, subs);
+	return sub.id;
+}
+
+/**
+ * rb_player_remove_tick_subscriber:
+ * @player:	a #RBPlayer
+ * @id:		subscription ID returned by #rb_player_add_tick_subscriber
+ *
+ * Removes a tick subscription.
+ */
+void
+rb_player_remove_tick_subscriber (RBPlayer *player, guint id)
+{
+	RBPlayerTickSubscriptions *subs;
+	guint i;
+
+	subs = get_tick_subscriptions (player);
+	for (i = 0; i < subs->subscribers->len; i++) {
+		if (g_array_index (subs->subscribers, RBPlayerTickSubscriber, i).id == id) {
+			g_array_remove_index_fast (subs->subscribers, i);
+			update_tick_interval (player, subs);
+			return;
+		}
+	}
+
+	g_warning ("unknown tick subscription %u", id);
+}
+
+/**
+ * rb_player_get_tick_interval:
+ * @player:	a #RBPlayer
+ *
+ * Returns the interval at which the player should emit ticks while playing,
+ * which is the shortest interval requested by any subscriber.
+ *
+ * Return value: tick interval in milliseconds, or 0 if there are no subscribers
+ */
+guint
+rb_player_get_tick_interval (RBPlayer *player)
+{
+	return get_tick_subscriptions (player)->interval;
+}
+
+/**
+ * _rb_player_add_tick_timeout:
+ * @player:	a #RBPlayer implementation
+ * @func:	function to call to emit a tick
+ * @data:	data to pass to @func
+ *
+ * Adds a timeout source to emit ticks at the current tick interval.
+ * Whole-second intervals use second-granularity timeouts so wakeups
+ * can be grouped with other timers.  To be used by implementations only.
+ *
+ * Return value: source ID, or 0 if no ticks are required
+ */
+guint
+_rb_player_add_tick_timeout (RBPlayer *player, GSourceFunc func, gpointer data)
+{
+	guint interval;
+
+	interval = rb_player_get_tick_interval (player);
+	if (interval == 0) {
+		return 0;
+	} else if (interval % 1000 == 0) {
+		return g_timeout_add_seconds (interval / 1000, func, data);
+	} else {
+		return g_timeout_add (interval, func, data);
+	}
+}
+
 /**
  * rb_player_new:
  * @want_crossfade: if TRUE, try to use a backend that supports
@@ -101,6 +101,12 @@ struct _RBPlayerIface
 						 gint64 newtime);
 	gint64		(*get_time)		(RBPlayer *player);
 	gboolean	(*multiple_open)	(RBPlayer *player);
+	gboolean	(*prepare)		(RBPlayer *player,
+						 const char *uri,
+						 gint64 lookahead,
+						 guint64 max_size,
+						 GError **error);
+	void		(*tick_interval_changed) (RBPlayer *player);
 
 
 	/* signals */
@@ -165,6 +171,15 @@ void		rb_player_set_time   (RBPlayer *player, gint64 newtime);
 gint64		rb_player_get_time   (RBPlayer *player);
 
 gboolean	rb_player_multiple_open (RBPlayer *player);
+gboolean	rb_player_prepare    (RBPlayer *player,
+				      const char *uri,
+				      gint64 lookahead,
+				      guint64 max_size,
+				      GError **error);
+
+guint		rb_player_add_tick_subscriber (RBPlayer *player, guint interval);
+void		rb_player_remove_tick_subscriber (RBPlayer *player, guint id);
+guint		rb_player_get_tick_interval (RBPlayer *player);
 
 /* only to be used by subclasses */
 void	_rb_player_emit_eos (RBPlayer *player, gpointer stream_data, gboolean early);
@@ -177,6 +192,7 @@ void	_rb_player_emit_playing_stream (RBPlayer *player, gpointer stream_data);
 void	_rb_player_emit_volume_changed (RBPlayer *player, float volume);
 void	_rb_player_emit_image (RBPlayer *player, gpointer stream_data, GdkPixbuf *image);
 void	_rb_player_emit_redirect (RBPlayer *player, gpointer stream_data, const char *uri);
+guint	_rb_player_add_tick_timeout (RBPlayer *player, GSourceFunc func, gpointer data);
 
 G_END_DECLS
 
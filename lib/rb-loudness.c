@@ -0,0 +1,420 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+/**
+ * SECTION:rbloudness
+ * @short_description: EBU R128 loudness measurement
+ *
+ * Measures the integrated loudness (as defined by ITU-R BS.1770 and EBU R128)
+ * and sample peak of a stream of interleaved float samples.  The K-weighted
+ * mean square is accumulated over 100ms sub-blocks, which are combined into
+ * 400ms gating blocks overlapping by 75%.  The gating blocks are kept rather
+ * than reduced to a single value, so the meters for the tracks on an album
+ * can be combined to measure the loudness of the whole album.
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <lib/rb-loudness.h>
+
+/* frames filtered in each pass over a channel */
+#define CHUNK_FRAMES		1024
+
+/* gating blocks are made up of four 100ms sub-blocks */
+#define SUBBLOCKS_PER_BLOCK	4
+
+#define ABSOLUTE_GATE		(-70.0)
+#define RELATIVE_GATE		(-10.0)
+
+typedef struct {
+	double b0, b1, b2;
+	double a1, a2;
+} Biquad;
+
+struct _RBLoudnessMeter
+{
+	guint rate;
+	guint channels;
+
+	Biquad shelf;
+	Biquad highpass;
+	double *state;		/* two values per filter stage for each channel */
+	double *weights;
+	double *scratch;
+
+	guint subblock_frames;
+	guint subblock_pos;
+	double subblock_sum;
+	double recent[SUBBLOCKS_PER_BLOCK - 1];
+	guint recent_count;
+
+	GArray *blocks;
+	float peak;
+};
+
+static void
+init_filters (RBLoudnessMeter *meter)
+{
+	double f0, G, Q, K, Vh, Vb, a0;
+
+	/* stage 1: high shelf modelling the acoustic effect of the head */
+	f0 = 1681.974450955533;
+	G = 3.999843853973347;
+	Q = 0.7071752369554196;
+	K = tan (G_PI * f0 / (double) meter->rate);
+	Vh = pow (10.0, G / 20.0);
+	Vb = pow (Vh, 0.4996667741545416);
+	a0 = 1.0 + K / Q + K * K;
+	meter->shelf.b0 = (Vh + Vb * K / Q + K * K) / a0;
+	meter->shelf.b1 = 2.0 * (K * K - Vh) / a0;
+	meter->shelf.b2 = (Vh - Vb * K / Q + K * K) / a0;
+	meter->shelf.a1 = 2.0 * (K * K - 1.0) / a0;
+	meter->shelf.a2 = (1.0 - K / Q + K * K) / a0;
+
+	/* stage 2: revised low-frequency B-weighting high pass */
+	f0 = 38.13547087602444;
+	Q = 0.5003270373238773;
+	K = tan (G_PI * f0 / (double) meter->rate);
+	a0 = 1.0 + K / Q + K * K;
+	meter->highpass.b0 = 1.0;
+	meter->highpass.b1 = -2.0;
+	meter->highpass.b2 = 1.0;
+	meter->highpass.a1 = 2.0 * (K * K - 1.0) / a0;
+	meter->highpass.a2 = (1.0 - K / Q + K * K) / a0;
+}
+
+static void
+init_weights (RBLoudnessMeter *meter)
+{
+	guint i;
+
+	for (i = 0; i < meter->channels; i++)
+		meter->weights[i] = 1.0;
+
+	/* surround channels get +1.5dB, the LFE channel is ignored.
+	 * this assumes the default channel order for 5.0 and 5.1.
+	 */
+	if (meter->channels == 5) {
+		meter->weights[3] = 1.41;
+		meter->weights[4] = 1.41;
+	} else if (meter->channels == 6) {
+		meter->weights[3] = 0.0;
+		meter->weights[4] = 1.41;
+		meter->weights[5] = 1.41;
+	}
+}
+
+/**
+ * rb_loudness_meter_new:
+ * @rate: sample rate of the input
+ * @channels: number of interleaved channels in the input
+ *
+ * Creates a new loudness meter for audio in the specified format.
+ *
+ * Return value: new #RBLoudnessMeter, free with rb_loudness_meter_free
+ */
+RBLoudnessMeter *
+rb_loudness_meter_new (guint rate, guint channels)
+{
+	RBLoudnessMeter *meter;
+
+	g_return_val_if_fail (rate > 0, NULL);
+	g_return_val_if_fail (channels > 0, NULL);
+
+	meter = g_new0 (RBLoudnessMeter, 1);
+	meter->rate = rate;
+	meter->channels = channels;
+	meter->state = g_new0 (double, channels * 4);
+	meter->weights = g_new0 (double, channels);
+	meter->scratch = g_new0 (double, CHUNK_FRAMES);
+	meter->subblock_frames = MAX (rate / 10, 1);
+	meter->blocks = g_array_new (FALSE, FALSE, sizeof (double));
+
+	init_filters (meter);
+	init_weights (meter);
+	return meter;
+}
+
+/**
+ * rb_loudness_meter_free:
+ * @meter: a #RBLoudnessMeter
+ *
+ * Frees a loudness meter.
+ */
+void
+rb_loudness_meter_free (RBLoudnessMeter *meter)
+{
+	if (meter == NULL)
+		return;
+
+	g_array_free (meter->blocks, TRUE);
+	g_free (meter->state);
+	g_free (meter->weights);
+	g_free (meter->scratch);
+	g_free (meter);
+}
+
+/* the filters are recursive, so each channel has to be run through them
+ * one frame at a time.  the reductions below are where the work can be
+ * spread across vector lanes.
+ */
+static void
+filter_channel (RBLoudnessMeter *meter, double *state, const float *in, guint frames)
+{
+	const Biquad *s1 = &meter->shelf;
+	const Biquad *s2 = &meter->highpass;
+	double z1 = state[0];
+	double z2 = state[1];
+	double z3 = state[2];
+	double z4 = state[3];
+	double *out = meter->scratch;
+	guint stride = meter->channels;
+	guint i;
+
+	for (i = 0; i < frames; i++) {
+		double x;
+		double y;
+
+		x = in[i * stride];
+		y = s1->b0 * x + z1;
+		z1 = s1->b1 * x - s1->a1 * y + z2;
+		z2 = s1->b2 * x - s1->a2 * y;
+
+		x = y;
+		y = s2->b0 * x + z3;
+		z3 = s2->b1 * x - s2->a1 * y + z4;
+		z4 = s2->b2 * x - s2->a2 * y;
+
+		out[i] = y;
+	}
+
+	/* flush denormals so silence doesn't get slow */
+	state[0] = fabs (z1) < 1e-30 ? 0.0 : z1;
+	state[1] = fabs (z2) < 1e-30 ? 0.0 : z2;
+	state[2] = fabs (z3) < 1e-30 ? 0.0 : z3;
+	state[3] = fabs (z4) < 1e-30 ? 0.0 : z4;
+}
+
+/* independent accumulators let the compiler vectorise these loops
+ * without reassociating floating point operations itself.
+ */
+static double
+sum_squares (const double *x, guint n)
+{
+	double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+	guint i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		s0 += x[i] * x[i];
+		s1 += x[i + 1] * x[i + 1];
+		s2 += x[i + 2] * x[i + 2];
+		s3 += x[i + 3] * x[i + 3];
+	}
+	for (; i < n; i++)
+		s0 += x[i] * x[i];
+
+	return (s0 + s1) + (s2 + s3);
+}
+
+static float
+find_peak (const float *x, gsize n, float peak)
+{
+	float p0 = peak, p1 = peak, p2 = peak, p3 = peak;
+	gsize i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		p0 = MAX (p0, fabsf (x[i]));
+		p1 = MAX (p1, fabsf (x[i + 1]));
+		p2 = MAX (p2, fabsf (x[i + 2]));
+		p3 = MAX (p3, fabsf (x[i + 3]));
+	}
+	for (; i < n; i++)
+		p0 = MAX (p0, fabsf (x[i]));
+
+	return MAX (MAX (p0, p1), MAX (p2, p3));
+}
+
+static void
+end_subblock (RBLoudnessMeter *meter)
+{
+	double z;
+	guint i;
+
+	z = meter->subblock_sum / meter->subblock_frames;
+	if (meter->recent_count == SUBBLOCKS_PER_BLOCK - 1) {
+		double block = z;
+
+		for (i = 0; i < SUBBLOCKS_PER_BLOCK - 1; i++)
+			block += meter->recent[i];
+		block /= SUBBLOCKS_PER_BLOCK;
+		g_array_append_val (meter->blocks, block);
+
+		memmove (meter->recent, meter->recent + 1, sizeof (double) * (SUBBLOCKS_PER_BLOCK - 2));
+		meter->recent[SUBBLOCKS_PER_BLOCK - 2] = z;
+	} else {
+		meter->recent[meter->recent_count++] = z;
+	}
+
+	meter->subblock_sum = 0.0;
+	meter->subblock_pos = 0;
+}
+
+/**
+ * rb_loudness_meter_process:
+ * @meter: a #RBLoudnessMeter
+ * @samples: interleaved samples
+ * @frames: number of frames in @samples
+ *
+ * Adds audio to the measurement.
+ */
+void
+rb_loudness_meter_process (RBLoudnessMeter *meter, const float *samples, gsize frames)
+{
+	guint c;
+
+	meter->peak = find_peak (samples, frames * meter->channels, meter->peak);
+
+	while (frames > 0) {
+		guint n;
+
+		n = MIN (frames, CHUNK_FRAMES);
+		n = MIN (n, meter->subblock_frames - meter->subblock_pos);
+
+		for (c = 0; c < meter->channels; c++) {
+			if (meter->weights[c] == 0.0)
+				continue;
+
+			filter_channel (meter, meter->state + (c * 4), samples + c, n);
+			meter->subblock_sum += meter->weights[c] * sum_squares (meter->scratch, n);
+		}
+
+		samples += n * meter->channels;
+		frames -= n;
+		meter->subblock_pos += n;
+		if (meter->subblock_pos == meter->subblock_frames)
+			end_subblock (meter);
+	}
+}
+
+/**
+ * rb_loudness_meter_add:
+ * @meter: a #RBLoudnessMeter
+ * @other: another #RBLoudnessMeter
+ *
+ * Adds the measurements from @other to @meter, as if the audio
+ * processed by @other had been processed by @meter.  This is used
+ * to measure album loudness from the meters for each track.
+ */
+void
+rb_loudness_meter_add (RBLoudnessMeter *meter, RBLoudnessMeter *other)
+{
+	g_array_append_vals (meter->blocks, other->blocks->data, other->blocks->len);
+	meter->peak = MAX (meter->peak, other->peak);
+}
+
+/**
+ * rb_loudness_meter_get_loudness:
+ * @meter: a #RBLoudnessMeter
+ * @lufs: (out): returns the integrated loudness in LUFS
+ *
+ * Calculates the gated integrated loudness of the audio processed so far.
+ *
+ * Return value: %FALSE if no audio loud enough to measure has been processed
+ */
+gboolean
+rb_loudness_meter_get_loudness (RBLoudnessMeter *meter, double *lufs)
+{
+	double absolute;
+	double relative;
+	double sum;
+	guint count;
+	guint i;
+
+	absolute = pow (10.0, (ABSOLUTE_GATE + 0.691) / 10.0);
+
+	sum = 0.0;
+	count = 0;
+	for (i = 0; i < meter->blocks->len; i++) {
+		double z = g_array_index (meter->blocks, double, i);
+		if (z > absolute) {
+			sum += z;
+			count++;
+		}
+	}
+	if (count == 0)
+		return FALSE;
+
+	relative = (sum / count) * pow (10.0, RELATIVE_GATE / 10.0);
+
+	sum = 0.0;
+	count = 0;
+	for (i = 0; i < meter->blocks->len; i++) {
+		double z = g_array_index (meter->blocks, double, i);
+		if (z > absolute && z > relative) {
+			sum += z;
+			count++;
+		}
+	}
+	if (count == 0)
+		return FALSE;
+
+	*lufs = -0.691 + 10.0 * log10 (sum / count);
+	return TRUE;
+}
+
+/**
+ * rb_loudness_meter_get_peak:
+ * @meter: a #RBLoudnessMeter
+ *
+ * Returns the largest absolute sample value processed so far.
+ *
+ * Return value: sample peak, where 1.0 is full scale
+ */
+double
+rb_loudness_meter_get_peak (RBLoudnessMeter *meter)
+{
+	return meter->peak;
+}
+
+/**
+ * rb_loudness_gain_from_loudness:
+ * @lufs: integrated loudness in LUFS
+ *
+ * Converts a loudness measurement into the ReplayGain adjustment
+ * required to bring it to the ReplayGain 2.0 reference level.
+ *
+ * Return value: gain in dB
+ */
+double
+rb_loudness_gain_from_loudness (double lufs)
+{
+	return RB_LOUDNESS_REFERENCE - lufs;
+}
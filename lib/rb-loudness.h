@@ -0,0 +1,57 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+#ifndef RB_LOUDNESS_H
+#define RB_LOUDNESS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* ReplayGain 2.0 reference level, in LUFS */
+#define RB_LOUDNESS_REFERENCE		(-18.0)
+
+typedef struct _RBLoudnessMeter RBLoudnessMeter;
+
+RBLoudnessMeter *rb_loudness_meter_new		(guint rate, guint channels);
+void		rb_loudness_meter_free		(RBLoudnessMeter *meter);
+
+void		rb_loudness_meter_process	(RBLoudnessMeter *meter,
+						 const float *samples,
+						 gsize frames);
+void		rb_loudness_meter_add		(RBLoudnessMeter *meter,
+						 RBLoudnessMeter *other);
+
+gboolean	rb_loudness_meter_get_loudness	(RBLoudnessMeter *meter, double *lufs);
+double		rb_loudness_meter_get_peak	(RBLoudnessMeter *meter);
+
+double		rb_loudness_gain_from_loudness	(double lufs);
+
+G_END_DECLS
+
+#endif /* RB_LOUDNESS_H */
@@ -0,0 +1,210 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+/*
+ * Benchmark for the in-process metadata reader.  Reads metadata from
+ * all the files given on the command line (directories are searched
+ * recursively) and reports how many files per second were read.
+ *
+ * With --single, a new RBMetaData is created for each file, as happened
+ * before metadata readers reused their state; otherwise the files are
+ * loaded as a single batch.  With --no-native, the native header
+ * readers are disabled so all files are read using the discoverer.
+ */
+
+#include <config.h>
+#include <locale.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <gst/gst.h>
+
+#include "rb-metadata.h"
+#include "rb-debug.h"
+
+static gboolean debug = FALSE;
+static gboolean single = FALSE;
+static gboolean no_native = FALSE;
+static int repeat = 1;
+
+static GOptionEntry entries [] = {
+	{ "debug", 0, 0, G_OPTION_ARG_NONE, &debug, "Enable debug output", NULL },
+	{ "single", 0, 0, G_OPTION_ARG_NONE, &single, "Use a new metadata reader for each file", NULL },
+	{ "no-native", 0, 0, G_OPTION_ARG_NONE, &no_native, "Don't use the native header readers", NULL },
+	{ "repeat", 0, 0, G_OPTION_ARG_INT, &repeat, "Number of times to read each file", "N" },
+	{ NULL }
+};
+
+typedef struct {
+	guint loaded;
+	guint errors;
+} BenchResults;
+
+static void
+collect_uris (GFile *file, GPtrArray *uris)
+{
+	GFileEnumerator *children;
+	GFileInfo *info;
+
+	info = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_TYPE, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	if (info == NULL)
+		return;
+
+	if (g_file_info_get_file_type (info) != G_FILE_TYPE_DIRECTORY) {
+		g_ptr_array_add (uris, g_file_get_uri (file));
+		g_object_unref (info);
+		return;
+	}
+	g_object_unref (info);
+
+	children = g_file_enumerate_children (file, G_FILE_ATTRIBUTE_STANDARD_NAME, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	if (children == NULL)
+		return;
+
+	while ((info = g_file_enumerator_next_file (children, NULL, NULL)) != NULL) {
+		GFile *child;
+
+		child = g_file_get_child (file, g_file_info_get_name (info));
+		collect_uris (child, uris);
+		g_object_unref (child);
+		g_object_unref (info);
+	}
+	g_object_unref (children);
+}
+
+static gboolean
+batch_result_cb (RBMetaData *md, const char *uri, const GError *error, BenchResults *results)
+{
+	if (error != NULL) {
+		rb_debug ("error reading %s: %s", uri, error->message);
+		results->errors++;
+	} else {
+		results->loaded++;
+	}
+	return TRUE;
+}
+
+static void
+run_single (const char * const *uris, BenchResults *results)
+{
+	int i;
+
+	for (i = 0; uris[i] != NULL; i++) {
+		RBMetaData *md;
+		GError *error = NULL;
+
+		md = rb_metadata_new ();
+		rb_metadata_load (md, uris[i], &error);
+		batch_result_cb (md, uris[i], error, results);
+		g_clear_error (&error);
+		g_object_unref (md);
+	}
+}
+
+int
+main (int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	GPtrArray *uris;
+	BenchResults results = {0,};
+	GTimer *timer;
+	double elapsed;
+	int i;
+
+	setlocale (LC_ALL, "");
+
+	context = g_option_context_new ("FILE|DIRECTORY...");
+	g_option_context_add_main_entries (context, entries, NULL);
+	g_option_context_add_group (context, gst_init_get_option_group ());
+	if (g_option_context_parse (context, &argc, &argv, &error) == FALSE) {
+		fprintf (stderr, "%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	rb_debug_init (debug);
+	if (no_native)
+		g_setenv ("RB_METADATA_NO_NATIVE", "1", TRUE);
+
+	uris = g_ptr_array_new_with_free_func (g_free);
+	for (i = 1; i < argc; i++) {
+		GFile *file;
+
+		file = g_file_new_for_commandline_arg (argv[i]);
+		collect_uris (file, uris);
+		g_object_unref (file);
+	}
+	if (uris->len == 0) {
+		fprintf (stderr, "no files to read\n");
+		return 1;
+	}
+
+	/* repeat the list rather than each file, so caching within the
+	 * reader doesn't make repeated reads look better than they are.
+	 */
+	if (repeat > 1) {
+		guint count = uris->len;
+		int r;
+
+		for (r = 1; r < repeat; r++) {
+			guint n;
+			for (n = 0; n < count; n++)
+				g_ptr_array_add (uris, g_strdup (g_ptr_array_index (uris, n)));
+		}
+	}
+	g_ptr_array_add (uris, NULL);
+
+	timer = g_timer_new ();
+	if (single) {
+		run_single ((const char * const *)uris->pdata, &results);
+	} else {
+		RBMetaData *md;
+
+		md = rb_metadata_new ();
+		rb_metadata_load_batch (md,
+					(const char * const *)uris->pdata,
+					(RBMetaDataBatchFunc) batch_result_cb,
+					&results);
+		g_object_unref (md);
+	}
+	elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	printf ("%s: %u files read, %u errors in %.3f seconds: %.1f files/second\n",
+		single ? "single" : "batch",
+		results.loaded,
+		results.errors,
+		elapsed,
+		(results.loaded + results.errors) / elapsed);
+
+	g_ptr_array_free (uris, TRUE);
+	return 0;
+}
@@ -74,18 +74,37 @@ static GList *instances = NULL;
 static void rb_ext_db_class_init (RBExtDBClass *klass);
 static void rb_ext_db_init (RBExtDB *store);
 
-static void maybe_start_store_request (RBExtDB *store);
+/* number of threads processing store requests */
+#define STORE_WORKERS		4
+
+/* maximum number of store requests committed in one transaction */
+#define STORE_BATCH_SIZE	64
+
+/* subdirectory holding files named after their contents */
+#define CONTENT_DIR		"content"
+
+typedef struct _RBExtDBStoreRequest RBExtDBStoreRequest;
+
+static void start_store_request (RBExtDB *store, RBExtDBStoreRequest *req);
+static void do_store_request (RBExtDBStoreRequest *req, RBExtDB *store);
 
 struct _RBExtDBPrivate
 {
 	char *name;
 
 	struct tdb_context *tdb_context;
+	GMutex tdb_lock;
 
 	GList *requests;
 	GList *load_requests;
-	GAsyncQueue *store_queue;
-	GSimpleAsyncResult *store_op;
+
+	GThreadPool *store_pool;
+	GHashTable *store_keys;
+
+	GMutex commit_lock;
+	GPtrArray *commit_batch;
+	guint store_in_flight;
+	GHashTable *content_pending;
 };
 
 typedef struct {
@@ -99,16 +118,22 @@ typedef struct {
 	GValue *data;
 } RBExtDBRequest;
 
-typedef struct {
+struct _RBExtDBStoreRequest {
+	RBExtDB *store;
 	RBExtDBKey *key;
+	GBytes *store_key;
 	RBExtDBSourceType source_type;
 	char *uri;
 	GValue *data;
 	GValue *value;
 
 	char *filename;
+	char *relname;
+	char *old_relname;
+	gboolean content_pending;
 	gboolean stored;
-} RBExtDBStoreRequest;
+	gboolean delete;
+};
 
 G_DEFINE_TYPE (RBExtDB, rb_ext_db, G_TYPE_OBJECT)
 
@@ -158,7 +183,8 @@ create_request (RBExtDBKey *key,
 
 
 static RBExtDBStoreRequest *
-create_store_request (RBExtDBKey *key,
+create_store_request (RBExtDB *store,
+		      RBExtDBKey *key,
 		      RBExtDBSourceType source_type,
 		      const char *uri,
 		      GValue *data,
@@ -166,6 +192,7 @@ create_store_request (RBExtDBKey *key,
 {
 	RBExtDBStoreRequest *sreq = g_slice_new0 (RBExtDBStoreRequest);
 	g_assert (rb_ext_db_key_is_lookup (key) == FALSE);
+	sreq->store = store;
 	sreq->key = rb_ext_db_key_copy (key);
 	sreq->source_type = source_type;
 	if (uri != NULL) {
@@ -197,10 +224,20 @@ free_store_request (RBExtDBStoreRequest *sreq)
 	}
 	g_free (sreq->uri);
 	g_free (sreq->filename);
+	g_free (sreq->relname);
+	g_free (sreq->old_relname);
+	if (sreq->store_key != NULL)
+		g_bytes_unref (sreq->store_key);
 	rb_ext_db_key_free (sreq->key);
 	g_slice_free (RBExtDBStoreRequest, sreq);
 }
 
+static void
+free_store_queue (GQueue *queue)
+{
+	g_queue_free_full (queue, (GDestroyNotify) free_store_request);
+}
+
 
 static TDB_DATA
 flatten_data (guint64 search_time, const char *filename, RBExtDBSourceType source_type)
@@ -381,15 +418,18 @@ static void
 impl_finalize (GObject *object)
 {
 	RBExtDB *store = RB_EXT_DB (object);
-	RBExtDBStoreRequest *req;
 
 	g_free (store->priv->name);
 
 	g_list_free_full (store->priv->requests, (GDestroyNotify) free_request);
-	while ((req = g_async_queue_try_pop (store->priv->store_queue)) != NULL) {
-		free_store_request (req);
-	}
-	g_async_queue_unref (store->priv->store_queue);
+
+	/* store requests hold references, so none can be running now */
+	g_thread_pool_free (store->priv->store_pool, TRUE, TRUE);
+	g_hash_table_destroy (store->priv->store_keys);
+	g_ptr_array_free (store->priv->commit_batch, TRUE);
+	g_hash_table_destroy (store->priv->content_pending);
+	g_mutex_clear (&store->priv->commit_lock);
+	g_mutex_clear (&store->priv->tdb_lock);
 
 	if (store->priv->tdb_context) {
 		tdb_close (store->priv->tdb_context);
@@ -405,7 +445,16 @@ rb_ext_db_init (RBExtDB *store)
 {
 	store->priv = G_TYPE_INSTANCE_GET_PRIVATE (store, RB_TYPE_EXT_DB, RBExtDBPrivate);
 
-	store->priv->store_queue = g_async_queue_new ();
+	g_mutex_init (&store->priv->tdb_lock);
+	g_mutex_init (&store->priv->commit_lock);
+
+	store->priv->store_pool = g_thread_pool_new ((GFunc) do_store_request, store, STORE_WORKERS, FALSE, NULL);
+	store->priv->store_keys = g_hash_table_new_full (g_bytes_hash,
+							 g_bytes_equal,
+							 (GDestroyNotify) g_bytes_unref,
+							 (GDestroyNotify) free_store_queue);
+	store->priv->commit_batch = g_ptr_array_new_with_free_func ((GDestroyNotify) free_store_request);
+	store->priv->content_pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 }
 
 static void
@@ -547,7 +596,9 @@ lookup_cb (TDB_DATA data, RBExtDBKey *key, gpointer user_data)
 	RBExtDBSourceType source_type = RB_EXT_DB_SOURCE_NONE;
 	guint64 search_time = 0;
 
+	g_mutex_lock (&lookup->store->priv->tdb_lock);
 	tdbvalue = tdb_fetch (lookup->store->priv->tdb_context, data);
+	g_mutex_unlock (&lookup->store->priv->tdb_lock);
 	if (tdbvalue.dptr == NULL) {
 		if (rb_debug_here ()) {
 			char *str = rb_ext_db_key_to_string (key);
@@ -786,7 +837,9 @@ rb_ext_db_request (RBExtDB *store,
 	/* lookup previous request time */
 	tdbkey = rb_ext_db_key_to_store_key (key);
 
+	g_mutex_lock (&store->priv->tdb_lock);
 	tdbvalue = tdb_fetch (store->priv->tdb_context, tdbkey);
+	g_mutex_unlock (&store->priv->tdb_lock);
 	if (tdbvalue.dptr != NULL) {
 		extract_data (tdbvalue, &last_time, NULL, NULL);
 		free (tdbvalue.dptr);
@@ -884,80 +937,345 @@ delete_file (RBExtDB *store, const char *filename)
 }
 
 
+static gboolean
+is_content_file (const char *filename)
+{
+	return (filename != NULL && g_str_has_prefix (filename, CONTENT_DIR G_DIR_SEPARATOR_S));
+}
+
+static TDB_DATA
+content_ref_key (const char *filename)
+{
+	TDB_DATA k;
+	gsize len;
+
+	/* store keys always start with a field name, so a leading nul can't collide */
+	len = strlen (filename);
+	k.dsize = len + 1;
+	k.dptr = g_malloc (k.dsize);
+	k.dptr[0] = '\0';
+	memcpy (k.dptr + 1, filename, len);
+	return k;
+}
+
+static guint32
+content_ref_count (RBExtDB *store, TDB_DATA k)
+{
+	TDB_DATA v;
+	guint32 refs = 0;
+
+	v = tdb_fetch (store->priv->tdb_context, k);
+	if (v.dptr != NULL) {
+		if (v.dsize == sizeof (refs)) {
+			memcpy (&refs, v.dptr, sizeof (refs));
+			refs = GUINT32_FROM_LE (refs);
+		}
+		free (v.dptr);
+	}
+	return refs;
+}
+
+static guint32
+content_ref_adjust (RBExtDB *store, const char *filename, int delta)
+{
+	TDB_DATA k;
+	TDB_DATA v;
+	guint32 refs;
+	guint32 le;
+
+	k = content_ref_key (filename);
+	refs = content_ref_count (store, k);
+	if (delta < 0 && refs < (guint32) -delta) {
+		refs = 0;
+	} else {
+		refs += delta;
+	}
+
+	if (refs == 0) {
+		tdb_delete (store->priv->tdb_context, k);
+	} else {
+		le = GUINT32_TO_LE (refs);
+		v.dptr = (unsigned char *)&le;
+		v.dsize = sizeof (le);
+		tdb_store (store->priv->tdb_context, k, v, 0);
+	}
+	g_free (k.dptr);
+	return refs;
+}
+
+/* called with the commit lock held */
 static void
-store_request_cb (RBExtDB *store, GAsyncResult *result, gpointer data)
+content_pending_adjust (RBExtDB *store, const char *filename, int delta)
 {
-	RBExtDBStoreRequest *sreq;
-	sreq = g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (result));
+	int count;
 
-	if (sreq == NULL) {
-		/* do nothing */
-	} else if (sreq->stored) {
-		GList *l;
-
-		/* answer any matching queries */
-		l = store->priv->requests;
-		while (l != NULL) {
-			RBExtDBRequest *req = l->data;
-			if (rb_ext_db_key_matches (sreq->key, req->key)) {
-				GList *n = l->next;
-				rb_debug ("answering metadata request %p", req);
-				answer_request (req, sreq->key, sreq->filename, sreq->value);
-				store->priv->requests = g_list_delete_link (store->priv->requests, l);
-				l = n;
+	count = GPOINTER_TO_INT (g_hash_table_lookup (store->priv->content_pending, filename)) + delta;
+	if (count > 0) {
+		g_hash_table_insert (store->priv->content_pending, g_strdup (filename), GINT_TO_POINTER (count));
+	} else {
+		g_hash_table_remove (store->priv->content_pending, filename);
+	}
+}
+
+/* called with the tdb lock held, once the transaction that dropped the
+ * last reference to a file has been committed.
+ */
+static void
+release_file (RBExtDB *store, const char *filename)
+{
+	if (is_content_file (filename) == FALSE) {
+		delete_file (store, filename);
+		return;
+	}
+
+	g_mutex_lock (&store->priv->commit_lock);
+	if (g_hash_table_contains (store->priv->content_pending, filename)) {
+		rb_debug ("not deleting %s, a store request is about to use it", filename);
+	} else {
+		TDB_DATA k;
+
+		k = content_ref_key (filename);
+		if (content_ref_count (store, k) == 0)
+			delete_file (store, filename);
+		g_free (k.dptr);
+	}
+	g_mutex_unlock (&store->priv->commit_lock);
+}
+
+static gboolean
+store_batch_done_cb (GPtrArray *batch)
+{
+	RBExtDB *store;
+	int i;
+
+	if (batch->len == 0) {
+		g_ptr_array_free (batch, TRUE);
+		return FALSE;
+	}
+
+	store = ((RBExtDBStoreRequest *) g_ptr_array_index (batch, 0))->store;
+	for (i = 0; i < batch->len; i++) {
+		RBExtDBStoreRequest *sreq = g_ptr_array_index (batch, i);
+		RBExtDBStoreRequest *next;
+		GQueue *waiting;
+
+		if (sreq->delete) {
+			if (sreq->stored)
+				g_signal_emit (store, signals[ADDED], 0, sreq->key, NULL, NULL);
+		} else if (sreq->stored) {
+			GList *l;
+
+			/* answer any matching queries */
+			l = store->priv->requests;
+			while (l != NULL) {
+				RBExtDBRequest *req = l->data;
+				if (rb_ext_db_key_matches (sreq->key, req->key)) {
+					GList *n = l->next;
+					rb_debug ("answering metadata request %p", req);
+					answer_request (req, sreq->key, sreq->filename, sreq->value);
+					store->priv->requests = g_list_delete_link (store->priv->requests, l);
+					l = n;
+				} else {
+					l = l->next;
+				}
+			}
+
+			/* let passive metadata consumers see it too */
+			rb_debug ("added; filename = %s, value type = %s", sreq->filename, sreq->value ? G_VALUE_TYPE_NAME (sreq->value) : "<none>");
+			g_signal_emit (store, signals[ADDED], 0, sreq->key, sreq->filename, sreq->value);
+		} else {
+			rb_debug ("no metadata was stored");
+		}
+
+		/* the record for this key is committed, so the next request for it can start */
+		waiting = g_hash_table_lookup (store->priv->store_keys, sreq->store_key);
+		next = waiting ? g_queue_pop_head (waiting) : NULL;
+		if (next != NULL) {
+			start_store_request (store, next);
+		} else {
+			g_hash_table_remove (store->priv->store_keys, sreq->store_key);
+		}
+	}
+
+	/* each request holds a reference to the store, so drop them last */
+	for (i = 0; i < batch->len; i++) {
+		g_object_unref (store);
+	}
+	g_ptr_array_free (batch, TRUE);
+	return FALSE;
+}
+
+static void
+commit_store_batch (RBExtDB *store, GPtrArray *batch)
+{
+	GPtrArray *released;
+	GTimeVal now;
+	gboolean committed;
+	int stored = 0;
+	int i;
+
+	released = g_ptr_array_new_with_free_func (g_free);
+	g_get_current_time (&now);
+
+	g_mutex_lock (&store->priv->tdb_lock);
+	committed = (tdb_transaction_start (store->priv->tdb_context) == 0);
+	if (committed == FALSE) {
+		rb_debug ("unable to start store transaction for %s", store->priv->name);
+	}
+
+	for (i = 0; committed && i < batch->len; i++) {
+		RBExtDBStoreRequest *sreq = g_ptr_array_index (batch, i);
+		TDB_DATA tdbkey;
+		TDB_DATA store_data;
+		TDB_DATA current;
+		char *current_relname = NULL;
+		gboolean found;
+
+		if (sreq->stored == FALSE && sreq->delete == FALSE)
+			continue;
+
+		/* the file references are adjusted from the record as it is now,
+		 * not as it was when the request started.
+		 */
+		tdbkey.dptr = (unsigned char *) g_bytes_get_data (sreq->store_key, &tdbkey.dsize);
+		current = tdb_fetch (store->priv->tdb_context, tdbkey);
+		found = (current.dptr != NULL);
+		if (found) {
+			extract_data (current, NULL, &current_relname, NULL);
+			free (current.dptr);
+		}
+
+		if (sreq->delete) {
+			/* only report deletions of items that were there */
+			sreq->stored = found;
+			if (found) {
+				rb_debug ("actually deleting; filename = %s", current_relname);
+				tdb_delete (store->priv->tdb_context, tdbkey);
+			}
+		} else {
+			rb_debug ("actually storing; time = %lu, filename = %s, source = %d", now.tv_sec, sreq->relname, sreq->source_type);
+			store_data = flatten_data (now.tv_sec, sreq->relname, sreq->source_type);
+			tdb_store (store->priv->tdb_context, tdbkey, store_data, 0);
+			/* XXX warn on error.. */
+			g_free (store_data.dptr);
+			stored++;
+
+			if (g_strcmp0 (sreq->relname, current_relname) == 0) {
+				g_free (current_relname);
+				continue;
+			}
+
+			if (is_content_file (sreq->relname)) {
+				content_ref_adjust (store, sreq->relname, 1);
+			}
+		}
+
+		if (current_relname != NULL) {
+			if (is_content_file (current_relname) == FALSE ||
+			    content_ref_adjust (store, current_relname, -1) == 0) {
+				g_ptr_array_add (released, current_relname);
 			} else {
-				l = l->next;
+				g_free (current_relname);
 			}
 		}
+	}
 
-		/* let passive metadata consumers see it too */
-		rb_debug ("added; filename = %s, value type = %s", sreq->filename, sreq->value ? G_VALUE_TYPE_NAME (sreq->value) : "<none>");
-		g_signal_emit (store, signals[ADDED], 0, sreq->key, sreq->filename, sreq->value);
-	} else {
-		rb_debug ("no metadata was stored");
+	if (committed && tdb_transaction_commit (store->priv->tdb_context) != 0) {
+		rb_debug ("unable to commit store transaction for %s", store->priv->name);
+		committed = FALSE;
+	}
+
+	/* new files are now referenced by their records (or lost, if the commit failed) */
+	g_mutex_lock (&store->priv->commit_lock);
+	for (i = 0; i < batch->len; i++) {
+		RBExtDBStoreRequest *sreq = g_ptr_array_index (batch, i);
+		if (sreq->content_pending)
+			content_pending_adjust (store, sreq->relname, -1);
+		if (committed == FALSE)
+			sreq->stored = FALSE;
 	}
+	g_mutex_unlock (&store->priv->commit_lock);
 
-	g_object_unref (store->priv->store_op);
-	store->priv->store_op = NULL;
+	for (i = 0; committed && i < released->len; i++) {
+		release_file (store, g_ptr_array_index (released, i));
+	}
+	g_mutex_unlock (&store->priv->tdb_lock);
+
+	rb_debug ("committed %d of %u store requests for %s", stored, batch->len, store->priv->name);
+	g_ptr_array_free (released, TRUE);
 
-	/* start another store request if we have one */
-	maybe_start_store_request (store);
+	g_idle_add ((GSourceFunc) store_batch_done_cb, batch);
 }
 
 static void
-do_store_request (GSimpleAsyncResult *result, GObject *object, GCancellable *cancel)
+finish_store_request (RBExtDB *store, RBExtDBStoreRequest *req)
+{
+	GPtrArray *batch = NULL;
+
+	g_mutex_lock (&store->priv->commit_lock);
+	g_ptr_array_add (store->priv->commit_batch, req);
+	store->priv->store_in_flight--;
+	if (store->priv->store_in_flight == 0 || store->priv->commit_batch->len >= STORE_BATCH_SIZE) {
+		batch = store->priv->commit_batch;
+		store->priv->commit_batch = g_ptr_array_new_with_free_func ((GDestroyNotify) free_store_request);
+	}
+	g_mutex_unlock (&store->priv->commit_lock);
+
+	if (batch != NULL)
+		commit_store_batch (store, batch);
+}
+
+static char *
+content_filename (const char *data, gsize size)
+{
+	const char *hash;
+	GChecksum *checksum;
+	char *filename;
+
+	checksum = g_checksum_new (G_CHECKSUM_SHA256);
+	g_checksum_update (checksum, (const guchar *) data, size);
+	hash = g_checksum_get_string (checksum);
+
+	/* spread files out over 256 subdirectories */
+	filename = g_strdup_printf ("%s%s%.2s%s%s", CONTENT_DIR, G_DIR_SEPARATOR_S, hash, G_DIR_SEPARATOR_S, hash + 2);
+	g_checksum_free (checksum);
+	return filename;
+}
+
+static void
+do_store_request (RBExtDBStoreRequest *req, RBExtDB *store)
 {
-	RBExtDB *store = RB_EXT_DB (object);
-	RBExtDBStoreRequest *req;
 	RBExtDBSourceType last_source_type = RB_EXT_DB_SOURCE_NONE;
 	guint64 last_time = 0;
 	const char *file_data;
-	char *filename = NULL;
 	gssize file_data_size;
-	GTimeVal now;
 	TDB_DATA tdbkey;
 	TDB_DATA tdbdata;
 	gboolean ignore;
 
-	req = g_async_queue_try_pop (store->priv->store_queue);
-	if (req == NULL) {
-		rb_debug ("nothing to do");
-		g_simple_async_result_set_op_res_gpointer (result, NULL, NULL);
-		return;
-	}
-	g_simple_async_result_set_op_res_gpointer (result, req, (GDestroyNotify)free_store_request);
-
 	/* convert key to storage blob */
 	if (rb_debug_here()) {
 		char *str = rb_ext_db_key_to_string (req->key);
 		rb_debug ("storing %s; source = %d", str, req->source_type);
 		g_free (str);
 	}
-	tdbkey = rb_ext_db_key_to_store_key (req->key);
+	tdbkey.dptr = (unsigned char *) g_bytes_get_data (req->store_key, &tdbkey.dsize);
+
+	if (req->delete) {
+		/* the record is removed when the batch is committed */
+		finish_store_request (store, req);
+		return;
+	}
 
-	/* fetch current contents, if any */
+	/* fetch current contents, if any.  no other request for this key
+	 * can be running, so this stays valid until we commit.
+	 */
+	g_mutex_lock (&store->priv->tdb_lock);
 	tdbdata = tdb_fetch (store->priv->tdb_context, tdbkey);
-	extract_data (tdbdata, &last_time, &filename, &last_source_type);
+	g_mutex_unlock (&store->priv->tdb_lock);
+	extract_data (tdbdata, &last_time, &req->old_relname, &last_source_type);
+	if (tdbdata.dptr != NULL)
+		free (tdbdata.dptr);
 
 	if (req->source_type == last_source_type) {
 		/* ignore new data if it just comes from a search,
@@ -972,12 +1290,10 @@ do_store_request (GSimpleAsyncResult *result, GObject *object, GCancellable *can
 	if (ignore) {
 		/* don't replace it */
 		rb_debug ("existing result is from a higher or equal priority source");
-		g_free (filename);
-		g_free (tdbkey.dptr);
-		if (tdbdata.dptr != NULL)
-			free (tdbdata.dptr);
+		finish_store_request (store, req);
 		return;
 	}
+	req->relname = g_strdup (req->old_relname);
 
 	/* if the metadata item is specified by a uri, retrieve the data */
 	if (req->uri != NULL) {
@@ -1067,124 +1383,92 @@ do_store_request (GSimpleAsyncResult *result, GObject *object, GCancellable *can
 	if (file_data != NULL && file_data_size > 0) {
 		GFile *f;
 		GError *error = NULL;
-		char *subdir = NULL;
-		char *basename = NULL;
-		char *fullsubdir;
-
-		if (filename == NULL) {
-			int seq;
+		char *subdir;
 
-			seq = tdb_get_seqnum (store->priv->tdb_context);
-			if (seq > 0xffffff) {
-				subdir = g_strdup_printf ("d%3.3x%sd%3.3x", seq >> 24, G_DIR_SEPARATOR_S, (seq >> 12) & 0xfff);
-			} else if (seq > 0xfff) {
-				subdir = g_strdup_printf ("d%3.3x", seq >> 12);
+		/* files are named after their contents, so identical items
+		 * (such as the same cover embedded in every track of an album)
+		 * share a single file.
+		 */
+		g_free (req->relname);
+		req->relname = content_filename (file_data, file_data_size);
+		req->filename = g_build_filename (rb_user_cache_dir (), store->priv->name, req->relname, NULL);
+
+		/* stop the file being deleted before our record refers to it */
+		g_mutex_lock (&store->priv->commit_lock);
+		content_pending_adjust (store, req->relname, 1);
+		req->content_pending = TRUE;
+		g_mutex_unlock (&store->priv->commit_lock);
+
+		if (g_file_test (req->filename, G_FILE_TEST_EXISTS)) {
+			rb_debug ("already have a copy of %s", req->relname);
+			req->stored = TRUE;
+		} else {
+			subdir = g_path_get_dirname (req->filename);
+			/* ignore errors, g_file_replace_contents will fail too, and it'll explain */
+			g_mkdir_with_parents (subdir, 0770);
+			g_free (subdir);
+
+			f = g_file_new_for_path (req->filename);
+			g_file_replace_contents (f,
+						 file_data,
+						 file_data_size,
+						 NULL,
+						 FALSE,
+						 G_FILE_CREATE_REPLACE_DESTINATION,
+						 NULL,
+						 NULL,
+						 &error);
+			if (error != NULL) {
+				rb_debug ("error saving %s: %s", req->filename, error->message);
+				g_clear_error (&error);
 			} else {
-				subdir = g_strdup (".");
+				rb_debug ("saved %s", req->relname);
+				req->stored = TRUE;
 			}
-			basename = g_strdup_printf ("%3.3x", seq & 0xfff);
-			rb_debug ("generated filename %s, subdir %s", basename, subdir ? subdir : "none");
-			filename = g_build_filename (subdir, basename, NULL);
-		} else {
-			basename = g_path_get_basename (filename);
-			subdir = g_path_get_dirname (filename);
-			rb_debug ("using existing filename %s (basename %s, subdir %s)", filename, basename, subdir);
+			g_object_unref (f);
 		}
-
-		fullsubdir = g_build_filename (rb_user_cache_dir (), store->priv->name, subdir, NULL);
-		/* ignore errors, g_file_replace_contents will fail too, and it'll explain */
-		g_mkdir_with_parents (fullsubdir, 0770);
-		g_free (fullsubdir);
-
-		req->filename = g_build_filename (rb_user_cache_dir (),
-						  store->priv->name,
-						  subdir,
-						  basename,
-						  NULL);
-
-		f = g_file_new_for_path (req->filename);
-
-		g_file_replace_contents (f,
-					 file_data,
-					 file_data_size,
-					 NULL,
-					 FALSE,
-					 G_FILE_CREATE_REPLACE_DESTINATION,
-					 NULL,
-					 NULL,
-					 &error);
-		if (error != NULL) {
-			rb_debug ("error saving %s: %s", req->filename, error->message);
-			g_clear_error (&error);
-		} else {
-			req->stored = TRUE;
-		}
-
-		g_free (basename);
-		g_free (subdir);
-
-		g_object_unref (f);
 	} else if (req->source_type == RB_EXT_DB_SOURCE_USER_EXPLICIT) {
-		if (filename != NULL) {
-			delete_file (store, filename);
-			g_free (filename);
-			filename = NULL;
-		}
+		/* the old file is released when the record is committed */
+		g_free (req->relname);
+		req->relname = NULL;
 		req->stored = TRUE;
 	} else if (req->source_type == RB_EXT_DB_SOURCE_NONE) {
 		req->stored = TRUE;
 	}
 
-	if (req->stored) {
-		TDB_DATA store_data;
-
-		g_get_current_time (&now);
-		rb_debug ("actually storing; time = %lu, filename = %s, source = %d", now.tv_sec, filename, req->source_type);
-		store_data = flatten_data (now.tv_sec, filename, req->source_type);
-		tdb_store (store->priv->tdb_context, tdbkey, store_data, 0);
-		/* XXX warn on error.. */
-		g_free (store_data.dptr);
-	}
-
-	if (tdbdata.dptr) {
-		free (tdbdata.dptr);
-		tdbdata.dptr = NULL;
-	}
-
-	g_free (filename);
-
-	g_free (tdbkey.dptr);
+	finish_store_request (store, req);
 }
 
 static void
-maybe_start_store_request (RBExtDB *store)
+start_store_request (RBExtDB *store, RBExtDBStoreRequest *req)
 {
-	if (store->priv->store_op != NULL) {
-		rb_debug ("already doing something");
-		return;
-	}
-
-	if (g_async_queue_length (store->priv->store_queue) < 1) {
-		rb_debug ("nothing to do");
-		return;
-	}
+	g_mutex_lock (&store->priv->commit_lock);
+	store->priv->store_in_flight++;
+	g_mutex_unlock (&store->priv->commit_lock);
 
-	store->priv->store_op = g_simple_async_result_new (G_OBJECT (store),
-							   (GAsyncReadyCallback) store_request_cb,
-							   NULL,
-							   maybe_start_store_request);
-	g_simple_async_result_run_in_thread (store->priv->store_op,
-					     do_store_request,
-					     G_PRIORITY_DEFAULT,
-					     NULL);	/* no cancel? */
+	g_object_ref (store);
+	g_thread_pool_push (store->priv->store_pool, req, NULL);
 }
 
 static void
 store_metadata (RBExtDB *store, RBExtDBStoreRequest *req)
 {
-	g_async_queue_push (store->priv->store_queue, req);
-	rb_debug ("now %d entries in store queue", g_async_queue_length (store->priv->store_queue));
-	maybe_start_store_request (store);
+	GQueue *waiting;
+	TDB_DATA tdbkey;
+
+	tdbkey = rb_ext_db_key_to_store_key (req->key);
+	req->store_key = g_bytes_new_take (tdbkey.dptr, tdbkey.dsize);
+
+	/* requests for the same key are committed in the order they were made */
+	waiting = g_hash_table_lookup (store->priv->store_keys, req->store_key);
+	if (waiting != NULL) {
+		g_queue_push_tail (waiting, req);
+		rb_debug ("now %u requests waiting for the same key", g_queue_get_length (waiting));
+		return;
+	}
+
+	g_hash_table_insert (store->priv->store_keys, g_bytes_ref (req->store_key), g_queue_new ());
+	start_store_request (store, req);
 }
 
 
@@ -1205,7 +1489,7 @@ rb_ext_db_store_uri (RBExtDB *store,
 		     const char *uri)
 {
 	rb_debug ("storing uri %s", uri);
-	store_metadata (store, create_store_request (key, source_type, uri, NULL, NULL));
+	store_metadata (store, create_store_request (store, key, source_type, uri, NULL, NULL));
 }
 
 /**
@@ -1228,7 +1512,7 @@ rb_ext_db_store (RBExtDB *store,
 		 GValue *data)
 {
 	rb_debug ("storing value of type %s", data ? G_VALUE_TYPE_NAME (data) : "<none>");
-	store_metadata (store, create_store_request (key, source_type, NULL, NULL, data));
+	store_metadata (store, create_store_request (store, key, source_type, NULL, NULL, data));
 }
 
 /**
@@ -1249,7 +1533,7 @@ rb_ext_db_store_raw (RBExtDB *store,
 		     GValue *data)
 {
 	rb_debug ("storing encoded data of type %s", data ? G_VALUE_TYPE_NAME (data) : "<none>");
-	store_metadata (store, create_store_request (key, source_type, NULL, data, NULL));
+	store_metadata (store, create_store_request (store, key, source_type, NULL, data, NULL));
 }
 
 /**
@@ -1258,36 +1542,24 @@ rb_ext_db_store_raw (RBExtDB *store,
  * @key: metadata storage key
  *
  * Deletes the item stored in the metadata store under the specified storage key.
+ * The item is removed after any earlier store requests for the key have been
+ * committed.
  */
 void
 rb_ext_db_delete (RBExtDB *store, RBExtDBKey *key)
 {
-	TDB_DATA k;
-	TDB_DATA value;
+	RBExtDBStoreRequest *req;
 
-	k = rb_ext_db_key_to_store_key (key);
 	if (rb_debug_here ()) {
 		char *str = rb_ext_db_key_to_string (key);
 		rb_debug ("deleting key %s", str);
 		g_free (str);
 	}
 
-	value = tdb_fetch (store->priv->tdb_context, k);
-	if (value.dptr != NULL) {
-		char *fn = NULL;
-
-		extract_data (value, NULL, &fn, NULL);
-		if (fn != NULL) {
-			delete_file (store, fn);
-			g_free (fn);
-		}
-
-		tdb_delete (store->priv->tdb_context, k);
-		free (value.dptr);
-
-		g_signal_emit (store, signals[ADDED], 0, key, NULL, NULL);
-	}
-	g_free (k.dptr);
+	/* deletes are queued behind any store requests for the same key */
+	req = create_store_request (store, key, RB_EXT_DB_SOURCE_NONE, NULL, NULL, NULL);
+	req->delete = TRUE;
+	store_metadata (store, req);
 }
 
 #define ENUM_ENTRY(NAME, DESC) { NAME, "" #NAME "", DESC }
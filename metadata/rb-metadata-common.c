@@ -154,6 +154,38 @@ rb_metadata_get_field_name (RBMetaDataField field)
 	return klass->values[field].value_nick;
 }
 
+/**
+ * rb_metadata_load_batch:
+ * @md: a #RBMetaData
+ * @uris: (array zero-terminated=1): URIs to load metadata from
+ * @func: (scope call): called with the results for each URI
+ * @data: data to pass to @func
+ *
+ * Reads metadata from each of a set of URIs in turn, calling @func
+ * as the results for each one become available.  Loading a batch of
+ * files this way allows the metadata reader to reuse its state between
+ * files, which is much faster than creating a new #RBMetaData for each.
+ */
+void
+rb_metadata_load_batch (RBMetaData *md,
+			const char * const *uris,
+			RBMetaDataBatchFunc func,
+			gpointer data)
+{
+	int i;
+
+	for (i = 0; uris[i] != NULL; i++) {
+		GError *error = NULL;
+		gboolean more;
+
+		rb_metadata_load (md, uris[i], &error);
+		more = func (md, uris[i], error, data);
+		g_clear_error (&error);
+		if (more == FALSE)
+			break;
+	}
+}
+
 GQuark
 rb_metadata_error_quark (void)
 {
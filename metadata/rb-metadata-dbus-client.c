@@ -43,7 +43,19 @@
  * currently), so the ping message serves two purposes - it checks that the
  * child is still capable of handling messages, and it ensures the child
  * doesn't time out between when we check the child is still running and when
- * we actually send it the request.
+ * we actually send it the request.  Helpers that have handled a request
+ * recently can't be about to time out, so they aren't pinged.
+ *
+ * Each helper process handles one request at a time, so several helpers
+ * are started (one per processor, up to a limit, or as set by the
+ * RB_METADATA_HELPERS environment variable) as concurrent requests need them.
+ * Each request goes to the helper with the fewest requests outstanding, and
+ * a few requests can be sent to each helper before any replies arrive.
+ * Since a helper handles its requests in order, a request's timeout also
+ * covers the requests sent to the helper ahead of it, so only a request
+ * that stalls the helper itself times out.  If a helper crashes or stops
+ * responding, only that helper is restarted.  The request it was handling
+ * fails, and the requests queued behind it are sent again.
  */
 
 /**
@@ -74,12 +86,54 @@ static void rb_metadata_class_init (RBMetaDataClass *klass);
 static void rb_metadata_init (RBMetaData *md);
 static void rb_metadata_finalize (GObject *object);
 
+/* the number of helpers started if RB_METADATA_HELPERS isn't set is
+ * the number of processors, up to this limit.
+ */
+#define RB_METADATA_MAX_HELPERS			4
+
+/* requests sent to each helper before waiting for replies */
+#define RB_METADATA_HELPER_MAX_REQUESTS		4
+
+/* helpers idle for longer than this are pinged before use (in microseconds) */
+#define RB_METADATA_HELPER_PING_INTERVAL	(5 * G_USEC_PER_SEC)
+
+typedef struct {
+	guint index;
+
+	/* held while starting, checking or stopping the helper */
+	GMutex lock;
+	GDBusConnection *connection;
+	GPid child;
+	int child_stdout;
+	guint generation;
+	gint64 last_used;
+
+	/* requests sent to the helper and not yet finished, oldest first.
+	 * protected by lock.
+	 */
+	GQueue requests;
+
+	/* protected by helper_pool_mutex */
+	guint outstanding;
+	gint pending_timeout;
+} RBMetaDataHelper;
+
+typedef struct {
+	GDBusConnection *connection;
+	gboolean stalled;
+	gboolean done;
+	GVariant *response;
+	GError *error;
+} RBMetaDataHelperRequest;
+
 static gboolean tried_env_address = FALSE;
-static GDBusConnection *dbus_connection = NULL;
-static GPid metadata_child = 0;
-static int metadata_stdout = -1;
+static RBMetaDataHelper *helpers = NULL;
+static guint n_helpers = 0;
+static GMutex helper_pool_mutex;
+static GCond helper_pool_cond;
+static guint helper_generation = 0;
 static GMainContext *main_context = NULL;
-static GMutex conn_mutex;
+static GMutex saveable_types_mutex;
 static char **saveable_types = NULL;
 
 struct RBMetaDataPrivate
@@ -141,47 +195,47 @@ rb_metadata_new (void)
 }
 
 static void
-kill_metadata_service (void)
+kill_metadata_service (RBMetaDataHelper *helper)
 {
-	if (dbus_connection) {
-		if (g_dbus_connection_is_closed (dbus_connection) == FALSE) {
-			rb_debug ("closing dbus connection");
-			g_dbus_connection_close_sync (dbus_connection, NULL, NULL);
+	if (helper->connection) {
+		if (g_dbus_connection_is_closed (helper->connection) == FALSE) {
+			rb_debug ("closing dbus connection to helper %u", helper->index);
+			g_dbus_connection_close_sync (helper->connection, NULL, NULL);
 		} else {
-			rb_debug ("dbus connection already closed");
+			rb_debug ("dbus connection to helper %u already closed", helper->index);
 		}
-		g_object_unref (dbus_connection);
-		dbus_connection = NULL;
+		g_object_unref (helper->connection);
+		helper->connection = NULL;
 	}
 
-	if (metadata_child) {
-		rb_debug ("killing child process");
-		kill (metadata_child, SIGINT);
-		g_spawn_close_pid (metadata_child);
-		metadata_child = 0;
+	if (helper->child) {
+		rb_debug ("killing child process %d", helper->child);
+		kill (helper->child, SIGINT);
+		g_spawn_close_pid (helper->child);
+		helper->child = 0;
 	}
 
-	if (metadata_stdout != -1) {
+	if (helper->child_stdout != -1) {
 		rb_debug ("closing metadata child process stdout pipe");
-		close (metadata_stdout);
-		metadata_stdout = -1;
+		close (helper->child_stdout);
+		helper->child_stdout = -1;
 	}
 }
 
 static gboolean
-ping_metadata_service (GError **error)
+ping_metadata_service (RBMetaDataHelper *helper, GError **error)
 {
 	GDBusMessage *message;
 	GDBusMessage *response;
 
-	if (g_dbus_connection_is_closed (dbus_connection))
+	if (g_dbus_connection_is_closed (helper->connection))
 		return FALSE;
 
 	message = g_dbus_message_new_method_call (RB_METADATA_DBUS_NAME,
 						  RB_METADATA_DBUS_OBJECT_PATH,
 						  RB_METADATA_DBUS_INTERFACE,
 						  "ping");
-	response = g_dbus_connection_send_message_with_reply_sync (dbus_connection,
+	response = g_dbus_connection_send_message_with_reply_sync (helper->connection,
 								   message,
 								   G_DBUS_SEND_MESSAGE_FLAGS_NONE,
 								   RB_METADATA_DBUS_TIMEOUT,
@@ -202,46 +256,77 @@ ping_metadata_service (GError **error)
 }
 
 static gboolean
-start_metadata_service (GError **error)
+helper_is_busy (RBMetaDataHelper *helper)
+{
+	gboolean busy;
+
+	/* the caller counts as one outstanding request */
+	g_mutex_lock (&helper_pool_mutex);
+	busy = (helper->outstanding > 1);
+	g_mutex_unlock (&helper_pool_mutex);
+	return busy;
+}
+
+static gboolean
+start_metadata_service (RBMetaDataHelper *helper, GError **error)
 {
 	GIOChannel *stdout_channel;
 	GIOStatus status;
 	gchar *dbus_address = NULL;
 	char *saveable_type_list;
+	char **types;
 	GVariant *response_body;
 
-	if (dbus_connection) {
-		if (ping_metadata_service (error))
-			return TRUE;
+	if (helper->connection) {
+		if (g_dbus_connection_is_closed (helper->connection) == FALSE) {
+			/* helpers that need to reread the plugin registry are
+			 * restarted once they're not handling any other requests.
+			 */
+			if (helper->generation != g_atomic_int_get (&helper_generation) &&
+			    helper_is_busy (helper) == FALSE) {
+				rb_debug ("restarting metadata helper %u to reload registry", helper->index);
+			} else if (g_get_monotonic_time () - helper->last_used < RB_METADATA_HELPER_PING_INTERVAL ||
+				   helper_is_busy (helper)) {
+				return TRUE;
+			} else if (ping_metadata_service (helper, error)) {
+				return TRUE;
+			}
+		}
 
 		/* Metadata service is broken.  Kill it, and if we haven't run
 		 * into any errors yet, we can try to restart it.
 		 */
-		kill_metadata_service ();
+		kill_metadata_service (helper);
 
 		if (*error)
 			return FALSE;
 	}
 
-	if (!tried_env_address) {
+	if (helper->index == 0 && !tried_env_address) {
 		const char *addr = g_getenv ("RB_DBUS_METADATA_ADDRESS");
 		tried_env_address = TRUE;
 		if (addr) {
 			rb_debug ("trying metadata service address %s (from environment)", addr);
 			dbus_address = g_strdup (addr);
-			metadata_child = 0;
+			helper->child = 0;
 		}
 	}
 
 	if (dbus_address == NULL) {
 		GPtrArray *argv;
+		const char *helper_path;
 		gboolean res;
 		char **debug_args;
 		GError *local_error;
 		int i;
 
+		/* the helper can be replaced for testing */
+		helper_path = g_getenv ("RB_METADATA_HELPER");
+		if (helper_path == NULL)
+			helper_path = LIBEXEC_DIR G_DIR_SEPARATOR_S INSTALLED_METADATA_HELPER;
+
 		argv = g_ptr_array_new ();
-		g_ptr_array_add (argv, LIBEXEC_DIR G_DIR_SEPARATOR_S INSTALLED_METADATA_HELPER);
+		g_ptr_array_add (argv, (char *) helper_path);
 		debug_args = rb_debug_get_args ();
 		i = 0;
 		while (debug_args[i] != NULL) {
@@ -258,9 +343,9 @@ start_metadata_service (GError **error)
 						NULL,
 						0,
 						NULL, NULL,
-						&metadata_child,
+						&helper->child,
 						NULL,
-						&metadata_stdout,
+						&helper->child_stdout,
 						NULL,
 						&local_error);
 		g_ptr_array_free (argv, TRUE);
@@ -271,39 +356,37 @@ start_metadata_service (GError **error)
 			return FALSE;
 		}
 
-		stdout_channel = g_io_channel_unix_new (metadata_stdout);
+		stdout_channel = g_io_channel_unix_new (helper->child_stdout);
 		status = g_io_channel_read_line (stdout_channel, &dbus_address, NULL, NULL, error);
 		g_io_channel_unref (stdout_channel);
 		if (status != G_IO_STATUS_NORMAL) {
-			kill_metadata_service ();
+			kill_metadata_service (helper);
 			return FALSE;
 		}
 
 		g_strchomp (dbus_address);
-		rb_debug ("Got metadata helper D-BUS address %s", dbus_address);
+		rb_debug ("Got metadata helper %u D-BUS address %s", helper->index, dbus_address);
 	}
 
-	dbus_connection = g_dbus_connection_new_for_address_sync (dbus_address,
-								  G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
-								  NULL,
-								  NULL,
-								  error);
+	helper->connection = g_dbus_connection_new_for_address_sync (dbus_address,
+								     G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+								     NULL,
+								     NULL,
+								     error);
 	g_free (dbus_address);
 	if (*error != NULL) {
-		kill_metadata_service ();
+		kill_metadata_service (helper);
 		return FALSE;
 	}
 
-	g_dbus_connection_set_exit_on_close (dbus_connection, FALSE);
+	g_dbus_connection_set_exit_on_close (helper->connection, FALSE);
+	helper->generation = g_atomic_int_get (&helper_generation);
+	helper->last_used = g_get_monotonic_time ();
 
-	rb_debug ("Metadata process %d started", metadata_child);
+	rb_debug ("Metadata process %d started as helper %u", helper->child, helper->index);
 
 	/* now ask it what types it can re-tag */
-	if (saveable_types != NULL) {
-		g_strfreev (saveable_types);
-	}
-
-	response_body = g_dbus_connection_call_sync (dbus_connection,
+	response_body = g_dbus_connection_call_sync (helper->connection,
 						     RB_METADATA_DBUS_NAME,
 						     RB_METADATA_DBUS_OBJECT_PATH,
 						     RB_METADATA_DBUS_INTERFACE,
@@ -319,9 +402,9 @@ start_metadata_service (GError **error)
 		return FALSE;
 	}
 
-	g_variant_get (response_body, "(^as)", &saveable_types);
-	if (saveable_types != NULL) {
-		saveable_type_list = g_strjoinv (", ", saveable_types);
+	g_variant_get (response_body, "(^as)", &types);
+	if (types != NULL) {
+		saveable_type_list = g_strjoinv (", ", types);
 		rb_debug ("saveable types from metadata helper: %s", saveable_type_list);
 		g_free (saveable_type_list);
 	} else {
@@ -329,9 +412,259 @@ start_metadata_service (GError **error)
 	}
 	g_variant_unref (response_body);
 
+	g_mutex_lock (&saveable_types_mutex);
+	g_strfreev (saveable_types);
+	saveable_types = types;
+	g_mutex_unlock (&saveable_types_mutex);
+
 	return TRUE;
 }
 
+static void
+init_helper_pool (void)
+{
+	const char *count;
+	guint i;
+
+	count = g_getenv ("RB_METADATA_HELPERS");
+	if (g_getenv ("RB_DBUS_METADATA_ADDRESS") != NULL) {
+		/* debugging a single helper started by hand */
+		n_helpers = 1;
+	} else if (count != NULL) {
+		n_helpers = CLAMP (strtoul (count, NULL, 10), 1, 64);
+	} else {
+		n_helpers = CLAMP (g_get_num_processors (), 1, RB_METADATA_MAX_HELPERS);
+	}
+	rb_debug ("using up to %u metadata helpers", n_helpers);
+
+	helpers = g_new0 (RBMetaDataHelper, n_helpers);
+	for (i = 0; i < n_helpers; i++) {
+		helpers[i].index = i;
+		helpers[i].child_stdout = -1;
+		g_mutex_init (&helpers[i].lock);
+		g_queue_init (&helpers[i].requests);
+	}
+}
+
+/*
+ * picks the helper with the fewest requests outstanding, waiting if every
+ * helper already has as many as it can take.  idle helpers are preferred
+ * over starting new ones, since helpers are started in index order.
+ * @timeout is the time the request needs, in milliseconds.
+ */
+static RBMetaDataHelper *
+acquire_helper (gint timeout)
+{
+	RBMetaDataHelper *helper;
+	guint i;
+
+	g_mutex_lock (&helper_pool_mutex);
+	if (helpers == NULL)
+		init_helper_pool ();
+
+	while (TRUE) {
+		helper = NULL;
+		for (i = 0; i < n_helpers; i++) {
+			if (helpers[i].outstanding >= RB_METADATA_HELPER_MAX_REQUESTS)
+				continue;
+			if (helper == NULL || helpers[i].outstanding < helper->outstanding)
+				helper = &helpers[i];
+		}
+
+		if (helper != NULL)
+			break;
+		g_cond_wait (&helper_pool_cond, &helper_pool_mutex);
+	}
+	helper->outstanding++;
+	helper->pending_timeout += timeout;
+	g_mutex_unlock (&helper_pool_mutex);
+
+	return helper;
+}
+
+static void
+release_helper (RBMetaDataHelper *helper, gint timeout)
+{
+	g_mutex_lock (&helper_pool_mutex);
+	helper->outstanding--;
+	helper->pending_timeout -= timeout;
+	g_cond_signal (&helper_pool_cond);
+	g_mutex_unlock (&helper_pool_mutex);
+}
+
+/* returns a reference to the helper's connection, starting the helper if necessary */
+static GDBusConnection *
+get_helper_connection (RBMetaDataHelper *helper, GError **error)
+{
+	GDBusConnection *connection = NULL;
+
+	g_mutex_lock (&helper->lock);
+	if (start_metadata_service (helper, error)) {
+		connection = g_object_ref (helper->connection);
+	}
+	g_mutex_unlock (&helper->lock);
+	return connection;
+}
+
+static void
+helper_call_cb (GObject *source, GAsyncResult *result, RBMetaDataHelperRequest *request)
+{
+	request->response = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), result, &request->error);
+	request->done = TRUE;
+}
+
+/*
+ * sends a request to a helper and waits for it to finish.  the request
+ * is added to the helper's request queue as it is sent, so the queue is
+ * in the order the helper handles the requests in.
+ */
+static void
+send_helper_request (RBMetaDataHelper *helper,
+		     RBMetaDataHelperRequest *request,
+		     const char *method,
+		     GVariant *parameters,
+		     gint timeout)
+{
+	GMainContext *context;
+
+	context = g_main_context_new ();
+	g_main_context_push_thread_default (context);
+
+	g_mutex_lock (&helper->lock);
+	g_queue_push_tail (&helper->requests, request);
+	g_dbus_connection_call (request->connection,
+				RB_METADATA_DBUS_NAME,
+				RB_METADATA_DBUS_OBJECT_PATH,
+				RB_METADATA_DBUS_INTERFACE,
+				method,
+				parameters,
+				NULL, /* complicated return type */
+				G_DBUS_CALL_FLAGS_NONE,
+				timeout,
+				NULL,
+				(GAsyncReadyCallback) helper_call_cb,
+				request);
+	g_mutex_unlock (&helper->lock);
+
+	while (request->done == FALSE)
+		g_main_context_iteration (context, TRUE);
+
+	g_main_context_pop_thread_default (context);
+	g_main_context_unref (context);
+}
+
+/*
+ * called after a request completes.  if the request failed because the
+ * helper crashed or stopped responding, the helper is stopped so it gets
+ * restarted for the next request.  other helpers are unaffected.
+ *
+ * returns TRUE if the request should be sent again, because it was queued
+ * behind the request that crashed or stalled the helper.
+ */
+static gboolean
+finish_helper_request (RBMetaDataHelper *helper, RBMetaDataHelperRequest *request)
+{
+	GError *error = request->error;
+	gboolean retry = FALSE;
+
+	g_mutex_lock (&helper->lock);
+	if (error != NULL &&
+	    (g_dbus_connection_is_closed (request->connection) ||
+	     g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_NO_REPLY) ||
+	     g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_DISCONNECTED) ||
+	     g_error_matches (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT) ||
+	     g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CLOSED))) {
+		if (request->connection == helper->connection) {
+			RBMetaDataHelperRequest *oldest = NULL;
+			GList *l;
+
+			/* the timeout covers the requests ahead of this one, so if it
+			 * timed out, this is the request the helper got stuck on.
+			 * otherwise the helper died handling the oldest request sent to it.
+			 */
+			if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT)) {
+				oldest = request;
+			} else {
+				for (l = helper->requests.head; oldest == NULL; l = l->next) {
+					RBMetaDataHelperRequest *r = l->data;
+					if (r->connection == request->connection)
+						oldest = r;
+				}
+			}
+			oldest->stalled = TRUE;
+
+			rb_debug ("metadata helper %u failed: %s", helper->index, error->message);
+			kill_metadata_service (helper);
+		}
+		retry = (request->stalled == FALSE &&
+			 g_error_matches (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT) == FALSE);
+	} else if (request->connection == helper->connection) {
+		helper->last_used = g_get_monotonic_time ();
+	}
+	g_queue_remove (&helper->requests, request);
+	g_mutex_unlock (&helper->lock);
+
+	g_object_unref (request->connection);
+	return retry;
+}
+
+/*
+ * sends a request to a metadata helper and waits for the reply.  if the
+ * helper is stopped while the request is queued behind the one that
+ * crashed or stalled it, the request is sent again once.
+ */
+static GVariant *
+call_helper (const char *method,
+	     const char *uri,
+	     GVariant *parameters,
+	     gint timeout,
+	     GError **error)
+{
+	RBMetaDataHelper *helper;
+	GVariant *response = NULL;
+	gboolean retried = FALSE;
+
+	g_variant_ref_sink (parameters);
+	while (TRUE) {
+		RBMetaDataHelperRequest request = {0,};
+		GError *local_error = NULL;
+		gboolean retry = FALSE;
+		gint call_timeout;
+
+		helper = acquire_helper (timeout);
+		request.connection = get_helper_connection (helper, &local_error);
+		if (request.connection != NULL) {
+			/* the helper handles requests in order, so wait for
+			 * the ones ahead of this one too
+			 */
+			g_mutex_lock (&helper_pool_mutex);
+			call_timeout = helper->pending_timeout;
+			g_mutex_unlock (&helper_pool_mutex);
+
+			rb_debug ("sending metadata %s request to helper %u: %s", method, helper->index, uri);
+			send_helper_request (helper, &request, method, parameters, call_timeout);
+			retry = finish_helper_request (helper, &request);
+			response = request.response;
+			local_error = request.error;
+		}
+		release_helper (helper, timeout);
+
+		if (retry && retried == FALSE) {
+			rb_debug ("metadata %s request for %s failed (%s), sending it again", method, uri, local_error->message);
+			g_error_free (local_error);
+			retried = TRUE;
+			continue;
+		}
+
+		if (local_error != NULL)
+			g_propagate_error (error, local_error);
+		break;
+	}
+	g_variant_unref (parameters);
+
+	return response;
+}
+
 /**
  * rb_metadata_reset:
  * @md: a #RBMetaData
@@ -369,7 +702,7 @@ rb_metadata_load (RBMetaData *md,
 		  const char *uri,
 		  GError **error)
 {
-	GVariant *response;
+	GVariant *response = NULL;
 	GError *fake_error = NULL;
 
 	if (error == NULL)
@@ -378,24 +711,8 @@ rb_metadata_load (RBMetaData *md,
 	rb_metadata_reset (md);
 	if (uri == NULL)
 		return;
-	g_mutex_lock (&conn_mutex);
 
-	start_metadata_service (error);
-
-	if (*error == NULL) {
-		rb_debug ("sending metadata load request: %s", uri);
-		response = g_dbus_connection_call_sync (dbus_connection,
-							RB_METADATA_DBUS_NAME,
-							RB_METADATA_DBUS_OBJECT_PATH,
-							RB_METADATA_DBUS_INTERFACE,
-							"load",
-							g_variant_new ("(s)", uri),
-							NULL, /* complicated return type */
-							G_DBUS_CALL_FLAGS_NONE,
-							RB_METADATA_DBUS_TIMEOUT,
-							NULL,
-							error);
-	}
+	response = call_helper ("load", uri, g_variant_new ("(s)", uri), RB_METADATA_DBUS_TIMEOUT, error);
 
 	if (*error == NULL) {
 		GVariantIter *metadata;
@@ -450,20 +767,19 @@ rb_metadata_load (RBMetaData *md,
 				     "%s", error_string);
 		}
 		g_variant_iter_free (metadata);
+		g_variant_unref (response);
 
 		/* if we're missing some plugins, we'll need to make sure the
-		 * metadata helper rereads the registry before the next load.
-		 * the easiest way to do this is to kill it.
+		 * metadata helpers reread the registry before the next load.
+		 * the easiest way to do this is to restart them.
 		 */
 		if (*error == NULL && g_strv_length (md->priv->missing_plugins) > 0) {
-			rb_debug ("missing plugins; killing metadata service to force registry reload");
-			kill_metadata_service ();
+			rb_debug ("missing plugins; restarting metadata helpers to force registry reload");
+			g_atomic_int_inc (&helper_generation);
 		}
 	}
 	if (fake_error)
 		g_error_free (fake_error);
-
-	g_mutex_unlock (&conn_mutex);
 }
 
 /**
@@ -600,19 +916,29 @@ rb_metadata_can_save (RBMetaData *md, const char *media_type)
 {
 	GError *error = NULL;
 	gboolean result = FALSE;
+	gboolean started;
 	int i = 0;
 
-	g_mutex_lock (&conn_mutex);
+	g_mutex_lock (&saveable_types_mutex);
+	started = (saveable_types != NULL);
+	g_mutex_unlock (&saveable_types_mutex);
 
-	if (saveable_types == NULL) {
-		if (start_metadata_service (&error) == FALSE) {
+	if (started == FALSE) {
+		RBMetaDataHelper *helper;
+		GDBusConnection *connection;
+
+		helper = acquire_helper (0);
+		connection = get_helper_connection (helper, &error);
+		release_helper (helper, 0);
+		if (connection == NULL) {
 			g_warning ("unable to start metadata service: %s", error->message);
-			g_mutex_unlock (&conn_mutex);
 			g_error_free (error);
 			return FALSE;
 		}
+		g_object_unref (connection);
 	}
 
+	g_mutex_lock (&saveable_types_mutex);
 	if (saveable_types != NULL) {
 		for (i = 0; saveable_types[i] != NULL; i++) {
 			if (g_str_equal (media_type, saveable_types[i])) {
@@ -621,8 +947,8 @@ rb_metadata_can_save (RBMetaData *md, const char *media_type)
 			}
 		}
 	}
+	g_mutex_unlock (&saveable_types_mutex);
 
-	g_mutex_unlock (&conn_mutex);
 	return result;
 }
 
@@ -639,7 +965,12 @@ rb_metadata_can_save (RBMetaData *md, const char *media_type)
 char **
 rb_metadata_get_saveable_types (RBMetaData *md)
 {
-	return g_strdupv (saveable_types);
+	char **types;
+
+	g_mutex_lock (&saveable_types_mutex);
+	types = g_strdupv (saveable_types);
+	g_mutex_unlock (&saveable_types_mutex);
+	return types;
 }
 
 /**
@@ -654,31 +985,19 @@ rb_metadata_get_saveable_types (RBMetaData *md)
 void
 rb_metadata_save (RBMetaData *md, const char *uri, GError **error)
 {
-	GVariant *response;
+	GVariant *response = NULL;
 	GError *fake_error = NULL;
 
 	if (error == NULL)
 		error = &fake_error;
 
-	g_mutex_lock (&conn_mutex);
-
-	start_metadata_service (error);
-
-	if (*error == NULL) {
-		response = g_dbus_connection_call_sync (dbus_connection,
-							RB_METADATA_DBUS_NAME,
-							RB_METADATA_DBUS_OBJECT_PATH,
-							RB_METADATA_DBUS_INTERFACE,
-							"save",
-							g_variant_new ("(sa{iv})",
-								       uri,
-								       rb_metadata_dbus_get_variant_builder (md)),
-							NULL,
-							G_DBUS_CALL_FLAGS_NONE,
-							RB_METADATA_SAVE_DBUS_TIMEOUT,
-							NULL,
-							error);
-	}
+	response = call_helper ("save",
+				uri,
+				g_variant_new ("(sa{iv})",
+					       uri,
+					       rb_metadata_dbus_get_variant_builder (md)),
+				RB_METADATA_SAVE_DBUS_TIMEOUT,
+				error);
 
 	if (*error == NULL) {
 		gboolean ok = TRUE;
@@ -697,8 +1016,6 @@ rb_metadata_save (RBMetaData *md, const char *uri, GError **error)
 
 	if (fake_error)
 		g_error_free (fake_error);
-
-	g_mutex_unlock (&conn_mutex);
 }
 
 gboolean
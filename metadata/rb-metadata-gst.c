@@ -38,6 +38,7 @@
 
 #include "rb-metadata.h"
 #include "rb-metadata-gst-common.h"
+#include "rb-metadata-native.h"
 #include "rb-gst-media-types.h"
 #include "rb-debug.h"
 #include "rb-file-helpers.h"
@@ -55,8 +56,18 @@ G_DEFINE_TYPE(RBMetaData, rb_metadata, G_TYPE_OBJECT)
 
 struct RBMetaDataPrivate
 {
+	/* reading; the discoverer and typefind pipeline are reused for each file */
+	GstDiscoverer *discoverer;
+	GstElement *typefind_pipeline;
+	GstElement *typefind_src;
 	GstDiscovererInfo *info;
 
+	/* results from the native header readers, used instead of the discoverer when they recognise the file */
+	gboolean use_native;
+	gboolean native_loaded;
+	RBMetaDataNativeInfo native;
+	GHashTable *native_decoders;	/* media types known to have a decoder installed */
+
 	char *mediatype;
 	gboolean has_audio;
 	gboolean has_non_audio;
@@ -84,9 +95,13 @@ rb_metadata_reset (RBMetaData *md)
 		gst_discoverer_info_unref (md->priv->info);
 		md->priv->info = NULL;
 	}
+	rb_metadata_native_info_clear (&md->priv->native);
+	md->priv->native_loaded = FALSE;
+
 	g_free (md->priv->mediatype);
 	md->priv->mediatype = NULL;
 
+	md->priv->audio_bitrate = 0;
 	md->priv->has_audio = FALSE;
 	md->priv->has_non_audio = FALSE;
 	md->priv->has_video = FALSE;
@@ -100,65 +115,148 @@ have_type_cb (GstElement *element, guint probability, GstCaps *caps, RBMetaData
 }
 
 static void
-run_typefind (RBMetaData *md, const char *uri)
+free_typefind_pipeline (RBMetaData *md)
+{
+	if (md->priv->typefind_pipeline != NULL) {
+		gst_element_set_state (md->priv->typefind_pipeline, GST_STATE_NULL);
+		g_object_unref (md->priv->typefind_pipeline);
+		md->priv->typefind_pipeline = NULL;
+		md->priv->typefind_src = NULL;
+	}
+}
+
+/* returns a typefind pipeline for the URI, reusing the previous one if its source can handle it */
+static GstElement *
+get_typefind_pipeline (RBMetaData *md, const char *uri)
 {
 	GstElement *src;
+	GstElement *pipeline;
+	GstElement *sink;
+	GstElement *typefind;
+
+	if (md->priv->typefind_pipeline != NULL) {
+		if (gst_uri_handler_set_uri (GST_URI_HANDLER (md->priv->typefind_src), uri, NULL))
+			return md->priv->typefind_pipeline;
+
+		rb_debug ("typefind source can't handle %s, creating a new pipeline", uri);
+		free_typefind_pipeline (md);
+	}
 
 	src = gst_element_make_from_uri (GST_URI_SRC, uri, NULL, NULL);
-	if (src != NULL) {
-		GstElement *pipeline = gst_pipeline_new (NULL);
-		GstElement *sink = gst_element_factory_make ("fakesink", NULL);
-		GstElement *typefind = gst_element_factory_make ("typefind", NULL);
-
-		gst_bin_add_many (GST_BIN (pipeline), src, typefind, sink, NULL);
-		if (gst_element_link_many (src, typefind, sink, NULL)) {
-			GstBus *bus;
-			GstMessage *message;
-			gboolean done;
-
-			g_signal_connect (typefind, "have-type", G_CALLBACK (have_type_cb), md);
-
-			bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
-			gst_element_set_state (pipeline, GST_STATE_PAUSED);
-			done = FALSE;
-
-			while (done == FALSE && md->priv->mediatype == NULL) {
-				message = gst_bus_timed_pop (bus, 5 * GST_SECOND);
-				if (message == NULL) {
-					rb_debug ("typefind pass timed out");
-					break;
-				}
+	if (src == NULL)
+		return NULL;
+
+	pipeline = gst_pipeline_new (NULL);
+	sink = gst_element_factory_make ("fakesink", NULL);
+	typefind = gst_element_factory_make ("typefind", NULL);
+
+	gst_bin_add_many (GST_BIN (pipeline), src, typefind, sink, NULL);
+	if (gst_element_link_many (src, typefind, sink, NULL) == FALSE) {
+		g_object_unref (pipeline);
+		return NULL;
+	}
+
+	g_signal_connect (typefind, "have-type", G_CALLBACK (have_type_cb), md);
+	md->priv->typefind_pipeline = gst_object_ref_sink (pipeline);
+	md->priv->typefind_src = src;
+	return pipeline;
+}
+
+static void
+run_typefind (RBMetaData *md, const char *uri)
+{
+	GstElement *pipeline;
+	GstBus *bus;
+	GstMessage *message;
+	gboolean done;
+
+	pipeline = get_typefind_pipeline (md, uri);
+	if (pipeline == NULL)
+		return;
+
+	bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+	gst_element_set_state (pipeline, GST_STATE_PAUSED);
+	done = FALSE;
+
+	while (done == FALSE && md->priv->mediatype == NULL) {
+		message = gst_bus_timed_pop (bus, 5 * GST_SECOND);
+		if (message == NULL) {
+			rb_debug ("typefind pass timed out");
+			break;
+		}
+
+		switch (GST_MESSAGE_TYPE (message)) {
+		case GST_MESSAGE_ERROR:
+			rb_debug ("typefind pass got an error");
+			done = TRUE;
+			break;
 
-				switch (GST_MESSAGE_TYPE (message)) {
-				case GST_MESSAGE_ERROR:
-					rb_debug ("typefind pass got an error");
+		case GST_MESSAGE_STATE_CHANGED:
+			if (GST_MESSAGE_SRC (message) == GST_OBJECT (pipeline)) {
+				GstState old, new, pending;
+				gst_message_parse_state_changed (message, &old, &new, &pending);
+				if (new == GST_STATE_PAUSED && pending == GST_STATE_VOID_PENDING) {
+					rb_debug ("typefind pipeline reached PAUSED");
 					done = TRUE;
-					break;
-
-				case GST_MESSAGE_STATE_CHANGED:
-					if (GST_MESSAGE_SRC (message) == GST_OBJECT (pipeline)) {
-						GstState old, new, pending;
-						gst_message_parse_state_changed (message, &old, &new, &pending);
-						if (new == GST_STATE_PAUSED && pending == GST_STATE_VOID_PENDING) {
-							rb_debug ("typefind pipeline reached PAUSED");
-							done = TRUE;
-						}
-					}
-					break;
-
-				default:
-					break;
 				}
-
-				gst_message_unref (message);
 			}
+			break;
 
-			g_object_unref (bus);
-			gst_element_set_state (GST_ELEMENT (pipeline), GST_STATE_NULL);
+		default:
+			break;
 		}
 
-		g_object_unref (pipeline);
+		gst_message_unref (message);
 	}
+
+	/* discard any remaining messages so the pipeline can be reused */
+	gst_element_set_state (pipeline, GST_STATE_NULL);
+	gst_bus_set_flushing (bus, TRUE);
+	gst_bus_set_flushing (bus, FALSE);
+	g_object_unref (bus);
+}
+
+static const GstTagList *
+get_read_tags (RBMetaData *md)
+{
+	if (md->priv->native_loaded)
+		return md->priv->native.tags;
+	else if (md->priv->info != NULL)
+		return gst_discoverer_info_get_tags (md->priv->info);
+	else
+		return NULL;
+}
+
+/* the native readers don't build a pipeline, so they can't tell us about
+ * missing plugins.  files that can't be decoded are left to the discoverer,
+ * which reports the missing plugin.  only positive results are cached so
+ * newly installed plugins are picked up.
+ */
+static gboolean
+native_decoder_available (RBMetaData *md, const char *media_type)
+{
+	GList *decoders;
+	GList *usable;
+	GstCaps *caps;
+	gboolean available;
+
+	if (g_hash_table_contains (md->priv->native_decoders, media_type))
+		return TRUE;
+
+	caps = rb_gst_media_type_to_caps (media_type);
+	decoders = gst_element_factory_list_get_elements (GST_ELEMENT_FACTORY_TYPE_DECODER, GST_RANK_MARGINAL);
+	usable = gst_element_factory_list_filter (decoders, caps, GST_PAD_SINK, FALSE);
+	available = (usable != NULL);
+	gst_plugin_feature_list_free (usable);
+	gst_plugin_feature_list_free (decoders);
+	gst_caps_unref (caps);
+
+	if (available) {
+		g_hash_table_add (md->priv->native_decoders, g_strdup (media_type));
+	} else {
+		rb_debug ("no decoder for %s, not using native reader", media_type);
+	}
+	return available;
 }
 
 void
@@ -166,18 +264,33 @@ rb_metadata_load (RBMetaData *md, const char *uri, GError **error)
 {
 	GList *streams;
 	GList *l;
-	GstDiscoverer *discoverer;
 	GstCaps *caps;
 	GError *gsterror = NULL;
 
 	rb_metadata_reset (md);
 
-	discoverer = gst_discoverer_new (30 * GST_SECOND, error);
-	if (*error != NULL)
-		return;
+	/* most files can be read from their headers without building a pipeline */
+	if (md->priv->use_native && rb_metadata_native_read (uri, &md->priv->native)) {
+		if (native_decoder_available (md, md->priv->native.media_type)) {
+			md->priv->native_loaded = TRUE;
+			md->priv->has_audio = TRUE;
+			md->priv->audio_bitrate = md->priv->native.bitrate;
+			md->priv->mediatype = g_strdup (md->priv->native.media_type);
+			return;
+		}
+		rb_metadata_native_info_clear (&md->priv->native);
+	}
 
-	md->priv->info = gst_discoverer_discover_uri (discoverer, g_strdup (uri), &gsterror);
-	g_object_unref (discoverer);
+	/* creating a discoverer is expensive compared to reading tags
+	 * from small files, so keep it around for the next one.
+	 */
+	if (md->priv->discoverer == NULL) {
+		md->priv->discoverer = gst_discoverer_new (30 * GST_SECOND, error);
+		if (*error != NULL)
+			return;
+	}
+
+	md->priv->info = gst_discoverer_discover_uri (md->priv->discoverer, uri, &gsterror);
 
 	/* figure out if we've got audio, non-audio, or video streams */
 	streams = gst_discoverer_info_get_streams (md->priv->info, GST_TYPE_DISCOVERER_STREAM_INFO);
@@ -838,13 +951,16 @@ rb_metadata_get (RBMetaData *md, RBMetaDataField field, GValue *ret)
 	const char *v;
 	int i;
 
-	if (md->priv->info == NULL)
+	if (md->priv->info == NULL && md->priv->native_loaded == FALSE)
 		return FALSE;
 
 	/* special cases: mostly duration */
 	switch (field) {
 	case RB_METADATA_FIELD_DURATION:
-		duration = gst_discoverer_info_get_duration (md->priv->info);
+		if (md->priv->native_loaded)
+			duration = md->priv->native.duration;
+		else
+			duration = gst_discoverer_info_get_duration (md->priv->info);
 		if (duration != 0) {
 			g_value_init (ret, G_TYPE_ULONG);
 			g_value_set_ulong (ret, duration / (1000 * 1000 * 1000));
@@ -866,7 +982,7 @@ rb_metadata_get (RBMetaData *md, RBMetaDataField field, GValue *ret)
 		break;
 
 	case RB_METADATA_FIELD_DATE:
-		tags = gst_discoverer_info_get_tags (md->priv->info);
+		tags = get_read_tags (md);
 		if (tags == NULL)
 			return FALSE;
 
@@ -895,7 +1011,7 @@ rb_metadata_get (RBMetaData *md, RBMetaDataField field, GValue *ret)
 			return FALSE;
 		}
 	case RB_METADATA_FIELD_COMMENT:
-		tags = gst_discoverer_info_get_tags (md->priv->info);
+		tags = get_read_tags (md);
 		if (tags == NULL)
 			return FALSE;
 
@@ -929,7 +1045,7 @@ rb_metadata_get (RBMetaData *md, RBMetaDataField field, GValue *ret)
 		break;
 	}
 
-	tags = gst_discoverer_info_get_tags (md->priv->info);
+	tags = get_read_tags (md);
 	if (tags == NULL) {
 		return FALSE;
 	}
@@ -1048,6 +1164,11 @@ rb_metadata_finalize (GObject *object)
 	md = RB_METADATA (object);
 	rb_metadata_reset (md);
 
+	if (md->priv->discoverer != NULL)
+		g_object_unref (md->priv->discoverer);
+	free_typefind_pipeline (md);
+	g_hash_table_destroy (md->priv->native_decoders);
+
 	G_OBJECT_CLASS (rb_metadata_parent_class)->finalize (object);
 }
 
@@ -1058,6 +1179,10 @@ rb_metadata_init (RBMetaData *md)
 
 	md->priv->taggers = g_hash_table_new (g_str_hash, g_str_equal);
 
+	/* RB_METADATA_NO_NATIVE makes everything go through the discoverer, for comparison */
+	md->priv->use_native = (g_getenv ("RB_METADATA_NO_NATIVE") == NULL);
+	md->priv->native_decoders = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
 	if (gst_element_factory_find ("giostreamsink") == FALSE) {
 		rb_debug ("giostreamsink not found, can't tag anything");
 	} else {
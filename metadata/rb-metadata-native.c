@@ -0,0 +1,613 @@
+/*
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+/*
+ * Header-only tag readers for the most common audio formats.
+ *
+ * Reading tags through GstDiscoverer means building and prerolling a
+ * decoding pipeline for every file, even though FLAC, Ogg Vorbis/Opus
+ * and MP3 files with ID3v2 tags keep everything we need in the first
+ * few kilobytes.  These readers parse the headers directly, using the
+ * GStreamer tag library to turn vorbis comments and ID3v2 frames into
+ * a tag list, and estimate the duration from the stream headers.
+ * Anything they don't recognise is left to the discoverer.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <glib/gstdio.h>
+#include <gst/tag/tag.h>
+
+#include "rb-metadata-native.h"
+#include "rb-debug.h"
+
+/* upper limit on the size of tag data we'll read.  embedded cover art
+ * can make tags fairly large, but anything bigger than this is left
+ * to the discoverer.
+ */
+#define MAX_TAG_SIZE		(16 * 1024 * 1024)
+
+/* how far past an ID3v2 tag to look for the first MPEG audio frame */
+#define MPEG_SYNC_SEARCH	(64 * 1024)
+
+/* how much of the end of an Ogg file to search for the last page */
+#define OGG_TAIL_SIZE		(64 * 1024)
+
+typedef struct {
+	FILE *fp;
+	gint64 size;
+} NativeFile;
+
+static gboolean
+read_at (NativeFile *f, gint64 offset, guint8 *buf, gsize len)
+{
+	if (offset < 0 || offset > f->size || (guint64) len > (guint64) (f->size - offset))
+		return FALSE;
+	if (len == 0)
+		return TRUE;
+	if (fseeko (f->fp, (off_t) offset, SEEK_SET) != 0)
+		return FALSE;
+	return (fread (buf, 1, len, f->fp) == len);
+}
+
+static guint
+estimate_bitrate (gint64 bytes, GstClockTime duration)
+{
+	if (bytes <= 0 || duration == 0)
+		return 0;
+	return (guint) gst_util_uint64_scale (bytes, 8 * GST_SECOND, duration);
+}
+
+/* FLAC */
+
+#define FLAC_BLOCK_STREAMINFO		0
+#define FLAC_BLOCK_VORBIS_COMMENT	4
+#define FLAC_BLOCK_INVALID		127
+
+static gboolean
+read_flac (NativeFile *f, RBMetaDataNativeInfo *info)
+{
+	guint8 header[4];
+	guint8 streaminfo[34];
+	gboolean have_streaminfo = FALSE;
+	gboolean last = FALSE;
+	gint64 offset = 4;
+	guint sample_rate = 0;
+	guint64 total_samples = 0;
+
+	while (last == FALSE) {
+		guint type;
+		guint length;
+
+		if (read_at (f, offset, header, sizeof (header)) == FALSE)
+			return FALSE;
+
+		last = (header[0] & 0x80) != 0;
+		type = header[0] & 0x7f;
+		length = GST_READ_UINT24_BE (header + 1);
+		offset += sizeof (header);
+		if (length > f->size - offset) {
+			rb_debug ("flac metadata block extends past the end of the file");
+			return FALSE;
+		}
+
+		switch (type) {
+		case FLAC_BLOCK_STREAMINFO:
+			if (length < sizeof (streaminfo) ||
+			    read_at (f, offset, streaminfo, sizeof (streaminfo)) == FALSE)
+				return FALSE;
+
+			sample_rate = (streaminfo[10] << 12) | (streaminfo[11] << 4) | (streaminfo[12] >> 4);
+			total_samples = ((guint64) (streaminfo[13] & 0x0f) << 32) | GST_READ_UINT32_BE (streaminfo + 14);
+			have_streaminfo = TRUE;
+			break;
+
+		case FLAC_BLOCK_VORBIS_COMMENT:
+			if (info->tags == NULL && length <= MAX_TAG_SIZE) {
+				guint8 *data;
+
+				data = g_malloc (length);
+				if (read_at (f, offset, data, length))
+					info->tags = gst_tag_list_from_vorbiscomment (data, length, NULL, 0, NULL);
+				g_free (data);
+			}
+			break;
+
+		case FLAC_BLOCK_INVALID:
+			return FALSE;
+
+		default:
+			break;
+		}
+
+		offset += length;
+	}
+
+	if (have_streaminfo == FALSE || sample_rate == 0)
+		return FALSE;
+
+	info->media_type = "audio/x-flac";
+	if (total_samples != 0) {
+		info->duration = gst_util_uint64_scale (total_samples, GST_SECOND, sample_rate);
+		info->bitrate = estimate_bitrate (f->size - offset, info->duration);
+	}
+	return TRUE;
+}
+
+/* Ogg */
+
+typedef struct {
+	guint8 header[27];
+	guint8 segments[255];
+	guint nsegments;
+	guint32 serial;
+	gint64 data_offset;
+	gsize data_size;
+} OggPage;
+
+static gboolean
+read_ogg_page (NativeFile *f, gint64 offset, OggPage *page)
+{
+	guint i;
+
+	if (read_at (f, offset, page->header, sizeof (page->header)) == FALSE ||
+	    memcmp (page->header, "OggS", 4) != 0)
+		return FALSE;
+
+	page->serial = GST_READ_UINT32_LE (page->header + 14);
+	page->nsegments = page->header[26];
+	if (read_at (f, offset + sizeof (page->header), page->segments, page->nsegments) == FALSE)
+		return FALSE;
+
+	page->data_offset = offset + sizeof (page->header) + page->nsegments;
+	page->data_size = 0;
+	for (i = 0; i < page->nsegments; i++)
+		page->data_size += page->segments[i];
+
+	return (page->data_size <= f->size - page->data_offset);
+}
+
+/* reads the identification and comment header packets of the first logical stream */
+static gboolean
+read_ogg_headers (NativeFile *f, GByteArray **packets, guint32 *serial, gint64 *end)
+{
+	GByteArray *current;
+	OggPage page;
+	gint64 offset = 0;
+	guint npackets = 0;
+
+	current = g_byte_array_new ();
+	while (npackets < 2) {
+		guint8 *data;
+		gsize pos = 0;
+		guint i;
+
+		if (read_ogg_page (f, offset, &page) == FALSE)
+			break;
+
+		if (offset == 0) {
+			*serial = page.serial;
+		} else if (page.serial != *serial) {
+			/* multiplexed streams are most likely video, so leave them to the discoverer */
+			rb_debug ("found another logical stream in the headers");
+			break;
+		}
+
+		data = g_malloc (page.data_size);
+		if (read_at (f, page.data_offset, data, page.data_size) == FALSE) {
+			g_free (data);
+			break;
+		}
+
+		for (i = 0; i < page.nsegments && npackets < 2; i++) {
+			g_byte_array_append (current, data + pos, page.segments[i]);
+			pos += page.segments[i];
+			if (page.segments[i] < 255) {
+				packets[npackets++] = current;
+				current = g_byte_array_new ();
+			}
+		}
+		g_free (data);
+
+		if (current->len > MAX_TAG_SIZE)
+			break;
+
+		offset = page.data_offset + page.data_size;
+	}
+	g_byte_array_unref (current);
+
+	if (npackets < 2) {
+		if (npackets > 0)
+			g_byte_array_unref (packets[0]);
+		packets[0] = NULL;
+		return FALSE;
+	}
+
+	*end = offset;
+	return TRUE;
+}
+
+static gboolean
+find_last_granule (NativeFile *f, guint32 serial, guint64 *granule)
+{
+	gint64 start;
+	gsize len;
+	guint8 *buf;
+	gssize i;
+	gboolean found = FALSE;
+
+	start = MAX (0, f->size - OGG_TAIL_SIZE);
+	len = f->size - start;
+	buf = g_malloc (len);
+	if (read_at (f, start, buf, len)) {
+		for (i = (gssize) len - 27; i >= 0; i--) {
+			if (memcmp (buf + i, "OggS", 4) != 0 ||
+			    GST_READ_UINT32_LE (buf + i + 14) != serial)
+				continue;
+
+			/* pages that don't complete a packet have no granule position */
+			*granule = GST_READ_UINT64_LE (buf + i + 6);
+			if (*granule != G_MAXUINT64) {
+				found = TRUE;
+				break;
+			}
+		}
+	}
+	g_free (buf);
+	return found;
+}
+
+static gboolean
+read_ogg (NativeFile *f, RBMetaDataNativeInfo *info)
+{
+	GByteArray *packets[2] = { NULL, NULL };
+	const guint8 *id;
+	guint32 serial = 0;
+	gint64 audio_offset = 0;
+	guint64 granule;
+	guint64 preskip = 0;
+	guint sample_rate;
+	gint32 nominal_bitrate = 0;
+	gboolean ret = FALSE;
+
+	if (read_ogg_headers (f, packets, &serial, &audio_offset) == FALSE)
+		return FALSE;
+
+	id = packets[0]->data;
+	if (packets[0]->len >= 30 && memcmp (id, "\001vorbis", 7) == 0 &&
+	    packets[1]->len >= 7 && memcmp (packets[1]->data, "\003vorbis", 7) == 0) {
+		sample_rate = GST_READ_UINT32_LE (id + 12);
+		nominal_bitrate = GST_READ_UINT32_LE (id + 20);
+		info->tags = gst_tag_list_from_vorbiscomment (packets[1]->data, packets[1]->len,
+							      (const guint8 *) "\003vorbis", 7, NULL);
+		info->media_type = "audio/x-vorbis";
+	} else if (packets[0]->len >= 19 && memcmp (id, "OpusHead", 8) == 0 &&
+		   packets[1]->len >= 8 && memcmp (packets[1]->data, "OpusTags", 8) == 0) {
+		/* opus granule positions are always in 48kHz samples */
+		sample_rate = 48000;
+		preskip = GST_READ_UINT16_LE (id + 10);
+		info->tags = gst_tag_list_from_vorbiscomment (packets[1]->data, packets[1]->len,
+							      (const guint8 *) "OpusTags", 8, NULL);
+		info->media_type = "audio/x-opus";
+	} else {
+		rb_debug ("unhandled ogg stream type");
+		goto out;
+	}
+
+	if (sample_rate == 0)
+		goto out;
+
+	if (find_last_granule (f, serial, &granule) && granule > preskip) {
+		info->duration = gst_util_uint64_scale (granule - preskip, GST_SECOND, sample_rate);
+	}
+
+	if (nominal_bitrate > 0) {
+		info->bitrate = nominal_bitrate;
+	} else {
+		info->bitrate = estimate_bitrate (f->size - audio_offset, info->duration);
+	}
+	ret = TRUE;
+out:
+	g_byte_array_unref (packets[0]);
+	g_byte_array_unref (packets[1]);
+	return ret;
+}
+
+/* ID3v2 tagged MPEG 1 layer 3 */
+
+static const guint mpeg_bitrates[2][16] = {
+	{ 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 },	/* MPEG 1 */
+	{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 }		/* MPEG 2, 2.5 */
+};
+
+static const guint mpeg_sample_rates[3][3] = {
+	{ 44100, 48000, 32000 },	/* MPEG 1 */
+	{ 22050, 24000, 16000 },	/* MPEG 2 */
+	{ 11025, 12000, 8000 }		/* MPEG 2.5 */
+};
+
+typedef struct {
+	guint version;
+	gboolean mono;
+	guint bitrate;
+	guint sample_rate;
+	guint samples;
+	guint frame_size;
+} MPEGHeader;
+
+static gboolean
+parse_mpeg_header (const guint8 *h, MPEGHeader *mh)
+{
+	guint layer;
+	guint bitrate_index;
+	guint rate_index;
+	guint padding;
+
+	if (h[0] != 0xff || (h[1] & 0xe0) != 0xe0)
+		return FALSE;
+
+	/* 0: MPEG 2.5, 1: reserved, 2: MPEG 2, 3: MPEG 1 */
+	mh->version = (h[1] >> 3) & 0x03;
+	layer = (h[1] >> 1) & 0x03;
+	bitrate_index = h[2] >> 4;
+	rate_index = (h[2] >> 2) & 0x03;
+	padding = (h[2] >> 1) & 0x01;
+
+	/* only layer 3 with a fixed bitrate index; free format is left to the discoverer */
+	if (mh->version == 1 || layer != 1 || bitrate_index == 0 || bitrate_index == 15 || rate_index == 3)
+		return FALSE;
+
+	mh->mono = ((h[3] >> 6) == 3);
+	mh->bitrate = mpeg_bitrates[mh->version == 3 ? 0 : 1][bitrate_index] * 1000;
+	mh->sample_rate = mpeg_sample_rates[mh->version == 3 ? 0 : (mh->version == 2 ? 1 : 2)][rate_index];
+	mh->samples = (mh->version == 3) ? 1152 : 576;
+	mh->frame_size = (mh->samples / 8) * mh->bitrate / mh->sample_rate + padding;
+	return TRUE;
+}
+
+/* finds the first frame header that is followed by another matching frame header */
+static gssize
+find_mpeg_frame (const guint8 *buf, gsize len, MPEGHeader *mh)
+{
+	MPEGHeader next;
+	gsize i;
+
+	for (i = 0; i + 4 <= len; i++) {
+		if (parse_mpeg_header (buf + i, mh) == FALSE)
+			continue;
+
+		if (i + mh->frame_size + 4 > len)
+			break;
+
+		if (parse_mpeg_header (buf + i + mh->frame_size, &next) &&
+		    next.version == mh->version &&
+		    next.sample_rate == mh->sample_rate)
+			return i;
+	}
+
+	return -1;
+}
+
+static gboolean
+read_id3v2_mp3 (NativeFile *f, RBMetaDataNativeInfo *info)
+{
+	guint8 header[10];
+	guint8 trailer[128];
+	guint8 *data;
+	GstBuffer *buffer;
+	gsize tag_size;
+	gsize len;
+	gssize frame;
+	gint64 audio_offset;
+	gint64 audio_end;
+	guint64 frames = 0;
+	guint64 bytes = 0;
+	MPEGHeader mh;
+	const guint8 *p;
+	guint xing_offset;
+	int i;
+
+	if (read_at (f, 0, header, sizeof (header)) == FALSE)
+		return FALSE;
+
+	for (i = 6; i < 10; i++) {
+		if (header[i] & 0x80)
+			return FALSE;
+	}
+	tag_size = ((header[6] << 21) | (header[7] << 14) | (header[8] << 7) | header[9]) + sizeof (header);
+	if (header[5] & 0x10)
+		tag_size += 10;		/* footer */
+	if (tag_size > MAX_TAG_SIZE)
+		return FALSE;
+
+	/* make sure there's actually mp3 data after the tag before parsing it */
+	audio_offset = tag_size;
+	if (audio_offset >= f->size) {
+		rb_debug ("id3v2 tag extends past the end of the file");
+		return FALSE;
+	}
+	len = MIN (MPEG_SYNC_SEARCH, f->size - audio_offset);
+	data = g_malloc (len);
+	if (read_at (f, audio_offset, data, len) == FALSE) {
+		g_free (data);
+		return FALSE;
+	}
+
+	frame = find_mpeg_frame (data, len, &mh);
+	if (frame < 0) {
+		rb_debug ("no mp3 frames found after id3v2 tag");
+		g_free (data);
+		return FALSE;
+	}
+	audio_offset += frame;
+	p = data + frame;
+
+	/* look for a Xing/Info or VBRI header in the first frame */
+	if (mh.version == 3)
+		xing_offset = 4 + (mh.mono ? 17 : 32);
+	else
+		xing_offset = 4 + (mh.mono ? 9 : 17);
+
+	if ((gsize) frame + xing_offset + 16 <= len &&
+	    (memcmp (p + xing_offset, "Xing", 4) == 0 || memcmp (p + xing_offset, "Info", 4) == 0)) {
+		guint32 flags;
+		const guint8 *x;
+
+		x = p + xing_offset + 4;
+		flags = GST_READ_UINT32_BE (x);
+		x += 4;
+		if (flags & 0x01) {
+			frames = GST_READ_UINT32_BE (x);
+			x += 4;
+		}
+		if (flags & 0x02)
+			bytes = GST_READ_UINT32_BE (x);
+	} else if ((gsize) frame + 4 + 32 + 18 <= len && memcmp (p + 4 + 32, "VBRI", 4) == 0) {
+		bytes = GST_READ_UINT32_BE (p + 4 + 32 + 10);
+		frames = GST_READ_UINT32_BE (p + 4 + 32 + 14);
+	}
+	g_free (data);
+
+	/* the tag itself */
+	data = g_malloc (tag_size);
+	if (read_at (f, 0, data, tag_size) == FALSE) {
+		g_free (data);
+		return FALSE;
+	}
+	buffer = gst_buffer_new_wrapped (data, tag_size);
+	info->tags = gst_tag_list_from_id3v2_tag (buffer);
+	gst_buffer_unref (buffer);
+
+	/* an id3v1 tag at the end isn't audio data, but may fill in gaps in the id3v2 tag */
+	audio_end = f->size;
+	if (read_at (f, f->size - sizeof (trailer), trailer, sizeof (trailer)) &&
+	    memcmp (trailer, "TAG", 3) == 0) {
+		GstTagList *v1;
+
+		audio_end -= sizeof (trailer);
+		v1 = gst_tag_list_new_from_id3v1 (trailer);
+		if (v1 != NULL && info->tags != NULL) {
+			gst_tag_list_insert (info->tags, v1, GST_TAG_MERGE_KEEP);
+			gst_tag_list_unref (v1);
+		} else if (v1 != NULL) {
+			info->tags = v1;
+		}
+	}
+
+	info->media_type = "audio/mpeg";
+	if (frames != 0) {
+		info->duration = gst_util_uint64_scale (frames * mh.samples, GST_SECOND, mh.sample_rate);
+		info->bitrate = estimate_bitrate (bytes != 0 ? (gint64) bytes : audio_end - audio_offset, info->duration);
+	} else {
+		/* assume constant bitrate */
+		info->bitrate = mh.bitrate;
+		if (audio_end > audio_offset)
+			info->duration = gst_util_uint64_scale (audio_end - audio_offset, 8 * GST_SECOND, mh.bitrate);
+	}
+	return TRUE;
+}
+
+/**
+ * rb_metadata_native_read:
+ * @uri: URI of the file to read
+ * @info: returns the tags and stream details
+ *
+ * Attempts to read tags and stream details for a local file by parsing
+ * its headers directly.  FLAC, Ogg Vorbis, Ogg Opus and MP3 files with
+ * ID3v2 tags are recognised.
+ *
+ * Return value: %TRUE if the file was recognised and read, %FALSE if
+ *   it should be read some other way.
+ */
+gboolean
+rb_metadata_native_read (const char *uri, RBMetaDataNativeInfo *info)
+{
+	NativeFile f;
+	GStatBuf st;
+	char *filename;
+	guint8 magic[4];
+	gboolean ret = FALSE;
+
+	memset (info, 0, sizeof (*info));
+
+	filename = g_filename_from_uri (uri, NULL, NULL);
+	if (filename == NULL)
+		return FALSE;
+
+	if (g_stat (filename, &st) != 0 || S_ISREG (st.st_mode) == FALSE) {
+		g_free (filename);
+		return FALSE;
+	}
+
+	f.size = st.st_size;
+	f.fp = g_fopen (filename, "rb");
+	g_free (filename);
+	if (f.fp == NULL)
+		return FALSE;
+
+	if (read_at (&f, 0, magic, sizeof (magic))) {
+		if (memcmp (magic, "fLaC", 4) == 0) {
+			ret = read_flac (&f, info);
+		} else if (memcmp (magic, "OggS", 4) == 0) {
+			ret = read_ogg (&f, info);
+		} else if (memcmp (magic, "ID3", 3) == 0) {
+			ret = read_id3v2_mp3 (&f, info);
+		}
+	}
+	fclose (f.fp);
+
+	if (ret == FALSE) {
+		rb_metadata_native_info_clear (info);
+		return FALSE;
+	}
+
+	if (info->tags == NULL)
+		info->tags = gst_tag_list_new_empty ();
+
+	rb_debug ("read %s natively: %s, duration %" GST_TIME_FORMAT ", bitrate %u",
+		  uri, info->media_type, GST_TIME_ARGS (info->duration), info->bitrate);
+	return TRUE;
+}
+
+/**
+ * rb_metadata_native_info_clear:
+ * @info: a #RBMetaDataNativeInfo
+ *
+ * Frees the contents of @info and resets it.
+ */
+void
+rb_metadata_native_info_clear (RBMetaDataNativeInfo *info)
+{
+	if (info->tags != NULL)
+		gst_tag_list_unref (info->tags);
+	memset (info, 0, sizeof (*info));
+}
@@ -138,6 +138,25 @@ void		rb_metadata_load	(RBMetaData *md,
 					 const char *uri,
 					 GError **error);
 
+/**
+ * RBMetaDataBatchFunc:
+ * @md: the #RBMetaData, holding the metadata loaded from @uri
+ * @uri: the URI that was loaded
+ * @error: error information for @uri, or %NULL
+ * @data: user data
+ *
+ * Called by rb_metadata_load_batch() as each URI is loaded.
+ * The metadata is only valid until the callback returns.
+ *
+ * Return value: %FALSE to stop loading the rest of the batch
+ */
+typedef gboolean (*RBMetaDataBatchFunc) (RBMetaData *md, const char *uri, const GError *error, gpointer data);
+
+void		rb_metadata_load_batch	(RBMetaData *md,
+					 const char * const *uris,
+					 RBMetaDataBatchFunc func,
+					 gpointer data);
+
 void		rb_metadata_save	(RBMetaData *md,
 					 const char *uri,
 					 GError **error);
@@ -1325,13 +1325,15 @@ static void
 elapsed_nano_changed_cb (RBShellPlayer *player, gint64 elapsed, RBMprisPlugin *plugin)
 {
 	/* interpret any change in the elapsed time other than an
-	 * increase of less than one second as a seek.  this includes
-	 * the seek back that we do after pausing (with crossfading),
-	 * which we intentionally report as a seek to help clients get
-	 * their time displays right.
+	 * increase of less than two seconds as a seek.  ticks only arrive
+	 * about once a second unless someone asks for more, and may be a
+	 * little more than a second apart.  this includes the seek back
+	 * that we do after pausing (with crossfading), which we
+	 * intentionally report as a seek to help clients get their time
+	 * displays right.
 	 */
 	if (elapsed >= plugin->last_elapsed &&
-	    (elapsed - plugin->last_elapsed < (G_USEC_PER_SEC * 1000))) {
+	    (elapsed - plugin->last_elapsed < ((gint64) 2 * G_USEC_PER_SEC * 1000))) {
 		plugin->last_elapsed = elapsed;
 		return;
 	}
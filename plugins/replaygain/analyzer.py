@@ -0,0 +1,100 @@
+# -*- Mode: python; coding: utf-8; tab-width: 8; indent-tabs-mode: t; -*-
+#
+# Copyright (C) 2026 Rhythmbox contributors
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2, or (at your option)
+# any later version.
+#
+# The Rhythmbox authors hereby grant permission for non-GPL compatible
+# GStreamer plugins to be used and distributed together with GStreamer
+# and Rhythmbox. This permission is above and beyond the permissions granted
+# by the GPL license by which Rhythmbox is covered. If you modify this code
+# you may extend this exception to your version of the code, but you are not
+# obligated to do so. If you do not wish to do so, delete this exception
+# statement from your version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+#
+
+from gi.repository import RB
+from gi.repository import GLib, Gio
+
+# seconds to wait after tracks are added before analyzing them, so
+# tracks from the same album get analyzed together
+QUEUE_DELAY = 10
+
+class ReplayGainAnalyzer(object):
+	def __init__(self, shell):
+		self.db = shell.props.db
+		self.settings = Gio.Settings.new("org.gnome.rhythmbox.plugins.replaygain")
+
+		self.analyzer = None
+		self.added = []
+		self.queue_id = 0
+		self.entry_added_id = 0
+
+		self.analyze_changed_id = self.settings.connect("changed::analyze", self.analyze_changed_cb)
+		self.analyze_changed_cb(self.settings, "analyze")
+
+	def deactivate(self):
+		self.settings.disconnect(self.analyze_changed_id)
+		self.stop()
+		self.db = None
+
+	def analyze_changed_cb(self, settings, key):
+		if settings['analyze']:
+			self.start()
+		else:
+			self.stop()
+
+	def start(self):
+		if self.analyzer is not None:
+			return
+
+		print("starting background replaygain analysis")
+		self.analyzer = RB.LoudnessAnalyzer.new(self.db)
+		self.settings.bind("write-tags", self.analyzer, "write-tags", Gio.SettingsBindFlags.GET)
+		self.entry_added_id = self.db.connect("entry-added", self.entry_added_cb)
+		self.analyzer.queue_missing()
+
+	def stop(self):
+		if self.analyzer is None:
+			return
+
+		print("stopping background replaygain analysis")
+		self.db.disconnect(self.entry_added_id)
+		self.entry_added_id = 0
+		if self.queue_id != 0:
+			GLib.source_remove(self.queue_id)
+			self.queue_id = 0
+		self.added = []
+
+		self.analyzer.cancel()
+		Gio.Settings.unbind(self.analyzer, "write-tags")
+		self.analyzer = None
+
+	def entry_added_cb(self, db, entry):
+		if entry.get_entry_type().props.name != "song":
+			return
+		if entry.get_double(RB.RhythmDBPropType.TRACK_PEAK) > 0.0:
+			return
+
+		self.added.append(entry)
+		if self.queue_id == 0:
+			self.queue_id = GLib.timeout_add_seconds(QUEUE_DELAY, self.queue_added_cb)
+
+	def queue_added_cb(self):
+		print("queueing %d new tracks for replaygain analysis" % len(self.added))
+		self.analyzer.queue_entries(self.added)
+		self.added = []
+		self.queue_id = 0
+		return False
@@ -68,6 +68,13 @@ class ReplayGainConfig(GObject.Object, PeasGtk.Configurable):
 		limiter = self.builder.get_object("limiter")
 		self.settings.bind("limiter", limiter, "active", Gio.SettingsBindFlags.DEFAULT)
 
+		analyze = self.builder.get_object("analyze")
+		self.settings.bind("analyze", analyze, "active", Gio.SettingsBindFlags.DEFAULT)
+
+		writetags = self.builder.get_object("writetags")
+		self.settings.bind("write-tags", writetags, "active", Gio.SettingsBindFlags.DEFAULT)
+		self.settings.bind("analyze", writetags, "sensitive", Gio.SettingsBindFlags.GET)
+
 		return content
 
 	def preamp_changed_cb(self, preamp):
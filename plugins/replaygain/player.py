@@ -55,6 +55,7 @@ class ReplayGainPlayer(object):
 
 		self.shell_player = shell.props.shell_player
 		self.player = self.shell_player.props.player
+		self.db = shell.props.db
 		self.settings = Gio.Settings.new("org.gnome.rhythmbox.plugins.replaygain")
 
 		self.settings.connect("changed::limiter", self.limiter_changed_cb)
@@ -77,9 +78,21 @@ class ReplayGainPlayer(object):
 		self.deactivate_backend()
 		self.player = None
 		self.shell_player = None
+		self.db = None
 
 
-	def set_rgvolume(self, rgvolume):
+	def entry_fallback_gain(self, entry):
+		# use the analyzed gain for the entry if there is one, otherwise
+		# the average of the gain values seen for previous tracks
+		if entry is None or entry.get_double(RB.RhythmDBPropType.TRACK_PEAK) <= 0.0:
+			return self.fallback_gain
+
+		if self.settings.get_enum('mode') == config.REPLAYGAIN_MODE_ALBUM and \
+		   entry.get_double(RB.RhythmDBPropType.ALBUM_PEAK) > 0.0:
+			return entry.get_double(RB.RhythmDBPropType.ALBUM_GAIN)
+		return entry.get_double(RB.RhythmDBPropType.TRACK_GAIN)
+
+	def set_rgvolume(self, rgvolume, entry=None):
 		# set preamp level
 		preamp = self.settings['preamp']
 		rgvolume.props.pre_amp = preamp
@@ -94,7 +107,7 @@ class ReplayGainPlayer(object):
 			rgvolume.props.album_mode = 0
 
 		# set calculated fallback gain
-		rgvolume.props.fallback_gain = self.fallback_gain
+		rgvolume.props.fallback_gain = self.entry_fallback_gain(entry)
 
 		print("updated rgvolume settings: preamp %f, album-mode %s, fallback gain %f" % (
 			rgvolume.props.pre_amp, str(rgvolume.props.album_mode), rgvolume.props.fallback_gain))
@@ -125,6 +138,9 @@ class ReplayGainPlayer(object):
 	def playbin_target_gain_cb(self, rgvolume, pspec):
 		self.update_fallback_gain(rgvolume)
 
+	def playbin_song_changed_cb(self, shell_player, entry):
+		self.rgvolume.props.fallback_gain = self.entry_fallback_gain(entry)
+
 	def setup_playbin_mode(self):
 		print("using output filter for rgvolume and rglimiter")
 		self.rgfilter = Gst.Bin()
@@ -141,8 +157,11 @@ class ReplayGainPlayer(object):
 		self.rgvolume.link(self.rglimiter)
 
 		self.player.add_filter(self.rgfilter)
+		self.song_changed_id = self.shell_player.connect("playing-song-changed", self.playbin_song_changed_cb)
 
 	def deactivate_playbin_mode(self):
+		self.shell_player.disconnect(self.song_changed_id)
+		self.song_changed_id = None
 		self.player.remove_filter(self.rgfilter)
 		self.rgfilter = None
 
@@ -158,7 +177,7 @@ class ReplayGainPlayer(object):
 		print("creating rgvolume instance for stream %s" % uri)
 		rgvolume = Gst.ElementFactory.make("rgvolume", None)
 		rgvolume.connect("notify::target-gain", self.multi_target_gain_cb)
-		self.set_rgvolume(rgvolume)
+		self.set_rgvolume(rgvolume, self.db.entry_lookup_by_location(uri))
 
 		print("creating rglimiter instance for stream %s" % uri)
 		self.rglimiter = Gst.ElementFactory.make("rglimiter", None)
@@ -31,6 +31,7 @@ from gi.repository import RB
 
 from config import ReplayGainConfig
 from player import ReplayGainPlayer
+from analyzer import ReplayGainAnalyzer
 
 class ReplayGainPlugin(GObject.Object, Peas.Activatable):
 	__gtype_name__ = 'ReplayGainPlugin'
@@ -42,8 +43,11 @@ class ReplayGainPlugin(GObject.Object, Peas.Activatable):
 
 	def do_activate (self):
 		self.player = ReplayGainPlayer(self.object)
+		self.analyzer = ReplayGainAnalyzer(self.object)
 
 	def do_deactivate (self):
 		self.config_dialog = None
 		self.player.deactivate()
 		self.player = None
+		self.analyzer.deactivate()
+		self.analyzer = None
@@ -33,26 +33,164 @@
 #include "rb-cut-and-paste-code.h"
 #include "rb-refstring.h"
 
-GHashTable *rb_refstrings;
-GMutex rb_refstrings_mutex;
+/*
+ * Refstrings are interned in a number of shards, selected by the string's
+ * hash, each with its own lock and hash table, so threads interning
+ * different strings (the metadata and database loading threads, for
+ * instance) rarely contend with each other.
+ *
+ * The refstrings and their cached folded and sort key strings are allocated
+ * from per-shard slabs of fixed size blocks rather than individually with
+ * g_malloc.  Freed blocks are kept on per-size free lists for reuse; slab
+ * memory is only returned to the system on shutdown.  Strings too large for
+ * any block size are allocated with g_malloc.
+ */
+
+#define RB_REFSTRING_SHARDS		32
+#define RB_REFSTRING_BLOCK_ALIGN	16
+#define RB_REFSTRING_MAX_BLOCK		512
+#define RB_REFSTRING_BLOCK_CLASSES	(RB_REFSTRING_MAX_BLOCK / RB_REFSTRING_BLOCK_ALIGN)
+#define RB_REFSTRING_SLAB_SIZE		(64 * 1024)
+
+typedef struct
+{
+	GMutex lock;
+	GHashTable *strings;
+
+	GSList *slabs;
+	char *slab_pos;
+	gsize slab_left;
+	gpointer free_blocks[RB_REFSTRING_BLOCK_CLASSES];
+
+	gsize bytes_used;
+	gsize bytes_allocated;
+	guint64 lock_count;
+	guint64 contended_count;
+} RBRefStringShard;
+
+static RBRefStringShard rb_refstring_shards[RB_REFSTRING_SHARDS];
 
 struct RBRefString
 {
 	gint refcount;
+	guint shard;
 	gpointer folded;
 	gpointer sortkey;
 	char value[1];
 };
 
+static guint
+get_shard_index (const char *str)
+{
+	guint hash = g_str_hash (str);
+	return (hash ^ (hash >> 16)) % RB_REFSTRING_SHARDS;
+}
+
+static void
+shard_lock (RBRefStringShard *shard)
+{
+	if (g_mutex_trylock (&shard->lock) == FALSE) {
+		g_mutex_lock (&shard->lock);
+		shard->contended_count++;
+	}
+	shard->lock_count++;
+}
+
+/* must be called with the shard locked */
+static gpointer
+shard_alloc (RBRefStringShard *shard, gsize size)
+{
+	gpointer block;
+	guint cls;
+
+	shard->bytes_used += size;
+	if (size > RB_REFSTRING_MAX_BLOCK) {
+		shard->bytes_allocated += size;
+		return g_malloc (size);
+	}
+
+	cls = (size - 1) / RB_REFSTRING_BLOCK_ALIGN;
+	block = shard->free_blocks[cls];
+	if (block != NULL) {
+		shard->free_blocks[cls] = *(gpointer *) block;
+		return block;
+	}
+
+	size = (cls + 1) * RB_REFSTRING_BLOCK_ALIGN;
+	if (shard->slab_left < size) {
+		/* the rest of the current slab is wasted; it's smaller than the largest block */
+		shard->slab_pos = g_malloc (RB_REFSTRING_SLAB_SIZE);
+		shard->slab_left = RB_REFSTRING_SLAB_SIZE;
+		shard->slabs = g_slist_prepend (shard->slabs, shard->slab_pos);
+		shard->bytes_allocated += RB_REFSTRING_SLAB_SIZE;
+	}
+
+	block = shard->slab_pos;
+	shard->slab_pos += size;
+	shard->slab_left -= size;
+	return block;
+}
+
+/* must be called with the shard locked */
+static void
+shard_free (RBRefStringShard *shard, gpointer block, gsize size)
+{
+	guint cls;
+
+	shard->bytes_used -= size;
+	if (size > RB_REFSTRING_MAX_BLOCK) {
+		shard->bytes_allocated -= size;
+		g_free (block);
+		return;
+	}
+
+	cls = (size - 1) / RB_REFSTRING_BLOCK_ALIGN;
+	*(gpointer *) block = shard->free_blocks[cls];
+	shard->free_blocks[cls] = block;
+}
+
+/* copies a string into a block allocated from the refstring's shard */
+static char *
+shard_strdup (RBRefString *val, const char *str)
+{
+	RBRefStringShard *shard = &rb_refstring_shards[val->shard];
+	gsize len = strlen (str) + 1;
+	char *copy;
+
+	shard_lock (shard);
+	copy = shard_alloc (shard, len);
+	g_mutex_unlock (&shard->lock);
+
+	memcpy (copy, str, len);
+	return copy;
+}
+
+static void
+shard_strfree (RBRefString *val, char *str)
+{
+	RBRefStringShard *shard = &rb_refstring_shards[val->shard];
+
+	shard_lock (shard);
+	shard_free (shard, str, strlen (str) + 1);
+	g_mutex_unlock (&shard->lock);
+}
+
+/* must be called with the shard locked */
 static void
 rb_refstring_free (RBRefString *refstr)
 {
+	RBRefStringShard *shard = &rb_refstring_shards[refstr->shard];
+
 	refstr->refcount = 0xdeadbeef;
-	g_free (refstr->folded);
-	refstr->folded = NULL;
-	g_free (refstr->sortkey);
-	refstr->sortkey = NULL;
-	g_free (refstr);
+	if (refstr->folded != NULL) {
+		shard_free (shard, refstr->folded, strlen (refstr->folded) + 1);
+		refstr->folded = NULL;
+	}
+	if (refstr->sortkey != NULL) {
+		shard_free (shard, refstr->sortkey, strlen (refstr->sortkey) + 1);
+		refstr->sortkey = NULL;
+	}
+	shard_free (shard, refstr, sizeof (RBRefString) + strlen (refstr->value));
 }
 
 /**
@@ -63,8 +201,15 @@ rb_refstring_free (RBRefString *refstr)
 void
 rb_refstring_system_init (void)
 {
-	rb_refstrings = g_hash_table_new_full (g_str_hash, g_str_equal,
-					       NULL, (GDestroyNotify) rb_refstring_free);
+	int i;
+
+	for (i = 0; i < RB_REFSTRING_SHARDS; i++) {
+		RBRefStringShard *shard = &rb_refstring_shards[i];
+
+		memset (shard, 0, sizeof (RBRefStringShard));
+		g_mutex_init (&shard->lock);
+		shard->strings = g_hash_table_new (g_str_hash, g_str_equal);
+	}
 }
 
 /**
@@ -80,26 +225,36 @@ rb_refstring_system_init (void)
 RBRefString *
 rb_refstring_new (const char *init)
 {
+	RBRefStringShard *shard;
 	RBRefString *ret;
+	guint index;
+	gsize len;
 
-	g_mutex_lock (&rb_refstrings_mutex);
-	ret = g_hash_table_lookup (rb_refstrings, init);
+	index = get_shard_index (init);
+	shard = &rb_refstring_shards[index];
+
+	shard_lock (shard);
+	ret = g_hash_table_lookup (shard->strings, init);
 
 	if (ret) {
-		rb_refstring_ref (ret);
-		g_mutex_unlock (&rb_refstrings_mutex);
+		/* the count may have just dropped to zero in rb_refstring_unref,
+		 * which rechecks it once it has the shard lock */
+		g_atomic_int_inc (&ret->refcount);
+		g_mutex_unlock (&shard->lock);
 		return ret;
 	}
 
-	ret = g_malloc (sizeof (RBRefString) + strlen (init));
+	len = strlen (init);
+	ret = shard_alloc (shard, sizeof (RBRefString) + len);
 
-	g_strlcpy (ret->value, init, strlen (init) + 1);
+	memcpy (ret->value, init, len + 1);
 	g_atomic_int_set (&ret->refcount, 1);
+	ret->shard = index;
 	ret->folded = NULL;
 	ret->sortkey = NULL;
 
-	g_hash_table_insert (rb_refstrings, ret->value, ret);
-	g_mutex_unlock (&rb_refstrings_mutex);
+	g_hash_table_insert (shard->strings, ret->value, ret);
+	g_mutex_unlock (&shard->lock);
 	return ret;
 }
 
@@ -116,15 +271,18 @@ rb_refstring_new (const char *init)
 RBRefString *
 rb_refstring_find (const char *init)
 {
+	RBRefStringShard *shard;
 	RBRefString *ret;
 
-	g_mutex_lock (&rb_refstrings_mutex);
-	ret = g_hash_table_lookup (rb_refstrings, init);
+	shard = &rb_refstring_shards[get_shard_index (init)];
+
+	shard_lock (shard);
+	ret = g_hash_table_lookup (shard->strings, init);
 
 	if (ret)
-		rb_refstring_ref (ret);
+		g_atomic_int_inc (&ret->refcount);
 
-	g_mutex_unlock (&rb_refstrings_mutex);
+	g_mutex_unlock (&shard->lock);
 	return ret;
 }
 
@@ -144,12 +302,16 @@ rb_refstring_unref (RBRefString *val)
 	g_return_if_fail (g_atomic_int_get (&val->refcount) > 0);
 
 	if (g_atomic_int_dec_and_test (&val->refcount)) {
-		g_mutex_lock (&rb_refstrings_mutex);
+		RBRefStringShard *shard = &rb_refstring_shards[val->shard];
+
+		shard_lock (shard);
 		/* ensure it's still not referenced, as something may have called
 		 * rb_refstring_new since we decremented the count */
-		if (g_atomic_int_get (&val->refcount) == 0)
-			g_hash_table_remove (rb_refstrings, val->value);
-		g_mutex_unlock (&rb_refstrings_mutex);
+		if (g_atomic_int_get (&val->refcount) == 0) {
+			g_hash_table_remove (shard->strings, val->value);
+			rb_refstring_free (val);
+		}
+		g_mutex_unlock (&shard->lock);
 	}
 }
 
@@ -162,7 +324,51 @@ rb_refstring_unref (RBRefString *val)
 void
 rb_refstring_system_shutdown (void)
 {
-	g_hash_table_destroy (rb_refstrings);
+	int i;
+
+	for (i = 0; i < RB_REFSTRING_SHARDS; i++) {
+		RBRefStringShard *shard = &rb_refstring_shards[i];
+		GHashTableIter iter;
+		gpointer value;
+
+		/* strings too large for the slabs are allocated separately */
+		g_hash_table_iter_init (&iter, shard->strings);
+		while (g_hash_table_iter_next (&iter, NULL, &value)) {
+			rb_refstring_free (value);
+		}
+		g_hash_table_destroy (shard->strings);
+		shard->strings = NULL;
+
+		g_slist_free_full (shard->slabs, g_free);
+		shard->slabs = NULL;
+		g_mutex_clear (&shard->lock);
+	}
+}
+
+/**
+ * rb_refstring_get_stats:
+ * @stats: (out caller-allocates): returns the statistics
+ *
+ * Collects statistics about the refstring table, for use in benchmarks and
+ * debugging.
+ */
+void
+rb_refstring_get_stats (RBRefStringStats *stats)
+{
+	int i;
+
+	memset (stats, 0, sizeof (RBRefStringStats));
+	for (i = 0; i < RB_REFSTRING_SHARDS; i++) {
+		RBRefStringShard *shard = &rb_refstring_shards[i];
+
+		g_mutex_lock (&shard->lock);
+		stats->strings += g_hash_table_size (shard->strings);
+		stats->bytes_used += shard->bytes_used;
+		stats->bytes_allocated += shard->bytes_allocated;
+		stats->lock_count += shard->lock_count;
+		stats->contended_count += shard->contended_count;
+		g_mutex_unlock (&shard->lock);
+	}
 }
 
 /**
@@ -231,12 +437,15 @@ rb_refstring_get_folded (RBRefString *val)
 	string = (const char*)g_atomic_pointer_get (ptr);
 	if (string == NULL) {
 		char *newstring;
+		char *folded;
 
-		newstring = rb_search_fold (rb_refstring_get (val));
+		folded = rb_search_fold (rb_refstring_get (val));
+		newstring = shard_strdup (val, folded);
+		g_free (folded);
 		if (g_atomic_pointer_compare_and_exchange (ptr, NULL, newstring)) {
 			string = newstring;
 		} else {
-			g_free (newstring);
+			shard_strfree (val, newstring);
 			string = (const char *)g_atomic_pointer_get (ptr);
 			g_assert (string);
 		}
@@ -270,16 +479,19 @@ rb_refstring_get_sort_key (RBRefString *val)
 	string = (const char *)g_atomic_pointer_get (ptr);
 	if (string == NULL) {
 		char *newstring;
+		char *key;
 		char *s;
 
 		s = g_utf8_casefold (val->value, -1);
-		newstring = g_utf8_collate_key_for_filename (s, -1);
+		key = g_utf8_collate_key_for_filename (s, -1);
+		newstring = shard_strdup (val, key);
+		g_free (key);
 		g_free (s);
 
 		if (g_atomic_pointer_compare_and_exchange (ptr, NULL, newstring)) {
 			string = newstring;
 		} else {
-			g_free (newstring);
+			shard_strfree (val, newstring);
 			string = (const char*)g_atomic_pointer_get (ptr);
 			g_assert (string);
 		}
@@ -35,6 +35,14 @@
 
 typedef struct RBRefString RBRefString;
 
+typedef struct {
+	guint strings;
+	gsize bytes_used;
+	gsize bytes_allocated;
+	guint64 lock_count;
+	guint64 contended_count;
+} RBRefStringStats;
+
 void		rb_refstring_system_init (void);
 void		rb_refstring_system_shutdown (void);
 
@@ -53,4 +61,6 @@ gboolean rb_refstring_equal (gconstpointer ap, gconstpointer bp);
 
 GType rb_refstring_get_type (void);
 
+void		rb_refstring_get_stats (RBRefStringStats *stats);
+
 #endif
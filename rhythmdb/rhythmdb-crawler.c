@@ -0,0 +1,726 @@
+/*
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+/*
+ * Directory crawler for import jobs.
+ *
+ * Directories are enumerated on a pool of worker threads, so a deep tree
+ * on a high latency file system (NFS, SMB) has many directory listings
+ * in flight at once rather than one.  Files found are handed to the
+ * callback on the main thread in batches.  Workers stop producing when
+ * too many files are waiting for the main thread, so memory use stays
+ * bounded however fast the tree can be listed.
+ *
+ * The crawler can also remember the modification time and contents of
+ * each directory it lists.  A directory whose modification time hasn't
+ * changed since the last crawl can't have gained or lost any files, so
+ * its files are passed to the callback from the saved state, with no
+ * file information, and only its subdirectories need to be checked.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "rhythmdb-crawler.h"
+#include "rb-debug.h"
+#include "rb-util.h"
+
+/* number of directories listed at once, unless set otherwise.
+ * listing is mostly waiting for I/O, so this doesn't depend on the CPU count.
+ */
+#define RHYTHMDB_CRAWLER_DEFAULT_WORKERS	8
+
+/* workers wait once this many files are waiting to be handled on the main thread */
+#define RHYTHMDB_CRAWLER_MAX_PENDING_FILES	1024
+
+/* files are handed to the main thread in batches of this size */
+#define RHYTHMDB_CRAWLER_BATCH_SIZE		64
+
+/* maximum time to spend handling files in one main loop iteration (microseconds) */
+#define RHYTHMDB_CRAWLER_IDLE_TIME		(20 * 1000)
+
+#define RHYTHMDB_CRAWLER_STATE_VERSION		1
+#define RHYTHMDB_CRAWLER_STATE_TYPE		"(ua(stasas))"
+
+/* includes everything needed for RhythmDB stat events, so files can be passed straight on */
+static const char *crawl_attributes =
+	G_FILE_ATTRIBUTE_STANDARD_NAME ","
+	G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME ","
+	G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+	G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+	G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
+	G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK ","
+	G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET ","
+	G_FILE_ATTRIBUTE_ID_FILE ","
+	G_FILE_ATTRIBUTE_ACCESS_CAN_READ ","
+	G_FILE_ATTRIBUTE_TIME_MODIFIED;
+
+typedef struct {
+	guint64 mtime;
+	char **subdirs;
+	char **files;
+} RhythmDBCrawlerDir;
+
+typedef struct {
+	GFile *file;
+	GFileInfo *info;
+} RhythmDBCrawlerFile;
+
+struct _RhythmDBCrawler
+{
+	GCancellable *cancel;
+	gulong cancel_id;
+	RBUriRecurseFunc func;
+	gpointer data;
+	GDestroyNotify done;
+
+	guint workers;
+	GThreadPool *pool;
+	GSList *roots;
+
+	/* state from the previous crawl; not modified while crawling */
+	GHashTable *old_state;
+
+	GMutex lock;
+	GCond space;
+	GHashTable *handled;
+	GHashTable *new_state;
+	GQueue *batches;
+	guint pending_files;
+	guint active_dirs;
+	guint idle_id;
+	gboolean finished;
+
+	guint listed_dirs;
+	guint skipped_dirs;
+	guint files;
+	gint64 start_time;
+};
+
+static void
+free_crawler_dir (RhythmDBCrawlerDir *dir)
+{
+	g_strfreev (dir->subdirs);
+	g_strfreev (dir->files);
+	g_free (dir);
+}
+
+static void
+free_crawler_file (RhythmDBCrawlerFile *file)
+{
+	g_object_unref (file->file);
+	g_clear_object (&file->info);
+	g_free (file);
+}
+
+static gboolean
+should_process (GFileInfo *info)
+{
+	/* check that the file is non-hidden and readable */
+	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_ACCESS_CAN_READ) &&
+	    g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_READ) == FALSE)
+		return FALSE;
+
+	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN) &&
+	    g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN))
+		return FALSE;
+
+	return TRUE;
+}
+
+static gboolean
+is_directory (GFileInfo *info)
+{
+	switch (g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_STANDARD_TYPE)) {
+	case G_FILE_TYPE_DIRECTORY:
+	case G_FILE_TYPE_MOUNTABLE:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static void
+crawl_done (RhythmDBCrawler *crawler)
+{
+	rb_debug ("crawl finished in %" G_GINT64_FORMAT " ms: %u directories listed, %u skipped, %u files",
+		  (g_get_monotonic_time () - crawler->start_time) / 1000,
+		  crawler->listed_dirs,
+		  crawler->skipped_dirs,
+		  crawler->files);
+
+	/* this may free the crawler */
+	if (crawler->done)
+		crawler->done (crawler->data);
+}
+
+static gboolean
+process_batches_idle (RhythmDBCrawler *crawler)
+{
+	GPtrArray *batch;
+	gint64 until;
+	gboolean finished;
+
+	until = g_get_monotonic_time () + RHYTHMDB_CRAWLER_IDLE_TIME;
+
+	g_mutex_lock (&crawler->lock);
+	while ((batch = g_queue_pop_head (crawler->batches)) != NULL) {
+		guint i;
+
+		g_mutex_unlock (&crawler->lock);
+		for (i = 0; i < batch->len; i++) {
+			RhythmDBCrawlerFile *f = g_ptr_array_index (batch, i);
+
+			if (g_cancellable_is_cancelled (crawler->cancel))
+				break;
+
+			if ((crawler->func) (f->file, f->info, crawler->data) == FALSE) {
+				rb_debug ("callback returned false");
+				g_cancellable_cancel (crawler->cancel);
+			}
+		}
+
+		g_mutex_lock (&crawler->lock);
+		crawler->pending_files -= batch->len;
+		g_cond_broadcast (&crawler->space);
+		g_ptr_array_unref (batch);
+
+		if (g_get_monotonic_time () > until)
+			break;
+	}
+
+	if (g_queue_is_empty (crawler->batches) == FALSE) {
+		g_mutex_unlock (&crawler->lock);
+		return TRUE;
+	}
+
+	crawler->idle_id = 0;
+	finished = (crawler->active_dirs == 0 && crawler->finished == FALSE);
+	if (finished)
+		crawler->finished = TRUE;
+	g_mutex_unlock (&crawler->lock);
+
+	if (finished)
+		crawl_done (crawler);
+	return FALSE;
+}
+
+/* must be called with the lock held */
+static void
+schedule_idle (RhythmDBCrawler *crawler)
+{
+	if (crawler->idle_id == 0)
+		crawler->idle_id = g_idle_add ((GSourceFunc) process_batches_idle, crawler);
+}
+
+static void
+deliver_batch (RhythmDBCrawler *crawler, GPtrArray *batch)
+{
+	if (batch->len == 0) {
+		g_ptr_array_unref (batch);
+		return;
+	}
+
+	g_mutex_lock (&crawler->lock);
+	while (crawler->pending_files >= RHYTHMDB_CRAWLER_MAX_PENDING_FILES &&
+	       g_cancellable_is_cancelled (crawler->cancel) == FALSE) {
+		g_cond_wait (&crawler->space, &crawler->lock);
+	}
+
+	crawler->files += batch->len;
+	crawler->pending_files += batch->len;
+	g_queue_push_tail (crawler->batches, batch);
+	schedule_idle (crawler);
+	g_mutex_unlock (&crawler->lock);
+}
+
+static void
+queue_dir (RhythmDBCrawler *crawler, GFile *dir)
+{
+	g_mutex_lock (&crawler->lock);
+	crawler->active_dirs++;
+	g_mutex_unlock (&crawler->lock);
+
+	g_thread_pool_push (crawler->pool, dir, NULL);
+}
+
+static void
+record_dir (RhythmDBCrawler *crawler, char *uri, guint64 mtime, char **subdirs, char **files)
+{
+	RhythmDBCrawlerDir *dir;
+
+	dir = g_new0 (RhythmDBCrawlerDir, 1);
+	dir->mtime = mtime;
+	dir->subdirs = subdirs;
+	dir->files = files;
+
+	g_mutex_lock (&crawler->lock);
+	g_hash_table_replace (crawler->new_state, uri, dir);
+	g_mutex_unlock (&crawler->lock);
+}
+
+/* returns TRUE if the directory was listed completely and can be skipped next time */
+static gboolean
+list_dir (RhythmDBCrawler *crawler, GFile *dir, GPtrArray *subdirs, GPtrArray *names)
+{
+	GFileEnumerator *files;
+	GFileInfo *info;
+	GPtrArray *batch;
+	GError *error = NULL;
+	gboolean complete = TRUE;
+
+	files = g_file_enumerate_children (dir, crawl_attributes, G_FILE_QUERY_INFO_NONE, crawler->cancel, &error);
+	if (error != NULL) {
+		rb_debug ("error enumerating directory: %s", error->message);
+		g_error_free (error);
+		return FALSE;
+	}
+
+	batch = g_ptr_array_new_with_free_func ((GDestroyNotify) free_crawler_file);
+	while (1) {
+		RhythmDBCrawlerFile *f;
+		const char *file_id;
+		GFile *child;
+
+		info = g_file_enumerator_next_file (files, crawler->cancel, &error);
+		if (error != NULL) {
+			rb_debug ("error enumerating files: %s", error->message);
+			g_clear_error (&error);
+			complete = FALSE;
+			break;
+		} else if (info == NULL) {
+			break;
+		}
+
+		if (should_process (info) == FALSE) {
+			g_object_unref (info);
+			continue;
+		}
+
+		/* already handled? symlinks can lead back to places we've already been */
+		file_id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
+		if (file_id != NULL) {
+			gboolean seen;
+
+			g_mutex_lock (&crawler->lock);
+			seen = (g_hash_table_lookup (crawler->handled, file_id) != NULL);
+			if (seen == FALSE)
+				g_hash_table_add (crawler->handled, g_strdup (file_id));
+			g_mutex_unlock (&crawler->lock);
+
+			if (seen) {
+				g_object_unref (info);
+				continue;
+			}
+		}
+
+		/* symlink targets can change without the directory changing */
+		if (g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK))
+			complete = FALSE;
+
+		child = g_file_get_child (dir, g_file_info_get_name (info));
+		if (is_directory (info)) {
+			g_ptr_array_add (subdirs, g_strdup (g_file_info_get_name (info)));
+			queue_dir (crawler, child);
+			g_object_unref (info);
+			continue;
+		}
+
+		g_ptr_array_add (names, g_strdup (g_file_info_get_name (info)));
+
+		f = g_new0 (RhythmDBCrawlerFile, 1);
+		f->file = child;
+		f->info = info;
+		g_ptr_array_add (batch, f);
+
+		if (batch->len >= RHYTHMDB_CRAWLER_BATCH_SIZE) {
+			deliver_batch (crawler, batch);
+			batch = g_ptr_array_new_with_free_func ((GDestroyNotify) free_crawler_file);
+		}
+	}
+
+	deliver_batch (crawler, batch);
+	g_object_unref (files);
+	return complete;
+}
+
+static void
+crawl_dir (GFile *dir, RhythmDBCrawler *crawler)
+{
+	RhythmDBCrawlerDir *previous = NULL;
+	GFileInfo *info;
+	GError *error = NULL;
+	guint64 mtime;
+	char *uri;
+
+	if (g_cancellable_is_cancelled (crawler->cancel))
+		goto out;
+
+	info = g_file_query_info (dir, crawl_attributes, G_FILE_QUERY_INFO_NONE, crawler->cancel, &error);
+	if (error != NULL) {
+		rb_debug ("unable to get details of directory: %s", error->message);
+		g_error_free (error);
+		goto out;
+	}
+
+	/* a crawl root can be a single file to process */
+	if (is_directory (info) == FALSE) {
+		if (should_process (info)) {
+			RhythmDBCrawlerFile *f;
+			GPtrArray *batch;
+
+			f = g_new0 (RhythmDBCrawlerFile, 1);
+			f->file = g_object_ref (dir);
+			f->info = info;
+			batch = g_ptr_array_new_with_free_func ((GDestroyNotify) free_crawler_file);
+			g_ptr_array_add (batch, f);
+			deliver_batch (crawler, batch);
+		} else {
+			g_object_unref (info);
+		}
+		goto out;
+	}
+
+	mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+	g_object_unref (info);
+
+	uri = g_file_get_uri (dir);
+	if (crawler->old_state != NULL)
+		previous = g_hash_table_lookup (crawler->old_state, uri);
+
+	if (previous != NULL && mtime != 0 && previous->mtime == mtime) {
+		GPtrArray *batch;
+		int i;
+
+		/* nothing has been added or removed here since the last crawl */
+		for (i = 0; previous->subdirs[i] != NULL; i++) {
+			queue_dir (crawler, g_file_get_child (dir, previous->subdirs[i]));
+		}
+
+		batch = g_ptr_array_new_with_free_func ((GDestroyNotify) free_crawler_file);
+		for (i = 0; previous->files[i] != NULL; i++) {
+			RhythmDBCrawlerFile *f;
+
+			f = g_new0 (RhythmDBCrawlerFile, 1);
+			f->file = g_file_get_child (dir, previous->files[i]);
+			g_ptr_array_add (batch, f);
+
+			if (batch->len >= RHYTHMDB_CRAWLER_BATCH_SIZE) {
+				deliver_batch (crawler, batch);
+				batch = g_ptr_array_new_with_free_func ((GDestroyNotify) free_crawler_file);
+			}
+		}
+		deliver_batch (crawler, batch);
+
+		record_dir (crawler, uri, mtime, g_strdupv (previous->subdirs), g_strdupv (previous->files));
+		g_mutex_lock (&crawler->lock);
+		crawler->skipped_dirs++;
+		g_mutex_unlock (&crawler->lock);
+	} else {
+		GPtrArray *subdirs;
+		GPtrArray *names;
+
+		subdirs = g_ptr_array_new ();
+		names = g_ptr_array_new ();
+		if (list_dir (crawler, dir, subdirs, names)) {
+			g_ptr_array_add (subdirs, NULL);
+			g_ptr_array_add (names, NULL);
+			record_dir (crawler,
+				    uri,
+				    mtime,
+				    (char **) g_ptr_array_free (subdirs, FALSE),
+				    (char **) g_ptr_array_free (names, FALSE));
+		} else {
+			/* don't skip this directory next time */
+			g_ptr_array_free (subdirs, TRUE);
+			g_ptr_array_free (names, TRUE);
+			g_free (uri);
+		}
+		g_mutex_lock (&crawler->lock);
+		crawler->listed_dirs++;
+		g_mutex_unlock (&crawler->lock);
+	}
+
+out:
+	g_object_unref (dir);
+
+	g_mutex_lock (&crawler->lock);
+	crawler->active_dirs--;
+	if (crawler->active_dirs == 0)
+		schedule_idle (crawler);
+	g_mutex_unlock (&crawler->lock);
+}
+
+static void
+crawl_cancelled_cb (GCancellable *cancel, RhythmDBCrawler *crawler)
+{
+	/* wake up workers waiting for the main thread */
+	g_mutex_lock (&crawler->lock);
+	g_cond_broadcast (&crawler->space);
+	g_mutex_unlock (&crawler->lock);
+}
+
+/**
+ * rhythmdb_crawler_new:
+ * @cancel: a #GCancellable used to stop the crawl
+ * @func: function to call on the main thread for each file found
+ * @data: data to pass to @func
+ * @done: function to call with @data once the crawl is finished
+ *
+ * Creates a new directory crawler.  If @func returns %FALSE, @cancel is
+ * cancelled and the crawl stops.  @func is passed %NULL file information
+ * for files in directories that haven't changed since the previous crawl.
+ *
+ * Return value: the new crawler
+ */
+RhythmDBCrawler *
+rhythmdb_crawler_new (GCancellable *cancel, RBUriRecurseFunc func, gpointer data, GDestroyNotify done)
+{
+	RhythmDBCrawler *crawler;
+
+	crawler = g_new0 (RhythmDBCrawler, 1);
+	crawler->cancel = g_object_ref (cancel);
+	crawler->func = func;
+	crawler->data = data;
+	crawler->done = done;
+	crawler->workers = RHYTHMDB_CRAWLER_DEFAULT_WORKERS;
+
+	g_mutex_init (&crawler->lock);
+	g_cond_init (&crawler->space);
+	crawler->handled = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	crawler->new_state = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) free_crawler_dir);
+	crawler->batches = g_queue_new ();
+
+	return crawler;
+}
+
+/**
+ * rhythmdb_crawler_set_workers:
+ * @crawler: a #RhythmDBCrawler
+ * @workers: number of directories to list at once
+ *
+ * Sets the number of worker threads used to list directories.
+ * Must be called before the crawl is started.
+ */
+void
+rhythmdb_crawler_set_workers (RhythmDBCrawler *crawler, guint workers)
+{
+	g_assert (crawler->pool == NULL);
+	crawler->workers = MAX (workers, 1);
+}
+
+/**
+ * rhythmdb_crawler_load_state:
+ * @crawler: a #RhythmDBCrawler
+ * @filename: file to load directory state from
+ *
+ * Loads directory contents saved by a previous crawl, so directories
+ * that haven't changed don't need to be listed again.
+ * Must be called before the crawl is started.
+ */
+void
+rhythmdb_crawler_load_state (RhythmDBCrawler *crawler, const char *filename)
+{
+	GVariant *state;
+	GVariantIter *iter;
+	GError *error = NULL;
+	const char *uri;
+	char **subdirs;
+	char **files;
+	guint64 mtime;
+	guint32 version;
+	char *data;
+	gsize length;
+
+	g_assert (crawler->pool == NULL);
+
+	if (g_file_get_contents (filename, &data, &length, &error) == FALSE) {
+		rb_debug ("unable to load crawl state: %s", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	/* not trusted, so a damaged file just gives an empty or unknown version */
+	state = g_variant_new_from_data (G_VARIANT_TYPE (RHYTHMDB_CRAWLER_STATE_TYPE), data, length, FALSE, g_free, data);
+	g_variant_get (state, RHYTHMDB_CRAWLER_STATE_TYPE, &version, &iter);
+	if (version != RHYTHMDB_CRAWLER_STATE_VERSION) {
+		rb_debug ("ignoring crawl state version %u", version);
+		g_variant_iter_free (iter);
+		g_variant_unref (state);
+		return;
+	}
+
+	crawler->old_state = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) free_crawler_dir);
+	while (g_variant_iter_next (iter, "(&st^as^as)", &uri, &mtime, &subdirs, &files)) {
+		RhythmDBCrawlerDir *dir;
+
+		dir = g_new0 (RhythmDBCrawlerDir, 1);
+		dir->mtime = mtime;
+		dir->subdirs = subdirs;
+		dir->files = files;
+		g_hash_table_replace (crawler->old_state, g_strdup (uri), dir);
+	}
+	rb_debug ("loaded crawl state for %u directories", g_hash_table_size (crawler->old_state));
+
+	g_variant_iter_free (iter);
+	g_variant_unref (state);
+}
+
+static gboolean
+under_roots (RhythmDBCrawler *crawler, const char *uri)
+{
+	GSList *l;
+
+	for (l = crawler->roots; l != NULL; l = l->next) {
+		if (g_strcmp0 (uri, l->data) == 0 || rb_uri_is_descendant (uri, l->data))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static void
+add_state_dir (GVariantBuilder *b, const char *uri, RhythmDBCrawlerDir *dir)
+{
+	g_variant_builder_add (b, "(st^as^as)", uri, dir->mtime, dir->subdirs, dir->files);
+}
+
+/**
+ * rhythmdb_crawler_save_state:
+ * @crawler: a #RhythmDBCrawler
+ * @filename: file to save directory state to
+ * @error: returns error information
+ *
+ * Saves the directory contents found by the crawl, along with
+ * any loaded state for directories outside the crawled locations.  Only
+ * call this once everything found by the crawl has been handled, or
+ * files found in unchanged directories may never be handled.
+ *
+ * Return value: %TRUE if the state was saved
+ */
+gboolean
+rhythmdb_crawler_save_state (RhythmDBCrawler *crawler, const char *filename, GError **error)
+{
+	GVariantBuilder b;
+	GHashTableIter iter;
+	GVariant *state;
+	gpointer uri;
+	gpointer dir;
+	gboolean ret;
+
+	g_assert (crawler->finished);
+
+	g_variant_builder_init (&b, G_VARIANT_TYPE ("a(stasas)"));
+	g_hash_table_iter_init (&iter, crawler->new_state);
+	while (g_hash_table_iter_next (&iter, &uri, &dir)) {
+		add_state_dir (&b, uri, dir);
+	}
+
+	/* directories under the crawled locations that weren't found don't exist any more */
+	if (crawler->old_state != NULL) {
+		g_hash_table_iter_init (&iter, crawler->old_state);
+		while (g_hash_table_iter_next (&iter, &uri, &dir)) {
+			if (g_hash_table_contains (crawler->new_state, uri) == FALSE &&
+			    under_roots (crawler, uri) == FALSE) {
+				add_state_dir (&b, uri, dir);
+			}
+		}
+	}
+
+	state = g_variant_ref_sink (g_variant_new (RHYTHMDB_CRAWLER_STATE_TYPE, RHYTHMDB_CRAWLER_STATE_VERSION, &b));
+	ret = g_file_set_contents (filename,
+				   g_variant_get_data (state),
+				   g_variant_get_size (state),
+				   error);
+	g_variant_unref (state);
+	return ret;
+}
+
+/**
+ * rhythmdb_crawler_start:
+ * @crawler: a #RhythmDBCrawler
+ * @uris: (element-type utf8): list of URIs to crawl
+ *
+ * Starts crawling the specified locations.  Each can be a directory or a
+ * single file.
+ */
+void
+rhythmdb_crawler_start (RhythmDBCrawler *crawler, GSList *uris)
+{
+	GSList *l;
+
+	g_assert (crawler->pool == NULL);
+
+	crawler->start_time = g_get_monotonic_time ();
+	crawler->cancel_id = g_cancellable_connect (crawler->cancel, G_CALLBACK (crawl_cancelled_cb), crawler, NULL);
+	crawler->pool = g_thread_pool_new ((GFunc) crawl_dir, crawler, crawler->workers, FALSE, NULL);
+
+	for (l = uris; l != NULL; l = l->next) {
+		rb_debug ("crawling %s", (const char *)l->data);
+		crawler->roots = g_slist_prepend (crawler->roots, g_strdup (l->data));
+		queue_dir (crawler, g_file_new_for_uri (l->data));
+	}
+
+	if (uris == NULL) {
+		g_mutex_lock (&crawler->lock);
+		schedule_idle (crawler);
+		g_mutex_unlock (&crawler->lock);
+	}
+}
+
+/**
+ * rhythmdb_crawler_free:
+ * @crawler: a #RhythmDBCrawler
+ *
+ * Stops the crawl if it's still running and frees the crawler.
+ */
+void
+rhythmdb_crawler_free (RhythmDBCrawler *crawler)
+{
+	if (crawler->pool != NULL) {
+		if (crawler->finished == FALSE)
+			g_cancellable_cancel (crawler->cancel);
+		g_thread_pool_free (crawler->pool, TRUE, TRUE);
+	}
+	if (crawler->cancel_id != 0)
+		g_cancellable_disconnect (crawler->cancel, crawler->cancel_id);
+
+	if (crawler->idle_id != 0)
+		g_source_remove (crawler->idle_id);
+
+	g_queue_free_full (crawler->batches, (GDestroyNotify) g_ptr_array_unref);
+	g_hash_table_destroy (crawler->handled);
+	g_hash_table_destroy (crawler->new_state);
+	if (crawler->old_state != NULL)
+		g_hash_table_destroy (crawler->old_state);
+	rb_slist_deep_free (crawler->roots);
+
+	g_mutex_clear (&crawler->lock);
+	g_cond_clear (&crawler->space);
+	g_object_unref (crawler->cancel);
+	g_free (crawler);
+}
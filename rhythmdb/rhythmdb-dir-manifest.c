@@ -0,0 +1,349 @@
+/*
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+/*
+ * Directory manifest for library sync.
+ *
+ * When the database is loaded, every file in the library is checked to
+ * see if it has changed.  The manifest records, for each directory
+ * containing library files, the directory's modification time, the number
+ * of entries in it, and a hash of their file names.  If all three match on
+ * the next startup, no files have been added to or removed from the
+ * directory since it was last checked and the database has the same set
+ * of entries for it, so the files don't need to be checked individually.
+ *
+ * Files modified in place don't change the directory modification time,
+ * so they aren't noticed by this.  The library monitor only picks up such
+ * changes while Rhythmbox is running (and only if monitoring is enabled),
+ * and its startup walk only looks for new files, so the manifest also
+ * records when every file was last checked individually.  Once that was
+ * too long ago, or too many startups ago, the manifest is ignored and all
+ * files are checked again.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "rhythmdb-dir-manifest.h"
+#include "rb-debug.h"
+
+#define RHYTHMDB_DIR_MANIFEST_VERSION	2
+#define RHYTHMDB_DIR_MANIFEST_TYPE	"(utua(stuu))"
+
+/* check every file at least this often */
+#define RHYTHMDB_DIR_MANIFEST_MAX_AGE		(7 * 24 * 60 * 60)
+#define RHYTHMDB_DIR_MANIFEST_MAX_STARTUPS	10
+
+typedef struct {
+	guint64 mtime;
+	guint count;
+	guint32 hash;
+} RhythmDBDirManifestEntry;
+
+struct _RhythmDBDirManifest
+{
+	GHashTable *dirs;
+	guint64 full_check_time;
+	guint startups;
+};
+
+/**
+ * rhythmdb_dir_manifest_get_filename:
+ * @source: name of the XML database file
+ *
+ * Returns the name of the directory manifest stored alongside @source.
+ *
+ * Return value: manifest file name, free with g_free
+ */
+char *
+rhythmdb_dir_manifest_get_filename (const char *source)
+{
+	if (g_str_has_suffix (source, ".xml")) {
+		char *base;
+		char *ret;
+
+		base = g_strndup (source, strlen (source) - strlen (".xml"));
+		ret = g_strconcat (base, ".dirs", NULL);
+		g_free (base);
+		return ret;
+	}
+
+	return g_strconcat (source, ".dirs", NULL);
+}
+
+/**
+ * rhythmdb_dir_manifest_new:
+ *
+ * Creates a new empty directory manifest.
+ *
+ * Return value: the new manifest
+ */
+RhythmDBDirManifest *
+rhythmdb_dir_manifest_new (void)
+{
+	RhythmDBDirManifest *manifest;
+
+	manifest = g_new0 (RhythmDBDirManifest, 1);
+	manifest->dirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	return manifest;
+}
+
+/**
+ * rhythmdb_dir_manifest_load:
+ * @filename: manifest file to load
+ *
+ * Loads a directory manifest.  If the file doesn't exist or can't be
+ * read, an empty manifest is returned.
+ *
+ * Return value: the loaded manifest
+ */
+RhythmDBDirManifest *
+rhythmdb_dir_manifest_load (const char *filename)
+{
+	RhythmDBDirManifest *manifest;
+	GVariantIter *iter;
+	GVariant *v;
+	GError *error = NULL;
+	const char *uri;
+	guint64 mtime;
+	guint32 count;
+	guint32 hash;
+	guint64 full_check_time;
+	guint32 startups;
+	guint32 version;
+	char *data;
+	gsize length;
+
+	manifest = rhythmdb_dir_manifest_new ();
+
+	if (g_file_get_contents (filename, &data, &length, &error) == FALSE) {
+		rb_debug ("unable to load directory manifest: %s", error->message);
+		g_error_free (error);
+		return manifest;
+	}
+
+	v = g_variant_new_from_data (G_VARIANT_TYPE (RHYTHMDB_DIR_MANIFEST_TYPE), data, length, FALSE, g_free, data);
+	g_variant_get (v, RHYTHMDB_DIR_MANIFEST_TYPE, &version, &full_check_time, &startups, &iter);
+	if (version == RHYTHMDB_DIR_MANIFEST_VERSION) {
+		manifest->full_check_time = full_check_time;
+		manifest->startups = startups;
+		while (g_variant_iter_next (iter, "(&stuu)", &uri, &mtime, &count, &hash)) {
+			rhythmdb_dir_manifest_set (manifest, uri, mtime, count, hash);
+		}
+		rb_debug ("loaded manifest for %u directories", g_hash_table_size (manifest->dirs));
+	} else {
+		rb_debug ("ignoring directory manifest version %u", version);
+	}
+
+	g_variant_iter_free (iter);
+	g_variant_unref (v);
+	return manifest;
+}
+
+/**
+ * rhythmdb_dir_manifest_save:
+ * @manifest: a #RhythmDBDirManifest
+ * @filename: file to save the manifest to
+ * @error: returns error information
+ *
+ * Saves a directory manifest.
+ *
+ * Return value: %TRUE if the manifest was saved
+ */
+gboolean
+rhythmdb_dir_manifest_save (RhythmDBDirManifest *manifest, const char *filename, GError **error)
+{
+	GVariantBuilder b;
+	GHashTableIter iter;
+	GVariant *v;
+	gpointer uri;
+	gpointer value;
+	gboolean ret;
+
+	g_variant_builder_init (&b, G_VARIANT_TYPE ("a(stuu)"));
+	g_hash_table_iter_init (&iter, manifest->dirs);
+	while (g_hash_table_iter_next (&iter, &uri, &value)) {
+		RhythmDBDirManifestEntry *dir = value;
+		g_variant_builder_add (&b, "(stuu)", uri, dir->mtime, dir->count, dir->hash);
+	}
+
+	v = g_variant_ref_sink (g_variant_new (RHYTHMDB_DIR_MANIFEST_TYPE,
+					       RHYTHMDB_DIR_MANIFEST_VERSION,
+					       manifest->full_check_time,
+					       manifest->startups,
+					       &b));
+	ret = g_file_set_contents (filename, g_variant_get_data (v), g_variant_get_size (v), error);
+	g_variant_unref (v);
+	return ret;
+}
+
+/**
+ * rhythmdb_dir_manifest_free:
+ * @manifest: a #RhythmDBDirManifest
+ *
+ * Frees a directory manifest.
+ */
+void
+rhythmdb_dir_manifest_free (RhythmDBDirManifest *manifest)
+{
+	g_hash_table_destroy (manifest->dirs);
+	g_free (manifest);
+}
+
+/**
+ * rhythmdb_dir_manifest_add_name:
+ * @hash: hash of the names added so far, initially 0
+ * @name: file name to add
+ *
+ * Adds a file name to a hash of the names of the entries in a directory.
+ * The result doesn't depend on the order the names are added in.
+ *
+ * Return value: the new hash
+ */
+guint32
+rhythmdb_dir_manifest_add_name (guint32 hash, const char *name)
+{
+	guint32 h = 2166136261u;
+	const guchar *p;
+
+	for (p = (const guchar *) name; *p != '\0'; p++) {
+		h ^= *p;
+		h *= 16777619u;
+	}
+	return hash + h;
+}
+
+/**
+ * rhythmdb_dir_manifest_set:
+ * @manifest: a #RhythmDBDirManifest
+ * @uri: directory URI
+ * @mtime: directory modification time
+ * @count: number of entries in the directory
+ * @hash: hash of the entry file names, from #rhythmdb_dir_manifest_add_name
+ *
+ * Records the state of a directory.
+ */
+void
+rhythmdb_dir_manifest_set (RhythmDBDirManifest *manifest, const char *uri, guint64 mtime, guint count, guint32 hash)
+{
+	RhythmDBDirManifestEntry *dir;
+
+	dir = g_new0 (RhythmDBDirManifestEntry, 1);
+	dir->mtime = mtime;
+	dir->count = count;
+	dir->hash = hash;
+	g_hash_table_replace (manifest->dirs, g_strdup (uri), dir);
+}
+
+/**
+ * rhythmdb_dir_manifest_matches:
+ * @manifest: a #RhythmDBDirManifest
+ * @uri: directory URI
+ * @mtime: current directory modification time
+ * @count: current number of entries in the directory
+ * @hash: current hash of the entry file names
+ *
+ * Checks whether a directory is unchanged since it was recorded.
+ *
+ * Return value: %TRUE if the directory is recorded with the same details
+ */
+gboolean
+rhythmdb_dir_manifest_matches (RhythmDBDirManifest *manifest, const char *uri, guint64 mtime, guint count, guint32 hash)
+{
+	RhythmDBDirManifestEntry *dir;
+
+	dir = g_hash_table_lookup (manifest->dirs, uri);
+	if (dir == NULL || mtime == 0)
+		return FALSE;
+
+	return (dir->mtime == mtime && dir->count == count && dir->hash == hash);
+}
+
+/**
+ * rhythmdb_dir_manifest_size:
+ * @manifest: a #RhythmDBDirManifest
+ *
+ * Return value: the number of directories recorded in the manifest
+ */
+guint
+rhythmdb_dir_manifest_size (RhythmDBDirManifest *manifest)
+{
+	return g_hash_table_size (manifest->dirs);
+}
+
+/**
+ * rhythmdb_dir_manifest_set_full_check:
+ * @manifest: a #RhythmDBDirManifest
+ * @time: time all files were last checked individually, in seconds
+ * @startups: number of startups since then
+ *
+ * Records when the state of the directories was last built by checking
+ * every file rather than trusting the manifest.
+ */
+void
+rhythmdb_dir_manifest_set_full_check (RhythmDBDirManifest *manifest, guint64 time, guint startups)
+{
+	manifest->full_check_time = time;
+	manifest->startups = startups;
+}
+
+/**
+ * rhythmdb_dir_manifest_get_full_check:
+ * @manifest: a #RhythmDBDirManifest
+ * @time: (out): returns the time all files were last checked individually
+ * @startups: (out): returns the number of startups since then
+ *
+ * Returns the details recorded by #rhythmdb_dir_manifest_set_full_check.
+ */
+void
+rhythmdb_dir_manifest_get_full_check (RhythmDBDirManifest *manifest, guint64 *time, guint *startups)
+{
+	*time = manifest->full_check_time;
+	*startups = manifest->startups;
+}
+
+/**
+ * rhythmdb_dir_manifest_is_expired:
+ * @manifest: a #RhythmDBDirManifest
+ * @now: current time, in seconds
+ *
+ * Checks whether the manifest has been relied on for too long.  Files
+ * modified in place while Rhythmbox wasn't running are only noticed when
+ * every file is checked, so this should happen regularly.
+ *
+ * Return value: %TRUE if all files should be checked individually
+ */
+gboolean
+rhythmdb_dir_manifest_is_expired (RhythmDBDirManifest *manifest, guint64 now)
+{
+	if (manifest->full_check_time == 0 || manifest->full_check_time > now)
+		return TRUE;
+
+	return (now - manifest->full_check_time >= RHYTHMDB_DIR_MANIFEST_MAX_AGE ||
+		manifest->startups >= RHYTHMDB_DIR_MANIFEST_MAX_STARTUPS);
+}
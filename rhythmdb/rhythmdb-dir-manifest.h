@@ -0,0 +1,79 @@
+/*
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+#ifndef RHYTHMDB_DIR_MANIFEST_H
+#define RHYTHMDB_DIR_MANIFEST_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _RhythmDBDirManifest RhythmDBDirManifest;
+
+char *		rhythmdb_dir_manifest_get_filename	(const char *source);
+
+RhythmDBDirManifest *rhythmdb_dir_manifest_new		(void);
+
+RhythmDBDirManifest *rhythmdb_dir_manifest_load		(const char *filename);
+
+gboolean	rhythmdb_dir_manifest_save		(RhythmDBDirManifest *manifest,
+							 const char *filename,
+							 GError **error);
+
+void		rhythmdb_dir_manifest_free		(RhythmDBDirManifest *manifest);
+
+guint32		rhythmdb_dir_manifest_add_name		(guint32 hash,
+							 const char *name);
+
+void		rhythmdb_dir_manifest_set		(RhythmDBDirManifest *manifest,
+							 const char *uri,
+							 guint64 mtime,
+							 guint count,
+							 guint32 hash);
+
+gboolean	rhythmdb_dir_manifest_matches		(RhythmDBDirManifest *manifest,
+							 const char *uri,
+							 guint64 mtime,
+							 guint count,
+							 guint32 hash);
+
+guint		rhythmdb_dir_manifest_size		(RhythmDBDirManifest *manifest);
+
+void		rhythmdb_dir_manifest_set_full_check	(RhythmDBDirManifest *manifest,
+							 guint64 time,
+							 guint startups);
+
+void		rhythmdb_dir_manifest_get_full_check	(RhythmDBDirManifest *manifest,
+							 guint64 *time,
+							 guint *startups);
+
+gboolean	rhythmdb_dir_manifest_is_expired	(RhythmDBDirManifest *manifest,
+							 guint64 now);
+
+G_END_DECLS
+
+#endif /* RHYTHMDB_DIR_MANIFEST_H */
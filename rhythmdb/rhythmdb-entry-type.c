@@ -252,6 +252,42 @@ rhythmdb_entry_type_fetch_metadata (RhythmDBEntryType *etype, const char *uri, G
 	return result;
 }
 
+/**
+ * rhythmdb_entry_type_prefetch_metadata:
+ * @etype: a #RhythmDBEntryType
+ * @uris: (array zero-terminated=1): URIs of items likely to be fetched soon
+ *
+ * Loads cached metadata for a set of URIs in one batch, so subsequent calls to
+ * @rhythmdb_entry_type_fetch_metadata for them are answered from memory.
+ * Does nothing if the entry type doesn't have a metadata cache.
+ */
+void
+rhythmdb_entry_type_prefetch_metadata (RhythmDBEntryType *etype, const char * const *uris)
+{
+	GPtrArray *keys;
+	int i;
+
+	RhythmDBEntryTypeClass *klass = RHYTHMDB_ENTRY_TYPE_GET_CLASS (etype);
+	if (klass->uri_to_cache_key == NULL || etype->priv->cache == NULL) {
+		return;
+	}
+
+	keys = g_ptr_array_new_with_free_func (g_free);
+	for (i = 0; uris[i] != NULL; i++) {
+		char *key;
+
+		key = klass->uri_to_cache_key (etype, uris[i]);
+		if (key != NULL)
+			g_ptr_array_add (keys, key);
+	}
+
+	if (keys->len > 0) {
+		g_ptr_array_add (keys, NULL);
+		rhythmdb_metadata_cache_prefetch (etype->priv->cache, (const char * const *)keys->pdata);
+	}
+	g_ptr_array_free (keys, TRUE);
+}
+
 /**
  * rhythmdb_entry_cache_metadata:
  * @entry: a #RhythmDBEntry
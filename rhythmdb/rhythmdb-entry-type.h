@@ -115,6 +115,7 @@ gboolean 	rhythmdb_entry_can_sync_metadata (RhythmDBEntry *entry);
 void 		rhythmdb_entry_sync_metadata (RhythmDBEntry *entry, GSList *changes, GError **error);
 
 gboolean	rhythmdb_entry_type_fetch_metadata (RhythmDBEntryType *etype, const char *uri, GArray *metadata);
+void		rhythmdb_entry_type_prefetch_metadata (RhythmDBEntryType *etype, const char * const *uris);
 void		rhythmdb_entry_cache_metadata (RhythmDBEntry *entry);
 void		rhythmdb_entry_apply_cached_metadata (RhythmDBEntry *entry, GArray *metadata);
 
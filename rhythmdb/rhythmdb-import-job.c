@@ -32,6 +32,8 @@
 
 #include "rhythmdb-import-job.h"
 #include "rhythmdb-entry-type.h"
+#include "rhythmdb-crawler.h"
+#include "rhythmdb-private.h"
 #include "rb-util.h"
 #include "rb-file-helpers.h"
 #include "rb-debug.h"
@@ -43,8 +45,15 @@
  * so having multiple in flight should help.  we also want to be able to
  * cancel import jobs quickly.  since we can't remove things from the
  * action queue, having fewer entries helps.
+ * metadata is loaded on a pool of workers, so this needs to be large
+ * enough to keep all of them busy.
  */
-#define PROCESSING_LIMIT		20
+#define PROCESSING_LIMIT		64
+
+/* maximum number of file details kept for files waiting to be processed.
+ * files beyond this are queried again when they're processed.
+ */
+#define FILE_INFO_LIMIT			4096
 
 enum
 {
@@ -53,6 +62,7 @@ enum
 	PROP_ENTRY_TYPE,
 	PROP_IGNORE_TYPE,
 	PROP_ERROR_TYPE,
+	PROP_CRAWL_STATE,
 	PROP_TASK_LABEL,
 	PROP_TASK_DETAIL,
 	PROP_TASK_PROGRESS,
@@ -90,10 +100,13 @@ struct _RhythmDBImportJobPrivate
 	RhythmDBEntryType *error_type;
 	GMutex		lock;
 	GSList		*uri_list;
-	GSList		*next;
 	gboolean	started;
 	GCancellable    *cancel;
 
+	RhythmDBCrawler	*crawler;
+	char		*crawl_state;
+	GHashTable	*file_info;
+
 	GSList		*retry_entries;
 	gboolean	retried;
 
@@ -213,6 +226,7 @@ maybe_start_more (RhythmDBImportJob *job)
 	}
 
 	while (g_queue_get_length (job->priv->processing) < PROCESSING_LIMIT) {
+		GFileInfo *info;
 		char *uri;
 
 		uri = g_queue_pop_head (job->priv->outstanding);
@@ -222,11 +236,42 @@ maybe_start_more (RhythmDBImportJob *job)
 
 		g_queue_push_tail (job->priv->processing, uri);
 
-		rhythmdb_add_uri_with_types (job->priv->db,
-					     uri,
-					     job->priv->entry_type,
-					     job->priv->ignore_type,
-					     job->priv->error_type);
+		/* if we still have the file details from the directory scan, skip the stat */
+		info = g_hash_table_lookup (job->priv->file_info, uri);
+		if (info != NULL) {
+			rhythmdb_add_file_info_with_types (job->priv->db,
+							   uri,
+							   info,
+							   job->priv->entry_type,
+							   job->priv->ignore_type,
+							   job->priv->error_type);
+			g_hash_table_remove (job->priv->file_info, uri);
+		} else {
+			rhythmdb_add_uri_with_types (job->priv->db,
+						     uri,
+						     job->priv->entry_type,
+						     job->priv->ignore_type,
+						     job->priv->error_type);
+		}
+	}
+}
+
+/* must be called with lock held */
+static void
+save_crawl_state (RhythmDBImportJob *job)
+{
+	GError *error = NULL;
+
+	if (job->priv->crawler == NULL || job->priv->crawl_state == NULL)
+		return;
+
+	if (job->priv->retried || g_cancellable_is_cancelled (job->priv->cancel))
+		return;
+
+	rb_debug ("saving crawl state to %s", job->priv->crawl_state);
+	if (rhythmdb_crawler_save_state (job->priv->crawler, job->priv->crawl_state, &error) == FALSE) {
+		rb_debug ("unable to save crawl state: %s", error->message);
+		g_error_free (error);
 	}
 }
 
@@ -329,6 +374,7 @@ emit_status_changed (RhythmDBImportJob *job)
 			g_closure_sink (retry);
 		} else {
 			rb_debug ("emitting job complete");
+			save_crawl_state (job);
 			job->priv->complete = TRUE;
 			g_signal_emit (job, signals[COMPLETE], 0, job->priv->total);
 			g_object_notify (G_OBJECT (job), "task-outcome");
@@ -346,21 +392,47 @@ emit_status_changed (RhythmDBImportJob *job)
 	return FALSE;
 }
 
+static gboolean
+file_is_symlink (GFileInfo *info)
+{
+	return g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK) ||
+	       g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET);
+}
+
 static gboolean
 uri_recurse_func (GFile *file, GFileInfo *info, RhythmDBImportJob *job)
 {
 	RhythmDBEntry *entry;
 	char *uri;
 
-	if (g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_STANDARD_TYPE) == G_FILE_TYPE_DIRECTORY) {
-		return TRUE;
-	}
-
 	if (g_cancellable_is_cancelled (job->priv->cancel))
 		return FALSE;
 
-	if (g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK) ||
-	    g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET)) {
+	if (info == NULL) {
+		/* the file's directory hasn't changed since the last import,
+		 * so only import the file if it isn't in the database.
+		 */
+		uri = g_file_get_uri (file);
+		entry = rhythmdb_entry_lookup_by_location (job->priv->db, uri);
+		if (entry == NULL) {
+			rb_debug ("waiting for entry %s", uri);
+			g_mutex_lock (&job->priv->lock);
+			job->priv->total++;
+			g_queue_push_tail (job->priv->outstanding, uri);
+
+			if (job->priv->status_changed_id == 0) {
+				job->priv->status_changed_id = g_idle_add ((GSourceFunc) emit_status_changed, job);
+			}
+
+			maybe_start_more (job);
+			g_mutex_unlock (&job->priv->lock);
+		} else {
+			g_free (uri);
+		}
+		return TRUE;
+	}
+
+	if (file_is_symlink (info)) {
 		GFile *r;
 		r = rb_file_resolve_symlink (file, NULL);
 		if (r != NULL) {
@@ -390,6 +462,11 @@ uri_recurse_func (GFile *file, GFileInfo *info, RhythmDBImportJob *job)
 		job->priv->total++;
 		g_queue_push_tail (job->priv->outstanding, g_strdup (uri));
 
+		if (file_is_symlink (info) == FALSE &&
+		    g_hash_table_size (job->priv->file_info) < FILE_INFO_LIMIT) {
+			g_hash_table_insert (job->priv->file_info, g_strdup (uri), g_object_ref (info));
+		}
+
 		if (job->priv->status_changed_id == 0) {
 			job->priv->status_changed_id = g_idle_add ((GSourceFunc) emit_status_changed, job);
 		}
@@ -404,11 +481,20 @@ uri_recurse_func (GFile *file, GFileInfo *info, RhythmDBImportJob *job)
 		if (et == job->priv->entry_type ||
 		    et == job->priv->ignore_type ||
 		    et == job->priv->error_type) {
-			rhythmdb_add_uri_with_types (job->priv->db,
-						     uri,
-						     job->priv->entry_type,
-						     job->priv->ignore_type,
-						     job->priv->error_type);
+			if (file_is_symlink (info)) {
+				rhythmdb_add_uri_with_types (job->priv->db,
+							     uri,
+							     job->priv->entry_type,
+							     job->priv->ignore_type,
+							     job->priv->error_type);
+			} else {
+				rhythmdb_add_file_info_with_types (job->priv->db,
+								   uri,
+								   info,
+								   job->priv->entry_type,
+								   job->priv->ignore_type,
+								   job->priv->error_type);
+			}
 		}
 	}
 
@@ -427,24 +513,12 @@ emit_scan_complete_idle (RhythmDBImportJob *job)
 }
 
 static void
-next_uri (RhythmDBImportJob *job)
+crawl_done (RhythmDBImportJob *job)
 {
 	g_mutex_lock (&job->priv->lock);
-	if (job->priv->next == NULL) {
-		rb_debug ("no more uris to scan");
-		job->priv->scan_complete = TRUE;
-		g_idle_add ((GSourceFunc)emit_scan_complete_idle, job);
-	} else {
-		const char *uri = job->priv->next->data;
-		job->priv->next = job->priv->next->next;
-
-		rb_debug ("scanning uri %s", uri);
-		rb_uri_handle_recursively_async (uri,
-						 job->priv->cancel,
-						 (RBUriRecurseFunc) uri_recurse_func,
-						 job,
-						 (GDestroyNotify) next_uri);
-	}
+	rb_debug ("no more uris to scan");
+	job->priv->scan_complete = TRUE;
+	g_idle_add ((GSourceFunc)emit_scan_complete_idle, job);
 	g_mutex_unlock (&job->priv->lock);
 }
 
@@ -465,11 +539,23 @@ rhythmdb_import_job_start (RhythmDBImportJob *job)
 	g_mutex_lock (&job->priv->lock);
 	job->priv->started = TRUE;
 	job->priv->uri_list = g_slist_reverse (job->priv->uri_list);
-	job->priv->next = job->priv->uri_list;
-	g_mutex_unlock (&job->priv->lock);
-	
+
 	/* reference is released in emit_scan_complete_idle */
-	next_uri (g_object_ref (job));
+	job->priv->crawler = rhythmdb_crawler_new (job->priv->cancel,
+						   (RBUriRecurseFunc) uri_recurse_func,
+						   g_object_ref (job),
+						   (GDestroyNotify) crawl_done);
+
+	/* if there are no entries of our type, the database has been
+	 * reset since the state was saved, so everything needs to be found again.
+	 */
+	if (job->priv->crawl_state != NULL &&
+	    rhythmdb_entry_count_by_type (job->priv->db, job->priv->entry_type) > 0) {
+		rhythmdb_crawler_load_state (job->priv->crawler, job->priv->crawl_state);
+	}
+	g_mutex_unlock (&job->priv->lock);
+
+	rhythmdb_crawler_start (job->priv->crawler, job->priv->uri_list);
 }
 
 /**
@@ -624,6 +710,7 @@ rhythmdb_import_job_init (RhythmDBImportJob *job)
 	g_mutex_init (&job->priv->lock);
 	job->priv->outstanding = g_queue_new ();
 	job->priv->processing = g_queue_new ();
+	job->priv->file_info = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
 
 	job->priv->cancel = g_cancellable_new ();
 }
@@ -653,6 +740,10 @@ impl_set_property (GObject *object,
 	case PROP_ERROR_TYPE:
 		job->priv->error_type = g_value_get_object (value);
 		break;
+	case PROP_CRAWL_STATE:
+		g_free (job->priv->crawl_state);
+		job->priv->crawl_state = g_value_dup_string (value);
+		break;
 	case PROP_TASK_LABEL:
 		job->priv->task_label = g_value_dup_string (value);
 		break;
@@ -701,6 +792,9 @@ impl_get_property (GObject *object,
 	case PROP_ERROR_TYPE:
 		g_value_set_object (value, job->priv->error_type);
 		break;
+	case PROP_CRAWL_STATE:
+		g_value_set_string (value, job->priv->crawl_state);
+		break;
 	case PROP_TASK_LABEL:
 		g_value_set_string (value, job->priv->task_label);
 		break;
@@ -751,6 +845,11 @@ impl_dispose (GObject *object)
 {
 	RhythmDBImportJob *job = RHYTHMDB_IMPORT_JOB (object);
 
+	if (job->priv->crawler != NULL) {
+		rhythmdb_crawler_free (job->priv->crawler);
+		job->priv->crawler = NULL;
+	}
+
 	if (job->priv->db != NULL) {
 		g_object_unref (job->priv->db);
 		job->priv->db = NULL;
@@ -771,10 +870,12 @@ impl_finalize (GObject *object)
 
 	g_queue_free_full (job->priv->outstanding, g_free);
 	g_queue_free_full (job->priv->processing, g_free);
+	g_hash_table_destroy (job->priv->file_info);
 
 	rb_slist_deep_free (job->priv->uri_list);
 
 	g_free (job->priv->task_label);
+	g_free (job->priv->crawl_state);
 
 	G_OBJECT_CLASS (rhythmdb_import_job_parent_class)->finalize (object);
 }
@@ -824,6 +925,21 @@ rhythmdb_import_job_class_init (RhythmDBImportJobClass *klass)
 							      "Entry type to use for import error entries added by this job",
 							      RHYTHMDB_TYPE_ENTRY_TYPE,
 							      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+	/**
+	 * RhythmDBImportJob:crawl-state:
+	 *
+	 * File used to remember the contents of the directories scanned
+	 * by the job.  Directories that haven't changed since the last job
+	 * using the same file completed aren't scanned again, and files in
+	 * them that are already in the database aren't checked for changes.
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_CRAWL_STATE,
+					 g_param_spec_string ("crawl-state",
+							      "crawl state",
+							      "File used to remember scanned directories",
+							      NULL,
+							      G_PARAM_READWRITE));
 
 	g_object_class_override_property (object_class, PROP_TASK_LABEL, "task-label");
 	g_object_class_override_property (object_class, PROP_TASK_DETAIL, "task-detail");
@@ -0,0 +1,1008 @@
+/*
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+/*
+ * The journal records changes made to the database since it was last saved,
+ * so the periodic save only has to append the changes rather than rewriting
+ * the whole XML file.  Each record describes an entry being added, changed or
+ * deleted, or a keyword being added to or removed from an entry, using the
+ * same property names as the XML file.  Records are serialised as GVariants
+ * and prefixed with their length.
+ *
+ * Replaying a record is idempotent, so records written while a full save
+ * (compaction) is in progress are kept after the save completes, even though
+ * some of them may already be reflected in the XML file.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <glib/gstdio.h>
+
+#include "rhythmdb-journal.h"
+#include "rhythmdb-private.h"
+#include "rhythmdb-query-model.h"
+#include "rb-podcast-entry-types.h"
+#include "rb-debug.h"
+
+#define RHYTHMDB_JOURNAL_MAGIC		"RBDBJRNL"
+#define RHYTHMDB_JOURNAL_VERSION	1
+#define RHYTHMDB_JOURNAL_HEADER_SIZE	(8 + sizeof (guint32))
+#define RHYTHMDB_JOURNAL_RECORD_TYPE	"(yssa{sv})"
+
+/* anything bigger than this is assumed to be garbage */
+#define RHYTHMDB_JOURNAL_MAX_RECORD	(1024 * 1024)
+
+enum {
+	JOURNAL_OP_ADD = 1,
+	JOURNAL_OP_SET,
+	JOURNAL_OP_DELETE,
+	JOURNAL_OP_KEYWORD_ADD,
+	JOURNAL_OP_KEYWORD_REMOVE
+};
+
+/* properties written to the XML file */
+static const RhythmDBPropType journal_properties[] = {
+	RHYTHMDB_PROP_TITLE,
+	RHYTHMDB_PROP_GENRE,
+	RHYTHMDB_PROP_ARTIST,
+	RHYTHMDB_PROP_ALBUM,
+	RHYTHMDB_PROP_TRACK_NUMBER,
+	RHYTHMDB_PROP_TRACK_TOTAL,
+	RHYTHMDB_PROP_DISC_NUMBER,
+	RHYTHMDB_PROP_DISC_TOTAL,
+	RHYTHMDB_PROP_DURATION,
+	RHYTHMDB_PROP_FILE_SIZE,
+	RHYTHMDB_PROP_MOUNTPOINT,
+	RHYTHMDB_PROP_MTIME,
+	RHYTHMDB_PROP_FIRST_SEEN,
+	RHYTHMDB_PROP_LAST_SEEN,
+	RHYTHMDB_PROP_RATING,
+	RHYTHMDB_PROP_PLAY_COUNT,
+	RHYTHMDB_PROP_LAST_PLAYED,
+	RHYTHMDB_PROP_BITRATE,
+	RHYTHMDB_PROP_DATE,
+	RHYTHMDB_PROP_MEDIA_TYPE,
+	RHYTHMDB_PROP_HIDDEN,
+	RHYTHMDB_PROP_MUSICBRAINZ_TRACKID,
+	RHYTHMDB_PROP_MUSICBRAINZ_ARTISTID,
+	RHYTHMDB_PROP_MUSICBRAINZ_ALBUMID,
+	RHYTHMDB_PROP_MUSICBRAINZ_ALBUMARTISTID,
+	RHYTHMDB_PROP_ARTIST_SORTNAME,
+	RHYTHMDB_PROP_ALBUM_SORTNAME,
+	RHYTHMDB_PROP_COMMENT,
+	RHYTHMDB_PROP_ALBUM_ARTIST,
+	RHYTHMDB_PROP_ALBUM_ARTIST_SORTNAME,
+	RHYTHMDB_PROP_BPM,
+	RHYTHMDB_PROP_TRACK_GAIN,
+	RHYTHMDB_PROP_TRACK_PEAK,
+	RHYTHMDB_PROP_ALBUM_GAIN,
+	RHYTHMDB_PROP_ALBUM_PEAK,
+	RHYTHMDB_PROP_COMPOSER,
+	RHYTHMDB_PROP_COMPOSER_SORTNAME,
+	RHYTHMDB_PROP_TITLE_SORTNAME,
+};
+
+/* properties only written for podcast entries */
+static const RhythmDBPropType journal_podcast_properties[] = {
+	RHYTHMDB_PROP_STATUS,
+	RHYTHMDB_PROP_DESCRIPTION,
+	RHYTHMDB_PROP_SUBTITLE,
+	RHYTHMDB_PROP_LANG,
+	RHYTHMDB_PROP_COPYRIGHT,
+	RHYTHMDB_PROP_IMAGE,
+	RHYTHMDB_PROP_POST_TIME,
+	RHYTHMDB_PROP_PODCAST_GUID,
+};
+
+struct _RhythmDBJournal
+{
+	char *filename;
+	GMutex lock;
+
+	int fd;
+	goffset size;			/* bytes in the journal file */
+	GByteArray *pending;		/* records not yet written to the file */
+	GByteArray *retained;		/* records for entry types that aren't registered */
+
+	goffset compact_offset;		/* file size when the current compaction started */
+	guint compact_pending;		/* pending bytes when the current compaction started */
+};
+
+static gboolean
+is_podcast_entry (RhythmDBEntry *entry)
+{
+	return (entry->type == RHYTHMDB_ENTRY_TYPE_PODCAST_FEED ||
+		entry->type == RHYTHMDB_ENTRY_TYPE_PODCAST_POST ||
+		entry->type == RHYTHMDB_ENTRY_TYPE_PODCAST_SEARCH);
+}
+
+static gboolean
+is_journal_property (RhythmDBPropType propid, gboolean podcast)
+{
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS (journal_properties); i++) {
+		if (journal_properties[i] == propid)
+			return TRUE;
+	}
+
+	if (podcast) {
+		for (i = 0; i < G_N_ELEMENTS (journal_podcast_properties); i++) {
+			if (journal_podcast_properties[i] == propid)
+				return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static gboolean
+is_journal_entry (RhythmDBEntry *entry)
+{
+	gboolean save_to_disk = FALSE;
+
+	g_object_get (entry->type, "save-to-disk", &save_to_disk, NULL);
+	return save_to_disk;
+}
+
+static GVariant *
+value_to_variant (const GValue *value)
+{
+	switch (G_VALUE_TYPE (value)) {
+	case G_TYPE_STRING:
+		/* unset strings (mountpoint, mostly) are stored as empty maybes */
+		return g_variant_new_maybe (G_VARIANT_TYPE_STRING,
+					    g_value_get_string (value) ? g_variant_new_string (g_value_get_string (value)) : NULL);
+	case G_TYPE_BOOLEAN:
+		return g_variant_new_boolean (g_value_get_boolean (value));
+	case G_TYPE_ULONG:
+		return g_variant_new_uint64 (g_value_get_ulong (value));
+	case G_TYPE_UINT64:
+		return g_variant_new_uint64 (g_value_get_uint64 (value));
+	case G_TYPE_DOUBLE:
+		return g_variant_new_double (g_value_get_double (value));
+	default:
+		return NULL;
+	}
+}
+
+static gboolean
+variant_to_value (GVariant *variant, GType type, GValue *value)
+{
+	GVariant *str;
+
+	switch (type) {
+	case G_TYPE_STRING:
+		if (g_variant_is_of_type (variant, G_VARIANT_TYPE ("ms")) == FALSE)
+			return FALSE;
+		g_value_init (value, G_TYPE_STRING);
+		str = g_variant_get_maybe (variant);
+		if (str != NULL) {
+			g_value_set_string (value, g_variant_get_string (str, NULL));
+			g_variant_unref (str);
+		}
+		return TRUE;
+	case G_TYPE_BOOLEAN:
+		if (g_variant_is_of_type (variant, G_VARIANT_TYPE_BOOLEAN) == FALSE)
+			return FALSE;
+		g_value_init (value, G_TYPE_BOOLEAN);
+		g_value_set_boolean (value, g_variant_get_boolean (variant));
+		return TRUE;
+	case G_TYPE_ULONG:
+		if (g_variant_is_of_type (variant, G_VARIANT_TYPE_UINT64) == FALSE)
+			return FALSE;
+		g_value_init (value, G_TYPE_ULONG);
+		g_value_set_ulong (value, g_variant_get_uint64 (variant));
+		return TRUE;
+	case G_TYPE_UINT64:
+		if (g_variant_is_of_type (variant, G_VARIANT_TYPE_UINT64) == FALSE)
+			return FALSE;
+		g_value_init (value, G_TYPE_UINT64);
+		g_value_set_uint64 (value, g_variant_get_uint64 (variant));
+		return TRUE;
+	case G_TYPE_DOUBLE:
+		if (g_variant_is_of_type (variant, G_VARIANT_TYPE_DOUBLE) == FALSE)
+			return FALSE;
+		g_value_init (value, G_TYPE_DOUBLE);
+		g_value_set_double (value, g_variant_get_double (variant));
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static void
+add_property (RhythmDB *db, GVariantBuilder *props, RhythmDBPropType propid, const GValue *value)
+{
+	GVariant *v;
+
+	v = value_to_variant (value);
+	if (v != NULL) {
+		g_variant_builder_add (props, "{sv}",
+				       (const char *) rhythmdb_nice_elt_name_from_propid (db, propid),
+				       v);
+	}
+}
+
+static void
+append_record (RhythmDBJournal *journal,
+	       guint8 op,
+	       RhythmDBEntry *entry,
+	       GVariantBuilder *props)
+{
+	GVariant *record;
+	guint32 length;
+
+	record = g_variant_new (RHYTHMDB_JOURNAL_RECORD_TYPE,
+				op,
+				rhythmdb_entry_type_get_name (entry->type),
+				rb_refstring_get (entry->location),
+				props);
+	g_variant_ref_sink (record);
+
+	length = GUINT32_TO_LE (g_variant_get_size (record));
+
+	g_mutex_lock (&journal->lock);
+	g_byte_array_append (journal->pending, (const guint8 *) &length, sizeof (length));
+	g_byte_array_append (journal->pending, g_variant_get_data (record), g_variant_get_size (record));
+	g_mutex_unlock (&journal->lock);
+
+	g_variant_unref (record);
+}
+
+/**
+ * rhythmdb_journal_get_filename:
+ * @source: name of the XML database file
+ *
+ * Returns the name of the journal file stored alongside @source.
+ *
+ * Return value: journal file name, free with g_free
+ */
+char *
+rhythmdb_journal_get_filename (const char *source)
+{
+	if (g_str_has_suffix (source, ".xml")) {
+		char *base;
+		char *ret;
+
+		base = g_strndup (source, strlen (source) - strlen (".xml"));
+		ret = g_strconcat (base, ".journal", NULL);
+		g_free (base);
+		return ret;
+	}
+
+	return g_strconcat (source, ".journal", NULL);
+}
+
+/**
+ * rhythmdb_journal_new:
+ * @filename: name of the journal file
+ *
+ * Creates a journal writing to @filename.  The file is not created until
+ * records are first written to it.
+ *
+ * Return value: new journal, free with rhythmdb_journal_free
+ */
+RhythmDBJournal *
+rhythmdb_journal_new (const char *filename)
+{
+	RhythmDBJournal *journal;
+	GStatBuf st;
+
+	journal = g_new0 (RhythmDBJournal, 1);
+	journal->filename = g_strdup (filename);
+	g_mutex_init (&journal->lock);
+	journal->fd = -1;
+	journal->pending = g_byte_array_new ();
+	journal->retained = g_byte_array_new ();
+	journal->compact_offset = -1;
+
+	if (g_stat (filename, &st) == 0)
+		journal->size = st.st_size;
+
+	return journal;
+}
+
+/**
+ * rhythmdb_journal_free:
+ * @journal: the #RhythmDBJournal
+ *
+ * Frees the journal.  Records that haven't been flushed are discarded.
+ */
+void
+rhythmdb_journal_free (RhythmDBJournal *journal)
+{
+	if (journal->fd != -1)
+		close (journal->fd);
+
+	g_byte_array_unref (journal->pending);
+	g_byte_array_unref (journal->retained);
+	g_mutex_clear (&journal->lock);
+	g_free (journal->filename);
+	g_free (journal);
+}
+
+/**
+ * rhythmdb_journal_add_entry:
+ * @journal: the #RhythmDBJournal
+ * @db: the #RhythmDB
+ * @entry: the newly added #RhythmDBEntry
+ *
+ * Records the addition of @entry, including all of its saved properties
+ * and keywords.
+ */
+void
+rhythmdb_journal_add_entry (RhythmDBJournal *journal,
+			    RhythmDB *db,
+			    RhythmDBEntry *entry)
+{
+	GVariantBuilder props;
+	gboolean podcast;
+	GList *keywords;
+	GList *l;
+	int i;
+
+	if (is_journal_entry (entry) == FALSE)
+		return;
+
+	podcast = is_podcast_entry (entry);
+	g_variant_builder_init (&props, G_VARIANT_TYPE_VARDICT);
+	for (i = 0; i < G_N_ELEMENTS (journal_properties); i++) {
+		GValue value = {0,};
+
+		g_value_init (&value, rhythmdb_get_property_type (db, journal_properties[i]));
+		rhythmdb_entry_get (db, entry, journal_properties[i], &value);
+		add_property (db, &props, journal_properties[i], &value);
+		g_value_unset (&value);
+	}
+
+	for (i = 0; podcast && i < G_N_ELEMENTS (journal_podcast_properties); i++) {
+		GValue value = {0,};
+
+		g_value_init (&value, rhythmdb_get_property_type (db, journal_podcast_properties[i]));
+		rhythmdb_entry_get (db, entry, journal_podcast_properties[i], &value);
+		add_property (db, &props, journal_podcast_properties[i], &value);
+		g_value_unset (&value);
+	}
+
+	keywords = rhythmdb_entry_keywords_get (db, entry);
+	for (l = keywords; l != NULL; l = l->next) {
+		g_variant_builder_add (&props, "{sv}",
+				       (const char *) rhythmdb_nice_elt_name_from_propid (db, RHYTHMDB_PROP_KEYWORD),
+				       g_variant_new_string (rb_refstring_get (l->data)));
+	}
+	g_list_free_full (keywords, (GDestroyNotify) rb_refstring_unref);
+
+	append_record (journal, JOURNAL_OP_ADD, entry, &props);
+}
+
+/**
+ * rhythmdb_journal_delete_entry:
+ * @journal: the #RhythmDBJournal
+ * @db: the #RhythmDB
+ * @entry: the deleted #RhythmDBEntry
+ *
+ * Records the deletion of @entry.
+ */
+void
+rhythmdb_journal_delete_entry (RhythmDBJournal *journal,
+			       RhythmDB *db,
+			       RhythmDBEntry *entry)
+{
+	GVariantBuilder props;
+
+	if (is_journal_entry (entry) == FALSE)
+		return;
+
+	g_variant_builder_init (&props, G_VARIANT_TYPE_VARDICT);
+	append_record (journal, JOURNAL_OP_DELETE, entry, &props);
+}
+
+/**
+ * rhythmdb_journal_change_entry:
+ * @journal: the #RhythmDBJournal
+ * @db: the #RhythmDB
+ * @entry: the changed #RhythmDBEntry
+ * @changes: list of #RhythmDBEntryChange structures
+ *
+ * Records the new values of the saved properties in @changes.
+ */
+void
+rhythmdb_journal_change_entry (RhythmDBJournal *journal,
+			       RhythmDB *db,
+			       RhythmDBEntry *entry,
+			       GSList *changes)
+{
+	GVariantBuilder props;
+	gboolean podcast;
+	gboolean any = FALSE;
+	GSList *l;
+
+	if (is_journal_entry (entry) == FALSE)
+		return;
+
+	podcast = is_podcast_entry (entry);
+	g_variant_builder_init (&props, G_VARIANT_TYPE_VARDICT);
+	for (l = changes; l != NULL; l = l->next) {
+		RhythmDBEntryChange *change = l->data;
+
+		if (is_journal_property (change->prop, podcast)) {
+			add_property (db, &props, change->prop, &change->new);
+			any = TRUE;
+		}
+	}
+
+	if (any) {
+		append_record (journal, JOURNAL_OP_SET, entry, &props);
+	} else {
+		g_variant_builder_clear (&props);
+	}
+}
+
+/**
+ * rhythmdb_journal_set_property:
+ * @journal: the #RhythmDBJournal
+ * @db: the #RhythmDB
+ * @entry: the changed #RhythmDBEntry
+ * @propid: the property that changed
+ * @value: the new value
+ *
+ * Records a property change that doesn't go through the usual change
+ * notification, such as updates to the last-seen time.
+ */
+void
+rhythmdb_journal_set_property (RhythmDBJournal *journal,
+			       RhythmDB *db,
+			       RhythmDBEntry *entry,
+			       RhythmDBPropType propid,
+			       const GValue *value)
+{
+	GVariantBuilder props;
+
+	if (is_journal_property (propid, is_podcast_entry (entry)) == FALSE ||
+	    is_journal_entry (entry) == FALSE)
+		return;
+
+	g_variant_builder_init (&props, G_VARIANT_TYPE_VARDICT);
+	add_property (db, &props, propid, value);
+	append_record (journal, JOURNAL_OP_SET, entry, &props);
+}
+
+/**
+ * rhythmdb_journal_set_keyword:
+ * @journal: the #RhythmDBJournal
+ * @db: the #RhythmDB
+ * @entry: the #RhythmDBEntry
+ * @keyword: the keyword
+ * @added: %TRUE if the keyword was added, %FALSE if it was removed
+ *
+ * Records a keyword being added to or removed from @entry.
+ */
+void
+rhythmdb_journal_set_keyword (RhythmDBJournal *journal,
+			      RhythmDB *db,
+			      RhythmDBEntry *entry,
+			      RBRefString *keyword,
+			      gboolean added)
+{
+	GVariantBuilder props;
+
+	if (is_journal_entry (entry) == FALSE)
+		return;
+
+	g_variant_builder_init (&props, G_VARIANT_TYPE_VARDICT);
+	g_variant_builder_add (&props, "{sv}",
+			       (const char *) rhythmdb_nice_elt_name_from_propid (db, RHYTHMDB_PROP_KEYWORD),
+			       g_variant_new_string (rb_refstring_get (keyword)));
+	append_record (journal, added ? JOURNAL_OP_KEYWORD_ADD : JOURNAL_OP_KEYWORD_REMOVE, entry, &props);
+}
+
+static gboolean
+write_all (int fd, const guint8 *data, gsize length)
+{
+	while (length > 0) {
+		gssize r;
+
+		r = write (fd, data, length);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return FALSE;
+		}
+		data += r;
+		length -= r;
+	}
+	return TRUE;
+}
+
+static void
+make_header (guint8 *header)
+{
+	guint32 version;
+
+	version = GUINT32_TO_LE (RHYTHMDB_JOURNAL_VERSION);
+	memcpy (header, RHYTHMDB_JOURNAL_MAGIC, 8);
+	memcpy (header + 8, &version, sizeof (version));
+}
+
+/* must be called with the journal lock held */
+static gboolean
+open_journal (RhythmDBJournal *journal, GError **error)
+{
+	GStatBuf st;
+
+	if (journal->fd != -1)
+		return TRUE;
+
+	journal->fd = g_open (journal->filename, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (journal->fd == -1 || fstat (journal->fd, &st) < 0) {
+		int err = errno;
+
+		g_set_error (error,
+			     G_FILE_ERROR,
+			     g_file_error_from_errno (err),
+			     "Unable to open journal %s: %s",
+			     journal->filename,
+			     g_strerror (err));
+		if (journal->fd != -1) {
+			close (journal->fd);
+			journal->fd = -1;
+		}
+		return FALSE;
+	}
+
+	journal->size = st.st_size;
+	if (journal->size == 0) {
+		guint8 header[RHYTHMDB_JOURNAL_HEADER_SIZE];
+
+		make_header (header);
+		if (write_all (journal->fd, header, sizeof (header)) == FALSE) {
+			int err = errno;
+
+			g_set_error (error,
+				     G_FILE_ERROR,
+				     g_file_error_from_errno (err),
+				     "Unable to write journal %s: %s",
+				     journal->filename,
+				     g_strerror (err));
+			close (journal->fd);
+			journal->fd = -1;
+			g_unlink (journal->filename);
+			return FALSE;
+		}
+		journal->size = sizeof (header);
+	}
+
+	return TRUE;
+}
+
+/**
+ * rhythmdb_journal_has_pending:
+ * @journal: the #RhythmDBJournal
+ *
+ * Return value: %TRUE if there are records that haven't been written to the
+ * journal file yet
+ */
+gboolean
+rhythmdb_journal_has_pending (RhythmDBJournal *journal)
+{
+	gboolean ret;
+
+	g_mutex_lock (&journal->lock);
+	ret = (journal->pending->len > 0);
+	g_mutex_unlock (&journal->lock);
+
+	return ret;
+}
+
+/**
+ * rhythmdb_journal_flush:
+ * @journal: the #RhythmDBJournal
+ * @error: returns error information
+ *
+ * Appends any pending records to the journal file.
+ *
+ * Return value: %TRUE if successful
+ */
+gboolean
+rhythmdb_journal_flush (RhythmDBJournal *journal, GError **error)
+{
+	gboolean ret = TRUE;
+
+	g_mutex_lock (&journal->lock);
+	if (journal->pending->len > 0 && open_journal (journal, error)) {
+		if (write_all (journal->fd, journal->pending->data, journal->pending->len)) {
+			rb_debug ("wrote %u bytes to journal", journal->pending->len);
+			journal->size += journal->pending->len;
+			if (journal->compact_offset != -1)
+				journal->compact_pending = 0;
+			g_byte_array_set_size (journal->pending, 0);
+		} else {
+			int err = errno;
+
+			g_set_error (error,
+				     G_FILE_ERROR,
+				     g_file_error_from_errno (err),
+				     "Unable to write journal %s: %s",
+				     journal->filename,
+				     g_strerror (err));
+
+			/* don't leave a partial record behind */
+			if (ftruncate (journal->fd, journal->size) < 0) {
+				rb_debug ("unable to truncate journal: %s", g_strerror (errno));
+			}
+			ret = FALSE;
+		}
+	} else if (journal->pending->len > 0) {
+		ret = FALSE;
+	}
+	g_mutex_unlock (&journal->lock);
+
+	return ret;
+}
+
+/**
+ * rhythmdb_journal_get_size:
+ * @journal: the #RhythmDBJournal
+ *
+ * Return value: the size of the journal, including pending records
+ */
+goffset
+rhythmdb_journal_get_size (RhythmDBJournal *journal)
+{
+	goffset size;
+
+	g_mutex_lock (&journal->lock);
+	size = journal->size + journal->pending->len;
+	g_mutex_unlock (&journal->lock);
+
+	return size;
+}
+
+/**
+ * rhythmdb_journal_begin_compaction:
+ * @journal: the #RhythmDBJournal
+ *
+ * Marks the start of a full save.  Records added up to this point will be
+ * discarded if rhythmdb_journal_compacted is called.
+ */
+void
+rhythmdb_journal_begin_compaction (RhythmDBJournal *journal)
+{
+	g_mutex_lock (&journal->lock);
+	journal->compact_offset = journal->size;
+	journal->compact_pending = journal->pending->len;
+	g_mutex_unlock (&journal->lock);
+}
+
+/**
+ * rhythmdb_journal_compacted:
+ * @journal: the #RhythmDBJournal
+ *
+ * Called when a full save has been written successfully.  Discards the
+ * records added before the save started, as they are now reflected in the
+ * saved database.
+ */
+void
+rhythmdb_journal_compacted (RhythmDBJournal *journal)
+{
+	GError *error = NULL;
+	char *contents = NULL;
+	gsize length = 0;
+
+	g_mutex_lock (&journal->lock);
+	if (journal->compact_offset == -1) {
+		g_mutex_unlock (&journal->lock);
+		return;
+	}
+
+	g_byte_array_remove_range (journal->pending, 0, journal->compact_pending);
+	journal->compact_pending = 0;
+
+	if (journal->size > journal->compact_offset &&
+	    g_file_get_contents (journal->filename, &contents, &length, &error) == FALSE) {
+		rb_debug ("unable to read journal for compaction: %s", error->message);
+		g_clear_error (&error);
+		journal->compact_offset = -1;
+		g_mutex_unlock (&journal->lock);
+		return;
+	}
+
+	if (journal->fd != -1) {
+		close (journal->fd);
+		journal->fd = -1;
+	}
+
+	if ((goffset) length <= journal->compact_offset && journal->retained->len == 0) {
+		rb_debug ("journal compacted to nothing");
+		g_unlink (journal->filename);
+		journal->size = 0;
+	} else {
+		GByteArray *data;
+		guint8 header[RHYTHMDB_JOURNAL_HEADER_SIZE];
+
+		make_header (header);
+		data = g_byte_array_new ();
+		g_byte_array_append (data, header, sizeof (header));
+		g_byte_array_append (data, journal->retained->data, journal->retained->len);
+		if ((goffset) length > journal->compact_offset) {
+			g_byte_array_append (data,
+					     (const guint8 *) contents + journal->compact_offset,
+					     length - journal->compact_offset);
+		}
+
+		if (g_file_set_contents (journal->filename, (const char *) data->data, data->len, &error)) {
+			rb_debug ("journal compacted to %u bytes", data->len);
+			journal->size = data->len;
+		} else {
+			/* the old journal is still there, and replaying it again is harmless */
+			g_warning ("Unable to compact journal: %s", error->message);
+			g_clear_error (&error);
+		}
+		g_byte_array_unref (data);
+	}
+
+	journal->compact_offset = -1;
+	g_mutex_unlock (&journal->lock);
+	g_free (contents);
+}
+
+/**
+ * rhythmdb_journal_end_compaction:
+ * @journal: the #RhythmDBJournal
+ *
+ * Marks the end of a full save, whether or not it succeeded.
+ */
+void
+rhythmdb_journal_end_compaction (RhythmDBJournal *journal)
+{
+	g_mutex_lock (&journal->lock);
+	journal->compact_offset = -1;
+	journal->compact_pending = 0;
+	g_mutex_unlock (&journal->lock);
+}
+
+static void
+apply_properties (RhythmDB *db, RhythmDBEntry *entry, GVariant *props, guint8 op)
+{
+	GVariantIter iter;
+	const char *name;
+	GVariant *v;
+	gboolean podcast;
+
+	podcast = is_podcast_entry (entry);
+	g_variant_iter_init (&iter, props);
+	while (g_variant_iter_next (&iter, "{&sv}", &name, &v)) {
+		GValue value = {0,};
+		int propid;
+
+		propid = rhythmdb_propid_from_nice_elt_name (db, (const xmlChar *) name);
+		if (propid == RHYTHMDB_PROP_KEYWORD) {
+			if (g_variant_is_of_type (v, G_VARIANT_TYPE_STRING)) {
+				RBRefString *keyword;
+
+				keyword = rb_refstring_new (g_variant_get_string (v, NULL));
+				if (op == JOURNAL_OP_KEYWORD_REMOVE) {
+					rhythmdb_entry_keyword_remove (db, entry, keyword);
+				} else {
+					rhythmdb_entry_keyword_add (db, entry, keyword);
+				}
+				rb_refstring_unref (keyword);
+			}
+		} else if (op != JOURNAL_OP_ADD && op != JOURNAL_OP_SET) {
+			/* keyword records only contain keywords */
+		} else if (propid >= 0 &&
+			   is_journal_property (propid, podcast) &&
+			   variant_to_value (v, rhythmdb_get_property_type (db, propid), &value)) {
+			if (G_VALUE_HOLDS_STRING (&value) &&
+			    g_value_get_string (&value) == NULL &&
+			    propid != RHYTHMDB_PROP_MOUNTPOINT) {
+				rb_debug ("ignoring unset value for property %s", name);
+			} else {
+				rhythmdb_entry_set_internal (db, entry, TRUE, propid, &value);
+			}
+			g_value_unset (&value);
+		} else {
+			rb_debug ("ignoring journal value for property %s", name);
+		}
+		g_variant_unref (v);
+	}
+}
+
+/* returns FALSE if the record refers to an unknown entry type */
+static gboolean
+apply_record (RhythmDB *db, GVariant *record)
+{
+	RhythmDBEntryType *entry_type;
+	RhythmDBEntry *entry;
+	const char *type_name;
+	const char *location;
+	GVariant *props;
+	guint8 op;
+
+	g_variant_get (record, "(y&s&s@a{sv})", &op, &type_name, &location, &props);
+
+	entry_type = rhythmdb_entry_type_get_by_name (db, type_name);
+	if (entry_type == NULL) {
+		rb_debug ("journal record for %s has unknown entry type %s", location, type_name);
+		g_variant_unref (props);
+		return FALSE;
+	}
+
+	entry = rhythmdb_entry_lookup_by_location (db, location);
+	if (entry != NULL && entry->type != entry_type) {
+		if (op == JOURNAL_OP_ADD) {
+			rb_debug ("replacing entry %s with an entry of type %s", location, type_name);
+			if ((entry->flags & RHYTHMDB_ENTRY_INSERTED) == 0)
+				rhythmdb_commit_internal (db, FALSE, g_thread_self ());
+			rhythmdb_entry_delete (db, entry);
+		}
+		entry = NULL;
+	}
+
+	switch (op) {
+	case JOURNAL_OP_ADD:
+		if (entry == NULL)
+			entry = rhythmdb_entry_new (db, entry_type, location);
+		if (entry != NULL)
+			apply_properties (db, entry, props, op);
+		break;
+	case JOURNAL_OP_SET:
+	case JOURNAL_OP_KEYWORD_ADD:
+	case JOURNAL_OP_KEYWORD_REMOVE:
+		if (entry != NULL)
+			apply_properties (db, entry, props, op);
+		break;
+	case JOURNAL_OP_DELETE:
+		if (entry != NULL) {
+			/* entries can only be deleted once the addition has been processed */
+			if ((entry->flags & RHYTHMDB_ENTRY_INSERTED) == 0)
+				rhythmdb_commit_internal (db, FALSE, g_thread_self ());
+			rhythmdb_entry_delete (db, entry);
+		}
+		break;
+	default:
+		rb_debug ("ignoring journal record with unknown operation %d", op);
+		break;
+	}
+
+	g_variant_unref (props);
+	return TRUE;
+}
+
+/**
+ * rhythmdb_journal_replay:
+ * @journal: the #RhythmDBJournal
+ * @db: the #RhythmDB
+ * @cancel: a #GCancellable
+ * @count: returns the number of records replayed
+ * @error: returns error information
+ *
+ * Applies the records in the journal file to the database.  This must be
+ * called from the database load thread, after the database file has been
+ * loaded.  Records for entry types that aren't registered are kept in the
+ * journal.  Anything following an incomplete record is discarded.
+ *
+ * Return value: %TRUE if successful
+ */
+gboolean
+rhythmdb_journal_replay (RhythmDBJournal *journal,
+			 RhythmDB *db,
+			 GCancellable *cancel,
+			 guint *count,
+			 GError **error)
+{
+	GError *local_error = NULL;
+	char *contents;
+	gsize length;
+	gsize offset;
+	guint32 version;
+	guint records = 0;
+
+	*count = 0;
+	if (g_file_get_contents (journal->filename, &contents, &length, &local_error) == FALSE) {
+		if (g_error_matches (local_error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+			g_clear_error (&local_error);
+			return TRUE;
+		}
+		g_propagate_error (error, local_error);
+		return FALSE;
+	}
+
+	offset = 0;
+	if (length < RHYTHMDB_JOURNAL_HEADER_SIZE || memcmp (contents, RHYTHMDB_JOURNAL_MAGIC, 8) != 0) {
+		rb_debug ("journal %s is not valid, discarding it", journal->filename);
+	} else {
+		memcpy (&version, contents + 8, sizeof (version));
+		if (GUINT32_FROM_LE (version) != RHYTHMDB_JOURNAL_VERSION) {
+			rb_debug ("journal %s has unsupported version %u, discarding it",
+				  journal->filename, GUINT32_FROM_LE (version));
+		} else {
+			offset = RHYTHMDB_JOURNAL_HEADER_SIZE;
+		}
+	}
+
+	while (offset > 0 && offset + sizeof (guint32) <= length) {
+		GVariant *record;
+		GBytes *bytes;
+		guint32 record_length;
+
+		memcpy (&record_length, contents + offset, sizeof (record_length));
+		record_length = GUINT32_FROM_LE (record_length);
+		if (record_length == 0 ||
+		    record_length > RHYTHMDB_JOURNAL_MAX_RECORD ||
+		    record_length > length - offset - sizeof (guint32))
+			break;
+
+		/* copy the record so it's suitably aligned */
+		bytes = g_bytes_new (contents + offset + sizeof (guint32), record_length);
+		record = g_variant_new_from_bytes (G_VARIANT_TYPE (RHYTHMDB_JOURNAL_RECORD_TYPE), bytes, FALSE);
+		g_variant_ref_sink (record);
+		if (apply_record (db, record) == FALSE) {
+			g_mutex_lock (&journal->lock);
+			g_byte_array_append (journal->retained,
+					     (const guint8 *) contents + offset,
+					     record_length + sizeof (guint32));
+			g_mutex_unlock (&journal->lock);
+		}
+		g_variant_unref (record);
+		g_bytes_unref (bytes);
+
+		offset += record_length + sizeof (guint32);
+		records++;
+
+		if (records % RHYTHMDB_QUERY_MODEL_SUGGESTED_UPDATE_CHUNK == 0) {
+			rhythmdb_commit_internal (db, FALSE, g_thread_self ());
+			if (g_cancellable_is_cancelled (cancel))
+				break;
+		}
+	}
+	rhythmdb_commit_internal (db, FALSE, g_thread_self ());
+	*count = records;
+
+	if (offset < length && g_cancellable_is_cancelled (cancel) == FALSE) {
+		rb_debug ("discarding %" G_GSIZE_FORMAT " bytes of journal data", length - offset);
+		if (offset == 0) {
+			g_unlink (journal->filename);
+		} else if (truncate (journal->filename, offset) < 0) {
+			rb_debug ("unable to truncate journal: %s", g_strerror (errno));
+		}
+	}
+
+	g_mutex_lock (&journal->lock);
+	journal->size = offset;
+	g_mutex_unlock (&journal->lock);
+
+	g_free (contents);
+	return TRUE;
+}
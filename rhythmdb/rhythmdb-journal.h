@@ -0,0 +1,83 @@
+/*
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+#ifndef RHYTHMDB_JOURNAL_H
+#define RHYTHMDB_JOURNAL_H
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <rhythmdb/rhythmdb.h>
+
+G_BEGIN_DECLS
+
+typedef struct _RhythmDBJournal RhythmDBJournal;
+
+char *		rhythmdb_journal_get_filename		(const char *source);
+
+RhythmDBJournal *rhythmdb_journal_new			(const char *filename);
+void		rhythmdb_journal_free			(RhythmDBJournal *journal);
+
+void		rhythmdb_journal_add_entry		(RhythmDBJournal *journal,
+							 RhythmDB *db,
+							 RhythmDBEntry *entry);
+void		rhythmdb_journal_delete_entry		(RhythmDBJournal *journal,
+							 RhythmDB *db,
+							 RhythmDBEntry *entry);
+void		rhythmdb_journal_change_entry		(RhythmDBJournal *journal,
+							 RhythmDB *db,
+							 RhythmDBEntry *entry,
+							 GSList *changes);
+void		rhythmdb_journal_set_property		(RhythmDBJournal *journal,
+							 RhythmDB *db,
+							 RhythmDBEntry *entry,
+							 RhythmDBPropType propid,
+							 const GValue *value);
+void		rhythmdb_journal_set_keyword		(RhythmDBJournal *journal,
+							 RhythmDB *db,
+							 RhythmDBEntry *entry,
+							 RBRefString *keyword,
+							 gboolean added);
+
+gboolean	rhythmdb_journal_has_pending		(RhythmDBJournal *journal);
+gboolean	rhythmdb_journal_flush			(RhythmDBJournal *journal,
+							 GError **error);
+goffset		rhythmdb_journal_get_size		(RhythmDBJournal *journal);
+
+void		rhythmdb_journal_begin_compaction	(RhythmDBJournal *journal);
+void		rhythmdb_journal_compacted		(RhythmDBJournal *journal);
+void		rhythmdb_journal_end_compaction		(RhythmDBJournal *journal);
+
+gboolean	rhythmdb_journal_replay			(RhythmDBJournal *journal,
+							 RhythmDB *db,
+							 GCancellable *cancel,
+							 guint *count,
+							 GError **error);
+
+G_END_DECLS
+
+#endif /* RHYTHMDB_JOURNAL_H */
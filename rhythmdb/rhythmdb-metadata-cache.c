@@ -31,6 +31,7 @@
 #include <sys/types.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
 
 #include <glib/gi18n.h>
 
@@ -91,6 +92,18 @@ struct _RhythmDBMetadataCachePrivate
 	char *name;
 
 	struct tdb_context *tdb_context;
+	GMutex tdb_lock;		/* loads happen on metadata worker threads */
+	guint32 schema_id;		/* protected by tdb_lock */
+
+	/* the following are protected by record_lock, which can be
+	 * taken while holding tdb_lock, but not the other way around.
+	 * stores only need this lock, so they don't wait for writes.
+	 */
+	GMutex record_lock;
+	GHashTable *pending;		/* key -> encoded record waiting to be written */
+	GHashTable *prefetched;		/* key -> decoded record */
+	guint flush_id;
+	gboolean flush_queued;
 
 	const char *purge_prefix;
 	guint64 purge_age;
@@ -141,98 +154,233 @@ rhythmdb_metadata_cache_get (RhythmDB *db, const char *name)
 	return RHYTHMDB_METADATA_CACHE (obj);
 }
 
-static void
-free_tdb_data(gpointer data)
+/* record format:
+ *   0  magic ("RBMC")
+ *   4  format version, then three reserved bytes
+ *   8  schema id (u32)
+ *  12  missing-since time (u64)
+ *  20  field count (u16)
+ *  22  fields: property id (u16), then the value:
+ *        strings: length (u32) and bytes, no terminator
+ *        ulong, uint64, double: 8 bytes
+ *        boolean: 1 byte
+ *
+ * all integers are little endian.  the schema id is derived from the
+ * ids, types and names of the cached properties, so records written by
+ * a version with a different property table are ignored rather than
+ * misread.  records without the magic are in the older a{sv} format.
+ */
+
+#define CACHE_RECORD_MAGIC		"RBMC"
+#define CACHE_RECORD_VERSION		1
+
+/* pending writes are committed in a single transaction once there are
+ * this many, or after a short delay, whichever comes first.
+ */
+#define CACHE_FLUSH_BATCH		256
+#define CACHE_FLUSH_DELAY		2
+
+/* upper limit on the number of prefetched records held in memory */
+#define CACHE_MAX_PREFETCHED		4096
+
+typedef struct {
+	RhythmDBEntryChange *fields;
+	guint n_fields;
+} RhythmDBMetadataCacheRecord;
+
+static guint32
+compute_schema_id (RhythmDB *db)
 {
-	free (data);
+	guint32 hash = 2166136261u;
+	int i;
+
+	/* FNV-1a over the property table, so the id is stable across runs */
+	for (i = 0; i < G_N_ELEMENTS (cached_properties); i++) {
+		char *desc;
+		const char *p;
+
+		desc = g_strdup_printf ("%d:%s:%s;",
+					cached_properties[i],
+					(const char *)rhythmdb_nice_elt_name_from_propid (db, cached_properties[i]),
+					g_type_name (rhythmdb_get_property_type (db, cached_properties[i])));
+		for (p = desc; *p != '\0'; p++) {
+			hash ^= (guchar) *p;
+			hash *= 16777619u;
+		}
+		g_free (desc);
+	}
+
+	return hash;
 }
 
 static void
-parse_value (TDB_DATA data, guint64 *missing_since, GVariant **metadata)
+free_fields (RhythmDBEntryChange *fields, guint n_fields)
 {
-	GVariant *v;
+	guint i;
 
-	v = g_variant_new_from_data (G_VARIANT_TYPE ("(ta{sv})"), data.dptr, data.dsize, FALSE, free_tdb_data, data.dptr);
+	for (i = 0; i < n_fields; i++) {
+		g_value_unset (&fields[i].new);
+	}
+	g_free (fields);
+}
 
-	g_variant_get_child (v, 0, "t", missing_since);
-	*metadata = g_variant_get_child_value (v, 1);
+static void
+free_record (RhythmDBMetadataCacheRecord *record)
+{
+	free_fields (record->fields, record->n_fields);
+	g_slice_free (RhythmDBMetadataCacheRecord, record);
+}
 
-	g_variant_unref (v);
+static void
+append_uint16 (GByteArray *b, guint16 v)
+{
+	v = GUINT16_TO_LE (v);
+	g_byte_array_append (b, (const guint8 *)&v, sizeof (v));
 }
 
 static void
-store_value (struct tdb_context *tdb, const char *key, guint64 missing_since, GVariant *metadata)
+append_uint32 (GByteArray *b, guint32 v)
 {
-	GVariantBuilder b;
-	GVariant *v;
-	TDB_DATA tdbdata;
-	TDB_DATA tdbkey;
+	v = GUINT32_TO_LE (v);
+	g_byte_array_append (b, (const guint8 *)&v, sizeof (v));
+}
 
-	g_variant_builder_init (&b, G_VARIANT_TYPE ("(ta{sv})"));
-	g_variant_builder_add (&b, "t", missing_since);
-	g_variant_builder_add_value (&b, metadata);
-	v = g_variant_builder_end (&b);
+static void
+append_uint64 (GByteArray *b, guint64 v)
+{
+	v = GUINT64_TO_LE (v);
+	g_byte_array_append (b, (const guint8 *)&v, sizeof (v));
+}
 
-	tdbdata.dsize = g_variant_get_size (v);
-	tdbdata.dptr = g_malloc0 (tdbdata.dsize);
-	g_variant_store (v, tdbdata.dptr);
-	g_variant_unref (v);
+static GBytes *
+encode_record (RhythmDBMetadataCache *cache, guint64 missing_since, RhythmDBEntryChange *fields, guint n_fields)
+{
+	const guint8 version[4] = { CACHE_RECORD_VERSION, 0, 0, 0 };
+	GByteArray *b;
+	guint i;
+
+	b = g_byte_array_sized_new (256);
+	g_byte_array_append (b, (const guint8 *)CACHE_RECORD_MAGIC, 4);
+	g_byte_array_append (b, version, sizeof (version));
+	append_uint32 (b, cache->priv->schema_id);
+	append_uint64 (b, missing_since);
+	append_uint16 (b, n_fields);
+
+	for (i = 0; i < n_fields; i++) {
+		const GValue *v = &fields[i].new;
+		const char *str;
+		guint8 boolean;
+		union {
+			gdouble d;
+			guint64 u;
+		} dbl;
+
+		append_uint16 (b, fields[i].prop);
+		switch (G_VALUE_TYPE (v)) {
+		case G_TYPE_STRING:
+			str = g_value_get_string (v);
+			if (str == NULL)
+				str = "";
+			append_uint32 (b, strlen (str));
+			g_byte_array_append (b, (const guint8 *)str, strlen (str));
+			break;
+		case G_TYPE_BOOLEAN:
+			boolean = g_value_get_boolean (v) ? 1 : 0;
+			g_byte_array_append (b, &boolean, 1);
+			break;
+		case G_TYPE_ULONG:
+			/* use uint64 for longs, even on ilp32 */
+			append_uint64 (b, g_value_get_ulong (v));
+			break;
+		case G_TYPE_UINT64:
+			append_uint64 (b, g_value_get_uint64 (v));
+			break;
+		case G_TYPE_DOUBLE:
+			dbl.d = g_value_get_double (v);
+			append_uint64 (b, dbl.u);
+			break;
+		default:
+			g_assert_not_reached ();
+			break;
+		}
+	}
 
-	tdbkey.dsize = strlen(key);
-	tdbkey.dptr = (unsigned char *)key;
+	return g_byte_array_free_to_bytes (b);
+}
 
-	tdb_store (tdb, tdbkey, tdbdata, 0);
+typedef struct {
+	const guint8 *data;
+	gsize size;
+	gsize pos;
+} RecordReader;
+
+static gboolean
+read_bytes (RecordReader *r, gpointer dest, gsize len)
+{
+	if (r->size - r->pos < len)
+		return FALSE;
 
-	g_free (tdbdata.dptr);
+	memcpy (dest, r->data + r->pos, len);
+	r->pos += len;
+	return TRUE;
 }
 
-/**
- * rhythmdb_metadata_cache_load:
- * @cache: a #RhythmDBMetadataCache
- * @key: cache key to load
- * @metadata: returns cached metadata items, if any
- *
- * Fetches metadata from the cache.
- *
- * Return value: %TRUE if metadata was added to the array
- */
-gboolean
-rhythmdb_metadata_cache_load (RhythmDBMetadataCache *cache,
-			      const char *key,
-			      GArray *metadata)
+static gboolean
+read_uint16 (RecordReader *r, guint16 *v)
 {
-	TDB_DATA tdbkey;
-	TDB_DATA tdbvalue;
-	GVariant *cached_metadata;
+	if (read_bytes (r, v, sizeof (*v)) == FALSE)
+		return FALSE;
+	*v = GUINT16_FROM_LE (*v);
+	return TRUE;
+}
+
+static gboolean
+read_uint32 (RecordReader *r, guint32 *v)
+{
+	if (read_bytes (r, v, sizeof (*v)) == FALSE)
+		return FALSE;
+	*v = GUINT32_FROM_LE (*v);
+	return TRUE;
+}
+
+static gboolean
+read_uint64 (RecordReader *r, guint64 *v)
+{
+	if (read_bytes (r, v, sizeof (*v)) == FALSE)
+		return FALSE;
+	*v = GUINT64_FROM_LE (*v);
+	return TRUE;
+}
+
+static gboolean
+decode_legacy_record (RhythmDBMetadataCache *cache,
+		      const guint8 *data,
+		      gsize size,
+		      guint64 *missing_since,
+		      RhythmDBMetadataCacheRecord *record)
+{
+	GVariant *v;
+	GVariant *metadata;
+	GVariant *value;
 	GVariantIter iter;
 	RhythmDBPropType prop;
-	RhythmDBEntryChange *fields;
-	GVariant *value;
-	guint64 missing_since;
 	GType proptype;
 	guint64 u64;
 	char *pkey;
-	int i;
-
-	tdbkey.dptr = (unsigned char *)key;
-	tdbkey.dsize = strlen(key);
-	tdbvalue = tdb_fetch (cache->priv->tdb_context, tdbkey);
-	if (tdbvalue.dptr == NULL)
-		return FALSE;
+	guint i;
 
-	parse_value (tdbvalue, &missing_since, &cached_metadata);
-
-	/* reset missing-since, if necessary */
-	if (missing_since != 0) {
-		store_value (cache->priv->tdb_context, key, 0, cached_metadata);
-	}
+	/* the variant needs suitably aligned data */
+	v = g_variant_new_from_data (G_VARIANT_TYPE ("(ta{sv})"),
+				     g_memdup (data, size), size,
+				     FALSE, g_free, NULL);
+	g_variant_get_child (v, 0, "t", missing_since);
+	metadata = g_variant_get_child_value (v, 1);
+	g_variant_unref (v);
 
-	metadata->len = g_variant_n_children (cached_metadata);
-	fields = g_new0 (RhythmDBEntryChange, metadata->len);
-	metadata->data = (char *)fields;
+	record->fields = g_new0 (RhythmDBEntryChange, g_variant_n_children (metadata));
 
 	i = 0;
-	g_variant_iter_init (&iter, cached_metadata);
+	g_variant_iter_init (&iter, metadata);
 	while (g_variant_iter_loop (&iter, "{sv}", &pkey, &value)) {
 		prop = rhythmdb_propid_from_nice_elt_name (cache->priv->db, (xmlChar *)pkey);
 		if (prop == -1) {
@@ -240,16 +388,16 @@ rhythmdb_metadata_cache_load (RhythmDBMetadataCache *cache,
 			continue;
 		}
 
-		fields[i].prop = prop;
+		record->fields[i].prop = prop;
 		proptype = rhythmdb_get_property_type (cache->priv->db, prop);
-		g_value_init (&fields[i].new, proptype);
+		g_value_init (&record->fields[i].new, proptype);
 
 		switch (proptype) {
 		case G_TYPE_STRING:
-			g_value_set_string (&fields[i].new, g_variant_get_string (value, NULL));
+			g_value_set_string (&record->fields[i].new, g_variant_get_string (value, NULL));
 			break;
 		case G_TYPE_BOOLEAN:
-			g_value_set_boolean (&fields[i].new, g_variant_get_boolean (value));
+			g_value_set_boolean (&record->fields[i].new, g_variant_get_boolean (value));
 			break;
 		case G_TYPE_ULONG:
 			/* we always store longs as uint64, so check for overflow */
@@ -258,13 +406,13 @@ rhythmdb_metadata_cache_load (RhythmDBMetadataCache *cache,
 				rb_debug ("value %" G_GUINT64_FORMAT " overflows", u64);
 				u64 = G_MAXULONG;
 			}
-			g_value_set_ulong (&fields[i].new, u64);
+			g_value_set_ulong (&record->fields[i].new, u64);
 			break;
 		case G_TYPE_UINT64:
-			g_value_set_uint64 (&fields[i].new, g_variant_get_uint64 (value));
+			g_value_set_uint64 (&record->fields[i].new, g_variant_get_uint64 (value));
 			break;
 		case G_TYPE_DOUBLE:
-			g_value_set_double (&fields[i].new, g_variant_get_double (value));
+			g_value_set_double (&record->fields[i].new, g_variant_get_double (value));
 			break;
 		default:
 			g_assert_not_reached ();
@@ -272,85 +420,514 @@ rhythmdb_metadata_cache_load (RhythmDBMetadataCache *cache,
 		}
 		i++;
 	}
+	record->n_fields = i;
+
+	g_variant_unref (metadata);
+	return TRUE;
+}
+
+static gboolean
+decode_record (RhythmDBMetadataCache *cache,
+	       const guint8 *data,
+	       gsize size,
+	       guint64 *missing_since,
+	       RhythmDBMetadataCacheRecord *record)
+{
+	RecordReader r = { data, size, 0 };
+	RhythmDBEntryChange *fields;
+	guint8 header[8];
+	guint32 schema_id;
+	guint16 n_fields;
+	guint n = 0;
+	guint i;
+
+	if (read_bytes (&r, header, sizeof (header)) == FALSE ||
+	    memcmp (header, CACHE_RECORD_MAGIC, 4) != 0) {
+		return decode_legacy_record (cache, data, size, missing_since, record);
+	}
+
+	if (header[4] != CACHE_RECORD_VERSION) {
+		rb_debug ("ignoring cache record with format version %d", header[4]);
+		return FALSE;
+	}
+
+	if (read_uint32 (&r, &schema_id) == FALSE ||
+	    read_uint64 (&r, missing_since) == FALSE ||
+	    read_uint16 (&r, &n_fields) == FALSE)
+		return FALSE;
+
+	if (schema_id != cache->priv->schema_id) {
+		rb_debug ("ignoring cache record with schema %x", schema_id);
+		return FALSE;
+	}
+
+	fields = g_new0 (RhythmDBEntryChange, n_fields);
+	for (i = 0; i < n_fields; i++) {
+		guint16 prop;
+		guint32 len;
+		guint64 u64;
+		guint8 boolean;
+		union {
+			gdouble d;
+			guint64 u;
+		} dbl;
+
+		if (read_uint16 (&r, &prop) == FALSE || prop >= RHYTHMDB_NUM_PROPERTIES)
+			goto corrupt;
+
+		fields[n].prop = prop;
+		switch (rhythmdb_get_property_type (cache->priv->db, prop)) {
+		case G_TYPE_STRING:
+			if (read_uint32 (&r, &len) == FALSE || r.size - r.pos < len)
+				goto corrupt;
+			g_value_init (&fields[n].new, G_TYPE_STRING);
+			g_value_take_string (&fields[n].new, g_strndup ((const char *)r.data + r.pos, len));
+			r.pos += len;
+			break;
+		case G_TYPE_BOOLEAN:
+			if (read_bytes (&r, &boolean, 1) == FALSE)
+				goto corrupt;
+			g_value_init (&fields[n].new, G_TYPE_BOOLEAN);
+			g_value_set_boolean (&fields[n].new, boolean != 0);
+			break;
+		case G_TYPE_ULONG:
+			if (read_uint64 (&r, &u64) == FALSE)
+				goto corrupt;
+			/* we always store longs as uint64, so check for overflow */
+			if (u64 > G_MAXULONG) {
+				rb_debug ("value %" G_GUINT64_FORMAT " overflows", u64);
+				u64 = G_MAXULONG;
+			}
+			g_value_init (&fields[n].new, G_TYPE_ULONG);
+			g_value_set_ulong (&fields[n].new, u64);
+			break;
+		case G_TYPE_UINT64:
+			if (read_uint64 (&r, &u64) == FALSE)
+				goto corrupt;
+			g_value_init (&fields[n].new, G_TYPE_UINT64);
+			g_value_set_uint64 (&fields[n].new, u64);
+			break;
+		case G_TYPE_DOUBLE:
+			if (read_uint64 (&r, &dbl.u) == FALSE)
+				goto corrupt;
+			g_value_init (&fields[n].new, G_TYPE_DOUBLE);
+			g_value_set_double (&fields[n].new, dbl.d);
+			break;
+		default:
+			goto corrupt;
+		}
+		n++;
+	}
+
+	record->fields = fields;
+	record->n_fields = n;
+	return TRUE;
+
+corrupt:
+	rb_debug ("corrupt cache record");
+	free_fields (fields, n);
+	return FALSE;
+}
+
+/* must be called with the tdb lock held */
+static gboolean
+flush_pending_locked (RhythmDBMetadataCache *cache)
+{
+	GHashTableIter iter;
+	GHashTable *batch;
+	gpointer key;
+	gpointer value;
+	guint count;
+
+	/* take the pending records, so stores can carry on while they're written */
+	g_mutex_lock (&cache->priv->record_lock);
+	batch = cache->priv->pending;
+	cache->priv->pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_bytes_unref);
+	cache->priv->flush_queued = FALSE;
+	g_mutex_unlock (&cache->priv->record_lock);
+
+	count = g_hash_table_size (batch);
+	if (count == 0 || cache->priv->tdb_context == NULL) {
+		g_hash_table_destroy (batch);
+		return TRUE;
+	}
+
+	if (tdb_transaction_start (cache->priv->tdb_context) != 0) {
+		rb_debug ("unable to start metadata cache transaction");
+		goto failed;
+	}
+
+	g_hash_table_iter_init (&iter, batch);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		TDB_DATA tdbkey;
+		TDB_DATA tdbdata;
+		gsize size;
+
+		tdbkey.dptr = (unsigned char *)key;
+		tdbkey.dsize = strlen (key);
+		tdbdata.dptr = (unsigned char *)g_bytes_get_data (value, &size);
+		tdbdata.dsize = size;
+		tdb_store (cache->priv->tdb_context, tdbkey, tdbdata, 0);
+	}
+
+	if (tdb_transaction_commit (cache->priv->tdb_context) != 0) {
+		rb_debug ("unable to commit metadata cache transaction");
+		goto failed;
+	}
 
-	g_variant_unref (cached_metadata);
+	rb_debug ("wrote %u metadata cache records", count);
+	g_hash_table_destroy (batch);
+	return TRUE;
+
+failed:
+	/* put back the records that haven't been replaced since */
+	g_mutex_lock (&cache->priv->record_lock);
+	g_hash_table_iter_init (&iter, batch);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		if (g_hash_table_contains (cache->priv->pending, key) == FALSE) {
+			g_hash_table_insert (cache->priv->pending, key, value);
+			g_hash_table_iter_steal (&iter);
+		}
+	}
+	g_mutex_unlock (&cache->priv->record_lock);
+	g_hash_table_destroy (batch);
+	return FALSE;
+}
+
+static void
+flush_pending_thread (GTask *task, RhythmDBMetadataCache *cache, gpointer task_data, GCancellable *cancel)
+{
+	g_mutex_lock (&cache->priv->tdb_lock);
+	flush_pending_locked (cache);
+	g_mutex_unlock (&cache->priv->tdb_lock);
+}
+
+/* must be called with the record lock held */
+static void
+queue_flush (RhythmDBMetadataCache *cache)
+{
+	GTask *task;
+
+	if (cache->priv->flush_queued)
+		return;
+
+	/* writing a batch takes a while, so do it on a worker thread */
+	cache->priv->flush_queued = TRUE;
+	task = g_task_new (cache, NULL, NULL, NULL);
+	g_task_run_in_thread (task, (GTaskThreadFunc) flush_pending_thread);
+	g_object_unref (task);
+}
+
+static gboolean
+flush_pending_cb (RhythmDBMetadataCache *cache)
+{
+	g_mutex_lock (&cache->priv->record_lock);
+	cache->priv->flush_id = 0;
+	queue_flush (cache);
+	g_mutex_unlock (&cache->priv->record_lock);
+	return FALSE;
+}
+
+/* must be called with the record lock held */
+static void
+queue_write (RhythmDBMetadataCache *cache, const char *key, GBytes *record)
+{
+	g_hash_table_replace (cache->priv->pending, g_strdup (key), record);
+
+	if (g_hash_table_size (cache->priv->pending) >= CACHE_FLUSH_BATCH) {
+		queue_flush (cache);
+	} else if (cache->priv->flush_id == 0) {
+		cache->priv->flush_id = g_timeout_add_seconds_full (G_PRIORITY_DEFAULT_IDLE,
+								    CACHE_FLUSH_DELAY,
+								    (GSourceFunc) flush_pending_cb,
+								    g_object_ref (cache),
+								    g_object_unref);
+	}
+}
+
+/* must be called with the tdb lock held */
+static RhythmDBMetadataCacheRecord *
+fetch_record_locked (RhythmDBMetadataCache *cache, const char *key)
+{
+	RhythmDBMetadataCacheRecord *record;
+	TDB_DATA tdbkey;
+	TDB_DATA tdbvalue;
+	GBytes *pending = NULL;
+	gpointer stolen_key;
+	guint64 missing_since = 0;
+	gboolean legacy = FALSE;
+	gboolean decoded;
+
+	g_mutex_lock (&cache->priv->record_lock);
+	if (g_hash_table_steal_extended (cache->priv->prefetched, key, &stolen_key, (gpointer *) &record)) {
+		g_mutex_unlock (&cache->priv->record_lock);
+		g_free (stolen_key);
+		return record;
+	}
+
+	pending = g_hash_table_lookup (cache->priv->pending, key);
+	if (pending != NULL)
+		g_bytes_ref (pending);
+	g_mutex_unlock (&cache->priv->record_lock);
+
+	record = g_slice_new0 (RhythmDBMetadataCacheRecord);
+	if (pending != NULL) {
+		gsize size;
+		const guint8 *data;
+
+		data = g_bytes_get_data (pending, &size);
+		decoded = decode_record (cache, data, size, &missing_since, record);
+		g_bytes_unref (pending);
+	} else {
+		if (cache->priv->tdb_context == NULL) {
+			g_slice_free (RhythmDBMetadataCacheRecord, record);
+			return NULL;
+		}
+
+		tdbkey.dptr = (unsigned char *)key;
+		tdbkey.dsize = strlen (key);
+		tdbvalue = tdb_fetch (cache->priv->tdb_context, tdbkey);
+		if (tdbvalue.dptr == NULL) {
+			g_slice_free (RhythmDBMetadataCacheRecord, record);
+			return NULL;
+		}
+
+		legacy = (tdbvalue.dsize < 4 || memcmp (tdbvalue.dptr, CACHE_RECORD_MAGIC, 4) != 0);
+		decoded = decode_record (cache, tdbvalue.dptr, tdbvalue.dsize, &missing_since, record);
+		free (tdbvalue.dptr);
+	}
+
+	if (decoded == FALSE) {
+		g_slice_free (RhythmDBMetadataCacheRecord, record);
+		return NULL;
+	}
+
+	/* reset missing-since, and convert old records, but don't wait for the write */
+	if (missing_since != 0 || legacy) {
+		GBytes *updated;
+
+		updated = encode_record (cache, 0, record->fields, record->n_fields);
+		g_mutex_lock (&cache->priv->record_lock);
+		queue_write (cache, key, updated);
+		g_mutex_unlock (&cache->priv->record_lock);
+	}
+
+	return record;
+}
+
+/**
+ * rhythmdb_metadata_cache_load:
+ * @cache: a #RhythmDBMetadataCache
+ * @key: cache key to load
+ * @metadata: returns cached metadata items, if any
+ *
+ * Fetches metadata from the cache.
+ *
+ * Return value: %TRUE if metadata was added to the array
+ */
+gboolean
+rhythmdb_metadata_cache_load (RhythmDBMetadataCache *cache,
+			      const char *key,
+			      GArray *metadata)
+{
+	RhythmDBMetadataCacheRecord *record;
+
+	g_mutex_lock (&cache->priv->tdb_lock);
+	record = fetch_record_locked (cache, key);
+	g_mutex_unlock (&cache->priv->tdb_lock);
+
+	if (record == NULL)
+		return FALSE;
+
+	metadata->data = (char *)record->fields;
+	metadata->len = record->n_fields;
+	g_slice_free (RhythmDBMetadataCacheRecord, record);
 	return TRUE;
 }
 
+/**
+ * rhythmdb_metadata_cache_load_many:
+ * @cache: a #RhythmDBMetadataCache
+ * @keys: (array zero-terminated=1): cache keys to load
+ * @func: (scope call): function to call for each key found in the cache
+ * @data: data to pass to @func
+ *
+ * Fetches metadata for several keys at once, taking the cache lock only
+ * once.  @func is called for each key that was found, after all the keys
+ * have been looked up, and takes ownership of the contents of the
+ * metadata array.
+ *
+ * Return value: the number of keys found in the cache
+ */
+guint
+rhythmdb_metadata_cache_load_many (RhythmDBMetadataCache *cache,
+				   const char * const *keys,
+				   RhythmDBMetadataCacheLoadFunc func,
+				   gpointer data)
+{
+	RhythmDBMetadataCacheRecord **records;
+	guint found = 0;
+	guint n;
+	guint i;
+
+	n = g_strv_length ((char **)keys);
+	records = g_new0 (RhythmDBMetadataCacheRecord *, n);
+
+	g_mutex_lock (&cache->priv->tdb_lock);
+	for (i = 0; i < n; i++) {
+		records[i] = fetch_record_locked (cache, keys[i]);
+	}
+	g_mutex_unlock (&cache->priv->tdb_lock);
+
+	for (i = 0; i < n; i++) {
+		GArray metadata;
+
+		if (records[i] == NULL)
+			continue;
+
+		metadata.data = (char *)records[i]->fields;
+		metadata.len = records[i]->n_fields;
+		g_slice_free (RhythmDBMetadataCacheRecord, records[i]);
+
+		func (keys[i], &metadata, data);
+		found++;
+	}
+
+	g_free (records);
+	return found;
+}
+
+static void
+prefetch_cb (const char *key, GArray *metadata, RhythmDBMetadataCache *cache)
+{
+	RhythmDBMetadataCacheRecord *record;
+
+	record = g_slice_new0 (RhythmDBMetadataCacheRecord);
+	record->fields = (RhythmDBEntryChange *)metadata->data;
+	record->n_fields = metadata->len;
+
+	g_mutex_lock (&cache->priv->record_lock);
+	g_hash_table_replace (cache->priv->prefetched, g_strdup (key), record);
+	g_mutex_unlock (&cache->priv->record_lock);
+}
+
+/**
+ * rhythmdb_metadata_cache_prefetch:
+ * @cache: a #RhythmDBMetadataCache
+ * @keys: (array zero-terminated=1): cache keys to prefetch
+ *
+ * Loads metadata for several keys into memory, so subsequent calls to
+ * @rhythmdb_metadata_cache_load for those keys don't need to touch the
+ * cache file.  Each prefetched record is dropped once it has been loaded.
+ */
+void
+rhythmdb_metadata_cache_prefetch (RhythmDBMetadataCache *cache,
+				  const char * const *keys)
+{
+	guint n;
+
+	n = g_strv_length ((char **)keys);
+	if (n > CACHE_MAX_PREFETCHED)
+		return;
+
+	/* records that were prefetched but never loaded aren't going to be */
+	g_mutex_lock (&cache->priv->record_lock);
+	if (g_hash_table_size (cache->priv->prefetched) + n > CACHE_MAX_PREFETCHED) {
+		rb_debug ("discarding %u unused prefetched records", g_hash_table_size (cache->priv->prefetched));
+		g_hash_table_remove_all (cache->priv->prefetched);
+	}
+	g_mutex_unlock (&cache->priv->record_lock);
+
+	rhythmdb_metadata_cache_load_many (cache, keys, (RhythmDBMetadataCacheLoadFunc) prefetch_cb, cache);
+}
+
 /**
  * rhythmdb_metadata_cache_store:
  * @cache: a #RhythmDBMetadataCache
  * @key: cache key to store
  * @entry: entry to store
  *
- * Stores metadata in the cache.
+ * Stores metadata in the cache.  The write happens some time later,
+ * batched with other writes.
  */
 void
 rhythmdb_metadata_cache_store (RhythmDBMetadataCache *cache,
 			       const char *key,
 			       RhythmDBEntry *entry)
 {
-	GVariantBuilder vb;
+	RhythmDBEntryChange fields[G_N_ELEMENTS (cached_properties)];
+	GBytes *record;
+	guint n = 0;
 	int i;
 
-	g_variant_builder_init (&vb, G_VARIANT_TYPE ("a{sv}"));
+	memset (fields, 0, sizeof (fields));
 	for (i = 0; i < G_N_ELEMENTS(cached_properties); i++) {
 		GType proptype;
 		const char *str;
 		gulong ulong;
 		guint64 u64;
-		GVariant *v;
 
-		v = NULL;
 		proptype = rhythmdb_get_property_type (cache->priv->db, cached_properties[i]);
 		switch (proptype) {
 		case G_TYPE_STRING:
 			str = rhythmdb_entry_get_string (entry, cached_properties[i]);
-			if (str != NULL && str[0] != '\0' && g_str_equal (str, _("Unknown")) == FALSE) {
-				v = g_variant_new_string (str);
-			}
+			if (str == NULL || str[0] == '\0' || g_str_equal (str, _("Unknown")))
+				continue;
+
+			g_value_init (&fields[n].new, G_TYPE_STRING);
+			g_value_set_string (&fields[n].new, str);
 			break;
 
 		case G_TYPE_ULONG:
 			ulong = rhythmdb_entry_get_ulong (entry, cached_properties[i]);
-			if (ulong != 0) {
-				/* use uint64 for longs, even on ilp32 */
-				v = g_variant_new_uint64 (ulong);
-			}
+			if (ulong == 0)
+				continue;
+
+			g_value_init (&fields[n].new, G_TYPE_ULONG);
+			g_value_set_ulong (&fields[n].new, ulong);
 			break;
 
 		case G_TYPE_UINT64:
 			u64 = rhythmdb_entry_get_uint64 (entry, cached_properties[i]);
-			if (u64 != 0) {
-				v = g_variant_new_uint64 (u64);
-			}
+			if (u64 == 0)
+				continue;
+
+			g_value_init (&fields[n].new, G_TYPE_UINT64);
+			g_value_set_uint64 (&fields[n].new, u64);
 			break;
 
 		case G_TYPE_BOOLEAN:
-			v = g_variant_new_boolean (rhythmdb_entry_get_boolean (entry, cached_properties[i]));
+			g_value_init (&fields[n].new, G_TYPE_BOOLEAN);
+			g_value_set_boolean (&fields[n].new, rhythmdb_entry_get_boolean (entry, cached_properties[i]));
 			break;
 
 		case G_TYPE_DOUBLE:
-			v = g_variant_new_double (rhythmdb_entry_get_double (entry, cached_properties[i]));
+			g_value_init (&fields[n].new, G_TYPE_DOUBLE);
+			g_value_set_double (&fields[n].new, rhythmdb_entry_get_double (entry, cached_properties[i]));
 			break;
 
 		default:
 			g_assert_not_reached ();
 		}
 
-		if (v != NULL) {
-			const char *tag;
+		fields[n].prop = cached_properties[i];
+		n++;
+	}
 
-			tag = (const char *)rhythmdb_nice_elt_name_from_propid (cache->priv->db, cached_properties[i]);
-			g_variant_builder_add (&vb, "{sv}", tag, v);
-		}
+	record = encode_record (cache, 0, fields, n);
+	for (i = 0; i < n; i++) {
+		g_value_unset (&fields[i].new);
 	}
 
-	store_value (cache->priv->tdb_context, key, 0, g_variant_builder_end (&vb));
+	g_mutex_lock (&cache->priv->record_lock);
+	/* a prefetched copy of the old record would be stale now */
+	g_hash_table_remove (cache->priv->prefetched, key);
+	queue_write (cache, key, record);
+	g_mutex_unlock (&cache->priv->record_lock);
 }
 
 typedef struct {
-	struct tdb_context *tdb;
+	RhythmDBMetadataCache *cache;
 
 	const char *prefix;
 	guint64 time;
@@ -363,10 +940,10 @@ typedef struct {
 static int
 purge_traverse_cb (struct tdb_context *tdb, TDB_DATA tdbkey, TDB_DATA tdbdata, RhythmDBMetadataCachePurge *purge)
 {
+	RhythmDBMetadataCacheRecord record;
 	guint64 missing_since;
-	GVariant *metadata;
+	GBytes *updated;
 	char *key;
-	TDB_DATA aligndata;
 
 	key = g_strndup ((const char *)tdbkey.dptr, tdbkey.dsize);
 	if (g_str_has_prefix (key, purge->prefix) == FALSE) {
@@ -374,19 +951,29 @@ purge_traverse_cb (struct tdb_context *tdb, TDB_DATA tdbkey, TDB_DATA tdbdata, R
 		return 0;
 	}
 
-	aligndata.dptr = g_memdup (tdbdata.dptr, tdbdata.dsize);
-	aligndata.dsize = tdbdata.dsize;
+	if (decode_record (purge->cache, tdbdata.dptr, tdbdata.dsize, &missing_since, &record) == FALSE) {
+		rb_debug ("entry %s can't be read, deleting", key);
+		tdb_delete (tdb, tdbkey);
+		g_free (key);
+		return 0;
+	}
 
-	parse_value (aligndata, &missing_since, &metadata);
 	if (missing_since == 0) {
 		if (purge->valid_func (key, purge->valid_func_data) == FALSE) {
-			store_value (purge->tdb, key, purge->time, metadata);
+			TDB_DATA newdata;
+			gsize size;
+
+			updated = encode_record (purge->cache, purge->time, record.fields, record.n_fields);
+			newdata.dptr = (unsigned char *)g_bytes_get_data (updated, &size);
+			newdata.dsize = size;
+			tdb_store (tdb, tdbkey, newdata, 0);
+			g_bytes_unref (updated);
 		}
 	} else if (missing_since < purge->before) {
 		rb_debug ("entry %s is too old, deleting", key);
 		tdb_delete (tdb, tdbkey);
 	}
-	g_variant_unref (metadata); /* also frees aligndata.dptr */
+	free_fields (record.fields, record.n_fields);
 	g_free (key);
 
 	return 0;
@@ -417,13 +1004,56 @@ rhythmdb_metadata_cache_purge (RhythmDBMetadataCache *cache,
 	purge.prefix = prefix;
 	purge.valid_func = cb;
 	purge.valid_func_data = cb_data;
-	purge.tdb = cache->priv->tdb_context;
-	tdb_traverse (cache->priv->tdb_context, (tdb_traverse_func)purge_traverse_cb, &purge);
+	purge.cache = cache;
+	g_mutex_lock (&cache->priv->tdb_lock);
+	if (cache->priv->tdb_context != NULL && flush_pending_locked (cache)) {
+		tdb_transaction_start (cache->priv->tdb_context);
+		tdb_traverse (cache->priv->tdb_context, (tdb_traverse_func)purge_traverse_cb, &purge);
+		tdb_transaction_commit (cache->priv->tdb_context);
+	}
+	g_mutex_unlock (&cache->priv->tdb_lock);
 
 	if (cb_data_destroy && cb_data)
 		cb_data_destroy (cb_data);
 }
 
+/**
+ * rhythmdb_metadata_cache_flush:
+ * @cache: a #RhythmDBMetadataCache
+ *
+ * Writes out any pending changes to the cache.
+ */
+void
+rhythmdb_metadata_cache_flush (RhythmDBMetadataCache *cache)
+{
+	g_mutex_lock (&cache->priv->tdb_lock);
+	flush_pending_locked (cache);
+	g_mutex_unlock (&cache->priv->tdb_lock);
+}
+
+/**
+ * rhythmdb_metadata_cache_flush_all:
+ *
+ * Writes out pending changes to all metadata caches.  Can only be called
+ * from the main thread.
+ */
+void
+rhythmdb_metadata_cache_flush_all (void)
+{
+	GHashTableIter iter;
+	gpointer cache;
+
+	g_assert (rb_is_main_thread ());
+
+	if (instances == NULL)
+		return;
+
+	g_hash_table_iter_init (&iter, instances);
+	while (g_hash_table_iter_next (&iter, NULL, &cache)) {
+		rhythmdb_metadata_cache_flush (RHYTHMDB_METADATA_CACHE (cache));
+	}
+}
+
 
 
 static void
@@ -432,6 +1062,11 @@ rhythmdb_metadata_cache_init (RhythmDBMetadataCache *cache)
 	cache->priv = G_TYPE_INSTANCE_GET_PRIVATE (cache,
 						   RHYTHMDB_TYPE_METADATA_CACHE,
 						   RhythmDBMetadataCachePrivate);
+
+	g_mutex_init (&cache->priv->tdb_lock);
+	g_mutex_init (&cache->priv->record_lock);
+	cache->priv->pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_bytes_unref);
+	cache->priv->prefetched = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) free_record);
 }
 
 static void
@@ -487,6 +1122,8 @@ impl_constructed (GObject *object)
 	RB_CHAIN_GOBJECT_METHOD (rhythmdb_metadata_cache_parent_class, constructed, object);
 
 	cache = RHYTHMDB_METADATA_CACHE (object);
+	cache->priv->schema_id = compute_schema_id (cache->priv->db);
+
 	cachedir = g_build_filename (rb_user_cache_dir (), "metadata", NULL);
 	if (g_mkdir_with_parents (cachedir, 0700) != 0) {
 		rb_debug ("unable to create metadata cache directory %s", cachedir);
@@ -509,6 +1146,13 @@ impl_dispose (GObject *object)
 {
 	RhythmDBMetadataCache *cache = RHYTHMDB_METADATA_CACHE (object);
 
+	g_mutex_lock (&cache->priv->tdb_lock);
+	flush_pending_locked (cache);
+	g_mutex_unlock (&cache->priv->tdb_lock);
+	g_mutex_lock (&cache->priv->record_lock);
+	g_clear_handle_id (&cache->priv->flush_id, g_source_remove);
+	g_mutex_unlock (&cache->priv->record_lock);
+
 	g_clear_object (&cache->priv->db);
 
 	G_OBJECT_CLASS (rhythmdb_metadata_cache_parent_class)->dispose (object);
@@ -520,6 +1164,12 @@ impl_finalize (GObject *object)
 	RhythmDBMetadataCache *cache = RHYTHMDB_METADATA_CACHE (object);
 
 	g_free (cache->priv->name);
+	g_hash_table_destroy (cache->priv->pending);
+	g_hash_table_destroy (cache->priv->prefetched);
+	g_mutex_clear (&cache->priv->tdb_lock);
+	g_mutex_clear (&cache->priv->record_lock);
+	if (cache->priv->tdb_context != NULL)
+		tdb_close (cache->priv->tdb_context);
 
 	G_OBJECT_CLASS (rhythmdb_metadata_cache_parent_class)->finalize (object);
 }
@@ -58,6 +58,7 @@ struct _RhythmDBMetadataCacheClass
 };
 
 typedef gboolean (*RhythmDBMetadataCacheValidFunc) (const char *key, gpointer data);
+typedef void (*RhythmDBMetadataCacheLoadFunc) (const char *key, GArray *metadata, gpointer data);
 
 GType		rhythmdb_metadata_cache_get_type		(void);
 
@@ -68,6 +69,14 @@ gboolean	rhythmdb_metadata_cache_load		(RhythmDBMetadataCache *cache,
 							 const char *key,
 							 GArray *metadata);
 
+guint		rhythmdb_metadata_cache_load_many	(RhythmDBMetadataCache *cache,
+							 const char * const *keys,
+							 RhythmDBMetadataCacheLoadFunc func,
+							 gpointer data);
+
+void		rhythmdb_metadata_cache_prefetch	(RhythmDBMetadataCache *cache,
+							 const char * const *keys);
+
 void		rhythmdb_metadata_cache_store		(RhythmDBMetadataCache *cache,
 							 const char *key,
 							 RhythmDBEntry *entry);
@@ -79,6 +88,10 @@ void		rhythmdb_metadata_cache_purge		(RhythmDBMetadataCache *cache,
 							 gpointer cb_data,
 							 GDestroyNotify cb_data_destroy);
 
+void		rhythmdb_metadata_cache_flush		(RhythmDBMetadataCache *cache);
+
+void		rhythmdb_metadata_cache_flush_all	(void);
+
 G_END_DECLS
 
 #endif /* RHYTHMDB_METADATA_CACHE_H */
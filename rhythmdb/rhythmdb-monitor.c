@@ -28,8 +28,21 @@
 
 #include <config.h>
 
+#ifdef HAVE_FANOTIFY
+#define _GNU_SOURCE
+#endif
+
 #include <string.h>
 
+#ifdef HAVE_FANOTIFY
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/fanotify.h>
+#include <glib-unix.h>
+#endif
+
 #include <glib.h>
 #include <glib-object.h>
 #include <glib/gi18n.h>
@@ -44,6 +57,69 @@
 
 #define RHYTHMDB_FILE_MODIFY_PROCESS_TIME 2
 
+/* number of directory monitors to create when the inotify limit can't be found.
+ * once this many directories are monitored, further library locations are scanned instead.
+ */
+#define RHYTHMDB_MONITOR_DEFAULT_WATCH_BUDGET	8192
+
+/* seconds between scans of library locations that are too large to monitor */
+#define RHYTHMDB_MONITOR_SCAN_INTERVAL		60
+
+/* every this many scans, list all directories to find files modified in place */
+#define RHYTHMDB_MONITOR_FULL_SCAN_ROUNDS	10
+
+/*
+ * Library locations are watched by one of three engines:
+ *
+ * - GIO: a GFileMonitor for each directory.  This reports changes
+ *   immediately, but each monitor uses an inotify watch, and there are
+ *   only so many of those to go around.
+ * - fanotify: a single mark on the file system containing the location,
+ *   reporting all changes on it.  Creating the mark needs CAP_SYS_ADMIN,
+ *   so this is only used where that's available.
+ * - scan: the location is listed every RHYTHMDB_MONITOR_SCAN_INTERVAL
+ *   seconds, only descending into directories whose modification time
+ *   has changed, and the results are compared with the previous listing.
+ *
+ * fanotify is used where possible, then GIO until the watch budget runs
+ * out, then scanning.  RB_MONITOR_ENGINE can be set to "gio", "fanotify"
+ * or "scan" to force one.  Changes found by each engine are handled the
+ * same way.
+ */
+typedef enum {
+	MONITOR_ENGINE_AUTO,
+	MONITOR_ENGINE_GIO,
+	MONITOR_ENGINE_FANOTIFY,
+	MONITOR_ENGINE_SCAN
+} RhythmDBMonitorEngine;
+
+typedef struct {
+	guint64 mtime;
+	GHashTable *files;		/* name -> modification time */
+	GHashTable *subdirs;		/* set of names */
+} RhythmDBScanDir;
+
+struct _RhythmDBMonitorLocation {
+	int refcount;
+	RhythmDB *db;
+	char *uri;
+	GFile *root;
+	RhythmDBMonitorEngine engine;
+	GCancellable *cancel;
+	gboolean stopped;
+
+	/* scan engine state; dirs is only accessed by the thread doing the scan */
+	GHashTable *dirs;		/* uri -> RhythmDBScanDir */
+	guint scan_count;
+	guint scan_id;
+	gboolean scanning;
+	gint64 scan_start;
+	guint scanned_dirs;
+
+	/* fanotify engine state */
+	int mount_fd;
+};
+
 static void rhythmdb_directory_change_cb (GFileMonitor *monitor,
 					  GFile *file,
 					  GFile *other_file,
@@ -55,6 +131,12 @@ static void rhythmdb_mount_added_cb (GVolumeMonitor *monitor,
 static void rhythmdb_mount_removed_cb (GVolumeMonitor *monitor,
 				       GMount *mount,
 				       RhythmDB *db);
+static guint get_watch_budget (void);
+static void add_uri_monitor (RhythmDB *db, const char *uri, GError **error);
+static void process_file_event (RhythmDB *db,
+				GFileMonitorEvent event_type,
+				const char *canon_uri,
+				const char *other_canon_uri);
 
 void
 rhythmdb_init_monitoring (RhythmDB *db)
@@ -67,6 +149,9 @@ rhythmdb_init_monitoring (RhythmDB *db)
 							 (GDestroyNotify) rb_refstring_unref,
 							 NULL);
 
+	db->priv->fanotify_fd = -1;
+	db->priv->monitor_watch_budget = get_watch_budget ();
+
 	db->priv->volume_monitor = g_volume_monitor_get ();
 	g_signal_connect (G_OBJECT (db->priv->volume_monitor),
 			  "mount-added",
@@ -106,14 +191,97 @@ rhythmdb_finalize_monitoring (RhythmDB *db)
 	g_hash_table_destroy (db->priv->changed_files);
 }
 
+static RhythmDBMonitorLocation *
+monitor_location_ref (RhythmDBMonitorLocation *loc)
+{
+	g_atomic_int_inc (&loc->refcount);
+	return loc;
+}
+
+static void
+monitor_location_unref (RhythmDBMonitorLocation *loc)
+{
+	if (g_atomic_int_dec_and_test (&loc->refcount) == FALSE)
+		return;
+
+	if (loc->dirs != NULL)
+		g_hash_table_destroy (loc->dirs);
+#ifdef HAVE_FANOTIFY
+	if (loc->mount_fd != -1)
+		close (loc->mount_fd);
+#endif
+	g_object_unref (loc->cancel);
+	g_object_unref (loc->root);
+	g_object_unref (loc->db);
+	g_free (loc->uri);
+	g_free (loc);
+}
+
 void
 rhythmdb_stop_monitoring (RhythmDB *db)
 {
+	GList *l;
+
+	for (l = db->priv->monitor_locations; l != NULL; l = l->next) {
+		RhythmDBMonitorLocation *loc = l->data;
+
+		loc->stopped = TRUE;
+		g_cancellable_cancel (loc->cancel);
+		if (loc->scan_id != 0) {
+			g_source_remove (loc->scan_id);
+			loc->scan_id = 0;
+		}
+		monitor_location_unref (loc);
+	}
+	g_list_free (db->priv->monitor_locations);
+	db->priv->monitor_locations = NULL;
+
+#ifdef HAVE_FANOTIFY
+	/* closing the fanotify descriptor removes all its marks */
+	if (db->priv->fanotify_watch_id != 0) {
+		g_source_remove (db->priv->fanotify_watch_id);
+		db->priv->fanotify_watch_id = 0;
+	}
+	if (db->priv->fanotify_fd != -1) {
+		close (db->priv->fanotify_fd);
+		db->priv->fanotify_fd = -1;
+	}
+#endif
+
 	g_hash_table_foreach_remove (db->priv->monitored_directories,
 				     (GHRFunc) rb_true_function,
 				     db);
 }
 
+/* returns TRUE if the directory is under a library location watched by something other than GIO */
+static gboolean
+directory_is_covered (RhythmDB *db, GFile *directory)
+{
+	GList *l;
+
+	for (l = db->priv->monitor_locations; l != NULL; l = l->next) {
+		RhythmDBMonitorLocation *loc = l->data;
+
+		if (loc->engine != MONITOR_ENGINE_FANOTIFY && loc->engine != MONITOR_ENGINE_SCAN)
+			continue;
+
+		if (g_file_equal (directory, loc->root) || g_file_has_prefix (directory, loc->root))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static gboolean
+watch_budget_used (RhythmDB *db)
+{
+	gboolean used;
+
+	g_mutex_lock (&db->priv->monitor_mutex);
+	used = g_hash_table_size (db->priv->monitored_directories) >= db->priv->monitor_watch_budget;
+	g_mutex_unlock (&db->priv->monitor_mutex);
+	return used;
+}
+
 static void
 actually_add_monitor (RhythmDB *db, GFile *directory, GError **error)
 {
@@ -123,6 +291,10 @@ actually_add_monitor (RhythmDB *db, GFile *directory, GError **error)
 		return;
 	}
 
+	if (directory_is_covered (db, directory)) {
+		return;
+	}
+
 	g_mutex_lock (&db->priv->monitor_mutex);
 
 	if (g_hash_table_lookup (db->priv->monitored_directories, directory)) {
@@ -144,13 +316,388 @@ actually_add_monitor (RhythmDB *db, GFile *directory, GError **error)
 	g_mutex_unlock (&db->priv->monitor_mutex);
 }
 
+static void
+free_scan_dir (RhythmDBScanDir *dir)
+{
+	g_hash_table_destroy (dir->files);
+	g_hash_table_destroy (dir->subdirs);
+	g_free (dir);
+}
+
+static void
+free_scan_change (RhythmDBScanChange *change)
+{
+	g_free (change->uri);
+	g_free (change);
+}
+
+static void
+add_scan_change (GPtrArray *changes, RhythmDBScanChangeType type, GFile *dir, const char *name)
+{
+	RhythmDBScanChange *change;
+	GFile *file;
+
+	file = g_file_get_child (dir, name);
+	change = g_new0 (RhythmDBScanChange, 1);
+	change->type = type;
+	change->uri = g_file_get_uri (file);
+	g_ptr_array_add (changes, change);
+	g_object_unref (file);
+}
+
+/* reports everything previously found under a directory as deleted */
+static void
+scan_dir_deleted (RhythmDBMonitorLocation *loc, GFile *dir, GPtrArray *changes)
+{
+	RhythmDBScanDir *scan_dir;
+	GHashTableIter iter;
+	gpointer name;
+	char *uri;
+
+	uri = g_file_get_uri (dir);
+	scan_dir = g_hash_table_lookup (loc->dirs, uri);
+	if (scan_dir == NULL) {
+		g_free (uri);
+		return;
+	}
+
+	g_hash_table_iter_init (&iter, scan_dir->files);
+	while (g_hash_table_iter_next (&iter, &name, NULL)) {
+		add_scan_change (changes, SCAN_FILE_DELETED, dir, name);
+	}
+
+	g_hash_table_iter_init (&iter, scan_dir->subdirs);
+	while (g_hash_table_iter_next (&iter, &name, NULL)) {
+		GFile *child;
+
+		child = g_file_get_child (dir, name);
+		scan_dir_deleted (loc, child, changes);
+		g_object_unref (child);
+	}
+
+	g_hash_table_remove (loc->dirs, uri);
+	g_free (uri);
+}
+
+static void
+scan_dir (RhythmDBMonitorLocation *loc, GFile *dir, gboolean initial, gboolean full, GQueue *dirs, GPtrArray *changes)
+{
+	RhythmDBScanDir *previous;
+	RhythmDBScanDir *current;
+	GFileEnumerator *files;
+	GHashTableIter iter;
+	GFileInfo *info;
+	GError *error = NULL;
+	gpointer name;
+	guint64 mtime;
+	char *uri;
+
+	info = g_file_query_info (dir, G_FILE_ATTRIBUTE_TIME_MODIFIED, G_FILE_QUERY_INFO_NONE, loc->cancel, &error);
+	if (error != NULL) {
+		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+			scan_dir_deleted (loc, dir, changes);
+		g_error_free (error);
+		return;
+	}
+	mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+	g_object_unref (info);
+
+	uri = g_file_get_uri (dir);
+	previous = g_hash_table_lookup (loc->dirs, uri);
+	if (previous != NULL && full == FALSE && mtime != 0 && previous->mtime == mtime) {
+		/* no files added or removed, so just check subdirectories */
+		g_hash_table_iter_init (&iter, previous->subdirs);
+		while (g_hash_table_iter_next (&iter, &name, NULL)) {
+			g_queue_push_tail (dirs, g_file_get_child (dir, name));
+		}
+		g_free (uri);
+		return;
+	}
+
+	files = g_file_enumerate_children (dir,
+					   G_FILE_ATTRIBUTE_STANDARD_NAME ","
+					   G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+					   G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
+					   G_FILE_ATTRIBUTE_TIME_MODIFIED,
+					   G_FILE_QUERY_INFO_NONE,
+					   loc->cancel,
+					   &error);
+	if (error != NULL) {
+		rb_debug ("unable to list %s: %s", uri, error->message);
+		g_error_free (error);
+		g_free (uri);
+		return;
+	}
+
+	current = g_new0 (RhythmDBScanDir, 1);
+	current->mtime = mtime;
+	current->files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	current->subdirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	while ((info = g_file_enumerator_next_file (files, loc->cancel, &error)) != NULL) {
+		const char *child_name;
+
+		child_name = g_file_info_get_name (info);
+		if (g_file_info_get_is_hidden (info)) {
+			g_object_unref (info);
+			continue;
+		}
+
+		if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+			g_hash_table_add (current->subdirs, g_strdup (child_name));
+			g_queue_push_tail (dirs, g_file_get_child (dir, child_name));
+		} else {
+			guint64 *file_mtime;
+			guint64 *previous_mtime = NULL;
+
+			file_mtime = g_new0 (guint64, 1);
+			*file_mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+			g_hash_table_insert (current->files, g_strdup (child_name), file_mtime);
+
+			if (previous != NULL)
+				previous_mtime = g_hash_table_lookup (previous->files, child_name);
+
+			if (initial) {
+				add_scan_change (changes, SCAN_FILE_FOUND, dir, child_name);
+			} else if (previous_mtime == NULL) {
+				add_scan_change (changes, SCAN_FILE_CREATED, dir, child_name);
+			} else if (*previous_mtime != *file_mtime) {
+				add_scan_change (changes, SCAN_FILE_CHANGED, dir, child_name);
+			}
+		}
+		g_object_unref (info);
+	}
+	g_object_unref (files);
+
+	if (error != NULL) {
+		/* the listing is incomplete, so anything not seen may still be there.
+		 * keep the previous listing so the next scan looks at the directory again.
+		 */
+		rb_debug ("error listing %s: %s", uri, error->message);
+		g_error_free (error);
+		if (previous != NULL)
+			previous->mtime = 0;
+		free_scan_dir (current);
+		g_free (uri);
+		return;
+	}
+
+	if (previous != NULL) {
+		g_hash_table_iter_init (&iter, previous->files);
+		while (g_hash_table_iter_next (&iter, &name, NULL)) {
+			if (g_hash_table_contains (current->files, name) == FALSE)
+				add_scan_change (changes, SCAN_FILE_DELETED, dir, name);
+		}
+
+		g_hash_table_iter_init (&iter, previous->subdirs);
+		while (g_hash_table_iter_next (&iter, &name, NULL)) {
+			if (g_hash_table_contains (current->subdirs, name) == FALSE) {
+				GFile *child;
+
+				child = g_file_get_child (dir, name);
+				scan_dir_deleted (loc, child, changes);
+				g_object_unref (child);
+			}
+		}
+	}
+
+	g_hash_table_replace (loc->dirs, uri, current);
+}
+
+static GPtrArray *
+scan_location_dirs (RhythmDBMonitorLocation *loc, gboolean initial, gboolean full)
+{
+	GPtrArray *changes;
+	GQueue dirs = G_QUEUE_INIT;
+	GFile *dir;
+
+	changes = g_ptr_array_new_with_free_func ((GDestroyNotify) free_scan_change);
+
+	g_queue_push_tail (&dirs, g_object_ref (loc->root));
+	while ((dir = g_queue_pop_head (&dirs)) != NULL) {
+		if (g_cancellable_is_cancelled (loc->cancel) == FALSE)
+			scan_dir (loc, dir, initial, full, &dirs, changes);
+		g_object_unref (dir);
+	}
+
+	loc->scanned_dirs = g_hash_table_size (loc->dirs);
+	return changes;
+}
+
+static void
+scan_location_thread (GTask *task, gpointer source, RhythmDBMonitorLocation *loc, GCancellable *cancel)
+{
+	GPtrArray *changes;
+	gboolean initial;
+	gboolean full;
+
+	initial = (loc->scan_count == 0);
+	full = (loc->scan_count % RHYTHMDB_MONITOR_FULL_SCAN_ROUNDS) == 0;
+	changes = scan_location_dirs (loc, initial, full);
+	g_task_return_pointer (task, changes, (GDestroyNotify) g_ptr_array_unref);
+}
+
+/*
+ * These run the scan engine synchronously on a location that isn't otherwise
+ * monitored, so tests can check what it finds.
+ */
+RhythmDBMonitorLocation *
+rhythmdb_monitor_scan_location_new (RhythmDB *db, const char *uri)
+{
+	RhythmDBMonitorLocation *loc;
+
+	loc = g_new0 (RhythmDBMonitorLocation, 1);
+	loc->refcount = 1;
+	loc->db = g_object_ref (db);
+	loc->uri = g_strdup (uri);
+	loc->root = g_file_new_for_uri (uri);
+	loc->cancel = g_cancellable_new ();
+	loc->mount_fd = -1;
+	loc->engine = MONITOR_ENGINE_SCAN;
+	loc->dirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) free_scan_dir);
+	return loc;
+}
+
+GPtrArray *
+rhythmdb_monitor_scan_location_run (RhythmDBMonitorLocation *loc, gboolean full)
+{
+	GPtrArray *changes;
+
+	changes = scan_location_dirs (loc, loc->scan_count == 0, full);
+	loc->scan_count++;
+	return changes;
+}
+
+void
+rhythmdb_monitor_scan_location_free (RhythmDBMonitorLocation *loc)
+{
+	monitor_location_unref (loc);
+}
+
+static void
+log_monitor_stats (RhythmDB *db)
+{
+	RhythmDBMonitorStats stats;
+
+	rhythmdb_get_monitor_stats (db, &stats);
+	rb_debug ("monitoring: %u directory monitors, %u file system locations, %u scanned locations (%u directories); %u events, %.1f per minute",
+		  stats.directory_monitors,
+		  stats.filesystem_locations,
+		  stats.scanned_locations,
+		  stats.scanned_directories,
+		  stats.events,
+		  stats.events_per_minute);
+}
+
+static void
+scan_location_done (GObject *source, GAsyncResult *result, RhythmDBMonitorLocation *loc)
+{
+	GPtrArray *changes;
+	RhythmDB *db = loc->db;
+	gint64 elapsed;
+	guint i;
+
+	changes = g_task_propagate_pointer (G_TASK (result), NULL);
+	loc->scanning = FALSE;
+	if (loc->stopped || changes == NULL) {
+		if (changes != NULL)
+			g_ptr_array_unref (changes);
+		monitor_location_unref (loc);
+		return;
+	}
+
+	elapsed = g_get_monotonic_time () - loc->scan_start;
+	rb_debug ("scan %u of %s took %" G_GINT64_FORMAT " ms, found %u changes",
+		  loc->scan_count,
+		  loc->uri,
+		  elapsed / 1000,
+		  changes->len);
+	loc->scan_count++;
+
+	for (i = 0; i < changes->len; i++) {
+		RhythmDBScanChange *change = g_ptr_array_index (changes, i);
+
+		switch (change->type) {
+		case SCAN_FILE_FOUND:
+			/* add the file to the database if it's not already there */
+			if (rhythmdb_entry_lookup_by_location (db, change->uri) == NULL)
+				rhythmdb_add_uri (db, change->uri);
+			break;
+		case SCAN_FILE_CREATED:
+			process_file_event (db, G_FILE_MONITOR_EVENT_CREATED, change->uri, NULL);
+			break;
+		case SCAN_FILE_CHANGED:
+			process_file_event (db, G_FILE_MONITOR_EVENT_CHANGED, change->uri, NULL);
+			break;
+		case SCAN_FILE_DELETED:
+			process_file_event (db, G_FILE_MONITOR_EVENT_DELETED, change->uri, NULL);
+			break;
+		}
+	}
+	g_ptr_array_unref (changes);
+
+	log_monitor_stats (db);
+	monitor_location_unref (loc);
+}
+
 static gboolean
-monitor_subdirectory (GFile *file, GFileInfo *info, RhythmDB *db)
+scan_location (RhythmDBMonitorLocation *loc)
+{
+	GTask *task;
+
+	if (loc->scanning)
+		return TRUE;
+
+	loc->scanning = TRUE;
+	loc->scan_start = g_get_monotonic_time ();
+	task = g_task_new (NULL, loc->cancel, (GAsyncReadyCallback) scan_location_done, monitor_location_ref (loc));
+	g_task_set_task_data (task, loc, NULL);
+	g_task_run_in_thread (task, (GTaskThreadFunc) scan_location_thread);
+	g_object_unref (task);
+	return TRUE;
+}
+
+static void
+start_scanning (RhythmDBMonitorLocation *loc)
 {
+	rb_debug ("scanning library location %s every %d seconds", loc->uri, RHYTHMDB_MONITOR_SCAN_INTERVAL);
+	loc->engine = MONITOR_ENGINE_SCAN;
+	loc->dirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) free_scan_dir);
+
+	scan_location (loc);
+	loc->scan_id = g_timeout_add_seconds (RHYTHMDB_MONITOR_SCAN_INTERVAL, (GSourceFunc) scan_location, loc);
+}
+
+static gboolean
+remove_covered_monitor (GFile *directory, GFileMonitor *monitor, GFile *root)
+{
+	return g_file_equal (directory, root) || g_file_has_prefix (directory, root);
+}
+
+static gboolean
+monitor_subdirectory (GFile *file, GFileInfo *info, RhythmDBMonitorLocation *loc)
+{
+	RhythmDB *db = loc->db;
 	char *uri;
 
+	if (loc->stopped)
+		return FALSE;
+
 	uri = g_file_get_uri (file);
 	if (g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_STANDARD_TYPE) == G_FILE_TYPE_DIRECTORY) {
+		if (loc->engine == MONITOR_ENGINE_AUTO && watch_budget_used (db)) {
+			rb_debug ("too many directories to monitor; switching %s to scanning", loc->uri);
+			g_mutex_lock (&db->priv->monitor_mutex);
+			g_hash_table_foreach_remove (db->priv->monitored_directories,
+						     (GHRFunc) remove_covered_monitor,
+						     loc->root);
+			g_mutex_unlock (&db->priv->monitor_mutex);
+
+			/* the initial scan adds anything the directory walk hasn't reached yet */
+			start_scanning (loc);
+			g_free (uri);
+			return FALSE;
+		}
 		actually_add_monitor (db, file, NULL);
 	} else {
 		/* add the file to the database if it's not already there */
@@ -165,22 +712,291 @@ monitor_subdirectory (GFile *file, GFileInfo *info, RhythmDB *db)
 	return TRUE;	
 }
 
+static void
+monitor_walk_done (RhythmDBMonitorLocation *loc)
+{
+	if (loc->stopped == FALSE) {
+		if (loc->engine == MONITOR_ENGINE_AUTO)
+			loc->engine = MONITOR_ENGINE_GIO;
+		log_monitor_stats (loc->db);
+	}
+	monitor_location_unref (loc);
+}
+
+#ifdef HAVE_FANOTIFY
+
+#define RHYTHMDB_FANOTIFY_EVENTS	(FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_CLOSE_WRITE | FAN_ONDIR)
+
+static char *
+fanotify_event_uri (RhythmDB *db, struct fanotify_event_metadata *event)
+{
+	struct fanotify_event_info_fid *fid;
+	struct file_handle *handle;
+	const char *name;
+	char proc_path[64];
+	char dir_path[PATH_MAX];
+	char *path;
+	char *uri;
+	ssize_t len;
+	int fd = -1;
+	GList *l;
+
+	fid = (struct fanotify_event_info_fid *) (event + 1);
+	if ((char *) fid + sizeof (*fid) > (char *) event + event->event_len ||
+	    fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME)
+		return NULL;
+
+	handle = (struct file_handle *) fid->handle;
+	name = (const char *) handle->f_handle + handle->handle_bytes;
+
+	/* the handle identifies the directory; any descriptor on the same file system can open it */
+	for (l = db->priv->monitor_locations; l != NULL && fd == -1; l = l->next) {
+		RhythmDBMonitorLocation *loc = l->data;
+
+		if (loc->engine == MONITOR_ENGINE_FANOTIFY)
+			fd = open_by_handle_at (loc->mount_fd, handle, O_PATH | O_CLOEXEC);
+	}
+	if (fd == -1)
+		return NULL;
+
+	g_snprintf (proc_path, sizeof (proc_path), "/proc/self/fd/%d", fd);
+	len = readlink (proc_path, dir_path, sizeof (dir_path) - 1);
+	close (fd);
+	if (len < 0)
+		return NULL;
+	dir_path[len] = '\0';
+
+	path = g_build_filename (dir_path, name, NULL);
+	uri = g_filename_to_uri (path, NULL, NULL);
+	g_free (path);
+	return uri;
+}
+
+static gboolean
+fanotify_uri_in_library (RhythmDB *db, const char *uri)
+{
+	GList *l;
+
+	for (l = db->priv->monitor_locations; l != NULL; l = l->next) {
+		RhythmDBMonitorLocation *loc = l->data;
+
+		if (loc->engine == MONITOR_ENGINE_FANOTIFY && rb_uri_is_descendant (uri, loc->uri))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static gboolean
+fanotify_events_cb (int fd, GIOCondition condition, RhythmDB *db)
+{
+	guint64 buf[1024];
+	char *moved_from = NULL;
+	ssize_t len;
+
+	while ((len = read (fd, buf, sizeof (buf))) > 0) {
+		struct fanotify_event_metadata *event;
+
+		for (event = (struct fanotify_event_metadata *) buf;
+		     FAN_EVENT_OK (event, len);
+		     event = FAN_EVENT_NEXT (event, len)) {
+			char *uri;
+
+			if (event->vers != FANOTIFY_METADATA_VERSION) {
+				rb_debug ("unexpected fanotify event version %d", event->vers);
+				continue;
+			}
+
+			if (event->mask & FAN_Q_OVERFLOW) {
+				rb_debug ("fanotify event queue overflowed; some changes will be missed");
+				continue;
+			}
+
+			uri = fanotify_event_uri (db, event);
+			if (uri == NULL || fanotify_uri_in_library (db, uri) == FALSE) {
+				g_free (uri);
+				continue;
+			}
+
+			/* a move within the file system is reported as a pair of events */
+			if (moved_from != NULL && (event->mask & FAN_MOVED_TO) == 0) {
+				process_file_event (db, G_FILE_MONITOR_EVENT_DELETED, moved_from, NULL);
+				g_clear_pointer (&moved_from, g_free);
+			}
+
+			if (event->mask & FAN_MOVED_FROM) {
+				moved_from = uri;
+				continue;
+			} else if (event->mask & FAN_MOVED_TO) {
+				if (moved_from != NULL) {
+					process_file_event (db, G_FILE_MONITOR_EVENT_MOVED, moved_from, uri);
+					g_clear_pointer (&moved_from, g_free);
+				} else {
+					process_file_event (db, G_FILE_MONITOR_EVENT_CREATED, uri, NULL);
+				}
+			} else if (event->mask & FAN_CREATE) {
+				process_file_event (db, G_FILE_MONITOR_EVENT_CREATED, uri, NULL);
+			} else if (event->mask & FAN_DELETE) {
+				process_file_event (db, G_FILE_MONITOR_EVENT_DELETED, uri, NULL);
+			} else if (event->mask & FAN_CLOSE_WRITE) {
+				process_file_event (db, G_FILE_MONITOR_EVENT_CHANGED, uri, NULL);
+			}
+			g_free (uri);
+		}
+	}
+
+	if (moved_from != NULL) {
+		process_file_event (db, G_FILE_MONITOR_EVENT_DELETED, moved_from, NULL);
+		g_free (moved_from);
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+start_fanotify (RhythmDBMonitorLocation *loc)
+{
+	RhythmDB *db = loc->db;
+	char *path;
+
+	path = g_file_get_path (loc->root);
+	if (path == NULL)
+		return FALSE;
+
+	if (db->priv->fanotify_fd == -1) {
+		int fd;
+
+		fd = fanotify_init (FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK | FAN_REPORT_DFID_NAME,
+				    O_RDONLY | O_CLOEXEC | O_LARGEFILE);
+		if (fd == -1) {
+			rb_debug ("fanotify not available: %s", g_strerror (errno));
+			g_free (path);
+			return FALSE;
+		}
+
+		db->priv->fanotify_fd = fd;
+		db->priv->fanotify_watch_id = g_unix_fd_add (fd, G_IO_IN, (GUnixFDSourceFunc) fanotify_events_cb, db);
+	}
+
+	loc->mount_fd = open (path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (loc->mount_fd == -1) {
+		rb_debug ("unable to open %s: %s", path, g_strerror (errno));
+		g_free (path);
+		return FALSE;
+	}
+
+	if (fanotify_mark (db->priv->fanotify_fd,
+			   FAN_MARK_ADD | FAN_MARK_FILESYSTEM,
+			   RHYTHMDB_FANOTIFY_EVENTS,
+			   AT_FDCWD,
+			   path) == -1) {
+		rb_debug ("unable to watch file system containing %s: %s", path, g_strerror (errno));
+		close (loc->mount_fd);
+		loc->mount_fd = -1;
+		g_free (path);
+		return FALSE;
+	}
+
+	rb_debug ("watching file system containing %s", path);
+	loc->engine = MONITOR_ENGINE_FANOTIFY;
+	g_free (path);
+	return TRUE;
+}
+
+#else
+
+static gboolean
+start_fanotify (RhythmDBMonitorLocation *loc)
+{
+	return FALSE;
+}
+
+#endif
+
+static RhythmDBMonitorEngine
+get_requested_engine (void)
+{
+	const char *engine;
+
+	engine = g_getenv ("RB_MONITOR_ENGINE");
+	if (engine == NULL)
+		return MONITOR_ENGINE_AUTO;
+	else if (strcmp (engine, "gio") == 0)
+		return MONITOR_ENGINE_GIO;
+	else if (strcmp (engine, "fanotify") == 0)
+		return MONITOR_ENGINE_FANOTIFY;
+	else if (strcmp (engine, "scan") == 0)
+		return MONITOR_ENGINE_SCAN;
+
+	g_warning ("unknown monitor engine %s", engine);
+	return MONITOR_ENGINE_AUTO;
+}
+
+static guint
+get_watch_budget (void)
+{
+	char *contents;
+	guint64 max_watches;
+
+	if (g_file_get_contents ("/proc/sys/fs/inotify/max_user_watches", &contents, NULL, NULL) == FALSE)
+		return RHYTHMDB_MONITOR_DEFAULT_WATCH_BUDGET;
+
+	/* leave plenty for other applications */
+	max_watches = g_ascii_strtoull (contents, NULL, 10);
+	g_free (contents);
+	if (max_watches == 0)
+		return RHYTHMDB_MONITOR_DEFAULT_WATCH_BUDGET;
+
+	return MIN (max_watches / 2, G_MAXUINT);
+}
+
 static void
 monitor_library_directory (const char *uri, RhythmDB *db)
 {
+	RhythmDBMonitorLocation *loc;
+	RhythmDBMonitorEngine engine;
+
 	if ((strcmp (uri, "file:///") == 0) ||
 	    (strcmp (uri, "file://") == 0)) {
 		/* display an error to the user? */
 		return;
 	}
 
-	rb_debug ("beginning monitor of the library directory %s", uri);
-	rhythmdb_monitor_uri_path (db, uri, NULL);
+	loc = g_new0 (RhythmDBMonitorLocation, 1);
+	loc->refcount = 1;
+	loc->db = g_object_ref (db);
+	loc->uri = g_strdup (uri);
+	loc->root = g_file_new_for_uri (uri);
+	loc->cancel = g_cancellable_new ();
+	loc->mount_fd = -1;
+	db->priv->monitor_locations = g_list_append (db->priv->monitor_locations, loc);
+
+	engine = get_requested_engine ();
+	if (engine == MONITOR_ENGINE_SCAN) {
+		start_scanning (loc);
+		return;
+	}
+
+	if ((engine == MONITOR_ENGINE_AUTO || engine == MONITOR_ENGINE_FANOTIFY) && start_fanotify (loc)) {
+		/* still need to find files added while we weren't running */
+		rb_debug ("beginning walk of the library directory %s", uri);
+	} else {
+		loc->engine = engine == MONITOR_ENGINE_GIO ? MONITOR_ENGINE_GIO : MONITOR_ENGINE_AUTO;
+		if (loc->engine == MONITOR_ENGINE_AUTO && watch_budget_used (db)) {
+			rb_debug ("no directory monitors left for %s", uri);
+			start_scanning (loc);
+			return;
+		}
+
+		rb_debug ("beginning monitor of the library directory %s", uri);
+		add_uri_monitor (db, uri, NULL);
+	}
+
+	/* the walk stops itself when monitor_subdirectory returns FALSE */
 	rb_uri_handle_recursively_async (uri,
 					 NULL,
 					 (RBUriRecurseFunc) monitor_subdirectory,
-					 g_object_ref (db),
-					 (GDestroyNotify)g_object_unref);
+					 monitor_location_ref (loc),
+					 (GDestroyNotify) monitor_walk_done);
 }
 
 static gboolean
@@ -222,6 +1038,10 @@ rhythmdb_process_changed_files (RhythmDB *db)
 void
 rhythmdb_start_monitoring (RhythmDB *db)
 {
+	db->priv->monitor_watch_budget = get_watch_budget ();
+	db->priv->monitor_events = 0;
+	db->priv->monitor_start_time = g_get_monotonic_time ();
+
 	/* monitor all library locations */
 	if (db->priv->library_locations) {
 		int i;
@@ -249,22 +1069,15 @@ add_changed_file (RhythmDB *db, const char *uri)
 }
 
 static void
-rhythmdb_directory_change_cb (GFileMonitor *monitor,
-			      GFile *file,
-			      GFile *other_file,
-			      GFileMonitorEvent event_type,
-			      RhythmDB *db)
+process_file_event (RhythmDB *db,
+		    GFileMonitorEvent event_type,
+		    const char *canon_uri,
+		    const char *other_canon_uri)
 {
-	char *canon_uri;
-	char *other_canon_uri = NULL;
 	RhythmDBEntry *entry;
 
-	canon_uri = g_file_get_uri (file);
-	if (other_file != NULL) {
-		other_canon_uri = g_file_get_uri (other_file);
-	}
-
 	rb_debug ("directory event %d for %s", event_type, canon_uri);
+	db->priv->monitor_events++;
 
 	switch (event_type) {
         case G_FILE_MONITOR_EVENT_CREATED:
@@ -292,7 +1105,11 @@ rhythmdb_directory_change_cb (GFileMonitor *monitor,
 
 		/* process directories immediately */
 		if (rb_uri_is_directory (canon_uri)) {
+			GFile *file;
+
+			file = g_file_new_for_uri (canon_uri);
 			actually_add_monitor (db, file, NULL);
+			g_object_unref (file);
 			rhythmdb_add_uri (db, canon_uri);
 		} else {
 			add_changed_file (db, canon_uri);
@@ -345,13 +1162,31 @@ rhythmdb_directory_change_cb (GFileMonitor *monitor,
 	default:
 		break;
 	}
+}
+
+static void
+rhythmdb_directory_change_cb (GFileMonitor *monitor,
+			      GFile *file,
+			      GFile *other_file,
+			      GFileMonitorEvent event_type,
+			      RhythmDB *db)
+{
+	char *canon_uri;
+	char *other_canon_uri = NULL;
+
+	canon_uri = g_file_get_uri (file);
+	if (other_file != NULL) {
+		other_canon_uri = g_file_get_uri (other_file);
+	}
+
+	process_file_event (db, event_type, canon_uri, other_canon_uri);
 
 	g_free (canon_uri);
 	g_free (other_canon_uri);
 }
 
-void
-rhythmdb_monitor_uri_path (RhythmDB *db, const char *uri, GError **error)
+static void
+add_uri_monitor (RhythmDB *db, const char *uri, GError **error)
 {
 	GFile *directory;
 
@@ -377,6 +1212,20 @@ rhythmdb_monitor_uri_path (RhythmDB *db, const char *uri, GError **error)
 	g_object_unref (directory);
 }
 
+void
+rhythmdb_monitor_uri_path (RhythmDB *db, const char *uri, GError **error)
+{
+	/* library locations fall back to scanning when the budget runs out;
+	 * other files just go unmonitored.
+	 */
+	if (watch_budget_used (db)) {
+		rb_debug ("not monitoring %s: directory monitor budget used up", uri);
+		return;
+	}
+
+	add_uri_monitor (db, uri, error);
+}
+
 static void
 rhythmdb_mount_added_cb (GVolumeMonitor *monitor,
 			 GMount *mount,
@@ -488,3 +1337,45 @@ rhythmdb_get_active_mounts (RhythmDB *db)
 	rb_list_destroy_free (mounts, (GDestroyNotify) g_object_unref);
 	return mountpoints;
 }
+
+/**
+ * rhythmdb_get_monitor_stats:
+ * @db: the #RhythmDB
+ * @stats: returns monitoring statistics
+ *
+ * Returns the number of watches used to monitor the library locations,
+ * and the rate at which changes are being reported.  For debugging.
+ */
+void
+rhythmdb_get_monitor_stats (RhythmDB *db, RhythmDBMonitorStats *stats)
+{
+	gint64 elapsed;
+	GList *l;
+
+	memset (stats, 0, sizeof (*stats));
+
+	g_mutex_lock (&db->priv->monitor_mutex);
+	stats->directory_monitors = g_hash_table_size (db->priv->monitored_directories);
+	g_mutex_unlock (&db->priv->monitor_mutex);
+
+	for (l = db->priv->monitor_locations; l != NULL; l = l->next) {
+		RhythmDBMonitorLocation *loc = l->data;
+
+		switch (loc->engine) {
+		case MONITOR_ENGINE_FANOTIFY:
+			stats->filesystem_locations++;
+			break;
+		case MONITOR_ENGINE_SCAN:
+			stats->scanned_locations++;
+			stats->scanned_directories += loc->scanned_dirs;
+			break;
+		default:
+			break;
+		}
+	}
+
+	stats->events = db->priv->monitor_events;
+	elapsed = g_get_monotonic_time () - db->priv->monitor_start_time;
+	if (elapsed > 0)
+		stats->events_per_minute = (stats->events * 60.0 * G_USEC_PER_SEC) / elapsed;
+}
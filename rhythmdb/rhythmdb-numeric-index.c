@@ -0,0 +1,498 @@
+/*
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+/*
+ * The numeric index keeps, for each of a few numeric properties commonly used
+ * in range criteria (ratings, play counts, and times), an array of
+ * (value, entry) pairs sorted by value, so the entries matching a range can
+ * be found with a binary search instead of checking every entry.
+ *
+ * Values are stored as doubles.  All of the indexed integer properties are
+ * times, counts or durations, well within the range doubles represent exactly.
+ *
+ * Changes are not made to the sorted array directly, as each insertion or
+ * removal would move half of it on average.  New values are appended after
+ * the sorted items, and removed values are either taken out of the unsorted
+ * items or remembered until the sorted items are next compacted.  The next
+ * range query drops the removed items, sorts the new ones and merges them in.
+ *
+ * The index does no locking of its own.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "rhythmdb-numeric-index.h"
+#include "rhythmdb-private.h"
+
+typedef struct {
+	double value;
+	RhythmDBEntry *entry;
+} RhythmDBNumericIndexItem;
+
+typedef struct {
+	GArray *items;
+	guint n_sorted;		/* number of items at the start of the array that are sorted */
+	GHashTable *unsorted;	/* entry -> position of each unsorted item, created when needed */
+	GHashTable *removed;	/* entries removed from the sorted items */
+} RhythmDBNumericIndexColumn;
+
+static const RhythmDBPropType indexed_properties[] = {
+	RHYTHMDB_PROP_RATING,
+	RHYTHMDB_PROP_PLAY_COUNT,
+	RHYTHMDB_PROP_LAST_PLAYED,
+	RHYTHMDB_PROP_FIRST_SEEN,
+	RHYTHMDB_PROP_DURATION
+};
+
+struct _RhythmDBNumericIndex
+{
+	RhythmDBNumericIndexColumn columns[G_N_ELEMENTS (indexed_properties)];
+	guint size;
+};
+
+static int
+get_column_index (RhythmDBPropType propid)
+{
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS (indexed_properties); i++) {
+		if (indexed_properties[i] == propid)
+			return i;
+	}
+	return -1;
+}
+
+static double
+get_entry_value (RhythmDBEntry *entry, RhythmDBPropType propid)
+{
+	switch (propid) {
+	case RHYTHMDB_PROP_RATING:
+		return entry->rating;
+	case RHYTHMDB_PROP_PLAY_COUNT:
+		return (gulong) entry->play_count;
+	case RHYTHMDB_PROP_LAST_PLAYED:
+		return entry->last_played;
+	case RHYTHMDB_PROP_FIRST_SEEN:
+		return entry->first_seen;
+	case RHYTHMDB_PROP_DURATION:
+		return entry->duration;
+	default:
+		g_assert_not_reached ();
+		return 0.0;
+	}
+}
+
+static int
+compare_items (gconstpointer a, gconstpointer b)
+{
+	const RhythmDBNumericIndexItem *ia = a;
+	const RhythmDBNumericIndexItem *ib = b;
+
+	if (ia->value != ib->value)
+		return (ia->value < ib->value) ? -1 : 1;
+
+	/* order entries with the same value by address, so each item has a unique position */
+	if (ia->entry != ib->entry)
+		return (ia->entry < ib->entry) ? -1 : 1;
+	return 0;
+}
+
+/* applies pending changes, so the whole array is sorted */
+static void
+sort_column (RhythmDBNumericIndexColumn *column)
+{
+	RhythmDBNumericIndexItem *items;
+	GArray *merged;
+	guint n_unsorted;
+	guint i, j, k;
+
+	if (column->removed != NULL) {
+		items = (RhythmDBNumericIndexItem *) column->items->data;
+		for (i = 0, j = 0; i < column->n_sorted; i++) {
+			if (g_hash_table_contains (column->removed, items[i].entry))
+				continue;
+			items[j++] = items[i];
+		}
+		g_array_remove_range (column->items, j, column->n_sorted - j);
+		column->n_sorted = j;
+
+		g_hash_table_destroy (column->removed);
+		column->removed = NULL;
+	}
+
+	g_clear_pointer (&column->unsorted, g_hash_table_destroy);
+	n_unsorted = column->items->len - column->n_sorted;
+	if (n_unsorted == 0)
+		return;
+
+	items = (RhythmDBNumericIndexItem *) column->items->data;
+	qsort (items + column->n_sorted, n_unsorted, sizeof (RhythmDBNumericIndexItem), compare_items);
+
+	if (column->n_sorted > 0) {
+		merged = g_array_sized_new (FALSE, FALSE, sizeof (RhythmDBNumericIndexItem), column->items->len);
+		g_array_set_size (merged, column->items->len);
+
+		i = 0;
+		j = column->n_sorted;
+		for (k = 0; k < merged->len; k++) {
+			if (j == column->items->len ||
+			    (i < column->n_sorted && compare_items (&items[i], &items[j]) < 0)) {
+				g_array_index (merged, RhythmDBNumericIndexItem, k) = items[i++];
+			} else {
+				g_array_index (merged, RhythmDBNumericIndexItem, k) = items[j++];
+			}
+		}
+
+		g_array_unref (column->items);
+		column->items = merged;
+	}
+	column->n_sorted = column->items->len;
+}
+
+/* returns the position of the first sorted item not less than @item */
+static guint
+find_item (RhythmDBNumericIndexColumn *column, const RhythmDBNumericIndexItem *item)
+{
+	guint lo = 0;
+	guint hi = column->n_sorted;
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+
+		if (compare_items (&g_array_index (column->items, RhythmDBNumericIndexItem, mid), item) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* returns the position of the first item with a value greater than (or, if
+ * @inclusive, not less than) @value */
+static guint
+find_value (RhythmDBNumericIndexColumn *column, double value, gboolean inclusive)
+{
+	guint lo = 0;
+	guint hi = column->items->len;
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		double v = g_array_index (column->items, RhythmDBNumericIndexItem, mid).value;
+
+		if (inclusive ? (v < value) : (v <= value))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static void
+column_insert (RhythmDBNumericIndexColumn *column, RhythmDBEntry *entry, double value)
+{
+	RhythmDBNumericIndexItem item;
+
+	item.value = value;
+	item.entry = entry;
+	g_array_append_val (column->items, item);
+	if (column->unsorted != NULL)
+		g_hash_table_insert (column->unsorted, entry, GUINT_TO_POINTER (column->items->len - 1));
+}
+
+static gboolean
+remove_unsorted (RhythmDBNumericIndexColumn *column, RhythmDBEntry *entry)
+{
+	RhythmDBNumericIndexItem *items;
+	gpointer p;
+	guint pos;
+	guint last;
+
+	if (column->items->len == column->n_sorted)
+		return FALSE;
+
+	if (column->unsorted == NULL) {
+		column->unsorted = g_hash_table_new (g_direct_hash, g_direct_equal);
+		for (pos = column->n_sorted; pos < column->items->len; pos++) {
+			g_hash_table_insert (column->unsorted,
+					     g_array_index (column->items, RhythmDBNumericIndexItem, pos).entry,
+					     GUINT_TO_POINTER (pos));
+		}
+	}
+
+	if (g_hash_table_lookup_extended (column->unsorted, entry, NULL, &p) == FALSE)
+		return FALSE;
+
+	/* order doesn't matter here, so move the last item into the gap */
+	items = (RhythmDBNumericIndexItem *) column->items->data;
+	pos = GPOINTER_TO_UINT (p);
+	last = column->items->len - 1;
+	if (pos != last) {
+		items[pos] = items[last];
+		g_hash_table_insert (column->unsorted, items[pos].entry, GUINT_TO_POINTER (pos));
+	}
+	g_array_set_size (column->items, last);
+	g_hash_table_remove (column->unsorted, entry);
+	return TRUE;
+}
+
+static void
+column_remove (RhythmDBNumericIndexColumn *column, RhythmDBEntry *entry, double value)
+{
+	RhythmDBNumericIndexItem item;
+	guint pos;
+
+	if (remove_unsorted (column, entry))
+		return;
+
+	item.value = value;
+	item.entry = entry;
+	pos = find_item (column, &item);
+	if (pos < column->n_sorted &&
+	    g_array_index (column->items, RhythmDBNumericIndexItem, pos).entry == entry &&
+	    (column->removed == NULL || g_hash_table_contains (column->removed, entry) == FALSE)) {
+		if (column->removed == NULL)
+			column->removed = g_hash_table_new (g_direct_hash, g_direct_equal);
+		g_hash_table_add (column->removed, entry);
+	} else {
+		g_warning ("entry %p not found in numeric index", entry);
+	}
+}
+
+/**
+ * rhythmdb_numeric_index_new:
+ *
+ * Creates a new, empty numeric index.
+ *
+ * Return value: the numeric index, free with rhythmdb_numeric_index_free
+ */
+RhythmDBNumericIndex *
+rhythmdb_numeric_index_new (void)
+{
+	RhythmDBNumericIndex *index;
+	int i;
+
+	index = g_new0 (RhythmDBNumericIndex, 1);
+	for (i = 0; i < G_N_ELEMENTS (indexed_properties); i++) {
+		index->columns[i].items = g_array_new (FALSE, FALSE, sizeof (RhythmDBNumericIndexItem));
+	}
+	return index;
+}
+
+/**
+ * rhythmdb_numeric_index_free:
+ * @index: the #RhythmDBNumericIndex
+ *
+ * Frees the numeric index.
+ */
+void
+rhythmdb_numeric_index_free (RhythmDBNumericIndex *index)
+{
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS (indexed_properties); i++) {
+		g_array_unref (index->columns[i].items);
+		if (index->columns[i].unsorted != NULL)
+			g_hash_table_destroy (index->columns[i].unsorted);
+		if (index->columns[i].removed != NULL)
+			g_hash_table_destroy (index->columns[i].removed);
+	}
+	g_free (index);
+}
+
+/**
+ * rhythmdb_numeric_index_has_property:
+ * @propid: a #RhythmDBPropType
+ *
+ * Return value: %TRUE if the numeric index covers the property
+ */
+gboolean
+rhythmdb_numeric_index_has_property (RhythmDBPropType propid)
+{
+	return (get_column_index (propid) != -1);
+}
+
+/**
+ * rhythmdb_numeric_index_add:
+ * @index: the #RhythmDBNumericIndex
+ * @entry: the #RhythmDBEntry to add
+ *
+ * Adds an entry to the index, using its current property values.
+ */
+void
+rhythmdb_numeric_index_add (RhythmDBNumericIndex *index, RhythmDBEntry *entry)
+{
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS (indexed_properties); i++) {
+		column_insert (&index->columns[i], entry, get_entry_value (entry, indexed_properties[i]));
+	}
+	index->size++;
+}
+
+/**
+ * rhythmdb_numeric_index_remove:
+ * @index: the #RhythmDBNumericIndex
+ * @entry: the #RhythmDBEntry to remove
+ *
+ * Removes an entry from the index.  The entry's property values must not
+ * have changed since it was added or last updated.
+ */
+void
+rhythmdb_numeric_index_remove (RhythmDBNumericIndex *index, RhythmDBEntry *entry)
+{
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS (indexed_properties); i++) {
+		column_remove (&index->columns[i], entry, get_entry_value (entry, indexed_properties[i]));
+	}
+	index->size--;
+}
+
+/**
+ * rhythmdb_numeric_index_update:
+ * @index: the #RhythmDBNumericIndex
+ * @entry: the #RhythmDBEntry being changed
+ * @propid: the property being changed
+ * @value: the new value of the property
+ *
+ * Updates the index for a change to an entry, before the new value is
+ * stored in the entry.  Does nothing if the property isn't indexed.
+ */
+void
+rhythmdb_numeric_index_update (RhythmDBNumericIndex *index,
+			       RhythmDBEntry *entry,
+			       RhythmDBPropType propid,
+			       const GValue *value)
+{
+	RhythmDBNumericIndexColumn *column;
+	double new_value;
+	int i;
+
+	i = get_column_index (propid);
+	if (i == -1)
+		return;
+
+	if (G_VALUE_HOLDS_DOUBLE (value))
+		new_value = g_value_get_double (value);
+	else
+		new_value = g_value_get_ulong (value);
+
+	column = &index->columns[i];
+	column_remove (column, entry, get_entry_value (entry, propid));
+	column_insert (column, entry, new_value);
+}
+
+/**
+ * rhythmdb_numeric_index_get_size:
+ * @index: the #RhythmDBNumericIndex
+ *
+ * Return value: the number of entries in the index
+ */
+guint
+rhythmdb_numeric_index_get_size (RhythmDBNumericIndex *index)
+{
+	return index->size;
+}
+
+/**
+ * rhythmdb_numeric_index_get_range:
+ * @index: the #RhythmDBNumericIndex
+ * @propid: the property
+ * @type: the type of criterion: %RHYTHMDB_QUERY_PROP_EQUALS,
+ *   %RHYTHMDB_QUERY_PROP_GREATER (greater than or equal) or
+ *   %RHYTHMDB_QUERY_PROP_LESS (less than or equal), or
+ *   %RHYTHMDB_QUERY_PROP_CURRENT_TIME_NOT_WITHIN for strictly less than
+ * @value: the value to compare against
+ * @start: (out): returns the position of the first matching entry
+ * @end: (out): returns the position after the last matching entry
+ *
+ * Finds the positions in the index of the entries matching a criterion.
+ * The matching entries can then be retrieved using
+ * rhythmdb_numeric_index_get_entry.
+ *
+ * Return value: %FALSE if the property or criterion isn't supported
+ */
+gboolean
+rhythmdb_numeric_index_get_range (RhythmDBNumericIndex *index,
+				  RhythmDBPropType propid,
+				  RhythmDBQueryType type,
+				  double value,
+				  guint *start,
+				  guint *end)
+{
+	RhythmDBNumericIndexColumn *column;
+	int i;
+
+	i = get_column_index (propid);
+	if (i == -1)
+		return FALSE;
+
+	column = &index->columns[i];
+	sort_column (column);
+
+	switch (type) {
+	case RHYTHMDB_QUERY_PROP_EQUALS:
+		*start = find_value (column, value, TRUE);
+		*end = find_value (column, value, FALSE);
+		return TRUE;
+	case RHYTHMDB_QUERY_PROP_GREATER:
+		*start = find_value (column, value, TRUE);
+		*end = column->items->len;
+		return TRUE;
+	case RHYTHMDB_QUERY_PROP_LESS:
+		*start = 0;
+		*end = find_value (column, value, FALSE);
+		return TRUE;
+	case RHYTHMDB_QUERY_PROP_CURRENT_TIME_NOT_WITHIN:
+		*start = 0;
+		*end = find_value (column, value, TRUE);
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/**
+ * rhythmdb_numeric_index_get_entry:
+ * @index: the #RhythmDBNumericIndex
+ * @propid: the property
+ * @position: position in the index for the property
+ *
+ * Return value: the entry at the given position in the index
+ */
+RhythmDBEntry *
+rhythmdb_numeric_index_get_entry (RhythmDBNumericIndex *index,
+				  RhythmDBPropType propid,
+				  guint position)
+{
+	RhythmDBNumericIndexColumn *column = &index->columns[get_column_index (propid)];
+
+	return g_array_index (column->items, RhythmDBNumericIndexItem, position).entry;
+}
@@ -0,0 +1,66 @@
+/*
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+#ifndef RHYTHMDB_NUMERIC_INDEX_H
+#define RHYTHMDB_NUMERIC_INDEX_H
+
+#include <glib.h>
+
+#include <rhythmdb/rhythmdb.h>
+
+G_BEGIN_DECLS
+
+typedef struct _RhythmDBNumericIndex RhythmDBNumericIndex;
+
+RhythmDBNumericIndex *rhythmdb_numeric_index_new		(void);
+void		rhythmdb_numeric_index_free		(RhythmDBNumericIndex *index);
+
+gboolean	rhythmdb_numeric_index_has_property	(RhythmDBPropType propid);
+
+void		rhythmdb_numeric_index_add		(RhythmDBNumericIndex *index,
+							 RhythmDBEntry *entry);
+void		rhythmdb_numeric_index_remove		(RhythmDBNumericIndex *index,
+							 RhythmDBEntry *entry);
+void		rhythmdb_numeric_index_update		(RhythmDBNumericIndex *index,
+							 RhythmDBEntry *entry,
+							 RhythmDBPropType propid,
+							 const GValue *value);
+
+guint		rhythmdb_numeric_index_get_size		(RhythmDBNumericIndex *index);
+gboolean	rhythmdb_numeric_index_get_range	(RhythmDBNumericIndex *index,
+							 RhythmDBPropType propid,
+							 RhythmDBQueryType type,
+							 double value,
+							 guint *start,
+							 guint *end);
+RhythmDBEntry *	rhythmdb_numeric_index_get_entry	(RhythmDBNumericIndex *index,
+							 RhythmDBPropType propid,
+							 guint position);
+
+G_END_DECLS
+
+#endif /* RHYTHMDB_NUMERIC_INDEX_H */
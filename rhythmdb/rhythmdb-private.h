@@ -30,6 +30,7 @@
 
 #include <rhythmdb/rhythmdb.h>
 #include <rhythmdb/rb-refstring.h>
+#include <rhythmdb/rhythmdb-journal.h>
 #include <metadata/rb-metadata.h>
 
 G_BEGIN_DECLS
@@ -60,21 +61,11 @@ enum {
 	RHYTHMDB_ENTRY_PRIVATE_FLAG_BASE = 65536,
 };
 
-struct _RhythmDBEntry {
-	/* internal bits */
-	guint flags;
-	volatile gint refcount;
-	void *data;
-	RhythmDBEntryType *type;
-	guint id;
-
-	/* metadata */
-	RBRefString *title;
-	RBRefString *artist;
+/* fields that are empty for most entries.  entries share a single
+ * default instance until one of these is set.
+ */
+typedef struct {
 	RBRefString *composer;
-	RBRefString *album;
-	RBRefString *album_artist;
-	RBRefString *genre;
 	RBRefString *comment;
 	RBRefString *musicbrainz_trackid;
 	RBRefString *musicbrainz_artistid;
@@ -85,20 +76,56 @@ struct _RhythmDBEntry {
 	RBRefString *album_sortname;
 	RBRefString *title_sortname;
 	RBRefString *album_artist_sortname;
-	gulong tracknum;
-	gulong tracktotal;
-	gulong discnum;
-	gulong disctotal;
-	gulong duration;
-	gulong bitrate;
 	double bpm;
+
+	/* replaygain values; a peak of 0 means not known */
+	double track_gain;
+	double track_peak;
+	double album_gain;
+	double album_peak;
+
+	/* playback error string */
+	RBRefString *playback_error;
+
+	/* TRUE for the default instance */
+	gboolean shared;
+} RhythmDBEntryExtra;
+
+/* formatted date strings, allocated the first time one is requested */
+typedef struct {
+	gpointer last_played_str;
+	gpointer first_seen_str;
+	gpointer last_seen_str;
+} RhythmDBEntryTimeStrings;
+
+struct _RhythmDBEntry {
+	/* internal bits */
+	guint flags;
+	volatile gint refcount;
+	void *data;
+	RhythmDBEntryType *type;
+	guint id;
+
+	/* metadata; track and disc numbers are clamped to G_MAXUINT16 */
+	guint16 tracknum;
+	guint16 tracktotal;
+	guint16 discnum;
+	guint16 disctotal;
+	guint32 duration;
+	guint32 bitrate;
 	GDate date;
+	RBRefString *title;
+	RBRefString *artist;
+	RBRefString *album;
+	RBRefString *album_artist;
+	RBRefString *genre;
+	RhythmDBEntryExtra *extra;
 
 	/* filesystem */
 	RBRefString *location;
 	RBRefString *mountpoint;
-	guint64 file_size;
 	RBRefString *media_type;
+	guint64 file_size;
 	gulong mtime;
 	gulong first_seen;
 	gulong last_seen;
@@ -109,14 +136,12 @@ struct _RhythmDBEntry {
 	gulong last_played;
 
 	/* cached data */
-	gpointer last_played_str;
-	gpointer first_seen_str;
-	gpointer last_seen_str;
-
-	/* playback error string */
-	RBRefString *playback_error;
+	RhythmDBEntryTimeStrings *time_strings;
 };
 
+RhythmDBEntryExtra *rhythmdb_entry_get_writable_extra	(RhythmDBEntry *entry);
+gsize		rhythmdb_entry_get_memory_size	(RhythmDBEntry *entry);
+
 struct _RhythmDBPrivate
 {
 	char *name;
@@ -127,6 +152,7 @@ struct _RhythmDBPrivate
 
 	RBRefString *empty_string;
 	RBRefString *octet_stream_str;
+	RhythmDBEntryExtra *default_extra;
 
 	gboolean action_thread_running;
 	gint outstanding_threads;
@@ -137,6 +163,13 @@ struct _RhythmDBPrivate
 	GThreadPool *query_thread_pool;
 	GThread *load_thread;
 
+	guint metadata_workers;
+	GMutex metadata_order_mutex;
+	GCond metadata_order_cond;
+	guint metadata_next_seq;
+	guint metadata_deliver_seq;
+	GHashTable *metadata_completed;
+
 	GList *stat_list;
 	GList *outstanding_stats;
 	GList *active_mounts;
@@ -152,10 +185,22 @@ struct _RhythmDBPrivate
 	guint changed_files_id;
 	char **library_locations;
 	GMutex monitor_mutex;
+	GList *monitor_locations;
+	guint monitor_watch_budget;
+	int fanotify_fd;
+	guint fanotify_watch_id;
+	guint monitor_events;
+	gint64 monitor_start_time;
 
 	gboolean dry_run;
 	gboolean no_update;
 
+	gboolean progressive_load;
+	gint64 load_start_time;
+	gint load_count;
+	gint load_progress_queued;
+	gboolean load_progress_reported;
+
 	GMutex change_mutex;
 	GHashTable *added_entries;
 	GHashTable *changed_entries;
@@ -171,6 +216,16 @@ struct _RhythmDBPrivate
 	guint save_count;
 
 	guint event_queue_watch_id;
+	gboolean event_batch_active;
+	gboolean event_batch_commit;
+	gboolean event_batch_changes;
+	gboolean event_batch_sync;
+	GHashTable *event_batch_uris;
+	guint event_batches;
+	guint64 event_batch_events;
+	gint64 event_batch_time;
+	gint64 event_batch_max_time;
+	guint event_batch_latency[5];
 	guint commit_timeout_id;
 	guint save_timeout_id;
 	guint sync_library_id;
@@ -188,6 +243,11 @@ struct _RhythmDBPrivate
 	gboolean saving;
 	gboolean dirty;
 
+	gboolean use_journal;
+	RhythmDBJournal *journal;
+	gboolean journal_replaying;
+	guint journal_flush_id;
+
 	GHashTable *entry_type_map;
 	GMutex entry_type_map_mutex;
 	GMutex entry_type_mutex;
@@ -206,6 +266,7 @@ typedef struct
 		RHYTHMDB_EVENT_METADATA_LOAD,
 		RHYTHMDB_EVENT_METADATA_CACHE,
 		RHYTHMDB_EVENT_DB_LOAD,
+		RHYTHMDB_EVENT_DB_LOAD_PROGRESS,
 		RHYTHMDB_EVENT_THREAD_EXITED,
 		RHYTHMDB_EVENT_DB_SAVED,
 		RHYTHMDB_EVENT_QUERY_COMPLETE,
@@ -235,18 +296,52 @@ typedef struct
 	RhythmDBEntryChange change;
 } RhythmDBEvent;
 
+/* metadata loads dispatched but not yet delivered.  once this many are
+ * outstanding, no more are dispatched until the oldest one is delivered,
+ * so a slow file can't make completed results pile up without bound.
+ */
+#define RHYTHMDB_METADATA_REORDER_WINDOW	256
+
 /* from rhythmdb.c */
+void rhythmdb_push_event (RhythmDB *db, RhythmDBEvent *event);
+guint rhythmdb_reserve_metadata_seq (RhythmDB *db);
+void rhythmdb_deliver_metadata_event (RhythmDB *db, guint seq, RhythmDBEvent *event);
 void rhythmdb_entry_set_visibility (RhythmDB *db, RhythmDBEntry *entry,
 				    gboolean visibility);
 void rhythmdb_entry_set_internal (RhythmDB *db, RhythmDBEntry *entry,
 				  gboolean notify_if_inserted, guint propid,
 				  const GValue *value);
 void rhythmdb_entry_type_foreach (RhythmDB *db, GHFunc func, gpointer data);
+void rhythmdb_commit_internal (RhythmDB *db, gboolean sync_changes, GThread *thread);
+void rhythmdb_load_batch_committed (RhythmDB *db, guint count);
 RhythmDBEntry *	rhythmdb_entry_lookup_by_location_refstring (RhythmDB *db, RBRefString *uri);
+void rhythmdb_add_file_info_with_types (RhythmDB *db, const char *uri, GFileInfo *info,
+					RhythmDBEntryType *type, RhythmDBEntryType *ignore_type,
+					RhythmDBEntryType *error_type);
 
 gboolean rhythmdb_is_query_thread (void);
 
+typedef struct {
+	guint batches;
+	guint64 events;
+	double mean_batch_ms;
+	double max_batch_ms;
+	/* batches taking under 1, 4, 16 and 64ms, and longer */
+	guint latency[5];
+} RhythmDBEventStats;
+
+void rhythmdb_get_event_stats (RhythmDB *db, RhythmDBEventStats *stats);
+
 /* from rhythmdb-monitor.c */
+typedef struct {
+	guint directory_monitors;
+	guint filesystem_locations;
+	guint scanned_locations;
+	guint scanned_directories;
+	guint events;
+	double events_per_minute;
+} RhythmDBMonitorStats;
+
 void rhythmdb_init_monitoring (RhythmDB *db);
 void rhythmdb_dispose_monitoring (RhythmDB *db);
 void rhythmdb_finalize_monitoring (RhythmDB *db);
@@ -254,6 +349,25 @@ void rhythmdb_stop_monitoring (RhythmDB *db);
 void rhythmdb_start_monitoring (RhythmDB *db);
 void rhythmdb_monitor_uri_path (RhythmDB *db, const char *uri, GError **error);
 GList *rhythmdb_get_active_mounts (RhythmDB *db);
+void rhythmdb_get_monitor_stats (RhythmDB *db, RhythmDBMonitorStats *stats);
+
+typedef enum {
+	SCAN_FILE_FOUND,
+	SCAN_FILE_CREATED,
+	SCAN_FILE_CHANGED,
+	SCAN_FILE_DELETED
+} RhythmDBScanChangeType;
+
+typedef struct {
+	RhythmDBScanChangeType type;
+	char *uri;
+} RhythmDBScanChange;
+
+typedef struct _RhythmDBMonitorLocation RhythmDBMonitorLocation;
+
+RhythmDBMonitorLocation *rhythmdb_monitor_scan_location_new (RhythmDB *db, const char *uri);
+GPtrArray *rhythmdb_monitor_scan_location_run (RhythmDBMonitorLocation *loc, gboolean full);
+void rhythmdb_monitor_scan_location_free (RhythmDBMonitorLocation *loc);
 
 /* from rhythmdb-query.c */
 GPtrArray *rhythmdb_query_parse_valist (RhythmDB *db, va_list args);
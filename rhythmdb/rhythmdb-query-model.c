@@ -80,10 +80,16 @@ static void rhythmdb_query_model_do_insert (RhythmDBQueryModel *model,
 					    gint index);
 static void rhythmdb_query_model_entry_added_cb (RhythmDB *db, RhythmDBEntry *entry,
 						 RhythmDBQueryModel *model);
-static void rhythmdb_query_model_entry_changed_cb (RhythmDB *db, RhythmDBEntry *entry,
-						   GPtrArray *changes, RhythmDBQueryModel *model);
 static void rhythmdb_query_model_entry_deleted_cb (RhythmDB *db, RhythmDBEntry *entry,
 						   RhythmDBQueryModel *model);
+static void rhythmdb_query_model_entries_added_cb (RhythmDB *db, GPtrArray *entries,
+						   RhythmDBQueryModel *model);
+static void rhythmdb_query_model_entries_changed_cb (RhythmDB *db, GPtrArray *entries,
+						     GPtrArray *changes, RhythmDBPropMask *mask,
+						     RhythmDBQueryModel *model);
+static void rhythmdb_query_model_entries_deleted_cb (RhythmDB *db, GPtrArray *entries,
+						     RhythmDBQueryModel *model);
+static void rhythmdb_query_model_resort (RhythmDBQueryModel *model);
 
 static void rhythmdb_query_model_filter_out_entry (RhythmDBQueryModel *model,
 						   RhythmDBEntry *entry);
@@ -219,6 +225,8 @@ struct _RhythmDBQueryModelPrivate
 
 	GPtrArray *query;
 	GPtrArray *original_query;
+	RhythmDBPropMask query_mask;
+	gboolean query_mask_complete;
 
 	guint stamp;
 
@@ -238,6 +246,7 @@ struct _RhythmDBQueryModelPrivate
 
 	gboolean reorder_drag_and_drop;
 	gboolean show_hidden;
+	gboolean defer_reorder;
 
 	gint query_reapply_timeout_id;
 };
@@ -538,6 +547,35 @@ rhythmdb_query_model_drag_dest_init (RbTreeDragDestIface *iface)
 	iface->rb_row_drop_position = rhythmdb_query_model_row_drop_position;
 }
 
+/* returns FALSE if the query depends on anything other than entry properties */
+static gboolean
+get_query_prop_mask (GPtrArray *query, RhythmDBPropMask *mask)
+{
+	gboolean complete = TRUE;
+	guint i;
+
+	for (i = 0; i < query->len; i++) {
+		RhythmDBQueryData *data = g_ptr_array_index (query, i);
+
+		switch (data->type) {
+		case RHYTHMDB_QUERY_DISJUNCTION:
+			break;
+		case RHYTHMDB_QUERY_SUBQUERY:
+			complete &= get_query_prop_mask (data->subquery, mask);
+			break;
+		default:
+			/* keyword changes aren't reported as entry changes */
+			if (data->propid == RHYTHMDB_PROP_KEYWORD || data->propid >= RHYTHMDB_NUM_PROPERTIES)
+				complete = FALSE;
+			else
+				rhythmdb_prop_mask_add (mask, data->propid);
+			break;
+		}
+	}
+
+	return complete;
+}
+
 static void
 rhythmdb_query_model_set_query_internal (RhythmDBQueryModel *model,
 					GPtrArray          *query)
@@ -552,6 +590,11 @@ rhythmdb_query_model_set_query_internal (RhythmDBQueryModel *model,
 	model->priv->original_query = rhythmdb_query_copy (model->priv->query);
 	rhythmdb_query_preprocess (model->priv->db, model->priv->query);
 
+	/* find the properties that can affect whether an entry matches */
+	memset (&model->priv->query_mask, 0, sizeof (model->priv->query_mask));
+	rhythmdb_prop_mask_add (&model->priv->query_mask, RHYTHMDB_PROP_HIDDEN);
+	model->priv->query_mask_complete = get_query_prop_mask (model->priv->query, &model->priv->query_mask);
+
 	/* if the query contains time-relative criteria, re-run it periodically.
 	 * currently it's just every minute, but perhaps it could be smarter.
 	 */
@@ -702,16 +745,16 @@ rhythmdb_query_model_constructed (GObject *object)
 	model = RHYTHMDB_QUERY_MODEL (object);
 
 	g_signal_connect_object (G_OBJECT (model->priv->db),
-				 "entry_added",
-				 G_CALLBACK (rhythmdb_query_model_entry_added_cb),
+				 "entries-added",
+				 G_CALLBACK (rhythmdb_query_model_entries_added_cb),
 				 model, 0);
 	g_signal_connect_object (G_OBJECT (model->priv->db),
-				 "entry_changed",
-				 G_CALLBACK (rhythmdb_query_model_entry_changed_cb),
+				 "entries-changed",
+				 G_CALLBACK (rhythmdb_query_model_entries_changed_cb),
 				 model, 0);
 	g_signal_connect_object (G_OBJECT (model->priv->db),
-				 "entry_deleted",
-				 G_CALLBACK (rhythmdb_query_model_entry_deleted_cb),
+				 "entries-deleted",
+				 G_CALLBACK (rhythmdb_query_model_entries_deleted_cb),
 				 model, 0);
 }
 
@@ -1039,18 +1082,32 @@ rhythmdb_query_model_entry_added_cb (RhythmDB *db,
 }
 
 static void
-rhythmdb_query_model_entry_changed_cb (RhythmDB *db,
-				       RhythmDBEntry *entry,
-				       GPtrArray *changes,
+rhythmdb_query_model_entries_added_cb (RhythmDB *db,
+				       GPtrArray *entries,
 				       RhythmDBQueryModel *model)
 {
+	guint i;
+
+	for (i = 0; i < entries->len; i++) {
+		rhythmdb_query_model_entry_added_cb (db, g_ptr_array_index (entries, i), model);
+	}
+}
+
+/* if check_query is FALSE, none of the changes can affect whether the entry matches the query */
+static void
+rhythmdb_query_model_process_entry_change (RhythmDBQueryModel *model,
+					   RhythmDBEntry *entry,
+					   GPtrArray *changes,
+					   gboolean check_query)
+{
+	RhythmDB *db = model->priv->db;
 	gboolean hidden = FALSE;
 	int i;
 
 	hidden = (!model->priv->show_hidden && rhythmdb_entry_get_boolean (entry, RHYTHMDB_PROP_HIDDEN));
 
 	if (g_hash_table_lookup (model->priv->reverse_map, entry) == NULL) {
-		if (hidden == FALSE) {
+		if (hidden == FALSE && check_query) {
 			/* the changed entry may now satisfy the query
 			 * so we test it */
 			rhythmdb_query_model_entry_added_cb (db, entry, model);
@@ -1131,14 +1188,17 @@ rhythmdb_query_model_entry_changed_cb (RhythmDB *db,
 		}
 	}
 
-	if (model->priv->query &&
+	if (model->priv->query && check_query &&
 	    !rhythmdb_evaluate_query (db, model->priv->query, entry)) {
 		rhythmdb_query_model_filter_out_entry (model, entry);
 		return;
 	}
 
-	/* it may have moved, so we can't just emit a changed entry */
-	if (!rhythmdb_query_model_do_reorder (model, entry)) {
+	/* it may have moved, so we can't just emit a changed entry.
+	 * if we're processing a large batch of changes, the whole model
+	 * is re-sorted at the end instead.
+	 */
+	if (model->priv->defer_reorder || !rhythmdb_query_model_do_reorder (model, entry)) {
 		/* but if it didn't, we can */
 		GtkTreeIter iter;
 		GtkTreePath *path;
@@ -1153,6 +1213,48 @@ rhythmdb_query_model_entry_changed_cb (RhythmDB *db,
 	}
 }
 
+/* re-sorting the whole model once is cheaper than moving this many
+ * entries one at a time, each move emitting its own rows-reordered signal
+ */
+#define RHYTHMDB_QUERY_MODEL_BATCH_REORDER_MIN	32
+
+static void
+rhythmdb_query_model_entries_changed_cb (RhythmDB *db,
+					 GPtrArray *entries,
+					 GPtrArray *changes,
+					 RhythmDBPropMask *mask,
+					 RhythmDBQueryModel *model)
+{
+	gboolean check_query;
+	gboolean batch_reorder;
+	guint i;
+
+	/* if none of the changed properties are used in the query, no entry
+	 * can have started or stopped matching it.  chained models also depend
+	 * on the base model's contents, so they always check.
+	 */
+	check_query = (model->priv->query == NULL ||
+		       model->priv->base_model != NULL ||
+		       model->priv->query_mask_complete == FALSE ||
+		       rhythmdb_prop_mask_intersects (mask, &model->priv->query_mask));
+
+	batch_reorder = (model->priv->sort_func != NULL &&
+			 model->priv->limit_type == RHYTHMDB_QUERY_MODEL_LIMIT_NONE &&
+			 entries->len >= RHYTHMDB_QUERY_MODEL_BATCH_REORDER_MIN);
+
+	model->priv->defer_reorder = batch_reorder;
+	for (i = 0; i < entries->len; i++) {
+		rhythmdb_query_model_process_entry_change (model,
+							   g_ptr_array_index (entries, i),
+							   g_ptr_array_index (changes, i),
+							   check_query);
+	}
+	model->priv->defer_reorder = FALSE;
+
+	if (batch_reorder)
+		rhythmdb_query_model_resort (model);
+}
+
 static void
 rhythmdb_query_model_base_entry_prop_changed (RhythmDBQueryModel *base_model,
 					      RhythmDBEntry *entry,
@@ -1180,6 +1282,18 @@ rhythmdb_query_model_entry_deleted_cb (RhythmDB *db,
 		rhythmdb_query_model_remove_entry (model, entry);
 }
 
+static void
+rhythmdb_query_model_entries_deleted_cb (RhythmDB *db,
+					 GPtrArray *entries,
+					 RhythmDBQueryModel *model)
+{
+	guint i;
+
+	for (i = 0; i < entries->len; i++) {
+		rhythmdb_query_model_entry_deleted_cb (db, g_ptr_array_index (entries, i), model);
+	}
+}
+
 static gboolean
 idle_process_update_idle (struct RhythmDBQueryModelUpdate *update)
 {
@@ -2540,6 +2654,52 @@ apply_updated_entry_sequence (RhythmDBQueryModel *model,
 	g_free (reorder_map);
 }
 
+/* re-sorts the model after entries have changed without being moved */
+static void
+rhythmdb_query_model_resort (RhythmDBQueryModel *model)
+{
+	GSequence *new_entries;
+	GSequenceIter *old_ptr;
+	GSequenceIter *new_ptr;
+	GCompareDataFunc sort_func;
+	gpointer sort_data;
+	struct ReverseSortData reverse_data;
+
+	if (model->priv->sort_reverse) {
+		sort_func = (GCompareDataFunc) _reverse_sorting_func;
+		sort_data = &reverse_data;
+		reverse_data.func = model->priv->sort_func;
+		reverse_data.data = model->priv->sort_data;
+	} else {
+		sort_func = model->priv->sort_func;
+		sort_data = model->priv->sort_data;
+	}
+
+	new_entries = g_sequence_new (NULL);
+	old_ptr = g_sequence_get_begin_iter (model->priv->entries);
+	while (!g_sequence_iter_is_end (old_ptr)) {
+		g_sequence_append (new_entries, g_sequence_get (old_ptr));
+		old_ptr = g_sequence_iter_next (old_ptr);
+	}
+	g_sequence_sort (new_entries, sort_func, sort_data);
+
+	/* only emit a re-order if something actually moved */
+	old_ptr = g_sequence_get_begin_iter (model->priv->entries);
+	new_ptr = g_sequence_get_begin_iter (new_entries);
+	while (!g_sequence_iter_is_end (old_ptr)) {
+		if (g_sequence_get (old_ptr) != g_sequence_get (new_ptr))
+			break;
+		old_ptr = g_sequence_iter_next (old_ptr);
+		new_ptr = g_sequence_iter_next (new_ptr);
+	}
+
+	if (g_sequence_iter_is_end (old_ptr)) {
+		g_sequence_free (new_entries);
+	} else {
+		apply_updated_entry_sequence (model, new_entries);
+	}
+}
+
 /**
  * rhythmdb_query_model_set_sort_order:
  * @model: a #RhythmDBQueryModel
@@ -0,0 +1,645 @@
+/*
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+/*
+ * A query plan is a flattened form of a preprocessed query, built once before
+ * a query is run over a large number of entries.  Each criterion becomes an
+ * op that knows how to fetch its field from the entry (usually straight from
+ * the entry structure, rather than through the rhythmdb_entry_get_* accessors),
+ * the type of the value, and the comparison to perform, so evaluating it per
+ * entry doesn't involve looking up property types or unpacking GValues.
+ *
+ * String equality tests on refstring fields hold a reference to the refstring
+ * for the value, so they can be done by comparing pointers.
+ *
+ * Disjunctions are ops too; each op records the position of the next
+ * disjunction so evaluation can skip the rest of a conjunction as soon as one
+ * of its criteria fails.  Subqueries are compiled into nested plans.
+ *
+ * The results of evaluating a plan must always match those of evaluating the
+ * query it was compiled from with rhythmdb_evaluate_query.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "rhythmdb-query-plan.h"
+#include "rhythmdb-private.h"
+#include "rb-util.h"
+
+typedef enum {
+	PLAN_OP_DISJUNCTION,
+	PLAN_OP_SUBQUERY,
+	PLAN_OP_STRING,
+	PLAN_OP_REFSTRING_EQUALS,
+	PLAN_OP_REFSTRING_NOT_EQUAL,
+	PLAN_OP_ULONG,
+	PLAN_OP_UINT64,
+	PLAN_OP_DOUBLE,
+	PLAN_OP_BOOLEAN,
+	PLAN_OP_OBJECT,
+	PLAN_OP_SEARCH_MATCH,
+	PLAN_OP_KEYWORD
+} RhythmDBQueryPlanOpCode;
+
+typedef enum {
+	PLAN_CMP_EQUALS,
+	PLAN_CMP_NOT_EQUAL,
+	PLAN_CMP_GREATER_EQUAL,
+	PLAN_CMP_LESS_EQUAL,
+	PLAN_CMP_LESS,
+	PLAN_CMP_LIKE,
+	PLAN_CMP_NOT_LIKE,
+	PLAN_CMP_PREFIX,
+	PLAN_CMP_SUFFIX
+} RhythmDBQueryPlanComparison;
+
+/* how the value of a property is fetched from an entry */
+typedef enum {
+	PLAN_FIELD_ACCESSOR,		/* rhythmdb_entry_get_* */
+	PLAN_FIELD_REFSTRING,
+	PLAN_FIELD_REFSTRING_FOLDED,
+	PLAN_FIELD_REFSTRING_SORT_KEY,
+	PLAN_FIELD_UINT16,
+	PLAN_FIELD_UINT32,
+	PLAN_FIELD_ULONG,
+	PLAN_FIELD_LONG,
+	PLAN_FIELD_UINT64,
+	PLAN_FIELD_DOUBLE,
+	PLAN_FIELD_TYPE,
+	PLAN_FIELD_HIDDEN
+} RhythmDBQueryPlanField;
+
+typedef struct {
+	guint8 code;
+	guint8 cmp;
+	guint8 field;
+	RhythmDBPropType propid;
+	gsize offset;
+	guint next;		/* index of the next disjunction, or the end of the plan */
+	union {
+		const char *string;
+		RBRefString *refstring;
+		gulong ulong;
+		guint64 uint64;
+		double dbl;
+		gboolean boolean;
+		gpointer object;
+		char **words;
+		RhythmDBQueryPlan *subplan;
+	} value;
+} RhythmDBQueryPlanOp;
+
+struct _RhythmDBQueryPlan
+{
+	RhythmDB *db;
+	GArray *ops;
+};
+
+#define ENTRY_FIELD(entry, offset, ctype) (*(ctype *) (((char *) (entry)) + (offset)))
+
+static void
+get_field (RhythmDBPropType propid, RhythmDBQueryPlanField *field, gsize *offset)
+{
+	*offset = 0;
+	switch (propid) {
+#define REFSTRING_PROP(prop, member) \
+	case RHYTHMDB_PROP_##prop: \
+		*field = PLAN_FIELD_REFSTRING; \
+		*offset = G_STRUCT_OFFSET (RhythmDBEntry, member); \
+		break;
+#define FOLDED_PROP(prop, member) \
+	case RHYTHMDB_PROP_##prop##_FOLDED: \
+		*field = PLAN_FIELD_REFSTRING_FOLDED; \
+		*offset = G_STRUCT_OFFSET (RhythmDBEntry, member); \
+		break;
+#define SORT_KEY_PROP(prop, member) \
+	case RHYTHMDB_PROP_##prop##_SORT_KEY: \
+		*field = PLAN_FIELD_REFSTRING_SORT_KEY; \
+		*offset = G_STRUCT_OFFSET (RhythmDBEntry, member); \
+		break;
+#define NUMERIC_PROP(prop, member, kind) \
+	case RHYTHMDB_PROP_##prop: \
+		*field = kind; \
+		*offset = G_STRUCT_OFFSET (RhythmDBEntry, member); \
+		break;
+
+	REFSTRING_PROP (TITLE, title)
+	REFSTRING_PROP (ALBUM, album)
+	REFSTRING_PROP (ARTIST, artist)
+	REFSTRING_PROP (GENRE, genre)
+	REFSTRING_PROP (ALBUM_ARTIST, album_artist)
+	REFSTRING_PROP (MEDIA_TYPE, media_type)
+
+	FOLDED_PROP (TITLE, title)
+	FOLDED_PROP (ALBUM, album)
+	FOLDED_PROP (ARTIST, artist)
+	FOLDED_PROP (GENRE, genre)
+	FOLDED_PROP (ALBUM_ARTIST, album_artist)
+
+	SORT_KEY_PROP (TITLE, title)
+	SORT_KEY_PROP (ALBUM, album)
+	SORT_KEY_PROP (ARTIST, artist)
+	SORT_KEY_PROP (GENRE, genre)
+	SORT_KEY_PROP (ALBUM_ARTIST, album_artist)
+
+	NUMERIC_PROP (TRACK_NUMBER, tracknum, PLAN_FIELD_UINT16)
+	NUMERIC_PROP (TRACK_TOTAL, tracktotal, PLAN_FIELD_UINT16)
+	NUMERIC_PROP (DISC_NUMBER, discnum, PLAN_FIELD_UINT16)
+	NUMERIC_PROP (DISC_TOTAL, disctotal, PLAN_FIELD_UINT16)
+	NUMERIC_PROP (DURATION, duration, PLAN_FIELD_UINT32)
+	NUMERIC_PROP (BITRATE, bitrate, PLAN_FIELD_UINT32)
+	NUMERIC_PROP (MTIME, mtime, PLAN_FIELD_ULONG)
+	NUMERIC_PROP (FIRST_SEEN, first_seen, PLAN_FIELD_ULONG)
+	NUMERIC_PROP (LAST_SEEN, last_seen, PLAN_FIELD_ULONG)
+	NUMERIC_PROP (LAST_PLAYED, last_played, PLAN_FIELD_ULONG)
+	NUMERIC_PROP (PLAY_COUNT, play_count, PLAN_FIELD_LONG)
+	NUMERIC_PROP (FILE_SIZE, file_size, PLAN_FIELD_UINT64)
+	NUMERIC_PROP (RATING, rating, PLAN_FIELD_DOUBLE)
+
+#undef REFSTRING_PROP
+#undef FOLDED_PROP
+#undef SORT_KEY_PROP
+#undef NUMERIC_PROP
+
+	case RHYTHMDB_PROP_TYPE:
+		*field = PLAN_FIELD_TYPE;
+		break;
+	case RHYTHMDB_PROP_HIDDEN:
+		*field = PLAN_FIELD_HIDDEN;
+		break;
+	default:
+		/* anything that needs more work to fetch, such as podcast
+		 * fields, the entry's extra fields, mirrored string properties,
+		 * and dates */
+		*field = PLAN_FIELD_ACCESSOR;
+		break;
+	}
+}
+
+static RhythmDBQueryPlanOpCode
+get_type_op (RhythmDB *db, RhythmDBPropType propid)
+{
+	GType type = rhythmdb_get_property_type (db, propid);
+
+	switch (type) {
+	case G_TYPE_STRING:
+		return PLAN_OP_STRING;
+	case G_TYPE_ULONG:
+		return PLAN_OP_ULONG;
+	case G_TYPE_UINT64:
+		return PLAN_OP_UINT64;
+	case G_TYPE_DOUBLE:
+		return PLAN_OP_DOUBLE;
+	case G_TYPE_BOOLEAN:
+		return PLAN_OP_BOOLEAN;
+	case G_TYPE_OBJECT:
+		return PLAN_OP_OBJECT;
+	default:
+		g_warning ("Unexpected type: %s", g_type_name (type));
+		g_assert_not_reached ();
+		return PLAN_OP_STRING;
+	}
+}
+
+static void
+set_op_value (RhythmDBQueryPlanOp *op, const GValue *val)
+{
+	switch (op->code) {
+	case PLAN_OP_STRING:
+		op->value.string = g_value_get_string (val);
+		break;
+	case PLAN_OP_ULONG:
+		op->value.ulong = g_value_get_ulong (val);
+		break;
+	case PLAN_OP_UINT64:
+		op->value.uint64 = g_value_get_uint64 (val);
+		break;
+	case PLAN_OP_DOUBLE:
+		op->value.dbl = g_value_get_double (val);
+		break;
+	case PLAN_OP_BOOLEAN:
+		op->value.boolean = g_value_get_boolean (val);
+		break;
+	case PLAN_OP_OBJECT:
+		op->value.object = g_value_get_object (val);
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+}
+
+static void
+compile_criterion (RhythmDBQueryPlan *plan, RhythmDBQueryData *data, RhythmDBQueryPlanOp *op)
+{
+	RhythmDBQueryPlanField field;
+
+	op->propid = data->propid;
+	get_field (data->propid, &field, &op->offset);
+	op->field = field;
+
+	switch (data->type) {
+	case RHYTHMDB_QUERY_DISJUNCTION:
+		op->code = PLAN_OP_DISJUNCTION;
+		return;
+
+	case RHYTHMDB_QUERY_SUBQUERY:
+		op->code = PLAN_OP_SUBQUERY;
+		op->value.subplan = rhythmdb_query_plan_compile (plan->db, data->subquery);
+		return;
+
+	case RHYTHMDB_QUERY_PROP_CURRENT_TIME_WITHIN:
+	case RHYTHMDB_QUERY_PROP_CURRENT_TIME_NOT_WITHIN:
+	{
+		GTimeVal current_time;
+
+		g_assert (rhythmdb_get_property_type (plan->db, data->propid) == G_TYPE_ULONG);
+
+		g_get_current_time (&current_time);
+		op->code = PLAN_OP_ULONG;
+		op->value.ulong = current_time.tv_sec - g_value_get_ulong (data->val);
+		if (data->type == RHYTHMDB_QUERY_PROP_CURRENT_TIME_WITHIN)
+			op->cmp = PLAN_CMP_GREATER_EQUAL;
+		else
+			op->cmp = PLAN_CMP_LESS;
+		return;
+	}
+
+	case RHYTHMDB_QUERY_PROP_PREFIX:
+	case RHYTHMDB_QUERY_PROP_SUFFIX:
+		g_assert (rhythmdb_get_property_type (plan->db, data->propid) == G_TYPE_STRING);
+
+		op->code = PLAN_OP_STRING;
+		op->cmp = (data->type == RHYTHMDB_QUERY_PROP_PREFIX) ? PLAN_CMP_PREFIX : PLAN_CMP_SUFFIX;
+		op->value.string = g_value_get_string (data->val);
+		return;
+
+	case RHYTHMDB_QUERY_PROP_LIKE:
+	case RHYTHMDB_QUERY_PROP_NOT_LIKE:
+		if (data->propid == RHYTHMDB_PROP_KEYWORD) {
+			op->code = PLAN_OP_KEYWORD;
+			op->cmp = (data->type == RHYTHMDB_QUERY_PROP_LIKE) ? PLAN_CMP_LIKE : PLAN_CMP_NOT_LIKE;
+			op->value.refstring = rb_refstring_find (g_value_get_string (data->val));
+			return;
+		} else if (data->propid == RHYTHMDB_PROP_SEARCH_MATCH) {
+			op->code = PLAN_OP_SEARCH_MATCH;
+			op->cmp = (data->type == RHYTHMDB_QUERY_PROP_LIKE) ? PLAN_CMP_LIKE : PLAN_CMP_NOT_LIKE;
+			op->value.words = g_value_get_boxed (data->val);
+			return;
+		} else if (rhythmdb_get_property_type (plan->db, data->propid) == G_TYPE_STRING) {
+			op->code = PLAN_OP_STRING;
+			op->cmp = (data->type == RHYTHMDB_QUERY_PROP_LIKE) ? PLAN_CMP_LIKE : PLAN_CMP_NOT_LIKE;
+			op->value.string = g_value_get_string (data->val);
+			return;
+		}
+		/* like the interpreter, treat LIKE on other types as EQUALS */
+		op->cmp = PLAN_CMP_EQUALS;
+		break;
+
+	case RHYTHMDB_QUERY_PROP_EQUALS:
+		op->cmp = PLAN_CMP_EQUALS;
+		break;
+	case RHYTHMDB_QUERY_PROP_NOT_EQUAL:
+		op->cmp = PLAN_CMP_NOT_EQUAL;
+		break;
+	case RHYTHMDB_QUERY_PROP_GREATER:
+		op->cmp = PLAN_CMP_GREATER_EQUAL;
+		break;
+	case RHYTHMDB_QUERY_PROP_LESS:
+		op->cmp = PLAN_CMP_LESS_EQUAL;
+		break;
+
+	case RHYTHMDB_QUERY_END:
+	case RHYTHMDB_QUERY_PROP_YEAR_EQUALS:
+	case RHYTHMDB_QUERY_PROP_YEAR_NOT_EQUAL:
+	case RHYTHMDB_QUERY_PROP_YEAR_LESS:
+	case RHYTHMDB_QUERY_PROP_YEAR_GREATER:
+		g_assert_not_reached ();
+		break;
+	}
+
+	op->code = get_type_op (plan->db, data->propid);
+	if (op->code == PLAN_OP_STRING &&
+	    op->field == PLAN_FIELD_REFSTRING &&
+	    (op->cmp == PLAN_CMP_EQUALS || op->cmp == PLAN_CMP_NOT_EQUAL)) {
+		/* strings are interned, so an entry has this value if and only
+		 * if its field points to this refstring */
+		const char *value = g_value_get_string (data->val);
+
+		op->code = (op->cmp == PLAN_CMP_EQUALS) ? PLAN_OP_REFSTRING_EQUALS : PLAN_OP_REFSTRING_NOT_EQUAL;
+		op->value.refstring = value ? rb_refstring_new (value) : NULL;
+	} else {
+		set_op_value (op, data->val);
+	}
+}
+
+/**
+ * rhythmdb_query_plan_compile:
+ * @db: the #RhythmDB
+ * @query: a preprocessed query
+ *
+ * Compiles a query into a form that can be evaluated quickly against a large
+ * number of entries.  The plan refers to values in @query, so the query must
+ * not be modified or freed while the plan is in use.
+ *
+ * Return value: the query plan, free with rhythmdb_query_plan_free
+ */
+RhythmDBQueryPlan *
+rhythmdb_query_plan_compile (RhythmDB *db, GPtrArray *query)
+{
+	RhythmDBQueryPlan *plan;
+	guint next;
+	guint i;
+
+	plan = g_new0 (RhythmDBQueryPlan, 1);
+	plan->db = db;
+	plan->ops = g_array_sized_new (FALSE, TRUE, sizeof (RhythmDBQueryPlanOp), query ? query->len : 0);
+
+	for (i = 0; query != NULL && i < query->len; i++) {
+		RhythmDBQueryPlanOp op = {0,};
+
+		compile_criterion (plan, g_ptr_array_index (query, i), &op);
+		g_array_append_val (plan->ops, op);
+	}
+
+	/* link each op to the following disjunction */
+	next = plan->ops->len;
+	for (i = plan->ops->len; i > 0; i--) {
+		RhythmDBQueryPlanOp *op = &g_array_index (plan->ops, RhythmDBQueryPlanOp, i - 1);
+
+		op->next = next;
+		if (op->code == PLAN_OP_DISJUNCTION)
+			next = i - 1;
+	}
+
+	return plan;
+}
+
+/**
+ * rhythmdb_query_plan_free:
+ * @plan: the #RhythmDBQueryPlan
+ *
+ * Frees a query plan.
+ */
+void
+rhythmdb_query_plan_free (RhythmDBQueryPlan *plan)
+{
+	guint i;
+
+	for (i = 0; i < plan->ops->len; i++) {
+		RhythmDBQueryPlanOp *op = &g_array_index (plan->ops, RhythmDBQueryPlanOp, i);
+
+		switch (op->code) {
+		case PLAN_OP_SUBQUERY:
+			rhythmdb_query_plan_free (op->value.subplan);
+			break;
+		case PLAN_OP_REFSTRING_EQUALS:
+		case PLAN_OP_REFSTRING_NOT_EQUAL:
+		case PLAN_OP_KEYWORD:
+			rb_refstring_unref (op->value.refstring);
+			break;
+		default:
+			break;
+		}
+	}
+
+	g_array_unref (plan->ops);
+	g_free (plan);
+}
+
+static const char *
+get_string (RhythmDBQueryPlanOp *op, RhythmDBEntry *entry)
+{
+	switch (op->field) {
+	case PLAN_FIELD_REFSTRING:
+		return rb_refstring_get (ENTRY_FIELD (entry, op->offset, RBRefString *));
+	case PLAN_FIELD_REFSTRING_FOLDED:
+		return rb_refstring_get_folded (ENTRY_FIELD (entry, op->offset, RBRefString *));
+	case PLAN_FIELD_REFSTRING_SORT_KEY:
+		return rb_refstring_get_sort_key (ENTRY_FIELD (entry, op->offset, RBRefString *));
+	default:
+		return rhythmdb_entry_get_string (entry, op->propid);
+	}
+}
+
+static gulong
+get_ulong (RhythmDBQueryPlanOp *op, RhythmDBEntry *entry)
+{
+	switch (op->field) {
+	case PLAN_FIELD_UINT16:
+		return ENTRY_FIELD (entry, op->offset, guint16);
+	case PLAN_FIELD_UINT32:
+		return ENTRY_FIELD (entry, op->offset, guint32);
+	case PLAN_FIELD_ULONG:
+		return ENTRY_FIELD (entry, op->offset, gulong);
+	case PLAN_FIELD_LONG:
+		return ENTRY_FIELD (entry, op->offset, glong);
+	default:
+		return rhythmdb_entry_get_ulong (entry, op->propid);
+	}
+}
+
+/* a and b must not have side effects */
+#define PLAN_COMPARE(cmp, a, b) \
+	((cmp) == PLAN_CMP_EQUALS ? (a) == (b) : \
+	 (cmp) == PLAN_CMP_NOT_EQUAL ? (a) != (b) : \
+	 (cmp) == PLAN_CMP_GREATER_EQUAL ? (a) >= (b) : \
+	 (cmp) == PLAN_CMP_LESS_EQUAL ? (a) <= (b) : \
+	 (a) < (b))
+
+static gboolean
+search_match (RhythmDBEntry *entry, char **words)
+{
+	RBRefString *fields[] = {
+		entry->title,
+		entry->album,
+		entry->artist,
+		entry->extra->composer,
+		entry->genre
+	};
+	char **current;
+	int i;
+
+	for (current = words; *current != NULL; current++) {
+		gboolean found = FALSE;
+
+		for (i = 0; i < G_N_ELEMENTS (fields) && !found; i++) {
+			const char *s = rb_refstring_get_folded (fields[i]);
+			found = (s != NULL && strstr (s, *current) != NULL);
+		}
+		if (!found)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static gboolean
+evaluate_op (RhythmDBQueryPlan *plan, RhythmDBQueryPlanOp *op, RhythmDBEntry *entry)
+{
+	switch (op->code) {
+	case PLAN_OP_SUBQUERY:
+		return rhythmdb_query_plan_evaluate (op->value.subplan, entry);
+
+	case PLAN_OP_REFSTRING_EQUALS:
+		return ENTRY_FIELD (entry, op->offset, RBRefString *) == op->value.refstring;
+	case PLAN_OP_REFSTRING_NOT_EQUAL:
+		return ENTRY_FIELD (entry, op->offset, RBRefString *) != op->value.refstring;
+
+	case PLAN_OP_STRING:
+	{
+		const char *s = get_string (op, entry);
+
+		switch (op->cmp) {
+		case PLAN_CMP_EQUALS:
+			return g_strcmp0 (s, op->value.string) == 0;
+		case PLAN_CMP_NOT_EQUAL:
+			return g_strcmp0 (s, op->value.string) != 0;
+		case PLAN_CMP_GREATER_EQUAL:
+			return g_strcmp0 (s, op->value.string) >= 0;
+		case PLAN_CMP_LESS_EQUAL:
+			return g_strcmp0 (s, op->value.string) <= 0;
+		case PLAN_CMP_LIKE:
+			return s != NULL && strstr (s, op->value.string) != NULL;
+		case PLAN_CMP_NOT_LIKE:
+			/* like the interpreter, a missing value never matches */
+			return s != NULL && strstr (s, op->value.string) == NULL;
+		case PLAN_CMP_PREFIX:
+			return s != NULL && g_str_has_prefix (s, op->value.string);
+		case PLAN_CMP_SUFFIX:
+			return s != NULL && g_str_has_suffix (s, op->value.string);
+		default:
+			g_assert_not_reached ();
+			return FALSE;
+		}
+	}
+
+	case PLAN_OP_ULONG:
+	{
+		gulong v = get_ulong (op, entry);
+		return PLAN_COMPARE (op->cmp, v, op->value.ulong);
+	}
+
+	case PLAN_OP_UINT64:
+	{
+		guint64 v;
+
+		if (op->field == PLAN_FIELD_UINT64)
+			v = ENTRY_FIELD (entry, op->offset, guint64);
+		else
+			v = rhythmdb_entry_get_uint64 (entry, op->propid);
+		return PLAN_COMPARE (op->cmp, v, op->value.uint64);
+	}
+
+	case PLAN_OP_DOUBLE:
+	{
+		double v;
+
+		if (op->field == PLAN_FIELD_DOUBLE)
+			v = ENTRY_FIELD (entry, op->offset, double);
+		else
+			v = rhythmdb_entry_get_double (entry, op->propid);
+		return PLAN_COMPARE (op->cmp, v, op->value.dbl);
+	}
+
+	case PLAN_OP_BOOLEAN:
+	{
+		gboolean v;
+
+		if (op->field == PLAN_FIELD_HIDDEN)
+			v = ((entry->flags & RHYTHMDB_ENTRY_HIDDEN) != 0);
+		else
+			v = rhythmdb_entry_get_boolean (entry, op->propid);
+		return PLAN_COMPARE (op->cmp, v, op->value.boolean);
+	}
+
+	case PLAN_OP_OBJECT:
+	{
+		gpointer v;
+
+		if (op->field == PLAN_FIELD_TYPE)
+			v = entry->type;
+		else
+			v = rhythmdb_entry_get_object (entry, op->propid);
+		return PLAN_COMPARE (op->cmp, v, op->value.object);
+	}
+
+	case PLAN_OP_SEARCH_MATCH:
+		return (op->cmp == PLAN_CMP_LIKE) == search_match (entry, op->value.words);
+
+	case PLAN_OP_KEYWORD:
+	{
+		gboolean has = FALSE;
+
+		if (op->value.refstring != NULL)
+			has = rhythmdb_entry_keyword_has (plan->db, entry, op->value.refstring);
+		return (op->cmp == PLAN_CMP_LIKE) == has;
+	}
+
+	case PLAN_OP_DISJUNCTION:
+	default:
+		g_assert_not_reached ();
+		return FALSE;
+	}
+}
+
+/**
+ * rhythmdb_query_plan_evaluate:
+ * @plan: the #RhythmDBQueryPlan
+ * @entry: a #RhythmDBEntry
+ *
+ * Evaluates the query plan against an entry.
+ *
+ * Return value: %TRUE if the entry matches the query
+ */
+gboolean
+rhythmdb_query_plan_evaluate (RhythmDBQueryPlan *plan, RhythmDBEntry *entry)
+{
+	RhythmDBQueryPlanOp *ops = (RhythmDBQueryPlanOp *) plan->ops->data;
+	guint n = plan->ops->len;
+	guint i = 0;
+
+	while (i < n) {
+		RhythmDBQueryPlanOp *op = &ops[i];
+
+		if (op->code == PLAN_OP_DISJUNCTION) {
+			/* reached the end of a conjunction without failing */
+			return TRUE;
+		}
+
+		if (evaluate_op (plan, op, entry)) {
+			i++;
+		} else if (op->next < n) {
+			/* try the next conjunction */
+			i = op->next + 1;
+		} else {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
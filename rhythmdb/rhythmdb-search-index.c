@@ -0,0 +1,329 @@
+/*
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+/*
+ * The search index maps each three-byte sequence (trigram) occurring in the
+ * case-folded search properties of an entry to the entries containing it.
+ * Posting lists are arrays of entries sorted by entry ID, so entries created
+ * in order (as they are when loading the database) are simply appended.
+ *
+ * A string can only be a substring of a property if all of its trigrams
+ * occur in the property, so intersecting the posting lists for the trigrams
+ * of the search words gives a small set of candidate entries, which are then
+ * checked against the full query.  Words shorter than three bytes can't be
+ * looked up, so they are only checked against the candidates.
+ *
+ * The index does no locking of its own.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "rhythmdb-search-index.h"
+#include "rhythmdb-private.h"
+
+struct _RhythmDBSearchIndex
+{
+	GHashTable *postings;		/* trigram -> GPtrArray<RhythmDBEntry> */
+};
+
+#define TRIGRAM(s)	((((guint32) (guint8) (s)[0]) << 16) | (((guint32) (guint8) (s)[1]) << 8) | ((guint32) (guint8) (s)[2]))
+
+static int
+compare_trigrams (gconstpointer a, gconstpointer b)
+{
+	guint32 ta = *(const guint32 *) a;
+	guint32 tb = *(const guint32 *) b;
+
+	return (ta > tb) - (ta < tb);
+}
+
+/* builds a sorted array of the distinct trigrams in the strings */
+static GArray *
+get_trigrams (const char * const *strings)
+{
+	GArray *trigrams;
+	guint i, j;
+
+	trigrams = g_array_new (FALSE, FALSE, sizeof (guint32));
+	for (i = 0; strings != NULL && strings[i] != NULL; i++) {
+		const char *s = strings[i];
+		gsize len = strlen (s);
+
+		for (j = 0; j + 3 <= len; j++) {
+			guint32 t = TRIGRAM (s + j);
+			g_array_append_val (trigrams, t);
+		}
+	}
+
+	if (trigrams->len > 1) {
+		g_array_sort (trigrams, compare_trigrams);
+		for (i = 1, j = 0; i < trigrams->len; i++) {
+			if (g_array_index (trigrams, guint32, i) != g_array_index (trigrams, guint32, j)) {
+				j++;
+				g_array_index (trigrams, guint32, j) = g_array_index (trigrams, guint32, i);
+			}
+		}
+		g_array_set_size (trigrams, j + 1);
+	}
+
+	return trigrams;
+}
+
+/* returns the position of the entry in the posting list, or where it should be inserted */
+static guint
+find_posting (GPtrArray *posting, RhythmDBEntry *entry, gboolean *found)
+{
+	guint lo = 0;
+	guint hi = posting->len;
+
+	/* entries are usually added in ID order */
+	if (hi > 0 && ((RhythmDBEntry *) g_ptr_array_index (posting, hi - 1))->id < entry->id) {
+		*found = FALSE;
+		return hi;
+	}
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		RhythmDBEntry *e = g_ptr_array_index (posting, mid);
+
+		if (e->id < entry->id) {
+			lo = mid + 1;
+		} else if (e->id > entry->id) {
+			hi = mid;
+		} else {
+			*found = TRUE;
+			return mid;
+		}
+	}
+
+	*found = FALSE;
+	return lo;
+}
+
+static void
+add_posting (RhythmDBSearchIndex *index, guint32 trigram, RhythmDBEntry *entry)
+{
+	GPtrArray *posting;
+	gboolean found;
+	guint pos;
+
+	posting = g_hash_table_lookup (index->postings, GUINT_TO_POINTER (trigram));
+	if (posting == NULL) {
+		posting = g_ptr_array_new ();
+		g_hash_table_insert (index->postings, GUINT_TO_POINTER (trigram), posting);
+	}
+
+	pos = find_posting (posting, entry, &found);
+	if (found)
+		return;
+
+	if (pos == posting->len) {
+		g_ptr_array_add (posting, entry);
+	} else {
+		g_ptr_array_add (posting, NULL);
+		memmove (posting->pdata + pos + 1,
+			 posting->pdata + pos,
+			 (posting->len - pos - 1) * sizeof (gpointer));
+		posting->pdata[pos] = entry;
+	}
+}
+
+static void
+remove_posting (RhythmDBSearchIndex *index, guint32 trigram, RhythmDBEntry *entry)
+{
+	GPtrArray *posting;
+	gboolean found;
+	guint pos;
+
+	posting = g_hash_table_lookup (index->postings, GUINT_TO_POINTER (trigram));
+	if (posting == NULL)
+		return;
+
+	pos = find_posting (posting, entry, &found);
+	if (found == FALSE)
+		return;
+
+	if (posting->len == 1) {
+		g_hash_table_remove (index->postings, GUINT_TO_POINTER (trigram));
+	} else {
+		g_ptr_array_remove_index (posting, pos);
+	}
+}
+
+/**
+ * rhythmdb_search_index_new:
+ *
+ * Creates a new, empty search index.
+ *
+ * Return value: the search index, free with rhythmdb_search_index_free
+ */
+RhythmDBSearchIndex *
+rhythmdb_search_index_new (void)
+{
+	RhythmDBSearchIndex *index;
+
+	index = g_new0 (RhythmDBSearchIndex, 1);
+	index->postings = g_hash_table_new_full (g_direct_hash,
+						 g_direct_equal,
+						 NULL,
+						 (GDestroyNotify) g_ptr_array_unref);
+	return index;
+}
+
+/**
+ * rhythmdb_search_index_free:
+ * @index: the #RhythmDBSearchIndex
+ *
+ * Frees the search index.
+ */
+void
+rhythmdb_search_index_free (RhythmDBSearchIndex *index)
+{
+	g_hash_table_destroy (index->postings);
+	g_free (index);
+}
+
+/**
+ * rhythmdb_search_index_update:
+ * @index: the #RhythmDBSearchIndex
+ * @entry: the #RhythmDBEntry
+ * @old_strings: (allow-none): %NULL-terminated array of the entry's previous
+ *   folded search strings, or %NULL if the entry isn't in the index
+ * @new_strings: (allow-none): %NULL-terminated array of the entry's new
+ *   folded search strings, or %NULL to remove the entry from the index
+ *
+ * Updates the index to reflect a change to the search strings for an entry.
+ * Only the trigrams that differ between the old and new strings are touched.
+ * Elements of the string arrays may be %NULL only at the end.
+ */
+void
+rhythmdb_search_index_update (RhythmDBSearchIndex *index,
+			      RhythmDBEntry *entry,
+			      const char * const *old_strings,
+			      const char * const *new_strings)
+{
+	GArray *old_trigrams;
+	GArray *new_trigrams;
+	guint i = 0;
+	guint j = 0;
+
+	old_trigrams = get_trigrams (old_strings);
+	new_trigrams = get_trigrams (new_strings);
+
+	/* walk the two sorted arrays together */
+	while (i < old_trigrams->len || j < new_trigrams->len) {
+		guint32 o = (i < old_trigrams->len) ? g_array_index (old_trigrams, guint32, i) : G_MAXUINT32;
+		guint32 n = (j < new_trigrams->len) ? g_array_index (new_trigrams, guint32, j) : G_MAXUINT32;
+
+		if (o == n) {
+			i++;
+			j++;
+		} else if (o < n) {
+			remove_posting (index, o, entry);
+			i++;
+		} else {
+			add_posting (index, n, entry);
+			j++;
+		}
+	}
+
+	g_array_unref (old_trigrams);
+	g_array_unref (new_trigrams);
+}
+
+static int
+compare_posting_length (gconstpointer a, gconstpointer b)
+{
+	GPtrArray *pa = *(GPtrArray * const *) a;
+	GPtrArray *pb = *(GPtrArray * const *) b;
+
+	return (pa->len > pb->len) - (pa->len < pb->len);
+}
+
+/**
+ * rhythmdb_search_index_lookup:
+ * @index: the #RhythmDBSearchIndex
+ * @words: %NULL-terminated array of folded search words
+ *
+ * Finds the entries that may contain all of @words in their search strings.
+ * The caller must still check each candidate, as the index only knows that
+ * each trigram occurs somewhere in the entry.
+ *
+ * Return value: (transfer container): array of candidate entries sorted by ID,
+ *   or %NULL if none of the words are long enough to be looked up
+ */
+GPtrArray *
+rhythmdb_search_index_lookup (RhythmDBSearchIndex *index,
+			      const char * const *words)
+{
+	GArray *trigrams;
+	GPtrArray *postings;
+	GPtrArray *result;
+	guint i, j;
+
+	trigrams = get_trigrams (words);
+	if (trigrams->len == 0) {
+		g_array_unref (trigrams);
+		return NULL;
+	}
+
+	postings = g_ptr_array_sized_new (trigrams->len);
+	for (i = 0; i < trigrams->len; i++) {
+		GPtrArray *posting;
+
+		posting = g_hash_table_lookup (index->postings,
+					       GUINT_TO_POINTER (g_array_index (trigrams, guint32, i)));
+		if (posting == NULL) {
+			/* nothing contains this trigram, so nothing can match */
+			g_ptr_array_free (postings, TRUE);
+			g_array_unref (trigrams);
+			return g_ptr_array_new ();
+		}
+		g_ptr_array_add (postings, posting);
+	}
+	g_array_unref (trigrams);
+
+	/* start with the shortest list, and look each of its entries up in the others */
+	g_ptr_array_sort (postings, compare_posting_length);
+	result = g_ptr_array_new ();
+	for (i = 0; i < ((GPtrArray *) g_ptr_array_index (postings, 0))->len; i++) {
+		RhythmDBEntry *entry = g_ptr_array_index ((GPtrArray *) g_ptr_array_index (postings, 0), i);
+		gboolean found = TRUE;
+
+		for (j = 1; j < postings->len && found; j++) {
+			find_posting (g_ptr_array_index (postings, j), entry, &found);
+		}
+
+		if (found)
+			g_ptr_array_add (result, entry);
+	}
+
+	g_ptr_array_free (postings, TRUE);
+	return result;
+}
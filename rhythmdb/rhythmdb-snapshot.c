@@ -0,0 +1,796 @@
+/*
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+/*
+ * The snapshot is a binary copy of the database, written next to the XML
+ * file on each save.  It consists of a header, an array of fixed-size entry
+ * records, an array of keyword references, and a string table.  All strings
+ * are referred to by their index in the string table, so each distinct
+ * string is only stored (and interned) once.  The whole file is mapped
+ * when loading, so reading it is mostly a matter of walking the records.
+ *
+ * The XML file remains the authoritative copy: the snapshot records the
+ * size and modification time of the XML file it was written alongside,
+ * and is ignored if they don't match.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include "rhythmdb-snapshot.h"
+#include "rhythmdb-private.h"
+#include "rb-podcast-entry-types.h"
+#include "rb-debug.h"
+
+#define RHYTHMDB_SNAPSHOT_MAGIC		"RBDBSNAP"
+#define RHYTHMDB_SNAPSHOT_VERSION	2
+#define RHYTHMDB_SNAPSHOT_BYTE_ORDER	0x01020304
+
+#define RHYTHMDB_SNAPSHOT_FLAG_HIDDEN	1
+
+/* how often to check for cancellation while loading */
+#define RHYTHMDB_SNAPSHOT_CANCEL_CHECK	1024
+
+enum {
+	SNAPSHOT_STRING_TITLE,
+	SNAPSHOT_STRING_ARTIST,
+	SNAPSHOT_STRING_COMPOSER,
+	SNAPSHOT_STRING_ALBUM,
+	SNAPSHOT_STRING_ALBUM_ARTIST,
+	SNAPSHOT_STRING_GENRE,
+	SNAPSHOT_STRING_COMMENT,
+	SNAPSHOT_STRING_MUSICBRAINZ_TRACKID,
+	SNAPSHOT_STRING_MUSICBRAINZ_ARTISTID,
+	SNAPSHOT_STRING_MUSICBRAINZ_ALBUMID,
+	SNAPSHOT_STRING_MUSICBRAINZ_ALBUMARTISTID,
+	SNAPSHOT_STRING_ARTIST_SORTNAME,
+	SNAPSHOT_STRING_COMPOSER_SORTNAME,
+	SNAPSHOT_STRING_ALBUM_SORTNAME,
+	SNAPSHOT_STRING_TITLE_SORTNAME,
+	SNAPSHOT_STRING_ALBUM_ARTIST_SORTNAME,
+	SNAPSHOT_STRING_LOCATION,
+	SNAPSHOT_STRING_MOUNTPOINT,
+	SNAPSHOT_STRING_MEDIA_TYPE,
+	SNAPSHOT_STRING_DESCRIPTION,
+	SNAPSHOT_STRING_SUBTITLE,
+	SNAPSHOT_STRING_LANG,
+	SNAPSHOT_STRING_COPYRIGHT,
+	SNAPSHOT_STRING_IMAGE,
+	SNAPSHOT_STRING_GUID,
+
+	SNAPSHOT_NUM_STRINGS
+};
+
+typedef struct
+{
+	char magic[8];
+	guint32 version;
+	guint32 byte_order;
+	guint32 record_size;
+	guint32 entry_count;
+	guint32 keyword_count;
+	guint32 string_count;
+	guint64 string_data_size;
+	guint64 records_offset;
+	guint64 keywords_offset;
+	guint64 string_offsets_offset;
+	guint64 string_data_offset;
+	gint64 source_mtime;
+	guint64 source_size;
+} RhythmDBSnapshotHeader;
+
+typedef struct
+{
+	guint64 file_size;
+	guint64 mtime;
+	guint64 first_seen;
+	guint64 last_seen;
+	guint64 last_played;
+	guint64 post_time;
+	gint64 play_count;
+	gdouble rating;
+	gdouble bpm;
+	gdouble track_gain;
+	gdouble track_peak;
+	gdouble album_gain;
+	gdouble album_peak;
+
+	guint32 type;
+	guint32 flags;
+	guint32 tracknum;
+	guint32 tracktotal;
+	guint32 discnum;
+	guint32 disctotal;
+	guint32 duration;
+	guint32 bitrate;
+	guint32 date;
+	guint32 status;
+	guint32 keyword_start;
+	guint32 keyword_count;
+
+	/* string table indexes, 0 means not set */
+	guint32 strings[SNAPSHOT_NUM_STRINGS];
+} RhythmDBSnapshotRecord;
+
+struct _RhythmDBSnapshotWriter
+{
+	RhythmDB *db;
+	char *filename;
+	char *tmpname;
+	FILE *handle;
+
+	GHashTable *string_map;		/* RBRefString -> index */
+	GPtrArray *strings;
+	GArray *keywords;
+	guint32 entry_count;
+
+	char *error;
+};
+
+static RhythmDBPodcastFields *
+get_podcast_fields (RhythmDBEntry *entry)
+{
+	if (entry->type == RHYTHMDB_ENTRY_TYPE_PODCAST_FEED ||
+	    entry->type == RHYTHMDB_ENTRY_TYPE_PODCAST_POST ||
+	    entry->type == RHYTHMDB_ENTRY_TYPE_PODCAST_SEARCH)
+		return RHYTHMDB_ENTRY_GET_TYPE_DATA (entry, RhythmDBPodcastFields);
+	return NULL;
+}
+
+static RBRefString **
+get_string_slot (RhythmDBEntry *entry, RhythmDBPodcastFields *podcast, guint slot, gboolean writable)
+{
+	/* only unshare the entry's extra fields when writing to them */
+#define EXTRA_SLOT(field) (writable ? &rhythmdb_entry_get_writable_extra (entry)->field : &entry->extra->field)
+
+	switch (slot) {
+	case SNAPSHOT_STRING_TITLE:			return &entry->title;
+	case SNAPSHOT_STRING_ARTIST:			return &entry->artist;
+	case SNAPSHOT_STRING_COMPOSER:			return EXTRA_SLOT (composer);
+	case SNAPSHOT_STRING_ALBUM:			return &entry->album;
+	case SNAPSHOT_STRING_ALBUM_ARTIST:		return &entry->album_artist;
+	case SNAPSHOT_STRING_GENRE:			return &entry->genre;
+	case SNAPSHOT_STRING_COMMENT:			return EXTRA_SLOT (comment);
+	case SNAPSHOT_STRING_MUSICBRAINZ_TRACKID:	return EXTRA_SLOT (musicbrainz_trackid);
+	case SNAPSHOT_STRING_MUSICBRAINZ_ARTISTID:	return EXTRA_SLOT (musicbrainz_artistid);
+	case SNAPSHOT_STRING_MUSICBRAINZ_ALBUMID:	return EXTRA_SLOT (musicbrainz_albumid);
+	case SNAPSHOT_STRING_MUSICBRAINZ_ALBUMARTISTID:	return EXTRA_SLOT (musicbrainz_albumartistid);
+	case SNAPSHOT_STRING_ARTIST_SORTNAME:		return EXTRA_SLOT (artist_sortname);
+	case SNAPSHOT_STRING_COMPOSER_SORTNAME:		return EXTRA_SLOT (composer_sortname);
+	case SNAPSHOT_STRING_ALBUM_SORTNAME:		return EXTRA_SLOT (album_sortname);
+	case SNAPSHOT_STRING_TITLE_SORTNAME:		return EXTRA_SLOT (title_sortname);
+	case SNAPSHOT_STRING_ALBUM_ARTIST_SORTNAME:	return EXTRA_SLOT (album_artist_sortname);
+	case SNAPSHOT_STRING_LOCATION:			return &entry->location;
+	case SNAPSHOT_STRING_MOUNTPOINT:		return &entry->mountpoint;
+	case SNAPSHOT_STRING_MEDIA_TYPE:		return &entry->media_type;
+	case SNAPSHOT_STRING_DESCRIPTION:		return podcast ? &podcast->description : NULL;
+	case SNAPSHOT_STRING_SUBTITLE:			return podcast ? &podcast->subtitle : NULL;
+	case SNAPSHOT_STRING_LANG:			return podcast ? &podcast->lang : NULL;
+	case SNAPSHOT_STRING_COPYRIGHT:			return podcast ? &podcast->copyright : NULL;
+	case SNAPSHOT_STRING_IMAGE:			return podcast ? &podcast->image : NULL;
+	case SNAPSHOT_STRING_GUID:			return podcast ? &podcast->guid : NULL;
+	default:
+		g_assert_not_reached ();
+		return NULL;
+	}
+#undef EXTRA_SLOT
+}
+
+/**
+ * rhythmdb_snapshot_get_filename:
+ * @source: name of the XML database file
+ *
+ * Returns the name of the snapshot file stored alongside @source.
+ *
+ * Return value: snapshot file name, free with g_free
+ */
+char *
+rhythmdb_snapshot_get_filename (const char *source)
+{
+	if (g_str_has_suffix (source, ".xml")) {
+		char *base;
+		char *ret;
+
+		base = g_strndup (source, strlen (source) - strlen (".xml"));
+		ret = g_strconcat (base, ".snapshot", NULL);
+		g_free (base);
+		return ret;
+	}
+
+	return g_strconcat (source, ".snapshot", NULL);
+}
+
+static gboolean
+read_header (const char *filename, RhythmDBSnapshotHeader *header)
+{
+	FILE *f;
+	gboolean ret;
+
+	f = g_fopen (filename, "rb");
+	if (f == NULL)
+		return FALSE;
+
+	ret = (fread (header, sizeof (*header), 1, f) == 1);
+	fclose (f);
+	return ret;
+}
+
+static gboolean
+check_header (const RhythmDBSnapshotHeader *header)
+{
+	if (memcmp (header->magic, RHYTHMDB_SNAPSHOT_MAGIC, sizeof (header->magic)) != 0) {
+		rb_debug ("snapshot has bad magic");
+		return FALSE;
+	}
+	if (header->byte_order != RHYTHMDB_SNAPSHOT_BYTE_ORDER) {
+		rb_debug ("snapshot was written with a different byte order");
+		return FALSE;
+	}
+	if (header->version != RHYTHMDB_SNAPSHOT_VERSION ||
+	    header->record_size != sizeof (RhythmDBSnapshotRecord)) {
+		rb_debug ("snapshot version %u (record size %u) doesn't match",
+			  header->version, header->record_size);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * rhythmdb_snapshot_is_current:
+ * @filename: snapshot file name
+ * @source: XML database file name
+ *
+ * Checks whether the snapshot file exists, is in a format we can read,
+ * and was written at the same time as the XML file.
+ *
+ * Return value: %TRUE if the snapshot can be loaded instead of @source
+ */
+gboolean
+rhythmdb_snapshot_is_current (const char *filename, const char *source)
+{
+	RhythmDBSnapshotHeader header;
+	GStatBuf source_stat;
+
+	if (g_stat (source, &source_stat) != 0)
+		return FALSE;
+
+	if (read_header (filename, &header) == FALSE)
+		return FALSE;
+
+	if (check_header (&header) == FALSE)
+		return FALSE;
+
+	if (header.source_mtime != (gint64) source_stat.st_mtime ||
+	    header.source_size != (guint64) source_stat.st_size) {
+		rb_debug ("snapshot %s doesn't match %s", filename, source);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+range_valid (gsize length, guint64 offset, guint64 count, gsize size)
+{
+	if (offset > length)
+		return FALSE;
+	if (size > 0 && count > (length - offset) / size)
+		return FALSE;
+	return TRUE;
+}
+
+/**
+ * rhythmdb_snapshot_load:
+ * @db: the #RhythmDB
+ * @filename: snapshot file name
+ * @cancel: a #GCancellable
+ * @func: function to call for each entry
+ * @data: data to pass to @func
+ * @error: returns error information
+ *
+ * Reads entries from a snapshot file.  The whole file is validated
+ * before any entries are created, so if this fails, no entries will have
+ * been passed to @func and the caller can fall back to reading the XML file.
+ *
+ * Return value: %TRUE if the snapshot was loaded
+ */
+gboolean
+rhythmdb_snapshot_load (RhythmDB *db,
+			const char *filename,
+			GCancellable *cancel,
+			RhythmDBSnapshotEntryFunc func,
+			gpointer data,
+			GError **error)
+{
+	GMappedFile *mapped;
+	const char *contents;
+	gsize length;
+	const RhythmDBSnapshotHeader *header;
+	const RhythmDBSnapshotRecord *records;
+	const guint32 *keywords;
+	const guint32 *string_offsets;
+	const char *string_data;
+	RhythmDBEntryType **types;
+	RBRefString **interned;
+	guint32 i;
+	int s;
+
+	mapped = g_mapped_file_new (filename, FALSE, error);
+	if (mapped == NULL)
+		return FALSE;
+
+	contents = g_mapped_file_get_contents (mapped);
+	length = g_mapped_file_get_length (mapped);
+	header = (const RhythmDBSnapshotHeader *) contents;
+
+	if (length < sizeof (RhythmDBSnapshotHeader) || check_header (header) == FALSE) {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+			     "snapshot %s has an invalid header", filename);
+		g_mapped_file_unref (mapped);
+		return FALSE;
+	}
+
+	if (!range_valid (length, header->records_offset, header->entry_count, sizeof (RhythmDBSnapshotRecord)) ||
+	    !range_valid (length, header->keywords_offset, header->keyword_count, sizeof (guint32)) ||
+	    !range_valid (length, header->string_offsets_offset, header->string_count, sizeof (guint32)) ||
+	    !range_valid (length, header->string_data_offset, header->string_data_size, 1) ||
+	    (header->records_offset % 8) != 0 ||
+	    (header->keywords_offset % 4) != 0 ||
+	    (header->string_offsets_offset % 4) != 0 ||
+	    header->string_count == 0 ||
+	    header->string_data_size == 0 ||
+	    contents[header->string_data_offset + header->string_data_size - 1] != '\0') {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+			     "snapshot %s is truncated or corrupt", filename);
+		g_mapped_file_unref (mapped);
+		return FALSE;
+	}
+
+	records = (const RhythmDBSnapshotRecord *) (contents + header->records_offset);
+	keywords = (const guint32 *) (contents + header->keywords_offset);
+	string_offsets = (const guint32 *) (contents + header->string_offsets_offset);
+	string_data = contents + header->string_data_offset;
+
+	for (i = 1; i < header->string_count; i++) {
+		if (string_offsets[i] >= header->string_data_size)
+			goto corrupt;
+	}
+	for (i = 0; i < header->keyword_count; i++) {
+		if (keywords[i] == 0 || keywords[i] >= header->string_count)
+			goto corrupt;
+	}
+
+	/* check all the records and resolve entry types before creating any entries,
+	 * so we can still fall back to the XML file if an entry type isn't available.
+	 */
+	types = g_new0 (RhythmDBEntryType *, header->string_count);
+	for (i = 0; i < header->entry_count; i++) {
+		const RhythmDBSnapshotRecord *record = &records[i];
+
+		if (record->type == 0 || record->type >= header->string_count)
+			goto corrupt_types;
+		if (record->strings[SNAPSHOT_STRING_LOCATION] == 0)
+			goto corrupt_types;
+		for (s = 0; s < SNAPSHOT_NUM_STRINGS; s++) {
+			if (record->strings[s] >= header->string_count)
+				goto corrupt_types;
+		}
+		if (!range_valid (header->keyword_count, record->keyword_start, record->keyword_count, 1))
+			goto corrupt_types;
+
+		if (types[record->type] == NULL) {
+			const char *typename = string_data + string_offsets[record->type];
+
+			types[record->type] = rhythmdb_entry_type_get_by_name (db, typename);
+			if (types[record->type] == NULL) {
+				g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+					     "snapshot %s contains entries of unknown type %s",
+					     filename, typename);
+				g_free (types);
+				g_mapped_file_unref (mapped);
+				return FALSE;
+			}
+		}
+	}
+
+	rb_debug ("loading %u entries from snapshot %s", header->entry_count, filename);
+	interned = g_new0 (RBRefString *, header->string_count);
+	for (i = 0; i < header->entry_count; i++) {
+		const RhythmDBSnapshotRecord *record = &records[i];
+		RhythmDBPodcastFields *podcast;
+		RhythmDBEntry *entry;
+		guint32 k;
+
+		if ((i % RHYTHMDB_SNAPSHOT_CANCEL_CHECK) == 0 && g_cancellable_is_cancelled (cancel)) {
+			rb_debug ("snapshot load cancelled");
+			break;
+		}
+
+		entry = rhythmdb_entry_allocate (db, types[record->type]);
+		podcast = get_podcast_fields (entry);
+
+		for (s = 0; s < SNAPSHOT_NUM_STRINGS; s++) {
+			guint32 index = record->strings[s];
+			RBRefString **slot;
+
+			if (index == 0)
+				continue;
+
+			slot = get_string_slot (entry, podcast, s, FALSE);
+			if (slot == NULL)
+				continue;
+
+			if (interned[index] == NULL)
+				interned[index] = rb_refstring_new (string_data + string_offsets[index]);
+
+			/* mostly empty strings already set by rhythmdb_entry_allocate */
+			if (*slot == interned[index])
+				continue;
+
+			slot = get_string_slot (entry, podcast, s, TRUE);
+			rb_refstring_unref (*slot);
+			*slot = rb_refstring_ref (interned[index]);
+		}
+
+		entry->tracknum = MIN (record->tracknum, G_MAXUINT16);
+		entry->tracktotal = MIN (record->tracktotal, G_MAXUINT16);
+		entry->discnum = MIN (record->discnum, G_MAXUINT16);
+		entry->disctotal = MIN (record->disctotal, G_MAXUINT16);
+		entry->duration = record->duration;
+		entry->bitrate = record->bitrate;
+		if (record->bpm != 0.0)
+			rhythmdb_entry_get_writable_extra (entry)->bpm = record->bpm;
+		if (record->track_peak != 0.0 || record->album_peak != 0.0) {
+			RhythmDBEntryExtra *extra = rhythmdb_entry_get_writable_extra (entry);
+			extra->track_gain = record->track_gain;
+			extra->track_peak = record->track_peak;
+			extra->album_gain = record->album_gain;
+			extra->album_peak = record->album_peak;
+		}
+		if (record->date > 0)
+			g_date_set_julian (&entry->date, record->date);
+		else
+			g_date_clear (&entry->date, 1);
+
+		entry->file_size = record->file_size;
+		entry->mtime = record->mtime;
+		entry->first_seen = record->first_seen;
+		entry->last_seen = record->last_seen;
+		entry->rating = record->rating;
+		entry->play_count = record->play_count;
+		entry->last_played = record->last_played;
+
+		if (record->flags & RHYTHMDB_SNAPSHOT_FLAG_HIDDEN)
+			entry->flags |= RHYTHMDB_ENTRY_HIDDEN;
+
+		if (podcast != NULL) {
+			podcast->status = record->status;
+			podcast->post_time = record->post_time;
+		}
+
+		for (k = 0; k < record->keyword_count; k++) {
+			guint32 index = keywords[record->keyword_start + k];
+
+			if (interned[index] == NULL)
+				interned[index] = rb_refstring_new (string_data + string_offsets[index]);
+			rhythmdb_entry_keyword_add (db, entry, interned[index]);
+		}
+
+		func (entry, data);
+	}
+
+	for (i = 0; i < header->string_count; i++) {
+		rb_refstring_unref (interned[i]);
+	}
+	g_free (interned);
+	g_free (types);
+	g_mapped_file_unref (mapped);
+	return TRUE;
+
+corrupt_types:
+	g_free (types);
+corrupt:
+	g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+		     "snapshot %s is corrupt", filename);
+	g_mapped_file_unref (mapped);
+	return FALSE;
+}
+
+static void
+write_data (RhythmDBSnapshotWriter *writer, gconstpointer data, gsize size)
+{
+	if (writer->error != NULL)
+		return;
+
+	if (fwrite (data, 1, size, writer->handle) != size)
+		writer->error = g_strdup (g_strerror (errno));
+}
+
+static guint32
+add_string (RhythmDBSnapshotWriter *writer, RBRefString *str)
+{
+	gpointer index;
+
+	if (str == NULL)
+		return 0;
+
+	if (g_hash_table_lookup_extended (writer->string_map, str, NULL, &index))
+		return GPOINTER_TO_UINT (index);
+
+	g_ptr_array_add (writer->strings, rb_refstring_ref (str));
+	g_hash_table_insert (writer->string_map, str, GUINT_TO_POINTER (writer->strings->len - 1));
+	return writer->strings->len - 1;
+}
+
+/**
+ * rhythmdb_snapshot_writer_new:
+ * @db: the #RhythmDB
+ * @filename: snapshot file name
+ * @error: returns error information
+ *
+ * Starts writing a new snapshot.  Entries are written to a temporary
+ * file, which replaces @filename when rhythmdb_snapshot_writer_finish
+ * is called.
+ *
+ * Return value: a new snapshot writer, or NULL on error
+ */
+RhythmDBSnapshotWriter *
+rhythmdb_snapshot_writer_new (RhythmDB *db, const char *filename, GError **error)
+{
+	RhythmDBSnapshotWriter *writer;
+	RhythmDBSnapshotHeader header;
+
+	writer = g_new0 (RhythmDBSnapshotWriter, 1);
+	writer->db = db;
+	writer->filename = g_strdup (filename);
+	writer->tmpname = g_strconcat (filename, ".tmp", NULL);
+
+	writer->handle = g_fopen (writer->tmpname, "wb");
+	if (writer->handle == NULL) {
+		int err = errno;
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (err),
+			     "Unable to create %s: %s", writer->tmpname, g_strerror (err));
+		g_free (writer->filename);
+		g_free (writer->tmpname);
+		g_free (writer);
+		return NULL;
+	}
+
+	writer->string_map = g_hash_table_new (g_direct_hash, g_direct_equal);
+	writer->strings = g_ptr_array_new_with_free_func ((GDestroyNotify) rb_refstring_unref);
+	writer->keywords = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+	/* string index 0 means 'not set' */
+	g_ptr_array_add (writer->strings, NULL);
+
+	/* the real header is written once we know where everything is */
+	memset (&header, 0, sizeof (header));
+	write_data (writer, &header, sizeof (header));
+
+	return writer;
+}
+
+/**
+ * rhythmdb_snapshot_writer_add_entry:
+ * @writer: a #RhythmDBSnapshotWriter
+ * @entry: the entry to write
+ * @keywords: (element-type RBRefString): keywords for the entry
+ *
+ * Writes an entry to the snapshot.
+ */
+void
+rhythmdb_snapshot_writer_add_entry (RhythmDBSnapshotWriter *writer,
+				    RhythmDBEntry *entry,
+				    GList *keywords)
+{
+	RhythmDBSnapshotRecord record;
+	RhythmDBPodcastFields *podcast;
+	RBRefString *typename;
+	GList *l;
+	int s;
+
+	if (writer->error != NULL)
+		return;
+
+	memset (&record, 0, sizeof (record));
+	podcast = get_podcast_fields (entry);
+
+	typename = rb_refstring_new (rhythmdb_entry_type_get_name (entry->type));
+	record.type = add_string (writer, typename);
+	rb_refstring_unref (typename);
+
+	for (s = 0; s < SNAPSHOT_NUM_STRINGS; s++) {
+		RBRefString **slot = get_string_slot (entry, podcast, s, FALSE);
+		if (slot != NULL)
+			record.strings[s] = add_string (writer, *slot);
+	}
+
+	record.tracknum = entry->tracknum;
+	record.tracktotal = entry->tracktotal;
+	record.discnum = entry->discnum;
+	record.disctotal = entry->disctotal;
+	record.duration = entry->duration;
+	record.bitrate = entry->bitrate;
+	record.bpm = entry->extra->bpm;
+	record.track_gain = entry->extra->track_gain;
+	record.track_peak = entry->extra->track_peak;
+	record.album_gain = entry->extra->album_gain;
+	record.album_peak = entry->extra->album_peak;
+	if (g_date_valid (&entry->date))
+		record.date = g_date_get_julian (&entry->date);
+
+	record.file_size = entry->file_size;
+	record.mtime = entry->mtime;
+	record.first_seen = entry->first_seen;
+	record.last_seen = entry->last_seen;
+	record.rating = entry->rating;
+	record.play_count = entry->play_count;
+	record.last_played = entry->last_played;
+
+	if (entry->flags & RHYTHMDB_ENTRY_HIDDEN)
+		record.flags |= RHYTHMDB_SNAPSHOT_FLAG_HIDDEN;
+
+	if (podcast != NULL) {
+		record.status = podcast->status;
+		record.post_time = podcast->post_time;
+	}
+
+	record.keyword_start = writer->keywords->len;
+	for (l = keywords; l != NULL; l = l->next) {
+		guint32 index = add_string (writer, (RBRefString *) l->data);
+		g_array_append_val (writer->keywords, index);
+		record.keyword_count++;
+	}
+
+	write_data (writer, &record, sizeof (record));
+	writer->entry_count++;
+}
+
+static void
+free_writer (RhythmDBSnapshotWriter *writer)
+{
+	g_hash_table_destroy (writer->string_map);
+	g_ptr_array_free (writer->strings, TRUE);
+	g_array_free (writer->keywords, TRUE);
+	g_free (writer->filename);
+	g_free (writer->tmpname);
+	g_free (writer->error);
+	g_free (writer);
+}
+
+/**
+ * rhythmdb_snapshot_writer_abort:
+ * @writer: a #RhythmDBSnapshotWriter
+ *
+ * Discards the snapshot being written and frees the writer.
+ */
+void
+rhythmdb_snapshot_writer_abort (RhythmDBSnapshotWriter *writer)
+{
+	fclose (writer->handle);
+	g_unlink (writer->tmpname);
+	free_writer (writer);
+}
+
+/**
+ * rhythmdb_snapshot_writer_finish:
+ * @writer: a #RhythmDBSnapshotWriter
+ * @source: name of the XML file the snapshot was written alongside
+ * @error: returns error information
+ *
+ * Writes out the string table and header, replaces the existing snapshot
+ * file, and frees the writer.  @source must already have been written,
+ * as its size and modification time are recorded in the snapshot.
+ *
+ * Return value: %TRUE if the snapshot was written successfully
+ */
+gboolean
+rhythmdb_snapshot_writer_finish (RhythmDBSnapshotWriter *writer,
+				 const char *source,
+				 GError **error)
+{
+	RhythmDBSnapshotHeader header;
+	GStatBuf source_stat;
+	guint32 offset;
+	guint i;
+	long pos;
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, RHYTHMDB_SNAPSHOT_MAGIC, sizeof (header.magic));
+	header.version = RHYTHMDB_SNAPSHOT_VERSION;
+	header.byte_order = RHYTHMDB_SNAPSHOT_BYTE_ORDER;
+	header.record_size = sizeof (RhythmDBSnapshotRecord);
+	header.entry_count = writer->entry_count;
+	header.records_offset = sizeof (RhythmDBSnapshotHeader);
+
+	if (g_stat (source, &source_stat) == 0) {
+		header.source_mtime = source_stat.st_mtime;
+		header.source_size = source_stat.st_size;
+	} else if (writer->error == NULL) {
+		writer->error = g_strdup_printf ("unable to stat %s: %s", source, g_strerror (errno));
+	}
+
+	/* keyword references */
+	header.keywords_offset = header.records_offset + ((guint64) writer->entry_count * sizeof (RhythmDBSnapshotRecord));
+	header.keyword_count = writer->keywords->len;
+	write_data (writer, writer->keywords->data, writer->keywords->len * sizeof (guint32));
+
+	/* string offsets */
+	header.string_offsets_offset = header.keywords_offset + (writer->keywords->len * sizeof (guint32));
+	header.string_count = writer->strings->len;
+	offset = 0;
+	write_data (writer, &offset, sizeof (offset));
+	for (i = 1; i < writer->strings->len; i++) {
+		write_data (writer, &offset, sizeof (offset));
+		offset += strlen (rb_refstring_get (g_ptr_array_index (writer->strings, i))) + 1;
+	}
+
+	/* string data */
+	header.string_data_offset = header.string_offsets_offset + (writer->strings->len * sizeof (guint32));
+	header.string_data_size = offset;
+	for (i = 1; i < writer->strings->len; i++) {
+		const char *str = rb_refstring_get (g_ptr_array_index (writer->strings, i));
+		write_data (writer, str, strlen (str) + 1);
+	}
+
+	if (writer->error == NULL) {
+		pos = ftell (writer->handle);
+		if (pos < 0 || (guint64) pos != header.string_data_offset + header.string_data_size) {
+			writer->error = g_strdup ("snapshot size mismatch");
+		} else if (fseek (writer->handle, 0, SEEK_SET) != 0) {
+			writer->error = g_strdup (g_strerror (errno));
+		}
+	}
+	write_data (writer, &header, sizeof (header));
+
+	if (fclose (writer->handle) != 0 && writer->error == NULL) {
+		writer->error = g_strdup (g_strerror (errno));
+	}
+
+	if (writer->error == NULL && g_rename (writer->tmpname, writer->filename) != 0) {
+		writer->error = g_strdup_printf ("unable to rename %s: %s", writer->tmpname, g_strerror (errno));
+	}
+
+	if (writer->error != NULL) {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+			     "Writing snapshot %s failed: %s", writer->filename, writer->error);
+		g_unlink (writer->tmpname);
+		free_writer (writer);
+		return FALSE;
+	}
+
+	rb_debug ("wrote %u entries, %u strings to snapshot %s",
+		  header.entry_count, header.string_count, writer->filename);
+	free_writer (writer);
+	return TRUE;
+}
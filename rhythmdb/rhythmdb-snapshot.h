@@ -0,0 +1,71 @@
+/*
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+#ifndef RHYTHMDB_SNAPSHOT_H
+#define RHYTHMDB_SNAPSHOT_H
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <rhythmdb/rhythmdb.h>
+
+G_BEGIN_DECLS
+
+typedef struct _RhythmDBSnapshotWriter RhythmDBSnapshotWriter;
+
+/* called for each entry read from a snapshot; the callback takes ownership of the entry */
+typedef void (*RhythmDBSnapshotEntryFunc) (RhythmDBEntry *entry, gpointer data);
+
+char *		rhythmdb_snapshot_get_filename		(const char *source);
+
+gboolean	rhythmdb_snapshot_is_current		(const char *filename,
+							 const char *source);
+
+gboolean	rhythmdb_snapshot_load			(RhythmDB *db,
+							 const char *filename,
+							 GCancellable *cancel,
+							 RhythmDBSnapshotEntryFunc func,
+							 gpointer data,
+							 GError **error);
+
+RhythmDBSnapshotWriter *rhythmdb_snapshot_writer_new	(RhythmDB *db,
+							 const char *filename,
+							 GError **error);
+
+void		rhythmdb_snapshot_writer_add_entry	(RhythmDBSnapshotWriter *writer,
+							 RhythmDBEntry *entry,
+							 GList *keywords);
+
+gboolean	rhythmdb_snapshot_writer_finish		(RhythmDBSnapshotWriter *writer,
+							 const char *source,
+							 GError **error);
+
+void		rhythmdb_snapshot_writer_abort		(RhythmDBSnapshotWriter *writer);
+
+G_END_DECLS
+
+#endif /* RHYTHMDB_SNAPSHOT_H */
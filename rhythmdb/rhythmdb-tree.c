@@ -41,6 +41,7 @@
 #include <string.h>
 #include <math.h>
 #include <glib/gprintf.h>
+#include <glib/gstdio.h>
 #include <glib.h>
 #include <glib/gi18n.h>
 #include <gtk/gtk.h>
@@ -51,6 +52,10 @@
 #include "rhythmdb-private.h"
 #include "rhythmdb-tree.h"
 #include "rhythmdb-property-model.h"
+#include "rhythmdb-snapshot.h"
+#include "rhythmdb-search-index.h"
+#include "rhythmdb-numeric-index.h"
+#include "rhythmdb-query-plan.h"
 #include "rb-debug.h"
 #include "rb-util.h"
 #include "rb-file-helpers.h"
@@ -70,6 +75,14 @@ typedef struct RhythmDBTreeProperty
 G_DEFINE_TYPE(RhythmDBTree, rhythmdb_tree, RHYTHMDB_TYPE)
 
 static void rhythmdb_tree_finalize (GObject *object);
+static void rhythmdb_tree_set_property (GObject *object,
+					guint prop_id,
+					const GValue *value,
+					GParamSpec *pspec);
+static void rhythmdb_tree_get_property (GObject *object,
+					guint prop_id,
+					GValue *value,
+					GParamSpec *pspec);
 
 static gboolean rhythmdb_tree_load (RhythmDB *rdb, GCancellable *cancel, GError **error);
 static void rhythmdb_tree_save (RhythmDB *rdb);
@@ -132,6 +145,7 @@ static void remove_entry_from_keywords (RhythmDBTree *db, RhythmDBEntry *entry);
 static GList *split_query_by_disjunctions (RhythmDBTree *db, GPtrArray *query);
 static gboolean evaluate_conjunctive_subquery (RhythmDBTree *db, GPtrArray *query,
 					       guint base, guint max, RhythmDBEntry *entry);
+static void parallel_query_worker (gpointer data, gpointer user_data);
 
 struct RhythmDBTreePrivate
 {
@@ -145,9 +159,19 @@ struct RhythmDBTreePrivate
 	GHashTable *genres;
 	GMutex genres_lock; /* must be held while using the tree */
 
+	RhythmDBSearchIndex *search_index; /* protected by genres_lock */
+	gboolean use_search_index;
+	RhythmDBNumericIndex *numeric_index; /* protected by genres_lock */
+	gboolean use_numeric_index;
+
+	GThreadPool *query_pool;
+	guint query_threads;
+
 	GHashTable *unknown_entry_types;
 	gboolean finalizing;
 
+	gboolean use_snapshot;
+
 	guint idle_load_id;
 };
 
@@ -168,6 +192,23 @@ typedef struct
 enum
 {
 	PROP_0,
+	PROP_SNAPSHOT,
+	PROP_SEARCH_INDEX,
+	PROP_NUMERIC_INDEX,
+	PROP_QUERY_THREADS,
+};
+
+/* queries scanning fewer entries than this aren't worth splitting up */
+#define RHYTHMDB_TREE_PARALLEL_QUERY_MIN_ENTRIES	2048
+#define RHYTHMDB_TREE_PARALLEL_QUERY_MIN_TASK		256
+
+/* folded properties matched by RHYTHMDB_PROP_SEARCH_MATCH */
+static const RhythmDBPropType search_properties[] = {
+	RHYTHMDB_PROP_TITLE_FOLDED,
+	RHYTHMDB_PROP_ALBUM_FOLDED,
+	RHYTHMDB_PROP_ARTIST_FOLDED,
+	RHYTHMDB_PROP_COMPOSER_FOLDED,
+	RHYTHMDB_PROP_GENRE_FOLDED
 };
 
 const int RHYTHMDB_TREE_PARSER_INITIAL_BUFFER_SIZE = 512;
@@ -189,6 +230,8 @@ rhythmdb_tree_class_init (RhythmDBTreeClass *klass)
 	RhythmDBClass *rhythmdb_class = RHYTHMDB_CLASS (klass);
 
 	object_class->finalize = rhythmdb_tree_finalize;
+	object_class->set_property = rhythmdb_tree_set_property;
+	object_class->get_property = rhythmdb_tree_get_property;
 
 	rhythmdb_class->impl_load = rhythmdb_tree_load;
 	rhythmdb_class->impl_save = rhythmdb_tree_save;
@@ -210,6 +253,67 @@ rhythmdb_tree_class_init (RhythmDBTreeClass *klass)
 	rhythmdb_class->impl_do_full_query = rhythmdb_tree_do_full_query;
 	rhythmdb_class->impl_entry_type_registered = rhythmdb_tree_entry_type_registered;
 
+	/**
+	 * RhythmDBTree:snapshot:
+	 *
+	 * If %TRUE, a binary snapshot of the database is written alongside
+	 * the XML file on each save, and is loaded instead of the XML file
+	 * if it is up to date.
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_SNAPSHOT,
+					 g_param_spec_boolean ("snapshot",
+							       "snapshot",
+							       "whether to use a binary snapshot",
+							       TRUE,
+							       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * RhythmDBTree:search-index:
+	 *
+	 * If %TRUE, queries containing substring matches on the search
+	 * properties use the trigram index to find candidate entries rather
+	 * than checking every entry.  The index is maintained either way.
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_SEARCH_INDEX,
+					 g_param_spec_boolean ("search-index",
+							       "search-index",
+							       "whether to use the search index for queries",
+							       TRUE,
+							       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * RhythmDBTree:numeric-index:
+	 *
+	 * If %TRUE, queries containing range criteria on rating, play count,
+	 * last played time, first seen time or duration use the sorted
+	 * numeric index to find candidate entries when the range is small
+	 * enough.  The index is maintained either way.
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_NUMERIC_INDEX,
+					 g_param_spec_boolean ("numeric-index",
+							       "numeric-index",
+							       "whether to use the numeric index for queries",
+							       TRUE,
+							       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * RhythmDBTree:query-threads:
+	 *
+	 * Number of threads to use to evaluate queries that scan large
+	 * parts of the database.  If 0, one thread per processor is used.
+	 * If 1, queries are evaluated entirely on the query thread.
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_QUERY_THREADS,
+					 g_param_spec_uint ("query-threads",
+							    "query-threads",
+							    "number of threads to use for queries",
+							    0, G_MAXINT, 0,
+							    G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
 	g_type_class_add_private (klass, sizeof (RhythmDBTreePrivate));
 }
 
@@ -228,6 +332,72 @@ rhythmdb_tree_init (RhythmDBTree *db)
 						  NULL, (GDestroyNotify)g_hash_table_destroy);
 
 	db->priv->unknown_entry_types = g_hash_table_new (rb_refstring_hash, rb_refstring_equal);
+
+	db->priv->search_index = rhythmdb_search_index_new ();
+	db->priv->numeric_index = rhythmdb_numeric_index_new ();
+	db->priv->query_pool = g_thread_pool_new (parallel_query_worker, db,
+						  g_get_num_processors (), FALSE, NULL);
+
+	db->priv->use_snapshot = TRUE;
+	db->priv->use_search_index = TRUE;
+	db->priv->use_numeric_index = TRUE;
+}
+
+static void
+rhythmdb_tree_set_property (GObject *object,
+			    guint prop_id,
+			    const GValue *value,
+			    GParamSpec *pspec)
+{
+	RhythmDBTree *db = RHYTHMDB_TREE (object);
+
+	switch (prop_id) {
+	case PROP_SNAPSHOT:
+		db->priv->use_snapshot = g_value_get_boolean (value);
+		break;
+	case PROP_SEARCH_INDEX:
+		db->priv->use_search_index = g_value_get_boolean (value);
+		break;
+	case PROP_NUMERIC_INDEX:
+		db->priv->use_numeric_index = g_value_get_boolean (value);
+		break;
+	case PROP_QUERY_THREADS:
+		db->priv->query_threads = g_value_get_uint (value);
+		g_thread_pool_set_max_threads (db->priv->query_pool,
+					       db->priv->query_threads ? db->priv->query_threads : g_get_num_processors (),
+					       NULL);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+		break;
+	}
+}
+
+static void
+rhythmdb_tree_get_property (GObject *object,
+			    guint prop_id,
+			    GValue *value,
+			    GParamSpec *pspec)
+{
+	RhythmDBTree *db = RHYTHMDB_TREE (object);
+
+	switch (prop_id) {
+	case PROP_SNAPSHOT:
+		g_value_set_boolean (value, db->priv->use_snapshot);
+		break;
+	case PROP_SEARCH_INDEX:
+		g_value_set_boolean (value, db->priv->use_search_index);
+		break;
+	case PROP_NUMERIC_INDEX:
+		g_value_set_boolean (value, db->priv->use_numeric_index);
+		break;
+	case PROP_QUERY_THREADS:
+		g_value_set_uint (value, db->priv->query_threads);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+		break;
+	}
 }
 
 /* must be called with the genres lock held */
@@ -281,8 +451,14 @@ rhythmdb_tree_finalize (GObject *object)
 
 	db->priv->finalizing = TRUE;
 
+	g_thread_pool_free (db->priv->query_pool, FALSE, TRUE);
+
 	g_mutex_lock (&db->priv->genres_lock);
 	g_hash_table_foreach (db->priv->entries, (GHFunc) unparent_entries, db);
+	rhythmdb_search_index_free (db->priv->search_index);
+	db->priv->search_index = NULL;
+	rhythmdb_numeric_index_free (db->priv->numeric_index);
+	db->priv->numeric_index = NULL;
 	g_mutex_unlock (&db->priv->genres_lock);
 
 	g_hash_table_destroy (db->priv->entries);
@@ -331,6 +507,15 @@ struct RhythmDBTreeLoadContext
 	guint update_local_mountpoints : 1;
 };
 
+/* commits the current batch of loaded entries so they become visible */
+static void
+rhythmdb_tree_load_commit (struct RhythmDBTreeLoadContext *ctx)
+{
+	rhythmdb_commit (RHYTHMDB (ctx->db));
+	rhythmdb_load_batch_committed (RHYTHMDB (ctx->db), ctx->batch_count);
+	ctx->batch_count = 0;
+}
+
 /* Returns the version as an int, multiplied by 100,
  * eg. "1.4" becomes 140 */
 static int
@@ -575,10 +760,8 @@ rhythmdb_tree_parser_end_element (struct RhythmDBTreeLoadContext *ctx,
 			if (entry == NULL) {
 				rhythmdb_tree_entry_new_internal (RHYTHMDB (ctx->db), ctx->entry);
 				rhythmdb_entry_insert (RHYTHMDB (ctx->db), ctx->entry);
-				if (++ctx->batch_count == RHYTHMDB_QUERY_MODEL_SUGGESTED_UPDATE_CHUNK) {
-					rhythmdb_commit (RHYTHMDB (ctx->db));
-					ctx->batch_count = 0;
-				}
+				if (++ctx->batch_count == RHYTHMDB_QUERY_MODEL_SUGGESTED_UPDATE_CHUNK)
+					rhythmdb_tree_load_commit (ctx);
 			} else if (ctx->entry->type == RHYTHMDB_ENTRY_TYPE_PODCAST_POST &&
 				   entry->type == RHYTHMDB_ENTRY_TYPE_SONG) {
 				rb_debug ("found song entry with duplicate location for Podcast post %s. merging metadata",
@@ -598,14 +781,17 @@ rhythmdb_tree_parser_end_element (struct RhythmDBTreeLoadContext *ctx,
 				/* And add the Podcast entry to the database */
 				rhythmdb_tree_entry_new_internal (RHYTHMDB (ctx->db), ctx->entry);
 				rhythmdb_entry_insert (RHYTHMDB (ctx->db), ctx->entry);
-				if (++ctx->batch_count == RHYTHMDB_QUERY_MODEL_SUGGESTED_UPDATE_CHUNK) {
-					rhythmdb_commit (RHYTHMDB (ctx->db));
-					ctx->batch_count = 0;
-				}
+				if (++ctx->batch_count == RHYTHMDB_QUERY_MODEL_SUGGESTED_UPDATE_CHUNK)
+					rhythmdb_tree_load_commit (ctx);
 			} else {
 				rb_debug ("found entry with duplicate location %s. merging metadata",
 					  rb_refstring_get (ctx->entry->location));
 
+				/* the merged properties are indexed, so take the
+				 * entry out of the numeric index while changing them */
+				g_mutex_lock (&ctx->db->priv->genres_lock);
+				rhythmdb_numeric_index_remove (ctx->db->priv->numeric_index, entry);
+
 				entry->play_count += ctx->entry->play_count;
 
 				if (entry->rating < 0.01)
@@ -622,6 +808,9 @@ rhythmdb_tree_parser_end_element (struct RhythmDBTreeLoadContext *ctx,
 				if (ctx->entry->last_seen > entry->last_seen)
 					entry->last_seen = ctx->entry->last_seen;
 
+				rhythmdb_numeric_index_add (ctx->db->priv->numeric_index, entry);
+				g_mutex_unlock (&ctx->db->priv->genres_lock);
+
 				rhythmdb_entry_unref (ctx->entry);
 			}
 			g_mutex_unlock (&ctx->db->priv->entries_lock);
@@ -670,11 +859,6 @@ rhythmdb_tree_parser_end_element (struct RhythmDBTreeLoadContext *ctx,
 				set = TRUE;
 			}
 			break;
-			/* drop replaygain properties */
-		case RHYTHMDB_PROP_TRACK_GAIN:
-		case RHYTHMDB_PROP_TRACK_PEAK:
-		case RHYTHMDB_PROP_ALBUM_GAIN:
-		case RHYTHMDB_PROP_ALBUM_PEAK:
 		case RHYTHMDB_PROP_SUMMARY:
 			skip = TRUE;
 			break;
@@ -750,6 +934,52 @@ rhythmdb_tree_parser_characters (struct RhythmDBTreeLoadContext *ctx,
 	}
 }
 
+static void
+rhythmdb_tree_load_snapshot_entry (RhythmDBEntry *entry,
+				   struct RhythmDBTreeLoadContext *ctx)
+{
+	g_mutex_lock (&ctx->db->priv->entries_lock);
+	if (g_hash_table_lookup (ctx->db->priv->entries, entry->location) == NULL) {
+		rhythmdb_tree_entry_new_internal (RHYTHMDB (ctx->db), entry);
+		rhythmdb_entry_insert (RHYTHMDB (ctx->db), entry);
+		if (++ctx->batch_count == RHYTHMDB_QUERY_MODEL_SUGGESTED_UPDATE_CHUNK)
+			rhythmdb_tree_load_commit (ctx);
+	} else {
+		rb_debug ("found entry with duplicate location %s in snapshot",
+			  rb_refstring_get (entry->location));
+		rhythmdb_entry_unref (entry);
+	}
+	g_mutex_unlock (&ctx->db->priv->entries_lock);
+}
+
+static gboolean
+rhythmdb_tree_load_snapshot (RhythmDBTree *db,
+			     const char *name,
+			     struct RhythmDBTreeLoadContext *ctx)
+{
+	GError *error = NULL;
+	char *snapshot;
+	gboolean ret = FALSE;
+
+	snapshot = rhythmdb_snapshot_get_filename (name);
+	if (rhythmdb_snapshot_is_current (snapshot, name)) {
+		rb_profile_start ("loading db snapshot");
+		ret = rhythmdb_snapshot_load (RHYTHMDB (db),
+					      snapshot,
+					      ctx->cancel,
+					      (RhythmDBSnapshotEntryFunc) rhythmdb_tree_load_snapshot_entry,
+					      ctx,
+					      &error);
+		rb_profile_end ("loading db snapshot");
+		if (ret == FALSE) {
+			rb_debug ("unable to load snapshot, reading XML instead: %s", error->message);
+			g_clear_error (&error);
+		}
+	}
+	g_free (snapshot);
+	return ret;
+}
+
 static gboolean
 rhythmdb_tree_load (RhythmDB *rdb,
 		    GCancellable *cancel,
@@ -780,7 +1010,10 @@ rhythmdb_tree_load (RhythmDB *rdb,
 
 	g_object_get (G_OBJECT (db), "name", &name, NULL);
 
-	if (g_file_test (name, G_FILE_TEST_EXISTS)) {
+	if (db->priv->use_snapshot && rhythmdb_tree_load_snapshot (db, name, ctx)) {
+		if (ctx->batch_count)
+			rhythmdb_tree_load_commit (ctx);
+	} else if (g_file_test (name, G_FILE_TEST_EXISTS)) {
 		ctxt = xmlCreateFileParserCtxt (name);
 		ctx->xmlctx = ctxt;
 		xmlFree (ctxt->sax);
@@ -791,7 +1024,7 @@ rhythmdb_tree_load (RhythmDB *rdb,
 		xmlFreeParserCtxt (ctxt);
 
 		if (ctx->batch_count)
-			rhythmdb_commit (RHYTHMDB (ctx->db));
+			rhythmdb_tree_load_commit (ctx);
 	}
 
 	ret = TRUE;
@@ -813,6 +1046,7 @@ struct RhythmDBTreeSaveContext
 	RhythmDBTree *db;
 	FILE *handle;
 	char *error;
+	RhythmDBSnapshotWriter *snapshot;
 };
 
 #ifdef HAVE_GNU_FWRITE_UNLOCKED
@@ -974,6 +1208,8 @@ save_entry (RhythmDBTree *db,
 	    entry->type == RHYTHMDB_ENTRY_TYPE_PODCAST_POST)
 		podcast = RHYTHMDB_ENTRY_GET_TYPE_DATA (entry, RhythmDBPodcastFields);
 
+	keywords = rhythmdb_entry_keywords_get (RHYTHMDB (db), entry);
+
 	RHYTHMDB_FWRITE_STATICSTR ("  <entry type=\"", ctx->handle, ctx->error);
 	encoded	= xmlEncodeEntitiesReentrant (NULL, BAD_CAST rhythmdb_entry_type_get_name (entry->type));
 	RHYTHMDB_FWRITE (encoded, 1, xmlStrlen (encoded), ctx->handle, ctx->error);
@@ -986,7 +1222,7 @@ save_entry (RhythmDBTree *db,
 		const xmlChar *elt_name;
 
 		if (ctx->error)
-			return;
+			break;
 
 		elt_name = rhythmdb_nice_elt_name_from_propid ((RhythmDB *) ctx->db, i);
 
@@ -1005,7 +1241,7 @@ save_entry (RhythmDBTree *db,
 			save_entry_string(ctx, elt_name, rb_refstring_get (entry->artist));
 			break;
 		case RHYTHMDB_PROP_COMPOSER:
-			save_entry_string_if_set(ctx, elt_name, rb_refstring_get (entry->composer));
+			save_entry_string_if_set(ctx, elt_name, rb_refstring_get (entry->extra->composer));
 			break;
 		case RHYTHMDB_PROP_ALBUM_ARTIST:
 			save_entry_string_if_set(ctx, elt_name, rb_refstring_get (entry->album_artist));
@@ -1014,34 +1250,34 @@ save_entry (RhythmDBTree *db,
 			save_entry_string(ctx, elt_name, rb_refstring_get (entry->genre));
 			break;
 		case RHYTHMDB_PROP_COMMENT:
-			save_entry_string_if_set(ctx, elt_name, rb_refstring_get (entry->comment));
+			save_entry_string_if_set(ctx, elt_name, rb_refstring_get (entry->extra->comment));
 			break;
 		case RHYTHMDB_PROP_MUSICBRAINZ_TRACKID:
-			save_entry_string_if_set (ctx, elt_name, rb_refstring_get (entry->musicbrainz_trackid));
+			save_entry_string_if_set (ctx, elt_name, rb_refstring_get (entry->extra->musicbrainz_trackid));
 			break;
 		case RHYTHMDB_PROP_MUSICBRAINZ_ARTISTID:
-			save_entry_string_if_set (ctx, elt_name, rb_refstring_get (entry->musicbrainz_artistid));
+			save_entry_string_if_set (ctx, elt_name, rb_refstring_get (entry->extra->musicbrainz_artistid));
 			break;
 		case RHYTHMDB_PROP_MUSICBRAINZ_ALBUMID:
-			save_entry_string_if_set (ctx, elt_name, rb_refstring_get (entry->musicbrainz_albumid));
+			save_entry_string_if_set (ctx, elt_name, rb_refstring_get (entry->extra->musicbrainz_albumid));
 			break;
 		case RHYTHMDB_PROP_MUSICBRAINZ_ALBUMARTISTID:
-			save_entry_string_if_set (ctx, elt_name, rb_refstring_get (entry->musicbrainz_albumartistid));
+			save_entry_string_if_set (ctx, elt_name, rb_refstring_get (entry->extra->musicbrainz_albumartistid));
 			break;
 		case RHYTHMDB_PROP_ARTIST_SORTNAME:
-			save_entry_string_if_set (ctx, elt_name, rb_refstring_get (entry->artist_sortname));
+			save_entry_string_if_set (ctx, elt_name, rb_refstring_get (entry->extra->artist_sortname));
 			break;
 		case RHYTHMDB_PROP_COMPOSER_SORTNAME:
-			save_entry_string_if_set (ctx, elt_name, rb_refstring_get (entry->composer_sortname));
+			save_entry_string_if_set (ctx, elt_name, rb_refstring_get (entry->extra->composer_sortname));
 			break;
 		case RHYTHMDB_PROP_ALBUM_SORTNAME:
-			save_entry_string_if_set (ctx, elt_name, rb_refstring_get (entry->album_sortname));
+			save_entry_string_if_set (ctx, elt_name, rb_refstring_get (entry->extra->album_sortname));
 			break;
 		case RHYTHMDB_PROP_TITLE_SORTNAME:
-			save_entry_string_if_set (ctx, elt_name, rb_refstring_get (entry->title_sortname));
+			save_entry_string_if_set (ctx, elt_name, rb_refstring_get (entry->extra->title_sortname));
 			break;
 		case RHYTHMDB_PROP_ALBUM_ARTIST_SORTNAME:
-			save_entry_string_if_set (ctx, elt_name, rb_refstring_get (entry->album_artist_sortname));
+			save_entry_string_if_set (ctx, elt_name, rb_refstring_get (entry->extra->album_artist_sortname));
 			break;
 		case RHYTHMDB_PROP_TRACK_NUMBER:
 			save_entry_ulong (ctx, elt_name, entry->tracknum, FALSE);
@@ -1071,7 +1307,21 @@ save_entry (RhythmDBTree *db,
 			save_entry_string(ctx, elt_name, rb_refstring_get (entry->location));
 			break;
 		case RHYTHMDB_PROP_BPM:
-			save_entry_double(ctx, elt_name, entry->bpm);
+			save_entry_double(ctx, elt_name, entry->extra->bpm);
+			break;
+		case RHYTHMDB_PROP_TRACK_GAIN:
+			if (entry->extra->track_peak > 0.0)
+				save_entry_double (ctx, elt_name, entry->extra->track_gain);
+			break;
+		case RHYTHMDB_PROP_TRACK_PEAK:
+			save_entry_double (ctx, elt_name, entry->extra->track_peak);
+			break;
+		case RHYTHMDB_PROP_ALBUM_GAIN:
+			if (entry->extra->album_peak > 0.0)
+				save_entry_double (ctx, elt_name, entry->extra->album_gain);
+			break;
+		case RHYTHMDB_PROP_ALBUM_PEAK:
+			save_entry_double (ctx, elt_name, entry->extra->album_peak);
 			break;
 		case RHYTHMDB_PROP_MOUNTPOINT:
 			save_entry_string_if_set (ctx, elt_name, rb_refstring_get (entry->mountpoint));
@@ -1139,8 +1389,6 @@ save_entry (RhythmDBTree *db,
 				save_entry_string(ctx, elt_name, rb_refstring_get (podcast->guid));
 			break;
 		case RHYTHMDB_PROP_KEYWORD:
-			keywords = rhythmdb_entry_keywords_get (RHYTHMDB (db), entry);
-
 			for (l = keywords; l != NULL; l = g_list_next (l)) {
 				RBRefString *keyword = (RBRefString*)l->data;
 
@@ -1149,11 +1397,7 @@ save_entry (RhythmDBTree *db,
 				RHYTHMDB_FWRITE (encoded, 1, xmlStrlen (encoded), ctx->handle, ctx->error);
 				g_free (encoded);
 				RHYTHMDB_FWRITE_STATICSTR ("</keyword>\n", ctx->handle, ctx->error);
-
-				rb_refstring_unref (keyword);
 			}
-
-			g_list_free (keywords);
 			break;
 		case RHYTHMDB_PROP_TITLE_SORT_KEY:
 		case RHYTHMDB_PROP_GENRE_SORT_KEY:
@@ -1184,11 +1428,6 @@ save_entry (RhythmDBTree *db,
 		case RHYTHMDB_PROP_SEARCH_MATCH:
 		case RHYTHMDB_PROP_YEAR:
 		case RHYTHMDB_NUM_PROPERTIES:
-		/* obsolete replaygain properties */
-		case RHYTHMDB_PROP_TRACK_GAIN:
-		case RHYTHMDB_PROP_TRACK_PEAK:
-		case RHYTHMDB_PROP_ALBUM_GAIN:
-		case RHYTHMDB_PROP_ALBUM_PEAK:
 		/* obsolete podcast properties */
 		case RHYTHMDB_PROP_SUMMARY:
 			break;
@@ -1196,6 +1435,11 @@ save_entry (RhythmDBTree *db,
 	}
 
 	RHYTHMDB_FWRITE_STATICSTR ("  </entry>\n", ctx->handle, ctx->error);
+
+	if (ctx->snapshot != NULL && ctx->error == NULL)
+		rhythmdb_snapshot_writer_add_entry (ctx->snapshot, entry, keywords);
+
+	g_list_free_full (keywords, (GDestroyNotify) rb_refstring_unref);
 }
 
 static void
@@ -1253,11 +1497,14 @@ rhythmdb_tree_save (RhythmDB *rdb)
 {
 	RhythmDBTree *db = RHYTHMDB_TREE (rdb);
 	char *name;
+	char *snapshot;
 	GString *savepath;
 	FILE *f;
 	struct RhythmDBTreeSaveContext ctx;
+	GError *error = NULL;
 
 	g_object_get (G_OBJECT (db), "name", &name, NULL);
+	snapshot = rhythmdb_snapshot_get_filename (name);
 
 	savepath = g_string_new (name);
 	g_string_append (savepath, ".tmp");
@@ -1272,6 +1519,22 @@ rhythmdb_tree_save (RhythmDB *rdb)
 	ctx.db = db;
 	ctx.handle = f;
 	ctx.error = NULL;
+	ctx.snapshot = NULL;
+
+	/* entries of unknown types can't be stored in the snapshot, so
+	 * only write one if there aren't any.
+	 */
+	g_mutex_lock (&db->priv->entries_lock);
+	if (db->priv->use_snapshot && g_hash_table_size (db->priv->unknown_entry_types) == 0) {
+		ctx.snapshot = rhythmdb_snapshot_writer_new (rdb, snapshot, &error);
+		if (ctx.snapshot == NULL) {
+			rb_debug ("not writing snapshot: %s", error->message);
+			g_clear_error (&error);
+		}
+	}
+	g_mutex_unlock (&db->priv->entries_lock);
+	if (ctx.snapshot == NULL)
+		g_unlink (snapshot);
 	RHYTHMDB_FWRITE_STATICSTR ("<?xml version=\"1.0\" standalone=\"yes\"?>\n"
 				   "<rhythmdb version=\"" RHYTHMDB_TREE_XML_VERSION "\">\n",
 				   ctx.handle, ctx.error);
@@ -1290,6 +1553,9 @@ rhythmdb_tree_save (RhythmDB *rdb)
 			   savepath->str,
 			   g_strerror (errno));
 		unlink (savepath->str);
+		if (ctx.snapshot != NULL)
+			rhythmdb_snapshot_writer_abort (ctx.snapshot);
+		g_free (ctx.error);
 		goto out;
 	}
 
@@ -1297,17 +1563,36 @@ rhythmdb_tree_save (RhythmDB *rdb)
 		g_warning ("Writing to the database failed: %s", ctx.error);
 		g_free (ctx.error);
 		unlink (savepath->str);
+		if (ctx.snapshot != NULL)
+			rhythmdb_snapshot_writer_abort (ctx.snapshot);
 	} else {
 		if (rename (savepath->str, name) < 0) {
 			g_warning ("Couldn't rename %s to %s: %s",
 				   name, savepath->str,
 				   g_strerror (errno));
 			unlink (savepath->str);
+			if (ctx.snapshot != NULL)
+				rhythmdb_snapshot_writer_abort (ctx.snapshot);
+		} else {
+			/* everything journaled before the save started is now in the XML file */
+			if (rdb->priv->journal != NULL)
+				rhythmdb_journal_compacted (rdb->priv->journal);
+
+			/* the snapshot records the size and mtime of the XML file,
+			 * so it has to be finished after the XML file is in place.
+			 */
+			if (ctx.snapshot != NULL &&
+			    rhythmdb_snapshot_writer_finish (ctx.snapshot, name, &error) == FALSE) {
+				g_warning ("%s", error->message);
+				g_clear_error (&error);
+				g_unlink (snapshot);
+			}
 		}
 	}
 
 out:
 	g_string_free (savepath, TRUE);
+	g_free (snapshot);
 	g_free (name);
 	return;
 }
@@ -1341,6 +1626,77 @@ set_entry_album (RhythmDBTree *db,
 	entry->data = prop;
 }
 
+/* fills in the folded search strings for an entry, skipping unset properties */
+static void
+get_search_strings (RhythmDB *db,
+		    RhythmDBEntry *entry,
+		    RhythmDBPropType replace_prop,
+		    const char *replace_value,
+		    const char **strings)
+{
+	guint i;
+	guint n = 0;
+
+	for (i = 0; i < G_N_ELEMENTS (search_properties); i++) {
+		const char *s;
+
+		if (search_properties[i] == replace_prop)
+			s = replace_value;
+		else
+			s = rhythmdb_entry_get_string (entry, search_properties[i]);
+
+		if (s != NULL)
+			strings[n++] = s;
+	}
+	strings[n] = NULL;
+}
+
+/* must be called with the genres_lock held */
+static void
+update_search_index (RhythmDBTree *db,
+		     RhythmDBEntry *entry,
+		     RhythmDBPropType folded_prop,
+		     const char *value)
+{
+	const char *old_strings[G_N_ELEMENTS (search_properties) + 1];
+	const char *new_strings[G_N_ELEMENTS (search_properties) + 1];
+	char *folded;
+
+	rb_assert_locked (&db->priv->genres_lock);
+
+	folded = rb_search_fold (value);
+	get_search_strings (RHYTHMDB (db), entry, RHYTHMDB_NUM_PROPERTIES, NULL, old_strings);
+	get_search_strings (RHYTHMDB (db), entry, folded_prop, folded, new_strings);
+	rhythmdb_search_index_update (db->priv->search_index, entry, old_strings, new_strings);
+	g_free (folded);
+}
+
+/* must be called with the genres_lock held */
+static void
+add_to_search_index (RhythmDBTree *db,
+		     RhythmDBEntry *entry)
+{
+	const char *strings[G_N_ELEMENTS (search_properties) + 1];
+
+	rb_assert_locked (&db->priv->genres_lock);
+
+	get_search_strings (RHYTHMDB (db), entry, RHYTHMDB_NUM_PROPERTIES, NULL, strings);
+	rhythmdb_search_index_update (db->priv->search_index, entry, NULL, strings);
+}
+
+/* must be called with the genres_lock held */
+static void
+remove_from_search_index (RhythmDBTree *db,
+			  RhythmDBEntry *entry)
+{
+	const char *strings[G_N_ELEMENTS (search_properties) + 1];
+
+	rb_assert_locked (&db->priv->genres_lock);
+
+	get_search_strings (RHYTHMDB (db), entry, RHYTHMDB_NUM_PROPERTIES, NULL, strings);
+	rhythmdb_search_index_update (db->priv->search_index, entry, strings, NULL);
+}
+
 static void
 rhythmdb_tree_entry_new (RhythmDB *rdb,
 			 RhythmDBEntry *entry)
@@ -1389,6 +1745,8 @@ rhythmdb_tree_entry_new_internal (RhythmDB *rdb, RhythmDBEntry *entry)
 	genre = get_or_create_genre (db, entry->type, entry->genre);
 	artist = get_or_create_artist (db, genre, entry->artist);
 	set_entry_album (db, entry, artist, entry->album);
+	add_to_search_index (db, entry);
+	rhythmdb_numeric_index_add (db->priv->numeric_index, entry);
 	g_mutex_unlock (&db->priv->genres_lock);
 
 	/* this accounts for the initial reference on the entry */
@@ -1649,6 +2007,7 @@ rhythmdb_tree_entry_set (RhythmDB *adb,
 			rb_refstring_ref (entry->album);
 
 			g_mutex_lock (&db->priv->genres_lock);
+			update_search_index (db, entry, RHYTHMDB_PROP_ALBUM_FOLDED, albumname);
 			remove_entry_from_album (db, entry);
 			genre = get_or_create_genre (db, type, entry->genre);
 			artist = get_or_create_artist (db, genre, entry->artist);
@@ -1674,6 +2033,7 @@ rhythmdb_tree_entry_set (RhythmDB *adb,
 			rb_refstring_ref (entry->album);
 
 			g_mutex_lock (&db->priv->genres_lock);
+			update_search_index (db, entry, RHYTHMDB_PROP_ARTIST_FOLDED, artistname);
 			remove_entry_from_album (db, entry);
 			genre = get_or_create_genre (db, type, entry->genre);
 			new_artist = get_or_create_artist (db, genre,
@@ -1700,6 +2060,7 @@ rhythmdb_tree_entry_set (RhythmDB *adb,
 			rb_refstring_ref (entry->album);
 
 			g_mutex_lock (&db->priv->genres_lock);
+			update_search_index (db, entry, RHYTHMDB_PROP_GENRE_FOLDED, genrename);
 			remove_entry_from_album (db, entry);
 			new_genre = get_or_create_genre (db, type,
 							 rb_refstring_new (genrename));
@@ -1713,6 +2074,27 @@ rhythmdb_tree_entry_set (RhythmDB *adb,
 		}
 		break;
 	}
+	case RHYTHMDB_PROP_TITLE:
+	case RHYTHMDB_PROP_COMPOSER:
+	{
+		const char *str = g_value_get_string (value);
+
+		g_mutex_lock (&db->priv->genres_lock);
+		update_search_index (db, entry,
+				     (propid == RHYTHMDB_PROP_TITLE) ? RHYTHMDB_PROP_TITLE_FOLDED : RHYTHMDB_PROP_COMPOSER_FOLDED,
+				     str);
+		g_mutex_unlock (&db->priv->genres_lock);
+		break;
+	}
+	case RHYTHMDB_PROP_RATING:
+	case RHYTHMDB_PROP_PLAY_COUNT:
+	case RHYTHMDB_PROP_LAST_PLAYED:
+	case RHYTHMDB_PROP_FIRST_SEEN:
+	case RHYTHMDB_PROP_DURATION:
+		g_mutex_lock (&db->priv->genres_lock);
+		rhythmdb_numeric_index_update (db->priv->numeric_index, entry, propid, value);
+		g_mutex_unlock (&db->priv->genres_lock);
+		break;
 	default:
 		break;
 	}
@@ -1728,6 +2110,8 @@ rhythmdb_tree_entry_delete (RhythmDB *adb,
 
 	g_mutex_lock (&db->priv->genres_lock);
 	remove_entry_from_album (db, entry);
+	remove_from_search_index (db, entry);
+	rhythmdb_numeric_index_remove (db->priv->numeric_index, entry);
 	g_mutex_unlock (&db->priv->genres_lock);
 
 	/* remove all keywords */
@@ -1768,6 +2152,8 @@ remove_one_song (gpointer key,
 		remove_entry_from_keywords (db, entry);
 		g_mutex_unlock (&db->priv->keywords_lock);
 		remove_entry_from_album (db, entry);
+		remove_from_search_index (db, entry);
+		rhythmdb_numeric_index_remove (db->priv->numeric_index, entry);
 		g_hash_table_remove (db->priv->entry_ids, GINT_TO_POINTER (entry->id));
 		entry->flags |= RHYTHMDB_ENTRY_TREE_REMOVED;
 		rhythmdb_entry_unref (entry);
@@ -1810,11 +2196,32 @@ struct RhythmDBTreeTraversalData
 {
 	RhythmDBTree *db;
 	GPtrArray *query;
+	RhythmDBQueryPlan *plan;
 	RhythmDBTreeTraversalFunc func;
 	gpointer data;
 	gboolean *cancel;
+
+	/* if set, albums to scan are collected here rather than scanned */
+	GPtrArray *albums;
+	guint album_entries;
 };
 
+/* a range of albums to be scanned by a query worker thread */
+typedef struct
+{
+	struct RhythmDBTreeTraversalData *data;
+	guint start;
+	guint end;
+	GAsyncQueue *results;
+} RhythmDBTreeQueryTask;
+
+/* matches found by a query worker thread */
+typedef struct
+{
+	GPtrArray *entries;
+	gboolean last;
+} RhythmDBTreeQueryBatch;
+
 static gboolean
 rhythmdb_tree_evaluate_query (RhythmDB *adb,
 			      GPtrArray *query,
@@ -1881,13 +2288,6 @@ search_match_properties (RhythmDB *db,
 			 RhythmDBEntry *entry,
 			 gchar **words)
 {
-	const RhythmDBPropType props[] = {
-		RHYTHMDB_PROP_TITLE_FOLDED,
-		RHYTHMDB_PROP_ALBUM_FOLDED,
-		RHYTHMDB_PROP_ARTIST_FOLDED,
-		RHYTHMDB_PROP_COMPOSER_FOLDED,
-		RHYTHMDB_PROP_GENRE_FOLDED
-	};
 	gboolean islike = TRUE;
 	gchar **current;
 	int i;
@@ -1895,8 +2295,8 @@ search_match_properties (RhythmDB *db,
 	for (current = words; *current != NULL; current++) {
 		gboolean word_found = FALSE;
 
-		for (i = 0; i < G_N_ELEMENTS (props); i++) {
-			const char *entry_string = rhythmdb_entry_get_string (entry, props[i]);
+		for (i = 0; i < G_N_ELEMENTS (search_properties); i++) {
+			const char *entry_string = rhythmdb_entry_get_string (entry, search_properties[i]);
 			if (entry_string && (strstr (entry_string, *current) != NULL)) {
 				/* the word was found, go to the next one */
 				word_found = TRUE;
@@ -2071,8 +2471,7 @@ do_conjunction (RhythmDBEntry *entry,
 	if (G_UNLIKELY (*data->cancel))
 		return;
 	/* Finally, we actually evaluate the query! */
-	if (evaluate_conjunctive_subquery (data->db, data->query, 0, data->query->len,
-					   entry)) {
+	if (rhythmdb_query_plan_evaluate (data->plan, entry)) {
 		data->func (data->db, entry, data->data);
 	}
 }
@@ -2084,9 +2483,118 @@ conjunctive_query_songs (const char *name,
 {
 	if (G_UNLIKELY (*data->cancel))
 		return;
+	if (data->albums != NULL) {
+		g_ptr_array_add (data->albums, album);
+		data->album_entries += g_hash_table_size (album->children);
+		return;
+	}
 	g_hash_table_foreach (album->children, (GHFunc) do_conjunction, data);
 }
 
+static void
+parallel_query_worker (gpointer taskdata, gpointer user_data)
+{
+	RhythmDBTreeQueryTask *task = taskdata;
+	struct RhythmDBTreeTraversalData *data = task->data;
+	RhythmDBTreeQueryBatch *batch;
+	GPtrArray *matches;
+	guint i;
+
+	/* the query thread holds the genres lock while this runs */
+	matches = g_ptr_array_new ();
+	for (i = task->start; i < task->end && !*data->cancel; i++) {
+		RhythmDBTreeProperty *album = g_ptr_array_index (data->albums, i);
+		GHashTableIter iter;
+		gpointer entry;
+
+		g_hash_table_iter_init (&iter, album->children);
+		while (g_hash_table_iter_next (&iter, &entry, NULL)) {
+			if (rhythmdb_query_plan_evaluate (data->plan, entry) == FALSE)
+				continue;
+
+			g_ptr_array_add (matches, entry);
+			if (matches->len >= RHYTHMDB_QUERY_MODEL_SUGGESTED_UPDATE_CHUNK) {
+				batch = g_new0 (RhythmDBTreeQueryBatch, 1);
+				batch->entries = matches;
+				g_async_queue_push (task->results, batch);
+				matches = g_ptr_array_new ();
+			}
+		}
+	}
+
+	batch = g_new0 (RhythmDBTreeQueryBatch, 1);
+	batch->entries = matches;
+	batch->last = TRUE;
+	g_async_queue_push (task->results, batch);
+	g_free (task);
+}
+
+/* must be called with the genres_lock held */
+static void
+scan_albums (RhythmDBTree *db,
+	     struct RhythmDBTreeTraversalData *data)
+{
+	GAsyncQueue *results;
+	guint nthreads;
+	guint task_size;
+	guint tasks;
+	guint start;
+	guint i;
+
+	rb_assert_locked (&db->priv->genres_lock);
+
+	nthreads = db->priv->query_threads ? db->priv->query_threads : g_get_num_processors ();
+	if (nthreads < 2 || data->album_entries < RHYTHMDB_TREE_PARALLEL_QUERY_MIN_ENTRIES) {
+		for (i = 0; i < data->albums->len && !*data->cancel; i++) {
+			RhythmDBTreeProperty *album = g_ptr_array_index (data->albums, i);
+			g_hash_table_foreach (album->children, (GHFunc) do_conjunction, data);
+		}
+		return;
+	}
+
+	/* split the albums into a few tasks per thread so the threads finish at about the same time */
+	task_size = MAX (data->album_entries / (nthreads * 4), RHYTHMDB_TREE_PARALLEL_QUERY_MIN_TASK);
+	results = g_async_queue_new ();
+	tasks = 0;
+	start = 0;
+	while (start < data->albums->len) {
+		RhythmDBTreeQueryTask *task;
+		guint count = 0;
+
+		task = g_new0 (RhythmDBTreeQueryTask, 1);
+		task->data = data;
+		task->results = results;
+		task->start = start;
+		while (start < data->albums->len && count < task_size) {
+			RhythmDBTreeProperty *album = g_ptr_array_index (data->albums, start);
+			count += g_hash_table_size (album->children);
+			start++;
+		}
+		task->end = start;
+
+		g_thread_pool_push (db->priv->query_pool, task, NULL);
+		tasks++;
+	}
+	rb_debug ("scanning %u entries in %u albums with %u tasks",
+		  data->album_entries, data->albums->len, tasks);
+
+	/* pass matches on from this thread, as the workers find them */
+	while (tasks > 0) {
+		RhythmDBTreeQueryBatch *batch;
+
+		batch = g_async_queue_pop (results);
+		for (i = 0; i < batch->entries->len && !*data->cancel; i++) {
+			data->func (data->db, g_ptr_array_index (batch->entries, i), data->data);
+		}
+		if (batch->last)
+			tasks--;
+
+		g_ptr_array_free (batch->entries, TRUE);
+		g_free (batch);
+	}
+	g_async_queue_unref (results);
+}
+
 static GPtrArray *
 clone_remove_ptr_array_index (GPtrArray *arr,
 			      guint index)
@@ -2230,6 +2738,118 @@ conjunctive_query_genre (RhythmDBTree *db,
 	g_hash_table_foreach (genres, (GHFunc) conjunctive_query_artists, data);
 }
 
+/* must be called with the genres_lock held */
+static GPtrArray *
+get_search_index_candidates (RhythmDBTree *db,
+			     GPtrArray *query)
+{
+	guint i, j;
+
+	rb_assert_locked (&db->priv->genres_lock);
+
+	for (i = 0; i < query->len; i++) {
+		RhythmDBQueryData *qdata = g_ptr_array_index (query, i);
+		const char *words[2] = { NULL, NULL };
+		GPtrArray *candidates;
+
+		if (qdata->type != RHYTHMDB_QUERY_PROP_LIKE)
+			continue;
+
+		if (qdata->propid == RHYTHMDB_PROP_SEARCH_MATCH) {
+			candidates = rhythmdb_search_index_lookup (db->priv->search_index,
+								   g_value_get_boxed (qdata->val));
+		} else {
+			for (j = 0; j < G_N_ELEMENTS (search_properties); j++) {
+				if (qdata->propid == search_properties[j])
+					break;
+			}
+			if (j == G_N_ELEMENTS (search_properties))
+				continue;
+
+			words[0] = g_value_get_string (qdata->val);
+			candidates = rhythmdb_search_index_lookup (db->priv->search_index, words);
+		}
+
+		if (candidates != NULL)
+			return candidates;
+	}
+
+	return NULL;
+}
+
+/* must be called with the genres_lock held */
+static GPtrArray *
+get_numeric_index_candidates (RhythmDBTree *db,
+			      GPtrArray *query)
+{
+	RhythmDBPropType best_prop = RHYTHMDB_PROP_TYPE;
+	guint best_start = 0;
+	guint best_end = 0;
+	GPtrArray *candidates;
+	guint i;
+
+	rb_assert_locked (&db->priv->genres_lock);
+
+	for (i = 0; i < query->len; i++) {
+		RhythmDBQueryData *qdata = g_ptr_array_index (query, i);
+		RhythmDBQueryType type = qdata->type;
+		GTimeVal current_time;
+		double value;
+		guint start, end;
+
+		if (rhythmdb_numeric_index_has_property (qdata->propid) == FALSE)
+			continue;
+
+		if (G_VALUE_HOLDS_DOUBLE (qdata->val))
+			value = g_value_get_double (qdata->val);
+		else
+			value = g_value_get_ulong (qdata->val);
+
+		switch (type) {
+		case RHYTHMDB_QUERY_PROP_EQUALS:
+		case RHYTHMDB_QUERY_PROP_GREATER:
+		case RHYTHMDB_QUERY_PROP_LESS:
+			break;
+		case RHYTHMDB_QUERY_PROP_CURRENT_TIME_WITHIN:
+			/* the query plan is compiled after this, so its idea of
+			 * the current time can only be later, making the range
+			 * found here a superset of the matching entries.
+			 */
+			g_get_current_time (&current_time);
+			value = (gulong) (current_time.tv_sec - g_value_get_ulong (qdata->val));
+			type = RHYTHMDB_QUERY_PROP_GREATER;
+			break;
+		case RHYTHMDB_QUERY_PROP_CURRENT_TIME_NOT_WITHIN:
+			/* allow some slack in the other direction here */
+			g_get_current_time (&current_time);
+			value = (gulong) (current_time.tv_sec + 60 - g_value_get_ulong (qdata->val));
+			break;
+		default:
+			continue;
+		}
+
+		if (rhythmdb_numeric_index_get_range (db->priv->numeric_index, qdata->propid, type, value, &start, &end) == FALSE)
+			continue;
+
+		if (best_prop == RHYTHMDB_PROP_TYPE || (end - start) < (best_end - best_start)) {
+			best_prop = qdata->propid;
+			best_start = start;
+			best_end = end;
+		}
+	}
+
+	/* only worth it if the range excludes most entries */
+	if (best_prop == RHYTHMDB_PROP_TYPE ||
+	    (best_end - best_start) * 2 >= rhythmdb_numeric_index_get_size (db->priv->numeric_index))
+		return NULL;
+
+	candidates = g_ptr_array_sized_new (best_end - best_start);
+	for (i = best_start; i < best_end; i++) {
+		g_ptr_array_add (candidates, rhythmdb_numeric_index_get_entry (db->priv->numeric_index, best_prop, i));
+	}
+	return candidates;
+}
+
 static void
 conjunctive_query (RhythmDBTree *db,
 		   GPtrArray *query,
@@ -2252,7 +2872,7 @@ conjunctive_query (RhythmDBTree *db,
 		}
 	}
 
-	traversal_data = g_new (struct RhythmDBTreeTraversalData, 1);
+	traversal_data = g_new0 (struct RhythmDBTreeTraversalData, 1);
 	traversal_data->db = db;
 	traversal_data->query = query;
 	traversal_data->func = func;
@@ -2260,12 +2880,41 @@ conjunctive_query (RhythmDBTree *db,
 	traversal_data->cancel = cancel;
 
 	g_mutex_lock (&db->priv->genres_lock);
+	if (db->priv->use_search_index || db->priv->use_numeric_index) {
+		GPtrArray *candidates = NULL;
+
+		/* if one of the indexes can narrow down the set of entries to
+		 * check, evaluate the whole query (including any type criteria)
+		 * against each candidate instead of walking the tree.
+		 */
+		if (db->priv->use_search_index)
+			candidates = get_search_index_candidates (db, query);
+		if (candidates == NULL && db->priv->use_numeric_index)
+			candidates = get_numeric_index_candidates (db, query);
+
+		if (candidates != NULL) {
+			rb_debug ("checking %u index candidates", candidates->len);
+			traversal_data->plan = rhythmdb_query_plan_compile (RHYTHMDB (db), query);
+			for (i = 0; i < candidates->len && !*cancel; i++) {
+				do_conjunction (g_ptr_array_index (candidates, i), NULL, traversal_data);
+			}
+			g_mutex_unlock (&db->priv->genres_lock);
+
+			rhythmdb_query_plan_free (traversal_data->plan);
+			g_ptr_array_free (candidates, TRUE);
+			g_free (traversal_data);
+			return;
+		}
+	}
+
 	if (type_query_idx >= 0) {
 		GHashTable *genres;
 		RhythmDBEntryType *etype;
 		RhythmDBQueryData *qdata = g_ptr_array_index (query, type_query_idx);
 
 		g_ptr_array_remove_index_fast (query, type_query_idx);
+		traversal_data->plan = rhythmdb_query_plan_compile (RHYTHMDB (db), query);
+		traversal_data->albums = g_ptr_array_new ();
 
 		etype = g_value_get_object (qdata->val);
 		genres = get_genres_hash_for_type (db, etype);
@@ -2277,11 +2926,16 @@ conjunctive_query (RhythmDBTree *db,
 	} else {
 		/* FIXME */
 		/* No type was given; punt and query everything */
+		traversal_data->plan = rhythmdb_query_plan_compile (RHYTHMDB (db), query);
+		traversal_data->albums = g_ptr_array_new ();
 		genres_hash_foreach (db, (RBHFunc)conjunctive_query_genre,
 				     traversal_data);
 	}
+	scan_albums (db, traversal_data);
 	g_mutex_unlock (&db->priv->genres_lock);
 
+	g_ptr_array_free (traversal_data->albums, TRUE);
+	rhythmdb_query_plan_free (traversal_data->plan);
 	g_free (traversal_data);
 }
 
@@ -62,6 +62,8 @@
 #include "rb-cut-and-paste-code.h"
 #include "rhythmdb-private.h"
 #include "rhythmdb-property-model.h"
+#include "rhythmdb-metadata-cache.h"
+#include "rhythmdb-dir-manifest.h"
 #include "rb-dialog.h"
 #include "rb-string-value-map.h"
 #include "rb-async-queue-watch.h"
@@ -177,6 +179,15 @@ static const RhythmDBPropertyDef rhythmdb_properties[] = {
 #define RHYTHMDB_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), RHYTHMDB_TYPE, RhythmDBPrivate))
 G_DEFINE_ABSTRACT_TYPE(RhythmDB, rhythmdb, G_TYPE_OBJECT)
 
+/* maximum number of events to process in one main loop iteration */
+#define RHYTHMDB_EVENT_BATCH_MAX	512
+
+/* maximum time to spend processing events in one main loop iteration (microseconds) */
+#define RHYTHMDB_EVENT_BATCH_TIME	(8 * 1000)
+
+/* event batches taking longer than this are logged (microseconds) */
+#define RHYTHMDB_EVENT_BATCH_SLOW	(50 * 1000)
+
 /* file attributes requested in RHYTHMDB_ACTION_STAT and RHYTHMDB_ACTION_LOAD */
 #define RHYTHMDB_FILE_INFO_ATTRIBUTES			\
 	G_FILE_ATTRIBUTE_STANDARD_SIZE ","		\
@@ -219,6 +230,12 @@ GPrivate is_query_thread;
  */
 #define REALLY_SMALL_FILE_SIZE	(4096)
 
+/* how long to wait after a commit before writing journal records */
+#define RHYTHMDB_JOURNAL_FLUSH_DELAY	(5)
+
+/* journal size above which the periodic save rewrites the whole database */
+#define RHYTHMDB_JOURNAL_COMPACT_SIZE	(4 * 1024 * 1024)
+
 
 typedef struct
 {
@@ -257,6 +274,17 @@ typedef struct
 	} data;
 } RhythmDBAction;
 
+/* a metadata load running on the metadata worker pool */
+typedef struct
+{
+	RhythmDBAction *action;
+	RhythmDBEvent *event;
+	guint seq;
+} RhythmDBMetadataTask;
+
+/* upper limit on the automatically chosen number of metadata workers */
+#define RHYTHMDB_MAX_AUTO_METADATA_WORKERS	8
+
 static void rhythmdb_dispose (GObject *object);
 static void rhythmdb_finalize (GObject *object);
 static void rhythmdb_set_property (GObject *object,
@@ -272,7 +300,7 @@ static GThread * rhythmdb_thread_create (RhythmDB *db,
 					 gpointer data);
 static void rhythmdb_read_enter (RhythmDB *db);
 static void rhythmdb_read_leave (RhythmDB *db);
-static void rhythmdb_process_one_event (RhythmDBEvent *event, RhythmDB *db);
+static void rhythmdb_process_events (RhythmDBEvent *event, RhythmDB *db);
 static gpointer action_thread_main (RhythmDB *db);
 static gpointer query_thread_main (RhythmDBQueryThreadData *data);
 static void rhythmdb_entry_set_mount_point (RhythmDB *db,
@@ -282,6 +310,7 @@ static void rhythmdb_entry_set_mount_point (RhythmDB *db,
 static gboolean rhythmdb_idle_save (RhythmDB *db);
 static void db_settings_changed_cb (GSettings *settings, const char *key, RhythmDB *db);
 static void rhythmdb_sync_library_location (RhythmDB *db);
+static void free_entry_extra (RhythmDBEntryExtra *extra);
 static void rhythmdb_entry_sync_mirrored (RhythmDBEntry *entry,
 					  guint propid);
 static gboolean rhythmdb_entry_extra_metadata_accumulator (GSignalInvocationHint *ihint,
@@ -307,6 +336,9 @@ enum
 	PROP_NAME,
 	PROP_DRY_RUN,
 	PROP_NO_UPDATE,
+	PROP_PROGRESSIVE_LOAD,
+	PROP_JOURNAL,
+	PROP_METADATA_WORKERS,
 };
 
 enum
@@ -316,10 +348,14 @@ enum
 	ENTRY_DELETED,
 	ENTRY_KEYWORD_ADDED,
 	ENTRY_KEYWORD_REMOVED,
+	ENTRIES_ADDED,
+	ENTRIES_CHANGED,
+	ENTRIES_DELETED,
 	ENTRY_EXTRA_METADATA_REQUEST,
 	ENTRY_EXTRA_METADATA_NOTIFY,
 	ENTRY_EXTRA_METADATA_GATHER,
 	LOAD_COMPLETE,
+	LOAD_PROGRESS,
 	SAVE_COMPLETE,
 	SAVE_ERROR,
 	READ_ONLY,
@@ -376,6 +412,50 @@ rhythmdb_class_init (RhythmDBClass *klass)
 							       "Whether or not to update the database",
 							       FALSE,
 							       G_PARAM_READWRITE));
+	/**
+	 * RhythmDB:journal:
+	 *
+	 * If %TRUE, changes are appended to a journal file alongside the database,
+	 * and the database is only rewritten in full when the journal gets too large
+	 * or the database is saved explicitly.  Must be set before the database is loaded.
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_JOURNAL,
+					 g_param_spec_boolean ("journal",
+							       "journal",
+							       "Whether to journal changes to the database",
+							       FALSE,
+							       G_PARAM_READWRITE));
+	/**
+	 * RhythmDB:progressive-load:
+	 *
+	 * If %TRUE, #RhythmDB::load-progress is emitted as batches of entries
+	 * are loaded, so the library can be displayed before the database
+	 * is fully loaded.  Must be set before the database is loaded.
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_PROGRESSIVE_LOAD,
+					 g_param_spec_boolean ("progressive-load",
+							       "progressive load",
+							       "Whether to report progress while loading the database",
+							       FALSE,
+							       G_PARAM_READWRITE));
+	/**
+	 * RhythmDB:metadata-workers:
+	 *
+	 * The number of threads used to read metadata from files.  If 0,
+	 * the number is chosen based on the number of processors.  Stat and
+	 * directory enumeration actions are handled separately, so they are
+	 * not held up by metadata loads.  Must be set before the action
+	 * thread is started.
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_METADATA_WORKERS,
+					 g_param_spec_uint ("metadata-workers",
+							    "metadata workers",
+							    "Number of threads reading metadata",
+							    0, 64, 0,
+							    G_PARAM_READWRITE));
 	/**
 	 * RhythmDB::entry-added:
 	 * @db: the #RhythmDB
@@ -465,6 +545,69 @@ rhythmdb_class_init (RhythmDBClass *klass)
 			      G_TYPE_NONE,
 			      2, RHYTHMDB_TYPE_ENTRY, RB_TYPE_REFSTRING);
 
+	/**
+	 * RhythmDB::entries-added:
+	 * @db: the #RhythmDB
+	 * @entries: (element-type RhythmDBEntry): the newly added entries
+	 *
+	 * Emitted once for each batch of entries added to the database,
+	 * before #RhythmDB::entry-added is emitted for each of them.
+	 * Handlers that can process a batch of entries at a time should
+	 * connect to this instead of #RhythmDB::entry-added.
+	 */
+	rhythmdb_signals[ENTRIES_ADDED] =
+		g_signal_new ("entries-added",
+			      RHYTHMDB_TYPE,
+			      G_SIGNAL_RUN_LAST,
+			      0,
+			      NULL, NULL,
+			      NULL,
+			      G_TYPE_NONE,
+			      1, G_TYPE_PTR_ARRAY);
+
+	/**
+	 * RhythmDB::entries-changed:
+	 * @db: the #RhythmDB
+	 * @entries: (element-type RhythmDBEntry): the changed entries
+	 * @changes: (element-type GPtrArray): for each entry, a #GPtrArray of
+	 *   #RhythmDBEntryChange structures describing the changes
+	 * @mask: (type gpointer): a #RhythmDBPropMask containing each property
+	 *   changed in any of the entries, along with the synthetic properties
+	 *   derived from them
+	 *
+	 * Emitted once for each batch of changed entries, before
+	 * #RhythmDB::entry-changed is emitted for each of them.  Handlers
+	 * can check @mask to skip work when none of the properties they
+	 * care about have changed.
+	 */
+	rhythmdb_signals[ENTRIES_CHANGED] =
+		g_signal_new ("entries-changed",
+			      RHYTHMDB_TYPE,
+			      G_SIGNAL_RUN_LAST,
+			      0,
+			      NULL, NULL,
+			      NULL,
+			      G_TYPE_NONE,
+			      3, G_TYPE_PTR_ARRAY, G_TYPE_PTR_ARRAY, G_TYPE_POINTER);
+
+	/**
+	 * RhythmDB::entries-deleted:
+	 * @db: the #RhythmDB
+	 * @entries: (element-type RhythmDBEntry): the deleted entries
+	 *
+	 * Emitted once for each batch of entries deleted from the database,
+	 * before #RhythmDB::entry-deleted is emitted for each of them.
+	 */
+	rhythmdb_signals[ENTRIES_DELETED] =
+		g_signal_new ("entries-deleted",
+			      RHYTHMDB_TYPE,
+			      G_SIGNAL_RUN_LAST,
+			      0,
+			      NULL, NULL,
+			      NULL,
+			      G_TYPE_NONE,
+			      1, G_TYPE_PTR_ARRAY);
+
 	/**
 	 * RhythmDB::entry-extra-metadata-request:
 	 * @db: the #RhythmDB
@@ -548,6 +691,27 @@ rhythmdb_class_init (RhythmDBClass *klass)
 			      G_TYPE_NONE,
 			      0);
 
+	/**
+	 * RhythmDB::load-progress:
+	 * @db: the #RhythmDB
+	 * @count: the number of entries loaded so far
+	 *
+	 * Emitted while the database is being loaded, if
+	 * #RhythmDB:progressive-load is set, once some entries have been
+	 * added.  Entries loaded so far can be queried as usual; entries
+	 * loaded later are added through the normal entry signals.
+	 * Several batches may be reported by a single emission.
+	 */
+	rhythmdb_signals[LOAD_PROGRESS] =
+		g_signal_new ("load-progress",
+			      RHYTHMDB_TYPE,
+			      G_SIGNAL_RUN_LAST,
+			      0,
+			      NULL, NULL,
+			      NULL,
+			      G_TYPE_NONE,
+			      1, G_TYPE_UINT);
+
 	/**
 	 * RhythmDB::save-complete:
 	 * @db: the #RhythmDB
@@ -624,7 +788,7 @@ rhythmdb_class_init (RhythmDBClass *klass)
 	g_type_class_add_private (klass, sizeof (RhythmDBPrivate));
 }
 
-static void
+void
 rhythmdb_push_event (RhythmDB *db, RhythmDBEvent *event)
 {
 	g_async_queue_push (db->priv->event_queue, event);
@@ -723,11 +887,14 @@ rhythmdb_init (RhythmDB *db)
 	db->priv->delayed_write_queue = g_async_queue_new ();
 	db->priv->event_queue_watch_id = rb_async_queue_watch_new (db->priv->event_queue,
 								   G_PRIORITY_LOW,		/* really? */
-								   (RBAsyncQueueWatchFunc) rhythmdb_process_one_event,
+								   (RBAsyncQueueWatchFunc) rhythmdb_process_events,
 								   db,
 								   NULL,
 								   NULL);
 
+	db->priv->event_batch_uris = g_hash_table_new_full (rb_refstring_hash, rb_refstring_equal,
+							    (GDestroyNotify) rb_refstring_unref, NULL);
+
 	db->priv->restored_queue = g_async_queue_new ();
 
 	db->priv->query_thread_pool = g_thread_pool_new ((GFunc)query_thread_main,
@@ -775,6 +942,20 @@ rhythmdb_init (RhythmDB *db)
 	db->priv->empty_string = rb_refstring_new ("");
 	db->priv->octet_stream_str = rb_refstring_new ("application/octet-stream");
 
+	db->priv->default_extra = g_new0 (RhythmDBEntryExtra, 1);
+	db->priv->default_extra->shared = TRUE;
+	db->priv->default_extra->composer = rb_refstring_ref (db->priv->empty_string);
+	db->priv->default_extra->comment = rb_refstring_ref (db->priv->empty_string);
+	db->priv->default_extra->musicbrainz_trackid = rb_refstring_ref (db->priv->empty_string);
+	db->priv->default_extra->musicbrainz_artistid = rb_refstring_ref (db->priv->empty_string);
+	db->priv->default_extra->musicbrainz_albumid = rb_refstring_ref (db->priv->empty_string);
+	db->priv->default_extra->musicbrainz_albumartistid = rb_refstring_ref (db->priv->empty_string);
+	db->priv->default_extra->artist_sortname = rb_refstring_ref (db->priv->empty_string);
+	db->priv->default_extra->composer_sortname = rb_refstring_ref (db->priv->empty_string);
+	db->priv->default_extra->album_sortname = rb_refstring_ref (db->priv->empty_string);
+	db->priv->default_extra->title_sortname = rb_refstring_ref (db->priv->empty_string);
+	db->priv->default_extra->album_artist_sortname = rb_refstring_ref (db->priv->empty_string);
+
 	db->priv->next_entry_id = 1;
 
 	rhythmdb_init_monitoring (db);
@@ -822,66 +1003,227 @@ typedef struct {
 	GList *stat_list;
 } RhythmDBStatThreadData;
 
+static void
+stat_thread_query_file (RhythmDB *db, RhythmDBEvent *event)
+{
+	GError *error = NULL;
+	GFile *file;
+
+	file = g_file_new_for_uri (rb_refstring_get (event->uri));
+	event->file_info = g_file_query_info (file,
+					      G_FILE_ATTRIBUTE_TIME_MODIFIED,	/* anything else? */
+					      G_FILE_QUERY_INFO_NONE,
+					      db->priv->exiting,
+					      &error);
+	if (error != NULL) {
+		event->error = make_access_failed_error (rb_refstring_get (event->uri), error);
+		g_clear_error (&error);
+
+		if (event->file_info != NULL) {
+			g_object_unref (event->file_info);
+			event->file_info = NULL;
+		}
+	}
+	g_object_unref (file);
+}
+
+static void
+stat_thread_push_event (RhythmDB *db, RhythmDBEvent *event)
+{
+	if (db->priv->stat_thread_done > 0 &&
+	    db->priv->stat_thread_done % 1000 == 0) {
+		rb_debug ("%d file info queries done",
+			  db->priv->stat_thread_done);
+	}
+
+	g_async_queue_push (db->priv->event_queue, event);
+	g_atomic_int_inc (&db->priv->stat_thread_done);
+}
+
+/* returns TRUE if the directory was checked without finding any changes */
+static gboolean
+stat_thread_check_dir (RhythmDB *db, const char *dir_uri, GPtrArray *events, RhythmDBDirManifest *manifest, RhythmDBDirManifest *new_manifest)
+{
+	GFileInfo *info;
+	GFile *dir;
+	guint64 mtime = 0;
+	guint32 hash = 0;
+	gboolean have_mtime = FALSE;
+	gboolean clean;
+	guint i;
+
+	clean = TRUE;
+	for (i = 0; i < events->len; i++) {
+		RhythmDBEvent *event = g_ptr_array_index (events, i);
+		const char *uri = rb_refstring_get (event->uri);
+
+		hash = rhythmdb_dir_manifest_add_name (hash, uri + strlen (dir_uri));
+		if (event->entry == NULL)
+			clean = FALSE;
+	}
+
+	/* get the directory modification time before checking the files in it,
+	 * so changes made while we're checking them will be noticed next time.
+	 */
+	dir = g_file_new_for_uri (dir_uri);
+	info = g_file_query_info (dir, G_FILE_ATTRIBUTE_TIME_MODIFIED, G_FILE_QUERY_INFO_NONE, db->priv->exiting, NULL);
+	if (info != NULL) {
+		mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+		have_mtime = TRUE;
+		g_object_unref (info);
+	}
+	g_object_unref (dir);
+
+	if (clean && rhythmdb_dir_manifest_matches (manifest, dir_uri, mtime, events->len, hash)) {
+		/* nothing added or removed, so the entries are all still there as they were */
+		for (i = 0; i < events->len; i++) {
+			RhythmDBEvent *event = g_ptr_array_index (events, i);
+
+			event->real_uri = rb_refstring_ref (event->uri);
+			event->file_info = g_file_info_new ();
+			g_file_info_set_attribute_uint64 (event->file_info,
+							  G_FILE_ATTRIBUTE_TIME_MODIFIED,
+							  rhythmdb_entry_get_ulong (event->entry, RHYTHMDB_PROP_MTIME));
+			stat_thread_push_event (db, event);
+		}
+		rhythmdb_dir_manifest_set (new_manifest, dir_uri, mtime, events->len, hash);
+		return TRUE;
+	}
+
+	for (i = 0; i < events->len; i++) {
+		RhythmDBEvent *event = g_ptr_array_index (events, i);
+
+		event->real_uri = rb_refstring_ref (event->uri);		/* what? */
+		stat_thread_query_file (db, event);
+
+		/* only record the directory if all its entries are up to date */
+		if (event->file_info == NULL ||
+		    (event->entry != NULL &&
+		     g_file_info_get_attribute_uint64 (event->file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED) !=
+		     rhythmdb_entry_get_ulong (event->entry, RHYTHMDB_PROP_MTIME))) {
+			clean = FALSE;
+		}
+
+		stat_thread_push_event (db, event);
+	}
+
+	if (clean && have_mtime)
+		rhythmdb_dir_manifest_set (new_manifest, dir_uri, mtime, events->len, hash);
+	return FALSE;
+}
+
 static gpointer
 stat_thread_main (RhythmDBStatThreadData *data)
 {
+	RhythmDB *db = data->db;
+	RhythmDBDirManifest *manifest;
+	RhythmDBDirManifest *new_manifest;
+	GHashTableIter iter;
+	GHashTable *dirs;
 	GList *i;
-	GError *error = NULL;
+	gpointer dir_uri;
+	gpointer events;
 	RhythmDBEvent *result;
+	char *manifest_file = NULL;
+	guint skipped = 0;
+	guint64 now;
 
-	data->db->priv->stat_thread_count = g_list_length (data->stat_list);
-	data->db->priv->stat_thread_done = 0;
+	db->priv->stat_thread_count = g_list_length (data->stat_list);
+	db->priv->stat_thread_done = 0;
 
-	rb_debug ("entering stat thread: %d to process", data->db->priv->stat_thread_count);
+	rb_debug ("entering stat thread: %d to process", db->priv->stat_thread_count);
+
+	/* group the files by directory */
+	dirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_ptr_array_unref);
 	for (i = data->stat_list; i != NULL; i = i->next) {
 		RhythmDBEvent *event = (RhythmDBEvent *)i->data;
-		GFile *file;
+		const char *uri;
+		const char *slash;
+		char *parent;
+		GPtrArray *dir_events;
+
+		uri = rb_refstring_get (event->uri);
+		slash = strrchr (uri, '/');
+		parent = slash ? g_strndup (uri, (slash - uri) + 1) : g_strdup (uri);
+
+		dir_events = g_hash_table_lookup (dirs, parent);
+		if (dir_events == NULL) {
+			dir_events = g_ptr_array_new ();
+			g_hash_table_insert (dirs, parent, dir_events);
+		} else {
+			g_free (parent);
+		}
+		g_ptr_array_add (dir_events, event);
+	}
+	g_list_free (data->stat_list);
+
+	if (db->priv->name != NULL) {
+		manifest_file = rhythmdb_dir_manifest_get_filename (db->priv->name);
+		manifest = rhythmdb_dir_manifest_load (manifest_file);
+	} else {
+		manifest = rhythmdb_dir_manifest_new ();
+	}
+	new_manifest = rhythmdb_dir_manifest_new ();
+
+	/* files modified in place don't change their directories, so
+	 * check every file individually every so often.
+	 */
+	now = g_get_real_time () / G_USEC_PER_SEC;
+	if (rhythmdb_dir_manifest_is_expired (manifest, now)) {
+		rb_debug ("directory manifest expired, checking all files");
+		rhythmdb_dir_manifest_free (manifest);
+		manifest = rhythmdb_dir_manifest_new ();
+		rhythmdb_dir_manifest_set_full_check (new_manifest, now, 0);
+	} else {
+		guint64 full_check_time;
+		guint startups;
+
+		rhythmdb_dir_manifest_get_full_check (manifest, &full_check_time, &startups);
+		rhythmdb_dir_manifest_set_full_check (new_manifest, full_check_time, startups + 1);
+	}
 
-		/* if we've been cancelled, just free the event.  this will
+	g_hash_table_iter_init (&iter, dirs);
+	while (g_hash_table_iter_next (&iter, &dir_uri, &events)) {
+		GPtrArray *dir_events = events;
+
+		/* if we've been cancelled, just free the events.  this will
 		 * clean up the list and then we'll exit the thread.
 		 */
-		if (g_cancellable_is_cancelled (data->db->priv->exiting)) {
-			rhythmdb_event_free (data->db, event);
+		if (g_cancellable_is_cancelled (db->priv->exiting)) {
+			guint j;
+			for (j = 0; j < dir_events->len; j++) {
+				rhythmdb_event_free (db, g_ptr_array_index (dir_events, j));
+			}
 			continue;
 		}
 
-		if (data->db->priv->stat_thread_done > 0 &&
-		    data->db->priv->stat_thread_done % 1000 == 0) {
-			rb_debug ("%d file info queries done",
-				  data->db->priv->stat_thread_done);
-		}
+		if (stat_thread_check_dir (db, dir_uri, dir_events, manifest, new_manifest))
+			skipped++;
+	}
+	rb_debug ("%u of %u directories unchanged", skipped, g_hash_table_size (dirs));
+	g_hash_table_destroy (dirs);
 
-		file = g_file_new_for_uri (rb_refstring_get (event->uri));
-		event->real_uri = rb_refstring_ref (event->uri);		/* what? */
-		event->file_info = g_file_query_info (file,
-						      G_FILE_ATTRIBUTE_TIME_MODIFIED,	/* anything else? */
-						      G_FILE_QUERY_INFO_NONE,
-						      data->db->priv->exiting,
-						      &error);
-		if (error != NULL) {
-			event->error = make_access_failed_error (rb_refstring_get (event->uri), error);
-			g_clear_error (&error);
+	if (manifest_file != NULL &&
+	    db->priv->dry_run == FALSE &&
+	    g_cancellable_is_cancelled (db->priv->exiting) == FALSE) {
+		GError *error = NULL;
 
-			if (event->file_info != NULL) {
-				g_object_unref (event->file_info);
-				event->file_info = NULL;
-			}
+		if (rhythmdb_dir_manifest_save (new_manifest, manifest_file, &error) == FALSE) {
+			rb_debug ("unable to save directory manifest: %s", error->message);
+			g_error_free (error);
 		}
-
-		g_async_queue_push (data->db->priv->event_queue, event);
-		g_object_unref (file);
-		g_atomic_int_inc (&data->db->priv->stat_thread_done);
 	}
+	rhythmdb_dir_manifest_free (manifest);
+	rhythmdb_dir_manifest_free (new_manifest);
+	g_free (manifest_file);
 
-	g_list_free (data->stat_list);
-
-	data->db->priv->stat_thread_running = FALSE;
+	db->priv->stat_thread_running = FALSE;
 
 	rb_debug ("exiting stat thread");
 	result = g_slice_new0 (RhythmDBEvent);
-	result->db = data->db;			/* need to unref? */
+	result->db = db;			/* need to unref? */
 	result->type = RHYTHMDB_EVENT_THREAD_EXITED;
-	rhythmdb_push_event (data->db, result);
+	rhythmdb_push_event (db, result);
 
 	g_free (data);
 	return NULL;
@@ -1001,6 +1343,7 @@ rhythmdb_event_free (RhythmDB *db,
 	case RHYTHMDB_EVENT_STAT:
 	case RHYTHMDB_EVENT_METADATA_LOAD:
 	case RHYTHMDB_EVENT_DB_LOAD:
+	case RHYTHMDB_EVENT_DB_LOAD_PROGRESS:
 	case RHYTHMDB_EVENT_DB_SAVED:
 	case RHYTHMDB_EVENT_QUERY_COMPLETE:
 		break;
@@ -1081,6 +1424,18 @@ rhythmdb_shutdown (RhythmDB *db)
 	while ((action = g_async_queue_try_pop (db->priv->action_queue)) != NULL) {
 		rhythmdb_action_free (db, action);
 	}
+
+	rhythmdb_metadata_cache_flush_all ();
+
+	if (db->priv->journal != NULL) {
+		GError *error = NULL;
+
+		g_clear_handle_id (&db->priv->journal_flush_id, g_source_remove);
+		if (rhythmdb_journal_flush (db->priv->journal, &error) == FALSE) {
+			g_warning ("Unable to write database journal: %s", error->message);
+			g_clear_error (&error);
+		}
+	}
 }
 
 static void
@@ -1109,6 +1464,8 @@ rhythmdb_dispose (GObject *object)
 		db->priv->save_timeout_id = 0;
 	}
 
+	g_clear_handle_id (&db->priv->journal_flush_id, g_source_remove);
+
 	if (db->priv->emit_entry_signals_id != 0) {
 		g_source_remove (db->priv->emit_entry_signals_id);
 		db->priv->emit_entry_signals_id = 0;
@@ -1160,6 +1517,7 @@ rhythmdb_finalize (GObject *object)
 	g_async_queue_unref (db->priv->event_queue);
 	g_async_queue_unref (db->priv->restored_queue);
 	g_async_queue_unref (db->priv->delayed_write_queue);
+	g_hash_table_destroy (db->priv->event_batch_uris);
 
 	g_list_free (db->priv->stat_list);
 
@@ -1169,11 +1527,15 @@ rhythmdb_finalize (GObject *object)
 	g_hash_table_destroy (db->priv->deleted_entries);
 	g_hash_table_destroy (db->priv->changed_entries);
 
+	free_entry_extra (db->priv->default_extra);
 	rb_refstring_unref (db->priv->empty_string);
 	rb_refstring_unref (db->priv->octet_stream_str);
 
 	g_hash_table_destroy (db->priv->entry_type_map);
 
+	if (db->priv->journal != NULL)
+		rhythmdb_journal_free (db->priv->journal);
+
 	g_free (db->priv->name);
 
 	G_OBJECT_CLASS (rhythmdb_parent_class)->finalize (object);
@@ -1198,6 +1560,15 @@ rhythmdb_set_property (GObject *object,
 	case PROP_NO_UPDATE:
 		db->priv->no_update = g_value_get_boolean (value);
 		break;
+	case PROP_JOURNAL:
+		db->priv->use_journal = g_value_get_boolean (value);
+		break;
+	case PROP_PROGRESSIVE_LOAD:
+		db->priv->progressive_load = g_value_get_boolean (value);
+		break;
+	case PROP_METADATA_WORKERS:
+		db->priv->metadata_workers = g_value_get_uint (value);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -1222,6 +1593,15 @@ rhythmdb_get_property (GObject *object,
 	case PROP_NO_UPDATE:
 		g_value_set_boolean (value, source->priv->no_update);
 		break;
+	case PROP_JOURNAL:
+		g_value_set_boolean (value, source->priv->use_journal);
+		break;
+	case PROP_PROGRESSIVE_LOAD:
+		g_value_set_boolean (value, source->priv->progressive_load);
+		break;
+	case PROP_METADATA_WORKERS:
+		g_value_set_uint (value, source->priv->metadata_workers);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -1332,16 +1712,104 @@ copy_entry_changes (GSList *entry_changes)
 	return g_slist_reverse (r);
 }
 
+static GPtrArray *
+entry_list_to_array (GList *entries)
+{
+	GPtrArray *array;
+	GList *l;
+
+	array = g_ptr_array_new_full (g_list_length (entries), (GDestroyNotify) rhythmdb_entry_unref);
+	for (l = entries; l != NULL; l = l->next) {
+		g_ptr_array_add (array, l->data);
+	}
+	return array;
+}
+
+/* adds a changed property and any synthetic properties derived from it */
+static void
+add_changed_prop (RhythmDBPropMask *mask, RhythmDBPropType propid)
+{
+	rhythmdb_prop_mask_add (mask, propid);
+
+	switch (propid) {
+	case RHYTHMDB_PROP_TITLE:
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_TITLE_SORT_KEY);
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_TITLE_FOLDED);
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_SEARCH_MATCH);
+		break;
+	case RHYTHMDB_PROP_GENRE:
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_GENRE_SORT_KEY);
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_GENRE_FOLDED);
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_SEARCH_MATCH);
+		break;
+	case RHYTHMDB_PROP_ARTIST:
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_ARTIST_SORT_KEY);
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_ARTIST_FOLDED);
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_SEARCH_MATCH);
+		break;
+	case RHYTHMDB_PROP_ALBUM:
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_ALBUM_SORT_KEY);
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_ALBUM_FOLDED);
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_SEARCH_MATCH);
+		break;
+	case RHYTHMDB_PROP_COMPOSER:
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_COMPOSER_SORT_KEY);
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_COMPOSER_FOLDED);
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_SEARCH_MATCH);
+		break;
+	case RHYTHMDB_PROP_ALBUM_ARTIST:
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_ALBUM_ARTIST_SORT_KEY);
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_ALBUM_ARTIST_FOLDED);
+		break;
+	case RHYTHMDB_PROP_ARTIST_SORTNAME:
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_ARTIST_SORTNAME_SORT_KEY);
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_ARTIST_SORTNAME_FOLDED);
+		break;
+	case RHYTHMDB_PROP_ALBUM_SORTNAME:
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_ALBUM_SORTNAME_SORT_KEY);
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_ALBUM_SORTNAME_FOLDED);
+		break;
+	case RHYTHMDB_PROP_ALBUM_ARTIST_SORTNAME:
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_ALBUM_ARTIST_SORTNAME_SORT_KEY);
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_ALBUM_ARTIST_SORTNAME_FOLDED);
+		break;
+	case RHYTHMDB_PROP_COMPOSER_SORTNAME:
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_COMPOSER_SORTNAME_SORT_KEY);
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_COMPOSER_SORTNAME_FOLDED);
+		break;
+	case RHYTHMDB_PROP_TITLE_SORTNAME:
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_TITLE_SORTNAME_SORT_KEY);
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_TITLE_SORTNAME_FOLDED);
+		break;
+	case RHYTHMDB_PROP_LAST_PLAYED:
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_LAST_PLAYED_STR);
+		break;
+	case RHYTHMDB_PROP_FIRST_SEEN:
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_FIRST_SEEN_STR);
+		break;
+	case RHYTHMDB_PROP_LAST_SEEN:
+	case RHYTHMDB_PROP_HIDDEN:
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_LAST_SEEN_STR);
+		break;
+	case RHYTHMDB_PROP_DATE:
+		rhythmdb_prop_mask_add (mask, RHYTHMDB_PROP_YEAR);
+		break;
+	default:
+		break;
+	}
+}
+
 static gboolean
 rhythmdb_emit_entry_signals_idle (RhythmDB *db)
 {
 	GList *added_entries;
 	GList *deleted_entries;
 	GHashTable *changed_entries;
-	GList *l;
 	GHashTableIter iter;
 	RhythmDBEntry *entry;
 	GSList *entry_changes;
+	GPtrArray *entries;
+	guint i;
 
 	/* get lists of entries to emit, reset source id value */
 	g_mutex_lock (&db->priv->change_mutex);
@@ -1359,8 +1827,15 @@ rhythmdb_emit_entry_signals_idle (RhythmDB *db)
 
 	g_mutex_unlock (&db->priv->change_mutex);
 
-	/* emit changed entries */
+	/* emit changed entries, first as a single batch, then one at a time */
 	if (changed_entries != NULL) {
+		GPtrArray *changes;
+		RhythmDBPropMask mask;
+
+		memset (&mask, 0, sizeof (mask));
+		entries = g_ptr_array_new_full (g_hash_table_size (changed_entries), NULL);
+		changes = g_ptr_array_new_full (g_hash_table_size (changed_entries), (GDestroyNotify) g_ptr_array_unref);
+
 		g_hash_table_iter_init (&iter, changed_entries);
 		while (g_hash_table_iter_next (&iter, (gpointer *)&entry, (gpointer *)&entry_changes)) {
 			GPtrArray *emit_changes;
@@ -1368,31 +1843,46 @@ rhythmdb_emit_entry_signals_idle (RhythmDB *db)
 
 			emit_changes = g_ptr_array_new_full (g_slist_length (entry_changes), NULL);
 			for (c = entry_changes; c != NULL; c = c->next) {
-				g_ptr_array_add (emit_changes, c->data); 
+				RhythmDBEntryChange *change = c->data;
+				g_ptr_array_add (emit_changes, change);
+				add_changed_prop (&mask, change->prop);
 			}
-			g_signal_emit (G_OBJECT (db), rhythmdb_signals[ENTRY_CHANGED], 0, entry, emit_changes);
-			g_ptr_array_unref (emit_changes);
-			g_hash_table_iter_remove (&iter);
+			g_ptr_array_add (entries, entry);
+			g_ptr_array_add (changes, emit_changes);
+		}
+
+		g_signal_emit (G_OBJECT (db), rhythmdb_signals[ENTRIES_CHANGED], 0, entries, changes, &mask);
+		for (i = 0; i < entries->len; i++) {
+			g_signal_emit (G_OBJECT (db), rhythmdb_signals[ENTRY_CHANGED], 0,
+				       g_ptr_array_index (entries, i),
+				       g_ptr_array_index (changes, i));
 		}
+
+		g_ptr_array_unref (entries);
+		g_ptr_array_unref (changes);
+		g_hash_table_destroy (changed_entries);
 	}
 
 	/* emit added entries */
-	for (l = added_entries; l; l = g_list_next (l)) {
-		entry = (RhythmDBEntry *)l->data;
-		g_signal_emit (G_OBJECT (db), rhythmdb_signals[ENTRY_ADDED], 0, entry);
-		rhythmdb_entry_unref (entry);
+	if (added_entries != NULL) {
+		entries = entry_list_to_array (added_entries);
+		g_signal_emit (G_OBJECT (db), rhythmdb_signals[ENTRIES_ADDED], 0, entries);
+		for (i = 0; i < entries->len; i++) {
+			g_signal_emit (G_OBJECT (db), rhythmdb_signals[ENTRY_ADDED], 0, g_ptr_array_index (entries, i));
+		}
+		g_ptr_array_unref (entries);
 	}
 
 	/* emit deleted entries */
-	for (l = deleted_entries; l; l = g_list_next (l)) {
-		entry = (RhythmDBEntry *)l->data;
-		g_signal_emit (G_OBJECT (db), rhythmdb_signals[ENTRY_DELETED], 0, entry);
-		rhythmdb_entry_unref (entry);
+	if (deleted_entries != NULL) {
+		entries = entry_list_to_array (deleted_entries);
+		g_signal_emit (G_OBJECT (db), rhythmdb_signals[ENTRIES_DELETED], 0, entries);
+		for (i = 0; i < entries->len; i++) {
+			g_signal_emit (G_OBJECT (db), rhythmdb_signals[ENTRY_DELETED], 0, g_ptr_array_index (entries, i));
+		}
+		g_ptr_array_unref (entries);
 	}
 
-	if (changed_entries != NULL) {
-		g_hash_table_destroy (changed_entries);
-	}
 	g_list_free (added_entries);
 	g_list_free (deleted_entries);
 	return FALSE;
@@ -1546,11 +2036,63 @@ sync_entry_changed (RhythmDBEntry *entry,
 	}
 }
 
+static gboolean
+rhythmdb_flush_journal_idle (RhythmDB *db)
+{
+	GError *error = NULL;
+
+	g_mutex_lock (&db->priv->change_mutex);
+	db->priv->journal_flush_id = 0;
+	g_mutex_unlock (&db->priv->change_mutex);
+
+	if (rhythmdb_journal_flush (db->priv->journal, &error) == FALSE) {
+		rb_debug ("unable to flush journal: %s", error->message);
+		g_clear_error (&error);
+	}
+	return FALSE;
+}
+
+/* must be called with the change mutex held */
+static void
+rhythmdb_journal_changes (RhythmDB *db, GThread *thread)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+
+	/* changes made while replaying the journal are already in it */
+	if (db->priv->journal_replaying == FALSE || thread != db->priv->load_thread) {
+		g_hash_table_iter_init (&iter, db->priv->changed_entries);
+		while (g_hash_table_iter_next (&iter, &key, &value)) {
+			rhythmdb_journal_change_entry (db->priv->journal, db, key, value);
+		}
+	}
+
+	/* entries added by the load thread came from the database file or the journal.
+	 * deletions go first so an entry can be replaced by one with the same location.
+	 */
+	g_hash_table_iter_init (&iter, db->priv->deleted_entries);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		if (value == thread && thread != db->priv->load_thread)
+			rhythmdb_journal_delete_entry (db->priv->journal, db, key);
+	}
+
+	g_hash_table_iter_init (&iter, db->priv->added_entries);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		if (value == thread && thread != db->priv->load_thread)
+			rhythmdb_journal_add_entry (db->priv->journal, db, key);
+	}
+
+	if (db->priv->journal_flush_id == 0 && rhythmdb_journal_has_pending (db->priv->journal)) {
+		db->priv->journal_flush_id = g_timeout_add_seconds (RHYTHMDB_JOURNAL_FLUSH_DELAY,
+								    (GSourceFunc) rhythmdb_flush_journal_idle,
+								    db);
+	}
+}
 
 static void
-rhythmdb_commit_internal (RhythmDB *db,
-			  gboolean sync_changes,
-			  GThread *thread)
+rhythmdb_commit_now (RhythmDB *db,
+		     gboolean sync_changes,
+		     GThread *thread)
 {
 	/*
 	 * during normal operation, if committing from a worker thread,
@@ -1584,6 +2126,10 @@ rhythmdb_commit_internal (RhythmDB *db,
 		g_hash_table_foreach (db->priv->changed_entries, (GHFunc) sync_entry_changed, db);
 	}
 
+	if (db->priv->journal != NULL) {
+		rhythmdb_journal_changes (db, thread);
+	}
+
 	/* update the sets of entry changed/added/deleted signals to emit */
 	g_hash_table_foreach_remove (db->priv->changed_entries, (GHRFunc) process_changed_entries_cb, db);
 	g_hash_table_foreach_remove (db->priv->added_entries, (GHRFunc) process_added_entries_cb, db);
@@ -1598,6 +2144,40 @@ rhythmdb_commit_internal (RhythmDB *db,
 	g_mutex_unlock (&db->priv->change_mutex);
 }
 
+/* commits changes deferred while processing a batch of events */
+static void
+rhythmdb_commit_event_batch (RhythmDB *db)
+{
+	/* entry set events leave their commit to a timeout, but their changes
+	 * still have to be committed before events of the other sync class.
+	 */
+	if (db->priv->event_batch_commit || db->priv->event_batch_changes) {
+		db->priv->event_batch_commit = FALSE;
+		db->priv->event_batch_changes = FALSE;
+		rhythmdb_commit_now (db, db->priv->event_batch_sync, g_thread_self ());
+	}
+	g_hash_table_remove_all (db->priv->event_batch_uris);
+}
+
+void
+rhythmdb_commit_internal (RhythmDB *db,
+			  gboolean sync_changes,
+			  GThread *thread)
+{
+	/*
+	 * while processing a batch of events, commits made by the event handlers
+	 * are merged into one at the end of the batch.  whether the changes are
+	 * synced back to files depends on the type of event that made them
+	 * (see rhythmdb_event_can_batch), not on the handler's commit call.
+	 */
+	if (db->priv->event_batch_active && thread == g_thread_self () && rb_is_main_thread ()) {
+		db->priv->event_batch_commit = TRUE;
+		return;
+	}
+
+	rhythmdb_commit_now (db, sync_changes, thread);
+}
+
 typedef struct {
 	RhythmDB *db;
 	gboolean sync;
@@ -1643,26 +2223,129 @@ rhythmdb_commit (RhythmDB *db)
 }
 
 /**
- * rhythmdb_error_quark:
+ * rhythmdb_error_quark:
+ *
+ * Returns the #GQuark used for #RhythmDBError information
+ *
+ * Return value: error quark
+ */
+GQuark
+rhythmdb_error_quark (void)
+{
+	static GQuark quark;
+	if (!quark)
+		quark = g_quark_from_static_string ("rhythmdb_error");
+
+	return quark;
+}
+
+/* structure alignment magic, stolen from glib */
+#define STRUCT_ALIGNMENT	(2 * sizeof (gsize))
+#define ALIGN_STRUCT(offset) \
+	((offset + (STRUCT_ALIGNMENT - 1)) & -STRUCT_ALIGNMENT)
+
+static void
+free_entry_extra (RhythmDBEntryExtra *extra)
+{
+	rb_refstring_unref (extra->composer);
+	rb_refstring_unref (extra->comment);
+	rb_refstring_unref (extra->musicbrainz_trackid);
+	rb_refstring_unref (extra->musicbrainz_artistid);
+	rb_refstring_unref (extra->musicbrainz_albumid);
+	rb_refstring_unref (extra->musicbrainz_albumartistid);
+	rb_refstring_unref (extra->artist_sortname);
+	rb_refstring_unref (extra->composer_sortname);
+	rb_refstring_unref (extra->album_sortname);
+	rb_refstring_unref (extra->title_sortname);
+	rb_refstring_unref (extra->album_artist_sortname);
+	rb_refstring_unref (extra->playback_error);
+	g_free (extra);
+}
+
+/**
+ * rhythmdb_entry_get_writable_extra:
+ * @entry: a #RhythmDBEntry
+ *
+ * Returns the entry's rarely used fields, replacing the shared default
+ * instance with a private copy first if necessary.
+ *
+ * This should only be used by RhythmDB itself, or a backend (such as rhythmdb-tree).
+ *
+ * Returns: the entry's extra fields
+ */
+RhythmDBEntryExtra *
+rhythmdb_entry_get_writable_extra (RhythmDBEntry *entry)
+{
+	RhythmDBEntryExtra *extra;
+
+	if (entry->extra->shared == FALSE)
+		return entry->extra;
+
+	extra = g_new0 (RhythmDBEntryExtra, 1);
+	extra->composer = rb_refstring_ref (entry->extra->composer);
+	extra->comment = rb_refstring_ref (entry->extra->comment);
+	extra->musicbrainz_trackid = rb_refstring_ref (entry->extra->musicbrainz_trackid);
+	extra->musicbrainz_artistid = rb_refstring_ref (entry->extra->musicbrainz_artistid);
+	extra->musicbrainz_albumid = rb_refstring_ref (entry->extra->musicbrainz_albumid);
+	extra->musicbrainz_albumartistid = rb_refstring_ref (entry->extra->musicbrainz_albumartistid);
+	extra->artist_sortname = rb_refstring_ref (entry->extra->artist_sortname);
+	extra->composer_sortname = rb_refstring_ref (entry->extra->composer_sortname);
+	extra->album_sortname = rb_refstring_ref (entry->extra->album_sortname);
+	extra->title_sortname = rb_refstring_ref (entry->extra->title_sortname);
+	extra->album_artist_sortname = rb_refstring_ref (entry->extra->album_artist_sortname);
+	extra->bpm = entry->extra->bpm;
+	extra->track_gain = entry->extra->track_gain;
+	extra->track_peak = entry->extra->track_peak;
+	extra->album_gain = entry->extra->album_gain;
+	extra->album_peak = entry->extra->album_peak;
+	extra->playback_error = rb_refstring_ref (entry->extra->playback_error);
+
+	entry->extra = extra;
+	return extra;
+}
+
+/**
+ * rhythmdb_entry_get_memory_size:
+ * @entry: a #RhythmDBEntry
  *
- * Returns the #GQuark used for #RhythmDBError information
+ * Returns the number of bytes used by the entry itself, including its type
+ * data, extra fields and cached strings, but not the strings it refers to.
  *
- * Return value: error quark
+ * Returns: number of bytes used by the entry
  */
-GQuark
-rhythmdb_error_quark (void)
+gsize
+rhythmdb_entry_get_memory_size (RhythmDBEntry *entry)
 {
-	static GQuark quark;
-	if (!quark)
-		quark = g_quark_from_static_string ("rhythmdb_error");
+	guint type_data_size = 0;
+	gsize size = sizeof (RhythmDBEntry);
 
-	return quark;
+	g_object_get (entry->type, "type-data-size", &type_data_size, NULL);
+	if (type_data_size > 0)
+		size = ALIGN_STRUCT (sizeof (RhythmDBEntry)) + type_data_size;
+
+	if (entry->extra->shared == FALSE)
+		size += sizeof (RhythmDBEntryExtra);
+	if (entry->time_strings != NULL)
+		size += sizeof (RhythmDBEntryTimeStrings);
+	return size;
 }
 
-/* structure alignment magic, stolen from glib */
-#define STRUCT_ALIGNMENT	(2 * sizeof (gsize))
-#define ALIGN_STRUCT(offset) \
-	((offset + (STRUCT_ALIGNMENT - 1)) & -STRUCT_ALIGNMENT)
+static void
+set_extra_string (RhythmDBEntry *entry, gsize offset, RBRefString *str)
+{
+	RBRefString **slot;
+
+	/* don't unshare the extra fields just to store the same string */
+	slot = G_STRUCT_MEMBER_P (entry->extra, offset);
+	if (*slot == str) {
+		rb_refstring_unref (str);
+		return;
+	}
+
+	slot = G_STRUCT_MEMBER_P (rhythmdb_entry_get_writable_extra (entry), offset);
+	rb_refstring_unref (*slot);
+	*slot = str;
+}
 
 /**
  * rhythmdb_entry_allocate:
@@ -1697,20 +2380,10 @@ rhythmdb_entry_allocate (RhythmDB *db,
 	ret->title = rb_refstring_ref (db->priv->empty_string);
 	ret->genre = rb_refstring_ref (db->priv->empty_string);
 	ret->artist = rb_refstring_ref (db->priv->empty_string);
-	ret->composer = rb_refstring_ref (db->priv->empty_string);
 	ret->album = rb_refstring_ref (db->priv->empty_string);
-	ret->comment = rb_refstring_ref (db->priv->empty_string);
 	ret->album_artist = rb_refstring_ref (db->priv->empty_string);
-	ret->musicbrainz_trackid = rb_refstring_ref (db->priv->empty_string);
-	ret->musicbrainz_artistid = rb_refstring_ref (db->priv->empty_string);
-	ret->musicbrainz_albumid = rb_refstring_ref (db->priv->empty_string);
-	ret->musicbrainz_albumartistid = rb_refstring_ref (db->priv->empty_string);
-	ret->artist_sortname = rb_refstring_ref (db->priv->empty_string);
-	ret->composer_sortname = rb_refstring_ref (db->priv->empty_string);
-	ret->album_sortname = rb_refstring_ref (db->priv->empty_string);
-	ret->title_sortname = rb_refstring_ref (db->priv->empty_string);
-	ret->album_artist_sortname = rb_refstring_ref (db->priv->empty_string);
 	ret->media_type = rb_refstring_ref (db->priv->octet_stream_str);
+	ret->extra = db->priv->default_extra;
 
 	ret->flags |= RHYTHMDB_ENTRY_LAST_PLAYED_DIRTY |
 		      RHYTHMDB_ENTRY_FIRST_SEEN_DIRTY |
@@ -1893,23 +2566,22 @@ rhythmdb_entry_finalize (RhythmDBEntry *entry)
 	rhythmdb_entry_pre_destroy (entry);
 
 	rb_refstring_unref (entry->location);
-	rb_refstring_unref (entry->playback_error);
 	rb_refstring_unref (entry->title);
 	rb_refstring_unref (entry->genre);
 	rb_refstring_unref (entry->artist);
-	rb_refstring_unref (entry->composer);
 	rb_refstring_unref (entry->album);
-	rb_refstring_unref (entry->comment);
-	rb_refstring_unref (entry->musicbrainz_trackid);
-	rb_refstring_unref (entry->musicbrainz_artistid);
-	rb_refstring_unref (entry->musicbrainz_albumid);
-	rb_refstring_unref (entry->musicbrainz_albumartistid);
-	rb_refstring_unref (entry->artist_sortname);
-	rb_refstring_unref (entry->composer_sortname);
-	rb_refstring_unref (entry->album_sortname);
-	rb_refstring_unref (entry->title_sortname);
 	rb_refstring_unref (entry->media_type);
 
+	if (entry->extra->shared == FALSE)
+		free_entry_extra (entry->extra);
+
+	if (entry->time_strings != NULL) {
+		rb_refstring_unref (entry->time_strings->last_played_str);
+		rb_refstring_unref (entry->time_strings->first_seen_str);
+		rb_refstring_unref (entry->time_strings->last_seen_str);
+		g_free (entry->time_strings);
+	}
+
 	g_free (entry);
 }
 
@@ -1958,6 +2630,23 @@ set_metadata_string_with_default (RhythmDB *db,
 	g_value_unset (&val);
 }
 
+static void
+set_metadata_double (RhythmDB *db,
+		     RBMetaData *metadata,
+		     RhythmDBEntry *entry,
+		     RBMetaDataField field,
+		     RhythmDBPropType prop)
+{
+	GValue val = {0, };
+
+	if (rb_metadata_get (metadata, field, &val) == FALSE)
+		return;
+
+	if (G_VALUE_HOLDS_DOUBLE (&val))
+		rhythmdb_entry_set_internal (db, entry, TRUE, prop, &val);
+	g_value_unset (&val);
+}
+
 static void
 set_props_from_metadata (RhythmDB *db,
 			 RhythmDBEntry *entry,
@@ -2115,6 +2804,12 @@ set_props_from_metadata (RhythmDB *db,
 		g_value_unset (&val);
 	}
 
+	/* replaygain; keep any values we already have if the file isn't tagged */
+	set_metadata_double (db, metadata, entry, RB_METADATA_FIELD_TRACK_GAIN, RHYTHMDB_PROP_TRACK_GAIN);
+	set_metadata_double (db, metadata, entry, RB_METADATA_FIELD_TRACK_PEAK, RHYTHMDB_PROP_TRACK_PEAK);
+	set_metadata_double (db, metadata, entry, RB_METADATA_FIELD_ALBUM_GAIN, RHYTHMDB_PROP_ALBUM_GAIN);
+	set_metadata_double (db, metadata, entry, RB_METADATA_FIELD_ALBUM_PEAK, RHYTHMDB_PROP_ALBUM_PEAK);
+
 	/* album */
 	set_metadata_string_with_default (db, metadata, entry,
 					  RB_METADATA_FIELD_ALBUM,
@@ -2650,6 +3345,26 @@ rhythmdb_process_queued_entry_set_event (RhythmDB *db,
 	rhythmdb_add_timeout_commit (db, TRUE);
 }
 
+static void
+rhythmdb_process_load_progress (RhythmDB *db)
+{
+	guint count;
+
+	/* allow the loader to queue another event; any batches committed
+	 * since the last one was queued are reported by this one.
+	 */
+	g_atomic_int_set (&db->priv->load_progress_queued, 0);
+	count = g_atomic_int_get (&db->priv->load_count);
+
+	if (db->priv->load_progress_reported == FALSE) {
+		rb_debug ("startup: first %u entries available after %" G_GINT64_FORMAT " ms",
+			  count, (g_get_monotonic_time () - db->priv->load_start_time) / 1000);
+		db->priv->load_progress_reported = TRUE;
+	}
+
+	g_signal_emit (G_OBJECT (db), rhythmdb_signals[LOAD_PROGRESS], 0, count);
+}
+
 static void
 rhythmdb_process_one_event (RhythmDBEvent *event, RhythmDB *db)
 {
@@ -2689,8 +3404,15 @@ rhythmdb_process_one_event (RhythmDBEvent *event, RhythmDB *db)
 		rb_debug ("processing RHYTHMDB_EVENT_ENTRY_SET");
 		rhythmdb_process_queued_entry_set_event (db, event);
 		break;
+	case RHYTHMDB_EVENT_DB_LOAD_PROGRESS:
+		rb_debug ("processing RHYTHMDB_EVENT_DB_LOAD_PROGRESS");
+		rhythmdb_process_load_progress (db);
+		break;
 	case RHYTHMDB_EVENT_DB_LOAD:
 		rb_debug ("processing RHYTHMDB_EVENT_DB_LOAD");
+		rb_debug ("startup: %u entries loaded after %" G_GINT64_FORMAT " ms",
+			  (guint) g_atomic_int_get (&db->priv->load_count),
+			  (g_get_monotonic_time () - db->priv->load_start_time) / 1000);
 		g_signal_emit (G_OBJECT (db), rhythmdb_signals[LOAD_COMPLETE], 0);
 
 		/* save the db every five minutes */
@@ -2730,6 +3452,117 @@ rhythmdb_process_one_event (RhythmDBEvent *event, RhythmDB *db)
 }
 
 
+/* returns TRUE if an event can be processed without first committing earlier events in the batch */
+static gboolean
+rhythmdb_event_can_batch (RhythmDB *db, RhythmDBEvent *event)
+{
+	RBRefString *uri = NULL;
+	gboolean sync;
+
+	switch (event->type) {
+	case RHYTHMDB_EVENT_STAT:
+		uri = event->real_uri ? event->real_uri : event->uri;
+		sync = TRUE;
+		break;
+
+	case RHYTHMDB_EVENT_METADATA_LOAD:
+	case RHYTHMDB_EVENT_METADATA_CACHE:
+		/* changes read from the file must not be written back to it */
+		uri = event->real_uri ? event->real_uri : event->uri;
+		sync = FALSE;
+		break;
+
+	case RHYTHMDB_EVENT_ENTRY_SET:
+		sync = TRUE;
+		break;
+
+	default:
+		/* signals and barriers need to see the results of everything before them */
+		return FALSE;
+	}
+
+	if (db->priv->event_batch_changes && db->priv->event_batch_sync != sync)
+		return FALSE;
+
+	/* entries added earlier in the batch can't be found by location until
+	 * they're committed, so a second event for the same file has to wait.
+	 */
+	if (uri != NULL) {
+		if (g_hash_table_contains (db->priv->event_batch_uris, uri))
+			return FALSE;
+		g_hash_table_add (db->priv->event_batch_uris, rb_refstring_ref (uri));
+	}
+
+	db->priv->event_batch_changes = TRUE;
+	db->priv->event_batch_sync = sync;
+	return TRUE;
+}
+
+static void
+rhythmdb_process_events (RhythmDBEvent *event, RhythmDB *db)
+{
+	gint64 start;
+	gint64 elapsed;
+	guint count = 0;
+	int bucket;
+
+	start = g_get_monotonic_time ();
+	db->priv->event_batch_active = TRUE;
+
+	/* process events until the queue is empty or the time slice is used up,
+	 * so the main loop still gets to run during large imports.
+	 */
+	do {
+		if (rhythmdb_event_can_batch (db, event) == FALSE) {
+			rhythmdb_commit_event_batch (db);
+			rhythmdb_event_can_batch (db, event);
+		}
+
+		rhythmdb_process_one_event (event, db);
+		count++;
+
+		if (count >= RHYTHMDB_EVENT_BATCH_MAX ||
+		    g_get_monotonic_time () - start >= RHYTHMDB_EVENT_BATCH_TIME)
+			break;
+	} while ((event = g_async_queue_try_pop (db->priv->event_queue)) != NULL);
+
+	rhythmdb_commit_event_batch (db);
+	db->priv->event_batch_active = FALSE;
+
+	elapsed = g_get_monotonic_time () - start;
+	db->priv->event_batches++;
+	db->priv->event_batch_events += count;
+	db->priv->event_batch_time += elapsed;
+	db->priv->event_batch_max_time = MAX (db->priv->event_batch_max_time, elapsed);
+	for (bucket = 0; bucket < 4; bucket++) {
+		if (elapsed < (1000 << (bucket * 2)))
+			break;
+	}
+	db->priv->event_batch_latency[bucket]++;
+
+	if (elapsed > RHYTHMDB_EVENT_BATCH_SLOW) {
+		rb_debug ("slow event batch: %u events took %" G_GINT64_FORMAT " ms", count, elapsed / 1000);
+	}
+}
+
+/**
+ * rhythmdb_get_event_stats:
+ * @db: the #RhythmDB
+ * @stats: returns event processing statistics
+ *
+ * Returns counts and timings of the batches of events processed on the
+ * main thread, to show how long the main loop is held up during imports.
+ */
+void
+rhythmdb_get_event_stats (RhythmDB *db, RhythmDBEventStats *stats)
+{
+	stats->batches = db->priv->event_batches;
+	stats->events = db->priv->event_batch_events;
+	stats->mean_batch_ms = db->priv->event_batches ? (db->priv->event_batch_time / 1000.0) / db->priv->event_batches : 0.0;
+	stats->max_batch_ms = db->priv->event_batch_max_time / 1000.0;
+	memcpy (stats->latency, db->priv->event_batch_latency, sizeof (stats->latency));
+}
+
 static void
 rhythmdb_file_info_query (RhythmDB *db, GFile *file, RhythmDBEvent *event)
 {
@@ -2911,8 +3744,6 @@ rhythmdb_execute_load (RhythmDB *db,
 					  &event->error);
 		}
 	}
-
-	rhythmdb_push_event (db, event);
 }
 
 static void
@@ -2921,6 +3752,7 @@ rhythmdb_execute_enum_dir (RhythmDB *db,
 {
 	GFile *dir;
 	GFileEnumerator *dir_enum;
+	GPtrArray *child_uris;
 	GError *error = NULL;
 
 	dir = g_file_new_for_uri (rb_refstring_get (action->uri));
@@ -2943,6 +3775,7 @@ rhythmdb_execute_enum_dir (RhythmDB *db,
 		return;
 	}
 
+	child_uris = g_ptr_array_new_with_free_func (g_free);
 	while (1) {
 		RhythmDBEvent *result;
 		GFileInfo *file_info;
@@ -2981,8 +3814,18 @@ rhythmdb_execute_enum_dir (RhythmDB *db,
 		result->error = error;
 
 		rhythmdb_push_event (db, result);
-		g_free (child_uri);
+		g_ptr_array_add (child_uris, child_uri);
+	}
+
+	/* files in the directory are about to be loaded, so fetch any cached
+	 * metadata for them in one go.
+	 */
+	if (child_uris->len > 0 && action->data.types.entry_type != NULL) {
+		g_ptr_array_add (child_uris, NULL);
+		rhythmdb_entry_type_prefetch_metadata (action->data.types.entry_type,
+						       (const char * const *)child_uris->pdata);
 	}
+	g_ptr_array_free (child_uris, TRUE);
 
 	g_file_enumerator_close (dir_enum, db->priv->exiting, &error);
 	if (error != NULL) {
@@ -3060,10 +3903,107 @@ emit_save_error_idle (RhythmDBSaveErrorData *data)
 	return FALSE;
 }
 
+/*
+ * assigns the sequence number for a metadata load, waiting while the
+ * reorder window is full.
+ */
+guint
+rhythmdb_reserve_metadata_seq (RhythmDB *db)
+{
+	guint seq;
+
+	g_mutex_lock (&db->priv->metadata_order_mutex);
+	while (db->priv->metadata_next_seq - db->priv->metadata_deliver_seq >= RHYTHMDB_METADATA_REORDER_WINDOW) {
+		g_cond_wait (&db->priv->metadata_order_cond, &db->priv->metadata_order_mutex);
+	}
+	seq = db->priv->metadata_next_seq++;
+	g_mutex_unlock (&db->priv->metadata_order_mutex);
+	return seq;
+}
+
+/*
+ * metadata loads complete out of order on the worker pool, but the events
+ * are delivered to the main thread in the order the loads were queued.
+ * a NULL event just advances the sequence.
+ */
+void
+rhythmdb_deliver_metadata_event (RhythmDB *db, guint seq, RhythmDBEvent *event)
+{
+	guint delivered;
+
+	gpointer next;
+
+	g_mutex_lock (&db->priv->metadata_order_mutex);
+	delivered = db->priv->metadata_deliver_seq;
+	g_hash_table_insert (db->priv->metadata_completed, GUINT_TO_POINTER (seq), event);
+	while (g_hash_table_lookup_extended (db->priv->metadata_completed,
+					     GUINT_TO_POINTER (db->priv->metadata_deliver_seq),
+					     NULL,
+					     &next)) {
+		g_hash_table_remove (db->priv->metadata_completed, GUINT_TO_POINTER (db->priv->metadata_deliver_seq));
+		db->priv->metadata_deliver_seq++;
+		if (next != NULL)
+			rhythmdb_push_event (db, next);
+	}
+	if (db->priv->metadata_deliver_seq != delivered)
+		g_cond_broadcast (&db->priv->metadata_order_cond);
+	g_mutex_unlock (&db->priv->metadata_order_mutex);
+}
+
+static void
+metadata_worker_main (RhythmDBMetadataTask *task, RhythmDB *db)
+{
+	if (g_cancellable_is_cancelled (db->priv->exiting)) {
+		rhythmdb_event_free (db, task->event);
+		rhythmdb_deliver_metadata_event (db, task->seq, NULL);
+	} else {
+		rb_debug ("executing RHYTHMDB_ACTION_LOAD for \"%s\"", rb_refstring_get (task->action->uri));
+		rhythmdb_execute_load (db, rb_refstring_get (task->action->uri), task->event);
+		rhythmdb_deliver_metadata_event (db, task->seq, task->event);
+	}
+
+	rhythmdb_action_free (db, task->action);
+	g_slice_free (RhythmDBMetadataTask, task);
+}
+
+static GThreadPool *
+create_metadata_pool (RhythmDB *db)
+{
+	GThreadPool *pool;
+	GError *error = NULL;
+	guint workers;
+
+	workers = db->priv->metadata_workers;
+	if (workers == 0)
+		workers = CLAMP (g_get_num_processors (), 1, RHYTHMDB_MAX_AUTO_METADATA_WORKERS);
+
+	db->priv->metadata_next_seq = 0;
+	db->priv->metadata_deliver_seq = 0;
+	db->priv->metadata_completed = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	pool = g_thread_pool_new ((GFunc) metadata_worker_main, db, workers, FALSE, &error);
+	if (pool == NULL) {
+		/* loads will run on the action thread instead */
+		g_warning ("Unable to create metadata worker threads: %s", error->message);
+		g_error_free (error);
+		return NULL;
+	}
+
+	rb_debug ("using %u metadata workers", workers);
+	return pool;
+}
+
 static gpointer
 action_thread_main (RhythmDB *db)
 {
 	RhythmDBEvent *result;
+	GThreadPool *metadata_pool;
+
+	/* this thread handles stat and directory enumeration actions itself,
+	 * and hands metadata loads off to the worker pool, so scanning
+	 * directories doesn't have to wait for tag parsing.
+	 */
+	metadata_pool = create_metadata_pool (db);
 
 	while (!g_cancellable_is_cancelled (db->priv->exiting)) {
 		RhythmDBAction *action;
@@ -3094,9 +4034,24 @@ action_thread_main (RhythmDB *db)
 				result->error_type = action->data.types.error_type;
 				result->ignore_type = action->data.types.ignore_type;
 
+				if (metadata_pool != NULL) {
+					RhythmDBMetadataTask *task;
+
+					task = g_slice_new0 (RhythmDBMetadataTask);
+					task->action = action;
+					task->event = result;
+					task->seq = rhythmdb_reserve_metadata_seq (db);
+					g_thread_pool_push (metadata_pool, task, NULL);
+
+					/* the worker frees the action */
+					action = NULL;
+					break;
+				}
+
 				rb_debug ("executing RHYTHMDB_ACTION_LOAD for \"%s\"", rb_refstring_get (action->uri));
 
 				rhythmdb_execute_load (db, rb_refstring_get (action->uri), result);
+				rhythmdb_push_event (db, result);
 				break;
 
 			case RHYTHMDB_ACTION_ENUM_DIR:
@@ -3145,7 +4100,15 @@ action_thread_main (RhythmDB *db)
 			}
 		}
 
-		rhythmdb_action_free (db, action);
+		if (action != NULL)
+			rhythmdb_action_free (db, action);
+	}
+
+	/* queued loads see the cancellation and finish immediately */
+	if (metadata_pool != NULL) {
+		g_thread_pool_free (metadata_pool, FALSE, TRUE);
+		g_hash_table_destroy (db->priv->metadata_completed);
+		db->priv->metadata_completed = NULL;
 	}
 
 	rb_debug ("exiting action thread");
@@ -3263,6 +4226,50 @@ rhythmdb_add_uri_with_types (RhythmDB *db,
 	}
 }
 
+/*
+ * rhythmdb_add_file_info_with_types:
+ * @db: a #RhythmDB.
+ * @uri: the URI of the file to add
+ * @info: file information for @uri, including RHYTHMDB_FILE_INFO_ATTRIBUTES
+ * @type: the #RhythmDBEntryType to use for new entries
+ * @ignore_type: the #RhythmDBEntryType to use for ignored files
+ * @error_type: the #RhythmDBEntryType to use for import errors
+ *
+ * Adds a file whose details have already been queried, such as one found
+ * while listing a directory.  This skips the stat action, going straight
+ * to loading metadata if the file is new or has changed.
+ */
+void
+rhythmdb_add_file_info_with_types (RhythmDB *db,
+				   const char *uri,
+				   GFileInfo *info,
+				   RhythmDBEntryType *type,
+				   RhythmDBEntryType *ignore_type,
+				   RhythmDBEntryType *error_type)
+{
+	RhythmDBEvent *event;
+
+	g_mutex_lock (&db->priv->stat_mutex);
+	if (db->priv->action_thread_running == FALSE) {
+		g_mutex_unlock (&db->priv->stat_mutex);
+		rhythmdb_add_uri_with_types (db, uri, type, ignore_type, error_type);
+		return;
+	}
+	g_mutex_unlock (&db->priv->stat_mutex);
+
+	rb_debug ("queueing stat event for \"%s\"", uri);
+	event = g_slice_new0 (RhythmDBEvent);
+	event->db = db;
+	event->type = RHYTHMDB_EVENT_STAT;
+	event->entry_type = type;
+	event->ignore_type = ignore_type;
+	event->error_type = error_type;
+	event->real_uri = rb_refstring_new (uri);
+	event->file_info = g_object_ref (info);
+
+	rhythmdb_push_event (db, event);
+}
+
 
 static gboolean
 rhythmdb_sync_library_idle (RhythmDB *db)
@@ -3300,6 +4307,22 @@ rhythmdb_load_thread_main (RhythmDB *db)
 		if (error) {
 			g_idle_add ((GSourceFunc) rhythmdb_load_error_cb, error);
 		}
+	} else if (db->priv->journal != NULL) {
+		guint count;
+
+		rb_profile_start ("replaying journal");
+		db->priv->journal_replaying = TRUE;
+		if (rhythmdb_journal_replay (db->priv->journal, db, db->priv->exiting, &count, &error) == FALSE) {
+			g_warning ("Unable to replay database journal: %s", error->message);
+			g_clear_error (&error);
+		} else if (count > 0) {
+			rb_debug ("replayed %u journal records", count);
+
+			/* the database file doesn't include the replayed changes */
+			db->priv->dirty = TRUE;
+		}
+		db->priv->journal_replaying = FALSE;
+		rb_profile_end ("replaying journal");
 	}
 	g_mutex_unlock (&db->priv->saving_mutex);
 
@@ -3323,15 +4346,52 @@ rhythmdb_load_thread_main (RhythmDB *db)
 	return NULL;
 }
 
+/*
+ * called by database implementations from the load thread after committing
+ * a batch of loaded entries.
+ */
+void
+rhythmdb_load_batch_committed (RhythmDB *db, guint count)
+{
+	RhythmDBEvent *event;
+
+	g_atomic_int_add (&db->priv->load_count, count);
+
+	/* only keep one progress event queued at a time */
+	if (db->priv->progressive_load == FALSE ||
+	    g_atomic_int_compare_and_exchange (&db->priv->load_progress_queued, 0, 1) == FALSE)
+		return;
+
+	event = g_slice_new0 (RhythmDBEvent);
+	event->db = db;
+	event->type = RHYTHMDB_EVENT_DB_LOAD_PROGRESS;
+	rhythmdb_push_event (db, event);
+}
+
 /**
  * rhythmdb_load:
  * @db: a #RhythmDB.
  *
- * Load the database from disk.
+ * Load the database from disk.  If #RhythmDB:progressive-load is set,
+ * #RhythmDB::load-progress is emitted as entries become available,
+ * before #RhythmDB::load-complete.
  */
 void
 rhythmdb_load (RhythmDB *db)
 {
+	db->priv->load_start_time = g_get_monotonic_time ();
+	db->priv->load_count = 0;
+	db->priv->load_progress_queued = 0;
+	db->priv->load_progress_reported = FALSE;
+
+	if (db->priv->use_journal && db->priv->journal == NULL && db->priv->name != NULL) {
+		char *filename;
+
+		filename = rhythmdb_journal_get_filename (db->priv->name);
+		db->priv->journal = rhythmdb_journal_new (filename);
+		g_free (filename);
+	}
+
 	db->priv->load_thread = rhythmdb_thread_create (db, (GThreadFunc) rhythmdb_load_thread_main, db);
 }
 
@@ -3362,7 +4422,11 @@ rhythmdb_save_thread_main (RhythmDB *db)
 	rb_debug ("saving rhythmdb");
 
 	klass = RHYTHMDB_GET_CLASS (db);
+	if (db->priv->journal != NULL)
+		rhythmdb_journal_begin_compaction (db->priv->journal);
 	klass->impl_save (db);
+	if (db->priv->journal != NULL)
+		rhythmdb_journal_end_compaction (db->priv->journal);
 
 	db->priv->saving = FALSE;
 	db->priv->dirty = FALSE;
@@ -3583,8 +4647,13 @@ rhythmdb_entry_set_internal (RhythmDB *db,
 		break;
 	}
 
-	if (nop == FALSE && (entry->flags & RHYTHMDB_ENTRY_INSERTED) && notify_if_inserted) {
-		record_entry_change (db, entry, propid, &old_value, value);
+	if (nop == FALSE && (entry->flags & RHYTHMDB_ENTRY_INSERTED)) {
+		if (notify_if_inserted) {
+			record_entry_change (db, entry, propid, &old_value, value);
+		} else if (db->priv->journal != NULL) {
+			/* changes without notification don't go through the commit path */
+			rhythmdb_journal_set_property (db->priv->journal, db, entry, propid, value);
+		}
 	}
 	g_value_unset (&old_value);
 
@@ -3633,22 +4702,20 @@ rhythmdb_entry_set_internal (RhythmDB *db,
 			entry->genre = rb_refstring_new (g_value_get_string (value));
 			break;
 		case RHYTHMDB_PROP_COMMENT:
-			if (entry->comment != NULL) {
-				rb_refstring_unref (entry->comment);
-			}
-			entry->comment = rb_refstring_new (g_value_get_string (value));
+			set_extra_string (entry, G_STRUCT_OFFSET (RhythmDBEntryExtra, comment),
+					  rb_refstring_new (g_value_get_string (value)));
 			break;
 		case RHYTHMDB_PROP_TRACK_NUMBER:
-			entry->tracknum = g_value_get_ulong (value);
+			entry->tracknum = MIN (g_value_get_ulong (value), G_MAXUINT16);
 			break;
 		case RHYTHMDB_PROP_TRACK_TOTAL:
-			entry->tracktotal = g_value_get_ulong (value);
+			entry->tracktotal = MIN (g_value_get_ulong (value), G_MAXUINT16);
 			break;
 		case RHYTHMDB_PROP_DISC_NUMBER:
-			entry->discnum = g_value_get_ulong (value);
+			entry->discnum = MIN (g_value_get_ulong (value), G_MAXUINT16);
 			break;
 		case RHYTHMDB_PROP_DISC_TOTAL:
-			entry->disctotal = g_value_get_ulong (value);
+			entry->disctotal = MIN (g_value_get_ulong (value), G_MAXUINT16);
 			break;
 		case RHYTHMDB_PROP_DURATION:
 			entry->duration = g_value_get_ulong (value);
@@ -3667,27 +4734,31 @@ rhythmdb_entry_set_internal (RhythmDB *db,
 			break;
 		}
 		case RHYTHMDB_PROP_TRACK_GAIN:
-			g_warning ("RHYTHMDB_PROP_TRACK_GAIN no longer supported");
+			if (entry->extra->track_gain != g_value_get_double (value))
+				rhythmdb_entry_get_writable_extra (entry)->track_gain = g_value_get_double (value);
 			break;
 		case RHYTHMDB_PROP_TRACK_PEAK:
-			g_warning ("RHYTHMDB_PROP_TRACK_PEAK no longer supported");
+			if (entry->extra->track_peak != g_value_get_double (value))
+				rhythmdb_entry_get_writable_extra (entry)->track_peak = g_value_get_double (value);
 			break;
 		case RHYTHMDB_PROP_ALBUM_GAIN:
-			g_warning ("RHYTHMDB_PROP_ALBUM_GAIN no longer supported");
+			if (entry->extra->album_gain != g_value_get_double (value))
+				rhythmdb_entry_get_writable_extra (entry)->album_gain = g_value_get_double (value);
 			break;
 		case RHYTHMDB_PROP_ALBUM_PEAK:
-			g_warning ("RHYTHMDB_PROP_ALBUM_PEAK no longer supported");
+			if (entry->extra->album_peak != g_value_get_double (value))
+				rhythmdb_entry_get_writable_extra (entry)->album_peak = g_value_get_double (value);
 			break;
 		case RHYTHMDB_PROP_LOCATION:
 			rb_refstring_unref (entry->location);
 			entry->location = rb_refstring_new (g_value_get_string (value));
 			break;
 		case RHYTHMDB_PROP_PLAYBACK_ERROR:
-			rb_refstring_unref (entry->playback_error);
 			if (g_value_get_string (value))
-				entry->playback_error = rb_refstring_new (g_value_get_string (value));
+				set_extra_string (entry, G_STRUCT_OFFSET (RhythmDBEntryExtra, playback_error),
+						  rb_refstring_new (g_value_get_string (value)));
 			else
-				entry->playback_error = NULL;
+				set_extra_string (entry, G_STRUCT_OFFSET (RhythmDBEntryExtra, playback_error), NULL);
 			break;
 		case RHYTHMDB_PROP_MOUNTPOINT:
 			if (entry->mountpoint != NULL) {
@@ -3729,51 +4800,52 @@ rhythmdb_entry_set_internal (RhythmDB *db,
 			entry->flags |= RHYTHMDB_ENTRY_LAST_PLAYED_DIRTY;
 			break;
 		case RHYTHMDB_PROP_BPM:
-			entry->bpm = g_value_get_double (value);
+			if (entry->extra->bpm != g_value_get_double (value))
+				rhythmdb_entry_get_writable_extra (entry)->bpm = g_value_get_double (value);
 			break;
 		case RHYTHMDB_PROP_MUSICBRAINZ_TRACKID:
-			rb_refstring_unref (entry->musicbrainz_trackid);
-			entry->musicbrainz_trackid = rb_refstring_new (g_value_get_string (value));
+			set_extra_string (entry, G_STRUCT_OFFSET (RhythmDBEntryExtra, musicbrainz_trackid),
+					  rb_refstring_new (g_value_get_string (value)));
 			break;
 		case RHYTHMDB_PROP_MUSICBRAINZ_ARTISTID:
-			rb_refstring_unref (entry->musicbrainz_artistid);
-			entry->musicbrainz_artistid = rb_refstring_new (g_value_get_string (value));
+			set_extra_string (entry, G_STRUCT_OFFSET (RhythmDBEntryExtra, musicbrainz_artistid),
+					  rb_refstring_new (g_value_get_string (value)));
 			break;
 		case RHYTHMDB_PROP_MUSICBRAINZ_ALBUMID:
-			rb_refstring_unref (entry->musicbrainz_albumid);
-			entry->musicbrainz_albumid = rb_refstring_new (g_value_get_string (value));
+			set_extra_string (entry, G_STRUCT_OFFSET (RhythmDBEntryExtra, musicbrainz_albumid),
+					  rb_refstring_new (g_value_get_string (value)));
 			break;
 		case RHYTHMDB_PROP_MUSICBRAINZ_ALBUMARTISTID:
-			rb_refstring_unref (entry->musicbrainz_albumartistid);
-			entry->musicbrainz_albumartistid = rb_refstring_new (g_value_get_string (value));
+			set_extra_string (entry, G_STRUCT_OFFSET (RhythmDBEntryExtra, musicbrainz_albumartistid),
+					  rb_refstring_new (g_value_get_string (value)));
 			break;
 		case RHYTHMDB_PROP_ARTIST_SORTNAME:
-			rb_refstring_unref (entry->artist_sortname);
-			entry->artist_sortname = rb_refstring_new (g_value_get_string (value));
+			set_extra_string (entry, G_STRUCT_OFFSET (RhythmDBEntryExtra, artist_sortname),
+					  rb_refstring_new (g_value_get_string (value)));
 			break;
 		case RHYTHMDB_PROP_ALBUM_SORTNAME:
-			rb_refstring_unref (entry->album_sortname);
-			entry->album_sortname = rb_refstring_new (g_value_get_string (value));
+			set_extra_string (entry, G_STRUCT_OFFSET (RhythmDBEntryExtra, album_sortname),
+					  rb_refstring_new (g_value_get_string (value)));
 			break;
 		case RHYTHMDB_PROP_TITLE_SORTNAME:
-			rb_refstring_unref (entry->title_sortname);
-			entry->title_sortname = rb_refstring_new (g_value_get_string (value));
+			set_extra_string (entry, G_STRUCT_OFFSET (RhythmDBEntryExtra, title_sortname),
+					  rb_refstring_new (g_value_get_string (value)));
 			break;
 		case RHYTHMDB_PROP_ALBUM_ARTIST:
 			rb_refstring_unref (entry->album_artist);
 			entry->album_artist = rb_refstring_new (g_value_get_string (value));
 			break;
 		case RHYTHMDB_PROP_ALBUM_ARTIST_SORTNAME:
-			rb_refstring_unref (entry->album_artist_sortname);
-			entry->album_artist_sortname = rb_refstring_new (g_value_get_string (value));
+			set_extra_string (entry, G_STRUCT_OFFSET (RhythmDBEntryExtra, album_artist_sortname),
+					  rb_refstring_new (g_value_get_string (value)));
 			break;
 		case RHYTHMDB_PROP_COMPOSER:
-			rb_refstring_unref (entry->composer);
-			entry->composer = rb_refstring_new (g_value_get_string (value));
+			set_extra_string (entry, G_STRUCT_OFFSET (RhythmDBEntryExtra, composer),
+					  rb_refstring_new (g_value_get_string (value)));
 			break;
 		case RHYTHMDB_PROP_COMPOSER_SORTNAME:
-			rb_refstring_unref (entry->composer_sortname);
-			entry->composer_sortname = rb_refstring_new (g_value_get_string (value));
+			set_extra_string (entry, G_STRUCT_OFFSET (RhythmDBEntryExtra, composer_sortname),
+					  rb_refstring_new (g_value_get_string (value)));
 			break;
 		case RHYTHMDB_PROP_HIDDEN:
 			if (g_value_get_boolean (value)) {
@@ -3867,6 +4939,25 @@ rhythmdb_entry_sync_mirrored (RhythmDBEntry *entry,
 	if (never == NULL)
 		never = _("Never");
 
+	switch (propid) {
+	case RHYTHMDB_PROP_LAST_PLAYED_STR:
+	case RHYTHMDB_PROP_FIRST_SEEN_STR:
+	case RHYTHMDB_PROP_LAST_SEEN_STR:
+		/* most entries are never displayed, so only allocate space
+		 * for the strings when they're first asked for.
+		 */
+		if (g_atomic_pointer_get (&entry->time_strings) == NULL) {
+			RhythmDBEntryTimeStrings *strings;
+
+			strings = g_new0 (RhythmDBEntryTimeStrings, 1);
+			if (g_atomic_pointer_compare_and_exchange (&entry->time_strings, NULL, strings) == FALSE)
+				g_free (strings);
+		}
+		break;
+	default:
+		return;
+	}
+
 	switch (propid) {
 	case RHYTHMDB_PROP_LAST_PLAYED_STR:
 	{
@@ -3875,7 +4966,7 @@ rhythmdb_entry_sync_mirrored (RhythmDBEntry *entry,
 		if (!(entry->flags & RHYTHMDB_ENTRY_LAST_PLAYED_DIRTY))
 			break;
 
-		old = g_atomic_pointer_get (&entry->last_played_str);
+		old = g_atomic_pointer_get (&entry->time_strings->last_played_str);
 		if (entry->last_played == 0) {
 			new = rb_refstring_new (never);
 		} else {
@@ -3884,7 +4975,7 @@ rhythmdb_entry_sync_mirrored (RhythmDBEntry *entry,
 			g_free (val);
 		}
 
-		if (g_atomic_pointer_compare_and_exchange (&entry->last_played_str, old, new)) {
+		if (g_atomic_pointer_compare_and_exchange (&entry->time_strings->last_played_str, old, new)) {
 			if (old != NULL) {
 				rb_refstring_unref (old);
 			}
@@ -3901,7 +4992,7 @@ rhythmdb_entry_sync_mirrored (RhythmDBEntry *entry,
 		if (!(entry->flags & RHYTHMDB_ENTRY_FIRST_SEEN_DIRTY))
 			break;
 
-		old = g_atomic_pointer_get (&entry->first_seen_str);
+		old = g_atomic_pointer_get (&entry->time_strings->first_seen_str);
  		if (entry->first_seen == 0) {
 			new = rb_refstring_new (never);
  		} else {
@@ -3910,7 +5001,7 @@ rhythmdb_entry_sync_mirrored (RhythmDBEntry *entry,
  			g_free (val);
  		}
 
-		if (g_atomic_pointer_compare_and_exchange (&entry->first_seen_str, old, new)) {
+		if (g_atomic_pointer_compare_and_exchange (&entry->time_strings->first_seen_str, old, new)) {
 			if (old != NULL) {
 				rb_refstring_unref (old);
 			}
@@ -3927,7 +5018,7 @@ rhythmdb_entry_sync_mirrored (RhythmDBEntry *entry,
 		if (!(entry->flags & RHYTHMDB_ENTRY_LAST_SEEN_DIRTY))
 			break;
 
-		old = g_atomic_pointer_get (&entry->last_seen_str);
+		old = g_atomic_pointer_get (&entry->time_strings->last_seen_str);
 		/* only store last seen time as a string for hidden entries */
 		if (entry->flags & RHYTHMDB_ENTRY_HIDDEN) {
 			val = rb_utf_friendly_time (entry->last_seen);
@@ -3937,7 +5028,7 @@ rhythmdb_entry_sync_mirrored (RhythmDBEntry *entry,
 			new = NULL;
 		}
 
-		if (g_atomic_pointer_compare_and_exchange (&entry->last_seen_str, old, new)) {
+		if (g_atomic_pointer_compare_and_exchange (&entry->time_strings->last_seen_str, old, new)) {
 			if (old != NULL) {
 				rb_refstring_unref (old);
 			}
@@ -4530,6 +5621,13 @@ void
 rhythmdb_emit_entry_deleted (RhythmDB *db,
 			     RhythmDBEntry *entry)
 {
+	GPtrArray *entries;
+
+	entries = g_ptr_array_new ();
+	g_ptr_array_add (entries, entry);
+	g_signal_emit (G_OBJECT (db), rhythmdb_signals[ENTRIES_DELETED], 0, entries);
+	g_ptr_array_unref (entries);
+
 	g_signal_emit (G_OBJECT (db), rhythmdb_signals[ENTRY_DELETED], 0, entry);
 }
 
@@ -4663,17 +5761,6 @@ rhythmdb_entry_gather_metadata (RhythmDB *db,
 			continue;
 		}
 
-		/* skip deprecated properties */
-		switch (prop) {
-		case RHYTHMDB_PROP_TRACK_GAIN:
-		case RHYTHMDB_PROP_TRACK_PEAK:
-		case RHYTHMDB_PROP_ALBUM_GAIN:
-		case RHYTHMDB_PROP_ALBUM_PEAK:
-			continue;
-		default:
-			break;
-		}
-
 		g_value_init (&value, value_type);
 		rhythmdb_entry_get (db, entry, prop, &value);
 		name = (char *)rhythmdb_nice_elt_name_from_propid (db, prop);
@@ -4909,11 +5996,24 @@ rhythmdb_entry_set_visibility (RhythmDB *db,
 static gboolean
 rhythmdb_idle_save (RhythmDB *db)
 {
-	if (db->priv->dirty) {
-		rb_debug ("database is dirty, doing regular save");
-		rhythmdb_save_async (db);
+	GError *error = NULL;
+
+	if (db->priv->dirty == FALSE)
+		return TRUE;
+
+	if (db->priv->journal != NULL &&
+	    rhythmdb_journal_get_size (db->priv->journal) < RHYTHMDB_JOURNAL_COMPACT_SIZE) {
+		if (rhythmdb_journal_flush (db->priv->journal, &error)) {
+			rb_debug ("database is dirty, changes are in the journal");
+			return TRUE;
+		}
+
+		rb_debug ("unable to flush journal: %s", error->message);
+		g_clear_error (&error);
 	}
 
+	rb_debug ("database is dirty, doing regular save");
+	rhythmdb_save_async (db);
 	return TRUE;
 }
 
@@ -4997,29 +6097,29 @@ rhythmdb_entry_get_string (RhythmDBEntry *entry,
 	case RHYTHMDB_PROP_GENRE:
 		return rb_refstring_get (entry->genre);
 	case RHYTHMDB_PROP_COMMENT:
-		return rb_refstring_get (entry->comment);
+		return rb_refstring_get (entry->extra->comment);
 	case RHYTHMDB_PROP_MUSICBRAINZ_TRACKID:
-		return rb_refstring_get (entry->musicbrainz_trackid);
+		return rb_refstring_get (entry->extra->musicbrainz_trackid);
 	case RHYTHMDB_PROP_MUSICBRAINZ_ARTISTID:
-		return rb_refstring_get (entry->musicbrainz_artistid);
+		return rb_refstring_get (entry->extra->musicbrainz_artistid);
 	case RHYTHMDB_PROP_MUSICBRAINZ_ALBUMID:
-		return rb_refstring_get (entry->musicbrainz_albumid);
+		return rb_refstring_get (entry->extra->musicbrainz_albumid);
 	case RHYTHMDB_PROP_MUSICBRAINZ_ALBUMARTISTID:
-		return rb_refstring_get (entry->musicbrainz_albumartistid);
+		return rb_refstring_get (entry->extra->musicbrainz_albumartistid);
 	case RHYTHMDB_PROP_ARTIST_SORTNAME:
-		return rb_refstring_get (entry->artist_sortname);
+		return rb_refstring_get (entry->extra->artist_sortname);
 	case RHYTHMDB_PROP_ALBUM_SORTNAME:
-		return rb_refstring_get (entry->album_sortname);
+		return rb_refstring_get (entry->extra->album_sortname);
 	case RHYTHMDB_PROP_TITLE_SORTNAME:
-		return rb_refstring_get (entry->title_sortname);
+		return rb_refstring_get (entry->extra->title_sortname);
 	case RHYTHMDB_PROP_ALBUM_ARTIST:
 		return rb_refstring_get (entry->album_artist);
 	case RHYTHMDB_PROP_ALBUM_ARTIST_SORTNAME:
-		return rb_refstring_get (entry->album_artist_sortname);
+		return rb_refstring_get (entry->extra->album_artist_sortname);
 	case RHYTHMDB_PROP_COMPOSER:
-		return rb_refstring_get (entry->composer);
+		return rb_refstring_get (entry->extra->composer);
 	case RHYTHMDB_PROP_COMPOSER_SORTNAME:
-		return rb_refstring_get (entry->composer_sortname);
+		return rb_refstring_get (entry->extra->composer_sortname);
 	case RHYTHMDB_PROP_MEDIA_TYPE:
 		return rb_refstring_get (entry->media_type);
 	case RHYTHMDB_PROP_TITLE_SORT_KEY:
@@ -5031,19 +6131,19 @@ rhythmdb_entry_get_string (RhythmDBEntry *entry,
 	case RHYTHMDB_PROP_GENRE_SORT_KEY:
 		return rb_refstring_get_sort_key (entry->genre);
 	case RHYTHMDB_PROP_ARTIST_SORTNAME_SORT_KEY:
-		return rb_refstring_get_sort_key (entry->artist_sortname);
+		return rb_refstring_get_sort_key (entry->extra->artist_sortname);
 	case RHYTHMDB_PROP_ALBUM_SORTNAME_SORT_KEY:
-		return rb_refstring_get_sort_key (entry->album_sortname);
+		return rb_refstring_get_sort_key (entry->extra->album_sortname);
 	case RHYTHMDB_PROP_TITLE_SORTNAME_SORT_KEY:
-		return rb_refstring_get_sort_key (entry->title_sortname);
+		return rb_refstring_get_sort_key (entry->extra->title_sortname);
 	case RHYTHMDB_PROP_ALBUM_ARTIST_SORT_KEY:
 		return rb_refstring_get_sort_key (entry->album_artist);
 	case RHYTHMDB_PROP_ALBUM_ARTIST_SORTNAME_SORT_KEY:
-		return rb_refstring_get_sort_key (entry->album_artist_sortname);
+		return rb_refstring_get_sort_key (entry->extra->album_artist_sortname);
 	case RHYTHMDB_PROP_COMPOSER_SORT_KEY:
-		return rb_refstring_get_sort_key (entry->composer);
+		return rb_refstring_get_sort_key (entry->extra->composer);
 	case RHYTHMDB_PROP_COMPOSER_SORTNAME_SORT_KEY:
-		return rb_refstring_get_sort_key (entry->composer_sortname);
+		return rb_refstring_get_sort_key (entry->extra->composer_sortname);
 	case RHYTHMDB_PROP_TITLE_FOLDED:
 		return rb_refstring_get_folded (entry->title);
 	case RHYTHMDB_PROP_ALBUM_FOLDED:
@@ -5053,31 +6153,31 @@ rhythmdb_entry_get_string (RhythmDBEntry *entry,
 	case RHYTHMDB_PROP_GENRE_FOLDED:
 		return rb_refstring_get_folded (entry->genre);
 	case RHYTHMDB_PROP_ARTIST_SORTNAME_FOLDED:
-		return rb_refstring_get_folded (entry->artist_sortname);
+		return rb_refstring_get_folded (entry->extra->artist_sortname);
 	case RHYTHMDB_PROP_ALBUM_SORTNAME_FOLDED:
-		return rb_refstring_get_folded (entry->album_sortname);
+		return rb_refstring_get_folded (entry->extra->album_sortname);
 	case RHYTHMDB_PROP_TITLE_SORTNAME_FOLDED:
-		return rb_refstring_get_folded (entry->title_sortname);
+		return rb_refstring_get_folded (entry->extra->title_sortname);
 	case RHYTHMDB_PROP_ALBUM_ARTIST_FOLDED:
 		return rb_refstring_get_folded (entry->album_artist);
 	case RHYTHMDB_PROP_ALBUM_ARTIST_SORTNAME_FOLDED:
-		return rb_refstring_get_folded (entry->album_artist_sortname);
+		return rb_refstring_get_folded (entry->extra->album_artist_sortname);
 	case RHYTHMDB_PROP_COMPOSER_FOLDED:
-		return rb_refstring_get_folded (entry->composer);
+		return rb_refstring_get_folded (entry->extra->composer);
 	case RHYTHMDB_PROP_COMPOSER_SORTNAME_FOLDED:
-		return rb_refstring_get_folded (entry->composer_sortname);
+		return rb_refstring_get_folded (entry->extra->composer_sortname);
 	case RHYTHMDB_PROP_LOCATION:
 		return rb_refstring_get (entry->location);
 	case RHYTHMDB_PROP_MOUNTPOINT:
 		return rb_refstring_get (entry->mountpoint);
 	case RHYTHMDB_PROP_LAST_PLAYED_STR:
-		return rb_refstring_get (entry->last_played_str);
+		return rb_refstring_get (entry->time_strings->last_played_str);
 	case RHYTHMDB_PROP_PLAYBACK_ERROR:
-		return rb_refstring_get (entry->playback_error);
+		return rb_refstring_get (entry->extra->playback_error);
 	case RHYTHMDB_PROP_FIRST_SEEN_STR:
-		return rb_refstring_get (entry->first_seen_str);
+		return rb_refstring_get (entry->time_strings->first_seen_str);
 	case RHYTHMDB_PROP_LAST_SEEN_STR:
-		return rb_refstring_get (entry->last_seen_str);
+		return rb_refstring_get (entry->time_strings->last_seen_str);
 
 	/* synthetic properties */
 	case RHYTHMDB_PROP_SEARCH_MATCH:
@@ -5153,43 +6253,43 @@ rhythmdb_entry_get_refstring (RhythmDBEntry *entry,
 	case RHYTHMDB_PROP_ALBUM_ARTIST:
 		return rb_refstring_ref (entry->album_artist);
 	case RHYTHMDB_PROP_COMPOSER:
-		return rb_refstring_ref (entry->composer);
+		return rb_refstring_ref (entry->extra->composer);
 	case RHYTHMDB_PROP_GENRE:
 		return rb_refstring_ref (entry->genre);
 	case RHYTHMDB_PROP_COMMENT:
-		return rb_refstring_ref (entry->comment);
+		return rb_refstring_ref (entry->extra->comment);
 	case RHYTHMDB_PROP_MUSICBRAINZ_TRACKID:
-		return rb_refstring_ref (entry->musicbrainz_trackid);
+		return rb_refstring_ref (entry->extra->musicbrainz_trackid);
 	case RHYTHMDB_PROP_MUSICBRAINZ_ARTISTID:
-		return rb_refstring_ref (entry->musicbrainz_artistid);
+		return rb_refstring_ref (entry->extra->musicbrainz_artistid);
 	case RHYTHMDB_PROP_MUSICBRAINZ_ALBUMID:
-		return rb_refstring_ref (entry->musicbrainz_albumid);
+		return rb_refstring_ref (entry->extra->musicbrainz_albumid);
 	case RHYTHMDB_PROP_MUSICBRAINZ_ALBUMARTISTID:
-		return rb_refstring_ref (entry->musicbrainz_albumartistid);
+		return rb_refstring_ref (entry->extra->musicbrainz_albumartistid);
 	case RHYTHMDB_PROP_ARTIST_SORTNAME:
-		return rb_refstring_ref (entry->artist_sortname);
+		return rb_refstring_ref (entry->extra->artist_sortname);
 	case RHYTHMDB_PROP_ALBUM_SORTNAME:
-		return rb_refstring_ref (entry->album_sortname);
+		return rb_refstring_ref (entry->extra->album_sortname);
 	case RHYTHMDB_PROP_TITLE_SORTNAME:
-		return rb_refstring_ref (entry->title_sortname);
+		return rb_refstring_ref (entry->extra->title_sortname);
 	case RHYTHMDB_PROP_ALBUM_ARTIST_SORTNAME:
-		return rb_refstring_ref (entry->album_artist_sortname);
+		return rb_refstring_ref (entry->extra->album_artist_sortname);
 	case RHYTHMDB_PROP_COMPOSER_SORTNAME:
-		return rb_refstring_ref (entry->composer_sortname);
+		return rb_refstring_ref (entry->extra->composer_sortname);
 	case RHYTHMDB_PROP_MEDIA_TYPE:
 		return rb_refstring_ref (entry->media_type);
 	case RHYTHMDB_PROP_MOUNTPOINT:
 		return rb_refstring_ref (entry->mountpoint);
 	case RHYTHMDB_PROP_LAST_PLAYED_STR:
-		return rb_refstring_ref (entry->last_played_str);
+		return rb_refstring_ref (entry->time_strings->last_played_str);
 	case RHYTHMDB_PROP_FIRST_SEEN_STR:
-		return rb_refstring_ref (entry->first_seen_str);
+		return rb_refstring_ref (entry->time_strings->first_seen_str);
 	case RHYTHMDB_PROP_LAST_SEEN_STR:
-		return rb_refstring_ref (entry->last_seen_str);
+		return rb_refstring_ref (entry->time_strings->last_seen_str);
 	case RHYTHMDB_PROP_LOCATION:
 		return rb_refstring_ref (entry->location);
 	case RHYTHMDB_PROP_PLAYBACK_ERROR:
-		return rb_refstring_ref (entry->playback_error);
+		return rb_refstring_ref (entry->extra->playback_error);
 	default:
 		g_assert_not_reached ();
 		return NULL;
@@ -5376,21 +6476,17 @@ rhythmdb_entry_get_double (RhythmDBEntry *entry,
 
 	switch (propid) {
 	case RHYTHMDB_PROP_TRACK_GAIN:
-		g_warning ("RHYTHMDB_PROP_TRACK_GAIN no longer supported");
-		return 0.0;
+		return entry->extra->track_gain;
 	case RHYTHMDB_PROP_TRACK_PEAK:
-		g_warning ("RHYTHMDB_PROP_TRACK_PEAK no longer supported");
-		return 1.0;
+		return entry->extra->track_peak;
 	case RHYTHMDB_PROP_ALBUM_GAIN:
-		g_warning ("RHYTHMDB_PROP_ALBUM_GAIN no longer supported");
-		return 0.0;
+		return entry->extra->album_gain;
 	case RHYTHMDB_PROP_ALBUM_PEAK:
-		g_warning ("RHYTHMDB_PROP_ALBUM_PEAK no longer supported");
-		return 1.0;
+		return entry->extra->album_peak;
 	case RHYTHMDB_PROP_RATING:
 		return entry->rating;
 	case RHYTHMDB_PROP_BPM:
-		return entry->bpm;
+		return entry->extra->bpm;
 	default:
 		g_assert_not_reached ();
 		return 0.0;
@@ -5418,6 +6514,11 @@ rhythmdb_entry_keyword_add	(RhythmDB *db,
 
 	ret = klass->impl_entry_keyword_add (db, entry, keyword);
 	if (!ret) {
+		if (db->priv->journal != NULL &&
+		    db->priv->journal_replaying == FALSE &&
+		    (entry->flags & RHYTHMDB_ENTRY_INSERTED)) {
+			rhythmdb_journal_set_keyword (db->priv->journal, db, entry, keyword, TRUE);
+		}
 		g_signal_emit (G_OBJECT (db), rhythmdb_signals[ENTRY_KEYWORD_ADDED], 0, entry, keyword);
 	}
 	return ret;
@@ -5443,6 +6544,11 @@ rhythmdb_entry_keyword_remove	(RhythmDB *db,
 
 	ret = klass->impl_entry_keyword_remove (db, entry, keyword);
 	if (ret) {
+		if (db->priv->journal != NULL &&
+		    db->priv->journal_replaying == FALSE &&
+		    (entry->flags & RHYTHMDB_ENTRY_INSERTED)) {
+			rhythmdb_journal_set_keyword (db->priv->journal, db, entry, keyword, FALSE);
+		}
 		g_signal_emit (G_OBJECT (db), rhythmdb_signals[ENTRY_KEYWORD_REMOVED], 0, entry, keyword);
 	}
 	return ret;
@@ -5605,6 +6711,57 @@ rhythmdb_entry_change_get_type (void)
 	return type;
 }
 
+/**
+ * rhythmdb_prop_mask_add:
+ * @mask: a #RhythmDBPropMask
+ * @propid: property to add
+ *
+ * Adds a property to a property mask.
+ */
+void
+rhythmdb_prop_mask_add (RhythmDBPropMask *mask, RhythmDBPropType propid)
+{
+	g_return_if_fail (propid < RHYTHMDB_NUM_PROPERTIES);
+	mask->bits[propid / 32] |= (1U << (propid % 32));
+}
+
+/**
+ * rhythmdb_prop_mask_contains:
+ * @mask: a #RhythmDBPropMask
+ * @propid: property to check for
+ *
+ * Checks whether a property mask contains a property.
+ *
+ * Return value: %TRUE if @propid is in @mask
+ */
+gboolean
+rhythmdb_prop_mask_contains (const RhythmDBPropMask *mask, RhythmDBPropType propid)
+{
+	g_return_val_if_fail (propid < RHYTHMDB_NUM_PROPERTIES, FALSE);
+	return (mask->bits[propid / 32] & (1U << (propid % 32))) != 0;
+}
+
+/**
+ * rhythmdb_prop_mask_intersects:
+ * @a: a #RhythmDBPropMask
+ * @b: another #RhythmDBPropMask
+ *
+ * Checks whether two property masks have any properties in common.
+ *
+ * Return value: %TRUE if any property is in both masks
+ */
+gboolean
+rhythmdb_prop_mask_intersects (const RhythmDBPropMask *a, const RhythmDBPropMask *b)
+{
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS (a->bits); i++) {
+		if (a->bits[i] & b->bits[i])
+			return TRUE;
+	}
+	return FALSE;
+}
+
 /**
  * rhythmdb_entry_is_lossless:
  * @entry: a #RhythmDBEntry
@@ -114,10 +114,10 @@ typedef enum _RhythmDBPropType
 	RHYTHMDB_PROP_LAST_PLAYED,
 	RHYTHMDB_PROP_BITRATE,
 	RHYTHMDB_PROP_DATE,
-	RHYTHMDB_PROP_TRACK_GAIN,			/* obsolete */
-	RHYTHMDB_PROP_TRACK_PEAK,			/* obsolete */
-	RHYTHMDB_PROP_ALBUM_GAIN,			/* obsolete */
-	RHYTHMDB_PROP_ALBUM_PEAK,			/* obsolete */
+	RHYTHMDB_PROP_TRACK_GAIN,
+	RHYTHMDB_PROP_TRACK_PEAK,
+	RHYTHMDB_PROP_ALBUM_GAIN,
+	RHYTHMDB_PROP_ALBUM_PEAK,
 	RHYTHMDB_PROP_MEDIA_TYPE,
 	RHYTHMDB_PROP_TITLE_SORT_KEY,
 	RHYTHMDB_PROP_GENRE_SORT_KEY,
@@ -222,6 +222,14 @@ typedef struct {
 	GValue new;
 } RhythmDBEntryChange;
 
+typedef struct {
+	guint32 bits[(RHYTHMDB_NUM_PROPERTIES + 31) / 32];
+} RhythmDBPropMask;
+
+void		rhythmdb_prop_mask_add		(RhythmDBPropMask *mask, RhythmDBPropType propid);
+gboolean	rhythmdb_prop_mask_contains	(const RhythmDBPropMask *mask, RhythmDBPropType propid);
+gboolean	rhythmdb_prop_mask_intersects	(const RhythmDBPropMask *a, const RhythmDBPropMask *b);
+
 const char *rhythmdb_entry_get_string	(RhythmDBEntry *entry, RhythmDBPropType propid);
 RBRefString *rhythmdb_entry_get_refstring (RhythmDBEntry *entry, RhythmDBPropType propid);
 char *rhythmdb_entry_dup_string	(RhythmDBEntry *entry, RhythmDBPropType propid);
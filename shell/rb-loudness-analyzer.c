@@ -0,0 +1,873 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <errno.h>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+#include <glib/gi18n.h>
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+
+#include "rb-loudness-analyzer.h"
+#include "rb-loudness.h"
+#include "rb-metadata.h"
+#include "rb-debug.h"
+
+/**
+ * SECTION:rbloudnessanalyzer
+ * @short_description: background ReplayGain analysis
+ *
+ * Decodes tracks in the background and measures their loudness so that
+ * ReplayGain can be applied to tracks that aren't tagged.  Tracks are
+ * grouped into albums so album gain can be calculated along with track gain.
+ * The results are stored in the track gain and peak properties of each
+ * entry, and can also be written to the files as ReplayGain tags.
+ *
+ * Each album is handed to a small pool of workers, each of which runs one
+ * decoding pipeline at a time.  The streaming threads for these pipelines
+ * run at the lowest scheduling priority so analysis doesn't interfere with
+ * playback or the user interface.
+ */
+
+/* niceness of the decoding threads */
+#define ANALYSIS_NICE		19
+
+#define DECODE_PIPELINE		"uridecodebin name=decoder ! audioconvert ! " \
+				"audio/x-raw,format=" GST_AUDIO_NE (F32) ",layout=interleaved ! " \
+				"fakesink name=sink sync=false signal-handoffs=true"
+
+/* how often to check for cancellation while decoding */
+#define CANCEL_CHECK_INTERVAL	(100 * GST_MSECOND)
+
+enum
+{
+	PROP_0,
+	PROP_DB,
+	PROP_WRITE_TAGS
+};
+
+enum
+{
+	TRACK_ANALYZED,
+	FINISHED,
+	LAST_SIGNAL
+};
+
+typedef struct _AnalysisAlbum AnalysisAlbum;
+
+typedef struct {
+	AnalysisAlbum *album;
+	RhythmDBEntry *entry;
+	char *uri;
+	char *media_type;
+
+	RBLoudnessMeter *meter;
+	guint channels;
+
+	gboolean measured;
+	double gain;
+	double peak;
+} AnalysisTrack;
+
+struct _AnalysisAlbum {
+	RBLoudnessAnalyzer *analyzer;
+	guint generation;
+	gboolean write_tags;
+	GPtrArray *tracks;
+	gint remaining;
+
+	gboolean measured;
+	double gain;
+	double peak;
+};
+
+struct _RBLoudnessAnalyzerPrivate
+{
+	RhythmDB *db;
+	gboolean write_tags;
+
+	GThreadPool *pool;
+	GstTaskPool *task_pool;
+	guint generation;
+
+	GHashTable *pending;
+	guint albums_pending;
+};
+
+static void rb_loudness_analyzer_class_init (RBLoudnessAnalyzerClass *klass);
+static void rb_loudness_analyzer_init (RBLoudnessAnalyzer *analyzer);
+
+static guint signals[LAST_SIGNAL] = { 0 };
+
+G_DEFINE_TYPE (RBLoudnessAnalyzer, rb_loudness_analyzer, G_TYPE_OBJECT)
+
+
+/* task pool for the decoding pipelines' streaming threads.  each task
+ * gets its own thread so the lowered priority can't leak into threads
+ * shared with anything else.
+ */
+
+typedef struct {
+	GstTaskPool parent;
+} RBAnalysisTaskPool;
+
+typedef struct {
+	GstTaskPoolClass parent_class;
+} RBAnalysisTaskPoolClass;
+
+typedef struct {
+	GstTaskPoolFunction func;
+	gpointer user_data;
+} AnalysisTaskData;
+
+static GType rb_analysis_task_pool_get_type (void);
+
+G_DEFINE_TYPE (RBAnalysisTaskPool, rb_analysis_task_pool, GST_TYPE_TASK_POOL)
+
+static void
+set_low_priority (void)
+{
+#if defined(__linux__)
+	/* on linux, this only applies to the calling thread */
+	if (setpriority (PRIO_PROCESS, syscall (SYS_gettid), ANALYSIS_NICE) != 0)
+		rb_debug ("unable to lower analysis thread priority: %s", g_strerror (errno));
+#endif
+}
+
+static gpointer
+analysis_task_thread (AnalysisTaskData *data)
+{
+	set_low_priority ();
+	data->func (data->user_data);
+	g_free (data);
+	return NULL;
+}
+
+static void
+analysis_task_pool_prepare (GstTaskPool *pool, GError **error)
+{
+}
+
+static void
+analysis_task_pool_cleanup (GstTaskPool *pool)
+{
+}
+
+static gpointer
+analysis_task_pool_push (GstTaskPool *pool, GstTaskPoolFunction func, gpointer user_data, GError **error)
+{
+	AnalysisTaskData *data;
+	GThread *thread;
+
+	data = g_new0 (AnalysisTaskData, 1);
+	data->func = func;
+	data->user_data = user_data;
+
+	thread = g_thread_try_new ("rb-loudness", (GThreadFunc) analysis_task_thread, data, error);
+	if (thread == NULL)
+		g_free (data);
+	return thread;
+}
+
+static void
+analysis_task_pool_join (GstTaskPool *pool, gpointer id)
+{
+	g_thread_join (id);
+}
+
+static void
+rb_analysis_task_pool_init (RBAnalysisTaskPool *pool)
+{
+}
+
+static void
+rb_analysis_task_pool_class_init (RBAnalysisTaskPoolClass *klass)
+{
+	GstTaskPoolClass *pool_class = GST_TASK_POOL_CLASS (klass);
+
+	pool_class->prepare = analysis_task_pool_prepare;
+	pool_class->cleanup = analysis_task_pool_cleanup;
+	pool_class->push = analysis_task_pool_push;
+	pool_class->join = analysis_task_pool_join;
+}
+
+
+static gboolean
+analysis_cancelled (AnalysisAlbum *album)
+{
+	return (g_atomic_int_get (&album->analyzer->priv->generation) != album->generation);
+}
+
+static void
+free_album (AnalysisAlbum *album)
+{
+	guint i;
+
+	for (i = 0; i < album->tracks->len; i++) {
+		AnalysisTrack *track = g_ptr_array_index (album->tracks, i);
+
+		rhythmdb_entry_unref (track->entry);
+		rb_loudness_meter_free (track->meter);
+		g_free (track->uri);
+		g_free (track->media_type);
+		g_free (track);
+	}
+	g_ptr_array_free (album->tracks, TRUE);
+	g_object_unref (album->analyzer);
+	g_free (album);
+}
+
+static void
+handoff_cb (GstElement *sink, GstBuffer *buffer, GstPad *pad, AnalysisTrack *track)
+{
+	GstMapInfo info;
+
+	if (track->meter == NULL) {
+		GstAudioInfo audio_info;
+		GstCaps *caps;
+
+		caps = gst_pad_get_current_caps (pad);
+		if (caps == NULL || gst_audio_info_from_caps (&audio_info, caps) == FALSE) {
+			rb_debug ("unable to get audio format for %s", track->uri);
+			if (caps != NULL)
+				gst_caps_unref (caps);
+			return;
+		}
+		gst_caps_unref (caps);
+
+		track->channels = GST_AUDIO_INFO_CHANNELS (&audio_info);
+		track->meter = rb_loudness_meter_new (GST_AUDIO_INFO_RATE (&audio_info), track->channels);
+	}
+
+	if (gst_buffer_map (buffer, &info, GST_MAP_READ) == FALSE)
+		return;
+
+	rb_loudness_meter_process (track->meter,
+				   (const float *) info.data,
+				   info.size / (sizeof (float) * track->channels));
+	gst_buffer_unmap (buffer, &info);
+}
+
+static GstBusSyncReply
+stream_status_cb (GstBus *bus, GstMessage *message, RBLoudnessAnalyzer *analyzer)
+{
+	GstStreamStatusType type;
+	const GValue *value;
+
+	if (GST_MESSAGE_TYPE (message) != GST_MESSAGE_STREAM_STATUS)
+		return GST_BUS_PASS;
+
+	gst_message_parse_stream_status (message, &type, NULL);
+	if (type != GST_STREAM_STATUS_TYPE_CREATE)
+		return GST_BUS_PASS;
+
+	value = gst_message_get_stream_status_object (message);
+	if (value != NULL && G_VALUE_HOLDS (value, GST_TYPE_TASK))
+		gst_task_set_pool (g_value_get_object (value), analyzer->priv->task_pool);
+
+	return GST_BUS_PASS;
+}
+
+static gboolean
+decode_track (RBLoudnessAnalyzer *analyzer, AnalysisTrack *track, GError **error)
+{
+	GstElement *pipeline;
+	GstElement *element;
+	GstBus *bus;
+	gboolean result = FALSE;
+
+	pipeline = gst_parse_launch (DECODE_PIPELINE, error);
+	if (pipeline == NULL)
+		return FALSE;
+
+	element = gst_bin_get_by_name (GST_BIN (pipeline), "decoder");
+	g_object_set (element, "uri", track->uri, NULL);
+	gst_object_unref (element);
+
+	element = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+	g_signal_connect (element, "handoff", G_CALLBACK (handoff_cb), track);
+	gst_object_unref (element);
+
+	bus = gst_element_get_bus (pipeline);
+	gst_bus_set_sync_handler (bus, (GstBusSyncHandler) stream_status_cb, analyzer, NULL);
+
+	gst_element_set_state (pipeline, GST_STATE_PLAYING);
+	while (TRUE) {
+		GstMessage *message;
+
+		message = gst_bus_timed_pop_filtered (bus, CANCEL_CHECK_INTERVAL, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+		if (message == NULL) {
+			if (analysis_cancelled (track->album)) {
+				g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CANCELLED, "analysis cancelled");
+				break;
+			}
+			continue;
+		}
+
+		if (GST_MESSAGE_TYPE (message) == GST_MESSAGE_EOS) {
+			result = TRUE;
+		} else {
+			gst_message_parse_error (message, error, NULL);
+		}
+		gst_message_unref (message);
+		break;
+	}
+
+	gst_element_set_state (pipeline, GST_STATE_NULL);
+	gst_bus_set_sync_handler (bus, NULL, NULL, NULL);
+	gst_object_unref (bus);
+	gst_object_unref (pipeline);
+	return result;
+}
+
+static void
+set_metadata_double (RBMetaData *md, RBMetaDataField field, double v)
+{
+	GValue value = {0,};
+
+	g_value_init (&value, G_TYPE_DOUBLE);
+	g_value_set_double (&value, v);
+	rb_metadata_set (md, field, &value);
+	g_value_unset (&value);
+}
+
+static void
+write_album_tags (AnalysisAlbum *album)
+{
+	RBMetaData *md;
+	guint i;
+
+	md = rb_metadata_new ();
+	for (i = 0; i < album->tracks->len; i++) {
+		AnalysisTrack *track = g_ptr_array_index (album->tracks, i);
+		GError *error = NULL;
+
+		if (track->measured == FALSE || analysis_cancelled (album))
+			continue;
+
+		if (rb_metadata_can_save (md, track->media_type) == FALSE) {
+			rb_debug ("can't write replaygain tags to %s (%s)", track->uri, track->media_type);
+			continue;
+		}
+
+		rb_metadata_reset (md);
+		set_metadata_double (md, RB_METADATA_FIELD_TRACK_GAIN, track->gain);
+		set_metadata_double (md, RB_METADATA_FIELD_TRACK_PEAK, track->peak);
+		if (album->measured) {
+			set_metadata_double (md, RB_METADATA_FIELD_ALBUM_GAIN, album->gain);
+			set_metadata_double (md, RB_METADATA_FIELD_ALBUM_PEAK, album->peak);
+		}
+
+		rb_metadata_save (md, track->uri, &error);
+		if (error != NULL) {
+			rb_debug ("unable to write replaygain tags to %s: %s", track->uri, error->message);
+			g_clear_error (&error);
+		}
+	}
+	g_object_unref (md);
+}
+
+static void
+set_entry_double (RhythmDB *db, RhythmDBEntry *entry, RhythmDBPropType prop, double v)
+{
+	GValue value = {0,};
+
+	g_value_init (&value, G_TYPE_DOUBLE);
+	g_value_set_double (&value, v);
+	rhythmdb_entry_set (db, entry, prop, &value);
+	g_value_unset (&value);
+}
+
+static gboolean
+album_done_cb (AnalysisAlbum *album)
+{
+	RBLoudnessAnalyzer *analyzer = album->analyzer;
+	gboolean cancelled;
+	guint i;
+
+	cancelled = analysis_cancelled (album);
+	for (i = 0; i < album->tracks->len; i++) {
+		AnalysisTrack *track = g_ptr_array_index (album->tracks, i);
+
+		if (g_hash_table_lookup (analyzer->priv->pending, track->entry) == album)
+			g_hash_table_remove (analyzer->priv->pending, track->entry);
+
+		if (track->measured == FALSE || cancelled)
+			continue;
+
+		set_entry_double (analyzer->priv->db, track->entry, RHYTHMDB_PROP_TRACK_GAIN, track->gain);
+		set_entry_double (analyzer->priv->db, track->entry, RHYTHMDB_PROP_TRACK_PEAK, track->peak);
+		if (album->measured) {
+			set_entry_double (analyzer->priv->db, track->entry, RHYTHMDB_PROP_ALBUM_GAIN, album->gain);
+			set_entry_double (analyzer->priv->db, track->entry, RHYTHMDB_PROP_ALBUM_PEAK, album->peak);
+		}
+	}
+
+	if (cancelled == FALSE) {
+		rhythmdb_commit (analyzer->priv->db);
+
+		for (i = 0; i < album->tracks->len; i++) {
+			AnalysisTrack *track = g_ptr_array_index (album->tracks, i);
+			if (track->measured)
+				g_signal_emit (analyzer, signals[TRACK_ANALYZED], 0, track->entry);
+		}
+	}
+
+	analyzer->priv->albums_pending--;
+	if (analyzer->priv->albums_pending == 0)
+		g_signal_emit (analyzer, signals[FINISHED], 0);
+
+	free_album (album);
+	return FALSE;
+}
+
+static void
+finish_album (AnalysisAlbum *album)
+{
+	RBLoudnessMeter *album_meter = NULL;
+	double lufs;
+	guint i;
+
+	/* the first measured track's meter collects the blocks for the album */
+	for (i = 0; i < album->tracks->len; i++) {
+		AnalysisTrack *track = g_ptr_array_index (album->tracks, i);
+
+		if (track->measured == FALSE)
+			continue;
+
+		if (album_meter == NULL)
+			album_meter = track->meter;
+		else
+			rb_loudness_meter_add (album_meter, track->meter);
+	}
+
+	if (album_meter != NULL && rb_loudness_meter_get_loudness (album_meter, &lufs)) {
+		album->gain = rb_loudness_gain_from_loudness (lufs);
+		album->peak = rb_loudness_meter_get_peak (album_meter);
+		album->measured = TRUE;
+	}
+
+	if (album->write_tags && analysis_cancelled (album) == FALSE)
+		write_album_tags (album);
+
+	g_idle_add ((GSourceFunc) album_done_cb, album);
+}
+
+static void
+analyze_track (AnalysisTrack *track, RBLoudnessAnalyzer *analyzer)
+{
+	AnalysisAlbum *album = track->album;
+	GError *error = NULL;
+	double lufs;
+
+	if (analysis_cancelled (album) == FALSE) {
+		if (decode_track (analyzer, track, &error) == FALSE) {
+			rb_debug ("unable to analyze %s: %s", track->uri, error ? error->message : "(unknown)");
+			g_clear_error (&error);
+		} else if (track->meter != NULL && rb_loudness_meter_get_loudness (track->meter, &lufs)) {
+			track->gain = rb_loudness_gain_from_loudness (lufs);
+			track->peak = rb_loudness_meter_get_peak (track->meter);
+			track->measured = TRUE;
+			rb_debug ("%s: %.2f LUFS, gain %.2f dB, peak %f", track->uri, lufs, track->gain, track->peak);
+		} else {
+			rb_debug ("%s: too quiet to measure", track->uri);
+		}
+	}
+
+	if (g_atomic_int_dec_and_test (&album->remaining))
+		finish_album (album);
+}
+
+static void
+queue_album (RBLoudnessAnalyzer *analyzer, GList *entries)
+{
+	AnalysisAlbum *album;
+	GList *l;
+	guint i;
+
+	album = g_new0 (AnalysisAlbum, 1);
+	album->generation = analyzer->priv->generation;
+	album->write_tags = analyzer->priv->write_tags;
+	album->tracks = g_ptr_array_new ();
+
+	for (l = entries; l != NULL; l = l->next) {
+		RhythmDBEntry *entry = l->data;
+		AnalysisTrack *track;
+
+		if (g_hash_table_contains (analyzer->priv->pending, entry))
+			continue;
+
+		track = g_new0 (AnalysisTrack, 1);
+		track->album = album;
+		track->entry = rhythmdb_entry_ref (entry);
+		track->uri = g_strdup (rhythmdb_entry_get_string (entry, RHYTHMDB_PROP_LOCATION));
+		track->media_type = g_strdup (rhythmdb_entry_get_string (entry, RHYTHMDB_PROP_MEDIA_TYPE));
+		g_ptr_array_add (album->tracks, track);
+		g_hash_table_insert (analyzer->priv->pending, entry, album);
+	}
+
+	if (album->tracks->len == 0) {
+		g_ptr_array_free (album->tracks, TRUE);
+		g_free (album);
+		return;
+	}
+
+	/* each album holds a reference so the worker pool outlives it */
+	album->analyzer = g_object_ref (analyzer);
+	album->remaining = album->tracks->len;
+	analyzer->priv->albums_pending++;
+
+	for (i = 0; i < album->tracks->len; i++) {
+		g_thread_pool_push (analyzer->priv->pool, g_ptr_array_index (album->tracks, i), NULL);
+	}
+}
+
+static char *
+album_key (RhythmDBEntry *entry)
+{
+	const char *album;
+	const char *artist;
+
+	album = rhythmdb_entry_get_string (entry, RHYTHMDB_PROP_ALBUM);
+	if (album == NULL || album[0] == '\0' || strcmp (album, _("Unknown")) == 0) {
+		/* tracks without an album are analyzed on their own */
+		return g_strdup (rhythmdb_entry_get_string (entry, RHYTHMDB_PROP_LOCATION));
+	}
+
+	artist = rhythmdb_entry_get_string (entry, RHYTHMDB_PROP_ALBUM_ARTIST);
+	if (artist == NULL || artist[0] == '\0')
+		artist = rhythmdb_entry_get_string (entry, RHYTHMDB_PROP_ARTIST);
+
+	return g_strdup_printf ("%s\n%s", artist, album);
+}
+
+static GHashTable *
+group_entries (GList *entries)
+{
+	GHashTable *albums;
+	GList *l;
+
+	albums = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_list_free);
+	for (l = entries; l != NULL; l = l->next) {
+		char *key;
+		GList *album;
+
+		key = album_key (l->data);
+		album = g_hash_table_lookup (albums, key);
+		if (album != NULL) {
+			/* the list head doesn't change, so the table still owns it */
+			album = g_list_append (album, l->data);
+			g_free (key);
+		} else {
+			g_hash_table_insert (albums, key, g_list_prepend (NULL, l->data));
+		}
+	}
+
+	return albums;
+}
+
+/**
+ * rb_loudness_analyzer_queue_entries:
+ * @analyzer: the #RBLoudnessAnalyzer
+ * @entries: (element-type RhythmDBEntry) (transfer none): entries to analyze
+ *
+ * Queues entries for analysis.  Entries from the same album are analyzed
+ * together so album gain can be calculated.  Entries that are already
+ * queued are ignored.
+ */
+void
+rb_loudness_analyzer_queue_entries (RBLoudnessAnalyzer *analyzer, GList *entries)
+{
+	GHashTableIter iter;
+	GHashTable *albums;
+	gpointer album;
+
+	albums = group_entries (entries);
+	g_hash_table_iter_init (&iter, albums);
+	while (g_hash_table_iter_next (&iter, NULL, &album)) {
+		queue_album (analyzer, album);
+	}
+	g_hash_table_destroy (albums);
+}
+
+static void
+collect_entry (RhythmDBEntry *entry, GList **entries)
+{
+	if (rhythmdb_entry_get_boolean (entry, RHYTHMDB_PROP_HIDDEN) == FALSE)
+		*entries = g_list_prepend (*entries, entry);
+}
+
+/**
+ * rb_loudness_analyzer_queue_missing:
+ * @analyzer: the #RBLoudnessAnalyzer
+ *
+ * Queues analysis of every album in the library that contains
+ * tracks without ReplayGain information.
+ */
+void
+rb_loudness_analyzer_queue_missing (RBLoudnessAnalyzer *analyzer)
+{
+	GHashTableIter iter;
+	GHashTable *albums;
+	GList *entries = NULL;
+	gpointer album;
+
+	rhythmdb_entry_foreach_by_type (analyzer->priv->db,
+					RHYTHMDB_ENTRY_TYPE_SONG,
+					(RhythmDBEntryForeachFunc) collect_entry,
+					&entries);
+	albums = group_entries (entries);
+	g_list_free (entries);
+
+	g_hash_table_iter_init (&iter, albums);
+	while (g_hash_table_iter_next (&iter, NULL, &album)) {
+		GList *l;
+
+		for (l = album; l != NULL; l = l->next) {
+			if (rhythmdb_entry_get_double (l->data, RHYTHMDB_PROP_TRACK_PEAK) == 0.0) {
+				queue_album (analyzer, album);
+				break;
+			}
+		}
+	}
+	g_hash_table_destroy (albums);
+}
+
+/**
+ * rb_loudness_analyzer_cancel:
+ * @analyzer: the #RBLoudnessAnalyzer
+ *
+ * Cancels all queued and running analysis.  Results for albums
+ * that haven't been completely analyzed are discarded.
+ */
+void
+rb_loudness_analyzer_cancel (RBLoudnessAnalyzer *analyzer)
+{
+	g_atomic_int_inc (&analyzer->priv->generation);
+	g_hash_table_remove_all (analyzer->priv->pending);
+}
+
+/**
+ * rb_loudness_analyzer_get_pending:
+ * @analyzer: the #RBLoudnessAnalyzer
+ *
+ * Returns the number of entries waiting to be analyzed.
+ *
+ * Return value: number of pending entries
+ */
+guint
+rb_loudness_analyzer_get_pending (RBLoudnessAnalyzer *analyzer)
+{
+	return g_hash_table_size (analyzer->priv->pending);
+}
+
+/**
+ * rb_loudness_analyzer_new:
+ * @db: the #RhythmDB
+ *
+ * Creates a new loudness analyzer.
+ *
+ * Return value: the #RBLoudnessAnalyzer
+ */
+RBLoudnessAnalyzer *
+rb_loudness_analyzer_new (RhythmDB *db)
+{
+	return g_object_new (RB_TYPE_LOUDNESS_ANALYZER, "db", db, NULL);
+}
+
+static void
+rb_loudness_analyzer_init (RBLoudnessAnalyzer *analyzer)
+{
+	guint workers;
+
+	analyzer->priv = G_TYPE_INSTANCE_GET_PRIVATE (analyzer,
+						      RB_TYPE_LOUDNESS_ANALYZER,
+						      RBLoudnessAnalyzerPrivate);
+
+	/* leave room for playback and everything else */
+	workers = MAX (g_get_num_processors () / 2, 1);
+	analyzer->priv->pool = g_thread_pool_new ((GFunc) analyze_track, analyzer, workers, FALSE, NULL);
+
+	analyzer->priv->task_pool = g_object_new (rb_analysis_task_pool_get_type (), NULL);
+	gst_task_pool_prepare (analyzer->priv->task_pool, NULL);
+
+	analyzer->priv->pending = g_hash_table_new (g_direct_hash, g_direct_equal);
+}
+
+static void
+impl_set_property (GObject *object,
+		   guint prop_id,
+		   const GValue *value,
+		   GParamSpec *pspec)
+{
+	RBLoudnessAnalyzer *analyzer = RB_LOUDNESS_ANALYZER (object);
+
+	switch (prop_id) {
+	case PROP_DB:
+		analyzer->priv->db = g_value_dup_object (value);
+		break;
+	case PROP_WRITE_TAGS:
+		analyzer->priv->write_tags = g_value_get_boolean (value);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+		break;
+	}
+}
+
+static void
+impl_get_property (GObject *object,
+		   guint prop_id,
+		   GValue *value,
+		   GParamSpec *pspec)
+{
+	RBLoudnessAnalyzer *analyzer = RB_LOUDNESS_ANALYZER (object);
+
+	switch (prop_id) {
+	case PROP_DB:
+		g_value_set_object (value, analyzer->priv->db);
+		break;
+	case PROP_WRITE_TAGS:
+		g_value_set_boolean (value, analyzer->priv->write_tags);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+		break;
+	}
+}
+
+static void
+impl_dispose (GObject *object)
+{
+	RBLoudnessAnalyzer *analyzer = RB_LOUDNESS_ANALYZER (object);
+
+	/* queued albums hold references, so the pool is idle by now */
+	if (analyzer->priv->pool != NULL) {
+		g_thread_pool_free (analyzer->priv->pool, FALSE, TRUE);
+		analyzer->priv->pool = NULL;
+	}
+
+	if (analyzer->priv->task_pool != NULL) {
+		gst_task_pool_cleanup (analyzer->priv->task_pool);
+		gst_object_unref (analyzer->priv->task_pool);
+		analyzer->priv->task_pool = NULL;
+	}
+
+	g_clear_object (&analyzer->priv->db);
+
+	G_OBJECT_CLASS (rb_loudness_analyzer_parent_class)->dispose (object);
+}
+
+static void
+impl_finalize (GObject *object)
+{
+	RBLoudnessAnalyzer *analyzer = RB_LOUDNESS_ANALYZER (object);
+
+	g_hash_table_destroy (analyzer->priv->pending);
+
+	G_OBJECT_CLASS (rb_loudness_analyzer_parent_class)->finalize (object);
+}
+
+static void
+rb_loudness_analyzer_class_init (RBLoudnessAnalyzerClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->set_property = impl_set_property;
+	object_class->get_property = impl_get_property;
+	object_class->dispose = impl_dispose;
+	object_class->finalize = impl_finalize;
+
+	/**
+	 * RBLoudnessAnalyzer:db:
+	 *
+	 * The #RhythmDB instance
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_DB,
+					 g_param_spec_object ("db",
+							      "db",
+							      "RhythmDB instance",
+							      RHYTHMDB_TYPE,
+							      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+	/**
+	 * RBLoudnessAnalyzer:write-tags:
+	 *
+	 * If %TRUE, analysis results are also written to the files as
+	 * ReplayGain tags.  This applies to albums queued after it is set.
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_WRITE_TAGS,
+					 g_param_spec_boolean ("write-tags",
+							       "write tags",
+							       "whether to write ReplayGain tags to files",
+							       FALSE,
+							       G_PARAM_READWRITE));
+
+	/**
+	 * RBLoudnessAnalyzer::track-analyzed:
+	 * @analyzer: the #RBLoudnessAnalyzer
+	 * @entry: the #RhythmDBEntry that was analyzed
+	 *
+	 * Emitted when the ReplayGain properties for an entry have been updated.
+	 */
+	signals[TRACK_ANALYZED] =
+		g_signal_new ("track-analyzed",
+			      G_OBJECT_CLASS_TYPE (object_class),
+			      G_SIGNAL_RUN_LAST,
+			      G_STRUCT_OFFSET (RBLoudnessAnalyzerClass, track_analyzed),
+			      NULL, NULL,
+			      NULL,
+			      G_TYPE_NONE,
+			      1, RHYTHMDB_TYPE_ENTRY);
+	/**
+	 * RBLoudnessAnalyzer::finished:
+	 * @analyzer: the #RBLoudnessAnalyzer
+	 *
+	 * Emitted when all queued analysis has finished.
+	 */
+	signals[FINISHED] =
+		g_signal_new ("finished",
+			      G_OBJECT_CLASS_TYPE (object_class),
+			      G_SIGNAL_RUN_LAST,
+			      G_STRUCT_OFFSET (RBLoudnessAnalyzerClass, finished),
+			      NULL, NULL,
+			      NULL,
+			      G_TYPE_NONE,
+			      0);
+
+	g_type_class_add_private (klass, sizeof (RBLoudnessAnalyzerPrivate));
+}
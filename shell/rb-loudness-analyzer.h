@@ -0,0 +1,76 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+#ifndef __RB_LOUDNESS_ANALYZER_H
+#define __RB_LOUDNESS_ANALYZER_H
+
+#include <rhythmdb/rhythmdb.h>
+
+G_BEGIN_DECLS
+
+#define RB_TYPE_LOUDNESS_ANALYZER         (rb_loudness_analyzer_get_type ())
+#define RB_LOUDNESS_ANALYZER(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), RB_TYPE_LOUDNESS_ANALYZER, RBLoudnessAnalyzer))
+#define RB_LOUDNESS_ANALYZER_CLASS(k)     (G_TYPE_CHECK_CLASS_CAST((k), RB_TYPE_LOUDNESS_ANALYZER, RBLoudnessAnalyzerClass))
+#define RB_IS_LOUDNESS_ANALYZER(o)        (G_TYPE_CHECK_INSTANCE_TYPE ((o), RB_TYPE_LOUDNESS_ANALYZER))
+#define RB_IS_LOUDNESS_ANALYZER_CLASS(k)  (G_TYPE_CHECK_CLASS_TYPE ((k), RB_TYPE_LOUDNESS_ANALYZER))
+#define RB_LOUDNESS_ANALYZER_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS ((o), RB_TYPE_LOUDNESS_ANALYZER, RBLoudnessAnalyzerClass))
+
+typedef struct _RBLoudnessAnalyzer RBLoudnessAnalyzer;
+typedef struct _RBLoudnessAnalyzerClass RBLoudnessAnalyzerClass;
+typedef struct _RBLoudnessAnalyzerPrivate RBLoudnessAnalyzerPrivate;
+
+struct _RBLoudnessAnalyzer
+{
+	GObject parent;
+	RBLoudnessAnalyzerPrivate *priv;
+};
+
+struct _RBLoudnessAnalyzerClass
+{
+	GObjectClass parent_class;
+
+	/* signals */
+	void	(*track_analyzed)	(RBLoudnessAnalyzer *analyzer,
+					 RhythmDBEntry *entry);
+	void	(*finished)		(RBLoudnessAnalyzer *analyzer);
+};
+
+GType			rb_loudness_analyzer_get_type		(void);
+
+RBLoudnessAnalyzer *	rb_loudness_analyzer_new		(RhythmDB *db);
+
+void			rb_loudness_analyzer_queue_entries	(RBLoudnessAnalyzer *analyzer,
+								 GList *entries);
+void			rb_loudness_analyzer_queue_missing	(RBLoudnessAnalyzer *analyzer);
+void			rb_loudness_analyzer_cancel		(RBLoudnessAnalyzer *analyzer);
+
+guint			rb_loudness_analyzer_get_pending	(RBLoudnessAnalyzer *analyzer);
+
+G_END_DECLS
+
+#endif /* __RB_LOUDNESS_ANALYZER_H */
@@ -189,6 +189,19 @@ static RBPlayOrder* rb_play_order_new (RBShellPlayer *player, const char* porder
 /* number of nanoseconds before the end of a track to start prerolling the next */
 #define PREROLL_TIME		RB_PLAYER_SECOND
 
+/* tick intervals (in milliseconds) requested from the player normally and
+ * when approaching the end of a track, where the transition checks need
+ * a more precise playback position.  the shell player always keeps a
+ * subscription while playing: elapsed-changed is documented as emitted
+ * every second and play counting, scrobbling and remote control plugins
+ * rely on that, and tick_cb is what notices the end of the track is
+ * getting close.  so the player only stops ticking when it isn't playing.
+ */
+#define TICK_INTERVAL			1000
+#define TRANSITION_TICK_INTERVAL	200
+/* how far ahead of a track transition to switch to the shorter interval */
+#define TRANSITION_TICK_MARGIN		((gint64) 3 * RB_PLAYER_SECOND)
+
 struct RBShellPlayerPrivate
 {
 	RhythmDB *db;
@@ -209,12 +222,18 @@ struct RBShellPlayerPrivate
 	gboolean handling_error;
 
 	RBPlayer *mmplayer;
+	guint tick_subscription;
+	guint tick_interval;
 
 	guint elapsed;
 	gint64 track_transition_time;
 	RhythmDBEntry *playing_entry;
 	gboolean playing_entry_eos;
 
+	gint64 lookahead_time;
+	guint64 lookahead_size;
+	RhythmDBEntry *lookahead_entry;
+
 	RBPlayOrder *play_order;
 	RBPlayOrder *queue_play_order;
 
@@ -926,6 +945,14 @@ player_settings_changed_cb (GSettings *settings, const char *key, RBShellPlayer
 		rb_debug ("track transition time changed");
 		newtime = g_settings_get_double (player->priv->settings, "transition-time");
 		player->priv->track_transition_time = newtime * RB_PLAYER_SECOND;
+	} else if (g_strcmp0 (key, "lookahead-time") == 0) {
+		double newtime;
+		rb_debug ("lookahead time changed");
+		newtime = g_settings_get_double (player->priv->settings, "lookahead-time");
+		player->priv->lookahead_time = newtime * RB_PLAYER_SECOND;
+	} else if (g_strcmp0 (key, "lookahead-size") == 0) {
+		rb_debug ("lookahead size changed");
+		player->priv->lookahead_size = ((guint64) g_settings_get_uint (player->priv->settings, "lookahead-size")) * 1024 * 1024;
 	}
 }
 
@@ -2141,6 +2168,7 @@ rb_shell_player_stop (RBShellPlayer *player)
 		rhythmdb_entry_unref (player->priv->playing_entry);
 		player->priv->playing_entry = NULL;
 	}
+	g_clear_pointer (&player->priv->lookahead_entry, rhythmdb_entry_unref);
 
 	rb_shell_player_set_playing_source (player, NULL);
 	rb_shell_player_sync_with_source (player);
@@ -2249,6 +2277,44 @@ rb_shell_player_get_playing_time (RBShellPlayer *player,
 	}
 }
 
+/**
+ * rb_shell_player_add_tick_subscriber:
+ * @player: the #RBShellPlayer
+ * @interval: the desired interval between position updates, in milliseconds
+ *
+ * Requests that the playback position be updated at least every @interval
+ * milliseconds while playing.  Without any subscriptions, the position is
+ * only updated about once a second.  The subscription should be removed
+ * using #rb_shell_player_remove_tick_subscriber when the caller no longer
+ * needs frequent updates, for instance when it is no longer visible.
+ *
+ * Return value: subscription ID
+ */
+guint
+rb_shell_player_add_tick_subscriber (RBShellPlayer *player, guint interval)
+{
+	if (player->priv->mmplayer == NULL)
+		return 0;
+
+	return rb_player_add_tick_subscriber (player->priv->mmplayer, interval);
+}
+
+/**
+ * rb_shell_player_remove_tick_subscriber:
+ * @player: the #RBShellPlayer
+ * @id: subscription ID returned by #rb_shell_player_add_tick_subscriber
+ *
+ * Removes a position update subscription.
+ */
+void
+rb_shell_player_remove_tick_subscriber (RBShellPlayer *player, guint id)
+{
+	if (player->priv->mmplayer == NULL || id == 0)
+		return;
+
+	rb_player_remove_tick_subscriber (player->priv->mmplayer, id);
+}
+
 /**
  * rb_shell_player_set_playing_time:
  * @player: the #RBShellPlayer
@@ -2509,6 +2575,8 @@ playing_stream_cb (RBPlayer *mmplayer,
 	if (entry_changed) {
 		const char *location;
 
+		g_clear_pointer (&player->priv->lookahead_entry, rhythmdb_entry_unref);
+
 		location = rhythmdb_entry_get_string (entry, RHYTHMDB_PROP_LOCATION);
 		rb_debug ("new playing stream: %s", location);
 		g_signal_emit (G_OBJECT (player),
@@ -2549,6 +2617,134 @@ error_cb (RBPlayer *mmplayer,
 	}
 }
 
+/*
+ * works out which entry will be played next without advancing any play orders,
+ * following the same rules as rb_shell_player_do_next_internal.
+ */
+static RhythmDBEntry *
+rb_shell_player_peek_next_entry (RBShellPlayer *player, RBSource **source)
+{
+	RhythmDBEntry *entry = NULL;
+	RBSource *new_source = NULL;
+	RBPlayOrder *porder;
+
+	if (player->priv->source == NULL)
+		return NULL;
+
+	/* the current playing source's play order, if it has one */
+	if (player->priv->current_playing_source != NULL) {
+		g_object_get (player->priv->current_playing_source, "play-order", &porder, NULL);
+		if (porder != NULL) {
+			entry = rb_play_order_get_next (porder);
+			if (entry != NULL)
+				new_source = player->priv->current_playing_source;
+			g_object_unref (porder);
+		}
+	}
+
+	/* then the source the user selected, going back to what it was
+	 * playing if we interrupted it to play something else
+	 */
+	if (entry == NULL) {
+		g_object_get (player->priv->source, "play-order", &porder, NULL);
+		if (porder == NULL)
+			porder = g_object_ref (player->priv->play_order);
+
+		if (player->priv->source != player->priv->current_playing_source)
+			entry = rb_play_order_get_playing_entry (porder);
+		if (entry == NULL)
+			entry = rb_play_order_get_next (porder);
+		if (entry != NULL)
+			new_source = player->priv->source;
+
+		g_object_unref (porder);
+	}
+
+	/* the play queue overrides the regular play order */
+	if (player->priv->queue_play_order != NULL &&
+	    new_source != RB_SOURCE (player->priv->queue_source)) {
+		RhythmDBEntry *queue_entry;
+
+		queue_entry = rb_play_order_get_next (player->priv->queue_play_order);
+		if (queue_entry != NULL) {
+			if (entry != NULL)
+				rhythmdb_entry_unref (entry);
+			entry = queue_entry;
+			new_source = RB_SOURCE (player->priv->queue_source);
+		}
+	}
+
+	*source = new_source;
+	return entry;
+}
+
+/*
+ * asks the player backend to start decoding the next entry, so the
+ * transition to it can be played from memory.
+ */
+static void
+rb_shell_player_prepare_next (RBShellPlayer *player)
+{
+	RhythmDBEntry *entry;
+	RBSource *source;
+	GError *error = NULL;
+	char *location;
+
+	entry = rb_shell_player_peek_next_entry (player, &source);
+	if (entry == NULL)
+		return;
+
+	/* only try each entry once */
+	if (entry == player->priv->lookahead_entry) {
+		rhythmdb_entry_unref (entry);
+		return;
+	}
+	if (player->priv->lookahead_entry != NULL)
+		rhythmdb_entry_unref (player->priv->lookahead_entry);
+	player->priv->lookahead_entry = entry;
+
+	/* playlist urls are resolved when the entry is opened */
+	if (rb_source_try_playlist (source))
+		return;
+
+	location = rhythmdb_entry_get_playback_uri (entry);
+	if (location == NULL)
+		return;
+
+	rb_debug ("preparing %s for playback", location);
+	if (rb_player_prepare (player->priv->mmplayer,
+			       location,
+			       player->priv->lookahead_time,
+			       player->priv->lookahead_size,
+			       &error) == FALSE) {
+		if (error != NULL) {
+			rb_debug ("unable to prepare %s: %s", location, error->message);
+			g_error_free (error);
+		}
+	}
+	g_free (location);
+}
+
+static void
+rb_shell_player_set_tick_interval (RBShellPlayer *player, guint interval)
+{
+	guint old_subscription;
+
+	if (player->priv->tick_interval == interval)
+		return;
+
+	rb_debug ("changing tick interval from %u to %u ms", player->priv->tick_interval, interval);
+
+	/* add the new subscription first so the player's interval doesn't
+	 * briefly fall back to some other subscriber's value
+	 */
+	old_subscription = player->priv->tick_subscription;
+	player->priv->tick_subscription = rb_player_add_tick_subscriber (player->priv->mmplayer, interval);
+	player->priv->tick_interval = interval;
+	if (old_subscription != 0)
+		rb_player_remove_tick_subscriber (player->priv->mmplayer, old_subscription);
+}
+
 static void
 tick_cb (RBPlayer *mmplayer,
 	 RhythmDBEntry *entry,
@@ -2599,6 +2795,14 @@ tick_cb (RBPlayer *mmplayer,
 		/* XXX update duration in various things? */
 	}
 
+	/* check if we should start decoding the next entry */
+	if (player->priv->lookahead_time > 0 &&
+	    duration > 0 &&
+	    elapsed > 0 &&
+	    ((duration - elapsed) <= player->priv->lookahead_time)) {
+		rb_shell_player_prepare_next (player);
+	}
+
 	/* check if we should start a crossfade */
 	if (rb_player_multiple_open (mmplayer)) {
 		if (player->priv->track_transition_time < PREROLL_TIME) {
@@ -2608,6 +2812,18 @@ tick_cb (RBPlayer *mmplayer,
 		}
 	}
 
+	/* tick more often as we approach a transition point so we don't
+	 * overshoot it by most of a second
+	 */
+	if (duration > 0 &&
+	    elapsed > 0 &&
+	    (remaining_check > 0 || player->priv->lookahead_time > 0) &&
+	    ((duration - elapsed) <= MAX (remaining_check, player->priv->lookahead_time) + TRANSITION_TICK_MARGIN)) {
+		rb_shell_player_set_tick_interval (player, TRANSITION_TICK_INTERVAL);
+	} else {
+		rb_shell_player_set_tick_interval (player, TICK_INTERVAL);
+	}
+
 	/*
 	 * just pretending we got an EOS will do exactly what we want
 	 * here.  if we don't want to crossfade, we'll just leave the stream
@@ -3000,6 +3216,8 @@ rb_shell_player_constructed (GObject *object)
 	gtk_application_set_accels_for_action (GTK_APPLICATION (app), "app.play-shuffle(true)", play_shuffle_accels);
 
 	player_settings_changed_cb (player->priv->settings, "transition-time", player);
+	player_settings_changed_cb (player->priv->settings, "lookahead-time", player);
+	player_settings_changed_cb (player->priv->settings, "lookahead-size", player);
 	player_settings_changed_cb (player->priv->settings, "play-order", player);
 
 	action = g_action_map_lookup_action (G_ACTION_MAP (app), "play-previous");
@@ -3332,6 +3550,7 @@ rb_shell_player_init (RBShellPlayer *player)
 				 "tick",
 				 G_CALLBACK (tick_cb),
 				 player, 0);
+	rb_shell_player_set_tick_interval (player, TICK_INTERVAL);
 
 	g_signal_connect_object (player->priv->mmplayer,
 				 "error",
@@ -3404,6 +3623,8 @@ rb_shell_player_dispose (GObject *object)
 		player->priv->mmplayer = NULL;
 	}
 
+	g_clear_pointer (&player->priv->lookahead_entry, rhythmdb_entry_unref);
+
 	if (player->priv->play_order != NULL) {
 		g_object_unref (player->priv->play_order);
 		player->priv->play_order = NULL;
@@ -3755,8 +3976,9 @@ rb_shell_player_class_init (RBShellPlayerClass *klass)
 	 * @elapsed: the new playback position in nanoseconds
 	 *
 	 * Emitted when the playback position changes.  Only use this (as opposed to
-	 * elapsed-changed) when you require subsecond precision.  This signal will be
-	 * emitted multiple times per second.
+	 * elapsed-changed) when you require subsecond precision.  This signal is
+	 * emitted at least once a second while playing; use
+	 * #rb_shell_player_add_tick_subscriber to receive it more often.
 	 */
 	rb_shell_player_signals[ELAPSED_NANO_CHANGED] =
 		g_signal_new ("elapsed-nano-changed",
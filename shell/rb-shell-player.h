@@ -119,6 +119,10 @@ gboolean		rb_shell_player_get_playing_time(RBShellPlayer *player,
 gboolean		rb_shell_player_set_playing_time(RBShellPlayer *player,
                                                          guint time,
                                                          GError **error);
+guint			rb_shell_player_add_tick_subscriber (RBShellPlayer *player,
+							 guint interval);
+void			rb_shell_player_remove_tick_subscriber (RBShellPlayer *player,
+							 guint id);
 gboolean		rb_shell_player_seek		(RBShellPlayer *player,
 							 gint32 offset,
 							 GError **error);
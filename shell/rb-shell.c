@@ -463,6 +463,8 @@ construct_db (RBShell *shell)
 	shell->priv->db = rhythmdb_tree_new (pathname);
 	g_free (pathname);
 
+	g_object_set (shell->priv->db, "journal", TRUE, "progressive-load", TRUE, NULL);
+
 	if (shell->priv->dry_run)
 		g_object_set (shell->priv->db, "dry-run", TRUE, NULL);
 	if (shell->priv->no_update)
@@ -41,6 +41,7 @@
 #include "rb-gst-media-types.h"
 #include "rb-task-progress.h"
 #include "rb-file-helpers.h"
+#include "rb-transcode-cache.h"
 
 enum
 {
@@ -69,6 +70,7 @@ enum
 	PROP_DONE_ENTRIES,
 	PROP_PROGRESS,
 	PROP_ENTRY_LIST,
+	PROP_MAX_ENCODERS,
 	PROP_TASK_LABEL,
 	PROP_TASK_DETAIL,
 	PROP_TASK_PROGRESS,
@@ -82,14 +84,43 @@ static void	rb_track_transfer_batch_class_init (RBTrackTransferBatchClass *klass
 static void	rb_track_transfer_batch_init (RBTrackTransferBatch *batch);
 static void	rb_track_transfer_batch_task_progress_init (RBTaskProgressInterface *iface);
 
+typedef enum {
+	TRACK_PREPARING,
+	TRACK_ENCODING,
+	TRACK_WAITING,
+	TRACK_ENCODED,
+	TRACK_POSTPROCESSING,
+	TRACK_FINISHED
+} TransferTrackState;
+
+typedef struct {
+	RBTrackTransferBatch *batch;
+	RhythmDBEntry *entry;
+	char *dest_uri;
+	GstEncodingProfile *profile;
+	RBEncoder *encoder;
+	TransferTrackState state;
+	double entry_fraction;
+	double fraction;
+	gboolean overwrite;
+
+	/* transcode cache state */
+	char *cache_key;
+	gboolean cache_hit;
+
+	/* results */
+	char *done_uri;
+	guint64 dest_size;
+	char *mediatype;
+	GError *error;
+	gboolean skipped;
+} TransferTrack;
+
 static gboolean start_next (RBTrackTransferBatch *batch);
-static void start_encoding (RBTrackTransferBatch *batch, gboolean overwrite);
-static void track_transfer_completed (RBTrackTransferBatch *batch,
-				      const char *dest_uri,
-				      guint64 dest_size,
-				      const char *mediatype,
-				      gboolean skipped,
-				      GError *error);
+static void start_encoding (TransferTrack *track, gboolean overwrite);
+static void complete_tracks (RBTrackTransferBatch *batch);
+static int get_max_encoders (RBTrackTransferBatch *batch);
+static void prompt_next_overwrite (RBTrackTransferBatch *batch);
 
 static guint	signals[LAST_SIGNAL] = { 0 };
 
@@ -111,13 +142,12 @@ struct _RBTrackTransferBatchPrivate
 	guint64 total_size;
 	double total_fraction;
 
-	RhythmDBEntry *current;
-	double current_entry_fraction;
-	char *current_dest_uri;
-	gboolean current_dest_uri_sanitized;
-	double current_fraction;
-	RBEncoder *current_encoder;
-	GstEncodingProfile *current_profile;
+	int max_encoders;
+	GList *active;
+	int encoders;
+	gboolean preparing;
+	TransferTrack *prompt_track;
+	GList *prompt_queue;
 	gboolean cancelled;
 
 	char *task_label;
@@ -381,7 +411,9 @@ _rb_track_transfer_batch_start (RBTrackTransferBatch *batch)
 	RBShell *shell;
 	GList *l;
 
-	g_object_get (batch->priv->queue, "shell", &shell, NULL);
+	shell = NULL;
+	if (batch->priv->queue != NULL)
+		g_object_get (batch->priv->queue, "shell", &shell, NULL);
 
 	/* calculate total duration and file size and figure out the
 	 * origin source if we weren't given one to start with.
@@ -408,7 +440,7 @@ _rb_track_transfer_batch_start (RBTrackTransferBatch *batch)
 			batch->priv->total_duration = 0;
 		}
 
-		if (batch->priv->source == NULL) {
+		if (batch->priv->source == NULL && shell != NULL) {
 			RhythmDBEntryType *entry_type;
 			RBSource *entry_origin;
 
@@ -423,7 +455,8 @@ _rb_track_transfer_batch_start (RBTrackTransferBatch *batch)
 		}
 	}
 
-	g_object_unref (shell);
+	if (shell != NULL)
+		g_object_unref (shell);
 
 	if (origin != NULL) {
 		batch->priv->source = origin;
@@ -432,6 +465,7 @@ _rb_track_transfer_batch_start (RBTrackTransferBatch *batch)
 	batch->priv->cancelled = FALSE;
 	batch->priv->total_fraction = 0.0;
 
+	rb_debug ("running up to %d encoders", get_max_encoders (batch));
 	g_signal_emit (batch, signals[STARTED], 0);
 	g_object_notify (G_OBJECT (batch), "task-progress");
 	g_object_notify (G_OBJECT (batch), "task-detail");
@@ -448,41 +482,114 @@ _rb_track_transfer_batch_start (RBTrackTransferBatch *batch)
 void
 _rb_track_transfer_batch_cancel (RBTrackTransferBatch *batch)
 {
+	GList *l;
+
 	batch->priv->cancelled = TRUE;
 	rb_debug ("batch being cancelled");
 
-	if (batch->priv->current_encoder != NULL) {
-		rb_encoder_cancel (batch->priv->current_encoder);
-
-		/* other things take care of cleaning up the encoder */
+	for (l = batch->priv->active; l != NULL; l = l->next) {
+		TransferTrack *track = l->data;
+
+		switch (track->state) {
+		case TRACK_ENCODING:
+			/* other things take care of cleaning up the encoder */
+			if (track->encoder != NULL)
+				rb_encoder_cancel (track->encoder);
+			break;
+		case TRACK_WAITING:
+			track->skipped = TRUE;
+			track->state = TRACK_FINISHED;
+			break;
+		default:
+			break;
+		}
 	}
+	batch->priv->prompt_track = NULL;
+	g_list_free (batch->priv->prompt_queue);
+	batch->priv->prompt_queue = NULL;
+
+	g_object_ref (batch);
+	complete_tracks (batch);
 
 	g_signal_emit (batch, signals[CANCELLED], 0);
 	g_object_notify (G_OBJECT (batch), "task-outcome");
-
-	/* anything else? */
+	g_object_unref (batch);
 }
 
 /**
  * _rb_track_transfer_batch_continue:
  * @batch: a #RBTrackTransferBatch
- * @overwrite: if %TRUE, overwrite the current file, otherwise skip
+ * @overwrite: if %TRUE, overwrite the existing file, otherwise skip
  *
- * Continues a transfer that was suspended because the current
- * destination URI exists.  Only to be called by the #RBTrackTransferQueue.
+ * Continues a transfer that was suspended because its destination
+ * URI exists.  Only to be called by the #RBTrackTransferQueue.
  */
 void
 _rb_track_transfer_batch_continue (RBTrackTransferBatch *batch, gboolean overwrite)
 {
+	TransferTrack *track;
+
+	track = batch->priv->prompt_track;
+	if (track == NULL) {
+		rb_debug ("no transfer is waiting for an overwrite decision");
+		return;
+	}
+	batch->priv->prompt_track = NULL;
+
+	g_object_ref (batch);
 	if (overwrite) {
-		start_encoding (batch, TRUE);
+		start_encoding (track, TRUE);
 	} else {
-		track_transfer_completed (batch, NULL, 0, NULL, TRUE, NULL);
+		track->skipped = TRUE;
+		track->state = TRACK_FINISHED;
+		complete_tracks (batch);
+		start_next (batch);
 	}
+
+	prompt_next_overwrite (batch);
+	g_object_unref (batch);
+}
+
+static int
+get_max_encoders (RBTrackTransferBatch *batch)
+{
+	int max = batch->priv->max_encoders;
+
+	if (max <= 0 && batch->priv->settings != NULL) {
+		GSettingsSchema *schema;
+
+		g_object_get (batch->priv->settings, "settings-schema", &schema, NULL);
+		if (schema != NULL) {
+			if (g_settings_schema_has_key (schema, "max-encoders"))
+				max = g_settings_get_int (batch->priv->settings, "max-encoders");
+			g_settings_schema_unref (schema);
+		}
+	}
+
+	if (max <= 0)
+		max = g_get_num_processors ();
+	return max;
+}
+
+static void
+transfer_track_free (TransferTrack *track)
+{
+	if (track->encoder != NULL) {
+		g_signal_handlers_disconnect_by_data (track->encoder, track);
+		g_object_unref (track->encoder);
+	}
+	if (track->entry != NULL)
+		rhythmdb_entry_unref (track->entry);
+	g_free (track->dest_uri);
+	g_free (track->cache_key);
+	g_free (track->done_uri);
+	g_free (track->mediatype);
+	g_clear_error (&track->error);
+	g_free (track);
 }
 
 static void
-emit_progress (RBTrackTransferBatch *batch)
+emit_progress (RBTrackTransferBatch *batch, TransferTrack *track)
 {
 	int done;
 	int total;
@@ -494,8 +601,8 @@ emit_progress (RBTrackTransferBatch *batch)
 		      "progress", &fraction,
 		      NULL);
 	g_signal_emit (batch, signals[TRACK_PROGRESS], 0,
-		       batch->priv->current,
-		       batch->priv->current_dest_uri,
+		       track->entry,
+		       track->dest_uri,
 		       done,
 		       total,
 		       fraction);
@@ -503,135 +610,215 @@ emit_progress (RBTrackTransferBatch *batch)
 }
 
 static void
-encoder_progress_cb (RBEncoder *encoder, double fraction, RBTrackTransferBatch *batch)
+encoder_progress_cb (RBEncoder *encoder, double fraction, TransferTrack *track)
 {
-	batch->priv->current_fraction = fraction;
-	emit_progress (batch);
+	track->fraction = fraction;
+	emit_progress (track->batch, track);
 }
 
 static void
-track_transfer_completed (RBTrackTransferBatch *batch,
-			  const char *dest_uri,
-			  guint64 dest_size,
-			  const char *mediatype,
-			  gboolean skipped,
-			  GError *error)
+postprocess_transfer_cb (GObject *source_object, GAsyncResult *result, gpointer data)
 {
-	RhythmDBEntry *entry;
+	RBTrackTransferBatch *batch;
+	GError *error = NULL;
+	TransferTrack *track = g_task_get_task_data (G_TASK (result));
 
-	entry = batch->priv->current;
-	batch->priv->current = NULL;
+	batch = RB_TRACK_TRANSFER_BATCH (source_object);
+	if (g_task_propagate_boolean (G_TASK (result), &error) == FALSE) {
+		rb_debug ("postprocessing failed for transfer %s: %s", track->done_uri, error->message);
+		g_free (track->done_uri);
+		g_free (track->mediatype);
+		track->done_uri = NULL;
+		track->mediatype = NULL;
+		track->dest_size = 0;
+		g_clear_error (&track->error);
+		track->error = error;
+	} else {
+		rb_debug ("postprocessing done for %s", track->done_uri);
+	}
+	track->state = TRACK_FINISHED;
 
-	batch->priv->current_profile = NULL;
+	g_object_ref (batch);
+	complete_tracks (batch);
+	start_next (batch);
+	g_object_unref (batch);
+}
 
-	/* update batch state to reflect that the track is done */
-	batch->priv->total_fraction += batch->priv->current_entry_fraction;
-	batch->priv->done_entries = g_list_append (batch->priv->done_entries, entry);
+static void
+postprocess_transfer (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+	RBTrackTransferBatch *batch;
+	TransferTrack *track = task_data;
 
-	if (batch->priv->cancelled == FALSE) {
-		/* keep ourselves alive until the end of the function, since it's
-		 * possible that a signal handler will cancel us.
-		 */
-		g_object_ref (batch);
-		if (skipped == FALSE) {
-			g_signal_emit (batch, signals[TRACK_DONE], 0,
-				       entry,
-				       dest_uri,
-				       dest_size,
-				       mediatype,
-				       error);
+	batch = RB_TRACK_TRANSFER_BATCH (source_object);
+	g_signal_emit (batch, signals[TRACK_POSTPROCESS], 0, task, track->entry, track->done_uri, track->dest_size, track->mediatype);
+	if (g_task_had_error (task) == FALSE)
+		g_task_return_boolean (task, TRUE);
+}
+
+/*
+ * Tracks are encoded in parallel, but postprocessing and completion
+ * happen strictly in the order the tracks were started, one at a time,
+ * so transfer targets see the same sequence as a serial transfer.
+ */
+static void
+complete_tracks (RBTrackTransferBatch *batch)
+{
+	while (batch->priv->active != NULL) {
+		TransferTrack *track = batch->priv->active->data;
+		RhythmDBEntry *entry;
+
+		if (track->state == TRACK_ENCODED) {
+			if (batch->priv->cancelled == FALSE &&
+			    track->error == NULL &&
+			    g_signal_has_handler_pending (batch, signals[TRACK_POSTPROCESS], 0, TRUE)) {
+				GTask *task;
+
+				task = g_task_new (batch, NULL, postprocess_transfer_cb, NULL);
+				g_task_set_task_data (task, track, NULL);
+				track->state = TRACK_POSTPROCESSING;
+
+				rb_debug ("postprocessing for %s", track->done_uri);
+				g_task_run_in_thread (task, postprocess_transfer);
+				g_object_unref (task);
+				return;
+			}
+
+			rb_debug ("no postprocessing for %s", track->done_uri);
+			track->state = TRACK_FINISHED;
 		}
 
-		start_next (batch);
+		if (track->state != TRACK_FINISHED)
+			return;
 
-		g_object_unref (batch);
+		/* update batch state to reflect that the track is done */
+		batch->priv->active = g_list_delete_link (batch->priv->active, batch->priv->active);
+		batch->priv->total_fraction += track->entry_fraction;
+		entry = track->entry;
+		track->entry = NULL;
+		batch->priv->done_entries = g_list_append (batch->priv->done_entries, entry);
+
+		if (batch->priv->cancelled == FALSE && track->skipped == FALSE) {
+			g_signal_emit (batch, signals[TRACK_DONE], 0,
+				       entry,
+				       track->done_uri,
+				       track->dest_size,
+				       track->mediatype,
+				       track->error);
+		}
+		transfer_track_free (track);
 	}
 }
 
-
-typedef struct {
-	char *dest_uri;
-	guint64 dest_size;
-	char *mediatype;
-} TransferPostprocessData;
-
 static void
-transfer_postprocess_data_destroy (gpointer data)
+prompt_next_overwrite (RBTrackTransferBatch *batch)
 {
-	TransferPostprocessData *td = data;
-	g_free (td->dest_uri);
-	g_free (td->mediatype);
-	g_free (td);
+	TransferTrack *track;
+
+	if (batch->priv->prompt_track != NULL || batch->priv->prompt_queue == NULL)
+		return;
+
+	track = batch->priv->prompt_queue->data;
+	batch->priv->prompt_queue = g_list_delete_link (batch->priv->prompt_queue, batch->priv->prompt_queue);
+	batch->priv->prompt_track = track;
+	g_signal_emit (batch, signals[OVERWRITE_PROMPT], 0, track->dest_uri);
 }
 
 static void
-postprocess_transfer_cb (GObject *source_object, GAsyncResult *result, gpointer data)
+cache_store_task (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
 {
-	RBTrackTransferBatch *batch;
+	TransferTrack *track = task_data;
 	GError *error = NULL;
-	TransferPostprocessData *td = g_task_get_task_data (G_TASK (result));
 
-	batch = RB_TRACK_TRANSFER_BATCH (source_object);
-	if (g_task_propagate_boolean (G_TASK (result), &error) == FALSE) {
-		rb_debug ("postprocessing failed for transfer %s: %s", td->dest_uri, error->message);
-		track_transfer_completed (batch, NULL, 0, NULL, FALSE, error);
+	if (rb_transcode_cache_store (rb_transcode_cache_get_default (), track->cache_key, track->done_uri, &error) == FALSE &&
+	    error != NULL) {
+		rb_debug ("unable to cache %s: %s", track->done_uri, error->message);
 		g_clear_error (&error);
-	} else {
-		rb_debug ("postprocessing done for %s", td->dest_uri);
-		track_transfer_completed (batch, td->dest_uri, td->dest_size, td->mediatype, FALSE, NULL);
 	}
+	g_task_return_boolean (task, TRUE);
 }
 
 static void
-postprocess_transfer (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+cache_store_cb (GObject *source_object, GAsyncResult *result, gpointer data)
 {
-	RBTrackTransferBatch *batch;
-	TransferPostprocessData *td = task_data;
+	RBTrackTransferBatch *batch = RB_TRACK_TRANSFER_BATCH (source_object);
+	TransferTrack *track = data;
 
-	batch = RB_TRACK_TRANSFER_BATCH (source_object);
-	g_signal_emit (batch, signals[TRACK_POSTPROCESS], 0, task, batch->priv->current, td->dest_uri, td->dest_size, td->mediatype);
-	if (g_task_had_error (task) == FALSE)
-		g_task_return_boolean (task, TRUE);
+	track->state = TRACK_ENCODED;
+
+	g_object_ref (batch);
+	complete_tracks (batch);
+	start_next (batch);
+	g_object_unref (batch);
 }
 
 static void
-encoder_completed_cb (RBEncoder *encoder,
-		      const char *dest_uri,
-		      guint64 dest_size,
-		      const char *mediatype,
-		      GError *error,
-		      RBTrackTransferBatch *batch)
+track_encoded (TransferTrack *track,
+	       const char *dest_uri,
+	       guint64 dest_size,
+	       const char *mediatype,
+	       GError *error)
 {
-	g_object_unref (batch->priv->current_encoder);
-	batch->priv->current_encoder = NULL;
+	RBTrackTransferBatch *batch = track->batch;
 
+	batch->priv->encoders--;
+
+	g_object_ref (batch);
 	if (error == NULL) {
 		rb_debug ("encoder finished (size %" G_GUINT64_FORMAT ")", dest_size);
-	} else if (g_error_matches (error, RB_ENCODER_ERROR, RB_ENCODER_ERROR_DEST_EXISTS)) {
+	} else if (g_error_matches (error, RB_ENCODER_ERROR, RB_ENCODER_ERROR_DEST_EXISTS) &&
+		   batch->priv->cancelled == FALSE) {
 		rb_debug ("encoder stopped because destination %s already exists", dest_uri);
-		g_signal_emit (batch, signals[OVERWRITE_PROMPT], 0, dest_uri);
+		track->state = TRACK_WAITING;
+		batch->priv->prompt_queue = g_list_append (batch->priv->prompt_queue, track);
+		start_next (batch);
+		prompt_next_overwrite (batch);
+		g_object_unref (batch);
 		return;
 	} else {
 		rb_debug ("encoder finished (error: %s)", error->message);
 	}
 
-	if (g_signal_has_handler_pending (batch, signals[TRACK_POSTPROCESS], 0, TRUE)) {
+	track->fraction = 1.0;
+	track->done_uri = g_strdup (dest_uri);
+	track->dest_size = dest_size;
+	track->mediatype = g_strdup (mediatype);
+	if (error != NULL)
+		track->error = g_error_copy (error);
+
+	/* keep a copy of the output before postprocessing can move it away */
+	if (error == NULL &&
+	    track->cache_key != NULL &&
+	    track->cache_hit == FALSE &&
+	    batch->priv->cancelled == FALSE) {
 		GTask *task;
-		TransferPostprocessData *td;
 
-		task = g_task_new (batch, NULL, postprocess_transfer_cb, NULL);
-		td = g_new0 (TransferPostprocessData, 1);
-		td->dest_uri = g_strdup (dest_uri);
-		td->dest_size = dest_size;
-		td->mediatype = g_strdup (mediatype);
-		g_task_set_task_data (task, td, transfer_postprocess_data_destroy);
-
-		rb_debug ("postprocessing for %s", dest_uri);
-		g_task_run_in_thread (task, postprocess_transfer);
+		task = g_task_new (batch, NULL, cache_store_cb, track);
+		g_task_set_task_data (task, track, NULL);
+		g_task_run_in_thread (task, cache_store_task);
+		g_object_unref (task);
 	} else {
-		rb_debug ("no postprocessing for %s", dest_uri);
-		track_transfer_completed (batch, dest_uri, dest_size, mediatype, FALSE, error);
+		track->state = TRACK_ENCODED;
+		complete_tracks (batch);
 	}
+
+	start_next (batch);
+	g_object_unref (batch);
+}
+
+static void
+encoder_completed_cb (RBEncoder *encoder,
+		      const char *dest_uri,
+		      guint64 dest_size,
+		      const char *mediatype,
+		      GError *error,
+		      TransferTrack *track)
+{
+	g_signal_handlers_disconnect_by_data (track->encoder, track);
+	g_object_unref (track->encoder);
+	track->encoder = NULL;
+
+	track_encoded (track, dest_uri, dest_size, mediatype, error);
 }
 
 static char *
@@ -656,53 +843,147 @@ get_extension_from_location (RhythmDBEntry *entry)
 }
 
 static void
-start_encoding (RBTrackTransferBatch *batch, gboolean overwrite)
+start_encoder (TransferTrack *track)
+{
+	track->encoder = rb_encoder_new ();
+
+	g_signal_connect (track->encoder, "progress",
+			  G_CALLBACK (encoder_progress_cb),
+			  track);
+	g_signal_connect (track->encoder, "completed",
+			  G_CALLBACK (encoder_completed_cb),
+			  track);
+
+	rb_encoder_encode (track->encoder,
+			   track->entry,
+			   track->dest_uri,
+			   track->overwrite,
+			   track->profile);
+}
+
+typedef struct {
+	char *uri;
+	guint64 size;
+} CacheFetchResult;
+
+static void
+cache_fetch_result_free (CacheFetchResult *result)
+{
+	g_free (result->uri);
+	g_free (result);
+}
+
+static void
+cache_fetch_task (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
 {
-	if (batch->priv->current_encoder != NULL) {
-		g_object_unref (batch->priv->current_encoder);
+	TransferTrack *track = task_data;
+	CacheFetchResult *result;
+	GError *error = NULL;
+
+	result = g_new0 (CacheFetchResult, 1);
+	if (rb_transcode_cache_fetch (rb_transcode_cache_get_default (),
+				      track->cache_key,
+				      track->dest_uri,
+				      track->overwrite,
+				      &result->uri,
+				      &result->size,
+				      &error)) {
+		g_task_return_pointer (task, result, (GDestroyNotify) cache_fetch_result_free);
+	} else if (error != NULL) {
+		cache_fetch_result_free (result);
+		g_task_return_error (task, error);
+	} else {
+		cache_fetch_result_free (result);
+		g_task_return_pointer (task, NULL, NULL);
+	}
+}
+
+static void
+cache_fetch_cb (GObject *source_object, GAsyncResult *result, gpointer data)
+{
+	TransferTrack *track = data;
+	CacheFetchResult *fetched;
+	GError *error = NULL;
+	char *mediatype;
+
+	fetched = g_task_propagate_pointer (G_TASK (result), &error);
+	if (fetched == NULL && error == NULL) {
+		rb_debug ("no cached transcode for %s", rhythmdb_entry_get_string (track->entry, RHYTHMDB_PROP_LOCATION));
+		if (track->batch->priv->cancelled) {
+			track_encoded (track, NULL, 0, NULL, NULL);
+		} else {
+			start_encoder (track);
+		}
+		return;
+	}
+
+	mediatype = rb_gst_encoding_profile_get_media_type (track->profile);
+	if (fetched != NULL) {
+		rb_debug ("using cached transcode for %s", track->dest_uri);
+		track->cache_hit = TRUE;
+		track_encoded (track, fetched->uri, fetched->size, mediatype, NULL);
+		cache_fetch_result_free (fetched);
+	} else {
+		track_encoded (track, track->dest_uri, 0, mediatype, error);
+		g_error_free (error);
+	}
+	g_free (mediatype);
+}
+
+static void
+start_encoding (TransferTrack *track, gboolean overwrite)
+{
+	RBTrackTransferBatch *batch = track->batch;
+
+	track->state = TRACK_ENCODING;
+	track->fraction = 0.0;
+	track->overwrite = overwrite;
+	batch->priv->encoders++;
+
+	/* transcoded output may be cached from an earlier transfer */
+	if (track->profile != NULL && track->cache_key == NULL && rb_transcode_cache_get_default () != NULL) {
+		track->cache_key = rb_transcode_cache_get_key (track->entry, track->profile);
+	}
+
+	if (track->cache_key != NULL) {
+		GTask *task;
+
+		task = g_task_new (batch, NULL, cache_fetch_cb, track);
+		g_task_set_task_data (task, track, NULL);
+		g_task_run_in_thread (task, cache_fetch_task);
+		g_object_unref (task);
+	} else {
+		start_encoder (track);
 	}
-	batch->priv->current_encoder = rb_encoder_new ();
-
-	g_signal_connect_object (batch->priv->current_encoder, "progress",
-				 G_CALLBACK (encoder_progress_cb),
-				 batch, 0);
-	g_signal_connect_object (batch->priv->current_encoder, "completed",
-				 G_CALLBACK (encoder_completed_cb),
-				 batch, 0);
-
-	rb_encoder_encode (batch->priv->current_encoder,
-			   batch->priv->current,
-			   batch->priv->current_dest_uri,
-			   overwrite,
-			   batch->priv->current_profile);
 }
 
 static void
 prepare_transfer_task (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
 {
 	RBTrackTransferBatch *batch;
+	TransferTrack *track = task_data;
 	GError *error = NULL;
 
 	batch = RB_TRACK_TRANSFER_BATCH (source_object);
-	rb_debug ("creating parent dirs for %s", batch->priv->current_dest_uri);
-	if (rb_uri_create_parent_dirs (batch->priv->current_dest_uri, &error) == FALSE) {
+	rb_debug ("creating parent dirs for %s", track->dest_uri);
+	if (rb_uri_create_parent_dirs (track->dest_uri, &error) == FALSE) {
 		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_INVALID_FILENAME)) {
 			char *dest;
 
 			g_clear_error (&error);
-			dest = rb_sanitize_uri_for_filesystem (batch->priv->current_dest_uri, "msdos");
-			g_free (batch->priv->current_dest_uri);
+			dest = rb_sanitize_uri_for_filesystem (track->dest_uri, "msdos");
+			g_free (track->dest_uri);
 
 			rb_debug ("retrying parent dir creation with sanitized uri: %s", dest);
-			batch->priv->current_dest_uri = dest;
+			track->dest_uri = dest;
 
-			rb_uri_create_parent_dirs (batch->priv->current_dest_uri, &error);
+			rb_uri_create_parent_dirs (track->dest_uri, &error);
 		}
 	}
 
 	if (error == NULL) {
-		rb_debug ("preparing for %s", batch->priv->current_dest_uri);
-		g_signal_emit (batch, signals[TRACK_PREPARE], 0, task, batch->priv->current, batch->priv->current_dest_uri);
+		rb_debug ("preparing for %s", track->dest_uri);
+		g_signal_emit (batch, signals[TRACK_PREPARE], 0, task, track->entry, track->dest_uri);
 	}
 
 	if (error != NULL) {
@@ -717,33 +998,57 @@ static void
 prepare_transfer_cb (GObject *source_object, GAsyncResult *result, gpointer data)
 {
 	RBTrackTransferBatch *batch;
+	TransferTrack *track = data;
 	GError *error = NULL;
 
 	batch = RB_TRACK_TRANSFER_BATCH (source_object);
+	batch->priv->preparing = FALSE;
+
+	g_object_ref (batch);
 	if (g_task_propagate_boolean (G_TASK (result), &error) == FALSE) {
-		rb_debug ("failed to prepare transfer of %s: %s", batch->priv->current_dest_uri, error->message);
-		track_transfer_completed (batch, NULL, 0, NULL, FALSE, error);
+		rb_debug ("failed to prepare transfer of %s: %s", track->dest_uri, error->message);
+		track->error = error;
+		track->state = TRACK_FINISHED;
+	} else if (batch->priv->cancelled) {
+		track->skipped = TRUE;
+		track->state = TRACK_FINISHED;
 	} else {
-		rb_debug ("successfully prepared to transfer %s", batch->priv->current_dest_uri);
+		rb_debug ("successfully prepared to transfer %s", track->dest_uri);
 		g_signal_emit (batch, signals[TRACK_STARTED], 0,
-			       batch->priv->current,
-			       batch->priv->current_dest_uri);
-		start_encoding (batch, FALSE);
+			       track->entry,
+			       track->dest_uri);
+		start_encoding (track, FALSE);
 		g_object_notify (G_OBJECT (batch), "task-detail");
 	}
+
+	complete_tracks (batch);
+	start_next (batch);
+	g_object_unref (batch);
 }
 
 static gboolean
 start_next (RBTrackTransferBatch *batch)
 {
 	GstEncodingProfile *profile = NULL;
+	TransferTrack *track = NULL;
+	int max_encoders;
 
 	if (batch->priv->cancelled == TRUE) {
 		return FALSE;
 	}
 
-	rb_debug ("%d entries remain in the batch", g_list_length (batch->priv->entries));
-	batch->priv->current_fraction = 0.0;
+	/* only prepare one track at a time, and don't let finished tracks
+	 * pile up too far behind one that is still being transferred.
+	 */
+	max_encoders = get_max_encoders (batch);
+	if (batch->priv->preparing ||
+	    batch->priv->encoders >= max_encoders ||
+	    g_list_length (batch->priv->active) >= max_encoders * 2) {
+		return TRUE;
+	}
+
+	rb_debug ("%d entries remain in the batch, %d encoders running",
+		  g_list_length (batch->priv->entries), batch->priv->encoders);
 
 	while ((batch->priv->entries != NULL) && (batch->priv->cancelled == FALSE)) {
 		RhythmDBEntry *entry;
@@ -753,6 +1058,7 @@ start_next (RBTrackTransferBatch *batch)
 		GList *n;
 		char *media_type;
 		char *extension;
+		char *dest_uri;
 
 		n = batch->priv->entries;
 		batch->priv->entries = g_list_remove_link (batch->priv->entries, n);
@@ -772,6 +1078,7 @@ start_next (RBTrackTransferBatch *batch)
 			fraction = ((double)filesize) / (double) batch->priv->total_size;
 		} else {
 			int count = g_list_length (batch->priv->entries) +
+				    g_list_length (batch->priv->active) +
 				    g_list_length (batch->priv->done_entries) + 1;
 			fraction = 1.0 / ((double)count);
 		}
@@ -813,18 +1120,16 @@ start_next (RBTrackTransferBatch *batch)
 			}
 		}
 
-		g_free (batch->priv->current_dest_uri);
-		batch->priv->current_dest_uri = NULL;
-		batch->priv->current_dest_uri_sanitized = FALSE;
+		dest_uri = NULL;
 		g_signal_emit (batch, signals[GET_DEST_URI], 0,
 			       entry,
 			       media_type,
 			       extension,
-			       &batch->priv->current_dest_uri);
+			       &dest_uri);
 		g_free (media_type);
 		g_free (extension);
 
-		if (batch->priv->current_dest_uri == NULL) {
+		if (dest_uri == NULL) {
 			rb_debug ("unable to build destination URI for %s, skipping",
 				  rhythmdb_entry_get_string (entry, RHYTHMDB_PROP_LOCATION));
 			rhythmdb_entry_unref (entry);
@@ -832,18 +1137,26 @@ start_next (RBTrackTransferBatch *batch)
 			continue;
 		}
 
-		batch->priv->current = entry;
-		batch->priv->current_entry_fraction = fraction;
-		batch->priv->current_profile = profile;
+		track = g_new0 (TransferTrack, 1);
+		track->batch = batch;
+		track->entry = entry;
+		track->dest_uri = dest_uri;
+		track->entry_fraction = fraction;
+		track->profile = profile;
+		track->state = TRACK_PREPARING;
 		break;
 	}
 
-	if (batch->priv->current != NULL) {
+	if (track != NULL) {
 		GTask *task;
 
-		task = g_task_new (batch, NULL, prepare_transfer_cb, NULL);
+		batch->priv->active = g_list_append (batch->priv->active, track);
+		batch->priv->preparing = TRUE;
+
+		task = g_task_new (batch, NULL, prepare_transfer_cb, track);
+		g_task_set_task_data (task, track, NULL);
 		g_task_run_in_thread (task, prepare_transfer_task);
-	} else {
+	} else if (batch->priv->active == NULL) {
 		g_signal_emit (batch, signals[COMPLETE], 0);
 		g_object_notify (G_OBJECT (batch), "task-outcome");
 		return FALSE;
@@ -885,6 +1198,9 @@ impl_set_property (GObject *object,
 	case PROP_DESTINATION:
 		batch->priv->destination = g_value_dup_object (value);
 		break;
+	case PROP_MAX_ENCODERS:
+		batch->priv->max_encoders = g_value_get_int (value);
+		break;
 	case PROP_TASK_LABEL:
 		batch->priv->task_label = g_value_dup_string (value);
 		break;
@@ -939,10 +1255,8 @@ impl_get_property (GObject *object,
 		{
 			int count;
 			count = g_list_length (batch->priv->done_entries) +
+				g_list_length (batch->priv->active) +
 				g_list_length (batch->priv->entries);
-			if (batch->priv->current != NULL) {
-				count++;
-			}
 			g_value_set_int (value, count);
 		}
 		break;
@@ -951,28 +1265,38 @@ impl_get_property (GObject *object,
 		break;
 	case PROP_TASK_PROGRESS:
 	case PROP_PROGRESS:		/* needed? */
-		if ((batch->priv->entries == NULL) && (batch->priv->done_entries != NULL)) {
+		if ((batch->priv->entries == NULL) &&
+		    (batch->priv->active == NULL) &&
+		    (batch->priv->done_entries != NULL)) {
 			g_value_set_double (value, 1.0);
 		} else {
 			double p = batch->priv->total_fraction;
-			if (batch->priv->current != NULL) {
-				p += batch->priv->current_fraction * batch->priv->current_entry_fraction;
+			GList *l;
+
+			for (l = batch->priv->active; l != NULL; l = l->next) {
+				TransferTrack *track = l->data;
+				p += track->fraction * track->entry_fraction;
 			}
-			g_value_set_double (value, p);
+			g_value_set_double (value, MIN (p, 1.0));
 		}
 		break;
 	case PROP_ENTRY_LIST:
 		{
 			GList *l;
+			GList *a;
 			l = g_list_copy (batch->priv->entries);
-			if (batch->priv->current != NULL) {
-				l = g_list_append (l, batch->priv->current);
+			for (a = batch->priv->active; a != NULL; a = a->next) {
+				TransferTrack *track = a->data;
+				l = g_list_append (l, track->entry);
 			}
 			l = g_list_concat (l, g_list_copy (batch->priv->done_entries));
 			g_list_foreach (l, (GFunc) rhythmdb_entry_ref, NULL);
 			g_value_set_pointer (value, l);
 		}
 		break;
+	case PROP_MAX_ENCODERS:
+		g_value_set_int (value, batch->priv->max_encoders);
+		break;
 	case PROP_TASK_LABEL:
 		g_value_set_string (value, batch->priv->task_label);
 		break;
@@ -983,8 +1307,8 @@ impl_get_property (GObject *object,
 
 			done = g_list_length (batch->priv->done_entries);
 			total = done + g_list_length (batch->priv->entries);
-			if (batch->priv->current) {
-				total++;
+			if (batch->priv->active != NULL) {
+				total += g_list_length (batch->priv->active);
 				done++;
 			}
 			g_value_take_string (value, g_strdup_printf (_("%d of %d"), done, total));
@@ -993,7 +1317,9 @@ impl_get_property (GObject *object,
 	case PROP_TASK_OUTCOME:
 		if (batch->priv->cancelled) {
 			g_value_set_enum (value, RB_TASK_OUTCOME_CANCELLED);
-		} else if ((batch->priv->entries == NULL) && (batch->priv->done_entries != NULL)) {
+		} else if ((batch->priv->entries == NULL) &&
+			   (batch->priv->active == NULL) &&
+			   (batch->priv->done_entries != NULL)) {
 			g_value_set_enum (value, RB_TASK_OUTCOME_COMPLETE);
 		} else {
 			g_value_set_enum (value, RB_TASK_OUTCOME_NONE);
@@ -1038,9 +1364,8 @@ impl_finalize (GObject *object)
 
 	rb_list_destroy_free (batch->priv->entries, (GDestroyNotify) rhythmdb_entry_unref);
 	rb_list_destroy_free (batch->priv->done_entries, (GDestroyNotify) rhythmdb_entry_unref);
-	if (batch->priv->current != NULL) {
-		rhythmdb_entry_unref (batch->priv->current);
-	}
+	g_list_free (batch->priv->prompt_queue);
+	g_list_free_full (batch->priv->active, (GDestroyNotify) transfer_track_free);
 	g_free (batch->priv->task_label);
 
 	G_OBJECT_CLASS (rb_track_transfer_batch_parent_class)->finalize (object);
@@ -1173,6 +1498,21 @@ rb_track_transfer_batch_class_init (RBTrackTransferBatchClass *klass)
 							       "list of all entries in the batch",
 							       G_PARAM_READABLE));
 
+	/**
+	 * RBTrackTransferBatch:max-encoders:
+	 *
+	 * Maximum number of tracks to encode at the same time.  If this is 0,
+	 * the max-encoders setting is used if it is set, otherwise one encoder
+	 * is run for each processor.
+	 */
+	g_object_class_install_property (object_class,
+					 PROP_MAX_ENCODERS,
+					 g_param_spec_int ("max-encoders",
+							   "max encoders",
+							   "Maximum number of concurrent encoders",
+							   0, G_MAXINT, 0,
+							   G_PARAM_READWRITE));
+
 	g_object_class_override_property (object_class, PROP_TASK_LABEL, "task-label");
 	g_object_class_override_property (object_class, PROP_TASK_DETAIL, "task-detail");
 	g_object_class_override_property (object_class, PROP_TASK_PROGRESS, "task-progress");
@@ -0,0 +1,593 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "rb-transcode-cache.h"
+#include "rb-encoder.h"
+#include "rb-debug.h"
+#include "rb-file-helpers.h"
+
+/**
+ * SECTION:rbtranscodecache
+ * @short_description: on-disk cache of transcoded tracks
+ *
+ * Keeps the output of recent transcodes so that transferring the same
+ * track with the same encoding profile again (for example, syncing a
+ * playlist to several devices) doesn't need to encode it again.
+ * Items are identified by the source location and modification time,
+ * the database metadata written into the output file, and the encoding
+ * profile, and the least recently used items are removed when the cache
+ * grows beyond its size limit.
+ */
+
+/* default cache size limit, in megabytes */
+#define DEFAULT_CACHE_SIZE	2048
+
+#define TEMP_PREFIX		".tmp-"
+
+typedef struct {
+	guint64 size;
+	gint64 used;		/* microseconds */
+} RBTranscodeCacheItem;
+
+/* entry properties the encoder writes into the output file as tags */
+static const RhythmDBPropType tag_string_props[] = {
+	RHYTHMDB_PROP_TITLE,
+	RHYTHMDB_PROP_ARTIST,
+	RHYTHMDB_PROP_ALBUM,
+	RHYTHMDB_PROP_GENRE,
+	RHYTHMDB_PROP_COMMENT,
+	RHYTHMDB_PROP_MUSICBRAINZ_TRACKID,
+	RHYTHMDB_PROP_MUSICBRAINZ_ARTISTID,
+	RHYTHMDB_PROP_MUSICBRAINZ_ALBUMID,
+	RHYTHMDB_PROP_MUSICBRAINZ_ALBUMARTISTID,
+	RHYTHMDB_PROP_ARTIST_SORTNAME,
+	RHYTHMDB_PROP_ALBUM_SORTNAME,
+	RHYTHMDB_PROP_TITLE_SORTNAME
+};
+
+static const RhythmDBPropType tag_ulong_props[] = {
+	RHYTHMDB_PROP_TRACK_NUMBER,
+	RHYTHMDB_PROP_DISC_NUMBER,
+	RHYTHMDB_PROP_DATE
+};
+
+struct _RBTranscodeCache
+{
+	char *dir;
+	guint64 max_size;
+
+	GMutex lock;
+	GHashTable *items;
+	guint64 total_size;
+	gboolean scanned;
+};
+
+static RBTranscodeCache *default_cache = NULL;
+
+/**
+ * rb_transcode_cache_get_default:
+ *
+ * Returns the transcode cache in the user's cache directory, sized
+ * according to the transcode-cache-size setting.  Must be called
+ * on the main thread.
+ *
+ * Return value: (transfer none): the default cache, or %NULL if caching is disabled
+ */
+RBTranscodeCache *
+rb_transcode_cache_get_default (void)
+{
+	static gboolean initialized = FALSE;
+	GSettingsSchema *schema;
+	int size = DEFAULT_CACHE_SIZE;
+
+	if (initialized)
+		return default_cache;
+	initialized = TRUE;
+
+	schema = g_settings_schema_source_lookup (g_settings_schema_source_get_default (), "org.gnome.rhythmbox", TRUE);
+	if (schema != NULL) {
+		if (g_settings_schema_has_key (schema, "transcode-cache-size")) {
+			GSettings *settings;
+
+			settings = g_settings_new ("org.gnome.rhythmbox");
+			size = g_settings_get_int (settings, "transcode-cache-size");
+			g_object_unref (settings);
+		}
+		g_settings_schema_unref (schema);
+	}
+
+	if (size > 0) {
+		char *dir;
+
+		dir = g_build_filename (rb_user_cache_dir (), "transcode", NULL);
+		default_cache = rb_transcode_cache_new (dir, ((guint64) size) * 1024 * 1024);
+		g_free (dir);
+	} else {
+		rb_debug ("transcode cache disabled");
+	}
+
+	return default_cache;
+}
+
+/**
+ * rb_transcode_cache_new:
+ * @dir: directory to store cached files in
+ * @max_size: maximum total size of the cached files, in bytes
+ *
+ * Creates a transcode cache using @dir.  The cache is safe to use from
+ * multiple threads.
+ *
+ * Return value: new cache
+ */
+RBTranscodeCache *
+rb_transcode_cache_new (const char *dir, guint64 max_size)
+{
+	RBTranscodeCache *cache;
+
+	cache = g_new0 (RBTranscodeCache, 1);
+	cache->dir = g_strdup (dir);
+	cache->max_size = max_size;
+	cache->items = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	g_mutex_init (&cache->lock);
+	return cache;
+}
+
+/**
+ * rb_transcode_cache_free:
+ * @cache: a #RBTranscodeCache
+ *
+ * Frees the cache.  Cached files are left on disk.
+ */
+void
+rb_transcode_cache_free (RBTranscodeCache *cache)
+{
+	g_hash_table_destroy (cache->items);
+	g_mutex_clear (&cache->lock);
+	g_free (cache->dir);
+	g_free (cache);
+}
+
+static void
+append_profile (GString *s, GstEncodingProfile *profile)
+{
+	const GstCaps *caps;
+	const char *preset;
+	char *str;
+
+	caps = gst_encoding_profile_get_format (profile);
+	if (caps != NULL) {
+		str = gst_caps_to_string (caps);
+		g_string_append (s, str);
+		g_free (str);
+	}
+	g_string_append_c (s, '\n');
+
+	preset = gst_encoding_profile_get_preset (profile);
+	if (preset != NULL)
+		g_string_append (s, preset);
+	g_string_append_c (s, '\n');
+
+	if (GST_IS_ENCODING_CONTAINER_PROFILE (profile)) {
+		const GList *l;
+
+		l = gst_encoding_container_profile_get_profiles (GST_ENCODING_CONTAINER_PROFILE (profile));
+		for (; l != NULL; l = l->next) {
+			append_profile (s, l->data);
+		}
+	}
+}
+
+/**
+ * rb_transcode_cache_get_key:
+ * @entry: the #RhythmDBEntry being transcoded
+ * @profile: the #GstEncodingProfile (including its preset) used to transcode it
+ *
+ * Builds the cache key identifying the output of transcoding @entry
+ * with @profile.  Any change to the source file, the profile, or the
+ * entry metadata written to the output file as tags gives a different key.
+ *
+ * Return value: cache key, or %NULL if the entry can't be cached
+ */
+char *
+rb_transcode_cache_get_key (RhythmDBEntry *entry, GstEncodingProfile *profile)
+{
+	GString *s;
+	char *key;
+	gulong mtime;
+	int i;
+
+	mtime = rhythmdb_entry_get_ulong (entry, RHYTHMDB_PROP_MTIME);
+	if (mtime == 0 || profile == NULL)
+		return NULL;
+
+	s = g_string_new (rhythmdb_entry_get_string (entry, RHYTHMDB_PROP_LOCATION));
+	g_string_append_printf (s, "\n%lu\n%" G_GUINT64_FORMAT "\n",
+				mtime,
+				rhythmdb_entry_get_uint64 (entry, RHYTHMDB_PROP_FILE_SIZE));
+
+	for (i = 0; i < G_N_ELEMENTS (tag_string_props); i++) {
+		g_string_append (s, rhythmdb_entry_get_string (entry, tag_string_props[i]));
+		g_string_append_c (s, '\n');
+	}
+	for (i = 0; i < G_N_ELEMENTS (tag_ulong_props); i++) {
+		g_string_append_printf (s, "%lu\n", rhythmdb_entry_get_ulong (entry, tag_ulong_props[i]));
+	}
+	g_string_append_printf (s, "%f\n", rhythmdb_entry_get_double (entry, RHYTHMDB_PROP_BPM));
+
+	append_profile (s, profile);
+
+	key = g_compute_checksum_for_string (G_CHECKSUM_SHA1, s->str, s->len);
+	g_string_free (s, TRUE);
+	return key;
+}
+
+static void
+scan_locked (RBTranscodeCache *cache)
+{
+	GDir *dir;
+	const char *name;
+
+	if (cache->scanned)
+		return;
+	cache->scanned = TRUE;
+
+	if (g_mkdir_with_parents (cache->dir, 0700) != 0) {
+		rb_debug ("unable to create transcode cache dir %s", cache->dir);
+		return;
+	}
+
+	dir = g_dir_open (cache->dir, 0, NULL);
+	if (dir == NULL)
+		return;
+
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		RBTranscodeCacheItem *item;
+		GStatBuf st;
+		char *path;
+
+		path = g_build_filename (cache->dir, name, NULL);
+		if (g_str_has_prefix (name, TEMP_PREFIX)) {
+			/* left over from an interrupted store */
+			g_unlink (path);
+		} else if (g_stat (path, &st) == 0 && S_ISREG (st.st_mode)) {
+			/* recency is only tracked in memory, so items from
+			 * earlier sessions are ordered by when they were stored
+			 */
+			item = g_new0 (RBTranscodeCacheItem, 1);
+			item->size = st.st_size;
+			item->used = ((gint64) st.st_mtime) * G_USEC_PER_SEC;
+			g_hash_table_insert (cache->items, g_strdup (name), item);
+			cache->total_size += item->size;
+		}
+		g_free (path);
+	}
+	g_dir_close (dir);
+
+	rb_debug ("transcode cache has %u items, %" G_GUINT64_FORMAT " bytes",
+		  g_hash_table_size (cache->items), cache->total_size);
+}
+
+static void
+remove_locked (RBTranscodeCache *cache, const char *key)
+{
+	RBTranscodeCacheItem *item;
+	char *path;
+
+	item = g_hash_table_lookup (cache->items, key);
+	if (item == NULL)
+		return;
+
+	path = g_build_filename (cache->dir, key, NULL);
+	g_unlink (path);
+	g_free (path);
+
+	cache->total_size -= item->size;
+	g_hash_table_remove (cache->items, key);
+}
+
+static void
+evict_locked (RBTranscodeCache *cache)
+{
+	while (cache->total_size > cache->max_size) {
+		GHashTableIter iter;
+		gpointer key;
+		gpointer value;
+		const char *oldest = NULL;
+		gint64 oldest_used = G_MAXINT64;
+
+		g_hash_table_iter_init (&iter, cache->items);
+		while (g_hash_table_iter_next (&iter, &key, &value)) {
+			RBTranscodeCacheItem *item = value;
+			if (item->used < oldest_used) {
+				oldest = key;
+				oldest_used = item->used;
+			}
+		}
+
+		if (oldest == NULL)
+			break;
+
+		rb_debug ("evicting %s from transcode cache", oldest);
+		remove_locked (cache, oldest);
+	}
+}
+
+/*
+ * Hard links are only used for temporary files that the caller moves away.
+ * Anything else would share an inode with the cached file, so changes to
+ * either one (tag edits, or a cache hit updating the modification time)
+ * would show up in the other.
+ */
+static gboolean
+copy_file (const char *src_path, GFile *dest, gboolean overwrite, gboolean link_ok, GError **error)
+{
+	GFile *src;
+	gboolean ret;
+
+	/* a hard link is free if the destination is on the same filesystem */
+	if (link_ok && g_file_is_native (dest) && overwrite == FALSE) {
+		char *dest_path = g_file_get_path (dest);
+		int r = link (src_path, dest_path);
+		int err = errno;
+
+		g_free (dest_path);
+		if (r == 0) {
+			return TRUE;
+		} else if (err == EEXIST) {
+			g_set_error (error, G_IO_ERROR, G_IO_ERROR_EXISTS, "%s", g_strerror (err));
+			return FALSE;
+		}
+	}
+
+	src = g_file_new_for_path (src_path);
+	ret = g_file_copy (src, dest,
+			   overwrite ? G_FILE_COPY_OVERWRITE : G_FILE_COPY_NONE,
+			   NULL, NULL, NULL, error);
+	g_object_unref (src);
+	return ret;
+}
+
+/**
+ * rb_transcode_cache_fetch:
+ * @cache: a #RBTranscodeCache
+ * @key: cache key from #rb_transcode_cache_get_key
+ * @dest_uri: destination URI, or RB_ENCODER_DEST_TEMPFILE
+ * @overwrite: whether to overwrite an existing destination file
+ * @result_uri: (out): returns the URI the cached file was written to
+ * @result_size: (out): returns the size of the cached file
+ * @error: returns error information
+ *
+ * Copies the cached output for @key to @dest_uri.  This may block, so it
+ * should be called from a worker thread.  If the destination already exists
+ * and @overwrite is %FALSE, this fails with %RB_ENCODER_ERROR_DEST_EXISTS,
+ * the same as an encoder would.
+ *
+ * Return value: %TRUE if the cached file was copied; %FALSE with @error unset
+ *   if nothing is cached for @key
+ */
+gboolean
+rb_transcode_cache_fetch (RBTranscodeCache *cache,
+			  const char *key,
+			  const char *dest_uri,
+			  gboolean overwrite,
+			  char **result_uri,
+			  guint64 *result_size,
+			  GError **error)
+{
+	RBTranscodeCacheItem *item;
+	GError *copy_error = NULL;
+	gboolean link_ok;
+	GFile *dest;
+	char *path;
+	guint64 size;
+
+	g_mutex_lock (&cache->lock);
+	scan_locked (cache);
+	item = g_hash_table_lookup (cache->items, key);
+	if (item == NULL) {
+		g_mutex_unlock (&cache->lock);
+		return FALSE;
+	}
+	item->used = g_get_real_time ();
+	size = item->size;
+
+	path = g_build_filename (cache->dir, key, NULL);
+	if (g_file_test (path, G_FILE_TEST_IS_REGULAR) == FALSE) {
+		/* cached file has gone away */
+		rb_debug ("cached file %s has gone away", path);
+		remove_locked (cache, key);
+		g_mutex_unlock (&cache->lock);
+		g_free (path);
+		return FALSE;
+	}
+	g_mutex_unlock (&cache->lock);
+
+	link_ok = (g_strcmp0 (dest_uri, RB_ENCODER_DEST_TEMPFILE) == 0);
+	if (link_ok) {
+		char *tmpname;
+		int fd;
+
+		fd = g_file_open_tmp ("rb-encoder-XXXXXX", &tmpname, error);
+		if (fd < 0) {
+			g_free (path);
+			return FALSE;
+		}
+		close (fd);
+
+		/* replace the empty file so it can be hard linked */
+		g_unlink (tmpname);
+		dest = g_file_new_for_path (tmpname);
+		g_free (tmpname);
+		overwrite = FALSE;
+	} else {
+		dest = g_file_new_for_uri (dest_uri);
+	}
+
+	if (copy_file (path, dest, overwrite, link_ok, &copy_error) == FALSE) {
+		if (g_file_test (path, G_FILE_TEST_EXISTS) == FALSE) {
+			/* evicted by another thread since we looked it up,
+			 * so treat it as a miss and transcode the track instead
+			 */
+			rb_debug ("cached file %s was evicted before it could be copied", key);
+			g_clear_error (&copy_error);
+			g_object_unref (dest);
+			g_free (path);
+			return FALSE;
+		} else if (g_error_matches (copy_error, G_IO_ERROR, G_IO_ERROR_EXISTS)) {
+			g_set_error_literal (error,
+					     RB_ENCODER_ERROR,
+					     RB_ENCODER_ERROR_DEST_EXISTS,
+					     copy_error->message);
+			g_clear_error (&copy_error);
+		} else {
+			g_propagate_error (error, copy_error);
+		}
+		g_object_unref (dest);
+		g_free (path);
+		return FALSE;
+	}
+
+	rb_debug ("copied cached file %s to %s", key, dest_uri);
+	*result_uri = g_file_get_uri (dest);
+	*result_size = size;
+	g_object_unref (dest);
+	g_free (path);
+	return TRUE;
+}
+
+/**
+ * rb_transcode_cache_store:
+ * @cache: a #RBTranscodeCache
+ * @key: cache key from #rb_transcode_cache_get_key
+ * @uri: URI of the transcoded file
+ * @error: returns error information
+ *
+ * Adds a transcoded file to the cache, removing the least recently used
+ * items if the cache grows too large.  Only local files are cached.  This
+ * may block, so it should be called from a worker thread.
+ *
+ * Return value: %TRUE if the file was added to the cache
+ */
+gboolean
+rb_transcode_cache_store (RBTranscodeCache *cache,
+			  const char *key,
+			  const char *uri,
+			  GError **error)
+{
+	RBTranscodeCacheItem *item;
+	GStatBuf st;
+	GFile *tmp;
+	char *src_path;
+	char *tmp_path;
+	char *tmp_name;
+	char *path;
+	gboolean ret;
+
+	src_path = g_filename_from_uri (uri, NULL, NULL);
+	if (src_path == NULL) {
+		rb_debug ("not caching non-local file %s", uri);
+		return FALSE;
+	}
+
+	if (g_stat (src_path, &st) != 0 || (guint64) st.st_size > cache->max_size) {
+		rb_debug ("not caching %s", uri);
+		g_free (src_path);
+		return FALSE;
+	}
+
+	g_mutex_lock (&cache->lock);
+	scan_locked (cache);
+	g_mutex_unlock (&cache->lock);
+
+	/* copy to a temporary name first so partial files are never visible */
+	tmp_name = g_strdup_printf ("%s%s-%08x", TEMP_PREFIX, key, g_random_int ());
+	tmp_path = g_build_filename (cache->dir, tmp_name, NULL);
+	tmp = g_file_new_for_path (tmp_path);
+	ret = copy_file (src_path, tmp, FALSE, FALSE, error);
+	g_object_unref (tmp);
+	g_free (tmp_name);
+	g_free (src_path);
+
+	if (ret == FALSE) {
+		g_unlink (tmp_path);
+		g_free (tmp_path);
+		return FALSE;
+	}
+
+	path = g_build_filename (cache->dir, key, NULL);
+	g_mutex_lock (&cache->lock);
+	remove_locked (cache, key);
+	if (g_rename (tmp_path, path) != 0) {
+		int err = errno;
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (err), "%s", g_strerror (err));
+		g_unlink (tmp_path);
+		ret = FALSE;
+	} else {
+		item = g_new0 (RBTranscodeCacheItem, 1);
+		item->size = st.st_size;
+		item->used = g_get_real_time ();
+		g_hash_table_insert (cache->items, g_strdup (key), item);
+		cache->total_size += item->size;
+		rb_debug ("cached %s as %s; cache size now %" G_GUINT64_FORMAT, uri, key, cache->total_size);
+		evict_locked (cache);
+	}
+	g_mutex_unlock (&cache->lock);
+
+	g_free (tmp_path);
+	g_free (path);
+	return ret;
+}
+
+/**
+ * rb_transcode_cache_get_size:
+ * @cache: a #RBTranscodeCache
+ *
+ * Return value: total size of the cached files, in bytes
+ */
+guint64
+rb_transcode_cache_get_size (RBTranscodeCache *cache)
+{
+	guint64 size;
+
+	g_mutex_lock (&cache->lock);
+	scan_locked (cache);
+	size = cache->total_size;
+	g_mutex_unlock (&cache->lock);
+	return size;
+}
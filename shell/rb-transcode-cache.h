@@ -0,0 +1,67 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+#ifndef __RB_TRANSCODE_CACHE_H
+#define __RB_TRANSCODE_CACHE_H
+
+#include <glib.h>
+#include <gst/pbutils/encoding-profile.h>
+
+#include <rhythmdb/rhythmdb.h>
+
+G_BEGIN_DECLS
+
+typedef struct _RBTranscodeCache RBTranscodeCache;
+
+RBTranscodeCache *	rb_transcode_cache_get_default	(void);
+
+RBTranscodeCache *	rb_transcode_cache_new		(const char *dir,
+							 guint64 max_size);
+void			rb_transcode_cache_free		(RBTranscodeCache *cache);
+
+char *			rb_transcode_cache_get_key	(RhythmDBEntry *entry,
+							 GstEncodingProfile *profile);
+
+gboolean		rb_transcode_cache_fetch	(RBTranscodeCache *cache,
+							 const char *key,
+							 const char *dest_uri,
+							 gboolean overwrite,
+							 char **result_uri,
+							 guint64 *result_size,
+							 GError **error);
+
+gboolean		rb_transcode_cache_store	(RBTranscodeCache *cache,
+							 const char *key,
+							 const char *uri,
+							 GError **error);
+
+guint64			rb_transcode_cache_get_size	(RBTranscodeCache *cache);
+
+G_END_DECLS
+
+#endif /* __RB_TRANSCODE_CACHE_H */
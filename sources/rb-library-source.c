@@ -273,16 +273,37 @@ initial_import_job_complete_cb (RhythmDBImportJob *job, int total, RBLibrarySour
 	}
 }
 
+static void
+db_load_progress_cb (RhythmDB *db, guint count, RBLibrarySource *source)
+{
+	gboolean populate;
+
+	/* show the entries loaded so far; the rest are added to the
+	 * source's query model as they're loaded.
+	 */
+	g_object_get (source, "populate", &populate, NULL);
+	if (populate == FALSE) {
+		rb_debug ("populating library source with the first %u entries", count);
+		g_object_set (source,
+			      "populate", TRUE,
+			      "load-status", RB_SOURCE_LOAD_STATUS_LOADING,
+			      NULL);
+	}
+}
+
 static void
 db_load_complete_cb (RhythmDB *db, RBLibrarySource *source)
 {
 	RhythmDBImportJob *job;
+	gboolean populate;
 
-	/* once the database is loaded, we can run the query to populate the library source */
-	g_object_set (source,
-		      "populate", TRUE,
-		      "load-status", RB_SOURCE_LOAD_STATUS_LOADED,
-		      NULL);
+	/* once the database is loaded, we can run the query to populate the library source,
+	 * unless that already happened while it was loading.
+	 */
+	g_object_get (source, "populate", &populate, NULL);
+	if (populate == FALSE)
+		g_object_set (source, "populate", TRUE, NULL);
+	g_object_set (source, "load-status", RB_SOURCE_LOAD_STATUS_LOADED, NULL);
 
 	if (source->priv->do_initial_import) {
 		const char *music_dir;
@@ -354,6 +375,7 @@ rb_library_source_constructed (GObject *object)
 	source->priv->db_settings = g_settings_new ("org.gnome.rhythmbox.rhythmdb");
 	g_signal_connect_object (source->priv->db_settings, "changed", G_CALLBACK (db_settings_changed_cb), source, 0);
 
+	g_signal_connect_object (source->priv->db, "load-progress", G_CALLBACK (db_load_progress_cb), source, 0);
 	g_signal_connect_object (source->priv->db, "load-complete", G_CALLBACK (db_load_complete_cb), source, 0);
 
 	/* Set up the default library location if there's no library location set */
@@ -1349,13 +1371,21 @@ maybe_create_import_job (RBLibrarySource *source)
 {
 	RhythmDBImportJob *job;
 	if (source->priv->import_jobs == NULL || source->priv->start_import_job_id == 0) {
+		char *crawl_state;
 
 		rb_debug ("creating new import job");
 		job = rhythmdb_import_job_new (source->priv->db,
 					       RHYTHMDB_ENTRY_TYPE_SONG,
 					       RHYTHMDB_ENTRY_TYPE_IGNORE,
 					       RHYTHMDB_ENTRY_TYPE_IMPORT_ERROR);
-		g_object_set (job, "task-label", _("Adding tracks to the library"), NULL);
+
+		/* skip directories that haven't changed since the last import */
+		crawl_state = rb_find_user_cache_file ("library-dirs");
+		g_object_set (job,
+			      "task-label", _("Adding tracks to the library"),
+			      "crawl-state", crawl_state,
+			      NULL);
+		g_free (crawl_state);
 
 		g_signal_connect_object (job,
 					 "complete",
@@ -0,0 +1,279 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+#include "config.h"
+
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <math.h>
+
+#include <gst/gst.h>
+
+#include "rb-debug.h"
+#include "rb-file-helpers.h"
+#include "rb-util.h"
+#include "rb-gst-media-types.h"
+#include "rb-loudness.h"
+
+#include "rhythmdb.h"
+#include "rhythmdb-tree.h"
+#include "rb-loudness-analyzer.h"
+
+/*
+ * Measures loudness analysis throughput: first the measurement kernel
+ * alone on generated audio, then the full analyzer (decoding included)
+ * on a generated corpus of FLAC files grouped into albums.
+ *
+ * usage: bench-loudness [tracks [seconds]]
+ */
+
+#define TRACKS_PER_ALBUM	10
+
+static gboolean
+generate_track (const char *path, int seconds)
+{
+	GstElement *pipeline;
+	GstMessage *msg;
+	GError *error = NULL;
+	char *desc;
+	gboolean ok;
+
+	desc = g_strdup_printf ("audiotestsrc wave=pink-noise num-buffers=%d samplesperbuffer=4410 ! "
+				"audio/x-raw,rate=44100,channels=2 ! audioconvert ! flacenc ! "
+				"filesink location=\"%s\"",
+				seconds * 10, path);
+	pipeline = gst_parse_launch (desc, &error);
+	g_free (desc);
+	if (pipeline == NULL) {
+		g_printerr ("unable to create pipeline: %s\n", error->message);
+		g_clear_error (&error);
+		return FALSE;
+	}
+
+	gst_element_set_state (pipeline, GST_STATE_PLAYING);
+	msg = gst_bus_timed_pop_filtered (GST_ELEMENT_BUS (pipeline),
+					  GST_CLOCK_TIME_NONE,
+					  GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+	ok = (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS);
+	gst_message_unref (msg);
+	gst_element_set_state (pipeline, GST_STATE_NULL);
+	gst_object_unref (pipeline);
+	return ok;
+}
+
+static void
+set_entry_string (RhythmDB *db, RhythmDBEntry *entry, RhythmDBPropType prop, const char *str)
+{
+	GValue val = {0,};
+
+	g_value_init (&val, G_TYPE_STRING);
+	g_value_set_string (&val, str);
+	rhythmdb_entry_set (db, entry, prop, &val);
+	g_value_unset (&val);
+}
+
+static GList *
+create_corpus (RhythmDB *db, const char *dir, int count, int seconds)
+{
+	GList *entries = NULL;
+	int i;
+
+	g_print ("generating %d tracks of %d seconds in %s\n", count, seconds, dir);
+	for (i = 0; i < count; i++) {
+		RhythmDBEntry *entry;
+		char *path;
+		char *uri;
+		char *str;
+
+		path = g_strdup_printf ("%s/track-%04d.flac", dir, i);
+		if (generate_track (path, seconds) == FALSE) {
+			g_printerr ("unable to generate %s\n", path);
+			g_free (path);
+			break;
+		}
+
+		uri = g_filename_to_uri (path, NULL, NULL);
+		entry = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_SONG, uri);
+		g_free (uri);
+		g_free (path);
+
+		str = g_strdup_printf ("Track %d", i);
+		set_entry_string (db, entry, RHYTHMDB_PROP_TITLE, str);
+		g_free (str);
+		str = g_strdup_printf ("Album %d", i / TRACKS_PER_ALBUM);
+		set_entry_string (db, entry, RHYTHMDB_PROP_ALBUM, str);
+		g_free (str);
+		set_entry_string (db, entry, RHYTHMDB_PROP_ARTIST, "Artist");
+		set_entry_string (db, entry, RHYTHMDB_PROP_MEDIA_TYPE, RB_GST_MEDIA_TYPE_FLAC);
+
+		entries = g_list_prepend (entries, entry);
+	}
+	rhythmdb_commit (db);
+
+	return g_list_reverse (entries);
+}
+
+static void
+remove_dir (const char *dir)
+{
+	GDir *d;
+	const char *name;
+
+	d = g_dir_open (dir, 0, NULL);
+	if (d != NULL) {
+		while ((name = g_dir_read_name (d)) != NULL) {
+			char *path = g_build_filename (dir, name, NULL);
+			g_unlink (path);
+			g_free (path);
+		}
+		g_dir_close (d);
+	}
+	g_rmdir (dir);
+}
+
+static void
+bench_kernel (int seconds)
+{
+	RBLoudnessMeter *meter;
+	GTimer *timer;
+	float *buf;
+	double elapsed;
+	double lufs;
+	int frames;
+	int runs = 20;
+	int i;
+
+	frames = 44100 * seconds;
+	buf = g_new (float, frames * 2);
+	for (i = 0; i < frames; i++) {
+		buf[i * 2] = 0.25 * sin (2.0 * G_PI * 440.0 * i / 44100.0);
+		buf[i * 2 + 1] = g_random_double_range (-0.25, 0.25);
+	}
+
+	timer = g_timer_new ();
+	for (i = 0; i < runs; i++) {
+		meter = rb_loudness_meter_new (44100, 2);
+		rb_loudness_meter_process (meter, buf, frames);
+		rb_loudness_meter_get_loudness (meter, &lufs);
+		rb_loudness_meter_free (meter);
+	}
+	elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+	g_free (buf);
+
+	g_print ("kernel:   %.1f tracks/minute (%.0fx realtime, single thread)\n",
+		 (runs * 60.0) / elapsed, (runs * seconds) / elapsed);
+}
+
+static void
+track_analyzed_cb (RBLoudnessAnalyzer *analyzer, RhythmDBEntry *entry, int *analyzed)
+{
+	(*analyzed)++;
+}
+
+static void
+bench_analyzer (RhythmDB *db, GList *entries)
+{
+	RBLoudnessAnalyzer *analyzer;
+	GMainLoop *loop;
+	GTimer *timer;
+	double elapsed;
+	int analyzed = 0;
+	int total;
+
+	total = g_list_length (entries);
+	loop = g_main_loop_new (NULL, FALSE);
+	analyzer = rb_loudness_analyzer_new (db);
+	g_signal_connect (analyzer, "track-analyzed", G_CALLBACK (track_analyzed_cb), &analyzed);
+	g_signal_connect_swapped (analyzer, "finished", G_CALLBACK (g_main_loop_quit), loop);
+
+	timer = g_timer_new ();
+	rb_loudness_analyzer_queue_entries (analyzer, entries);
+	g_main_loop_run (loop);
+	elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	if (analyzed < total)
+		g_print ("%d tracks failed\n", total - analyzed);
+	g_print ("analyzer: %.1f tracks/minute (%d tracks in %.2f seconds)\n",
+		 (analyzed * 60.0) / elapsed, analyzed, elapsed);
+	if (entries != NULL) {
+		RhythmDBEntry *entry = entries->data;
+		g_print ("first track: gain %.2f dB, peak %.3f; album gain %.2f dB, peak %.3f\n",
+			 rhythmdb_entry_get_double (entry, RHYTHMDB_PROP_TRACK_GAIN),
+			 rhythmdb_entry_get_double (entry, RHYTHMDB_PROP_TRACK_PEAK),
+			 rhythmdb_entry_get_double (entry, RHYTHMDB_PROP_ALBUM_GAIN),
+			 rhythmdb_entry_get_double (entry, RHYTHMDB_PROP_ALBUM_PEAK));
+	}
+
+	g_object_unref (analyzer);
+	g_main_loop_unref (loop);
+}
+
+int
+main (int argc, char **argv)
+{
+	RhythmDB *db;
+	GList *entries;
+	char *corpus_dir;
+	int tracks = 40;
+	int seconds = 60;
+
+	if (argc > 1)
+		tracks = atoi (argv[1]);
+	if (argc > 2)
+		seconds = atoi (argv[2]);
+
+	rb_threads_init ();
+	setlocale (LC_ALL, "");
+	gst_init (&argc, &argv);
+	rb_debug_init (FALSE);
+	rb_refstring_system_init ();
+	rb_file_helpers_init ();
+
+	bench_kernel (seconds);
+
+	db = rhythmdb_tree_new ("test");
+	corpus_dir = g_dir_make_tmp ("rb-bench-XXXXXX", NULL);
+	entries = create_corpus (db, corpus_dir, tracks, seconds);
+
+	bench_analyzer (db, entries);
+
+	g_list_free (entries);
+	remove_dir (corpus_dir);
+	g_free (corpus_dir);
+
+	rhythmdb_shutdown (db);
+	g_object_unref (db);
+
+	rb_file_helpers_shutdown ();
+	rb_refstring_system_shutdown ();
+	return 0;
+}
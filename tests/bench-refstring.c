@@ -0,0 +1,195 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+/*
+ * Interns a large number of distinct strings from several threads at once,
+ * as the metadata and database loading threads do during an import, and
+ * reports the time taken, how often the refstring locks were contended, and
+ * how much memory the refstring table uses.
+ *
+ * usage: bench-refstring [strings] [threads]
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rb-refstring.h"
+
+static const char *genres[] = {
+	"Rock", "Pop", "Jazz", "Classical", "Electronic", "Hip-Hop", "Folk", "Metal"
+};
+
+typedef struct {
+	guint first;
+	guint count;
+	RBRefString **strings;
+} BenchThreadData;
+
+static gpointer
+intern_thread (BenchThreadData *data)
+{
+	guint i;
+
+	for (i = 0; i < data->count; i++) {
+		guint n = data->first + i;
+		RBRefString *genre;
+		char *str;
+
+		str = g_strdup_printf ("/music/Artist %u/Album %u/%07u - Track %u.flac",
+				       n / 1000, n / 10, n, n % 10);
+		data->strings[i] = rb_refstring_new (str);
+		g_free (str);
+
+		/* some strings are shared by many entries */
+		genre = rb_refstring_new (genres[n % G_N_ELEMENTS (genres)]);
+		rb_refstring_unref (genre);
+	}
+
+	return NULL;
+}
+
+static gpointer
+fold_thread (BenchThreadData *data)
+{
+	guint i;
+
+	for (i = 0; i < data->count; i++) {
+		rb_refstring_get_folded (data->strings[i]);
+		rb_refstring_get_sort_key (data->strings[i]);
+	}
+
+	return NULL;
+}
+
+static gpointer
+unref_thread (BenchThreadData *data)
+{
+	guint i;
+
+	for (i = 0; i < data->count; i++) {
+		rb_refstring_unref (data->strings[i]);
+	}
+
+	return NULL;
+}
+
+static double
+run_threads (BenchThreadData *data, guint nthreads, GThreadFunc func)
+{
+	GThread **threads;
+	GTimer *timer;
+	double elapsed;
+	guint i;
+
+	threads = g_new0 (GThread *, nthreads);
+	timer = g_timer_new ();
+	for (i = 0; i < nthreads; i++) {
+		threads[i] = g_thread_new ("bench-refstring", func, &data[i]);
+	}
+	for (i = 0; i < nthreads; i++) {
+		g_thread_join (threads[i]);
+	}
+	elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+	g_free (threads);
+
+	return elapsed;
+}
+
+static void
+print_stats (const char *stage, double elapsed, guint count)
+{
+	RBRefStringStats stats;
+
+	rb_refstring_get_stats (&stats);
+	g_print ("%-8s %8.3f s  %7.1f ns/string  %9u strings  %5.2f%% of %" G_GUINT64_FORMAT " locks contended  %6.1f MB used  %6.1f MB allocated\n",
+		 stage,
+		 elapsed,
+		 (elapsed * 1e9) / count,
+		 stats.strings,
+		 stats.lock_count ? (100.0 * stats.contended_count) / stats.lock_count : 0.0,
+		 stats.lock_count,
+		 stats.bytes_used / (1024.0 * 1024.0),
+		 stats.bytes_allocated / (1024.0 * 1024.0));
+}
+
+static void
+bench (guint count, guint nthreads)
+{
+	BenchThreadData *data;
+	RBRefStringStats stats;
+	guint i;
+
+	g_print ("%u strings, %u threads:\n", count, nthreads);
+	rb_refstring_system_init ();
+
+	data = g_new0 (BenchThreadData, nthreads);
+	for (i = 0; i < nthreads; i++) {
+		data[i].first = (count / nthreads) * i;
+		data[i].count = (i == nthreads - 1) ? count - data[i].first : count / nthreads;
+		data[i].strings = g_new0 (RBRefString *, data[i].count);
+	}
+
+	print_stats ("intern", run_threads (data, nthreads, (GThreadFunc) intern_thread), count);
+	rb_refstring_get_stats (&stats);
+	g_print ("         %.1f bytes per string\n", (double) stats.bytes_allocated / stats.strings);
+
+	print_stats ("fold", run_threads (data, nthreads, (GThreadFunc) fold_thread), count);
+	rb_refstring_get_stats (&stats);
+	g_print ("         %.1f bytes per string\n", (double) stats.bytes_allocated / stats.strings);
+
+	print_stats ("unref", run_threads (data, nthreads, (GThreadFunc) unref_thread), count);
+
+	for (i = 0; i < nthreads; i++) {
+		g_free (data[i].strings);
+	}
+	g_free (data);
+
+	rb_refstring_system_shutdown ();
+}
+
+int
+main (int argc, char **argv)
+{
+	guint count = 1000000;
+	guint nthreads = 4;
+
+	if (argc > 1)
+		count = atoi (argv[1]);
+	if (argc > 2)
+		nthreads = MAX (atoi (argv[2]), 1);
+
+	bench (count, 1);
+	if (nthreads > 1)
+		bench (count, nthreads);
+
+	return 0;
+}
@@ -30,6 +30,8 @@
 #include "config.h"
 
 #include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <locale.h>
 
@@ -39,6 +41,9 @@
 
 #include "rhythmdb.h"
 #include "rhythmdb-tree.h"
+#include "rhythmdb-snapshot.h"
+#include "rhythmdb-private.h"
+#include "rhythmdb-query-model.h"
 #include "rb-podcast-entry-types.h"
 
 /* test utils */
@@ -83,14 +88,169 @@ static void wait_for_signal (void)
 }
 
 
+static char *
+create_synthetic_library (RhythmDB *db, int count)
+{
+	char *dir;
+	char *name;
+	int i;
+
+	dir = g_dir_make_tmp ("rb-bench-XXXXXX", NULL);
+	if (dir == NULL) {
+		g_printerr ("unable to create temporary directory\n");
+		return NULL;
+	}
+	name = g_build_filename (dir, "rhythmdb.xml", NULL);
+	g_free (dir);
+	g_object_set (G_OBJECT (db), "name", name, NULL);
+
+	g_print ("generating %d entries in %s\n", count, name);
+	for (i = 0; i < count; i++) {
+		RhythmDBEntry *entry;
+		GValue val = {0,};
+		char *str;
+
+		str = g_strdup_printf ("file:///music/artist-%d/album-%d/track-%d.flac", i / 100, i / 10, i);
+		entry = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_SONG, str);
+		g_free (str);
+
+		g_value_init (&val, G_TYPE_STRING);
+		g_value_take_string (&val, g_strdup_printf ("Track %d", i));
+		rhythmdb_entry_set (db, entry, RHYTHMDB_PROP_TITLE, &val);
+		g_value_take_string (&val, g_strdup_printf ("Artist %d", i / 100));
+		rhythmdb_entry_set (db, entry, RHYTHMDB_PROP_ARTIST, &val);
+		g_value_take_string (&val, g_strdup_printf ("Album %d", i / 10));
+		rhythmdb_entry_set (db, entry, RHYTHMDB_PROP_ALBUM, &val);
+		g_value_take_string (&val, g_strdup_printf ("Genre %d", i % 20));
+		rhythmdb_entry_set (db, entry, RHYTHMDB_PROP_GENRE, &val);
+		g_value_set_static_string (&val, "audio/x-flac");
+		rhythmdb_entry_set (db, entry, RHYTHMDB_PROP_MEDIA_TYPE, &val);
+		if (i % 4 == 0) {
+			g_value_take_string (&val, g_strdup_printf ("%08x-0000-0000-0000-000000000000", i));
+			rhythmdb_entry_set (db, entry, RHYTHMDB_PROP_MUSICBRAINZ_TRACKID, &val);
+		}
+		g_value_unset (&val);
+
+		g_value_init (&val, G_TYPE_ULONG);
+		g_value_set_ulong (&val, (i % 10) + 1);
+		rhythmdb_entry_set (db, entry, RHYTHMDB_PROP_TRACK_NUMBER, &val);
+		g_value_set_ulong (&val, 120 + (i % 300));
+		rhythmdb_entry_set (db, entry, RHYTHMDB_PROP_DURATION, &val);
+		g_value_set_ulong (&val, 1000000000 + i);
+		rhythmdb_entry_set (db, entry, RHYTHMDB_PROP_MTIME, &val);
+		rhythmdb_entry_set (db, entry, RHYTHMDB_PROP_FIRST_SEEN, &val);
+		g_value_set_ulong (&val, i % 50);
+		rhythmdb_entry_set (db, entry, RHYTHMDB_PROP_PLAY_COUNT, &val);
+		g_value_unset (&val);
+
+		g_value_init (&val, G_TYPE_UINT64);
+		g_value_set_uint64 (&val, 20000000 + i);
+		rhythmdb_entry_set (db, entry, RHYTHMDB_PROP_FILE_SIZE, &val);
+		g_value_unset (&val);
+
+		if (i % RHYTHMDB_QUERY_MODEL_SUGGESTED_UPDATE_CHUNK == 0)
+			rhythmdb_commit (db);
+	}
+	rhythmdb_commit (db);
+
+	/* writes both the XML file and the snapshot */
+	rhythmdb_save (db);
+	rhythmdb_entry_delete_by_type (db, RHYTHMDB_ENTRY_TYPE_SONG);
+	rhythmdb_commit (db);
+
+	return name;
+}
+
+static void
+remove_synthetic_library (const char *name)
+{
+	char *snapshot;
+	char *dir;
+
+	snapshot = rhythmdb_snapshot_get_filename (name);
+	dir = g_path_get_dirname (name);
+	g_unlink (snapshot);
+	g_unlink (name);
+	g_rmdir (dir);
+	g_free (snapshot);
+	g_free (dir);
+}
+
+static double
+bench_load (RhythmDB *db, gboolean snapshot, int loads)
+{
+	GTimer *timer;
+	double elapsed;
+	int i;
+
+	g_object_set (G_OBJECT (db), "snapshot", snapshot, NULL);
+
+	timer = g_timer_new ();
+	elapsed = 0.0;
+	for (i = 0; i < loads; i++) {
+		g_timer_start (timer);
+		set_waiting_signal (G_OBJECT (db), "load-complete");
+		rhythmdb_load (db);
+		wait_for_signal ();
+		g_timer_stop (timer);
+		elapsed += g_timer_elapsed (timer, NULL);
+
+		rhythmdb_entry_delete_by_type (db, RHYTHMDB_ENTRY_TYPE_SONG);
+		rhythmdb_entry_delete_by_type (db, rhythmdb_entry_type_get_by_name (db, "iradio"));
+		rhythmdb_entry_delete_by_type (db, RHYTHMDB_ENTRY_TYPE_PODCAST_FEED);
+		rhythmdb_entry_delete_by_type (db, RHYTHMDB_ENTRY_TYPE_PODCAST_POST);
+		rhythmdb_commit (db);
+	}
+	g_timer_destroy (timer);
+
+	return elapsed / loads;
+}
+
+static void
+add_entry_size (RhythmDBEntry *entry, gsize *total)
+{
+	*total += rhythmdb_entry_get_memory_size (entry);
+}
+
+static void
+report_memory (RhythmDB *db)
+{
+	RBRefStringStats stats;
+	gsize total = 0;
+	gint64 count;
+
+	set_waiting_signal (G_OBJECT (db), "load-complete");
+	rhythmdb_load (db);
+	wait_for_signal ();
+
+	count = rhythmdb_entry_count (db);
+	rhythmdb_entry_foreach (db, (GFunc) add_entry_size, &total);
+	rb_refstring_get_stats (&stats);
+
+	g_print ("entries:  %" G_GINT64_FORMAT ", %" G_GSIZE_FORMAT " bytes per entry struct\n",
+		 count, sizeof (RhythmDBEntry));
+	if (count > 0) {
+		g_print ("          %.1f bytes per entry including extra fields\n",
+			 (double) total / count);
+		g_print ("          %.1f bytes per entry including strings\n",
+			 (double) (total + stats.bytes_allocated) / count);
+	}
+
+	rhythmdb_entry_delete_by_type (db, RHYTHMDB_ENTRY_TYPE_SONG);
+	rhythmdb_commit (db);
+}
+
 int 
 main (int argc, char **argv)
 {
 	RhythmDB *db;
-	char *name;
+	char *name = NULL;
+	int synthetic = 0;
 	int i;
 
-	if (argc < 2) {
+	if (argc > 2 && strcmp (argv[1], "--synthetic") == 0) {
+		synthetic = atoi (argv[2]);
+	} else if (argc < 2) {
 		name = g_build_filename (rb_user_data_dir(), "rhythmdb.xml", NULL);
 		g_print ("using %s\n", name);
 	} else {
@@ -107,24 +267,35 @@ main (int argc, char **argv)
 	rb_file_helpers_init ();
 
 	db = rhythmdb_tree_new ("test");
-	g_object_set (G_OBJECT (db), "name", name, NULL);
-	g_free (name);
-
-	for (i = 1; i <= 10; i++) {
-		int j;
-		rb_profile_start ("10 rhythmdb loads");
-		for (j = 1; j <= 10; j++) {
-			set_waiting_signal (G_OBJECT (db), "load-complete");
-			rhythmdb_load (db);
-			wait_for_signal ();
-
-			rhythmdb_entry_delete_by_type (db, RHYTHMDB_ENTRY_TYPE_SONG);
-			rhythmdb_entry_delete_by_type (db, rhythmdb_entry_type_get_by_name (db, "iradio"));
-			rhythmdb_entry_delete_by_type (db, RHYTHMDB_ENTRY_TYPE_PODCAST_FEED);
-			rhythmdb_entry_delete_by_type (db, RHYTHMDB_ENTRY_TYPE_PODCAST_POST);
+
+	if (synthetic > 0) {
+		double xml_time, snapshot_time;
+
+		name = create_synthetic_library (db, synthetic);
+		if (name == NULL)
+			return 1;
+
+		xml_time = bench_load (db, FALSE, 5);
+		g_print ("XML:      %.3f seconds per load\n", xml_time);
+		snapshot_time = bench_load (db, TRUE, 5);
+		g_print ("snapshot: %.3f seconds per load\n", snapshot_time);
+		if (snapshot_time > 0.0)
+			g_print ("snapshot is %.1fx faster\n", xml_time / snapshot_time);
+
+		report_memory (db);
+
+		remove_synthetic_library (name);
+		g_free (name);
+	} else {
+		g_object_set (G_OBJECT (db), "name", name, NULL);
+		g_free (name);
+
+		for (i = 1; i <= 10; i++) {
+			rb_profile_start ("10 rhythmdb loads");
+			bench_load (db, TRUE, 10);
+			rb_profile_end ("10 rhythmdb loads");
+			g_print ("completed %d loads\n", i * 10);
 		}
-		rb_profile_end ("10 rhythmdb loads");
-		g_print ("completed %d loads\n", i * 10);
 	}
 
 	rhythmdb_shutdown (db);
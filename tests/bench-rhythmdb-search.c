@@ -0,0 +1,187 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+/*
+ * Measures the time taken to run the browser search query for each prefix
+ * of a search string, as happens when the user types into the search entry,
+ * with and without the search index.
+ *
+ * usage: bench-rhythmdb-search [entries] [search text]
+ */
+
+#include "config.h"
+
+#include <gtk/gtk.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+
+#include "rb-debug.h"
+#include "rb-file-helpers.h"
+#include "rb-util.h"
+
+#include "rhythmdb.h"
+#include "rhythmdb-tree.h"
+#include "rhythmdb-query-model.h"
+
+static const char *words[] = {
+	"midnight", "rain", "summer", "echo", "river", "golden", "shadow", "fire",
+	"dream", "silver", "ocean", "light", "heart", "city", "winter", "blue",
+	"electric", "wild", "broken", "morning", "storm", "velvet", "star", "road",
+	"paper", "crystal", "thunder", "garden", "ghost", "sugar", "neon", "wolf"
+};
+
+static void
+set_string (RhythmDB *db, RhythmDBEntry *entry, RhythmDBPropType prop, char *str)
+{
+	GValue val = {0,};
+
+	g_value_init (&val, G_TYPE_STRING);
+	g_value_take_string (&val, str);
+	rhythmdb_entry_set (db, entry, prop, &val);
+	g_value_unset (&val);
+}
+
+static void
+create_entries (RhythmDB *db, int count)
+{
+	const int n = G_N_ELEMENTS (words);
+	int i;
+
+	g_print ("generating %d entries\n", count);
+	for (i = 0; i < count; i++) {
+		RhythmDBEntry *entry;
+		char *str;
+
+		str = g_strdup_printf ("file:///music/%d/%d.flac", i / 100, i);
+		entry = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_SONG, str);
+		g_free (str);
+
+		set_string (db, entry, RHYTHMDB_PROP_TITLE,
+			    g_strdup_printf ("%s %s %d", words[i % n], words[(i / n) % n], i));
+		set_string (db, entry, RHYTHMDB_PROP_ARTIST,
+			    g_strdup_printf ("The %s %ss", words[(i / 100) % n], words[(i / 300) % n]));
+		set_string (db, entry, RHYTHMDB_PROP_ALBUM,
+			    g_strdup_printf ("%s of %s %d", words[(i / 10) % n], words[(i / 7) % n], i / 10));
+		set_string (db, entry, RHYTHMDB_PROP_GENRE, g_strdup (words[(i / 1000) % n]));
+		set_string (db, entry, RHYTHMDB_PROP_MEDIA_TYPE, g_strdup ("audio/x-flac"));
+
+		if (i % RHYTHMDB_QUERY_MODEL_SUGGESTED_UPDATE_CHUNK == 0)
+			rhythmdb_commit (db);
+	}
+	rhythmdb_commit (db);
+}
+
+static double
+bench_search (RhythmDB *db, const char *text, gboolean use_index)
+{
+	GTimer *timer;
+	double total = 0.0;
+	double worst = 0.0;
+	int len;
+	int i;
+
+	g_object_set (db, "search-index", use_index, NULL);
+	g_print ("%s search index:\n", use_index ? "with" : "without");
+
+	timer = g_timer_new ();
+	len = strlen (text);
+	for (i = 1; i <= len; i++) {
+		RhythmDBQueryModel *model;
+		GPtrArray *query;
+		char *prefix;
+		double elapsed;
+
+		prefix = g_strndup (text, i);
+		query = rhythmdb_query_parse (db,
+					      RHYTHMDB_QUERY_PROP_EQUALS, RHYTHMDB_PROP_TYPE, RHYTHMDB_ENTRY_TYPE_SONG,
+					      RHYTHMDB_QUERY_PROP_LIKE, RHYTHMDB_PROP_SEARCH_MATCH, prefix,
+					      RHYTHMDB_QUERY_END);
+		model = rhythmdb_query_model_new_empty (db);
+
+		g_timer_start (timer);
+		rhythmdb_do_full_query_parsed (db, RHYTHMDB_QUERY_RESULTS (model), query);
+		g_timer_stop (timer);
+
+		elapsed = g_timer_elapsed (timer, NULL);
+		total += elapsed;
+		if (elapsed > worst)
+			worst = elapsed;
+		g_print ("  %-24s %7d matches  %8.2f ms\n",
+			 prefix,
+			 gtk_tree_model_iter_n_children (GTK_TREE_MODEL (model), NULL),
+			 elapsed * 1000.0);
+
+		g_object_unref (model);
+		rhythmdb_query_free (query);
+		g_free (prefix);
+	}
+	g_timer_destroy (timer);
+
+	g_print ("  mean %.2f ms, worst %.2f ms per keystroke\n", (total / len) * 1000.0, worst * 1000.0);
+	return total / len;
+}
+
+int
+main (int argc, char **argv)
+{
+	RhythmDB *db;
+	const char *text = "midnight rain";
+	int count = 100000;
+	double scan_time, index_time;
+
+	if (argc > 1)
+		count = atoi (argv[1]);
+	if (argc > 2)
+		text = argv[2];
+
+	rb_threads_init ();
+	setlocale (LC_ALL, "");
+	gtk_init (&argc, &argv);
+	rb_debug_init (FALSE);
+	rb_refstring_system_init ();
+	rb_file_helpers_init ();
+
+	db = rhythmdb_tree_new ("test");
+	create_entries (db, count);
+
+	scan_time = bench_search (db, text, FALSE);
+	index_time = bench_search (db, text, TRUE);
+	if (index_time > 0.0)
+		g_print ("search index is %.1fx faster\n", scan_time / index_time);
+
+	rhythmdb_entry_delete_by_type (db, RHYTHMDB_ENTRY_TYPE_SONG);
+	rhythmdb_commit (db);
+	rhythmdb_shutdown (db);
+	g_object_unref (G_OBJECT (db));
+
+	rb_file_helpers_shutdown ();
+	rb_refstring_system_shutdown ();
+
+	return 0;
+}
@@ -0,0 +1,292 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+#include "config.h"
+
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+
+#include <gst/gst.h>
+
+#include "rb-debug.h"
+#include "rb-file-helpers.h"
+#include "rb-util.h"
+#include "rb-gst-media-types.h"
+
+#include "rhythmdb.h"
+#include "rhythmdb-tree.h"
+#include "rb-track-transfer-batch.h"
+
+/*
+ * Transcodes a generated corpus of FLAC files into a temporary directory
+ * using RBTrackTransferBatch, first with a single encoder and then with
+ * one encoder per processor.
+ *
+ * usage: bench-transcode [tracks [seconds [media-type]]]
+ */
+
+static GMainLoop *loop;
+
+static gboolean
+generate_track (const char *path, int seconds)
+{
+	GstElement *pipeline;
+	GstMessage *msg;
+	GError *error = NULL;
+	char *desc;
+	gboolean ok;
+
+	desc = g_strdup_printf ("audiotestsrc wave=pink-noise num-buffers=%d samplesperbuffer=4410 ! "
+				"audio/x-raw,rate=44100,channels=2 ! audioconvert ! flacenc ! "
+				"filesink location=\"%s\"",
+				seconds * 10, path);
+	pipeline = gst_parse_launch (desc, &error);
+	g_free (desc);
+	if (pipeline == NULL) {
+		g_printerr ("unable to create pipeline: %s\n", error->message);
+		g_clear_error (&error);
+		return FALSE;
+	}
+
+	gst_element_set_state (pipeline, GST_STATE_PLAYING);
+	msg = gst_bus_timed_pop_filtered (GST_ELEMENT_BUS (pipeline),
+					  GST_CLOCK_TIME_NONE,
+					  GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+	ok = (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS);
+	gst_message_unref (msg);
+	gst_element_set_state (pipeline, GST_STATE_NULL);
+	gst_object_unref (pipeline);
+	return ok;
+}
+
+static GList *
+create_corpus (RhythmDB *db, const char *dir, int count, int seconds)
+{
+	GList *entries = NULL;
+	int i;
+
+	g_print ("generating %d tracks of %d seconds in %s\n", count, seconds, dir);
+	for (i = 0; i < count; i++) {
+		RhythmDBEntry *entry;
+		GValue val = {0,};
+		GStatBuf st;
+		char *path;
+		char *uri;
+
+		path = g_strdup_printf ("%s/track-%04d.flac", dir, i);
+		if (generate_track (path, seconds) == FALSE || g_stat (path, &st) != 0) {
+			g_printerr ("unable to generate %s\n", path);
+			g_free (path);
+			break;
+		}
+
+		uri = g_filename_to_uri (path, NULL, NULL);
+		entry = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_SONG, uri);
+		g_free (uri);
+		g_free (path);
+
+		g_value_init (&val, G_TYPE_STRING);
+		g_value_take_string (&val, g_strdup_printf ("Track %d", i));
+		rhythmdb_entry_set (db, entry, RHYTHMDB_PROP_TITLE, &val);
+		g_value_set_static_string (&val, RB_GST_MEDIA_TYPE_FLAC);
+		rhythmdb_entry_set (db, entry, RHYTHMDB_PROP_MEDIA_TYPE, &val);
+		g_value_unset (&val);
+
+		g_value_init (&val, G_TYPE_ULONG);
+		g_value_set_ulong (&val, seconds);
+		rhythmdb_entry_set (db, entry, RHYTHMDB_PROP_DURATION, &val);
+		g_value_unset (&val);
+
+		g_value_init (&val, G_TYPE_UINT64);
+		g_value_set_uint64 (&val, st.st_size);
+		rhythmdb_entry_set (db, entry, RHYTHMDB_PROP_FILE_SIZE, &val);
+		g_value_unset (&val);
+
+		entries = g_list_prepend (entries, entry);
+	}
+	rhythmdb_commit (db);
+
+	return g_list_reverse (entries);
+}
+
+static void
+remove_dir (const char *dir)
+{
+	GDir *d;
+	const char *name;
+
+	d = g_dir_open (dir, 0, NULL);
+	if (d != NULL) {
+		while ((name = g_dir_read_name (d)) != NULL) {
+			char *path = g_build_filename (dir, name, NULL);
+			g_unlink (path);
+			g_free (path);
+		}
+		g_dir_close (d);
+	}
+	g_rmdir (dir);
+}
+
+static char *
+get_dest_uri_cb (RBTrackTransferBatch *batch,
+		 RhythmDBEntry *entry,
+		 const char *mediatype,
+		 const char *extension,
+		 const char *dest_dir)
+{
+	char *basename;
+	char *path;
+	char *uri;
+
+	basename = g_path_get_basename (rhythmdb_entry_get_string (entry, RHYTHMDB_PROP_LOCATION));
+	path = g_strdup_printf ("%s/%s.%s", dest_dir, basename, extension ? extension : "out");
+	uri = g_filename_to_uri (path, NULL, NULL);
+	g_free (basename);
+	g_free (path);
+	return uri;
+}
+
+static void
+track_done_cb (RBTrackTransferBatch *batch,
+	       RhythmDBEntry *entry,
+	       const char *dest,
+	       guint64 dest_size,
+	       const char *mediatype,
+	       GError *error,
+	       int *failed)
+{
+	if (error != NULL) {
+		g_printerr ("failed to transcode %s: %s\n", dest, error->message);
+		(*failed)++;
+	}
+}
+
+static double
+bench_transcode (GList *entries, GstEncodingTarget *target, int encoders)
+{
+	RBTrackTransferBatch *batch;
+	GTimer *timer;
+	double elapsed;
+	char *dest_dir;
+	int failed = 0;
+	GList *l;
+
+	dest_dir = g_dir_make_tmp ("rb-bench-out-XXXXXX", NULL);
+
+	batch = rb_track_transfer_batch_new (target, NULL, NULL, NULL, NULL);
+	g_object_set (batch, "max-encoders", encoders, NULL);
+	for (l = entries; l != NULL; l = l->next) {
+		rb_track_transfer_batch_add (batch, l->data);
+	}
+	g_signal_connect (batch, "get-dest-uri", G_CALLBACK (get_dest_uri_cb), dest_dir);
+	g_signal_connect (batch, "track-done", G_CALLBACK (track_done_cb), &failed);
+	g_signal_connect_swapped (batch, "complete", G_CALLBACK (g_main_loop_quit), loop);
+
+	timer = g_timer_new ();
+	_rb_track_transfer_batch_start (batch);
+	g_main_loop_run (loop);
+	elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	if (failed > 0)
+		g_print ("%d tracks failed\n", failed);
+
+	g_object_unref (batch);
+	remove_dir (dest_dir);
+	g_free (dest_dir);
+	return elapsed;
+}
+
+int
+main (int argc, char **argv)
+{
+	RhythmDB *db;
+	GstEncodingTarget *target;
+	GstEncodingProfile *profile;
+	const char *media_type = RB_GST_MEDIA_TYPE_OGG_VORBIS;
+	GList *entries;
+	char *corpus_dir;
+	double serial_time;
+	double parallel_time;
+	int tracks = 32;
+	int seconds = 30;
+	int cores;
+
+	if (argc > 1)
+		tracks = atoi (argv[1]);
+	if (argc > 2)
+		seconds = atoi (argv[2]);
+	if (argc > 3)
+		media_type = argv[3];
+
+	rb_threads_init ();
+	setlocale (LC_ALL, "");
+	gst_init (&argc, &argv);
+	rb_debug_init (FALSE);
+	rb_refstring_system_init ();
+	rb_file_helpers_init ();
+
+	profile = rb_gst_get_encoding_profile (media_type);
+	if (profile == NULL) {
+		g_printerr ("no encoding profile for %s\n", media_type);
+		return 1;
+	}
+	target = gst_encoding_target_new ("bench", "device", "", NULL);
+	gst_encoding_target_add_profile (target, profile);
+
+	loop = g_main_loop_new (NULL, FALSE);
+	db = rhythmdb_tree_new ("test");
+
+	corpus_dir = g_dir_make_tmp ("rb-bench-XXXXXX", NULL);
+	entries = create_corpus (db, corpus_dir, tracks, seconds);
+
+	cores = g_get_num_processors ();
+	serial_time = bench_transcode (entries, target, 1);
+	g_print ("1 encoder:   %.2f seconds (%.1f tracks/s)\n",
+		 serial_time, g_list_length (entries) / serial_time);
+	parallel_time = bench_transcode (entries, target, cores);
+	g_print ("%d encoders: %.2f seconds (%.1f tracks/s)\n",
+		 cores, parallel_time, g_list_length (entries) / parallel_time);
+	if (parallel_time > 0.0)
+		g_print ("parallel transcoding is %.1fx faster\n", serial_time / parallel_time);
+
+	g_list_free (entries);
+	remove_dir (corpus_dir);
+	g_free (corpus_dir);
+
+	rhythmdb_shutdown (db);
+	g_object_unref (db);
+	gst_encoding_target_unref (target);
+	g_main_loop_unref (loop);
+
+	rb_file_helpers_shutdown ();
+	rb_refstring_system_shutdown ();
+	return 0;
+}
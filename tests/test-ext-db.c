@@ -0,0 +1,227 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+#include "config.h"
+
+#include <check.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "rb-ext-db.h"
+#include "rb-debug.h"
+#include "rb-file-helpers.h"
+#include "rb-util.h"
+
+static void
+remove_tree (const char *path)
+{
+	GDir *d;
+	const char *name;
+
+	d = g_dir_open (path, 0, NULL);
+	if (d != NULL) {
+		while ((name = g_dir_read_name (d)) != NULL) {
+			char *child = g_build_filename (path, name, NULL);
+			if (g_file_test (child, G_FILE_TEST_IS_DIR))
+				remove_tree (child);
+			else
+				g_unlink (child);
+			g_free (child);
+		}
+		g_dir_close (d);
+	}
+	g_rmdir (path);
+}
+
+static void
+added_cb (RBExtDB *store, RBExtDBKey *key, const char *filename, GValue *data, guint *count)
+{
+	(*count)++;
+}
+
+static void
+wait_for_added (guint *count, guint expected)
+{
+	while (*count < expected)
+		g_main_context_iteration (NULL, TRUE);
+}
+
+static void
+store_string (RBExtDB *store, const char *album, const char *data)
+{
+	RBExtDBKey *key;
+	GValue v = {0,};
+
+	key = rb_ext_db_key_create_storage ("album", album);
+	g_value_init (&v, G_TYPE_STRING);
+	g_value_set_string (&v, data);
+	rb_ext_db_store_raw (store, key, RB_EXT_DB_SOURCE_EMBEDDED, &v);
+	g_value_unset (&v);
+	rb_ext_db_key_free (key);
+}
+
+static void
+delete_key (RBExtDB *store, const char *album)
+{
+	RBExtDBKey *key;
+
+	key = rb_ext_db_key_create_storage ("album", album);
+	rb_ext_db_delete (store, key);
+	rb_ext_db_key_free (key);
+}
+
+static char *
+lookup (RBExtDB *store, const char *album)
+{
+	RBExtDBKey *key;
+	char *filename;
+
+	key = rb_ext_db_key_create_lookup ("album", album);
+	filename = rb_ext_db_lookup (store, key, NULL);
+	rb_ext_db_key_free (key);
+	return filename;
+}
+
+START_TEST (test_ext_db_shared_content)
+{
+	RBExtDB *store;
+	guint added = 0;
+	char *a, *b;
+
+	store = rb_ext_db_new ("test-shared-content");
+	g_signal_connect (store, "added", G_CALLBACK (added_cb), &added);
+
+	/* identical items share a file */
+	store_string (store, "a", "cover");
+	store_string (store, "b", "cover");
+	wait_for_added (&added, 2);
+	a = lookup (store, "a");
+	b = lookup (store, "b");
+	ck_assert_msg (a != NULL && b != NULL, "stored items not found");
+	ck_assert_msg (strcmp (a, b) == 0, "identical items stored in different files");
+	ck_assert_msg (g_file_test (a, G_FILE_TEST_EXISTS), "content file missing");
+
+	/* storing the same item again doesn't add a reference */
+	store_string (store, "a", "cover");
+	wait_for_added (&added, 3);
+
+	/* the file stays until the last item using it is removed */
+	delete_key (store, "a");
+	wait_for_added (&added, 4);
+	ck_assert_msg (lookup (store, "a") == NULL, "deleted item still found");
+	ck_assert_msg (g_file_test (b, G_FILE_TEST_EXISTS), "shared file deleted while still used");
+
+	delete_key (store, "b");
+	wait_for_added (&added, 5);
+	ck_assert_msg (g_file_test (b, G_FILE_TEST_EXISTS) == FALSE, "unused file not deleted");
+
+	g_free (a);
+	g_free (b);
+	g_object_unref (store);
+}
+END_TEST
+
+START_TEST (test_ext_db_delete_during_store)
+{
+	RBExtDB *store;
+	guint added = 0;
+	char *a, *c;
+
+	store = rb_ext_db_new ("test-delete-during-store");
+	g_signal_connect (store, "added", G_CALLBACK (added_cb), &added);
+
+	store_string (store, "a", "cover");
+	store_string (store, "c", "cover");
+	wait_for_added (&added, 2);
+	c = lookup (store, "c");
+	ck_assert_msg (c != NULL, "stored item not found");
+
+	/* replace a's item and delete it before the replacement is committed;
+	 * the file a used to share with c is only released once.
+	 */
+	store_string (store, "a", "another cover");
+	delete_key (store, "a");
+	wait_for_added (&added, 4);
+
+	a = lookup (store, "a");
+	ck_assert_msg (a == NULL, "item stored after it was deleted");
+	ck_assert_msg (g_file_test (c, G_FILE_TEST_EXISTS), "shared file deleted while still used");
+	g_free (c);
+
+	c = lookup (store, "c");
+	ck_assert_msg (c != NULL, "other item lost");
+	g_free (c);
+	g_object_unref (store);
+}
+END_TEST
+
+static Suite *
+rb_ext_db_suite (void)
+{
+	Suite *s = suite_create ("rb-ext-db");
+	TCase *tc_chain = tcase_create ("rb-ext-db-core");
+
+	suite_add_tcase (s, tc_chain);
+
+	tcase_add_test (tc_chain, test_ext_db_shared_content);
+	tcase_add_test (tc_chain, test_ext_db_delete_during_store);
+
+	return s;
+}
+
+int
+main (int argc, char **argv)
+{
+	int ret;
+	SRunner *sr;
+	Suite *s;
+	char *cache_dir;
+
+	/* keep the stores out of the real cache directory */
+	cache_dir = g_dir_make_tmp ("rb-test-ext-db-XXXXXX", NULL);
+	g_setenv ("XDG_CACHE_HOME", cache_dir, TRUE);
+
+	rb_profile_start ("rb-ext-db test suite");
+	rb_threads_init ();
+	rb_debug_init (TRUE);
+	rb_file_helpers_init ();
+
+	/* setup tests */
+	s = rb_ext_db_suite ();
+	sr = srunner_create (s);
+	srunner_run_all (sr, CK_NORMAL);
+	ret = srunner_ntests_failed (sr);
+	srunner_free (sr);
+
+	rb_file_helpers_shutdown ();
+	remove_tree (cache_dir);
+	g_free (cache_dir);
+
+	rb_profile_end ("rb-ext-db test suite");
+	return ret;
+}
@@ -0,0 +1,277 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+/*
+ * Tests for the metadata helper pool.  The test program replaces the
+ * metadata helper with itself, acting as a fake helper that crashes
+ * when asked to load certain files.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "rb-metadata.h"
+#include "rb-metadata-dbus.h"
+#include "rb-debug.h"
+#include "rb-util.h"
+
+#define CRASH_URI	"file:///crash.ogg"
+
+static char *load_log = NULL;
+
+/* fake helper */
+
+static void
+fake_helper_method_call (GDBusConnection *connection,
+			 const char *sender,
+			 const char *object_path,
+			 const char *interface_name,
+			 const char *method_name,
+			 GVariant *parameters,
+			 GDBusMethodInvocation *invocation,
+			 gpointer data)
+{
+	const char *nothing[] = { NULL };
+
+	if (g_strcmp0 (method_name, "ping") == 0) {
+		g_dbus_method_invocation_return_value (invocation, g_variant_new ("(b)", TRUE));
+	} else if (g_strcmp0 (method_name, "getSaveableTypes") == 0) {
+		g_dbus_method_invocation_return_value (invocation, g_variant_new ("(^as)", nothing));
+	} else if (g_strcmp0 (method_name, "load") == 0) {
+		const char *uri;
+		char *line;
+		FILE *log;
+
+		/* record each load so the test can see which requests were sent again */
+		g_variant_get (parameters, "(&s)", &uri);
+		line = g_strdup_printf ("%s\n", uri);
+		log = fopen (g_getenv ("RB_TEST_LOAD_LOG"), "a");
+		fputs (line, log);
+		fclose (log);
+		g_free (line);
+
+		if (g_strcmp0 (uri, CRASH_URI) == 0) {
+			/* give the test time to queue more requests behind this one */
+			g_usleep (G_USEC_PER_SEC / 2);
+			_exit (1);
+		}
+
+		g_dbus_method_invocation_return_value (invocation,
+						       g_variant_new ("(^as^asbbbsbisa{iv})",
+								      nothing,
+								      nothing,
+								      TRUE,
+								      FALSE,
+								      FALSE,
+								      "audio/x-vorbis",
+								      TRUE,
+								      0,
+								      "",
+								      NULL));
+	}
+}
+
+static const GDBusInterfaceVTable fake_helper_vtable = {
+	fake_helper_method_call,
+	NULL,
+	NULL
+};
+
+static gboolean
+fake_helper_new_connection_cb (GDBusServer *server, GDBusConnection *connection, GDBusNodeInfo *node_info)
+{
+	g_dbus_connection_register_object (connection,
+					   RB_METADATA_DBUS_OBJECT_PATH,
+					   g_dbus_node_info_lookup_interface (node_info, RB_METADATA_DBUS_INTERFACE),
+					   &fake_helper_vtable,
+					   NULL,
+					   NULL,
+					   NULL);
+	g_object_ref (connection);
+	g_dbus_connection_set_exit_on_close (connection, TRUE);
+	return TRUE;
+}
+
+static int
+run_fake_helper (const char *address)
+{
+	GDBusNodeInfo *node_info;
+	GDBusServer *server;
+	GMainLoop *loop;
+	char *guid;
+
+	node_info = g_dbus_node_info_new_for_xml (rb_metadata_iface_xml, NULL);
+	guid = g_dbus_generate_guid ();
+	server = g_dbus_server_new_sync (address, G_DBUS_SERVER_FLAGS_NONE, guid, NULL, NULL, NULL);
+	g_free (guid);
+	if (server == NULL)
+		return 1;
+
+	g_signal_connect (server, "new-connection", G_CALLBACK (fake_helper_new_connection_cb), node_info);
+	g_dbus_server_start (server);
+
+	printf ("%s\n", g_dbus_server_get_client_address (server));
+	fflush (stdout);
+
+	loop = g_main_loop_new (NULL, FALSE);
+	g_main_loop_run (loop);
+	return 0;
+}
+
+/* tests */
+
+static gpointer
+load_thread (const char *uri)
+{
+	RBMetaData *md;
+	GError *error = NULL;
+
+	md = rb_metadata_new ();
+	rb_metadata_load (md, uri, &error);
+	g_object_unref (md);
+	return error;
+}
+
+static guint
+count_loads (const char *uri)
+{
+	char *data;
+	char **lines;
+	guint count = 0;
+	int i;
+
+	if (g_file_get_contents (load_log, &data, NULL, NULL) == FALSE)
+		return 0;
+
+	lines = g_strsplit (data, "\n", -1);
+	for (i = 0; lines[i] != NULL; i++) {
+		if (g_strcmp0 (lines[i], uri) == 0)
+			count++;
+	}
+	g_strfreev (lines);
+	g_free (data);
+	return count;
+}
+
+START_TEST (test_metadata_helper_crash)
+{
+	const char *uris[] = {
+		"file:///queued-1.ogg",
+		"file:///queued-2.ogg",
+		"file:///queued-3.ogg",
+	};
+	GThread *crash_thread;
+	GThread *threads[G_N_ELEMENTS (uris)];
+	GError *error;
+	guint i;
+
+	/* start the helper first, so requests go to it in the order they're made */
+	error = load_thread ("file:///start.ogg");
+	ck_assert_msg (error == NULL, "unable to start fake metadata helper: %s", error ? error->message : "");
+
+	crash_thread = g_thread_new ("crash", (GThreadFunc) load_thread, CRASH_URI);
+	g_usleep (G_USEC_PER_SEC / 10);
+	for (i = 0; i < G_N_ELEMENTS (uris); i++) {
+		threads[i] = g_thread_new ("load", (GThreadFunc) load_thread, (gpointer) uris[i]);
+	}
+
+	/* the request that crashed the helper fails without being sent again */
+	error = g_thread_join (crash_thread);
+	ck_assert_msg (error != NULL, "request that crashed the helper succeeded");
+	g_error_free (error);
+	ck_assert_msg (count_loads (CRASH_URI) == 1, "request that crashed the helper was sent %u times", count_loads (CRASH_URI));
+
+	/* the requests queued behind it are sent to the restarted helper */
+	for (i = 0; i < G_N_ELEMENTS (uris); i++) {
+		error = g_thread_join (threads[i]);
+		ck_assert_msg (error == NULL, "request queued behind the crash failed: %s", error ? error->message : "");
+		ck_assert_msg (count_loads (uris[i]) == 2, "request for %s was sent %u times", uris[i], count_loads (uris[i]));
+	}
+}
+END_TEST
+
+static Suite *
+rb_metadata_helper_suite (void)
+{
+	Suite *s = suite_create ("rb-metadata-helper");
+	TCase *tc_chain = tcase_create ("rb-metadata-helper-core");
+
+	suite_add_tcase (s, tc_chain);
+
+	tcase_add_test (tc_chain, test_metadata_helper_crash);
+
+	return s;
+}
+
+int
+main (int argc, char **argv)
+{
+	int ret;
+	SRunner *sr;
+	Suite *s;
+	char *dir;
+	char *self;
+
+	/* the last argument to the helper is the address to listen on */
+	if (g_getenv ("RB_TEST_LOAD_LOG") != NULL)
+		return run_fake_helper (argv[argc - 1]);
+
+	rb_profile_start ("rb-metadata-helper test suite");
+	rb_threads_init ();
+	rb_debug_init (TRUE);
+
+	dir = g_dir_make_tmp ("rb-test-metadata-helper-XXXXXX", NULL);
+	load_log = g_build_filename (dir, "loads", NULL);
+	self = g_file_read_link ("/proc/self/exe", NULL);
+	g_setenv ("RB_METADATA_HELPER", self, TRUE);
+	g_setenv ("RB_METADATA_HELPERS", "1", TRUE);
+	g_setenv ("RB_TEST_LOAD_LOG", load_log, TRUE);
+
+	/* setup tests */
+	s = rb_metadata_helper_suite ();
+	sr = srunner_create (s);
+	srunner_run_all (sr, CK_NORMAL);
+	ret = srunner_ntests_failed (sr);
+	srunner_free (sr);
+
+	g_unlink (load_log);
+	g_rmdir (dir);
+	g_free (load_log);
+	g_free (self);
+	g_free (dir);
+
+	rb_profile_end ("rb-metadata-helper test suite");
+	return ret;
+}
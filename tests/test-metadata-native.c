@@ -0,0 +1,381 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+/*
+ * Tests for the native tag readers: files encoded with GStreamer must
+ * read the same natively as through the discoverer, and truncated or
+ * corrupt files must be rejected rather than crashing the reader.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <check.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+#include <gst/tag/tag.h>
+
+#include "rb-metadata.h"
+#include "rb-metadata-native.h"
+#include "rb-debug.h"
+#include "rb-util.h"
+
+#define FIXTURE_TITLE	"Native Title"
+#define FIXTURE_ARTIST	"Native Artist"
+#define FIXTURE_ALBUM	"Native Album"
+
+typedef struct {
+	const char *name;
+	const char *elements[4];
+	const char *pipeline;
+} FixtureFormat;
+
+/* five seconds of audio in each format */
+static const FixtureFormat fixture_formats[] = {
+	{ "test.flac", { "flacenc", NULL },
+	  "audiotestsrc num-buffers=50 samplesperbuffer=4410 ! audioconvert ! flacenc ! filesink location=\"%s\"" },
+	{ "test.ogg", { "vorbisenc", "oggmux", NULL },
+	  "audiotestsrc num-buffers=50 samplesperbuffer=4410 ! audioconvert ! vorbisenc ! oggmux ! filesink location=\"%s\"" },
+	{ "test.opus", { "opusenc", "oggmux", NULL },
+	  "audiotestsrc num-buffers=50 samplesperbuffer=4410 ! audioconvert ! audioresample ! opusenc ! oggmux ! filesink location=\"%s\"" },
+	{ "test.mp3", { "lamemp3enc", "id3v2mux", NULL },
+	  "audiotestsrc num-buffers=50 samplesperbuffer=4410 ! audioconvert ! lamemp3enc ! id3v2mux ! filesink location=\"%s\"" },
+};
+
+/* created before the tests are forked off, so it can be removed afterwards */
+static char *fixture_dir = NULL;
+
+static char *
+fixture_path (const char *name)
+{
+	return g_build_filename (fixture_dir, name, NULL);
+}
+
+static void
+cleanup_fixture (const char *filename)
+{
+	g_unlink (filename);
+}
+
+/* returns the filename of the encoded file, or NULL if the encoder isn't available */
+static char *
+encode_fixture (const FixtureFormat *format)
+{
+	GstElement *pipeline;
+	GstIterator *iter;
+	GValue item = {0,};
+	GstTagList *tags;
+	GstMessage *message;
+	GstBus *bus;
+	char *filename;
+	char *desc;
+	int i;
+
+	for (i = 0; format->elements[i] != NULL; i++) {
+		GstElementFactory *factory;
+
+		factory = gst_element_factory_find (format->elements[i]);
+		if (factory == NULL) {
+			rb_debug ("%s not available, skipping %s", format->elements[i], format->name);
+			return NULL;
+		}
+		gst_object_unref (factory);
+	}
+
+	filename = fixture_path (format->name);
+	desc = g_strdup_printf (format->pipeline, filename);
+	pipeline = gst_parse_launch (desc, NULL);
+	g_free (desc);
+	ck_assert_msg (pipeline != NULL, "couldn't create encoding pipeline");
+
+	tags = gst_tag_list_new (GST_TAG_TITLE, FIXTURE_TITLE,
+				 GST_TAG_ARTIST, FIXTURE_ARTIST,
+				 GST_TAG_ALBUM, FIXTURE_ALBUM,
+				 NULL);
+	iter = gst_bin_iterate_all_by_interface (GST_BIN (pipeline), GST_TYPE_TAG_SETTER);
+	while (gst_iterator_next (iter, &item) == GST_ITERATOR_OK) {
+		gst_tag_setter_merge_tags (GST_TAG_SETTER (g_value_get_object (&item)), tags, GST_TAG_MERGE_REPLACE_ALL);
+		g_value_reset (&item);
+	}
+	g_value_unset (&item);
+	gst_iterator_free (iter);
+	gst_tag_list_unref (tags);
+
+	gst_element_set_state (pipeline, GST_STATE_PLAYING);
+	bus = gst_element_get_bus (pipeline);
+	message = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+	ck_assert_msg (GST_MESSAGE_TYPE (message) == GST_MESSAGE_EOS, "encoding %s failed", format->name);
+	gst_message_unref (message);
+	gst_object_unref (bus);
+
+	gst_element_set_state (pipeline, GST_STATE_NULL);
+	gst_object_unref (pipeline);
+	return filename;
+}
+
+static char *
+write_fixture (const char *name, const guint8 *data, gsize len)
+{
+	char *filename;
+
+	filename = fixture_path (name);
+	ck_assert_msg (g_file_set_contents (filename, (const char *) data, len, NULL), "couldn't write %s", name);
+	return filename;
+}
+
+static gboolean
+native_read_file (const char *filename)
+{
+	RBMetaDataNativeInfo info;
+	gboolean ret;
+	char *uri;
+
+	uri = g_filename_to_uri (filename, NULL, NULL);
+	ret = rb_metadata_native_read (uri, &info);
+	if (ret)
+		ck_assert_msg (info.tags != NULL, "native reader returned no tag list");
+	rb_metadata_native_info_clear (&info);
+	g_free (uri);
+	return ret;
+}
+
+static RBMetaData *
+load_metadata (const char *uri, gboolean native)
+{
+	RBMetaData *md;
+	GError *error = NULL;
+
+	/* the reader checks this when it's created */
+	if (native == FALSE)
+		g_setenv ("RB_METADATA_NO_NATIVE", "1", TRUE);
+	md = rb_metadata_new ();
+	g_unsetenv ("RB_METADATA_NO_NATIVE");
+
+	rb_metadata_load (md, uri, &error);
+	ck_assert_msg (error == NULL, "error loading %s: %s", uri, error ? error->message : "");
+	return md;
+}
+
+static void
+check_string_field (RBMetaData *native, RBMetaData *gst, RBMetaDataField field, const char *expected)
+{
+	GValue nv = {0,};
+	GValue gv = {0,};
+
+	ck_assert_msg (rb_metadata_get (gst, field, &gv), "%s missing from discoverer results", rb_metadata_get_field_name (field));
+	ck_assert_msg (rb_metadata_get (native, field, &nv), "%s missing from native results", rb_metadata_get_field_name (field));
+	ck_assert (g_strcmp0 (g_value_get_string (&gv), expected) == 0);
+	ck_assert (g_strcmp0 (g_value_get_string (&nv), g_value_get_string (&gv)) == 0);
+	g_value_unset (&nv);
+	g_value_unset (&gv);
+}
+
+START_TEST (test_native_matches_discoverer)
+{
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS (fixture_formats); i++) {
+		RBMetaData *native;
+		RBMetaData *gst;
+		GValue nv = {0,};
+		GValue gv = {0,};
+		char *filename;
+		char *uri;
+		long diff;
+
+		filename = encode_fixture (&fixture_formats[i]);
+		if (filename == NULL)
+			continue;
+
+		rb_debug ("comparing results for %s", fixture_formats[i].name);
+		ck_assert_msg (native_read_file (filename), "%s not read natively", fixture_formats[i].name);
+
+		uri = g_filename_to_uri (filename, NULL, NULL);
+		native = load_metadata (uri, TRUE);
+		gst = load_metadata (uri, FALSE);
+
+		ck_assert (g_strcmp0 (rb_metadata_get_media_type (native), rb_metadata_get_media_type (gst)) == 0);
+		ck_assert_msg (rb_metadata_has_audio (native), "native results have no audio");
+		ck_assert_msg (rb_metadata_has_missing_plugins (native) == FALSE, "native results have missing plugins");
+
+		check_string_field (native, gst, RB_METADATA_FIELD_TITLE, FIXTURE_TITLE);
+		check_string_field (native, gst, RB_METADATA_FIELD_ARTIST, FIXTURE_ARTIST);
+		check_string_field (native, gst, RB_METADATA_FIELD_ALBUM, FIXTURE_ALBUM);
+
+		/* duration estimates can differ a little, but not by more than a second */
+		ck_assert_msg (rb_metadata_get (gst, RB_METADATA_FIELD_DURATION, &gv), "no duration from discoverer");
+		ck_assert_msg (rb_metadata_get (native, RB_METADATA_FIELD_DURATION, &nv), "no native duration");
+		diff = (long) g_value_get_ulong (&nv) - (long) g_value_get_ulong (&gv);
+		ck_assert_msg (ABS (diff) <= 1, "durations differ for %s: %lu vs %lu",
+			       fixture_formats[i].name, g_value_get_ulong (&nv), g_value_get_ulong (&gv));
+		g_value_unset (&nv);
+		g_value_unset (&gv);
+
+		g_object_unref (native);
+		g_object_unref (gst);
+		cleanup_fixture (filename);
+		g_free (filename);
+		g_free (uri);
+	}
+}
+END_TEST
+
+START_TEST (test_native_truncated)
+{
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS (fixture_formats); i++) {
+		static const gsize headers_only[] = { 3, 4, 10, 30 };
+		char *filename;
+		char *truncated;
+		char *contents;
+		gsize len;
+		gsize cut;
+		int j;
+
+		filename = encode_fixture (&fixture_formats[i]);
+		if (filename == NULL)
+			continue;
+
+		ck_assert (g_file_get_contents (filename, &contents, &len, NULL));
+
+		/* too short to contain complete headers */
+		for (j = 0; j < G_N_ELEMENTS (headers_only); j++) {
+			truncated = write_fixture ("truncated", (guint8 *) contents, headers_only[j]);
+			ck_assert_msg (native_read_file (truncated) == FALSE,
+				       "%s truncated to %" G_GSIZE_FORMAT " bytes read natively",
+				       fixture_formats[i].name, headers_only[j]);
+			cleanup_fixture (truncated);
+			g_free (truncated);
+		}
+
+		/* anywhere else, the reader may or may not accept the file, but must not crash */
+		for (cut = 1; cut < len; cut += MAX (1, len / 97)) {
+			truncated = write_fixture ("truncated", (guint8 *) contents, cut);
+			native_read_file (truncated);
+			cleanup_fixture (truncated);
+			g_free (truncated);
+		}
+
+		g_free (contents);
+		cleanup_fixture (filename);
+		g_free (filename);
+	}
+}
+END_TEST
+
+START_TEST (test_native_oversized_tags)
+{
+	guint8 data[256];
+	char *filename;
+
+	/* id3v2 tag claiming to be 1MB long in a 256 byte file */
+	memset (data, 0, sizeof (data));
+	memcpy (data, "ID3\x04\x00\x00\x00\x40\x00\x00", 10);
+	filename = write_fixture ("oversized.mp3", data, sizeof (data));
+	ck_assert_msg (native_read_file (filename) == FALSE, "oversized id3v2 tag accepted");
+	cleanup_fixture (filename);
+	g_free (filename);
+
+	/* id3v2 tag filling the whole file, with no audio after it */
+	memcpy (data, "ID3\x04\x00\x00\x00\x00\x01\x76", 10);		/* 246 bytes */
+	filename = write_fixture ("tag-only.mp3", data, sizeof (data));
+	ck_assert_msg (native_read_file (filename) == FALSE, "id3v2 tag without audio accepted");
+	cleanup_fixture (filename);
+	g_free (filename);
+
+	/* flac with a vorbis comment block longer than the file */
+	memset (data, 0, sizeof (data));
+	memcpy (data, "fLaC\x00\x00\x00\x22", 8);
+	data[8 + 10] = 0x0a;		/* 44100Hz */
+	data[8 + 11] = 0xc4;
+	data[8 + 12] = 0x40;
+	memcpy (data + 8 + 34, "\x84\xff\xff\xff", 4);
+	filename = write_fixture ("oversized.flac", data, sizeof (data));
+	ck_assert_msg (native_read_file (filename) == FALSE, "oversized flac metadata block accepted");
+	cleanup_fixture (filename);
+	g_free (filename);
+
+	/* ogg page claiming more data than the file holds */
+	memset (data, 0xff, sizeof (data));
+	memset (data, 0, 27);
+	memcpy (data, "OggS", 4);
+	data[5] = 0x02;			/* beginning of stream */
+	data[26] = 200;			/* segments, all 255 bytes long */
+	filename = write_fixture ("oversized.ogg", data, sizeof (data));
+	ck_assert_msg (native_read_file (filename) == FALSE, "oversized ogg page accepted");
+	cleanup_fixture (filename);
+	g_free (filename);
+}
+END_TEST
+
+static Suite *
+rb_metadata_native_suite (void)
+{
+	Suite *s = suite_create ("rb-metadata-native");
+	TCase *tc_chain = tcase_create ("rb-metadata-native-core");
+
+	suite_add_tcase (s, tc_chain);
+	/* encoding the fixtures can take a while on slow machines */
+	tcase_set_timeout (tc_chain, 60);
+
+	tcase_add_test (tc_chain, test_native_matches_discoverer);
+	tcase_add_test (tc_chain, test_native_truncated);
+	tcase_add_test (tc_chain, test_native_oversized_tags);
+
+	return s;
+}
+
+int
+main (int argc, char **argv)
+{
+	int ret;
+	SRunner *sr;
+	Suite *s;
+
+	rb_profile_start ("rb-metadata-native test suite");
+	rb_threads_init ();
+	rb_debug_init (TRUE);
+	gst_init (&argc, &argv);
+
+	fixture_dir = g_dir_make_tmp ("rb-test-metadata-native-XXXXXX", NULL);
+
+	/* setup tests */
+	s = rb_metadata_native_suite ();
+	sr = srunner_create (s);
+	srunner_run_all (sr, CK_NORMAL);
+	ret = srunner_ntests_failed (sr);
+	srunner_free (sr);
+
+	g_rmdir (fixture_dir);
+	g_free (fixture_dir);
+
+	rb_profile_end ("rb-metadata-native test suite");
+	return ret;
+}
@@ -0,0 +1,235 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+#include "config.h"
+
+#include <check.h>
+#include <glib-object.h>
+
+#include "rb-player.h"
+#include "rb-player-gst-helper.h"
+#include "rb-debug.h"
+#include "rb-util.h"
+
+/* a player that only tracks changes to the tick interval */
+
+#define TEST_TYPE_PLAYER	(test_player_get_type ())
+#define TEST_PLAYER(o)		(G_TYPE_CHECK_INSTANCE_CAST ((o), TEST_TYPE_PLAYER, TestPlayer))
+
+typedef struct {
+	GObject parent;
+	int interval_changes;
+} TestPlayer;
+
+typedef struct {
+	GObjectClass parent_class;
+} TestPlayerClass;
+
+static void test_player_iface_init (RBPlayerIface *iface);
+GType test_player_get_type (void);
+
+G_DEFINE_TYPE_WITH_CODE (TestPlayer, test_player, G_TYPE_OBJECT,
+			 G_IMPLEMENT_INTERFACE (RB_TYPE_PLAYER, test_player_iface_init))
+
+static void
+test_player_tick_interval_changed (RBPlayer *player)
+{
+	TEST_PLAYER (player)->interval_changes++;
+}
+
+static void
+test_player_iface_init (RBPlayerIface *iface)
+{
+	iface->tick_interval_changed = test_player_tick_interval_changed;
+}
+
+static void
+test_player_init (TestPlayer *player)
+{
+}
+
+static void
+test_player_class_init (TestPlayerClass *klass)
+{
+}
+
+static gboolean
+dummy_tick (gpointer data)
+{
+	return TRUE;
+}
+
+START_TEST (test_tick_subscribers)
+{
+	TestPlayer *player;
+	RBPlayer *rbp;
+	guint slow;
+	guint fast;
+	guint second;
+
+	player = g_object_new (TEST_TYPE_PLAYER, NULL);
+	rbp = RB_PLAYER (player);
+
+	/* no subscribers, no ticks */
+	ck_assert (rb_player_get_tick_interval (rbp) == 0);
+	ck_assert (_rb_player_add_tick_timeout (rbp, dummy_tick, NULL) == 0);
+
+	slow = rb_player_add_tick_subscriber (rbp, 1000);
+	ck_assert (slow != 0);
+	ck_assert (rb_player_get_tick_interval (rbp) == 1000);
+	ck_assert (player->interval_changes == 1);
+
+	/* the shortest interval wins */
+	fast = rb_player_add_tick_subscriber (rbp, 200);
+	ck_assert (fast != slow);
+	ck_assert (rb_player_get_tick_interval (rbp) == 200);
+	ck_assert (player->interval_changes == 2);
+
+	/* a longer interval doesn't change anything */
+	second = rb_player_add_tick_subscriber (rbp, 1000);
+	ck_assert (rb_player_get_tick_interval (rbp) == 200);
+	ck_assert (player->interval_changes == 2);
+
+	rb_player_remove_tick_subscriber (rbp, fast);
+	ck_assert (rb_player_get_tick_interval (rbp) == 1000);
+	ck_assert (player->interval_changes == 3);
+
+	/* removing one of two equal subscriptions doesn't change the interval */
+	rb_player_remove_tick_subscriber (rbp, slow);
+	ck_assert (rb_player_get_tick_interval (rbp) == 1000);
+	ck_assert (player->interval_changes == 3);
+
+	/* and removing the last one stops ticks altogether */
+	rb_player_remove_tick_subscriber (rbp, second);
+	ck_assert (rb_player_get_tick_interval (rbp) == 0);
+	ck_assert (player->interval_changes == 4);
+	ck_assert (_rb_player_add_tick_timeout (rbp, dummy_tick, NULL) == 0);
+
+	g_object_unref (player);
+}
+END_TEST
+
+START_TEST (test_tick_timeout)
+{
+	TestPlayer *player;
+	RBPlayer *rbp;
+	guint sub;
+	guint id;
+
+	player = g_object_new (TEST_TYPE_PLAYER, NULL);
+	rbp = RB_PLAYER (player);
+
+	sub = rb_player_add_tick_subscriber (rbp, 1000);
+	id = _rb_player_add_tick_timeout (rbp, dummy_tick, NULL);
+	ck_assert (id != 0);
+	g_source_remove (id);
+	rb_player_remove_tick_subscriber (rbp, sub);
+
+	sub = rb_player_add_tick_subscriber (rbp, 250);
+	id = _rb_player_add_tick_timeout (rbp, dummy_tick, NULL);
+	ck_assert (id != 0);
+	g_source_remove (id);
+	rb_player_remove_tick_subscriber (rbp, sub);
+
+	g_object_unref (player);
+}
+END_TEST
+
+START_TEST (test_position_estimate)
+{
+	RBGstPosition pos;
+	gint64 estimate;
+
+	/* nothing to estimate from */
+	rb_gst_position_reset (&pos);
+	ck_assert (rb_gst_position_estimate (&pos, &estimate) == FALSE);
+
+	/* a fresh sample extrapolates to roughly itself */
+	rb_gst_position_update (&pos, (gint64) 10 * RB_PLAYER_SECOND);
+	ck_assert (rb_gst_position_estimate (&pos, &estimate));
+	ck_assert (estimate >= (gint64) 10 * RB_PLAYER_SECOND);
+	ck_assert (estimate < (gint64) 11 * RB_PLAYER_SECOND);
+
+	/* an older sample extrapolates using the elapsed time */
+	pos.sample_time -= 2 * G_USEC_PER_SEC;
+	ck_assert (rb_gst_position_estimate (&pos, &estimate));
+	ck_assert (estimate >= (gint64) 12 * RB_PLAYER_SECOND);
+	ck_assert (estimate < (gint64) 13 * RB_PLAYER_SECOND);
+
+	/* samples expire after a few seconds */
+	pos.sample_time -= 4 * G_USEC_PER_SEC;
+	ck_assert (rb_gst_position_estimate (&pos, &estimate) == FALSE);
+
+	/* and a failed position query discards the sample */
+	rb_gst_position_update (&pos, (gint64) 10 * RB_PLAYER_SECOND);
+	rb_gst_position_update (&pos, -1);
+	ck_assert (rb_gst_position_estimate (&pos, &estimate) == FALSE);
+
+	rb_gst_position_update (&pos, 0);
+	ck_assert (rb_gst_position_estimate (&pos, &estimate));
+	rb_gst_position_reset (&pos);
+	ck_assert (rb_gst_position_estimate (&pos, &estimate) == FALSE);
+}
+END_TEST
+
+static Suite *
+rb_player_suite (void)
+{
+	Suite *s = suite_create ("rb-player");
+	TCase *tc_chain = tcase_create ("rb-player-ticks");
+
+	suite_add_tcase (s, tc_chain);
+
+	tcase_add_test (tc_chain, test_tick_subscribers);
+	tcase_add_test (tc_chain, test_tick_timeout);
+	tcase_add_test (tc_chain, test_position_estimate);
+
+	return s;
+}
+
+int
+main (int argc, char **argv)
+{
+	int ret;
+	SRunner *sr;
+	Suite *s;
+
+	rb_profile_start ("rb-player test suite");
+	rb_threads_init ();
+	rb_debug_init (TRUE);
+
+	/* setup tests */
+	s = rb_player_suite ();
+	sr = srunner_create (s);
+	srunner_run_all (sr, CK_NORMAL);
+	ret = srunner_ntests_failed (sr);
+	srunner_free (sr);
+
+	rb_profile_end ("rb-player test suite");
+	return ret;
+}
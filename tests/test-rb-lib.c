@@ -27,6 +27,7 @@
 
 #include "config.h"
 
+#include <math.h>
 #include <string.h>
 #include <glib-object.h>
 
@@ -35,6 +36,7 @@
 #include "rb-util.h"
 #include "rb-string-value-map.h"
 #include "rb-debug.h"
+#include "rb-loudness.h"
 
 START_TEST (test_rb_string_value_map)
 {
@@ -82,6 +84,100 @@ START_TEST (test_rb_string_value_map)
 }
 END_TEST
 
+/* feeds @seconds of a 1kHz sine at @dbfs peak level, or silence if @dbfs is 0 */
+static void
+feed_sine (RBLoudnessMeter *meter, guint rate, guint channels, double dbfs, guint seconds)
+{
+	float *buf;
+	double amplitude;
+	guint frames;
+	guint i, c;
+
+	amplitude = (dbfs < 0.0) ? pow (10.0, dbfs / 20.0) : 0.0;
+	frames = rate * seconds;
+	buf = g_new (float, frames * channels);
+	for (i = 0; i < frames; i++) {
+		float v = amplitude * sin (2.0 * G_PI * 1000.0 * i / rate);
+		for (c = 0; c < channels; c++)
+			buf[i * channels + c] = v;
+	}
+
+	/* uneven pieces to cross sub-block boundaries at odd places */
+	for (i = 0; i < frames; ) {
+		guint n = MIN (frames - i, 3001);
+		rb_loudness_meter_process (meter, buf + (i * channels), n);
+		i += n;
+	}
+	g_free (buf);
+}
+
+START_TEST (test_rb_loudness_reference)
+{
+	RBLoudnessMeter *meter;
+	double lufs;
+
+	/* EBU Tech 3341 case 1: stereo 1kHz sine at -23dBFS reads -23 LUFS */
+	meter = rb_loudness_meter_new (48000, 2);
+	feed_sine (meter, 48000, 2, -23.0, 20);
+	ck_assert_msg (rb_loudness_meter_get_loudness (meter, &lufs), "no loudness for reference tone");
+	ck_assert_msg (fabs (lufs + 23.0) < 0.1, "reference tone measured %f LUFS", lufs);
+	ck_assert_msg (fabs (rb_loudness_meter_get_peak (meter) - pow (10.0, -23.0 / 20.0)) < 0.001, "wrong peak");
+	ck_assert_msg (fabs (rb_loudness_gain_from_loudness (lufs) - 5.0) < 0.1, "wrong gain");
+	rb_loudness_meter_free (meter);
+
+	/* same at 44.1kHz */
+	meter = rb_loudness_meter_new (44100, 2);
+	feed_sine (meter, 44100, 2, -23.0, 20);
+	ck_assert_msg (rb_loudness_meter_get_loudness (meter, &lufs), "no loudness for reference tone");
+	ck_assert_msg (fabs (lufs + 23.0) < 0.1, "44.1kHz reference tone measured %f LUFS", lufs);
+	rb_loudness_meter_free (meter);
+
+	/* mono carries half the power of the stereo signal */
+	meter = rb_loudness_meter_new (48000, 1);
+	feed_sine (meter, 48000, 1, -20.0, 20);
+	ck_assert_msg (rb_loudness_meter_get_loudness (meter, &lufs), "no loudness for mono tone");
+	ck_assert_msg (fabs (lufs + 23.0) < 0.1, "mono tone measured %f LUFS", lufs);
+	rb_loudness_meter_free (meter);
+}
+END_TEST
+
+START_TEST (test_rb_loudness_gating)
+{
+	RBLoudnessMeter *meter;
+	RBLoudnessMeter *other;
+	double lufs;
+
+	/* silence can't be measured */
+	meter = rb_loudness_meter_new (48000, 2);
+	feed_sine (meter, 48000, 2, 0.0, 5);
+	ck_assert_msg (rb_loudness_meter_get_loudness (meter, &lufs) == FALSE, "measured loudness of silence");
+	ck_assert_msg (rb_loudness_meter_get_peak (meter) == 0.0, "silence has a peak");
+
+	/* silence is excluded by the absolute gate */
+	feed_sine (meter, 48000, 2, -23.0, 10);
+	ck_assert_msg (rb_loudness_meter_get_loudness (meter, &lufs), "no loudness after tone");
+	ck_assert_msg (fabs (lufs + 23.0) < 0.2, "tone after silence measured %f LUFS", lufs);
+
+	/* quiet passages are excluded by the relative gate; the blocks
+	 * spanning the transitions account for the wider tolerance.
+	 */
+	feed_sine (meter, 48000, 2, -40.0, 10);
+	ck_assert_msg (rb_loudness_meter_get_loudness (meter, &lufs), "no loudness after quiet tone");
+	ck_assert_msg (fabs (lufs + 23.0) < 0.2, "tone with quiet passage measured %f LUFS", lufs);
+
+	/* album loudness combines the blocks of each track */
+	other = rb_loudness_meter_new (44100, 2);
+	feed_sine (other, 44100, 2, -13.0, 10);
+	rb_loudness_meter_add (meter, other);
+	ck_assert_msg (rb_loudness_meter_get_loudness (meter, &lufs), "no album loudness");
+	ck_assert_msg (fabs (lufs + 15.6) < 0.2, "album measured %f LUFS", lufs);
+	ck_assert_msg (fabs (rb_loudness_meter_get_peak (meter) - pow (10.0, -13.0 / 20.0)) < 0.001, "wrong album peak");
+
+	rb_loudness_meter_free (other);
+	rb_loudness_meter_free (meter);
+}
+END_TEST
+
 static Suite *
 rb_file_helpers_suite (void)
 {
@@ -91,6 +187,8 @@ rb_file_helpers_suite (void)
 	suite_add_tcase (s, tc_chain);
 
 	tcase_add_test (tc_chain, test_rb_string_value_map);
+	tcase_add_test (tc_chain, test_rb_loudness_reference);
+	tcase_add_test (tc_chain, test_rb_loudness_gating);
 
 	return s;
 }
@@ -0,0 +1,238 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+#include "config.h"
+
+#include <check.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "rhythmdb-crawler.h"
+#include "rb-debug.h"
+#include "rb-file-helpers.h"
+#include "rb-util.h"
+
+typedef struct {
+	GHashTable *found;	/* path -> whether file info was provided */
+	gboolean done;
+} CrawlResults;
+
+static gboolean
+crawl_file_cb (GFile *file, GFileInfo *info, CrawlResults *results)
+{
+	g_hash_table_insert (results->found, g_file_get_path (file), GINT_TO_POINTER (info != NULL));
+	return TRUE;
+}
+
+static void
+crawl_done_cb (CrawlResults *results)
+{
+	results->done = TRUE;
+}
+
+/* crawls dir, loading state from and saving it to state_file, and returns the files found */
+static GHashTable *
+crawl (const char *dir, const char *state_file)
+{
+	RhythmDBCrawler *crawler;
+	GCancellable *cancel;
+	CrawlResults results;
+	GSList *uris;
+
+	results.found = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	results.done = FALSE;
+
+	cancel = g_cancellable_new ();
+	crawler = rhythmdb_crawler_new (cancel, (RBUriRecurseFunc) crawl_file_cb, &results, (GDestroyNotify) crawl_done_cb);
+	rhythmdb_crawler_set_workers (crawler, 2);
+	rhythmdb_crawler_load_state (crawler, state_file);
+
+	uris = g_slist_prepend (NULL, g_filename_to_uri (dir, NULL, NULL));
+	rhythmdb_crawler_start (crawler, uris);
+	while (results.done == FALSE)
+		g_main_context_iteration (NULL, TRUE);
+
+	ck_assert_msg (rhythmdb_crawler_save_state (crawler, state_file, NULL), "failed to save crawl state");
+	rhythmdb_crawler_free (crawler);
+	rb_slist_deep_free (uris);
+	g_object_unref (cancel);
+	return results.found;
+}
+
+static char *
+make_file (const char *dir, const char *name)
+{
+	char *path;
+
+	path = g_build_filename (dir, name, NULL);
+	ck_assert (g_file_set_contents (path, "x", -1, NULL));
+	return path;
+}
+
+static void
+set_mtime (const char *path, guint64 mtime)
+{
+	GFile *file;
+
+	file = g_file_new_for_path (path);
+	ck_assert (g_file_set_attribute_uint64 (file, G_FILE_ATTRIBUTE_TIME_MODIFIED, mtime, G_FILE_QUERY_INFO_NONE, NULL, NULL));
+	g_object_unref (file);
+}
+
+/* checks whether a file was found, and whether it was listed (with file info) or taken from the saved state */
+static void
+check_found (GHashTable *found, const char *path, gboolean listed)
+{
+	gpointer value;
+
+	ck_assert_msg (g_hash_table_lookup_extended (found, path, NULL, &value), "%s not found", path);
+	ck_assert_msg (GPOINTER_TO_INT (value) == listed,
+		       listed ? "%s not listed" : "%s listed in an unchanged directory", path);
+}
+
+START_TEST (test_crawler_state)
+{
+	GHashTable *found;
+	char *dir;
+	char *sub;
+	char *state_file;
+	char *a, *b, *c;
+	char *data;
+	gsize len;
+
+	dir = g_dir_make_tmp ("rb-test-crawler-XXXXXX", NULL);
+	ck_assert (dir != NULL);
+	sub = g_build_filename (dir, "sub", NULL);
+	ck_assert (g_mkdir (sub, 0700) == 0);
+	a = make_file (dir, "a.ogg");
+	b = make_file (sub, "b.ogg");
+	set_mtime (sub, 1000);
+	set_mtime (dir, 1000);
+	state_file = g_build_filename (dir, ".crawl-state", NULL);
+
+	/* without any saved state, everything is listed */
+	found = crawl (dir, state_file);
+	ck_assert (g_hash_table_size (found) == 2);
+	check_found (found, a, TRUE);
+	check_found (found, b, TRUE);
+	g_hash_table_destroy (found);
+	ck_assert_msg (g_file_test (state_file, G_FILE_TEST_EXISTS), "crawl state not saved");
+
+	/* unchanged directories are skipped, but their files are still reported */
+	set_mtime (dir, 1000);
+	found = crawl (dir, state_file);
+	ck_assert (g_hash_table_size (found) == 2);
+	check_found (found, a, FALSE);
+	check_found (found, b, FALSE);
+	g_hash_table_destroy (found);
+
+	/* only the changed directory is listed again */
+	c = make_file (sub, "c.ogg");
+	set_mtime (sub, 2000);
+	set_mtime (dir, 1000);
+	found = crawl (dir, state_file);
+	ck_assert (g_hash_table_size (found) == 3);
+	check_found (found, a, FALSE);
+	check_found (found, b, TRUE);
+	check_found (found, c, TRUE);
+	g_hash_table_destroy (found);
+
+	/* a damaged state file must not break the crawl */
+	ck_assert (g_file_get_contents (state_file, &data, &len, NULL));
+	ck_assert (g_file_set_contents (state_file, data, len / 2, NULL));
+	g_free (data);
+	set_mtime (dir, 1000);
+	found = crawl (dir, state_file);
+	ck_assert (g_hash_table_size (found) == 3);
+	ck_assert (g_hash_table_contains (found, a));
+	ck_assert (g_hash_table_contains (found, b));
+	ck_assert (g_hash_table_contains (found, c));
+	g_hash_table_destroy (found);
+
+	/* and one that isn't a crawl state at all is ignored */
+	ck_assert (g_file_set_contents (state_file, "not a crawl state", -1, NULL));
+	set_mtime (dir, 1000);
+	found = crawl (dir, state_file);
+	ck_assert (g_hash_table_size (found) == 3);
+	check_found (found, a, TRUE);
+	check_found (found, b, TRUE);
+	check_found (found, c, TRUE);
+	g_hash_table_destroy (found);
+
+	g_unlink (state_file);
+	g_unlink (a);
+	g_unlink (b);
+	g_unlink (c);
+	g_rmdir (sub);
+	g_rmdir (dir);
+	g_free (state_file);
+	g_free (a);
+	g_free (b);
+	g_free (c);
+	g_free (sub);
+	g_free (dir);
+}
+END_TEST
+
+static Suite *
+rhythmdb_crawler_suite (void)
+{
+	Suite *s = suite_create ("rhythmdb-crawler");
+	TCase *tc_chain = tcase_create ("rhythmdb-crawler-core");
+
+	suite_add_tcase (s, tc_chain);
+
+	tcase_add_test (tc_chain, test_crawler_state);
+
+	return s;
+}
+
+int
+main (int argc, char **argv)
+{
+	int ret;
+	SRunner *sr;
+	Suite *s;
+
+	rb_profile_start ("rhythmdb-crawler test suite");
+	rb_threads_init ();
+	rb_debug_init (TRUE);
+	rb_file_helpers_init ();
+
+	/* setup tests */
+	s = rhythmdb_crawler_suite ();
+	sr = srunner_create (s);
+	srunner_run_all (sr, CK_NORMAL);
+	ret = srunner_ntests_failed (sr);
+	srunner_free (sr);
+
+	rb_file_helpers_shutdown ();
+
+	rb_profile_end ("rhythmdb-crawler test suite");
+	return ret;
+}
@@ -31,6 +31,7 @@
 #include <gtk/gtk.h>
 #include <string.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 
 #include "test-utils.h"
 
@@ -41,6 +42,9 @@
 #include "rhythmdb.h"
 #include "rhythmdb-tree.h"
 #include "rhythmdb-query-model.h"
+#include "rhythmdb-metadata-cache.h"
+#include "rhythmdb-dir-manifest.h"
+#include "rhythmdb-private.h"
 #include "rb-podcast-entry-types.h"
 
 static void
@@ -52,6 +56,49 @@ set_true (RhythmDBEntry *entry, gboolean *b)
 
 
 /* tests */
+START_TEST (test_refstring)
+{
+	RBRefString *a, *b, *c;
+	RBRefStringStats stats;
+	char *large;
+	guint strings;
+
+	rb_refstring_get_stats (&stats);
+	strings = stats.strings;
+
+	a = rb_refstring_new ("Some Artist");
+	b = rb_refstring_new ("Some Artist");
+	ck_assert_msg (a == b, "equal strings not interned to the same refstring");
+	ck_assert_msg (strcmp (rb_refstring_get (a), "Some Artist") == 0, "refstring value incorrect");
+	ck_assert_msg (strcmp (rb_refstring_get_folded (a), "some artist") == 0, "folded value incorrect");
+	ck_assert_msg (rb_refstring_get_sort_key (a) != NULL, "no sort key");
+	rb_refstring_unref (b);
+
+	b = rb_refstring_find ("Some Artist");
+	ck_assert_msg (a == b, "refstring not found");
+	rb_refstring_unref (b);
+	ck_assert_msg (rb_refstring_find ("Some Other Artist") == NULL, "found nonexistent refstring");
+
+	/* strings too large for the slabs */
+	large = g_strnfill (2000, 'X');
+	c = rb_refstring_new (large);
+	ck_assert_msg (strcmp (rb_refstring_get (c), large) == 0, "large refstring value incorrect");
+	ck_assert_msg (strlen (rb_refstring_get_folded (c)) == 2000, "large folded value incorrect");
+
+	rb_refstring_get_stats (&stats);
+	ck_assert_msg (stats.strings == strings + 2, "wrong number of refstrings");
+
+	rb_refstring_unref (a);
+	rb_refstring_unref (c);
+	ck_assert_msg (rb_refstring_find ("Some Artist") == NULL, "refstring not freed");
+	ck_assert_msg (rb_refstring_find (large) == NULL, "large refstring not freed");
+	g_free (large);
+
+	rb_refstring_get_stats (&stats);
+	ck_assert_msg (stats.strings == strings, "wrong number of refstrings after freeing");
+}
+END_TEST
+
 START_TEST (test_rhythmdb_indexing)
 {
 	RhythmDBEntry *entry = NULL;
@@ -403,6 +450,633 @@ START_TEST (test_rhythmdb_deserialisation3)
 END_TEST
 
 
+START_TEST (test_rhythmdb_snapshot)
+{
+	RhythmDBEntry *entry;
+	RBRefString *keyword;
+	char *dir;
+	char *name;
+	char *snapshot;
+
+	dir = g_dir_make_tmp ("rb-test-snapshot-XXXXXX", NULL);
+	ck_assert_msg (dir != NULL, "failed to create temporary directory");
+	name = g_build_filename (dir, "rhythmdb.xml", NULL);
+	snapshot = g_build_filename (dir, "rhythmdb.snapshot", NULL);
+	g_object_set (G_OBJECT (db), "name", name, NULL);
+
+	entry = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_IGNORE, "file:///snapshot.ogg");
+	ck_assert_msg (entry != NULL, "failed to create entry");
+	set_entry_string (db, entry, RHYTHMDB_PROP_TITLE, "Sin");
+	set_entry_string (db, entry, RHYTHMDB_PROP_ARTIST, "Nine Inch Nails");
+	set_entry_string (db, entry, RHYTHMDB_PROP_ALBUM, "Pretty Hate Machine");
+	set_entry_ulong (db, entry, RHYTHMDB_PROP_TRACK_NUMBER, 3);
+	set_entry_ulong (db, entry, RHYTHMDB_PROP_DATE, 726468);
+	set_entry_double (db, entry, RHYTHMDB_PROP_TRACK_GAIN, -3.5);
+	set_entry_double (db, entry, RHYTHMDB_PROP_TRACK_PEAK, 0.75);
+	set_entry_double (db, entry, RHYTHMDB_PROP_ALBUM_GAIN, -4.25);
+	set_entry_double (db, entry, RHYTHMDB_PROP_ALBUM_PEAK, 0.875);
+	set_entry_hidden (db, entry, TRUE);
+
+	keyword = rb_refstring_new ("industrial");
+	rhythmdb_entry_keyword_add (db, entry, keyword);
+	rhythmdb_commit (db);
+
+	rhythmdb_save (db);
+	ck_assert_msg (g_file_test (snapshot, G_FILE_TEST_EXISTS), "snapshot not written");
+
+	rhythmdb_entry_delete_by_type (db, RHYTHMDB_ENTRY_TYPE_IGNORE);
+	rhythmdb_commit (db);
+	ck_assert_msg (rhythmdb_entry_lookup_by_location (db, "file:///snapshot.ogg") == NULL, "entry not deleted");
+
+	set_waiting_signal (G_OBJECT (db), "load-complete");
+	rhythmdb_load (db);
+	wait_for_signal ();
+
+	entry = rhythmdb_entry_lookup_by_location (db, "file:///snapshot.ogg");
+	ck_assert_msg (entry != NULL, "entry not loaded from snapshot");
+	ck_assert_msg (strcmp (rhythmdb_entry_get_string (entry, RHYTHMDB_PROP_TITLE), "Sin") == 0,
+		       "TITLE loaded incorrectly");
+	ck_assert_msg (strcmp (rhythmdb_entry_get_string (entry, RHYTHMDB_PROP_ARTIST), "Nine Inch Nails") == 0,
+		       "ARTIST loaded incorrectly");
+	ck_assert_msg (strcmp (rhythmdb_entry_get_string (entry, RHYTHMDB_PROP_ALBUM), "Pretty Hate Machine") == 0,
+		       "ALBUM loaded incorrectly");
+	ck_assert_msg (rhythmdb_entry_get_ulong (entry, RHYTHMDB_PROP_TRACK_NUMBER) == 3,
+		       "TRACK_NUMBER loaded incorrectly");
+	ck_assert_msg (rhythmdb_entry_get_ulong (entry, RHYTHMDB_PROP_DATE) == 726468,
+		       "DATE loaded incorrectly");
+	ck_assert_msg (rhythmdb_entry_get_double (entry, RHYTHMDB_PROP_TRACK_GAIN) == -3.5,
+		       "TRACK_GAIN loaded incorrectly");
+	ck_assert_msg (rhythmdb_entry_get_double (entry, RHYTHMDB_PROP_TRACK_PEAK) == 0.75,
+		       "TRACK_PEAK loaded incorrectly");
+	ck_assert_msg (rhythmdb_entry_get_double (entry, RHYTHMDB_PROP_ALBUM_GAIN) == -4.25,
+		       "ALBUM_GAIN loaded incorrectly");
+	ck_assert_msg (rhythmdb_entry_get_double (entry, RHYTHMDB_PROP_ALBUM_PEAK) == 0.875,
+		       "ALBUM_PEAK loaded incorrectly");
+	ck_assert_msg (rhythmdb_entry_get_boolean (entry, RHYTHMDB_PROP_HIDDEN),
+		       "HIDDEN loaded incorrectly");
+	ck_assert_msg (rhythmdb_entry_keyword_has (db, entry, keyword), "keyword not loaded");
+
+	rb_refstring_unref (keyword);
+	g_unlink (name);
+	g_unlink (snapshot);
+	g_rmdir (dir);
+	g_free (snapshot);
+	g_free (name);
+	g_free (dir);
+}
+END_TEST
+
+static void
+load_progress_cb (RhythmDB *db, guint count, guint *loaded)
+{
+	ck_assert_msg (count >= *loaded, "load progress went backwards");
+	*loaded = count;
+}
+
+START_TEST (test_rhythmdb_progressive_load)
+{
+	RhythmDBEntry *entry;
+	char *dir;
+	char *name;
+	char *uri;
+	guint loaded = 0;
+	int i;
+
+	dir = g_dir_make_tmp ("rb-test-progressive-XXXXXX", NULL);
+	ck_assert_msg (dir != NULL, "failed to create temporary directory");
+	name = g_build_filename (dir, "rhythmdb.xml", NULL);
+	g_object_set (G_OBJECT (db), "name", name, "progressive-load", TRUE, NULL);
+
+	/* enough entries to be loaded in several batches */
+	for (i = 0; i < RHYTHMDB_QUERY_MODEL_SUGGESTED_UPDATE_CHUNK * 2 + 1; i++) {
+		uri = g_strdup_printf ("file:///progressive-%d.ogg", i);
+		entry = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_IGNORE, uri);
+		set_entry_ulong (db, entry, RHYTHMDB_PROP_TRACK_NUMBER, i);
+		g_free (uri);
+	}
+	rhythmdb_commit (db);
+	rhythmdb_save (db);
+
+	rhythmdb_entry_delete_by_type (db, RHYTHMDB_ENTRY_TYPE_IGNORE);
+	rhythmdb_commit (db);
+
+	g_signal_connect (G_OBJECT (db), "load-progress", G_CALLBACK (load_progress_cb), &loaded);
+	set_waiting_signal (G_OBJECT (db), "load-complete");
+	rhythmdb_load (db);
+	wait_for_signal ();
+
+	ck_assert_msg (loaded == RHYTHMDB_QUERY_MODEL_SUGGESTED_UPDATE_CHUNK * 2 + 1,
+		       "load progress reported %u entries", loaded);
+	ck_assert_msg (rhythmdb_entry_lookup_by_location (db, "file:///progressive-0.ogg") != NULL,
+		       "entry not loaded");
+
+	g_unlink (name);
+	uri = g_build_filename (dir, "rhythmdb.snapshot", NULL);
+	g_unlink (uri);
+	g_free (uri);
+	g_rmdir (dir);
+	g_free (name);
+	g_free (dir);
+}
+END_TEST
+
+START_TEST (test_rhythmdb_journal)
+{
+	RhythmDBEntry *entry;
+	RBRefString *keyword;
+	char *dir;
+	char *name;
+	char *snapshot;
+	char *journal;
+
+	dir = g_dir_make_tmp ("rb-test-journal-XXXXXX", NULL);
+	ck_assert_msg (dir != NULL, "failed to create temporary directory");
+	name = g_build_filename (dir, "rhythmdb.xml", NULL);
+	snapshot = g_build_filename (dir, "rhythmdb.snapshot", NULL);
+	journal = g_build_filename (dir, "rhythmdb.journal", NULL);
+	g_object_set (G_OBJECT (db), "name", name, "journal", TRUE, NULL);
+
+	set_waiting_signal (G_OBJECT (db), "load-complete");
+	rhythmdb_load (db);
+	wait_for_signal ();
+
+	/* an added entry, later changed */
+	entry = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_IGNORE, "file:///journal.ogg");
+	ck_assert_msg (entry != NULL, "failed to create entry");
+	set_entry_string (db, entry, RHYTHMDB_PROP_TITLE, "Head Like a Hole");
+	rhythmdb_commit (db);
+
+	set_entry_ulong (db, entry, RHYTHMDB_PROP_PLAY_COUNT, 5);
+	set_entry_double (db, entry, RHYTHMDB_PROP_TRACK_GAIN, -3.5);
+	set_entry_double (db, entry, RHYTHMDB_PROP_TRACK_PEAK, 0.75);
+	set_entry_double (db, entry, RHYTHMDB_PROP_ALBUM_GAIN, -4.25);
+	set_entry_double (db, entry, RHYTHMDB_PROP_ALBUM_PEAK, 0.875);
+	keyword = rb_refstring_new ("industrial");
+	rhythmdb_entry_keyword_add (db, entry, keyword);
+	rhythmdb_commit (db);
+
+	/* an added entry, later deleted */
+	entry = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_IGNORE, "file:///deleted.ogg");
+	ck_assert_msg (entry != NULL, "failed to create entry");
+	rhythmdb_commit (db);
+	rhythmdb_entry_delete (db, entry);
+	rhythmdb_commit (db);
+
+	/* shutting down writes the journal without saving the database */
+	test_rhythmdb_shutdown ();
+	ck_assert_msg (g_file_test (journal, G_FILE_TEST_EXISTS), "journal not written");
+	ck_assert_msg (g_file_test (name, G_FILE_TEST_EXISTS) == FALSE, "database saved");
+
+	test_rhythmdb_setup ();
+	g_object_set (G_OBJECT (db), "name", name, "journal", TRUE, NULL);
+	set_waiting_signal (G_OBJECT (db), "load-complete");
+	rhythmdb_load (db);
+	wait_for_signal ();
+
+	entry = rhythmdb_entry_lookup_by_location (db, "file:///journal.ogg");
+	ck_assert_msg (entry != NULL, "entry not replayed from journal");
+	ck_assert_msg (strcmp (rhythmdb_entry_get_string (entry, RHYTHMDB_PROP_TITLE), "Head Like a Hole") == 0,
+		       "TITLE replayed incorrectly");
+	ck_assert_msg (rhythmdb_entry_get_ulong (entry, RHYTHMDB_PROP_PLAY_COUNT) == 5,
+		       "PLAY_COUNT replayed incorrectly");
+	ck_assert_msg (rhythmdb_entry_get_double (entry, RHYTHMDB_PROP_TRACK_GAIN) == -3.5,
+		       "TRACK_GAIN replayed incorrectly");
+	ck_assert_msg (rhythmdb_entry_get_double (entry, RHYTHMDB_PROP_TRACK_PEAK) == 0.75,
+		       "TRACK_PEAK replayed incorrectly");
+	ck_assert_msg (rhythmdb_entry_get_double (entry, RHYTHMDB_PROP_ALBUM_GAIN) == -4.25,
+		       "ALBUM_GAIN replayed incorrectly");
+	ck_assert_msg (rhythmdb_entry_get_double (entry, RHYTHMDB_PROP_ALBUM_PEAK) == 0.875,
+		       "ALBUM_PEAK replayed incorrectly");
+	ck_assert_msg (rhythmdb_entry_keyword_has (db, entry, keyword), "keyword not replayed");
+	ck_assert_msg (rhythmdb_entry_lookup_by_location (db, "file:///deleted.ogg") == NULL,
+		       "deletion not replayed");
+
+	/* a full save compacts the journal away */
+	rhythmdb_save (db);
+	ck_assert_msg (g_file_test (name, G_FILE_TEST_EXISTS), "database not saved");
+	ck_assert_msg (g_file_test (journal, G_FILE_TEST_EXISTS) == FALSE, "journal not compacted");
+
+	rb_refstring_unref (keyword);
+	g_unlink (name);
+	g_unlink (snapshot);
+	g_unlink (journal);
+	g_rmdir (dir);
+	g_free (journal);
+	g_free (snapshot);
+	g_free (name);
+	g_free (dir);
+}
+END_TEST
+
+static int
+count_search_matches (const char *text)
+{
+	RhythmDBQueryModel *model;
+	GPtrArray *query;
+	int count;
+
+	query = rhythmdb_query_parse (db,
+				      RHYTHMDB_QUERY_PROP_EQUALS, RHYTHMDB_PROP_TYPE, RHYTHMDB_ENTRY_TYPE_IGNORE,
+				      RHYTHMDB_QUERY_PROP_LIKE, RHYTHMDB_PROP_SEARCH_MATCH, text,
+				      RHYTHMDB_QUERY_END);
+	model = rhythmdb_query_model_new_empty (db);
+	g_object_set (G_OBJECT (model), "show-hidden", TRUE, NULL);
+	rhythmdb_do_full_query_parsed (db, RHYTHMDB_QUERY_RESULTS (model), query);
+
+	count = gtk_tree_model_iter_n_children (GTK_TREE_MODEL (model), NULL);
+	g_object_unref (model);
+	rhythmdb_query_free (query);
+	return count;
+}
+
+START_TEST (test_rhythmdb_search_index)
+{
+	RhythmDBEntry *entry;
+	RhythmDBEntry *deleted;
+	gboolean use_index;
+
+	deleted = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_IGNORE, "file:///hole.ogg");
+	set_entry_string (db, deleted, RHYTHMDB_PROP_TITLE, "Head Like a Hole");
+	set_entry_string (db, deleted, RHYTHMDB_PROP_ARTIST, "Nine Inch Nails");
+
+	entry = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_IGNORE, "file:///sky.ogg");
+	set_entry_string (db, entry, RHYTHMDB_PROP_TITLE, "Hole in the Sky");
+	set_entry_string (db, entry, RHYTHMDB_PROP_ARTIST, "Black Sabbath");
+
+	entry = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_IGNORE, "file:///holiday.ogg");
+	set_entry_string (db, entry, RHYTHMDB_PROP_TITLE, "Holiday");
+	set_entry_string (db, entry, RHYTHMDB_PROP_ARTIST, "Green Day");
+	rhythmdb_commit (db);
+
+	/* results must be the same whether or not the index is used */
+	for (use_index = FALSE; use_index <= TRUE; use_index++) {
+		g_object_set (G_OBJECT (db), "search-index", use_index, NULL);
+		ck_assert_msg (count_search_matches ("ho") == 3, "wrong number of matches for \"ho\"");
+		ck_assert_msg (count_search_matches ("hole") == 2, "wrong number of matches for \"hole\"");
+		ck_assert_msg (count_search_matches ("HOLE nine") == 1, "wrong number of matches for \"HOLE nine\"");
+		ck_assert_msg (count_search_matches ("day hol") == 1, "wrong number of matches for \"day hol\"");
+		ck_assert_msg (count_search_matches ("zzz") == 0, "wrong number of matches for \"zzz\"");
+	}
+
+	/* changes and deletions update the index */
+	set_entry_string (db, entry, RHYTHMDB_PROP_TITLE, "Boulevard");
+	rhythmdb_entry_delete (db, deleted);
+	rhythmdb_commit (db);
+
+	ck_assert_msg (count_search_matches ("hol") == 1, "wrong number of matches for \"hol\"");
+	ck_assert_msg (count_search_matches ("boulevard green") == 1, "wrong number of matches for \"boulevard green\"");
+	ck_assert_msg (count_search_matches ("nails") == 0, "wrong number of matches for \"nails\"");
+}
+END_TEST
+
+static void
+count_evaluated_match (RhythmDBEntry *entry, GPtrArray *query)
+{
+	int *count = g_object_get_data (G_OBJECT (db), "test-match-count");
+
+	if (rhythmdb_evaluate_query (db, query, entry))
+		(*count)++;
+}
+
+/* checks that running the query (which compiles it) gives the same results
+ * as evaluating it against each entry */
+static void
+check_query_plan (GPtrArray *query, int expected)
+{
+	RhythmDBQueryModel *model;
+	GPtrArray *processed;
+	int count = 0;
+
+	model = rhythmdb_query_model_new_empty (db);
+	g_object_set (G_OBJECT (model), "show-hidden", TRUE, NULL);
+	rhythmdb_do_full_query_parsed (db, RHYTHMDB_QUERY_RESULTS (model), query);
+	ck_assert_msg (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (model), NULL) == expected,
+		       "wrong number of query results");
+	g_object_unref (model);
+
+	processed = rhythmdb_query_copy (query);
+	rhythmdb_query_preprocess (db, processed);
+	g_object_set_data (G_OBJECT (db), "test-match-count", &count);
+	rhythmdb_entry_foreach (db, (RhythmDBEntryForeachFunc) count_evaluated_match, processed);
+	g_object_set_data (G_OBJECT (db), "test-match-count", NULL);
+	ck_assert_msg (count == expected, "wrong number of entries matched by query evaluation");
+
+	rhythmdb_query_free (processed);
+	rhythmdb_query_free (query);
+}
+
+START_TEST (test_rhythmdb_query_plan)
+{
+	RhythmDBEntry *entry;
+	GPtrArray *subquery;
+
+	entry = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_IGNORE, "file:///hole.ogg");
+	set_entry_string (db, entry, RHYTHMDB_PROP_TITLE, "Head Like a Hole");
+	set_entry_string (db, entry, RHYTHMDB_PROP_ARTIST, "Nine Inch Nails");
+	set_entry_string (db, entry, RHYTHMDB_PROP_GENRE, "Industrial");
+	set_entry_ulong (db, entry, RHYTHMDB_PROP_PLAY_COUNT, 10);
+	set_entry_ulong (db, entry, RHYTHMDB_PROP_DURATION, 300);
+
+	entry = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_IGNORE, "file:///sky.ogg");
+	set_entry_string (db, entry, RHYTHMDB_PROP_TITLE, "Hole in the Sky");
+	set_entry_string (db, entry, RHYTHMDB_PROP_ARTIST, "Black Sabbath");
+	set_entry_string (db, entry, RHYTHMDB_PROP_GENRE, "Metal");
+	set_entry_ulong (db, entry, RHYTHMDB_PROP_PLAY_COUNT, 2);
+	set_entry_ulong (db, entry, RHYTHMDB_PROP_DURATION, 240);
+
+	entry = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_IGNORE, "file:///holiday.ogg");
+	set_entry_string (db, entry, RHYTHMDB_PROP_TITLE, "Holiday");
+	set_entry_string (db, entry, RHYTHMDB_PROP_ARTIST, "Green Day");
+	set_entry_string (db, entry, RHYTHMDB_PROP_GENRE, "Punk");
+	set_entry_ulong (db, entry, RHYTHMDB_PROP_DURATION, 180);
+	set_entry_hidden (db, entry, TRUE);
+	rhythmdb_commit (db);
+
+	check_query_plan (rhythmdb_query_parse (db,
+						RHYTHMDB_QUERY_PROP_EQUALS, RHYTHMDB_PROP_ARTIST, "Nine Inch Nails",
+						RHYTHMDB_QUERY_END),
+			  1);
+	check_query_plan (rhythmdb_query_parse (db,
+						RHYTHMDB_QUERY_PROP_EQUALS, RHYTHMDB_PROP_TYPE, RHYTHMDB_ENTRY_TYPE_IGNORE,
+						RHYTHMDB_QUERY_PROP_NOT_EQUAL, RHYTHMDB_PROP_ARTIST, "Black Sabbath",
+						RHYTHMDB_QUERY_PROP_PREFIX, RHYTHMDB_PROP_TITLE, "H",
+						RHYTHMDB_QUERY_END),
+			  2);
+	check_query_plan (rhythmdb_query_parse (db,
+						RHYTHMDB_QUERY_PROP_GREATER, RHYTHMDB_PROP_PLAY_COUNT, (gulong) 2,
+						RHYTHMDB_QUERY_END),
+			  2);
+	check_query_plan (rhythmdb_query_parse (db,
+						RHYTHMDB_QUERY_PROP_LIKE, RHYTHMDB_PROP_TITLE_FOLDED, "sky",
+						RHYTHMDB_QUERY_DISJUNCTION,
+						RHYTHMDB_QUERY_PROP_LESS, RHYTHMDB_PROP_DURATION, (gulong) 200,
+						RHYTHMDB_QUERY_END),
+			  2);
+	check_query_plan (rhythmdb_query_parse (db,
+						RHYTHMDB_QUERY_PROP_EQUALS, RHYTHMDB_PROP_HIDDEN, FALSE,
+						RHYTHMDB_QUERY_PROP_NOT_LIKE, RHYTHMDB_PROP_SEARCH_MATCH, "nails",
+						RHYTHMDB_QUERY_END),
+			  1);
+	check_query_plan (rhythmdb_query_parse (db,
+						RHYTHMDB_QUERY_PROP_EQUALS, RHYTHMDB_PROP_GENRE, "Nonexistent Genre",
+						RHYTHMDB_QUERY_END),
+			  0);
+
+	subquery = rhythmdb_query_parse (db,
+					 RHYTHMDB_QUERY_PROP_EQUALS, RHYTHMDB_PROP_GENRE, "Metal",
+					 RHYTHMDB_QUERY_DISJUNCTION,
+					 RHYTHMDB_QUERY_PROP_EQUALS, RHYTHMDB_PROP_GENRE, "Punk",
+					 RHYTHMDB_QUERY_END);
+	check_query_plan (rhythmdb_query_parse (db,
+						RHYTHMDB_QUERY_SUBQUERY, subquery,
+						RHYTHMDB_QUERY_PROP_SUFFIX, RHYTHMDB_PROP_TITLE, "Sky",
+						RHYTHMDB_QUERY_END),
+			  1);
+	rhythmdb_query_free (subquery);
+}
+END_TEST
+
+static RhythmDBQueryModel *
+run_parallel_query (guint threads, gboolean with_type)
+{
+	RhythmDBQueryModel *model;
+	GPtrArray *query;
+
+	g_object_set (G_OBJECT (db), "query-threads", threads, "numeric-index", FALSE, NULL);
+	if (with_type) {
+		query = rhythmdb_query_parse (db,
+					      RHYTHMDB_QUERY_PROP_EQUALS, RHYTHMDB_PROP_TYPE, RHYTHMDB_ENTRY_TYPE_IGNORE,
+					      RHYTHMDB_QUERY_PROP_GREATER, RHYTHMDB_PROP_PLAY_COUNT, (gulong) 5,
+					      RHYTHMDB_QUERY_END);
+	} else {
+		query = rhythmdb_query_parse (db,
+					      RHYTHMDB_QUERY_PROP_GREATER, RHYTHMDB_PROP_PLAY_COUNT, (gulong) 5,
+					      RHYTHMDB_QUERY_END);
+	}
+
+	model = rhythmdb_query_model_new_empty (db);
+	g_object_set (G_OBJECT (model), "show-hidden", TRUE, NULL);
+	rhythmdb_do_full_query_parsed (db, RHYTHMDB_QUERY_RESULTS (model), query);
+	rhythmdb_query_free (query);
+	return model;
+}
+
+START_TEST (test_rhythmdb_parallel_query)
+{
+	RhythmDBQueryModel *serial;
+	RhythmDBQueryModel *parallel;
+	GtkTreeIter iter;
+	gboolean with_type;
+	int i;
+
+	/* enough entries that the query is split up */
+	for (i = 0; i < 5000; i++) {
+		RhythmDBEntry *entry;
+		char *str;
+
+		str = g_strdup_printf ("file:///parallel/%d.ogg", i);
+		entry = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_IGNORE, str);
+		g_free (str);
+
+		str = g_strdup_printf ("Album %d", i / 10);
+		set_entry_string (db, entry, RHYTHMDB_PROP_ALBUM, str);
+		g_free (str);
+		set_entry_ulong (db, entry, RHYTHMDB_PROP_PLAY_COUNT, i % 10);
+	}
+	rhythmdb_commit (db);
+
+	for (with_type = FALSE; with_type <= TRUE; with_type++) {
+		serial = run_parallel_query (1, with_type);
+		parallel = run_parallel_query (4, with_type);
+
+		ck_assert_msg (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (serial), NULL) == 2500,
+			       "wrong number of serial query results");
+		ck_assert_msg (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (parallel), NULL) == 2500,
+			       "wrong number of parallel query results");
+
+		if (gtk_tree_model_get_iter_first (GTK_TREE_MODEL (serial), &iter)) {
+			do {
+				RhythmDBEntry *entry;
+				GtkTreeIter piter;
+
+				entry = rhythmdb_query_model_iter_to_entry (serial, &iter);
+				ck_assert_msg (rhythmdb_query_model_entry_to_iter (parallel, entry, &piter),
+					       "entry missing from parallel query results");
+				rhythmdb_entry_unref (entry);
+			} while (gtk_tree_model_iter_next (GTK_TREE_MODEL (serial), &iter));
+		}
+
+		g_object_unref (serial);
+		g_object_unref (parallel);
+	}
+}
+END_TEST
+
+START_TEST (test_rhythmdb_entry_extra)
+{
+	RhythmDBEntry *a;
+	RhythmDBEntry *b;
+
+	a = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_IGNORE, "file:///extra/a.ogg");
+	b = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_IGNORE, "file:///extra/b.ogg");
+	rhythmdb_commit (db);
+
+	/* rarely used fields start out empty and can be set independently */
+	ck_assert_msg (strcmp (rhythmdb_entry_get_string (a, RHYTHMDB_PROP_COMPOSER), "") == 0,
+		       "composer not empty");
+	set_entry_string (db, a, RHYTHMDB_PROP_COMPOSER, "Composer");
+	set_entry_string (db, a, RHYTHMDB_PROP_MUSICBRAINZ_TRACKID, "1234");
+	rhythmdb_commit (db);
+
+	ck_assert_msg (strcmp (rhythmdb_entry_get_string (a, RHYTHMDB_PROP_COMPOSER), "Composer") == 0,
+		       "composer not set");
+	ck_assert_msg (strcmp (rhythmdb_entry_get_string (a, RHYTHMDB_PROP_MUSICBRAINZ_TRACKID), "1234") == 0,
+		       "musicbrainz track id not set");
+	ck_assert_msg (strcmp (rhythmdb_entry_get_string (b, RHYTHMDB_PROP_COMPOSER), "") == 0,
+		       "composer set on the wrong entry");
+	ck_assert_msg (strcmp (rhythmdb_entry_get_string (b, RHYTHMDB_PROP_MUSICBRAINZ_TRACKID), "") == 0,
+		       "musicbrainz track id set on the wrong entry");
+
+	/* track numbers are stored in 16 bits */
+	set_entry_ulong (db, b, RHYTHMDB_PROP_TRACK_NUMBER, 12);
+	set_entry_ulong (db, b, RHYTHMDB_PROP_DISC_NUMBER, 100000);
+	rhythmdb_commit (db);
+	ck_assert_msg (rhythmdb_entry_get_ulong (b, RHYTHMDB_PROP_TRACK_NUMBER) == 12, "wrong track number");
+	ck_assert_msg (rhythmdb_entry_get_ulong (b, RHYTHMDB_PROP_DISC_NUMBER) == G_MAXUINT16, "disc number not clamped");
+
+	/* date strings are only formatted when asked for */
+	ck_assert_msg (rhythmdb_entry_get_string (b, RHYTHMDB_PROP_LAST_PLAYED_STR) != NULL,
+		       "last played string missing");
+}
+END_TEST
+
+static int
+count_numeric_matches (gboolean use_index, RhythmDBQueryType type, RhythmDBPropType propid, gulong value)
+{
+	RhythmDBQueryModel *model;
+	GPtrArray *query;
+	int count;
+
+	g_object_set (G_OBJECT (db), "numeric-index", use_index, NULL);
+	query = rhythmdb_query_parse (db,
+				      RHYTHMDB_QUERY_PROP_EQUALS, RHYTHMDB_PROP_TYPE, RHYTHMDB_ENTRY_TYPE_IGNORE,
+				      type, propid, value,
+				      RHYTHMDB_QUERY_END);
+	model = rhythmdb_query_model_new_empty (db);
+	g_object_set (G_OBJECT (model), "show-hidden", TRUE, NULL);
+	rhythmdb_do_full_query_parsed (db, RHYTHMDB_QUERY_RESULTS (model), query);
+
+	count = gtk_tree_model_iter_n_children (GTK_TREE_MODEL (model), NULL);
+	g_object_unref (model);
+	rhythmdb_query_free (query);
+	return count;
+}
+
+static void
+check_numeric_query (RhythmDBQueryType type, RhythmDBPropType propid, gulong value, int expected)
+{
+	ck_assert_msg (count_numeric_matches (FALSE, type, propid, value) == expected,
+		       "wrong number of results without numeric index");
+	ck_assert_msg (count_numeric_matches (TRUE, type, propid, value) == expected,
+		       "wrong number of results with numeric index");
+}
+
+START_TEST (test_rhythmdb_numeric_index)
+{
+	RhythmDBEntry *entries[100];
+	GTimeVal now;
+	int i;
+
+	g_get_current_time (&now);
+	for (i = 0; i < G_N_ELEMENTS (entries); i++) {
+		char *uri;
+
+		uri = g_strdup_printf ("file:///numeric/%d.ogg", i);
+		entries[i] = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_IGNORE, uri);
+		g_free (uri);
+
+		set_entry_ulong (db, entries[i], RHYTHMDB_PROP_PLAY_COUNT, i);
+		set_entry_ulong (db, entries[i], RHYTHMDB_PROP_DURATION, 100 + (i % 10));
+		/* every tenth entry was played in the last hour */
+		if (i % 10 == 0)
+			set_entry_ulong (db, entries[i], RHYTHMDB_PROP_LAST_PLAYED, now.tv_sec - 60);
+		else
+			set_entry_ulong (db, entries[i], RHYTHMDB_PROP_LAST_PLAYED, now.tv_sec - 86400);
+	}
+	rhythmdb_commit (db);
+
+	check_numeric_query (RHYTHMDB_QUERY_PROP_GREATER, RHYTHMDB_PROP_PLAY_COUNT, 90, 10);
+	check_numeric_query (RHYTHMDB_QUERY_PROP_LESS, RHYTHMDB_PROP_PLAY_COUNT, 9, 10);
+	check_numeric_query (RHYTHMDB_QUERY_PROP_EQUALS, RHYTHMDB_PROP_PLAY_COUNT, 42, 1);
+	check_numeric_query (RHYTHMDB_QUERY_PROP_EQUALS, RHYTHMDB_PROP_DURATION, 105, 10);
+	check_numeric_query (RHYTHMDB_QUERY_PROP_CURRENT_TIME_WITHIN, RHYTHMDB_PROP_LAST_PLAYED, 3600, 10);
+	check_numeric_query (RHYTHMDB_QUERY_PROP_CURRENT_TIME_NOT_WITHIN, RHYTHMDB_PROP_LAST_PLAYED, 3600, 90);
+
+	/* changes and deletions must be reflected in the index */
+	set_entry_ulong (db, entries[0], RHYTHMDB_PROP_PLAY_COUNT, 1000);
+	rhythmdb_entry_delete (db, entries[99]);
+	rhythmdb_commit (db);
+
+	check_numeric_query (RHYTHMDB_QUERY_PROP_GREATER, RHYTHMDB_PROP_PLAY_COUNT, 90, 10);
+	check_numeric_query (RHYTHMDB_QUERY_PROP_LESS, RHYTHMDB_PROP_PLAY_COUNT, 9, 9);
+	check_numeric_query (RHYTHMDB_QUERY_PROP_EQUALS, RHYTHMDB_PROP_PLAY_COUNT, 1000, 1);
+	check_numeric_query (RHYTHMDB_QUERY_PROP_CURRENT_TIME_NOT_WITHIN, RHYTHMDB_PROP_LAST_PLAYED, 3600, 89);
+
+	/* entries added, changed and deleted again between queries */
+	for (i = 0; i < 10; i++) {
+		char *uri;
+
+		uri = g_strdup_printf ("file:///numeric/new-%d.ogg", i);
+		entries[i] = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_IGNORE, uri);
+		g_free (uri);
+		set_entry_ulong (db, entries[i], RHYTHMDB_PROP_PLAY_COUNT, 500 + i);
+	}
+	rhythmdb_commit (db);
+	set_entry_ulong (db, entries[0], RHYTHMDB_PROP_PLAY_COUNT, 2000);
+	set_entry_ulong (db, entries[1], RHYTHMDB_PROP_PLAY_COUNT, 42);
+	rhythmdb_entry_delete (db, entries[2]);
+	rhythmdb_entry_delete (db, entries[9]);
+	rhythmdb_entry_delete (db, entries[50]);
+	rhythmdb_commit (db);
+
+	check_numeric_query (RHYTHMDB_QUERY_PROP_GREATER, RHYTHMDB_PROP_PLAY_COUNT, 500, 8);
+	check_numeric_query (RHYTHMDB_QUERY_PROP_EQUALS, RHYTHMDB_PROP_PLAY_COUNT, 2000, 1);
+	check_numeric_query (RHYTHMDB_QUERY_PROP_EQUALS, RHYTHMDB_PROP_PLAY_COUNT, 42, 2);
+	check_numeric_query (RHYTHMDB_QUERY_PROP_EQUALS, RHYTHMDB_PROP_PLAY_COUNT, 50, 0);
+	check_numeric_query (RHYTHMDB_QUERY_PROP_LESS, RHYTHMDB_PROP_PLAY_COUNT, 99, 98);
+}
+END_TEST
+
+START_TEST (test_rhythmdb_numeric_index_duplicate)
+{
+	RhythmDBEntry *entry;
+
+	/* entries with duplicate locations are merged while loading */
+	g_object_set (G_OBJECT (db), "name", TEST_DIR "/duplicate-location.xml", NULL);
+	set_waiting_signal (G_OBJECT (db), "load-complete");
+	rhythmdb_load (db);
+	wait_for_signal ();
+
+	entry = rhythmdb_entry_lookup_by_location (db, "file:///duplicate/track.ogg");
+	ck_assert_msg (entry != NULL, "merged entry missing");
+	ck_assert_msg (rhythmdb_entry_get_ulong (entry, RHYTHMDB_PROP_PLAY_COUNT) == 7, "play counts not merged");
+
+	check_numeric_query (RHYTHMDB_QUERY_PROP_EQUALS, RHYTHMDB_PROP_PLAY_COUNT, 7, 1);
+	check_numeric_query (RHYTHMDB_QUERY_PROP_EQUALS, RHYTHMDB_PROP_PLAY_COUNT, 3, 0);
+	check_numeric_query (RHYTHMDB_QUERY_PROP_GREATER, RHYTHMDB_PROP_PLAY_COUNT, 6, 1);
+	check_numeric_query (RHYTHMDB_QUERY_PROP_LESS, RHYTHMDB_PROP_PLAY_COUNT, 6, 1);
+	check_numeric_query (RHYTHMDB_QUERY_PROP_GREATER, RHYTHMDB_PROP_LAST_PLAYED, 1400000000, 1);
+	check_numeric_query (RHYTHMDB_QUERY_PROP_LESS, RHYTHMDB_PROP_LAST_PLAYED, 1100000000, 0);
+
+	/* the merged entry must also be removable from the index */
+	rhythmdb_entry_delete (db, entry);
+	rhythmdb_commit (db);
+
+	check_numeric_query (RHYTHMDB_QUERY_PROP_LESS, RHYTHMDB_PROP_PLAY_COUNT, 10, 1);
+	check_numeric_query (RHYTHMDB_QUERY_PROP_GREATER, RHYTHMDB_PROP_LAST_PLAYED, 1100000000, 1);
+}
+END_TEST
+
 #define BARRIER_TEST_THREADS	10
 
 typedef struct {
@@ -605,6 +1279,560 @@ START_TEST (test_rhythmdb_commit_change_merging)
 }
 END_TEST
 
+static void
+entries_changed_cb (RhythmDB *db, GPtrArray *entries, GPtrArray *changes, RhythmDBPropMask *mask, guint *count)
+{
+	(*count)++;
+	ck_assert_msg (entries->len == 2, "both changed entries in one batch");
+	ck_assert_msg (changes->len == entries->len, "change list for each entry");
+	ck_assert_msg (rhythmdb_prop_mask_contains (mask, RHYTHMDB_PROP_ARTIST), "artist in change mask");
+	ck_assert_msg (rhythmdb_prop_mask_contains (mask, RHYTHMDB_PROP_ARTIST_SORT_KEY), "derived artist prop in change mask");
+	ck_assert_msg (rhythmdb_prop_mask_contains (mask, RHYTHMDB_PROP_SEARCH_MATCH), "search match in change mask");
+	ck_assert_msg (rhythmdb_prop_mask_contains (mask, RHYTHMDB_PROP_GENRE) == FALSE, "genre not in change mask");
+}
+
+START_TEST (test_rhythmdb_entries_changed)
+{
+	RhythmDBEntry *a, *b;
+	RhythmDBPropMask query_mask = {{0,}};
+	GValue val = {0,};
+	guint count = 0;
+
+	a = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_IGNORE, "file:///a.ogg");
+	b = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_IGNORE, "file:///b.ogg");
+	rhythmdb_commit (db);
+
+	g_value_init (&val, G_TYPE_STRING);
+	g_value_set_static_string (&val, "Someone");
+	rhythmdb_entry_set (db, a, RHYTHMDB_PROP_ARTIST, &val);
+	rhythmdb_entry_set (db, b, RHYTHMDB_PROP_ARTIST, &val);
+	g_value_unset (&val);
+
+	g_signal_connect (G_OBJECT (db), "entries-changed", G_CALLBACK (entries_changed_cb), &count);
+	set_waiting_signal (G_OBJECT (db), "entry-changed");
+	rhythmdb_commit (db);
+	wait_for_signal ();
+	ck_assert_msg (count == 1, "entries-changed emitted once per commit");
+
+	rhythmdb_prop_mask_add (&query_mask, RHYTHMDB_PROP_GENRE);
+	rhythmdb_prop_mask_add (&query_mask, RHYTHMDB_PROP_RATING);
+	ck_assert_msg (rhythmdb_prop_mask_contains (&query_mask, RHYTHMDB_PROP_RATING), "added prop in mask");
+	ck_assert_msg (rhythmdb_prop_mask_contains (&query_mask, RHYTHMDB_PROP_ARTIST) == FALSE, "other prop not in mask");
+}
+END_TEST
+
+#define LIVE_MODEL_ENTRIES	40
+
+static void
+rows_reordered_cb (GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter, gpointer new_order, guint *count)
+{
+	(*count)++;
+}
+
+static gboolean
+model_sorted_by_play_count (RhythmDBQueryModel *model)
+{
+	GtkTreeIter iter;
+	gulong last = 0;
+
+	if (gtk_tree_model_get_iter_first (GTK_TREE_MODEL (model), &iter) == FALSE)
+		return TRUE;
+
+	do {
+		RhythmDBEntry *entry;
+		gulong play_count;
+
+		entry = rhythmdb_query_model_iter_to_entry (model, &iter);
+		play_count = rhythmdb_entry_get_ulong (entry, RHYTHMDB_PROP_PLAY_COUNT);
+		rhythmdb_entry_unref (entry);
+		if (play_count < last)
+			return FALSE;
+		last = play_count;
+	} while (gtk_tree_model_iter_next (GTK_TREE_MODEL (model), &iter));
+
+	return TRUE;
+}
+
+static void
+commit_and_wait (RhythmDB *db)
+{
+	set_waiting_signal (G_OBJECT (db), "entry-changed");
+	rhythmdb_commit (db);
+	wait_for_signal ();
+}
+
+START_TEST (test_rhythmdb_entries_changed_model)
+{
+	RhythmDBEntry *entries[LIVE_MODEL_ENTRIES];
+	RhythmDBQueryModel *model;
+	GtkTreeIter iter;
+	GPtrArray *query;
+	guint reordered = 0;
+	int i;
+
+	for (i = 0; i < LIVE_MODEL_ENTRIES; i++) {
+		char *uri;
+
+		uri = g_strdup_printf ("file:///live/%d.ogg", i);
+		entries[i] = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_IGNORE, uri);
+		g_free (uri);
+		set_entry_ulong (db, entries[i], RHYTHMDB_PROP_PLAY_COUNT, i + 1);
+	}
+	rhythmdb_commit (db);
+
+	query = rhythmdb_query_parse (db,
+				      RHYTHMDB_QUERY_PROP_EQUALS, RHYTHMDB_PROP_TYPE, RHYTHMDB_ENTRY_TYPE_IGNORE,
+				      RHYTHMDB_QUERY_PROP_GREATER, RHYTHMDB_PROP_PLAY_COUNT, (gulong) 1,
+				      RHYTHMDB_QUERY_END);
+	model = rhythmdb_query_model_new (db, query,
+					  (GCompareDataFunc) rhythmdb_query_model_ulong_sort_func,
+					  GINT_TO_POINTER (RHYTHMDB_PROP_PLAY_COUNT), NULL, FALSE);
+	g_object_set (G_OBJECT (model), "show-hidden", TRUE, NULL);
+	rhythmdb_do_full_query_parsed (db, RHYTHMDB_QUERY_RESULTS (model), query);
+	rhythmdb_query_free (query);
+	ck_assert_msg (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (model), NULL) == LIVE_MODEL_ENTRIES,
+		       "wrong number of entries in live model");
+
+	/* changes to properties the query doesn't use skip the query check,
+	 * so an entry taken out of the model stays out
+	 */
+	rhythmdb_query_model_remove_entry (model, entries[0]);
+	set_entry_string (db, entries[0], RHYTHMDB_PROP_ARTIST, "Someone Else");
+	commit_and_wait (db);
+	ck_assert_msg (rhythmdb_query_model_entry_to_iter (model, entries[0], &iter) == FALSE,
+		       "query checked for a change to an unrelated property");
+
+	/* changes to properties it does use are checked */
+	set_entry_ulong (db, entries[0], RHYTHMDB_PROP_PLAY_COUNT, 100);
+	commit_and_wait (db);
+	ck_assert_msg (rhythmdb_query_model_entry_to_iter (model, entries[0], &iter),
+		       "entry matching the query not added back");
+
+	/* a large batch of changes re-sorts the model once */
+	g_signal_connect (G_OBJECT (model), "rows-reordered", G_CALLBACK (rows_reordered_cb), &reordered);
+	for (i = 0; i < LIVE_MODEL_ENTRIES; i++) {
+		set_entry_ulong (db, entries[i], RHYTHMDB_PROP_PLAY_COUNT, (LIVE_MODEL_ENTRIES * 2) - i);
+	}
+	commit_and_wait (db);
+	ck_assert_msg (reordered == 1, "model reordered %u times for one batch", reordered);
+	ck_assert_msg (model_sorted_by_play_count (model), "model not sorted after batch change");
+
+	/* smaller batches move entries individually */
+	set_entry_ulong (db, entries[1], RHYTHMDB_PROP_PLAY_COUNT, 1000);
+	set_entry_ulong (db, entries[2], RHYTHMDB_PROP_PLAY_COUNT, 2);
+	commit_and_wait (db);
+	ck_assert_msg (model_sorted_by_play_count (model), "model not sorted after small change");
+
+	g_object_unref (model);
+}
+END_TEST
+
+static void
+metadata_cache_load_cb (const char *key, GArray *metadata, guint *count)
+{
+	RhythmDBEntryChange *fields = (RhythmDBEntryChange *)metadata->data;
+	int i;
+
+	ck_assert_msg (g_str_equal (key, "cache-test"), "unexpected key %s loaded", key);
+	(*count)++;
+
+	for (i = 0; i < metadata->len; i++) {
+		g_value_unset (&fields[i].new);
+	}
+	g_free (fields);
+}
+
+START_TEST (test_rhythmdb_metadata_cache)
+{
+	RhythmDBMetadataCache *cache;
+	RhythmDBEntry *entry;
+	RhythmDBEntryChange *fields;
+	GArray metadata = {0,};
+	const char *keys[] = { "cache-test", "cache-missing", NULL };
+	gboolean have_title = FALSE;
+	gboolean have_duration = FALSE;
+	guint count = 0;
+	char *path;
+	int i;
+
+	path = g_build_filename (rb_user_cache_dir (), "metadata", "test-rhythmdb.tdb", NULL);
+	g_unlink (path);
+	cache = rhythmdb_metadata_cache_get (db, "test-rhythmdb");
+
+	entry = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_IGNORE, "file:///cache-test.ogg");
+	set_entry_string (db, entry, RHYTHMDB_PROP_TITLE, "Cached");
+	set_entry_ulong (db, entry, RHYTHMDB_PROP_DURATION, 123);
+	rhythmdb_commit (db);
+
+	/* the record can be loaded before the deferred write happens */
+	rhythmdb_metadata_cache_store (cache, "cache-test", entry);
+	ck_assert_msg (rhythmdb_metadata_cache_load (cache, "cache-test", &metadata), "pending record not found");
+
+	fields = (RhythmDBEntryChange *)metadata.data;
+	for (i = 0; i < metadata.len; i++) {
+		if (fields[i].prop == RHYTHMDB_PROP_TITLE) {
+			have_title = g_str_equal (g_value_get_string (&fields[i].new), "Cached");
+		} else if (fields[i].prop == RHYTHMDB_PROP_DURATION) {
+			have_duration = (g_value_get_ulong (&fields[i].new) == 123);
+		}
+		g_value_unset (&fields[i].new);
+	}
+	g_free (fields);
+	ck_assert_msg (have_title, "title not cached");
+	ck_assert_msg (have_duration, "duration not cached");
+
+	rhythmdb_metadata_cache_flush (cache);
+	ck_assert_msg (rhythmdb_metadata_cache_load_many (cache, keys, (RhythmDBMetadataCacheLoadFunc) metadata_cache_load_cb, &count) == 1,
+		       "batched lookup found the wrong number of records");
+	ck_assert_msg (count == 1, "batched lookup callback called %u times", count);
+
+	g_object_unref (cache);
+	g_unlink (path);
+	g_free (path);
+}
+END_TEST
+
+START_TEST (test_rhythmdb_dir_manifest)
+{
+	RhythmDBDirManifest *manifest;
+	guint32 hash;
+	guint64 full_check_time;
+	guint startups;
+	char *dir;
+	char *name;
+	char *filename;
+
+	dir = g_dir_make_tmp ("rb-test-manifest-XXXXXX", NULL);
+	ck_assert_msg (dir != NULL, "failed to create temporary directory");
+	name = g_build_filename (dir, "rhythmdb.xml", NULL);
+	filename = rhythmdb_dir_manifest_get_filename (name);
+	ck_assert_msg (g_str_has_suffix (filename, "rhythmdb.dirs"), "wrong manifest file name %s", filename);
+
+	/* name hashes don't depend on order */
+	hash = rhythmdb_dir_manifest_add_name (rhythmdb_dir_manifest_add_name (0, "a.ogg"), "b.ogg");
+	ck_assert_msg (hash == rhythmdb_dir_manifest_add_name (rhythmdb_dir_manifest_add_name (0, "b.ogg"), "a.ogg"),
+		       "name hash depends on order");
+	ck_assert_msg (hash != rhythmdb_dir_manifest_add_name (rhythmdb_dir_manifest_add_name (0, "a.ogg"), "c.ogg"),
+		       "different names hash the same");
+
+	manifest = rhythmdb_dir_manifest_new ();
+	ck_assert_msg (rhythmdb_dir_manifest_is_expired (manifest, 100000000), "new manifest not expired");
+	rhythmdb_dir_manifest_set (manifest, "file:///music/", 1234, 2, hash);
+	rhythmdb_dir_manifest_set_full_check (manifest, 100000000, 3);
+	ck_assert_msg (rhythmdb_dir_manifest_save (manifest, filename, NULL), "failed to save manifest");
+	rhythmdb_dir_manifest_free (manifest);
+
+	manifest = rhythmdb_dir_manifest_load (filename);
+	ck_assert_msg (rhythmdb_dir_manifest_size (manifest) == 1, "manifest loaded incorrectly");
+	ck_assert_msg (rhythmdb_dir_manifest_matches (manifest, "file:///music/", 1234, 2, hash), "unchanged directory doesn't match");
+	ck_assert_msg (rhythmdb_dir_manifest_matches (manifest, "file:///music/", 1235, 2, hash) == FALSE, "modified directory matches");
+	ck_assert_msg (rhythmdb_dir_manifest_matches (manifest, "file:///music/", 1234, 1, hash) == FALSE, "entry count ignored");
+	ck_assert_msg (rhythmdb_dir_manifest_matches (manifest, "file:///music/", 1234, 2, hash + 1) == FALSE, "name hash ignored");
+	ck_assert_msg (rhythmdb_dir_manifest_matches (manifest, "file:///other/", 1234, 2, hash) == FALSE, "unknown directory matches");
+
+	/* files are checked individually again after a while */
+	rhythmdb_dir_manifest_get_full_check (manifest, &full_check_time, &startups);
+	ck_assert_msg (full_check_time == 100000000 && startups == 3, "full check details loaded incorrectly");
+	ck_assert_msg (rhythmdb_dir_manifest_is_expired (manifest, 100000000 + 60) == FALSE, "recent manifest expired");
+	ck_assert_msg (rhythmdb_dir_manifest_is_expired (manifest, 100000000 + 30 * 24 * 60 * 60), "old manifest not expired");
+	ck_assert_msg (rhythmdb_dir_manifest_is_expired (manifest, 100000000 - 60), "manifest from the future not expired");
+	rhythmdb_dir_manifest_set_full_check (manifest, 100000000, 100);
+	ck_assert_msg (rhythmdb_dir_manifest_is_expired (manifest, 100000000 + 60), "manifest used for many startups not expired");
+	rhythmdb_dir_manifest_free (manifest);
+
+	g_unlink (filename);
+	g_rmdir (dir);
+	g_free (filename);
+	g_free (name);
+	g_free (dir);
+}
+END_TEST
+
+static guint sync_checks;
+
+static gboolean
+count_sync_check (RhythmDBEntryType *etype, RhythmDBEntry *entry)
+{
+	sync_checks++;
+	return TRUE;
+}
+
+START_TEST (test_rhythmdb_event_batch_sync)
+{
+	RhythmDBEntryTypeClass *etype_class;
+	RhythmDBEntryChange *fields;
+	RhythmDBEntry *a;
+	RhythmDBEntry *b;
+	RhythmDBEvent *event;
+
+	a = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_SONG, "file:///a.ogg");
+	set_entry_ulong (db, a, RHYTHMDB_PROP_MTIME, 1000);
+	b = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_SONG, "file:///b.ogg");
+	rhythmdb_commit (db);
+
+	etype_class = RHYTHMDB_ENTRY_TYPE_GET_CLASS (RHYTHMDB_ENTRY_TYPE_SONG);
+	etype_class->can_sync_metadata = (RhythmDBEntryTypeBooleanFunc) count_sync_check;
+	sync_checks = 0;
+
+	/* a stat event for an unmodified file, committed with syncing */
+	event = g_slice_new0 (RhythmDBEvent);
+	event->type = RHYTHMDB_EVENT_STAT;
+	event->uri = rb_refstring_new ("file:///a.ogg");
+	event->real_uri = rb_refstring_ref (event->uri);
+	event->entry_type = RHYTHMDB_ENTRY_TYPE_SONG;
+	event->file_info = g_file_info_new ();
+	g_file_info_set_attribute_uint32 (event->file_info, G_FILE_ATTRIBUTE_STANDARD_TYPE, G_FILE_TYPE_REGULAR);
+	g_file_info_set_attribute_uint64 (event->file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED, 1000);
+	rhythmdb_push_event (db, event);
+
+	/* followed in the same batch by metadata read from another file */
+	event = g_slice_new0 (RhythmDBEvent);
+	event->type = RHYTHMDB_EVENT_METADATA_CACHE;
+	event->uri = rb_refstring_new ("file:///b.ogg");
+	event->real_uri = rb_refstring_ref (event->uri);
+	event->entry_type = RHYTHMDB_ENTRY_TYPE_SONG;
+	fields = g_new0 (RhythmDBEntryChange, 1);
+	fields[0].prop = RHYTHMDB_PROP_TITLE;
+	g_value_init (&fields[0].new, G_TYPE_STRING);
+	g_value_set_static_string (&fields[0].new, "Read From The File");
+	event->cached_metadata.data = (gchar *) fields;
+	event->cached_metadata.len = 1;
+	rhythmdb_push_event (db, event);
+
+	while (g_main_context_iteration (NULL, FALSE))
+		;
+
+	ck_assert_msg (strcmp (rhythmdb_entry_get_string (b, RHYTHMDB_PROP_TITLE), "Read From The File") == 0,
+		       "cached metadata not applied");
+	ck_assert_msg (sync_checks == 0, "metadata read from a file queued %u sync actions", sync_checks);
+
+	etype_class->can_sync_metadata = (RhythmDBEntryTypeBooleanFunc) rb_true_function;
+}
+END_TEST
+
+static RhythmDBEvent *
+title_event (const char *uri, const char *title)
+{
+	RhythmDBEntryChange *fields;
+	RhythmDBEvent *event;
+
+	event = g_slice_new0 (RhythmDBEvent);
+	event->type = RHYTHMDB_EVENT_METADATA_CACHE;
+	event->uri = rb_refstring_new (uri);
+	event->real_uri = rb_refstring_ref (event->uri);
+	event->entry_type = RHYTHMDB_ENTRY_TYPE_SONG;
+	fields = g_new0 (RhythmDBEntryChange, 1);
+	fields[0].prop = RHYTHMDB_PROP_TITLE;
+	g_value_init (&fields[0].new, G_TYPE_STRING);
+	g_value_set_static_string (&fields[0].new, title);
+	event->cached_metadata.data = (gchar *) fields;
+	event->cached_metadata.len = 1;
+	return event;
+}
+
+static gint seq_reserved;
+
+static gpointer
+reserve_seq_thread (RhythmDB *db)
+{
+	guint seq;
+
+	seq = rhythmdb_reserve_metadata_seq (db);
+	g_atomic_int_set (&seq_reserved, 1);
+	return GUINT_TO_POINTER (seq);
+}
+
+START_TEST (test_rhythmdb_metadata_order)
+{
+	RhythmDBEntry *entry;
+	GThread *thread;
+	guint seq[3];
+	guint first;
+	guint last;
+	guint i;
+
+	entry = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_SONG, "file:///order.ogg");
+	rhythmdb_commit (db);
+
+	for (i = 0; i < G_N_ELEMENTS (seq); i++) {
+		seq[i] = rhythmdb_reserve_metadata_seq (db);
+	}
+
+	/* later loads finishing first are held back until the earlier ones are done */
+	rhythmdb_deliver_metadata_event (db, seq[2], title_event ("file:///order.ogg", "Third"));
+	rhythmdb_deliver_metadata_event (db, seq[1], title_event ("file:///order.ogg", "Second"));
+	while (g_main_context_iteration (NULL, FALSE))
+		;
+	ck_assert_msg (strcmp (rhythmdb_entry_get_string (entry, RHYTHMDB_PROP_TITLE), "Second") != 0 &&
+		       strcmp (rhythmdb_entry_get_string (entry, RHYTHMDB_PROP_TITLE), "Third") != 0,
+		       "metadata delivered before earlier loads finished");
+
+	rhythmdb_deliver_metadata_event (db, seq[0], title_event ("file:///order.ogg", "First"));
+	while (g_main_context_iteration (NULL, FALSE))
+		;
+	ck_assert_msg (strcmp (rhythmdb_entry_get_string (entry, RHYTHMDB_PROP_TITLE), "Third") == 0,
+		       "metadata delivered out of order");
+
+	/* once the window is full, no more loads are dispatched until the oldest is delivered */
+	first = rhythmdb_reserve_metadata_seq (db);
+	for (i = 1; i < RHYTHMDB_METADATA_REORDER_WINDOW; i++) {
+		rhythmdb_reserve_metadata_seq (db);
+	}
+
+	seq_reserved = 0;
+	thread = g_thread_new ("reserve", (GThreadFunc) reserve_seq_thread, db);
+	g_usleep (G_USEC_PER_SEC / 10);
+	ck_assert_msg (g_atomic_int_get (&seq_reserved) == 0, "load dispatched with the reorder window full");
+
+	rhythmdb_deliver_metadata_event (db, first, NULL);
+	last = GPOINTER_TO_UINT (g_thread_join (thread));
+	ck_assert_msg (last == first + RHYTHMDB_METADATA_REORDER_WINDOW, "unexpected sequence number %u", last);
+
+	for (i = first + 1; i <= last; i++) {
+		rhythmdb_deliver_metadata_event (db, i, NULL);
+	}
+}
+END_TEST
+
+static void
+set_mtime (const char *path, guint64 mtime)
+{
+	GFile *file;
+
+	file = g_file_new_for_path (path);
+	ck_assert_msg (g_file_set_attribute_uint64 (file, G_FILE_ATTRIBUTE_TIME_MODIFIED, mtime, G_FILE_QUERY_INFO_NONE, NULL, NULL),
+		       "failed to set modification time of %s", path);
+	g_object_unref (file);
+}
+
+static gboolean
+has_scan_change (GPtrArray *changes, RhythmDBScanChangeType type, const char *dir, const char *name)
+{
+	gboolean found = FALSE;
+	char *path;
+	char *uri;
+	guint i;
+
+	path = g_build_filename (dir, name, NULL);
+	uri = g_filename_to_uri (path, NULL, NULL);
+	for (i = 0; i < changes->len; i++) {
+		RhythmDBScanChange *change = g_ptr_array_index (changes, i);
+		if (change->type == type && strcmp (change->uri, uri) == 0)
+			found = TRUE;
+	}
+	g_free (uri);
+	g_free (path);
+	return found;
+}
+
+START_TEST (test_rhythmdb_monitor_scan)
+{
+	RhythmDBMonitorLocation *loc;
+	GPtrArray *changes;
+	char *dir;
+	char *uri;
+	char *path;
+
+	dir = g_dir_make_tmp ("rb-test-scan-XXXXXX", NULL);
+	ck_assert_msg (dir != NULL, "failed to create temporary directory");
+	path = g_build_filename (dir, "sub", "deeper", NULL);
+	g_mkdir_with_parents (path, 0700);
+	g_free (path);
+
+	path = g_build_filename (dir, "a.ogg", NULL);
+	g_file_set_contents (path, "a", -1, NULL);
+	g_free (path);
+	path = g_build_filename (dir, "sub", "b.ogg", NULL);
+	g_file_set_contents (path, "b", -1, NULL);
+	g_free (path);
+	path = g_build_filename (dir, "sub", "deeper", "c.ogg", NULL);
+	g_file_set_contents (path, "c", -1, NULL);
+	g_free (path);
+	set_mtime (dir, 1000);
+
+	uri = g_filename_to_uri (dir, NULL, NULL);
+	loc = rhythmdb_monitor_scan_location_new (db, uri);
+
+	/* the first scan reports everything as found */
+	changes = rhythmdb_monitor_scan_location_run (loc, TRUE);
+	ck_assert_msg (changes->len == 3, "initial scan found %u changes", changes->len);
+	ck_assert_msg (has_scan_change (changes, SCAN_FILE_FOUND, dir, "a.ogg"), "file not found");
+	ck_assert_msg (has_scan_change (changes, SCAN_FILE_FOUND, dir, "sub/deeper/c.ogg"), "nested file not found");
+	g_ptr_array_unref (changes);
+
+	/* nothing has changed */
+	changes = rhythmdb_monitor_scan_location_run (loc, FALSE);
+	ck_assert_msg (changes->len == 0, "unchanged directory reported %u changes", changes->len);
+	g_ptr_array_unref (changes);
+
+	/* a new file changes the directory's modification time */
+	path = g_build_filename (dir, "d.ogg", NULL);
+	g_file_set_contents (path, "d", -1, NULL);
+	g_free (path);
+	set_mtime (dir, 2000);
+	changes = rhythmdb_monitor_scan_location_run (loc, FALSE);
+	ck_assert_msg (changes->len == 1, "new file reported %u changes", changes->len);
+	ck_assert_msg (has_scan_change (changes, SCAN_FILE_CREATED, dir, "d.ogg"), "new file not reported");
+	g_ptr_array_unref (changes);
+
+	/* files modified in place are only noticed by full scans */
+	path = g_build_filename (dir, "a.ogg", NULL);
+	set_mtime (path, 3000);
+	g_free (path);
+	changes = rhythmdb_monitor_scan_location_run (loc, FALSE);
+	ck_assert_msg (changes->len == 0, "partial scan reported %u changes", changes->len);
+	g_ptr_array_unref (changes);
+	changes = rhythmdb_monitor_scan_location_run (loc, TRUE);
+	ck_assert_msg (changes->len == 1, "modified file reported %u changes", changes->len);
+	ck_assert_msg (has_scan_change (changes, SCAN_FILE_CHANGED, dir, "a.ogg"), "modified file not reported");
+	g_ptr_array_unref (changes);
+
+	/* deleted files */
+	path = g_build_filename (dir, "d.ogg", NULL);
+	g_unlink (path);
+	g_free (path);
+	set_mtime (dir, 4000);
+	changes = rhythmdb_monitor_scan_location_run (loc, FALSE);
+	ck_assert_msg (changes->len == 1, "deleted file reported %u changes", changes->len);
+	ck_assert_msg (has_scan_change (changes, SCAN_FILE_DELETED, dir, "d.ogg"), "deleted file not reported");
+	g_ptr_array_unref (changes);
+
+	/* removing a subdirectory deletes everything under it */
+	path = g_build_filename (dir, "sub", "deeper", "c.ogg", NULL);
+	g_unlink (path);
+	g_free (path);
+	path = g_build_filename (dir, "sub", "deeper", NULL);
+	g_rmdir (path);
+	g_free (path);
+	path = g_build_filename (dir, "sub", "b.ogg", NULL);
+	g_unlink (path);
+	g_free (path);
+	path = g_build_filename (dir, "sub", NULL);
+	g_rmdir (path);
+	g_free (path);
+	set_mtime (dir, 5000);
+	changes = rhythmdb_monitor_scan_location_run (loc, FALSE);
+	ck_assert_msg (changes->len == 2, "removed subdirectory reported %u changes", changes->len);
+	ck_assert_msg (has_scan_change (changes, SCAN_FILE_DELETED, dir, "sub/b.ogg"), "file in removed subdirectory not reported");
+	ck_assert_msg (has_scan_change (changes, SCAN_FILE_DELETED, dir, "sub/deeper/c.ogg"), "nested file in removed subdirectory not reported");
+	g_ptr_array_unref (changes);
+
+	/* and the removed directories are forgotten */
+	changes = rhythmdb_monitor_scan_location_run (loc, TRUE);
+	ck_assert_msg (changes->len == 0, "scan after removal reported %u changes", changes->len);
+	g_ptr_array_unref (changes);
+
+	rhythmdb_monitor_scan_location_free (loc);
+
+	path = g_build_filename (dir, "a.ogg", NULL);
+	g_unlink (path);
+	g_free (path);
+	g_rmdir (dir);
+	g_free (uri);
+	g_free (dir);
+}
+END_TEST
+
 static Suite *
 rhythmdb_suite (void)
 {
@@ -618,7 +1846,7 @@ rhythmdb_suite (void)
 	tcase_add_checked_fixture (tc_bugs, test_rhythmdb_setup, test_rhythmdb_shutdown);
 
 	/* test core functionality */
-	/*tcase_add_test (tc_chain, test_refstring);*/
+	tcase_add_test (tc_chain, test_refstring);
 	tcase_add_test (tc_chain, test_rhythmdb_indexing);
 	tcase_add_test (tc_chain, test_rhythmdb_multiple);
 	tcase_add_test (tc_chain, test_rhythmdb_mirroring);
@@ -630,9 +1858,25 @@ rhythmdb_suite (void)
 	tcase_add_test (tc_chain, test_rhythmdb_deserialisation2);
 	tcase_add_test (tc_chain, test_rhythmdb_deserialisation3);
 	/*tcase_add_test (tc_chain, test_rhythmdb_serialisation);*/
+	tcase_add_test (tc_chain, test_rhythmdb_snapshot);
+	tcase_add_test (tc_chain, test_rhythmdb_journal);
+	tcase_add_test (tc_chain, test_rhythmdb_progressive_load);
+	tcase_add_test (tc_chain, test_rhythmdb_search_index);
+	tcase_add_test (tc_chain, test_rhythmdb_query_plan);
+	tcase_add_test (tc_chain, test_rhythmdb_parallel_query);
+	tcase_add_test (tc_chain, test_rhythmdb_numeric_index);
+	tcase_add_test (tc_chain, test_rhythmdb_numeric_index_duplicate);
+	tcase_add_test (tc_chain, test_rhythmdb_entry_extra);
+	tcase_add_test (tc_chain, test_rhythmdb_entries_changed);
+	tcase_add_test (tc_chain, test_rhythmdb_entries_changed_model);
+	tcase_add_test (tc_chain, test_rhythmdb_metadata_cache);
+	tcase_add_test (tc_chain, test_rhythmdb_dir_manifest);
+	tcase_add_test (tc_chain, test_rhythmdb_monitor_scan);
 
 	/* tests for entry changes and commits from worker threads */
 	tcase_add_test (tc_chain, test_rhythmdb_thread_barrier);
+	tcase_add_test (tc_chain, test_rhythmdb_event_batch_sync);
+	tcase_add_test (tc_chain, test_rhythmdb_metadata_order);
 
 	/* tests for breakable bug fixes */
 	tcase_add_test (tc_chain, test_rhythmdb_podcast_upgrade);
@@ -0,0 +1,364 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ *  Copyright (C) 2026  Rhythmbox contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  The Rhythmbox authors hereby grant permission for non-GPL compatible
+ *  GStreamer plugins to be used and distributed together with GStreamer
+ *  and Rhythmbox. This permission is above and beyond the permissions granted
+ *  by the GPL license by which Rhythmbox is covered. If you modify this code
+ *  you may extend this exception to your version of the code, but you are not
+ *  obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA.
+ *
+ */
+
+#include "config.h"
+
+#include <check.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+
+#include "test-utils.h"
+#include "rb-transcode-cache.h"
+#include "rb-encoder.h"
+#include "rb-debug.h"
+#include "rb-file-helpers.h"
+#include "rb-util.h"
+#include "rhythmdb.h"
+
+static GstEncodingProfile *
+make_profile (const char *media_type)
+{
+	GstEncodingProfile *profile;
+	GstCaps *caps;
+
+	caps = gst_caps_new_empty_simple (media_type);
+	profile = GST_ENCODING_PROFILE (gst_encoding_audio_profile_new (caps, NULL, NULL, 0));
+	gst_caps_unref (caps);
+	return profile;
+}
+
+static char *
+make_file (const char *dir, const char *name, gsize size)
+{
+	char *path;
+	char *data;
+	char *uri;
+
+	path = g_build_filename (dir, name, NULL);
+	data = g_malloc0 (size);
+	ck_assert (g_file_set_contents (path, data, size, NULL));
+	uri = g_filename_to_uri (path, NULL, NULL);
+	g_free (data);
+	g_free (path);
+	return uri;
+}
+
+static void
+remove_dir (const char *path)
+{
+	GDir *d;
+	const char *name;
+
+	d = g_dir_open (path, 0, NULL);
+	if (d != NULL) {
+		while ((name = g_dir_read_name (d)) != NULL) {
+			char *child = g_build_filename (path, name, NULL);
+			g_unlink (child);
+			g_free (child);
+		}
+		g_dir_close (d);
+	}
+	g_rmdir (path);
+}
+
+static gboolean
+fetch (RBTranscodeCache *cache, const char *key, GError **error)
+{
+	char *uri = NULL;
+	char *path;
+	guint64 size = 0;
+
+	if (rb_transcode_cache_fetch (cache, key, RB_ENCODER_DEST_TEMPFILE, FALSE, &uri, &size, error) == FALSE)
+		return FALSE;
+
+	ck_assert (size == 100);
+	path = g_filename_from_uri (uri, NULL, NULL);
+	ck_assert (path != NULL);
+	g_unlink (path);
+	g_free (path);
+	g_free (uri);
+	return TRUE;
+}
+
+static void
+check_key_changes (RhythmDBEntry *entry, GstEncodingProfile *profile, char **key)
+{
+	char *new_key;
+
+	rhythmdb_commit (db);
+	new_key = rb_transcode_cache_get_key (entry, profile);
+	ck_assert (new_key != NULL);
+	ck_assert_msg (g_strcmp0 (*key, new_key) != 0, "cache key didn't change");
+	g_free (*key);
+	*key = new_key;
+}
+
+START_TEST (test_transcode_cache_key)
+{
+	RhythmDBEntry *entry;
+	GstEncodingProfile *vorbis;
+	GstEncodingProfile *opus;
+	char *key;
+	char *other;
+
+	vorbis = make_profile ("audio/x-vorbis");
+	opus = make_profile ("audio/x-opus");
+
+	entry = rhythmdb_entry_new (db, RHYTHMDB_ENTRY_TYPE_IGNORE, "file:///cached.flac");
+	ck_assert (entry != NULL);
+
+	/* entries without a modification time can't be cached */
+	rhythmdb_commit (db);
+	ck_assert (rb_transcode_cache_get_key (entry, vorbis) == NULL);
+
+	set_entry_ulong (db, entry, RHYTHMDB_PROP_MTIME, 1000);
+	rhythmdb_commit (db);
+	ck_assert (rb_transcode_cache_get_key (entry, NULL) == NULL);
+
+	key = rb_transcode_cache_get_key (entry, vorbis);
+	ck_assert (key != NULL);
+	other = rb_transcode_cache_get_key (entry, vorbis);
+	ck_assert (g_strcmp0 (key, other) == 0);
+	g_free (other);
+
+	other = rb_transcode_cache_get_key (entry, opus);
+	ck_assert (g_strcmp0 (key, other) != 0);
+	g_free (other);
+
+	/* changes to the source file */
+	set_entry_ulong (db, entry, RHYTHMDB_PROP_MTIME, 2000);
+	check_key_changes (entry, vorbis, &key);
+
+	/* changes to metadata written to the output file */
+	set_entry_string (db, entry, RHYTHMDB_PROP_TITLE, "a title");
+	check_key_changes (entry, vorbis, &key);
+	set_entry_string (db, entry, RHYTHMDB_PROP_ARTIST, "an artist");
+	check_key_changes (entry, vorbis, &key);
+	set_entry_string (db, entry, RHYTHMDB_PROP_ALBUM_SORTNAME, "album, an");
+	check_key_changes (entry, vorbis, &key);
+	set_entry_string (db, entry, RHYTHMDB_PROP_MUSICBRAINZ_TRACKID, "0e1a1ee2-8bf7-45c6-9fd1-2ab3a9dc9ef1");
+	check_key_changes (entry, vorbis, &key);
+	set_entry_ulong (db, entry, RHYTHMDB_PROP_TRACK_NUMBER, 3);
+	check_key_changes (entry, vorbis, &key);
+	set_entry_ulong (db, entry, RHYTHMDB_PROP_DISC_NUMBER, 2);
+	check_key_changes (entry, vorbis, &key);
+	set_entry_ulong (db, entry, RHYTHMDB_PROP_DATE, 730000);
+	check_key_changes (entry, vorbis, &key);
+	set_entry_double (db, entry, RHYTHMDB_PROP_BPM, 120.0);
+	check_key_changes (entry, vorbis, &key);
+
+	/* but not to properties that aren't written out */
+	set_entry_ulong (db, entry, RHYTHMDB_PROP_PLAY_COUNT, 5);
+	rhythmdb_commit (db);
+	other = rb_transcode_cache_get_key (entry, vorbis);
+	ck_assert (g_strcmp0 (key, other) == 0);
+	g_free (other);
+
+	g_free (key);
+	g_object_unref (vorbis);
+	g_object_unref (opus);
+}
+END_TEST
+
+START_TEST (test_transcode_cache_lru)
+{
+	RBTranscodeCache *cache;
+	GError *error = NULL;
+	char *dir;
+	char *cache_dir;
+	char *a, *b, *c, *big;
+	char *path;
+
+	dir = g_dir_make_tmp ("rb-test-transcode-cache-XXXXXX", NULL);
+	ck_assert (dir != NULL);
+	cache_dir = g_build_filename (dir, "cache", NULL);
+	ck_assert (g_mkdir (cache_dir, 0700) == 0);
+
+	a = make_file (dir, "a", 100);
+	b = make_file (dir, "b", 100);
+	c = make_file (dir, "c", 100);
+	big = make_file (dir, "big", 300);
+
+	cache = rb_transcode_cache_new (cache_dir, 250);
+	ck_assert (rb_transcode_cache_fetch (cache, "a", RB_ENCODER_DEST_TEMPFILE, FALSE, NULL, NULL, &error) == FALSE);
+	ck_assert (error == NULL);
+
+	ck_assert (rb_transcode_cache_store (cache, "a", a, NULL));
+	ck_assert (rb_transcode_cache_store (cache, "b", b, NULL));
+	ck_assert (rb_transcode_cache_get_size (cache) == 200);
+
+	/* using a makes b the least recently used item */
+	ck_assert (fetch (cache, "a", NULL));
+	ck_assert (rb_transcode_cache_store (cache, "c", c, NULL));
+	ck_assert (rb_transcode_cache_get_size (cache) == 200);
+
+	ck_assert (fetch (cache, "b", &error) == FALSE);
+	ck_assert (error == NULL);
+	ck_assert (fetch (cache, "a", NULL));
+	ck_assert (fetch (cache, "c", NULL));
+
+	/* files larger than the cache aren't stored */
+	ck_assert (rb_transcode_cache_store (cache, "big", big, NULL) == FALSE);
+	ck_assert (rb_transcode_cache_get_size (cache) == 200);
+
+	/* a cached file that goes away is a miss, not an error */
+	path = g_build_filename (cache_dir, "c", NULL);
+	ck_assert (g_unlink (path) == 0);
+	g_free (path);
+	ck_assert (fetch (cache, "c", &error) == FALSE);
+	ck_assert (error == NULL);
+	ck_assert (rb_transcode_cache_get_size (cache) == 100);
+
+	/* items are found again by a new cache in the same directory */
+	rb_transcode_cache_free (cache);
+	cache = rb_transcode_cache_new (cache_dir, 250);
+	ck_assert (fetch (cache, "a", NULL));
+	ck_assert (rb_transcode_cache_get_size (cache) == 100);
+	rb_transcode_cache_free (cache);
+
+	remove_dir (cache_dir);
+	remove_dir (dir);
+	g_free (a);
+	g_free (b);
+	g_free (c);
+	g_free (big);
+	g_free (cache_dir);
+	g_free (dir);
+}
+END_TEST
+
+START_TEST (test_transcode_cache_copies)
+{
+	RBTranscodeCache *cache;
+	GStatBuf src_st, cached_st, dest_st;
+	char *dir;
+	char *cache_dir;
+	char *src;
+	char *src_path;
+	char *cached_path;
+	char *dest_path;
+	char *dest_uri;
+	char *result_uri = NULL;
+	char *data = NULL;
+	gsize len;
+	guint64 size = 0;
+
+	dir = g_dir_make_tmp ("rb-test-transcode-cache-XXXXXX", NULL);
+	ck_assert (dir != NULL);
+	cache_dir = g_build_filename (dir, "cache", NULL);
+	ck_assert (g_mkdir (cache_dir, 0700) == 0);
+
+	src = make_file (dir, "src", 100);
+	src_path = g_filename_from_uri (src, NULL, NULL);
+	cached_path = g_build_filename (cache_dir, "src", NULL);
+	dest_path = g_build_filename (dir, "dest", NULL);
+	dest_uri = g_filename_to_uri (dest_path, NULL, NULL);
+
+	/* the cache keeps its own copy of the encoder output */
+	cache = rb_transcode_cache_new (cache_dir, 250);
+	ck_assert (rb_transcode_cache_store (cache, "src", src, NULL));
+	ck_assert (g_stat (src_path, &src_st) == 0);
+	ck_assert (g_stat (cached_path, &cached_st) == 0);
+	ck_assert_msg (src_st.st_ino != cached_st.st_ino, "cached file linked to the encoder output");
+
+	/* and copies it to real destinations, rather than linking */
+	ck_assert (rb_transcode_cache_fetch (cache, "src", dest_uri, FALSE, &result_uri, &size, NULL));
+	ck_assert (size == 100);
+	ck_assert (g_stat (dest_path, &dest_st) == 0);
+	ck_assert_msg (dest_st.st_ino != cached_st.st_ino, "destination linked to the cached file");
+
+	/* so changing the destination leaves the cached file alone */
+	ck_assert (g_file_set_contents (dest_path, "changed", -1, NULL));
+	ck_assert (g_file_get_contents (cached_path, &data, &len, NULL));
+	ck_assert (len == 100);
+	g_free (data);
+
+	rb_transcode_cache_free (cache);
+	remove_dir (cache_dir);
+	remove_dir (dir);
+	g_free (result_uri);
+	g_free (dest_uri);
+	g_free (dest_path);
+	g_free (cached_path);
+	g_free (src_path);
+	g_free (src);
+	g_free (cache_dir);
+	g_free (dir);
+}
+END_TEST
+
+static Suite *
+rb_transcode_cache_suite (void)
+{
+	Suite *s = suite_create ("rb-transcode-cache");
+	TCase *tc_chain = tcase_create ("rb-transcode-cache-core");
+
+	suite_add_tcase (s, tc_chain);
+	tcase_add_checked_fixture (tc_chain, test_rhythmdb_setup, test_rhythmdb_shutdown);
+
+	tcase_add_test (tc_chain, test_transcode_cache_key);
+	tcase_add_test (tc_chain, test_transcode_cache_lru);
+	tcase_add_test (tc_chain, test_transcode_cache_copies);
+
+	return s;
+}
+
+int
+main (int argc, char **argv)
+{
+	int ret;
+	SRunner *sr;
+	Suite *s;
+
+	/* init stuff */
+	rb_profile_start ("rb-transcode-cache test suite");
+
+	rb_threads_init ();
+	rb_debug_init (TRUE);
+	rb_refstring_system_init ();
+	rb_file_helpers_init ();
+	gst_init (&argc, &argv);
+
+	/* setup tests */
+	s = rb_transcode_cache_suite ();
+	sr = srunner_create (s);
+
+	init_setup (sr, argc, argv);
+	init_once (FALSE);
+
+	srunner_run_all (sr, CK_NORMAL);
+	ret = srunner_ntests_failed (sr);
+	srunner_free (sr);
+
+	rb_file_helpers_shutdown ();
+	rb_refstring_system_shutdown ();
+
+	rb_profile_end ("rb-transcode-cache test suite");
+	return ret;
+}
@@ -201,6 +201,17 @@ set_entry_ulong (RhythmDB *db, RhythmDBEntry *entry, RhythmDBPropType prop, gulo
 	g_value_unset (&v);
 }
 
+void
+set_entry_double (RhythmDB *db, RhythmDBEntry *entry, RhythmDBPropType prop, double value)
+{
+	GValue v = {0,};
+
+	g_value_init (&v, G_TYPE_DOUBLE);
+	g_value_set_double (&v, value);
+	rhythmdb_entry_set (db, entry, prop, &v);
+	g_value_unset (&v);
+}
+
 void
 set_entry_hidden (RhythmDB *db, RhythmDBEntry *entry, gboolean hidden)
 {
@@ -47,6 +47,7 @@ void test_rhythmdb_shutdown (void);
 
 void set_entry_string (RhythmDB *db, RhythmDBEntry *entry, RhythmDBPropType prop, const char *value);
 void set_entry_ulong (RhythmDB *db, RhythmDBEntry *entry, RhythmDBPropType prop, gulong value);
+void set_entry_double (RhythmDB *db, RhythmDBEntry *entry, RhythmDBPropType prop, double value);
 void set_entry_hidden (RhythmDB *db, RhythmDBEntry *entry, gboolean hidden);
 
 gulong set_waiting_signal_with_callback (GObject *o, const char *name, GCallback callback, gpointer data);
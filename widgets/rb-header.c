@@ -81,6 +81,8 @@ static void rb_header_get_preferred_width (GtkWidget *widget,
 					   int *minimum_size,
 					   int *natural_size);
 static void rb_header_size_allocate (GtkWidget *widget, GtkAllocation *allocation);
+static void rb_header_map (GtkWidget *widget);
+static void rb_header_unmap (GtkWidget *widget);
 static void rb_header_update_elapsed (RBHeader *header);
 static void apply_slider_position (RBHeader *header);
 static gboolean slider_press_callback (GtkWidget *widget, GdkEventButton *event, RBHeader *header);
@@ -135,6 +137,7 @@ struct RBHeaderPrivate
 	GtkWidget *timelabel;
 
 	gint64 elapsed_time;		/* nanoseconds */
+	guint tick_subscription;
 	gboolean show_remaining;
 	long duration;
 	gboolean seekable;
@@ -169,6 +172,9 @@ static const char *const UNICODE_MIDDLE_DOT = "\xC2\xB7";
 #define SCROLL_UP_SEEK_OFFSET	5
 #define SCROLL_DOWN_SEEK_OFFSET -5
 
+/* how often to update the time display and slider, in milliseconds */
+#define HEADER_TICK_INTERVAL	500
+
 G_DEFINE_TYPE (RBHeader, rb_header, GTK_TYPE_GRID)
 
 static void
@@ -187,6 +193,8 @@ rb_header_class_init (RBHeaderClass *klass)
 	widget_class->get_request_mode = rb_header_get_request_mode;
 	widget_class->get_preferred_width = rb_header_get_preferred_width;
 	widget_class->size_allocate = rb_header_size_allocate;
+	widget_class->map = rb_header_map;
+	widget_class->unmap = rb_header_unmap;
 	/* GtkGrid's get_preferred_height_for_width does all we need here */
 
 	/**
@@ -453,6 +461,11 @@ rb_header_dispose (GObject *object)
 	}
 
 	if (header->priv->shell_player != NULL) {
+		if (header->priv->tick_subscription != 0) {
+			rb_shell_player_remove_tick_subscriber (header->priv->shell_player,
+								header->priv->tick_subscription);
+			header->priv->tick_subscription = 0;
+		}
 		g_object_unref (header->priv->shell_player);
 		header->priv->shell_player = NULL;
 	}
@@ -596,6 +609,35 @@ rb_header_get_preferred_width (GtkWidget *widget,
 	*natural_width = 0;
 }
 
+/* only ask for frequent position updates while the header is visible */
+static void
+rb_header_map (GtkWidget *widget)
+{
+	RBHeader *header = RB_HEADER (widget);
+
+	GTK_WIDGET_CLASS (rb_header_parent_class)->map (widget);
+
+	if (header->priv->shell_player != NULL && header->priv->tick_subscription == 0) {
+		header->priv->tick_subscription =
+			rb_shell_player_add_tick_subscriber (header->priv->shell_player,
+							     HEADER_TICK_INTERVAL);
+	}
+}
+
+static void
+rb_header_unmap (GtkWidget *widget)
+{
+	RBHeader *header = RB_HEADER (widget);
+
+	if (header->priv->shell_player != NULL && header->priv->tick_subscription != 0) {
+		rb_shell_player_remove_tick_subscriber (header->priv->shell_player,
+							header->priv->tick_subscription);
+		header->priv->tick_subscription = 0;
+	}
+
+	GTK_WIDGET_CLASS (rb_header_parent_class)->unmap (widget);
+}
+
 static void
 rb_header_size_allocate (GtkWidget *widget, GtkAllocation *allocation)
 {